@@ -0,0 +1,204 @@
+// benchmarks/decoding_benchmark.cpp
+#include "streaming/client/decoder.hpp"
+#include "streaming/codec/h264_decoder.hpp"
+#include "streaming/codec/h264_encoder.hpp"
+#include "streaming/performance/parallelization.hpp"
+#include <benchmark/benchmark.h>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+using namespace streaming;
+
+namespace {
+
+constexpr int WIDTH = 1920;
+constexpr int HEIGHT = 1080;
+constexpr int SEQUENCE_FRAMES = 30; // One GOP: IDR + 29 P frames
+
+// Panning pattern, so P frames carry real (sub-pel) motion
+codec::VideoFrame make_test_frame(int index) {
+    codec::VideoFrame frame;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.stride = WIDTH;
+    frame.timestamp = index;
+    frame.data.assign(WIDTH * HEIGHT * 3 / 2, 128);
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            const double fx = x + index * 2.5, fy = y - index * 1.25;
+            frame.data[y * WIDTH + x] = static_cast<uint8_t>(
+                128 + 60 * std::sin(fx * 0.021) * std::cos(fy * 0.017) + 30 * std::sin((fx + fy) * 0.05));
+        }
+    }
+    return frame;
+}
+
+// 1080p access units, encoded once per slice count / deblocking and shared by the benchmarks
+const std::vector<std::vector<uint8_t>>& encoded_sequence(uint32_t slices, bool deblocking = true) {
+    static std::map<std::pair<uint32_t, bool>, std::vector<std::vector<uint8_t>>> sequences;
+    auto& sequence = sequences[{slices, deblocking}];
+    if (sequence.empty()) {
+        codec::H264Encoder encoder;
+        encoder.set_slice_count(slices);
+        encoder.set_deblocking(deblocking);
+        encoder.initialize(WIDTH, HEIGHT, 30, 8000000);
+        encoder.set_gop_size(SEQUENCE_FRAMES);
+        for (int i = 0; i < SEQUENCE_FRAMES; ++i) {
+            std::vector<uint8_t> output;
+            encoder.encode_frame(make_test_frame(i), output);
+            sequence.push_back(std::move(output));
+        }
+    }
+    return sequence;
+}
+
+size_t sequence_bytes(const std::vector<std::vector<uint8_t>>& sequence) {
+    size_t bytes = 0;
+    for (const auto& access_unit : sequence) {
+        bytes += access_unit.size();
+    }
+    return bytes;
+}
+
+} // namespace
+
+// 1080p decode fps; range(0) = pool threads (0 = calling thread), range(1) = slices per picture
+static void BM_H264_Decoding(benchmark::State& state) {
+    const int threads = static_cast<int>(state.range(0));
+    const auto& sequence = encoded_sequence(static_cast<uint32_t>(state.range(1)));
+
+    codec::H264Decoder decoder;
+    if (threads > 0) {
+        decoder.set_thread_pool(std::make_shared<performance::ThreadPool>(threads));
+    }
+    decoder.initialize();
+
+    // The sequence loops from its IDR, so every iteration decodes a valid picture
+    codec::VideoFrame output;
+    size_t frame_index = 0;
+    for (auto _ : state) {
+        const auto& access_unit = sequence[frame_index++ % sequence.size()];
+        if (!decoder.decode_frame(access_unit.data(), access_unit.size(), output)) {
+            state.SkipWithError("decoding failed");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data.data());
+    }
+
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+    state.counters["threads"] = threads;
+    state.counters["kB/frame"] = static_cast<double>(sequence_bytes(sequence)) / sequence.size() / 1000.0;
+}
+
+// Cost of the packed output copy: range(0) = 0 decode_frame (copy), 1 decode_picture (pooled, zero-copy)
+static void BM_H264_Decode_Output(benchmark::State& state) {
+    const bool zero_copy = state.range(0) != 0;
+    const auto& sequence = encoded_sequence(1);
+
+    codec::H264Decoder decoder;
+    decoder.initialize();
+
+    codec::VideoFrame output;
+    std::shared_ptr<codec::ReferencePicture> picture;
+    size_t frame_index = 0;
+    for (auto _ : state) {
+        const auto& access_unit = sequence[frame_index++ % sequence.size()];
+        const bool ok = zero_copy ? decoder.decode_picture(access_unit.data(), access_unit.size(), picture)
+                                  : decoder.decode_frame(access_unit.data(), access_unit.size(), output);
+        if (!ok) {
+            state.SkipWithError("decoding failed");
+            break;
+        }
+        benchmark::DoNotOptimize(zero_copy ? picture.get() : static_cast<void*>(output.data.data()));
+    }
+
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+}
+
+// Decode fps with the in-loop deblocking off / on: range(0) = deblocking. The difference is
+// the filter's share of single-threaded decoding.
+static void BM_H264_Decode_Deblocking(benchmark::State& state) {
+    const auto& sequence = encoded_sequence(1, state.range(0) != 0);
+
+    codec::H264Decoder decoder;
+    decoder.initialize();
+
+    codec::VideoFrame output;
+    size_t frame_index = 0;
+    for (auto _ : state) {
+        const auto& access_unit = sequence[frame_index++ % sequence.size()];
+        if (!decoder.decode_frame(access_unit.data(), access_unit.size(), output)) {
+            state.SkipWithError("decoding failed");
+            break;
+        }
+        benchmark::DoNotOptimize(output.data.data());
+    }
+
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+}
+
+// Frame-threaded client decoding; range(0) = frame threads (1 = serial), one picture more in
+// flight than threads so a worker never idles on the output. Single-slice pictures, the
+// parallelism comes from overlapping frames only.
+static void BM_Client_FrameThreads(benchmark::State& state) {
+    const uint32_t threads = static_cast<uint32_t>(state.range(0));
+    const auto& sequence = encoded_sequence(1);
+
+    client::Decoder::DecoderConfig config;
+    config.hardware_acceleration = false;
+    config.enable_parallel_decoding = threads > 1;
+    config.thread_count = threads;
+    config.max_concurrent_frames = threads + 1;
+
+    client::Decoder decoder;
+    decoder.initialize(config);
+
+    client::Decoder::DecodedFrame output;
+    size_t frame_index = 0;
+    int64_t frames_out = 0;
+    for (auto _ : state) {
+        const auto& access_unit = sequence[frame_index % sequence.size()];
+        if (decoder.decode_video(access_unit.data(), access_unit.size(), output, frame_index)) {
+            frames_out++;
+        }
+        frame_index++;
+        benchmark::DoNotOptimize(output.data.data());
+    }
+    while (decoder.drain_video(output)) {
+        frames_out++;
+    }
+    if (frames_out != state.iterations()) {
+        state.SkipWithError("decoding failed");
+    }
+
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+    state.counters["threads"] = threads;
+}
+
+// Register benchmarks
+BENCHMARK(BM_H264_Decoding)
+    ->Args({0, 1})
+    ->ArgsProduct({{1, 2, 4, 8}, {4}})
+    ->Args({8, 8})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_H264_Decode_Output)
+    ->DenseRange(0, 1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_H264_Decode_Deblocking)
+    ->DenseRange(0, 1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Client_FrameThreads)
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -1,68 +1,1004 @@
 // benchmarks/encoding_benchmark.cpp
 #include "streaming/performance/profiler.hpp"
+#include "streaming/codec/abr_ladder.hpp"
+#include "streaming/codec/av1_encoder.hpp"
+#include "streaming/codec/encoder_pool.hpp"
 #include "streaming/codec/h264_encoder.hpp"
+#include "streaming/codec/h265_encoder.hpp"
+#include "streaming/codec/vvc_encoder.hpp"
 #include "streaming/performance/optimizer.hpp"
+#include "streaming/performance/parallelization.hpp"
+#include "streaming/processing/av1_entropy.hpp"
+#include "streaming/processing/block_kernels.hpp"
+#include "streaming/processing/cabac_encoder.hpp"
+#include "streaming/processing/cavlc_encoder.hpp"
+#include "streaming/processing/deblocking_filter.hpp"
+#include "streaming/processing/frame_scaler.hpp"
+#include "streaming/processing/intra_prediction.hpp"
+#include "streaming/processing/motion_estimation.hpp"
+#include "streaming/processing/partition_search.hpp"
+#include "streaming/processing/vvc_entropy.hpp"
 #include <benchmark/benchmark.h>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
 #include <random>
+#include <string>
+#include <vector>
 
 using namespace streaming;
 
-static void BM_H264_Encoding(benchmark::State& state) {
+static void BM_Memory_Intensive_Operation(benchmark::State& state) {
+    performance::CacheOptimizer cache_opt;
+    const size_t size = state.range(0);
+    
+    std::vector<float> data(size);
+    
+    for (auto _ : state) {
+        PROFILE_SCOPE("MemoryIntensive");
+        
+        // Test different access patterns
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = std::sin(i * 0.1f) * std::cos(i * 0.05f);
+        }
+        
+        benchmark::DoNotOptimize(data);
+    }
+    
+    state.SetBytesProcessed(state.iterations() * size * sizeof(float));
+}
+
+// Smooth test pattern so sub-pel positions actually matter
+static std::vector<uint8_t> make_subpel_test_plane(int width, int height, double shift_x, double shift_y) {
+    std::vector<uint8_t> plane(width * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            double fx = x + shift_x, fy = y + shift_y;
+            double v = 128 + 60 * std::sin(fx * 0.21) * std::cos(fy * 0.17) + 30 * std::sin((fx + fy) * 0.05);
+            plane[y * width + x] = static_cast<uint8_t>(std::lround(v));
+        }
+    }
+    return plane;
+}
+
+// Reference suite: deterministic synthetic sequences (range(1) = 0: moving gradient,
+// 1: panning texture, 2: noise) through codec range(0) (EncoderCodec, default preset).
+// Every iteration codes the whole sequence as a new stream (reset()), so the bit and
+// quality counters do not depend on the iteration count and the JSON output of two
+// releases can be diffed:
+//   encoding_benchmark --benchmark_filter=BM_Reference_Encoding --benchmark_out=ref.json --benchmark_out_format=json
+//   compare.py benchmarks old.json ref.json   (tools/ of Google Benchmark)
+static constexpr int REFERENCE_WIDTH = 640;
+static constexpr int REFERENCE_HEIGHT = 360;
+static constexpr int REFERENCE_FRAMES = 16;
+static constexpr uint32_t REFERENCE_BITRATE = 1500000;
+
+static codec::VideoFrame make_reference_frame(int sequence, int index) {
+    const int width = REFERENCE_WIDTH, height = REFERENCE_HEIGHT;
+    codec::VideoFrame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = width;
+    frame.timestamp = index;
+    switch (sequence) {
+        case 0: {
+            // Diagonal triangle-wave ramp moving 3 pixels per frame over a vertical ramp
+            frame.data.resize(width * height);
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    const int t = (x + y / 2 + 3 * index) & 255;
+                    frame.data[y * width + x] = static_cast<uint8_t>(48 + (t < 128 ? t : 255 - t) + y * 32 / height);
+                }
+            }
+            break;
+        }
+        case 1:
+            frame.data = make_subpel_test_plane(width, height, index * 2.5, -index * 1.25);
+            break;
+        default: {
+            // Independent per frame, seeded with the frame index
+            std::mt19937 gen(static_cast<uint32_t>(index));
+            std::uniform_int_distribution<> dis(0, 255);
+            frame.data.resize(width * height);
+            for (auto& pixel : frame.data) {
+                pixel = static_cast<uint8_t>(dis(gen));
+            }
+            break;
+        }
+    }
+    frame.data.resize(width * height * 3 / 2, 128);
+    return frame;
+}
+
+static double luma_psnr(const codec::FrameView& a, const codec::FrameView& b) {
+    double squared_error = 0.0;
+    for (uint32_t y = 0; y < a.height; ++y) {
+        const uint8_t* row_a = a.luma() + static_cast<size_t>(y) * a.luma_stride();
+        const uint8_t* row_b = b.luma() + static_cast<size_t>(y) * b.luma_stride();
+        for (uint32_t x = 0; x < a.width; ++x) {
+            const double diff = static_cast<double>(row_a[x]) - row_b[x];
+            squared_error += diff * diff;
+        }
+    }
+    const double mse = squared_error / (static_cast<double>(a.width) * a.height);
+    return mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+// Mean SSIM of 8x8 windows every 4 pixels
+static double luma_ssim(const codec::FrameView& a, const codec::FrameView& b) {
+    constexpr double C1 = (0.01 * 255) * (0.01 * 255), C2 = (0.03 * 255) * (0.03 * 255);
+    double sum = 0.0;
+    int windows = 0;
+    for (uint32_t y = 0; y + 8 <= a.height; y += 4) {
+        for (uint32_t x = 0; x + 8 <= a.width; x += 4) {
+            double sa = 0, sb = 0, saa = 0, sbb = 0, sab = 0;
+            for (uint32_t j = 0; j < 8; ++j) {
+                const uint8_t* row_a = a.luma() + static_cast<size_t>(y + j) * a.luma_stride() + x;
+                const uint8_t* row_b = b.luma() + static_cast<size_t>(y + j) * b.luma_stride() + x;
+                for (int i = 0; i < 8; ++i) {
+                    sa += row_a[i];
+                    sb += row_b[i];
+                    saa += row_a[i] * row_a[i];
+                    sbb += row_b[i] * row_b[i];
+                    sab += row_a[i] * row_b[i];
+                }
+            }
+            const double mean_a = sa / 64, mean_b = sb / 64;
+            const double var_a = saa / 64 - mean_a * mean_a, var_b = sbb / 64 - mean_b * mean_b;
+            const double cov = sab / 64 - mean_a * mean_b;
+            sum += (2 * mean_a * mean_b + C1) * (2 * cov + C2) /
+                   ((mean_a * mean_a + mean_b * mean_b + C1) * (var_a + var_b + C2));
+            windows++;
+        }
+    }
+    return windows ? sum / windows : 1.0;
+}
+
+// fps counts encode time only. psnr_y / ssim_y compare the source luma with
+// IVideoEncoder::reconstructed_frame(); VVC and AV1 code open loop (no reconstruction),
+// so they report rate only. The <stage>_ms counters are HighResProfiler samples of the
+// encoders per frame (BlockCoding includes the LoopFilter running behind the rows).
+static void BM_Reference_Encoding(benchmark::State& state) {
+    static const char* const CODECS[] = {"H.264", "H.265", "VVC", "AV1"};
+    static const char* const SEQUENCES[] = {"gradient", "panning", "noise"};
+    const int sequence = static_cast<int>(state.range(1));
+    const codec::EncoderKey key{static_cast<codec::EncoderCodec>(state.range(0)), REFERENCE_WIDTH, REFERENCE_HEIGHT, 30};
+
+    auto encoder = codec::EncoderPool::create_encoder(key, REFERENCE_BITRATE);
+    if (!encoder) {
+        state.SkipWithError("encoder initialization failed");
+        return;
+    }
+    std::vector<codec::VideoFrame> frames;
+    for (int i = 0; i < REFERENCE_FRAMES; ++i) {
+        frames.push_back(make_reference_frame(sequence, i));
+    }
+    state.SetLabel(std::string(CODECS[state.range(0)]) + "/" + SEQUENCES[sequence]);
+
+    auto& profiler = performance::HighResProfiler::get_instance();
+    profiler.start_session("BM_Reference_Encoding");
+
+    std::vector<uint8_t> output;
+    uint64_t bits = 0, coded = 0, measured = 0;
+    double psnr = 0.0, ssim = 0.0;
+    for (auto _ : state) {
+        encoder->reset();
+        for (const auto& frame : frames) {
+            if (!encoder->encode_frame(frame, output)) {
+                state.SkipWithError("encode_frame failed");
+                break;
+            }
+            bits += output.size() * 8;
+            coded++;
+
+            state.PauseTiming();
+            const codec::FrameView reconstruction = encoder->reconstructed_frame();
+            if (reconstruction.luma()) {
+                const codec::FrameView source = codec::FrameView::from(frame);
+                psnr += luma_psnr(source, reconstruction);
+                ssim += luma_ssim(source, reconstruction);
+                measured++;
+            }
+            state.ResumeTiming();
+        }
+    }
+    profiler.end_session();
+
+    const double frames_coded = static_cast<double>(std::max<uint64_t>(coded, 1));
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(coded), benchmark::Counter::kIsRate);
+    state.counters["bits_per_frame"] = static_cast<double>(bits) / frames_coded;
+    if (measured > 0) {
+        state.counters["psnr_y"] = psnr / measured;
+        state.counters["ssim_y"] = ssim / measured;
+    }
+    for (const auto& stage : profiler.get_results()) {
+        state.counters[stage.name + "_ms"] = static_cast<double>(stage.total_time) / 1e6 / frames_coded;
+    }
+}
+
+static void BM_HalfPel_Plane_Build(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    auto filter = static_cast<processing::SubpelFilterType>(state.range(0));
+    auto reference = make_subpel_test_plane(width, height, 0.0, 0.0);
+    processing::HalfPelPlanes planes;
+    
+    for (auto _ : state) {
+        planes.build(reference.data(), width, width, height, filter);
+        benchmark::DoNotOptimize(planes.at(processing::HalfPelPlanes::HALF_HV, 0, 0));
+    }
+    
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+
+static void BM_Subpel_Refinement(benchmark::State& state) {
+    const int width = 640, height = 360;
+    auto filter = static_cast<processing::SubpelFilterType>(state.range(0));
+    auto reference = make_subpel_test_plane(width, height, 0.0, 0.0);
+    auto current = make_subpel_test_plane(width, height, 2.5, -1.25);
+    
+    processing::HalfPelPlanes planes;
+    planes.build(reference.data(), width, width, height, filter);
+    processing::MotionEstimator estimator;
+    
+    // Integer search once; the benchmark measures the refinement step only
+    std::vector<std::pair<int, int>> blocks;
+    std::vector<processing::MotionVector> integer_mvs;
+    for (int y = 16; y + 32 <= height; y += 16) {
+        for (int x = 16; x + 32 <= width; x += 16) {
+            blocks.emplace_back(x, y);
+            integer_mvs.push_back(estimator.estimate_diamond_search(
+                current.data(), reference.data(), width, height, x, y));
+        }
+    }
+    
+    int64_t gained = 0;
+    for (auto _ : state) {
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            auto refined = estimator.refine_subpel(current.data(), width, planes,
+                                                   blocks[i].first, blocks[i].second, integer_mvs[i]);
+            gained += integer_mvs[i].cost - refined.cost;
+            benchmark::DoNotOptimize(refined);
+        }
+    }
+    
+    // items/s -> refined blocks per second (ns per refined block = 1e9 / rate)
+    state.SetItemsProcessed(state.iterations() * blocks.size());
+    state.counters["ns_per_block"] = benchmark::Counter(
+        static_cast<double>(state.iterations() * blocks.size()),
+        benchmark::Counter::kIsRate | benchmark::Counter::kInvert, benchmark::Counter::kIs1000);
+    state.counters["cost_gain_per_block"] = static_cast<double>(gained) /
+        static_cast<double>(state.iterations() * blocks.size());
+}
+
+// fps vs threads for 1080p60 P frames; range(0) = pool threads, range(1) = slices
+static void BM_H264_Wavefront_Threads(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const int threads = static_cast<int>(state.range(0));
+    
     codec::H264Encoder encoder;
+    encoder.set_thread_pool(std::make_shared<performance::ThreadPool>(threads));
+    encoder.set_slice_count(static_cast<uint32_t>(state.range(1)));
+    encoder.initialize(width, height, 60, 8000000);
+    encoder.set_gop_size(1 << 20); // Only the first frame is IDR
+    
+    // Two shifted frames, so every iteration has real motion to search
+    std::array<codec::VideoFrame, 2> frames;
+    for (int i = 0; i < 2; ++i) {
+        frames[i].width = width;
+        frames[i].height = height;
+        frames[i].stride = width;
+        frames[i].data = make_subpel_test_plane(width, height, i * 3.0, i * -1.5);
+        frames[i].data.resize(width * height * 3 / 2, 128);
+    }
+    
+    std::vector<uint8_t> output;
+    encoder.encode_frame(frames[0], output);
+    
+    size_t frame_index = 1;
+    for (auto _ : state) {
+        encoder.encode_frame(frames[frame_index++ & 1], output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+    state.counters["threads"] = threads;
+}
+
+// VVC CTU encoding fps; range(0) = pool threads, range(1) = WPP on/off
+static void BM_VVC_Parallel_CTU(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const int threads = static_cast<int>(state.range(0));
+    
+    codec::VVCEncoder encoder;
+    encoder.set_thread_pool(std::make_shared<performance::ThreadPool>(threads));
+    encoder.set_wavefront(state.range(1) != 0);
+    encoder.initialize(width, height, 30, 4000000);
+    
     codec::VideoFrame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = width;
+    frame.data = make_subpel_test_plane(width, height, 0.0, 0.0);
+    frame.data.resize(width * height * 3 / 2, 128);
+    
+    std::vector<uint8_t> output;
+    for (auto _ : state) {
+        encoder.encode_frame(frame, output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+    state.counters["threads"] = threads;
+}
+
+// HEVC CTU encoding fps; range(0) = pool threads, range(1) = 0: WPP, 1: 4x2 tiles, 2: both
+static void BM_H265_Parallel_CTU(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const int threads = static_cast<int>(state.range(0));
+    const int mode = static_cast<int>(state.range(1));
     
-    // Create test frame
-    frame.width = 1920;
-    frame.height = 1080;
-    frame.data.resize(1920 * 1080 * 3);
+    codec::H265Encoder encoder;
+    encoder.set_thread_pool(std::make_shared<performance::ThreadPool>(threads));
+    encoder.set_wavefront(mode != 1);
+    encoder.set_tiles(mode != 0 ? 4 : 1, mode != 0 ? 2 : 1);
+    encoder.initialize(width, height, 30, 4000000);
+    encoder.set_gop_size(1 << 20); // Only the first frame is IDR
+    
+    // Two shifted frames, so every iteration has real motion to search
+    std::array<codec::VideoFrame, 2> frames;
+    for (int i = 0; i < 2; ++i) {
+        frames[i].width = width;
+        frames[i].height = height;
+        frames[i].stride = width;
+        frames[i].data = make_subpel_test_plane(width, height, i * 3.0, i * -1.5);
+        frames[i].data.resize(width * height * 3 / 2, 128);
+    }
     
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(0, 255);
+    std::vector<uint8_t> output;
+    encoder.encode_frame(frames[0], output);
     
-    for (auto& pixel : frame.data) {
-        pixel = static_cast<uint8_t>(dis(gen));
+    size_t frame_index = 1;
+    for (auto _ : state) {
+        encoder.encode_frame(frames[frame_index++ & 1], output);
+        benchmark::DoNotOptimize(output.data());
     }
     
-    performance::HighResProfiler::get_instance().start_session("H264_Benchmark");
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+    state.counters["threads"] = threads;
+}
+
+// AV1 tile-parallel fps; range(0) = pool threads, range(1) = frame height (1080 / 2160)
+static void BM_AV1_Tile_Threads(benchmark::State& state) {
+    const int threads = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const int width = height * 16 / 9;
+    
+    codec::AV1Encoder encoder;
+    encoder.set_thread_pool(std::make_shared<performance::ThreadPool>(threads));
+    encoder.set_tiles(4, 4); // 16 tiles at both sizes
+    encoder.initialize(width, height, 30, 8000000);
     
+    codec::VideoFrame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = width;
+    frame.data = make_subpel_test_plane(width, height, 0.0, 0.0);
+    frame.data.resize(width * height * 3 / 2, 128);
+    
+    std::vector<uint8_t> output;
     for (auto _ : state) {
-        performance::HighResProfiler::get_instance().begin_sample("EncodeFrame");
-        
-        std::vector<uint8_t> output;
         encoder.encode_frame(frame, output);
-        
-        performance::HighResProfiler::get_instance().end_sample();
-        
-        benchmark::DoNotOptimize(output);
+        benchmark::DoNotOptimize(output.data());
     }
     
-    performance::HighResProfiler::get_instance().end_session();
-    performance::HighResProfiler::get_instance().print_summary();
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+    state.counters["threads"] = threads;
 }
 
-static void BM_Memory_Intensive_Operation(benchmark::State& state) {
-    performance::CacheOptimizer cache_opt;
-    const size_t size = state.range(0);
+// 4-rung HEVC ladder from a 1080p source, total process CPU per source frame;
+// range(0) = 0: four independent encoders (own resize and analysis), 1: AbrLadderEncoder
+static void BM_ABR_Ladder(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const bool use_ladder = state.range(0) != 0;
+    const std::vector<codec::LadderRung> rungs = {
+        {1920, 1080, 6000000}, {1280, 720, 3000000}, {854, 480, 1500000}, {640, 360, 800000}};
     
-    std::vector<float> data(size);
+    std::array<codec::VideoFrame, 2> frames;
+    for (int i = 0; i < 2; ++i) {
+        frames[i].width = width;
+        frames[i].height = height;
+        frames[i].stride = width;
+        frames[i].data = make_subpel_test_plane(width, height, i * 3.0, i * -1.5);
+        frames[i].data.resize(width * height * 3 / 2, 128);
+    }
     
+    auto pool = std::make_shared<performance::ThreadPool>(rungs.size());
+    codec::AbrLadderEncoder ladder([] { return std::make_unique<codec::H265Encoder>(); });
+    std::vector<std::unique_ptr<codec::H265Encoder>> encoders;
+    std::vector<processing::FrameScaler> scalers(rungs.size());
+    std::vector<codec::VideoFrame> scaled(rungs.size());
+    if (use_ladder) {
+        codec::AbrLadderConfig config;
+        config.rungs = rungs;
+        ladder.set_thread_pool(pool);
+        ladder.initialize(width, height, config);
+    } else {
+        for (size_t i = 0; i < rungs.size(); ++i) {
+            encoders.push_back(std::make_unique<codec::H265Encoder>());
+            encoders[i]->initialize(rungs[i].width, rungs[i].height, 30, rungs[i].bitrate);
+            scalers[i].configure(width, height, rungs[i].width, rungs[i].height);
+            scaled[i].width = rungs[i].width;
+            scaled[i].height = rungs[i].height;
+            scaled[i].stride = rungs[i].width;
+        }
+    }
+    
+    std::vector<std::vector<uint8_t>> outputs(rungs.size());
+    size_t frame_index = 0;
     for (auto _ : state) {
-        PROFILE_SCOPE("MemoryIntensive");
-        
-        // Test different access patterns
-        for (size_t i = 0; i < size; ++i) {
-            data[i] = std::sin(i * 0.1f) * std::cos(i * 0.05f);
+        const codec::VideoFrame& frame = frames[frame_index++ & 1];
+        if (use_ladder) {
+            ladder.encode_frame(frame, outputs);
+        } else {
+            std::vector<std::future<bool>> futures;
+            for (size_t i = 0; i < rungs.size(); ++i) {
+                futures.push_back(pool->enqueue([&, i]() {
+                    if (i == 0) return encoders[i]->encode_frame(frame, outputs[i]);
+                    scalers[i].scale(frame.data.data(), width, true, scaled[i].data);
+                    return encoders[i]->encode_frame(scaled[i], outputs[i]);
+                }));
+            }
+            for (auto& future : futures) {
+                future.get();
+            }
         }
-        
-        benchmark::DoNotOptimize(data);
+        benchmark::DoNotOptimize(outputs.data());
     }
     
-    state.SetBytesProcessed(state.iterations() * size * sizeof(float));
+    state.counters["fps"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                               benchmark::Counter::kIsRate);
+}
+
+// Share of the in-loop deblocking in 1080p P-frame encoding; range(0) = 0: H.264, 1: H.265.
+// Each iteration encodes the same frame with deblocking off and on.
+static void BM_Deblocking_Share(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const bool hevc = state.range(0) != 0;
+
+    std::array<std::unique_ptr<codec::IVideoEncoder>, 2> encoders; // [0] off, [1] on
+    for (int on = 0; on < 2; ++on) {
+        if (hevc) {
+            auto encoder = std::make_unique<codec::H265Encoder>();
+            encoder->set_deblocking(on != 0);
+            encoder->initialize(width, height, 30, 4000000);
+            encoder->set_gop_size(1 << 20);
+            encoders[on] = std::move(encoder);
+        } else {
+            auto encoder = std::make_unique<codec::H264Encoder>();
+            encoder->set_deblocking(on != 0);
+            encoder->initialize(width, height, 30, 8000000);
+            encoder->set_gop_size(1 << 20);
+            encoders[on] = std::move(encoder);
+        }
+    }
+
+    std::array<codec::VideoFrame, 2> frames;
+    for (int i = 0; i < 2; ++i) {
+        frames[i].width = width;
+        frames[i].height = height;
+        frames[i].stride = width;
+        frames[i].data = make_subpel_test_plane(width, height, i * 3.0, i * -1.5);
+        frames[i].data.resize(width * height * 3 / 2, 128);
+    }
+
+    std::vector<uint8_t> output;
+    for (auto& encoder : encoders) {
+        encoder->encode_frame(frames[0], output);
+    }
+
+    std::array<double, 2> seconds{};
+    size_t frame_index = 1;
+    for (auto _ : state) {
+        const auto& frame = frames[frame_index++ & 1];
+        for (int on = 0; on < 2; ++on) {
+            const auto start = std::chrono::steady_clock::now();
+            encoders[on]->encode_frame(frame, output);
+            seconds[on] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            benchmark::DoNotOptimize(output.data());
+        }
+    }
+
+    const double frames_encoded = static_cast<double>(state.iterations());
+    state.counters["fps_off"] = frames_encoded / seconds[0];
+    state.counters["fps_on"] = frames_encoded / seconds[1];
+    state.counters["deblock_share"] = seconds[1] > 0.0 ? 1.0 - seconds[0] / seconds[1] : 0.0;
+}
+
+// Filter throughput alone: every macroblock row of a 1080p intra picture with all 8x8 blocks coded
+static void BM_H264_Deblocking_Filter(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    auto source = make_subpel_test_plane(width, height, 0.0, 0.0);
+    // Blocky copy, so the filter has edges to work on
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            source[y * width + x] = static_cast<uint8_t>((source[y * width + x] & 0xF0) + ((x >> 3) + (y >> 3)) % 7);
+        }
+    }
+
+    processing::H264DeblockingFilter filter;
+    filter.configure(width, height);
+    for (uint32_t mb_y = 0; mb_y < filter.mb_height(); ++mb_y) {
+        for (uint32_t mb_x = 0; mb_x < filter.mb_width(); ++mb_x) {
+            auto& info = filter.info(mb_x, mb_y);
+            info.intra = true;
+            info.coded = 0x0F;
+            info.qp = 30;
+        }
+    }
+
+    std::vector<uint8_t> picture(source.size());
+    for (auto _ : state) {
+        state.PauseTiming();
+        picture = source;
+        state.ResumeTiming();
+        for (uint32_t mb_y = 0; mb_y < filter.mb_height(); ++mb_y) {
+            filter.filter_row(picture.data(), width, mb_y);
+        }
+        benchmark::DoNotOptimize(picture.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * filter.mb_width() * filter.mb_height());
+}
+
+// Predictor + SATD throughput: every HEVC mode on range(0) x range(0) blocks of a 1080p
+// picture, predicted from its unfiltered neighbours
+static void BM_Intra_Predict_SATD(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const int size = static_cast<int>(state.range(0));
+    const auto picture = make_subpel_test_plane(width, height, 0.0, 0.0);
+
+    processing::IntraEdges edges;
+    alignas(32) std::array<uint8_t, 32 * 32> prediction{};
+    uint64_t satd = 0;
+    int x = size, y = size;
+    for (auto _ : state) {
+        const uint8_t* block = picture.data() + static_cast<size_t>(y) * width + x;
+        edges.load(block, width, 2 * size, 2 * size, 2 * size, 2 * size, true);
+        for (int mode = 0; mode < processing::HEVC_INTRA_MODES; ++mode) {
+            processing::predict_hevc(edges, size, mode, prediction.data(), 32);
+            satd += processing::intra_satd(block, width, prediction.data(), 32, size, size);
+        }
+        x += size;
+        if (x + 2 * size > width) {
+            x = size;
+            y += size;
+            if (y + 2 * size > height) y = size;
+        }
+    }
+    benchmark::DoNotOptimize(satd);
+
+    state.SetItemsProcessed(state.iterations() * processing::HEVC_INTRA_MODES);
+    state.SetBytesProcessed(state.iterations() * processing::HEVC_INTRA_MODES * size * size);
+}
+
+// 1080p intra frames with the per-CTU (H.264: per macroblock) mode decision time budget of
+// range(1) microseconds (0 = unlimited); range(0) = 0: H.264, 1: H.265, 2: VVC, 3: AV1.
+// modes_per_block counts the modes evaluated per 16x16 luma samples.
+static void BM_Intra_Mode_Decision(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const std::chrono::microseconds budget(state.range(1));
+
+    std::unique_ptr<codec::IVideoEncoder> encoder;
+    std::function<uint64_t()> modes_evaluated;
+    switch (state.range(0)) {
+        case 0: {
+            auto h264 = std::make_unique<codec::H264Encoder>();
+            h264->set_intra_time_budget(budget);
+            modes_evaluated = [e = h264.get()]() { return e->intra_modes_evaluated(); };
+            encoder = std::move(h264);
+            break;
+        }
+        case 1: {
+            auto h265 = std::make_unique<codec::H265Encoder>();
+            h265->set_intra_time_budget(budget);
+            modes_evaluated = [e = h265.get()]() { return e->intra_modes_evaluated(); };
+            encoder = std::move(h265);
+            break;
+        }
+        case 2: {
+            auto vvc = std::make_unique<codec::VVCEncoder>();
+            vvc->set_intra_time_budget(budget);
+            modes_evaluated = [e = vvc.get()]() { return e->intra_modes_evaluated(); };
+            encoder = std::move(vvc);
+            break;
+        }
+        default: {
+            auto av1 = std::make_unique<codec::AV1Encoder>();
+            av1->set_intra_time_budget(budget);
+            modes_evaluated = [e = av1.get()]() { return e->intra_modes_evaluated(); };
+            encoder = std::move(av1);
+            break;
+        }
+    }
+    encoder->initialize(width, height, 30, 8000000);
+    encoder->set_gop_size(1); // Every frame intra
+
+    codec::VideoFrame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = width;
+    frame.data = make_subpel_test_plane(width, height, 0.0, 0.0);
+    frame.data.resize(width * height * 3 / 2, 128);
+
+    std::vector<uint8_t> output;
+    size_t bytes = 0;
+    for (auto _ : state) {
+        encoder->encode_frame(frame, output);
+        bytes += output.size();
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    const double frames = static_cast<double>(state.iterations());
+    state.counters["fps"] = benchmark::Counter(frames, benchmark::Counter::kIsRate);
+    state.counters["bytes_per_frame"] = static_cast<double>(bytes) / frames;
+    state.counters["modes_per_block"] = static_cast<double>(modes_evaluated()) /
+                                        (frames * (width / 16) * (height / 16));
+}
+
+// Partition search statistics of one 64x64 CTU: the summed-area tables every split
+// candidate of the CTU is costed from
+static void BM_Partition_Block_Statistics(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const std::vector<uint8_t> plane = make_subpel_test_plane(width, height, 0.0, 0.0);
+    processing::BlockStatistics statistics;
+
+    int ctu = 0;
+    for (auto _ : state) {
+        const int x = (ctu % (width / 64)) * 64, y = (ctu / (width / 64) % (height / 64)) * 64;
+        statistics.compute(plane.data(), width, width, height, x, y, 64);
+        benchmark::DoNotOptimize(statistics.block(x, y, 64, 64).sse());
+        ctu++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 720p moving content (I then P frames) at partition speed preset range(1);
+// range(0) = 1: H.265, 2: VVC (complexity level mapped to the preset), 3: AV1
+static void BM_Partition_Speed_Presets(benchmark::State& state) {
+    const int width = 1280, height = 720;
+    const int speed = static_cast<int>(state.range(1));
+
+    std::unique_ptr<codec::IVideoEncoder> encoder;
+    switch (state.range(0)) {
+        case 1: {
+            auto h265 = std::make_unique<codec::H265Encoder>();
+            h265->set_speed_preset(speed);
+            encoder = std::move(h265);
+            break;
+        }
+        case 2: {
+            auto vvc = std::make_unique<codec::VVCEncoder>();
+            vvc->set_complexity_level(10 - (speed * 10 + 8) / 9);
+            encoder = std::move(vvc);
+            break;
+        }
+        default: {
+            auto av1 = std::make_unique<codec::AV1Encoder>();
+            av1->set_speed_preset(speed);
+            encoder = std::move(av1);
+            break;
+        }
+    }
+    encoder->initialize(width, height, 30, 4000000);
+
+    codec::VideoFrame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = width;
+
+    std::vector<uint8_t> output;
+    size_t bytes = 0;
+    int index = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        frame.data = make_subpel_test_plane(width, height, index * 2.5, -index * 1.25);
+        frame.data.resize(width * height * 3 / 2, 128);
+        index++;
+        state.ResumeTiming();
+
+        encoder->encode_frame(frame, output);
+        bytes += output.size();
+        benchmark::DoNotOptimize(output.data());
+    }
+
+    const double frames = static_cast<double>(state.iterations());
+    state.counters["fps"] = benchmark::Counter(frames, benchmark::Counter::kIsRate);
+    state.counters["bytes_per_frame"] = static_cast<double>(bytes) / frames;
+}
+
+// Entropy coder throughput on 64K skewed bins (P(1) = 1/8); range(0) = 0: HEVC
+// context-coded, 1: VVC context-coded (two-rate estimator), 2: bypass
+static void BM_CABAC_Encode_Bins(benchmark::State& state) {
+    const int mode = static_cast<int>(state.range(0));
+    std::vector<uint8_t> bins(1 << 16);
+    std::mt19937 gen(42);
+    for (auto& bin : bins) {
+        bin = gen() % 8 == 0;
+    }
+
+    utils::BitstreamWriter writer;
+    processing::CABACEncoder cabac;
+    processing::VVCCABACEncoder vvc_cabac;
+    for (auto _ : state) {
+        writer.clear();
+        if (mode == 0) {
+            processing::CABACEncoder::ContextModel ctx;
+            ctx.init(154, 32);
+            cabac.init_encoder(writer);
+            for (uint8_t bin : bins) {
+                cabac.encode_bit(ctx, bin);
+            }
+            cabac.encode_terminator(true);
+            cabac.flush_encoder();
+        } else if (mode == 1) {
+            vvc_cabac.init_encoder(writer, 32);
+            for (uint8_t bin : bins) {
+                vvc_cabac.encode_cbf(bin);
+            }
+            vvc_cabac.finish_substream();
+        } else {
+            cabac.init_encoder(writer);
+            for (size_t i = 0; i < bins.size(); i += 8) {
+                uint32_t value = 0;
+                for (size_t j = 0; j < 8; ++j) {
+                    value = value << 1 | bins[i + j];
+                }
+                cabac.encode_bypass_bins(value, 8);
+            }
+            cabac.encode_terminator(true);
+            cabac.flush_encoder();
+        }
+        benchmark::DoNotOptimize(writer.get_data().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(bins.size()));
+}
+
+// Rate of an intra mode candidate for RDO, all 67 VVC modes per iteration; range(0) = 0:
+// VVCRateEstimator on a copy of the contexts, 1: trial encode on the real coder with
+// checkpoint / rollback, 2: AV1 y_mode + angle_delta_y from the CDFs
+static void BM_Rate_Estimation(benchmark::State& state) {
+    static constexpr int MPM[6] = {0, 1, 50, 18, 46, 54};
+    const int mode = static_cast<int>(state.range(0));
+
+    utils::BitstreamWriter writer;
+    processing::VVCCABACEncoder cabac;
+    cabac.init_encoder(writer, 32);
+    processing::VVCRateEstimator estimator(cabac.contexts());
+    processing::AV1EntropyEncoder av1;
+
+    uint64_t total = 0;
+    for (auto _ : state) {
+        for (int candidate = 0; candidate < 67; ++candidate) {
+            if (mode == 0) {
+                estimator.reset(cabac.contexts());
+                estimator.encode_intra_luma_mode(candidate, MPM);
+                total += estimator.rate();
+            } else if (mode == 1) {
+                const processing::VVCCABACEncoder::ContextSet contexts = cabac.contexts();
+                const auto checkpoint = cabac.engine().checkpoint();
+                const uint64_t bits = cabac.engine().bits_written();
+                cabac.encode_intra_luma_mode(candidate, MPM);
+                total += cabac.engine().bits_written() - bits;
+                cabac.engine().rollback(checkpoint);
+                cabac.load_contexts(contexts);
+            } else {
+                const auto y_mode = static_cast<codec::PredictionMode>(candidate % 13);
+                total += av1.prediction_mode_rate(y_mode, false);
+                if (processing::av1_is_directional(y_mode)) {
+                    total += av1.angle_delta_rate(y_mode, candidate % 7 - 3);
+                }
+            }
+        }
+    }
+    benchmark::DoNotOptimize(total);
+    state.SetItemsProcessed(state.iterations() * 67);
+}
+
+// CAVLC residual coding of quantized 8x8 blocks (four interleaved 4x4 blocks each);
+// range(0) is the percentage of nonzero coefficients
+static void BM_CAVLC_Encode_Residual(benchmark::State& state) {
+    const int density = static_cast<int>(state.range(0));
+    std::vector<std::array<std::array<int16_t, 8>, 8>> blocks(256);
+    std::mt19937 gen(42);
+    for (auto& block : blocks) {
+        for (auto& row : block) {
+            for (auto& coefficient : row) {
+                const int magnitude = gen() % 4 == 0 ? 1 + static_cast<int>(gen() % 20) : 1;
+                coefficient = static_cast<int>(gen() % 100) < density ? (gen() & 1 ? magnitude : -magnitude) : 0;
+            }
+        }
+    }
+
+    // One macroblock row of counts, every block coded as the top-left one of a macroblock
+    std::array<uint8_t, 8 * 4> counts{};
+    processing::CAVLCCoeffCounts view{counts.data() + 4, 8, true, false};
+    processing::CAVLCEncoder cavlc;
+    utils::BitstreamWriter writer;
+    writer.reserve(1 << 20);
+    for (auto _ : state) {
+        writer.clear();
+        for (const auto& block : blocks) {
+            cavlc.encode_residual(writer, block, view, 0);
+        }
+        benchmark::DoNotOptimize(writer.get_data().data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(blocks.size()));
+    state.counters["bits/block"] = static_cast<double>(writer.bit_count()) / blocks.size();
+}
+
+// AV1 multi-symbol coding with CDF adaptation, 64K symbols of a geometric distribution;
+// range(0) is the alphabet size. items_per_second is symbols/s.
+static void BM_AV1_Symbol_Coding(benchmark::State& state) {
+    const int num_symbols = static_cast<int>(state.range(0));
+    std::vector<uint16_t> symbols(1 << 16);
+    std::mt19937 gen(42);
+    for (auto& symbol : symbols) {
+        symbol = static_cast<uint16_t>(std::min(std::countr_zero(gen() | 0x80000000u), num_symbols - 1));
+    }
+
+    processing::AV1EntropyEncoder entropy;
+    std::vector<uint8_t> output;
+    for (auto _ : state) {
+        processing::AV1EntropyEncoder::CDF cdf{};
+        for (int i = 0; i < num_symbols; ++i) {
+            cdf[i] = static_cast<uint16_t>(32768 - (i + 1) * 32768 / num_symbols);
+        }
+        entropy.init_frame();
+        for (uint16_t symbol : symbols) {
+            entropy.encode_symbol(symbol, cdf, num_symbols);
+        }
+        output.clear();
+        entropy.finish(output);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(symbols.size()));
+    state.counters["bits/symbol"] = output.size() * 8.0 / symbols.size();
+}
+
+// SAD + forward DCT + quantization of range(0) x range(0) blocks of a 1080p picture through
+// the block-size dispatch table, as a caller with a runtime block size would
+static void BM_Block_Kernels(benchmark::State& state) {
+    const int width = 1920, height = 1080;
+    const int size = static_cast<int>(state.range(0));
+    const auto current = make_subpel_test_plane(width, height, 0.0, 0.0);
+    const auto reference = make_subpel_test_plane(width, height, 1.5, 0.75);
+    const processing::BlockKernels& kernels = processing::block_kernels(processing::block_size_of(size));
+
+    std::vector<int16_t> residual(size * size);
+    std::vector<double> coeffs(size * size);
+    uint64_t sad = 0;
+    int x = 0, y = 0;
+    for (auto _ : state) {
+        const uint8_t* a = current.data() + static_cast<size_t>(y) * width + x;
+        const uint8_t* b = reference.data() + static_cast<size_t>(y) * width + x;
+        sad += kernels.sad(a, width, b, width);
+        for (int i = 0; i < size; ++i) {
+            for (int j = 0; j < size; ++j) {
+                residual[i * size + j] = static_cast<int16_t>(a[i * width + j] - b[i * width + j]);
+            }
+        }
+        kernels.fdct(residual.data(), size, coeffs.data());
+        kernels.quant(coeffs.data(), 30);
+        benchmark::DoNotOptimize(coeffs.data());
+
+        x += size;
+        if (x + size > width) {
+            x = 0;
+            y = y + 2 * size > height ? 0 : y + size;
+        }
+    }
+    benchmark::DoNotOptimize(sad);
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * size * size);
+}
+
+// Short 640x360 sessions (2 frames each) of codec range(0) (EncoderCodec);
+// range(1) = 0: a new encoder per session, 1: encoders from an EncoderPool
+static void BM_Encoder_Pool_Sessions(benchmark::State& state) {
+    const int width = 640, height = 360;
+    const codec::EncoderKey key{static_cast<codec::EncoderCodec>(state.range(0)), width, height, 30, 7};
+    const bool pooled = state.range(1) != 0;
+    auto pool = codec::EncoderPool::create(1);
+
+    codec::VideoFrame frame;
+    frame.width = width;
+    frame.height = height;
+    frame.stride = width;
+    frame.data = make_subpel_test_plane(width, height, 0.0, 0.0);
+    frame.data.resize(width * height * 3 / 2, 128);
+
+    std::vector<uint8_t> output;
+    for (auto _ : state) {
+        std::shared_ptr<codec::IVideoEncoder> encoder;
+        if (pooled) {
+            encoder = pool->acquire(key, 1000000);
+        } else {
+            encoder = codec::EncoderPool::create_encoder(key, 1000000);
+        }
+        for (int i = 0; i < 2; ++i) {
+            encoder->encode_frame(frame, output);
+            benchmark::DoNotOptimize(output.data());
+        }
+    }
+
+    const codec::EncoderPool::Stats stats = pool->stats();
+    state.counters["sessions/s"] = benchmark::Counter(static_cast<double>(state.iterations()),
+                                                      benchmark::Counter::kIsRate);
+    state.counters["hit_rate"] = stats.hit_rate();
+    state.counters["init_ms"] = stats.average_init_ms();
+    state.counters["reset_ms"] = stats.average_reset_ms();
 }
 
 // Register benchmarks
-BENCHMARK(BM_H264_Encoding)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Reference_Encoding)
+    ->ArgsProduct({{0, 1, 2, 3}, {0, 1, 2}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_HalfPel_Plane_Build)->DenseRange(0, 4)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Subpel_Refinement)->DenseRange(0, 4)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_H264_Wavefront_Threads)
+    ->ArgsProduct({{1, 2, 4, 8}, {1}})
+    ->Args({8, 4})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_VVC_Parallel_CTU)
+    ->ArgsProduct({{1, 4, 16}, {0, 1}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_H265_Parallel_CTU)
+    ->ArgsProduct({{1, 4, 16}, {0, 1, 2}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AV1_Tile_Threads)
+    ->ArgsProduct({{1, 2, 4, 8, 16}, {1080, 2160}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ABR_Ladder)
+    ->DenseRange(0, 1)
+    ->MeasureProcessCPUTime()
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Deblocking_Share)
+    ->DenseRange(0, 1)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_H264_Deblocking_Filter)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Intra_Predict_SATD)->Arg(8)->Arg(16)->Arg(32);
+BENCHMARK(BM_Intra_Mode_Decision)
+    ->ArgsProduct({{0, 1, 2, 3}, {0, 20}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Partition_Block_Statistics);
+BENCHMARK(BM_Partition_Speed_Presets)
+    ->ArgsProduct({{1, 2, 3}, {0, 5, 9}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CABAC_Encode_Bins)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Rate_Estimation)->DenseRange(0, 2);
+BENCHMARK(BM_CAVLC_Encode_Residual)->Arg(5)->Arg(25)->Arg(75);
+BENCHMARK(BM_AV1_Symbol_Coding)->Arg(2)->Arg(4)->Arg(13)->Arg(16);
+BENCHMARK(BM_Block_Kernels)->RangeMultiplier(2)->Range(4, 64);
+BENCHMARK(BM_Encoder_Pool_Sessions)
+    ->ArgsProduct({{0, 1, 2, 3}, {0, 1}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
 BENCHMARK(BM_Memory_Intensive_Operation)
     ->Range(1 << 10, 1 << 20)
     ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,146 @@
+// examples/allocation_test.cpp
+#include "streaming/codec/h264_encoder.hpp"
+#include "streaming/codec/h265_encoder.hpp"
+#include "streaming/codec/vvc_encoder.hpp"
+#include "streaming/codec/av1_encoder.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+
+using namespace streaming;
+
+// Her heap allocation'ı say
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+constexpr uint32_t WIDTH = 320;
+constexpr uint32_t HEIGHT = 192;
+constexpr uint32_t PADDED_STRIDE = 384; // Capture buffers usually have padded rows
+constexpr int WARMUP_FRAMES = 8;
+constexpr int MEASURED_FRAMES = 40;
+
+// Capture-style I420 buffer: padded luma rows, chroma planes after it
+struct CaptureBuffer {
+    std::vector<uint8_t> storage;
+    codec::FrameView view;
+};
+
+CaptureBuffer make_capture(int index) {
+    const uint32_t chroma_stride = PADDED_STRIDE / 2;
+    const size_t luma_size = static_cast<size_t>(PADDED_STRIDE) * HEIGHT;
+    const size_t chroma_size = static_cast<size_t>(chroma_stride) * (HEIGHT / 2);
+
+    CaptureBuffer buffer;
+    buffer.storage.assign(luma_size + 2 * chroma_size, 128);
+    for (uint32_t y = 0; y < HEIGHT; ++y) {
+        for (uint32_t x = 0; x < WIDTH; ++x) {
+            buffer.storage[y * PADDED_STRIDE + x] = static_cast<uint8_t>(
+                128 + 60 * std::sin((x + index * 3) * 0.1) * std::cos(y * 0.07) + (x * 7 + y * 13) % 11);
+        }
+    }
+
+    buffer.view.width = WIDTH;
+    buffer.view.height = HEIGHT;
+    buffer.view.planes[0] = {buffer.storage.data(), PADDED_STRIDE};
+    buffer.view.planes[1] = {buffer.storage.data() + luma_size, chroma_stride};
+    buffer.view.planes[2] = {buffer.storage.data() + luma_size + chroma_size, chroma_stride};
+    return buffer;
+}
+
+// The same picture as a packed VideoFrame
+codec::VideoFrame to_packed(const codec::FrameView& view) {
+    codec::VideoFrame frame;
+    frame.width = view.width;
+    frame.height = view.height;
+    frame.stride = view.width;
+    frame.timestamp = view.timestamp;
+    for (int plane = 0; plane < 3; ++plane) {
+        const uint32_t w = plane ? (view.width + 1) / 2 : view.width;
+        const uint32_t h = plane ? (view.height + 1) / 2 : view.height;
+        for (uint32_t y = 0; y < h; ++y) {
+            const uint8_t* row = view.planes[plane].data + static_cast<size_t>(y) * view.planes[plane].stride;
+            frame.data.insert(frame.data.end(), row, row + w);
+        }
+    }
+    return frame;
+}
+
+bool run(const std::string& name, const std::function<std::unique_ptr<codec::IVideoEncoder>()>& factory,
+         const std::vector<CaptureBuffer>& captures) {
+    auto encoder = factory();
+    auto reference = factory();
+    encoder->initialize(WIDTH, HEIGHT, 30, 500000);
+    reference->initialize(WIDTH, HEIGHT, 30, 500000);
+
+    std::vector<uint8_t> output;     // Reused: swapped with the encoder's bitstream buffer
+    std::vector<uint8_t> packed_output;
+    size_t worst = 0;
+    bool identical = true;
+
+    for (int f = 0; f < WARMUP_FRAMES + MEASURED_FRAMES; ++f) {
+        const codec::FrameView& view = captures[f % captures.size()].view;
+
+        const size_t before = g_allocations.load();
+        if (!encoder->encode_frame(view, output)) {
+            std::cerr << name << ": encoding failed" << std::endl;
+            return false;
+        }
+        const size_t allocations = g_allocations.load() - before;
+        if (f >= WARMUP_FRAMES) {
+            worst = std::max(worst, allocations);
+        }
+
+        // The strided view must code exactly like the packed copy of the frame
+        reference->encode_frame(to_packed(view), packed_output);
+        identical = identical && packed_output == output;
+    }
+
+    const bool ok = worst == 0 && identical;
+    std::cout << (ok ? "✅ " : "❌ ") << name << ": " << worst << " allocations per frame (max over "
+              << MEASURED_FRAMES << " frames)" << (identical ? "" : ", output differs from packed frames")
+              << std::endl;
+    return ok;
+}
+
+} // namespace
+
+int main() {
+    std::vector<CaptureBuffer> captures;
+    for (int i = 0; i < 2; ++i) {
+        captures.push_back(make_capture(i));
+    }
+
+    // Single-threaded encoding; thread pool tasks allocate their futures
+    bool ok = true;
+    ok = run("H.264", [] { return std::make_unique<codec::H264Encoder>(); }, captures) && ok;
+    ok = run("H.265", [] { return std::make_unique<codec::H265Encoder>(); }, captures) && ok;
+    ok = run("VVC", [] {
+        auto encoder = std::make_unique<codec::VVCEncoder>();
+        encoder->set_parallel_processing(false);
+        return encoder;
+    }, captures) && ok;
+    ok = run("AV1", [] { return std::make_unique<codec::AV1Encoder>(); }, captures) && ok;
+
+    std::cout << (ok ? "🎉 Steady-state encoding is allocation-free" : "Allocation test failed") << std::endl;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,355 @@
+// examples/av1_entropy_test.cpp
+#include "streaming/processing/av1_entropy.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace streaming;
+
+namespace {
+
+using Entropy = processing::AV1EntropyEncoder;
+using codec::PartitionType;
+using codec::PredictionMode;
+
+constexpr int TRIALS = 300;
+constexpr int EC_PROB_SHIFT = 6;
+constexpr int EC_MIN_PROB = 4;
+constexpr uint32_t CDF_PROB_TOP = 1u << Entropy::CDF_PROB_BITS;
+
+// Multi-symbol range decoder as in libaom's entdec.c (od_ec_dec), 64-bit window. Reads
+// zeros past the end.
+class SymbolDecoder {
+public:
+    SymbolDecoder(const uint8_t* data, size_t size) : position_(data), end_(data + size) {
+        refill();
+    }
+
+    // Inverse CDF, then the CDF adapts as in the spec's process, entry by entry
+    int decode_symbol(Entropy::CDF& cdf, int num_symbols) {
+        const uint32_t c = static_cast<uint32_t>(difference_ >> (WINDOW - 16));
+        const int n = num_symbols - 1;
+        uint32_t u = 0, v = range_;
+        int symbol = -1;
+        do {
+            u = v;
+            symbol++;
+            v = ((range_ >> 8) * (cdf[symbol] >> EC_PROB_SHIFT) >> (7 - EC_PROB_SHIFT)) + EC_MIN_PROB * (n - symbol);
+        } while (c < v);
+        normalize(difference_ - (static_cast<uint64_t>(v) << (WINDOW - 16)), u - v);
+        update_cdf(cdf, symbol, num_symbols);
+        return symbol;
+    }
+
+    bool decode_bool() {
+        const uint32_t v = ((range_ >> 8) * ((CDF_PROB_TOP / 2) >> EC_PROB_SHIFT) >> (7 - EC_PROB_SHIFT)) + EC_MIN_PROB;
+        const uint64_t threshold = static_cast<uint64_t>(v) << (WINDOW - 16);
+        if (difference_ >= threshold) {
+            normalize(difference_ - threshold, range_ - v);
+            return false;
+        }
+        normalize(difference_, v);
+        return true;
+    }
+
+    uint32_t decode_literal(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; ++i) value = (value << 1) | decode_bool();
+        return value;
+    }
+
+    uint32_t decode_golomb() {
+        int leading_zeros = 0;
+        while (!decode_bool()) leading_zeros++;
+        return ((1u << leading_zeros) | decode_literal(leading_zeros)) - 1;
+    }
+
+private:
+    static constexpr int WINDOW = 64;
+
+    static void update_cdf(Entropy::CDF& cdf, int symbol, int num_symbols) {
+        const int rate = 3 + (cdf[num_symbols] > 15) + (cdf[num_symbols] > 31) + (num_symbols > 3 ? 2 : 1);
+        uint32_t target = CDF_PROB_TOP;
+        for (int i = 0; i < num_symbols - 1; ++i) {
+            if (i == symbol) target = 0;
+            if (target < cdf[i]) {
+                cdf[i] -= static_cast<uint16_t>((cdf[i] - target) >> rate);
+            } else {
+                cdf[i] += static_cast<uint16_t>((target - cdf[i]) >> rate);
+            }
+        }
+        cdf[num_symbols] += cdf[num_symbols] < 32;
+    }
+
+    void refill() {
+        int shift = WINDOW - 9 - (count_ + 15);
+        for (; shift >= 0 && position_ < end_; shift -= 8, ++position_) {
+            difference_ ^= static_cast<uint64_t>(*position_) << shift;
+            count_ += 8;
+        }
+        if (position_ >= end_) count_ = 0x4000; // Zeros from here on
+    }
+
+    void normalize(uint64_t difference, uint32_t range) {
+        const int d = 16 - static_cast<int>(std::bit_width(range));
+        count_ -= d;
+        difference_ = ((difference + 1) << d) - 1;
+        range_ = range << d;
+        if (count_ < 0) refill();
+    }
+
+    const uint8_t* position_;
+    const uint8_t* end_;
+    uint64_t difference_ = (uint64_t{1} << (WINDOW - 1)) - 1;
+    uint32_t range_ = 0x8000;
+    int count_ = -15;
+};
+
+Entropy::CDF uniform_cdf(int num_symbols) {
+    Entropy::CDF cdf{};
+    for (int i = 0; i < num_symbols; ++i) {
+        cdf[i] = static_cast<uint16_t>(CDF_PROB_TOP - (i + 1) * CDF_PROB_TOP / num_symbols);
+    }
+    return cdf;
+}
+
+// Adaptive symbols of every alphabet size, equiprobable bools, literals and Exp-Golomb
+// codes in random order, through the range coder and back
+bool check_symbols() {
+    enum Kind { SYMBOL, BOOL, LITERAL, GOLOMB };
+    struct Symbol {
+        Kind kind;
+        uint32_t value;
+        int size; // Alphabet size or literal bits
+    };
+
+    std::mt19937 rng(7);
+    for (int trial = 0; trial < TRIALS; ++trial) {
+        // One CDF per alphabet size 2..16
+        std::vector<Entropy::CDF> cdfs, decoder_cdfs;
+        for (int size = 2; size <= Entropy::MAX_SYMBOLS; ++size) cdfs.push_back(uniform_cdf(size));
+        decoder_cdfs = cdfs;
+
+        // Skewed towards the first symbols, so the CDFs adapt far from uniform
+        std::vector<Symbol> symbols(rng() % 4000);
+        for (Symbol& symbol : symbols) {
+            symbol.kind = static_cast<Kind>(rng() % 4);
+            switch (symbol.kind) {
+            case SYMBOL:
+                symbol.size = 2 + rng() % (Entropy::MAX_SYMBOLS - 1);
+                symbol.value = rng() % 4 ? std::min<uint32_t>(std::countr_zero(rng() | 0x80000000u), symbol.size - 1)
+                                         : rng() % symbol.size;
+                break;
+            case BOOL: symbol.value = rng() & 1; break;
+            case LITERAL:
+                symbol.size = 1 + rng() % 24;
+                symbol.value = rng() & ((1u << symbol.size) - 1);
+                break;
+            case GOLOMB: symbol.value = rng() % (1u << (rng() % 20)); break;
+            }
+        }
+
+        Entropy encoder;
+        encoder.init_frame();
+        for (const Symbol& symbol : symbols) {
+            switch (symbol.kind) {
+            case SYMBOL:
+                encoder.encode_symbol(static_cast<uint16_t>(symbol.value), cdfs[symbol.size - 2], symbol.size);
+                break;
+            case BOOL: encoder.encode_bool(symbol.value); break;
+            case LITERAL: encoder.encode_literal(symbol.value, symbol.size); break;
+            case GOLOMB: encoder.encode_golomb(symbol.value); break;
+            }
+        }
+        std::vector<uint8_t> output;
+        encoder.finish(output);
+
+        SymbolDecoder decoder(output.data(), output.size());
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            const Symbol& symbol = symbols[i];
+            uint32_t value = 0;
+            switch (symbol.kind) {
+            case SYMBOL: value = decoder.decode_symbol(decoder_cdfs[symbol.size - 2], symbol.size); break;
+            case BOOL: value = decoder.decode_bool(); break;
+            case LITERAL: value = decoder.decode_literal(symbol.size); break;
+            case GOLOMB: value = decoder.decode_golomb(); break;
+            }
+            if (value != symbol.value) {
+                std::cerr << "❌ Symbol trial " << trial << ": symbol " << i << " decodes to " << value
+                          << " instead of " << symbol.value << std::endl;
+                return false;
+            }
+        }
+        if (cdfs != decoder_cdfs) {
+            std::cerr << "❌ Symbol trial " << trial << ": encoder and decoder CDFs adapted differently" << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "✅ Range coder: " << TRIALS << " random symbol sequences decode" << std::endl;
+    return true;
+}
+
+// AV1 syntax elements, decoded with the binarisations of av1_entropy.cpp
+enum Kind { PARTITION, MODE, ANGLE_DELTA, MV, DELTA_Q, COEFFS };
+struct Element {
+    Kind kind;
+    int value;
+    int param; // Block size, inter frame, directional mode or transform size
+    std::vector<std::vector<int16_t>> coeffs;
+};
+
+Element random_element(std::mt19937& rng) {
+    Element element{static_cast<Kind>(rng() % 6), 0, 0, {}};
+    switch (element.kind) {
+    case PARTITION: {
+        element.param = 8 << (rng() % 5); // 8 .. 128
+        const int num_symbols = element.param == 128 ? 8 : (element.param == 8 ? 4 : 10);
+        element.value = rng() % 2 ? 0 : rng() % num_symbols;
+        break;
+    }
+    case MODE:
+        element.param = rng() & 1;
+        element.value = rng() % (element.param ? 17 : 13);
+        break;
+    case ANGLE_DELTA:
+        element.param = 1 + rng() % 8; // V_PRED .. D67_PRED
+        element.value = static_cast<int>(rng() % 7) - 3;
+        break;
+    case MV: element.value = rng() % 3 ? static_cast<int>(rng() % 257) - 128 : 0; break;
+    case DELTA_Q: element.value = rng() % 2 ? static_cast<int>(rng() % 7) - 3 : static_cast<int>(rng() % 511) - 255; break;
+    case COEFFS: {
+        element.param = rng() % 2 ? 4 : 8;
+        const int density = rng() % 5; // 0: all zero
+        element.coeffs.assign(element.param, std::vector<int16_t>(element.param, 0));
+        for (auto& row : element.coeffs) {
+            for (int16_t& coefficient : row) {
+                if (static_cast<int>(rng() % 8) >= density) continue;
+                const int level = rng() % 4 ? 1 + rng() % 3 : 1 + rng() % 2000;
+                coefficient = static_cast<int16_t>(rng() & 1 ? -level : level);
+            }
+        }
+        break;
+    }
+    }
+    return element;
+}
+
+void encode_element(Entropy& encoder, const Element& element) {
+    switch (element.kind) {
+    case PARTITION: encoder.encode_partition_type(static_cast<PartitionType>(element.value), element.param); break;
+    case MODE: encoder.encode_prediction_mode(static_cast<PredictionMode>(element.value), element.param); break;
+    case ANGLE_DELTA: encoder.encode_angle_delta(static_cast<PredictionMode>(element.param), element.value); break;
+    case MV: encoder.encode_mv_component(static_cast<int16_t>(element.value)); break;
+    case DELTA_Q: encoder.encode_delta_qindex(element.value); break;
+    case COEFFS: encoder.encode_coeffs(element.coeffs, element.param, true); break;
+    }
+}
+
+bool decode_element(SymbolDecoder& decoder, Entropy::Contexts& contexts, const Element& element) {
+    switch (element.kind) {
+    case PARTITION: {
+        const int index = 8 - static_cast<int>(std::bit_width(static_cast<uint32_t>(element.param))); // 128 .. 8
+        const int num_symbols = index == 0 ? 8 : (index == 4 ? 4 : 10);
+        return decoder.decode_symbol(contexts.partition[index], num_symbols) == element.value;
+    }
+    case MODE: {
+        const bool is_inter = element.param && decoder.decode_symbol(contexts.is_inter, 2);
+        const int mode = is_inter ? 13 + decoder.decode_symbol(contexts.inter_mode, 4)
+                                  : decoder.decode_symbol(contexts.y_mode, 13);
+        return mode == element.value;
+    }
+    case ANGLE_DELTA:
+        return decoder.decode_symbol(contexts.angle_delta[element.param - 1], 7) - 3 == element.value;
+    case MV: {
+        int value = 0;
+        if (decoder.decode_symbol(contexts.mv_zero, 2)) {
+            const bool negative = decoder.decode_bool();
+            value = static_cast<int>(decoder.decode_golomb()) + 1;
+            if (negative) value = -value;
+        }
+        return value == element.value;
+    }
+    case DELTA_Q: {
+        uint32_t abs_delta = decoder.decode_symbol(contexts.delta_q, 4);
+        if (abs_delta == 3) {
+            const int rem_bits = static_cast<int>(decoder.decode_literal(3)) + 1;
+            abs_delta = decoder.decode_literal(rem_bits) + (1u << rem_bits) + 1;
+        }
+        const bool negative = abs_delta > 0 && decoder.decode_bool();
+        return (negative ? -static_cast<int>(abs_delta) : static_cast<int>(abs_delta)) == element.value;
+    }
+    case COEFFS: {
+        std::vector<std::vector<int16_t>> coeffs(element.param, std::vector<int16_t>(element.param, 0));
+        if (!decoder.decode_symbol(contexts.all_zero, 2)) {
+            for (int i = 0; i < element.param; ++i) {
+                for (int j = 0; j < element.param; ++j) {
+                    if (!decoder.decode_symbol(contexts.coeff_zero[std::min(i + j, 3)], 2)) continue;
+                    int level = 1;
+                    if (decoder.decode_symbol(contexts.coeff_greater1, 2)) {
+                        level = static_cast<int>(decoder.decode_golomb()) + 2;
+                    }
+                    coeffs[i][j] = static_cast<int16_t>(decoder.decode_bool() ? -level : level);
+                }
+            }
+        }
+        return coeffs == element.coeffs;
+    }
+    }
+    return false;
+}
+
+// Syntax elements over two tiles of two frames: the second frame starts from the
+// contexts the first one ended with, counters reset
+bool check_syntax() {
+    std::mt19937 rng(7);
+    for (int trial = 0; trial < TRIALS; ++trial) {
+        std::vector<Element> frames[2];
+        for (auto& elements : frames) {
+            elements.resize(rng() % 1500);
+            for (Element& element : elements) element = random_element(rng);
+        }
+
+        Entropy encoder;
+        std::vector<uint8_t> output;
+        size_t first_size = 0;
+        Entropy::Contexts contexts = Entropy::Contexts::defaults();
+        for (int frame = 0; frame < 2; ++frame) {
+            encoder.init_frame(contexts);
+            for (const Element& element : frames[frame]) encode_element(encoder, element);
+            encoder.finish(output);
+            contexts = encoder.contexts();
+            contexts.reset_counters();
+            if (frame == 0) first_size = output.size();
+        }
+
+        Entropy::Contexts decoder_contexts = Entropy::Contexts::defaults();
+        for (int frame = 0; frame < 2; ++frame) {
+            const size_t start = frame ? first_size : 0, end = frame ? output.size() : first_size;
+            SymbolDecoder decoder(output.data() + start, end - start);
+            for (size_t i = 0; i < frames[frame].size(); ++i) {
+                if (!decode_element(decoder, decoder_contexts, frames[frame][i])) {
+                    std::cerr << "❌ Syntax trial " << trial << ": element " << i << " (kind "
+                              << frames[frame][i].kind << ") of frame " << frame << " decodes wrongly" << std::endl;
+                    return false;
+                }
+            }
+            decoder_contexts.reset_counters();
+        }
+    }
+
+    std::cout << "✅ AV1 syntax: " << TRIALS << " random element sequences decode over two frames" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const bool ok = check_symbols() & check_syntax();
+    std::cout << (ok ? "🎉 AV1 entropy coding decodes with the reference decoder" : "AV1 entropy test failed")
+              << std::endl;
+    return ok ? 0 : -1;
+}
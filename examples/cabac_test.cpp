@@ -0,0 +1,340 @@
+// examples/cabac_test.cpp
+#include "streaming/processing/cabac_encoder.hpp"
+#include "streaming/processing/vvc_entropy.hpp"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace streaming;
+
+namespace {
+
+constexpr int TRIALS = 300;
+
+// rangeTabLps and transIdxLps (H.265 tables 9-52 and 9-53), kept apart from the encoder's
+// copies so the decoder below checks them too
+constexpr uint8_t RANGE_TAB_LPS[64][4] = {
+    {128, 176, 208, 240}, {128, 167, 197, 227}, {128, 158, 187, 216}, {123, 150, 178, 205},
+    {116, 142, 169, 195}, {111, 135, 160, 185}, {105, 128, 152, 175}, {100, 122, 144, 166},
+    { 95, 116, 137, 158}, { 90, 110, 130, 150}, { 85, 104, 123, 142}, { 81,  99, 117, 135},
+    { 77,  94, 111, 128}, { 73,  89, 105, 122}, { 69,  85, 100, 116}, { 66,  80,  95, 110},
+    { 62,  76,  90, 104}, { 59,  72,  86,  99}, { 56,  69,  81,  94}, { 53,  65,  77,  89},
+    { 51,  62,  73,  85}, { 48,  59,  69,  80}, { 46,  56,  66,  76}, { 43,  53,  63,  72},
+    { 41,  50,  59,  69}, { 39,  48,  56,  65}, { 37,  45,  54,  62}, { 35,  43,  51,  59},
+    { 33,  41,  48,  56}, { 32,  39,  46,  53}, { 30,  37,  43,  50}, { 29,  35,  41,  48},
+    { 27,  33,  39,  45}, { 26,  31,  37,  43}, { 24,  30,  35,  41}, { 23,  28,  33,  39},
+    { 22,  27,  32,  37}, { 21,  26,  30,  35}, { 20,  24,  29,  33}, { 19,  23,  27,  31},
+    { 18,  22,  26,  30}, { 17,  21,  25,  28}, { 16,  20,  23,  27}, { 15,  19,  22,  25},
+    { 14,  18,  21,  24}, { 14,  17,  20,  23}, { 13,  16,  19,  22}, { 12,  15,  18,  21},
+    { 12,  14,  17,  20}, { 11,  14,  16,  19}, { 11,  13,  15,  18}, { 10,  12,  15,  17},
+    { 10,  12,  14,  16}, {  9,  11,  13,  15}, {  9,  11,  12,  14}, {  8,  10,  12,  14},
+    {  8,   9,  11,  13}, {  7,   9,  11,  12}, {  7,   9,  10,  12}, {  7,   8,  10,  11},
+    {  6,   8,   9,  11}, {  6,   7,   9,  10}, {  6,   7,   8,   9}, {  2,   2,   2,   2}
+};
+
+constexpr uint8_t TRANS_IDX_LPS[64] = {
+    0, 0, 1, 2, 2, 4, 4, 5, 6, 7, 8, 9, 9, 11, 11, 12,
+    13, 13, 15, 15, 16, 16, 18, 18, 19, 19, 21, 21, 22, 22, 23, 24,
+    24, 25, 26, 26, 27, 27, 28, 29, 29, 30, 30, 30, 31, 32, 32, 33,
+    33, 33, 34, 34, 35, 35, 35, 36, 36, 36, 37, 37, 37, 38, 38, 63
+};
+
+// Arithmetic decoding engine as in 9.3.4.3, bit by bit. Reads zeros past the end.
+class ArithmeticDecoder {
+public:
+    explicit ArithmeticDecoder(const std::vector<uint8_t>& data) : data_(data) {
+        for (int i = 0; i < 9; ++i) offset_ = (offset_ << 1) | read_bit();
+    }
+
+    uint32_t range() const { return range_; }
+
+    uint32_t decode_decision(uint32_t lps_range, uint32_t mps) {
+        range_ -= lps_range;
+        uint32_t bin = mps;
+        if (offset_ >= range_) {
+            bin = 1 - mps;
+            offset_ -= range_;
+            range_ = lps_range;
+        }
+        renormalize();
+        return bin;
+    }
+
+    uint32_t decode_bypass() {
+        offset_ = (offset_ << 1) | read_bit();
+        if (offset_ >= range_) {
+            offset_ -= range_;
+            return 1;
+        }
+        return 0;
+    }
+
+    uint32_t decode_bypass_bins(int num_bins) {
+        uint32_t value = 0;
+        for (int i = 0; i < num_bins; ++i) value = (value << 1) | decode_bypass();
+        return value;
+    }
+
+    uint32_t decode_ue_bypass() {
+        int k = 0;
+        while (decode_bypass()) k++;
+        return (1u << k) - 1 + decode_bypass_bins(k);
+    }
+
+    uint32_t decode_terminate() {
+        range_ -= 2;
+        if (offset_ >= range_) return 1;
+        renormalize();
+        return 0;
+    }
+
+private:
+    uint32_t read_bit() {
+        const size_t byte = position_ / 8;
+        const uint32_t bit = byte < data_.size() ? (data_[byte] >> (7 - position_ % 8)) & 1 : 0;
+        position_++;
+        return bit;
+    }
+
+    void renormalize() {
+        while (range_ < 256) {
+            range_ <<= 1;
+            offset_ = (offset_ << 1) | read_bit();
+        }
+    }
+
+    const std::vector<uint8_t>& data_;
+    size_t position_ = 0;
+    uint32_t range_ = 510;
+    uint32_t offset_ = 0;
+};
+
+// HEVC context: 6-bit state and MPS (9.3.4.3.2)
+uint32_t decode_hevc(ArithmeticDecoder& decoder, processing::CABACEncoder::ContextModel& ctx) {
+    const uint32_t bin = decoder.decode_decision(RANGE_TAB_LPS[ctx.state][(decoder.range() >> 6) & 3], ctx.mps);
+    if (bin == ctx.mps) {
+        ctx.state = std::min<uint8_t>(ctx.state + 1, 62);
+    } else {
+        if (ctx.state == 0) ctx.mps = 1 - ctx.mps;
+        ctx.state = TRANS_IDX_LPS[ctx.state];
+    }
+    return bin;
+}
+
+// VVC context: two probability estimates of a 1 (9.3.4.3.2 of H.266)
+uint32_t decode_vvc(ArithmeticDecoder& decoder, processing::VVCCABACEncoder::ContextModel& ctx) {
+    const uint32_t state = ctx.state1 + 16u * ctx.state0;
+    const uint32_t mps = state >> 14;
+    const uint32_t q = (mps ? 32767 - state : state) >> 9;
+    const uint32_t bin = decoder.decode_decision((((decoder.range() >> 5) * q) >> 1) + 4, mps);
+    ctx.state0 = static_cast<uint16_t>(ctx.state0 - (ctx.state0 >> ctx.shift0) + ((1023 * bin) >> ctx.shift0));
+    ctx.state1 = static_cast<uint16_t>(ctx.state1 - (ctx.state1 >> ctx.shift1) + ((16383 * bin) >> ctx.shift1));
+    return bin;
+}
+
+// Context-coded, bypass, Exp-Golomb and terminating bins in random order, through the
+// HEVC engine and back
+bool check_hevc() {
+    using ContextModel = processing::CABACEncoder::ContextModel;
+    enum Kind { CONTEXT, BYPASS, BYPASS_BINS, UE_BYPASS, TERMINATE };
+    struct Symbol {
+        Kind kind;
+        uint32_t value;
+        int ctx;
+    };
+
+    std::mt19937 rng(5);
+    for (int trial = 0; trial < TRIALS; ++trial) {
+        ContextModel contexts[8];
+        for (ContextModel& ctx : contexts) ctx.init(static_cast<uint8_t>(rng()), 22 + trial % 20);
+        ContextModel decoder_contexts[8];
+        std::copy(std::begin(contexts), std::end(contexts), decoder_contexts);
+
+        // Contexts 0-3 are skewed, 4-7 near even
+        std::vector<Symbol> symbols(rng() % 3000);
+        for (Symbol& symbol : symbols) {
+            symbol.kind = static_cast<Kind>(rng() % 5);
+            symbol.ctx = rng() % 8;
+            switch (symbol.kind) {
+            case CONTEXT: symbol.value = rng() % 100 < (symbol.ctx < 4 ? 90u : 50u); break;
+            case BYPASS: symbol.value = rng() & 1; break;
+            case BYPASS_BINS: symbol.value = rng() & 0xFFFFF; break;
+            case UE_BYPASS: symbol.value = rng() % (1u << (rng() % 16)); break;
+            case TERMINATE: symbol.value = 0; break;
+            }
+        }
+
+        utils::BitstreamWriter writer;
+        processing::CABACEncoder encoder;
+        encoder.init_encoder(writer);
+        for (const Symbol& symbol : symbols) {
+            switch (symbol.kind) {
+            case CONTEXT: encoder.encode_bit(contexts[symbol.ctx], symbol.value); break;
+            case BYPASS: encoder.encode_bypass(symbol.value); break;
+            case BYPASS_BINS: encoder.encode_bypass_bins(symbol.value, 20); break;
+            case UE_BYPASS: encoder.encode_ue_bypass(symbol.value); break;
+            case TERMINATE: encoder.encode_terminator(false); break;
+            }
+        }
+        encoder.encode_terminator(true);
+        encoder.flush_encoder();
+        writer.write_trailing_bits();
+
+        ArithmeticDecoder decoder(writer.get_data());
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            const Symbol& symbol = symbols[i];
+            uint32_t value = 0;
+            switch (symbol.kind) {
+            case CONTEXT: value = decode_hevc(decoder, decoder_contexts[symbol.ctx]); break;
+            case BYPASS: value = decoder.decode_bypass(); break;
+            case BYPASS_BINS: value = decoder.decode_bypass_bins(20); break;
+            case UE_BYPASS: value = decoder.decode_ue_bypass(); break;
+            case TERMINATE: value = decoder.decode_terminate(); break;
+            }
+            if (value != symbol.value) {
+                std::cerr << "❌ HEVC trial " << trial << ": symbol " << i << " decodes to " << value
+                          << " instead of " << symbol.value << std::endl;
+                return false;
+            }
+        }
+        if (!decoder.decode_terminate()) {
+            std::cerr << "❌ HEVC trial " << trial << ": no end of slice after the last symbol" << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "✅ HEVC CABAC: " << TRIALS << " random bin sequences decode" << std::endl;
+    return true;
+}
+
+// VVC syntax elements decoded with the binarisations of H.266 7.3.11 and 9.3.3, with RDO
+// style checkpoint / rollback trials in between that must leave no trace
+bool check_vvc() {
+    using codec::VVCPartitionType;
+    enum Kind { MTT_SPLIT, INTRA_LUMA_MODE, SE_BYPASS, CBF, BYPASS_BINS };
+    struct Symbol {
+        Kind kind;
+        int value;
+    };
+    static const int MPM[6] = {0, 1, 50, 18, 46, 54};
+    // NO_SPLIT, QT, then mtt_split_cu_vertical_flag and mtt_split_cu_binary_flag
+    static const VVCPartitionType SPLITS[] = {
+        VVCPartitionType::NO_SPLIT, VVCPartitionType::QT_SPLIT,
+        VVCPartitionType::TT_HORZ_SPLIT, VVCPartitionType::BT_HORZ_SPLIT,
+        VVCPartitionType::TT_VERT_SPLIT, VVCPartitionType::BT_VERT_SPLIT};
+
+    std::mt19937 rng(5);
+    for (int trial = 0; trial < TRIALS; ++trial) {
+        std::vector<Symbol> symbols(50 + rng() % 2000);
+        for (Symbol& symbol : symbols) {
+            symbol.kind = static_cast<Kind>(rng() % 5);
+            switch (symbol.kind) {
+            case MTT_SPLIT:
+                symbol.value = static_cast<int>(rng() % 10 < 8 ? VVCPartitionType::NO_SPLIT : SPLITS[rng() % 6]);
+                break;
+            case INTRA_LUMA_MODE: symbol.value = rng() % 67; break;
+            case SE_BYPASS: symbol.value = static_cast<int>(rng() % 100) - 50; break;
+            case CBF: symbol.value = rng() & 1; break;
+            case BYPASS_BINS: symbol.value = rng() % (1 << 12); break;
+            }
+        }
+
+        utils::BitstreamWriter writer;
+        processing::VVCCABACEncoder encoder;
+        encoder.init_encoder(writer, 20 + trial % 20);
+        processing::VVCCABACEncoder::ContextSet contexts = encoder.contexts();
+
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            if (i % 7 == 3) {
+                const auto checkpoint = encoder.engine().checkpoint();
+                const auto saved = encoder.contexts();
+                for (int j = 0; j < 30; ++j) {
+                    encoder.encode_bypass_bins(rng(), 20);
+                    encoder.encode_cbf(rng() & 1);
+                }
+                encoder.engine().rollback(checkpoint);
+                encoder.load_contexts(saved);
+            }
+            const Symbol& symbol = symbols[i];
+            switch (symbol.kind) {
+            case MTT_SPLIT: encoder.encode_mtt_split(static_cast<VVCPartitionType>(symbol.value)); break;
+            case INTRA_LUMA_MODE: encoder.encode_intra_luma_mode(symbol.value, MPM); break;
+            case SE_BYPASS: encoder.encode_se_bypass(symbol.value); break;
+            case CBF: encoder.encode_cbf(symbol.value); break;
+            case BYPASS_BINS: encoder.encode_bypass_bins(symbol.value, 12); break;
+            }
+        }
+        encoder.finish_substream();
+        writer.write_trailing_bits();
+
+        ArithmeticDecoder decoder(writer.get_data());
+        for (size_t i = 0; i < symbols.size(); ++i) {
+            const Symbol& symbol = symbols[i];
+            int value = 0;
+            switch (symbol.kind) {
+            case MTT_SPLIT: {
+                int split = 0;
+                if (decode_vvc(decoder, contexts.mtt_split[0])) {
+                    split = 1;
+                    if (!decode_vvc(decoder, contexts.mtt_split[1])) {
+                        const uint32_t vertical = decode_vvc(decoder, contexts.mtt_split[2]);
+                        const uint32_t binary = decode_vvc(decoder, contexts.mtt_split[3]);
+                        split = 2 + 2 * vertical + binary;
+                    }
+                }
+                value = static_cast<int>(SPLITS[split]);
+                break;
+            }
+            case INTRA_LUMA_MODE:
+                if (decode_vvc(decoder, contexts.intra_luma_mpm)) {
+                    int index = 0;
+                    if (decode_vvc(decoder, contexts.intra_luma_not_planar)) {
+                        index = 1;
+                        while (index < 5 && decoder.decode_bypass()) index++;
+                    }
+                    value = MPM[index];
+                } else {
+                    // Truncated binary over 61 values: 5 bits, 6 for all but the first 3
+                    uint32_t remainder = decoder.decode_bypass_bins(5);
+                    if (remainder >= 3) remainder = ((remainder << 1) | decoder.decode_bypass()) - 3;
+                    int sorted[6];
+                    std::copy(MPM, MPM + 6, sorted);
+                    std::sort(sorted, sorted + 6);
+                    value = static_cast<int>(remainder);
+                    for (int mode : sorted) {
+                        if (mode <= value) value++;
+                    }
+                }
+                break;
+            case SE_BYPASS: {
+                const uint32_t code = decoder.decode_ue_bypass();
+                value = (code & 1) ? static_cast<int>((code + 1) / 2) : -static_cast<int>(code / 2);
+                break;
+            }
+            case CBF: value = static_cast<int>(decode_vvc(decoder, contexts.cbf)); break;
+            case BYPASS_BINS: value = static_cast<int>(decoder.decode_bypass_bins(12)); break;
+            }
+            if (value != symbol.value) {
+                std::cerr << "❌ VVC trial " << trial << ": symbol " << i << " decodes to " << value
+                          << " instead of " << symbol.value << std::endl;
+                return false;
+            }
+        }
+        if (!decoder.decode_terminate()) {
+            std::cerr << "❌ VVC trial " << trial << ": no end of slice after the last symbol" << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "✅ VVC CABAC: " << TRIALS << " random syntax element sequences decode" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const bool ok = check_hevc() & check_vvc();
+    std::cout << (ok ? "🎉 CABAC output decodes with the reference decoder" : "CABAC test failed") << std::endl;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,90 @@
+// examples/cavlc_round_trip_test.cpp
+#include "streaming/processing/cavlc_encoder.hpp"
+#include "streaming/processing/cavlc_decoder.hpp"
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace streaming;
+
+namespace {
+
+constexpr int BLOCKS = 200000;
+
+// The 4x4 block of the classic CAVLC walkthrough (zigzag order, nC = 0): TotalCoeff 5,
+// TrailingOnes 3, levels 1 and 3, runs 1, 0, 0, 1, 1
+constexpr int16_t EXAMPLE_BLOCK[16] = {0, 3, 0, 1, -1, -1, 0, 1};
+const std::string EXAMPLE_BITS = "000010001110010111101101";
+
+bool check_example() {
+    utils::BitstreamWriter writer;
+    processing::CAVLCEncoder::encode_block(writer, EXAMPLE_BLOCK, 0);
+
+    std::string bits;
+    const auto& data = writer.get_data();
+    for (size_t i = 0; i < writer.bit_count(); ++i) {
+        bits += ((data[i / 8] >> (7 - i % 8)) & 1) ? '1' : '0';
+    }
+    if (bits != EXAMPLE_BITS) {
+        std::cerr << "❌ Example block coded as " << bits << ", expected " << EXAMPLE_BITS << std::endl;
+        return false;
+    }
+    std::cout << "✅ Example block matches the reference bits" << std::endl;
+    return true;
+}
+
+// Random blocks of every density and magnitude (escape codes included) under every nC
+// table, decoded back
+bool check_round_trip() {
+    std::mt19937 rng(1);
+    int failures = 0;
+    for (int block = 0; block < BLOCKS; ++block) {
+        int16_t coefficients[16] = {};
+        const int density = rng() % 17;
+        const int magnitude = 1 << (rng() % 16);
+        for (int16_t& coefficient : coefficients) {
+            if (static_cast<int>(rng() % 16) >= density) continue;
+            int value = std::min(static_cast<int>(rng() % magnitude) + 1, 32767);
+            if (rng() % 3 == 0) value = 1; // Trailing ones
+            coefficient = static_cast<int16_t>((rng() & 1) ? -value : value);
+        }
+        const int nc = rng() % 20;
+
+        utils::BitstreamWriter writer;
+        processing::CAVLCEncoder::encode_block(writer, coefficients, nc);
+        writer.write_trailing_bits();
+
+        const auto& data = writer.get_data();
+        utils::BitstreamReader reader(data.data(), data.size());
+        int16_t decoded[16] = {};
+        try {
+            processing::CAVLCDecoder::decode_block(reader, decoded, nc);
+        } catch (const std::exception& e) {
+            if (failures++ < 5) {
+                std::cerr << "❌ Block " << block << " (nC " << nc << "): " << e.what() << std::endl;
+            }
+            continue;
+        }
+        if (!std::equal(coefficients, coefficients + 16, decoded)) {
+            if (failures++ < 5) {
+                std::cerr << "❌ Block " << block << " (nC " << nc << ") decodes to different coefficients" << std::endl;
+            }
+        }
+    }
+
+    if (failures) {
+        std::cerr << "❌ " << failures << " of " << BLOCKS << " blocks failed the round trip" << std::endl;
+        return false;
+    }
+    std::cout << "✅ " << BLOCKS << " random blocks decode to the coded coefficients" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main() {
+    const bool ok = check_example() & check_round_trip();
+    std::cout << (ok ? "🎉 CAVLC round trip passed" : "CAVLC round trip test failed") << std::endl;
+    return ok ? 0 : -1;
+}
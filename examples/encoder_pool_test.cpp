@@ -0,0 +1,198 @@
+// examples/encoder_pool_test.cpp
+#include "streaming/codec/encoder_pool.hpp"
+#include "streaming/codec/h264_encoder.hpp"
+#include "streaming/codec/h265_encoder.hpp"
+#include "streaming/codec/rate_control.hpp"
+#include "streaming/video/low_latency_encoder.hpp"
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace streaming;
+
+namespace {
+
+constexpr uint32_t WIDTH = 320;
+constexpr uint32_t HEIGHT = 192;
+constexpr uint32_t BITRATE = 800000;
+constexpr int FRAMES = 6; // IDR + P frames
+
+// Panning texture, so P frames carry real motion
+codec::VideoFrame make_frame(int index, int seed) {
+    codec::VideoFrame frame;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.stride = WIDTH;
+    frame.timestamp = index;
+    frame.data.assign(WIDTH * HEIGHT * 3 / 2, 128);
+    for (uint32_t y = 0; y < HEIGHT; ++y) {
+        for (uint32_t x = 0; x < WIDTH; ++x) {
+            const double fx = x + index * 2.5 + seed, fy = y - index * 1.25;
+            frame.data[y * WIDTH + x] = static_cast<uint8_t>(
+                128 + 60 * std::sin(fx * 0.11) * std::cos(fy * 0.07) + (x * 7 + y * 13) % 11);
+        }
+    }
+    return frame;
+}
+
+// Access units of the whole sequence, concatenated
+bool encode(codec::IVideoEncoder& encoder, int seed, std::vector<uint8_t>& stream) {
+    stream.clear();
+    std::vector<uint8_t> output;
+    for (int i = 0; i < FRAMES; ++i) {
+        if (!encoder.encode_frame(make_frame(i, seed), output)) {
+            return false;
+        }
+        stream.insert(stream.end(), output.begin(), output.end());
+    }
+    return true;
+}
+
+// Everything a session can change through the interface, and some codec settings
+void change_settings(codec::IVideoEncoder& encoder, const std::shared_ptr<int>& slices_seen) {
+    codec::RateControlConfig config;
+    config.mode = codec::RateControlMode::VBR;
+    config.bitrate = 300000;
+    config.vbv_buffer_size = 150000;
+    config.lookahead_frames = 4;
+    encoder.set_rate_control(config);
+    encoder.rate_control().set_qp_range(30, 45);
+    encoder.set_gop_size(2);
+    encoder.set_intra_refresh(3);
+    encoder.set_speed_preset(0);
+    encoder.set_slice_output([slices_seen](const uint8_t*, size_t) { ++*slices_seen; });
+
+    if (auto* h264 = dynamic_cast<codec::H264Encoder*>(&encoder)) {
+        h264->set_slice_count(3);
+        h264->set_deblocking(false);
+        h264->set_max_reference_frames(2);
+    } else if (auto* h265 = dynamic_cast<codec::H265Encoder*>(&encoder)) {
+        h265->set_tiles(2, 2);
+        h265->set_wavefront(false);
+    }
+}
+
+// A re-acquired encoder must code like a fresh one, whatever the previous session set
+bool run(const std::string& name, codec::EncoderCodec codec_type) {
+    const codec::EncoderKey key{codec_type, WIDTH, HEIGHT, 30, 7};
+
+    std::vector<uint8_t> reference, stream;
+    auto fresh = codec::EncoderPool::create_encoder(key, BITRATE);
+    if (!fresh || !encode(*fresh, 0, reference)) {
+        std::cerr << "❌ " << name << ": encoding with a fresh encoder failed" << std::endl;
+        return false;
+    }
+
+    auto pool = codec::EncoderPool::create(1);
+    auto slices_seen = std::make_shared<int>(0);
+    {
+        auto encoder = pool->acquire(key, 2000000);
+        if (!encoder) {
+            std::cerr << "❌ " << name << ": acquire failed" << std::endl;
+            return false;
+        }
+        change_settings(*encoder, slices_seen);
+        if (!encode(*encoder, 1, stream)) {
+            std::cerr << "❌ " << name << ": encoding with changed settings failed" << std::endl;
+            return false;
+        }
+    }
+    const int slices_before_release = *slices_seen;
+
+    auto encoder = pool->acquire(key, BITRATE);
+    if (!encoder || pool->stats().hits != 1) {
+        std::cerr << "❌ " << name << ": the released encoder was not reused" << std::endl;
+        return false;
+    }
+    if (!encode(*encoder, 0, stream)) {
+        std::cerr << "❌ " << name << ": encoding with the reused encoder failed" << std::endl;
+        return false;
+    }
+
+    if (*slices_seen != slices_before_release) {
+        std::cerr << "❌ " << name << ": the previous session's slice output was still called" << std::endl;
+        return false;
+    }
+    if (stream != reference) {
+        size_t offset = 0;
+        while (offset < std::min(stream.size(), reference.size()) && stream[offset] == reference[offset]) {
+            offset++;
+        }
+        std::cerr << "❌ " << name << ": reused encoder differs from a fresh one at byte " << offset << " ("
+                  << stream.size() << " vs " << reference.size() << " bytes)" << std::endl;
+        return false;
+    }
+
+    std::cout << "✅ " << name << ": reused encoder identical to a fresh one, " << reference.size() << " bytes"
+              << std::endl;
+    return true;
+}
+
+// A LowLatencyEncoder around a pooled encoder hands it back with its own settings once
+// it is gone, and its slice output is no longer called
+bool run_low_latency(const std::string& name, codec::EncoderCodec codec_type) {
+    const codec::EncoderKey key{codec_type, WIDTH, HEIGHT, 30, 7};
+    auto pool = codec::EncoderPool::create(1);
+    auto encoder = pool->acquire(key, BITRATE);
+    if (!encoder) {
+        std::cerr << "❌ " << name << ": acquire failed" << std::endl;
+        return false;
+    }
+    const codec::RateControlConfig rate_control = encoder->rate_control().config();
+    const uint32_t intra_refresh_period = encoder->intra_refresh_period();
+    const int speed_preset = encoder->speed_preset();
+
+    auto slices_seen = std::make_shared<int>(0);
+    {
+        video::LowLatencyEncoder low_latency;
+        video::LowLatencyEncoder::LowLatencyConfig config;
+        config.max_encoding_time_ms = 1; // Under time pressure: preset and QP floor go up
+        config.intra_refresh_period = 4;
+        config.speed_preset = 2;
+        low_latency.set_slice_output([slices_seen](const uint8_t*, size_t) { ++*slices_seen; });
+        if (!low_latency.initialize(encoder, config)) {
+            std::cerr << "❌ " << name << ": LowLatencyEncoder initialization failed" << std::endl;
+            return false;
+        }
+        std::vector<uint8_t> output;
+        bool dropped = false;
+        for (int i = 0; i < FRAMES; ++i) {
+            if (!low_latency.encode_frame_low_latency(make_frame(i, 0), output, dropped)) {
+                std::cerr << "❌ " << name << ": low latency encoding failed" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    const int slices_before = *slices_seen;
+    std::vector<uint8_t> stream;
+    if (!encode(*encoder, 0, stream) || *slices_seen != slices_before) {
+        std::cerr << "❌ " << name << ": the LowLatencyEncoder's slice output is still called" << std::endl;
+        return false;
+    }
+    if (!(encoder->rate_control().config() == rate_control) ||
+        encoder->intra_refresh_period() != intra_refresh_period || encoder->speed_preset() != speed_preset) {
+        std::cerr << "❌ " << name << ": settings of the LowLatencyEncoder stay with the encoder" << std::endl;
+        return false;
+    }
+
+    std::cout << "✅ " << name << ": LowLatencyEncoder restores the encoder's settings" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main() {
+    bool ok = true;
+    ok = run("H.264", codec::EncoderCodec::H264) && ok;
+    ok = run("H.265", codec::EncoderCodec::H265) && ok;
+    ok = run("VVC", codec::EncoderCodec::VVC) && ok;
+    ok = run("AV1", codec::EncoderCodec::AV1) && ok;
+    ok = run_low_latency("H.264", codec::EncoderCodec::H264) && ok;
+    ok = run_low_latency("H.265", codec::EncoderCodec::H265) && ok;
+
+    std::cout << (ok ? "🎉 Pooled encoders start every session fresh" : "Encoder pool test failed") << std::endl;
+    return ok ? 0 : -1;
+}
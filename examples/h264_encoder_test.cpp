@@ -2,62 +2,120 @@
 #include "streaming/codec/h264_encoder.hpp"
 #include "streaming/codec/h264_decoder.hpp"
 #include <chrono>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <iostream>
 
 using namespace streaming;
 
+namespace {
+
+constexpr uint32_t WIDTH = 1920;
+constexpr uint32_t HEIGHT = 1080;
+constexpr int FRAMES = 8;           // IDR + P frames
+constexpr double MIN_PSNR = 30.0;   // Per frame, luma against the source
+
+// Smooth diagonal gradient moving 4 pixels per frame
+codec::VideoFrame make_frame(int index) {
+    codec::VideoFrame frame;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.stride = WIDTH;
+    frame.timestamp = index;
+    frame.data.resize(WIDTH * HEIGHT * 3 / 2, 128);
+    for (uint32_t y = 0; y < HEIGHT; ++y) {
+        for (uint32_t x = 0; x < WIDTH; ++x) {
+            frame.data[y * WIDTH + x] = static_cast<uint8_t>((x + y + 4 * index) * 255 / (WIDTH + HEIGHT + 4 * FRAMES));
+        }
+    }
+    return frame;
+}
+
+} // namespace
+
 int main() {
     try {
         // Encoder'ı başlat
         codec::H264Encoder encoder;
-        if (!encoder.initialize(1920, 1080, 30, 4000000)) {
+        if (!encoder.initialize(WIDTH, HEIGHT, 30, 4000000)) {
             std::cerr << "Encoder initialization failed!" << std::endl;
             return -1;
         }
-        
-        // Test frame oluştur (gradient pattern)
-        codec::VideoFrame frame;
-        frame.width = 1920;
-        frame.height = 1080;
-        frame.data.resize(1920 * 1080);
-        
-        for (int y = 0; y < 1080; ++y) {
-            for (int x = 0; x < 1920; ++x) {
-                frame.data[y * 1920 + x] = static_cast<uint8_t>((x + y) % 256);
-            }
-        }
-        
-        std::cout << "🎥 Encoding test frame..." << std::endl;
-        
-        // Encode et
-        auto start = std::chrono::high_resolution_clock::now();
-        
+
+        codec::H264Decoder decoder;
+        decoder.initialize();
+
+        std::ofstream file("encoded_frame.h264", std::ios::binary);
         std::vector<uint8_t> encoded_data;
-        if (!encoder.encode_frame(frame, encoded_data)) {
-            std::cerr << "Encoding failed!" << std::endl;
-            return -1;
+        codec::VideoFrame decoded;
+        size_t total_bytes = 0;
+        double min_psnr = 99.0;
+
+        std::cout << "🎥 Encoding " << FRAMES << " test frames..." << std::endl;
+
+        for (int i = 0; i < FRAMES; ++i) {
+            const codec::VideoFrame frame = make_frame(i);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            if (!encoder.encode_frame(frame, encoded_data)) {
+                std::cerr << "Encoding failed at frame " << i << "!" << std::endl;
+                return -1;
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+            // Encoded datayı dosyaya yaz (analiz için)
+            file.write(reinterpret_cast<const char*>(encoded_data.data()), encoded_data.size());
+            total_bytes += encoded_data.size();
+
+            // Decoder'dan geri oku: it has to see exactly what the encoder reconstructed
+            if (!decoder.decode_frame(encoded_data.data(), encoded_data.size(), decoded) ||
+                decoded.width != frame.width || decoded.height != frame.height) {
+                std::cerr << "❌ Decoding failed at frame " << i << std::endl;
+                return -1;
+            }
+            const codec::FrameView reconstruction = encoder.reconstructed_frame();
+            for (uint32_t y = 0; y < HEIGHT; ++y) {
+                if (std::memcmp(decoded.data.data() + static_cast<size_t>(y) * decoded.stride,
+                                reconstruction.luma() + static_cast<size_t>(y) * reconstruction.luma_stride(), WIDTH) != 0) {
+                    std::cerr << "❌ Frame " << i << ": decoded luma differs from the encoder's reconstruction at row "
+                              << y << std::endl;
+                    return -1;
+                }
+            }
+
+            double squared_error = 0.0;
+            for (uint32_t y = 0; y < HEIGHT; ++y) {
+                for (uint32_t x = 0; x < WIDTH; ++x) {
+                    const double diff = static_cast<double>(decoded.data[y * decoded.stride + x]) - frame.data[y * WIDTH + x];
+                    squared_error += diff * diff;
+                }
+            }
+            const double mse = squared_error / (WIDTH * HEIGHT);
+            const double psnr = mse > 0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+            min_psnr = std::min(min_psnr, psnr);
+
+            std::cout << "   Frame " << i << ": " << encoded_data.size() << " bytes, "
+                      << duration.count() << " μs, PSNR " << psnr << " dB" << std::endl;
         }
-        
-        auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-        
+
         std::cout << "✅ Encoding successful!" << std::endl;
-        std::cout << "Original size: " << (1920 * 1080) << " bytes" << std::endl;
-        std::cout << "Encoded size: " << encoded_data.size() << " bytes" << std::endl;
-        std::cout << "Compression ratio: " << (1920.0 * 1080 / encoded_data.size()) << ":1" << std::endl;
-        std::cout << "Encoding time: " << duration.count() << " μs" << std::endl;
-        
-        // Encoded datayı dosyaya yaz (analiz için)
-        std::ofstream file("encoded_frame.h264", std::ios::binary);
-        file.write(reinterpret_cast<const char*>(encoded_data.data()), encoded_data.size());
-        file.close();
-        
+        std::cout << "Original size: " << (static_cast<size_t>(WIDTH) * HEIGHT * FRAMES) << " bytes" << std::endl;
+        std::cout << "Encoded size: " << total_bytes << " bytes" << std::endl;
+        std::cout << "Compression ratio: " << (static_cast<double>(WIDTH) * HEIGHT * FRAMES / total_bytes) << ":1" << std::endl;
         std::cout << "💾 Encoded data saved to encoded_frame.h264" << std::endl;
-        
+
+        if (min_psnr < MIN_PSNR) {
+            std::cerr << "❌ Minimum PSNR " << min_psnr << " dB is below " << MIN_PSNR << " dB" << std::endl;
+            return -1;
+        }
+        std::cout << "✅ Decoding matches the encoder's reconstruction, minimum PSNR: " << min_psnr << " dB" << std::endl;
+
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return -1;
     }
-    
+
     return 0;
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 // examples/latency_measurement_test.cpp
 #include "streaming/engine/latency_analyzer.hpp"
+#include "streaming/codec/h264_encoder.hpp"
 #include "streaming/video/low_latency_encoder.hpp"
 #include "streaming/audio/low_latency_processor.hpp"
 #include <chrono>
@@ -17,15 +18,25 @@ private:
     
 public:
     bool initialize() {
-        // Video encoder setup
+        // Video encoder setup: 720p H.264, each of 4 slices sent as soon as it is coded
+        auto h264 = std::make_shared<codec::H264Encoder>();
+        h264->set_slice_count(4);
+        if (!h264->initialize(1280, 720, 30, 2500000)) {
+            return false;
+        }
+        
         video::LowLatencyEncoder::LowLatencyConfig video_config;
         video_config.max_encoding_time_ms = 10;  // 10ms max encoding
         video_config.target_frame_size_ms = 8;   // 125 FPS target
         video_config.enable_frame_dropping = true;
+        video_config.intra_refresh_period = 30;  // No keyframe spikes after the first
         
-        if (!video_encoder_.initialize(video_config)) {
+        if (!video_encoder_.initialize(h264, video_config)) {
             return false;
         }
+        video_encoder_.set_slice_output([this](const uint8_t*, size_t) {
+            latency_analyzer_.mark_stage("video_slice", frame_id_);
+        });
         
         // Audio processor setup
         audio::LowLatencyAudioProcessor::AudioLatencyConfig audio_config;
@@ -73,7 +84,12 @@ private:
     void process_video_pipeline() {
         latency_analyzer_.mark_stage("video_start", frame_id_);
         
-        VideoFrame frame;
+        codec::VideoFrame frame;
+        frame.width = 1280;
+        frame.height = 720;
+        frame.stride = 1280;
+        frame.timestamp = frame_id_ * 33333;
+        frame.data.assign(1280 * 720 * 3 / 2, 128);
         std::vector<uint8_t> encoded;
         bool dropped = false;
         
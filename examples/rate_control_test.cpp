@@ -0,0 +1,111 @@
+// examples/rate_control_test.cpp
+#include "streaming/codec/h264_encoder.hpp"
+#include "streaming/codec/h265_encoder.hpp"
+#include "streaming/codec/vvc_encoder.hpp"
+#include "streaming/codec/av1_encoder.hpp"
+#include "streaming/codec/rate_control.hpp"
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <tuple>
+
+using namespace streaming;
+
+namespace {
+
+constexpr uint32_t WIDTH = 320;
+constexpr uint32_t HEIGHT = 180;
+constexpr uint32_t FPS = 30;
+constexpr int FRAMES = 300; // ABR corrects towards the average over seconds
+constexpr uint32_t BITRATE = 250000;
+constexpr double TOLERANCE = 0.1; // Of the target, over the whole sequence
+
+using Factory = std::function<std::unique_ptr<codec::IVideoEncoder>()>;
+
+// Panning noisy texture: P frames carry real motion and a residual at every QP
+codec::VideoFrame make_frame(int index) {
+    codec::VideoFrame frame;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.stride = WIDTH;
+    frame.timestamp = index;
+    frame.data.assign(WIDTH * HEIGHT * 3 / 2, 128);
+    for (uint32_t y = 0; y < HEIGHT; ++y) {
+        for (uint32_t x = 0; x < WIDTH; ++x) {
+            const uint32_t px = x + index * 3, py = y + index;
+            const uint32_t hash = (px * 73856093u) ^ (py * 19349663u);
+            frame.data[y * WIDTH + x] = static_cast<uint8_t>(
+                128 + 60 * std::sin(px * 0.11) * std::cos(py * 0.07) + (hash >> 7) % 24);
+        }
+    }
+    return frame;
+}
+
+// The coded sequence must average the target bitrate without underflowing the VBV.
+// With residual_coded false the encoder's size hardly depends on QP, it only has to
+// stay under the target.
+bool run(const std::string& name, const Factory& factory, bool residual_coded, codec::RateControlMode mode,
+         const std::vector<codec::VideoFrame>& frames) {
+    const std::string label = name + (mode == codec::RateControlMode::CBR ? " CBR" : " ABR");
+    auto encoder = factory();
+    if (!encoder->initialize(WIDTH, HEIGHT, FPS, BITRATE)) {
+        std::cerr << "❌ " << label << ": initialization failed" << std::endl;
+        return false;
+    }
+    codec::RateControlConfig config = encoder->rate_control().config();
+    config.mode = mode;
+    config.bitrate = BITRATE;
+    encoder->set_rate_control(config);
+
+    size_t bytes = 0;
+    std::vector<uint8_t> output;
+    for (const auto& frame : frames) {
+        if (!encoder->encode_frame(frame, output)) {
+            std::cerr << "❌ " << label << ": encoding failed" << std::endl;
+            return false;
+        }
+        bytes += output.size();
+    }
+
+    const double bitrate = bytes * 8.0 * FPS / frames.size();
+    const double error = bitrate / BITRATE - 1.0;
+    const uint32_t underflows = encoder->rate_control().vbv_underflows();
+    if ((residual_coded ? std::abs(error) : error) > TOLERANCE || underflows > 0) {
+        std::cerr << "❌ " << label << ": " << bitrate / 1000 << " kbps for a " << BITRATE / 1000
+                  << " kbps target, " << underflows << " VBV underflows" << std::endl;
+        return false;
+    }
+
+    std::cout << "✅ " << label << ": " << bitrate / 1000 << " kbps for a " << BITRATE / 1000
+              << " kbps target (" << (error >= 0 ? "+" : "") << error * 100 << "%), no VBV underflow" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main() {
+    std::vector<codec::VideoFrame> frames;
+    for (int i = 0; i < FRAMES; ++i) {
+        frames.push_back(make_frame(i));
+    }
+
+    // VVCEncoder codes no residual yet (partitions and modes only)
+    const std::tuple<std::string, Factory, bool> encoders[] = {
+        {"H.264", [] { return std::make_unique<codec::H264Encoder>(); }, true},
+        {"H.265", [] { return std::make_unique<codec::H265Encoder>(); }, true},
+        {"VVC", [] { return std::make_unique<codec::VVCEncoder>(); }, false},
+        {"AV1", [] { return std::make_unique<codec::AV1Encoder>(); }, true},
+    };
+
+    bool ok = true;
+    for (const auto& [name, factory, residual_coded] : encoders) {
+        for (auto mode : {codec::RateControlMode::CBR, codec::RateControlMode::VBR}) {
+            ok = run(name, factory, residual_coded, mode, frames) && ok;
+        }
+    }
+
+    std::cout << (ok ? "🎉 Rate control hits its targets" : "Rate control test failed") << std::endl;
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,148 @@
+// examples/thread_determinism_test.cpp
+#include "streaming/codec/h264_encoder.hpp"
+#include "streaming/codec/h265_encoder.hpp"
+#include "streaming/codec/vvc_encoder.hpp"
+#include "streaming/codec/av1_encoder.hpp"
+#include "streaming/performance/parallelization.hpp"
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace streaming;
+
+namespace {
+
+constexpr uint32_t WIDTH = 640;
+constexpr uint32_t HEIGHT = 360;
+constexpr int FRAMES = 6; // IDR + P frames
+constexpr size_t THREAD_COUNTS[] = {0, 1, 4}; // 0 = no pool, rows / tiles on the calling thread
+
+using Factory = std::function<std::unique_ptr<codec::IVideoEncoder>(std::shared_ptr<performance::ThreadPool>)>;
+
+// Panning texture, so P frames carry real motion
+codec::VideoFrame make_frame(int index) {
+    codec::VideoFrame frame;
+    frame.width = WIDTH;
+    frame.height = HEIGHT;
+    frame.stride = WIDTH;
+    frame.timestamp = index;
+    frame.data.assign(WIDTH * HEIGHT * 3 / 2, 128);
+    for (uint32_t y = 0; y < HEIGHT; ++y) {
+        for (uint32_t x = 0; x < WIDTH; ++x) {
+            const double fx = x + index * 2.5, fy = y - index * 1.25;
+            frame.data[y * WIDTH + x] = static_cast<uint8_t>(
+                128 + 60 * std::sin(fx * 0.11) * std::cos(fy * 0.07) + (x * 7 + y * 13) % 11);
+        }
+    }
+    return frame;
+}
+
+// Access units of the whole sequence, concatenated
+bool encode(const Factory& factory, size_t threads, const std::vector<codec::VideoFrame>& frames,
+            std::vector<uint8_t>& stream) {
+    auto pool = threads ? std::make_shared<performance::ThreadPool>(threads) : nullptr;
+    auto encoder = factory(pool);
+    if (!encoder->initialize(WIDTH, HEIGHT, 30, 1000000)) {
+        return false;
+    }
+
+    stream.clear();
+    std::vector<uint8_t> output;
+    for (const auto& frame : frames) {
+        if (!encoder->encode_frame(frame, output)) {
+            return false;
+        }
+        stream.insert(stream.end(), output.begin(), output.end());
+    }
+    return true;
+}
+
+// The bitstream must not depend on the number of threads
+bool run(const std::string& name, const Factory& factory, const std::vector<codec::VideoFrame>& frames) {
+    std::vector<uint8_t> reference, stream;
+    if (!encode(factory, THREAD_COUNTS[0], frames, reference)) {
+        std::cerr << "❌ " << name << ": encoding failed" << std::endl;
+        return false;
+    }
+
+    for (size_t i = 1; i < std::size(THREAD_COUNTS); ++i) {
+        if (!encode(factory, THREAD_COUNTS[i], frames, stream)) {
+            std::cerr << "❌ " << name << ": encoding failed with " << THREAD_COUNTS[i] << " threads" << std::endl;
+            return false;
+        }
+        if (stream != reference) {
+            size_t offset = 0;
+            while (offset < std::min(stream.size(), reference.size()) && stream[offset] == reference[offset]) {
+                offset++;
+            }
+            std::cerr << "❌ " << name << ": " << THREAD_COUNTS[i] << " threads differ from " << THREAD_COUNTS[0]
+                      << " at byte " << offset << " (" << stream.size() << " vs " << reference.size() << " bytes)"
+                      << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "✅ " << name << ": " << reference.size() << " bytes, identical with 0, 1 and 4 threads" << std::endl;
+    return true;
+}
+
+} // namespace
+
+int main() {
+    std::vector<codec::VideoFrame> frames;
+    for (int i = 0; i < FRAMES; ++i) {
+        frames.push_back(make_frame(i));
+    }
+
+    bool ok = true;
+    for (uint32_t slices : {1u, 4u}) {
+        for (bool wavefront : {true, false}) {
+            ok = run("H.264 " + std::to_string(slices) + " slices" + (wavefront ? ", wavefront" : ""),
+                     [=](std::shared_ptr<performance::ThreadPool> pool) {
+                         auto encoder = std::make_unique<codec::H264Encoder>();
+                         encoder->set_thread_pool(std::move(pool));
+                         encoder->set_slice_count(slices);
+                         encoder->set_wavefront(wavefront);
+                         return encoder;
+                     }, frames) && ok;
+        }
+    }
+    for (uint32_t tiles : {1u, 2u}) {
+        for (bool wavefront : {true, false}) {
+            ok = run("H.265 " + std::to_string(tiles) + "x" + std::to_string(tiles) + " tiles" +
+                     (wavefront ? ", WPP" : ""),
+                     [=](std::shared_ptr<performance::ThreadPool> pool) {
+                         auto encoder = std::make_unique<codec::H265Encoder>();
+                         encoder->set_thread_pool(std::move(pool));
+                         encoder->set_tiles(tiles, tiles);
+                         encoder->set_wavefront(wavefront);
+                         return encoder;
+                     }, frames) && ok;
+        }
+    }
+    for (bool wavefront : {true, false}) {
+        ok = run(std::string("VVC") + (wavefront ? " WPP" : ""),
+                 [=](std::shared_ptr<performance::ThreadPool> pool) {
+                     auto encoder = std::make_unique<codec::VVCEncoder>();
+                     encoder->set_parallel_processing(pool != nullptr);
+                     encoder->set_thread_pool(std::move(pool));
+                     encoder->set_wavefront(wavefront);
+                     return encoder;
+                 }, frames) && ok;
+    }
+    for (uint32_t tiles : {1u, 2u}) {
+        ok = run("AV1 " + std::to_string(tiles) + "x" + std::to_string(tiles) + " tiles",
+                 [=](std::shared_ptr<performance::ThreadPool> pool) {
+                     auto encoder = std::make_unique<codec::AV1Encoder>();
+                     encoder->set_thread_pool(std::move(pool));
+                     encoder->set_tiles(tiles, tiles);
+                     return encoder;
+                 }, frames) && ok;
+    }
+
+    std::cout << (ok ? "🎉 Bitstreams are independent of the thread count" : "Thread determinism test failed")
+              << std::endl;
+    return ok ? 0 : -1;
+}
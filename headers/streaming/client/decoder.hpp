@@ -2,14 +2,23 @@
 #pragma once
 
 #include <cstdint>
+#include <deque>
+#include <future>
 #include <vector>
 #include <memory>
 #include "streaming/codec/video_codec.hpp"
-#include "streaming/codec/audio_codec.hpp"
+#include "streaming/codec/h264_decoder.hpp"
+#include "streaming/audio/audio_codec.hpp"
+#include "streaming/performance/parallelization.hpp"
 
 namespace streaming {
 namespace client {
 
+// With enable_parallel_decoding and thread_count > 1, video is frame-threaded: up to
+// max_concurrent_frames pictures decode at once, each one starting as soon as the
+// reference rows it reads are done. Output then lags input by max_concurrent_frames - 1
+// pictures; decode_video() returns false while the pipeline fills and drain_video()
+// returns what is left at the end of the stream.
 class Decoder {
 public:
     struct DecoderConfig {
@@ -39,9 +48,11 @@ public:
                      DecodedFrame& output_frame, uint64_t timestamp);
     bool decode_audio(const uint8_t* encoded_data, size_t size,
                      audio::AudioFrame& output_frame, uint64_t timestamp);
+    // Next frame still in the frame-threading pipeline (false once it is empty)
+    bool drain_video(DecodedFrame& output_frame);
     
     // Performance optimization
-    void flush_buffers();
+    void flush_buffers(); // Drops the frames in the pipeline
     void reset();
     void set_max_decode_time(uint32_t max_time_ms);
     
@@ -49,9 +60,22 @@ public:
     bool initialize_hardware_decoder();
     bool is_hardware_accelerated() const;
 
+    bool is_frame_threaded() const { return frame_pool_ != nullptr; }
+    size_t frames_in_flight() const { return in_flight_.size(); }
+
 private:
-    bool decode_video_software(const uint8_t* data, size_t size, DecodedFrame& output);
+    // One picture of the frame-threading pipeline
+    struct PendingFrame {
+        std::unique_ptr<codec::H264Decoder::PictureJob> job;
+        std::future<bool> result;
+        uint64_t timestamp = 0;
+    };
+
+    bool decode_video_software(const uint8_t* data, size_t size, DecodedFrame& output, uint64_t timestamp);
     bool decode_video_hardware(const uint8_t* data, size_t size, DecodedFrame& output);
+    bool decode_video_threaded(const uint8_t* data, size_t size, DecodedFrame& output, uint64_t timestamp);
+    bool complete_oldest(DecodedFrame& output); // Waits for the oldest pending frame
+    static void copy_picture(const codec::ReferencePicture& picture, uint64_t timestamp, DecodedFrame& output);
     
     bool decode_audio_software(const uint8_t* data, size_t size, audio::AudioFrame& output);
     bool decode_audio_hardware(const uint8_t* data, size_t size, audio::AudioFrame& output);
@@ -59,7 +83,7 @@ private:
     DecoderConfig config_;
     
     // Video decoders
-    std::unique_ptr<codec::IVideoDecoder> h264_decoder_;
+    std::unique_ptr<codec::H264Decoder> h264_decoder_;
     std::unique_ptr<codec::IVideoDecoder> h265_decoder_;
     std::unique_ptr<codec::IVideoDecoder> av1_decoder_;
     
@@ -67,6 +91,11 @@ private:
     std::unique_ptr<audio::IAudioDecoder> opus_decoder_;
     std::unique_ptr<audio::IAudioDecoder> aac_decoder_;
     
+    // Frame threading
+    std::unique_ptr<performance::ThreadPool> frame_pool_;
+    std::deque<PendingFrame> in_flight_;                                      // Decoding order
+    std::vector<std::unique_ptr<codec::H264Decoder::PictureJob>> free_jobs_; // Reused jobs
+    
     // Hardware acceleration
     void* hardware_context_ = nullptr;
     bool hardware_initialized_ = false;
@@ -0,0 +1,86 @@
+// include/streaming/codec/abr_ladder.hpp
+#pragma once
+
+#include "video_codec.hpp"
+#include "rate_control.hpp"
+#include "frame_analysis.hpp"
+#include "../processing/frame_scaler.hpp"
+#include "../performance/parallelization.hpp"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace streaming {
+namespace codec {
+
+struct LadderRung {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t bitrate = 0;
+};
+
+struct AbrLadderConfig {
+    std::vector<LadderRung> rungs;   // Highest resolution first
+    uint32_t fps = 30;
+    uint32_t gop_size = 60;
+    RateControlConfig rate_control;  // Mode / VBV / AQ / scene cut for every rung; bitrate from the rung
+};
+
+// Encodes all renditions of an ABR ladder (e.g. HlsHandler::HlsConfig::bitrate_levels)
+// from one source. The source is resized once per rung; the pre-analysis (complexity,
+// AQ offsets, motion and intra hints) runs once at the top rung and is scaled to the
+// others, which use it for rate control and as motion search start. Keyframes are
+// decided by the ladder, so every rendition has its IDRs on the same frames and the
+// segments can switch between them.
+class AbrLadderEncoder {
+public:
+    using EncoderFactory = std::function<std::unique_ptr<IVideoEncoder>()>;
+
+    explicit AbrLadderEncoder(EncoderFactory factory);
+
+    bool initialize(uint32_t source_width, uint32_t source_height, const AbrLadderConfig& config);
+
+    // outputs[i] = access unit of rung i. Reusing the same outputs every frame keeps the
+    // renditions allocation-free (IVideoEncoder::encode_frame(const FrameView&, ...)).
+    bool encode_frame(const VideoFrame& input, std::vector<std::vector<uint8_t>>& outputs);
+    bool encode_frame(const FrameView& input, std::vector<std::vector<uint8_t>>& outputs);
+
+    // Renditions are encoded in parallel on this pool. It must not be the pool of the
+    // rung encoders' own CTU / tile threading (those tasks would wait behind the renditions).
+    void set_thread_pool(std::shared_ptr<performance::ThreadPool> pool) { thread_pool_ = std::move(pool); }
+
+    size_t rung_count() const { return renditions_.size(); }
+    IVideoEncoder& encoder(size_t rung) { return *renditions_[rung].encoder; }
+    bool last_frame_keyframe() const { return is_keyframe_; }
+
+private:
+    struct Rendition {
+        LadderRung rung;
+        std::unique_ptr<IVideoEncoder> encoder;
+        processing::FrameScaler scaler;
+        bool scaled = false;     // false: the source is encoded as is
+        VideoFrame frame{};      // Resized source
+        FrameView view;          // Of frame
+        FrameAnalysis analysis;  // Top rung analysis at this size
+    };
+
+    void resize_source(Rendition& rendition, const FrameView& input);
+    bool encode_rendition(Rendition& rendition, const FrameView& input, std::vector<uint8_t>& output);
+
+    EncoderFactory factory_;
+    AbrLadderConfig config_;
+    uint32_t source_width_ = 0;
+    uint32_t source_height_ = 0;
+    std::vector<Rendition> renditions_;
+
+    FrameAnalyzer analyzer_;
+    FrameAnalysis analysis_;
+    uint32_t frame_count_ = 0;
+    uint32_t last_keyframe_ = 0;
+    bool is_keyframe_ = false;
+
+    std::shared_ptr<performance::ThreadPool> thread_pool_;
+};
+
+} // namespace codec
+} // namespace streaming
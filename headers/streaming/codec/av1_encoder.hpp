@@ -2,10 +2,19 @@
 #pragma once
 
 #include "video_codec.hpp"
+#include "rate_control.hpp"
 #include "av1_structures.hpp"
+#include "reference_picture.hpp"
 #include "../utils/bitstream.hpp"
 #include "../processing/dct_transform.hpp"
 #include "../processing/quantization.hpp"
+#include "../processing/av1_entropy.hpp"
+#include "../processing/intra_prediction.hpp"
+#include "../processing/partition_search.hpp"
+#include "../performance/parallelization.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -15,17 +24,34 @@ namespace codec {
 class AV1Encoder : public IVideoEncoder {
 private:
     struct EncodingBlock {
-        int x, y;
-        int width, height;
-        PartitionType partition;
-        PredictionMode pred_mode;
-        TransformBlock transform;
+        int x = 0, y = 0;
+        int width = 0, height = 0;
+        PartitionType partition = PartitionType::PARTITION_NONE;
+        PredictionMode pred_mode = PredictionMode::DC_PRED;
+        int angle_delta = 0; // AngleDeltaY of directional modes, -3..3
+        TransformBlock transform{};
         
         // AV1-specific features
         bool use_palette = false;
         bool use_obmc = false;  // Overlapped Block Motion Compensation
         bool use_cfl = false;   // Chroma from Luma
     };
+    
+    // Everything a worker needs to code one tile; tiles share no mutable state
+    struct TileContext {
+        processing::AV1EntropyEncoder entropy;
+        int x0 = 0, y0 = 0, x1 = 0, y1 = 0; // Pixel bounds, clipped to the frame
+        bool is_keyframe = true;
+        int qindex = 0;          // CurrentQIndex, updated by the superblock deltas
+        int target_qindex = 0;   // Adaptive-quantization qindex of the current superblock
+        bool read_deltas = false; // Delta not yet coded in the current superblock
+        std::vector<PartitionType> decisions; // Partition tree of the current superblock
+        TransformBlock transform;             // Scratch coefficients, reused across blocks
+        std::vector<uint8_t> output;          // Coded tile
+        processing::IntraModeSearch intra_search;
+        processing::BlockStatistics block_statistics; // Of the current superblock
+        alignas(32) std::array<uint8_t, 64 * 64> prediction; // One transform block
+    };
 
 public:
     AV1Encoder();
@@ -34,25 +60,71 @@ public:
     bool initialize(uint32_t width, uint32_t height, uint32_t fps, 
                    uint32_t bitrate) override;
     bool encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) override;
+    bool encode_frame(const FrameView& input, std::vector<uint8_t>& output) override;
     void set_bitrate(uint32_t bitrate) override;
     void set_gop_size(uint32_t gop_size) override;
     uint32_t get_encoded_size() const override;
+    void reset() override;
+    void set_rate_control(const RateControlConfig& config) override;
+    RateController& rate_control() override { return rate_control_; }
 
     // AV1-specific optimizations
     void enable_tools(bool obmc, bool cfl, bool palette, bool warp_motion);
-    void set_speed_preset(int speed);  // 0=best quality, 9=fastest
+    bool set_speed_preset(int speed) override;  // 0=best quality, 9=fastest (tools and processing::partition_search_config)
+    int speed_preset() const override { return speed_preset_; }
+    // Every block is intra coded (no inter prediction yet), so every frame refreshes the
+    // whole picture already: intra refresh only drops the periodic and scene-cut keyframes
+    bool set_intra_refresh(uint32_t period) override;
+    uint32_t intra_refresh_period() const override { return intra_refresh_period_; }
+
+    // Number of previous frames kept as references (DPB size, default 1, at most 8 slots)
+    void set_max_reference_frames(uint32_t count);
+    // Share reference pictures with other encoders of the same resolution
+    void set_reference_pool(std::shared_ptr<ReferencePicturePool> pool) { reference_pool_ = std::move(pool); }
+    
+    // Tiles are encoded on this pool; without one they are encoded on the calling thread
+    void set_thread_pool(std::shared_ptr<performance::ThreadPool> pool) { thread_pool_ = std::move(pool); }
+    // Uniform tile grid; counts are rounded up to powers of two (uniform_tile_spacing_flag)
+    // and limited to one superblock per tile
+    void set_tiles(uint32_t columns, uint32_t rows);
+    // Time per superblock for the intra mode decision (0 = unlimited, deterministic
+    // output). Past it each block keeps the best mode found so far.
+    void set_intra_time_budget(std::chrono::microseconds budget) { intra_time_budget_ = budget; }
+    // Intra prediction modes evaluated since initialize()
+    uint64_t intra_modes_evaluated() const { return intra_modes_evaluated_.load(std::memory_order_relaxed); }
 
 private:
-    bool encode_obu_sequence(const VideoFrame& frame, utils::BitstreamWriter& writer);
+    bool encode_obu_sequence(const FrameView& frame, utils::BitstreamWriter& writer);
+    void write_obu(utils::BitstreamWriter& writer, uint8_t obu_type, const utils::BitstreamWriter& payload);
+    void encode_sequence_header(utils::BitstreamWriter& writer);
     void encode_frame_header(utils::BitstreamWriter& writer, bool is_keyframe);
-    void encode_tile_group(utils::BitstreamWriter& writer, const VideoFrame& frame);
-    void encode_superblock(utils::BitstreamWriter& writer, const SuperBlock& sb, int x, int y);
+    void encode_tile_info(utils::BitstreamWriter& writer);
+    void setup_tiles(int sb_cols, int sb_rows);
+    void encode_tile_group(utils::BitstreamWriter& writer, bool is_keyframe);
+    void encode_tile(int tile_index, bool is_keyframe);
+    void encode_superblock(TileContext& tile, int x, int y);
     
     // AV1'in benzersiz özellikleri
-    void rdo_partition_decision(EncodingBlock& block, double& best_cost);
-    void encode_prediction_mode(utils::BitstreamWriter& writer, const EncodingBlock& block);
-    void encode_transform_info(utils::BitstreamWriter& writer, const TransformBlock& tx);
-    void encode_palette_mode(utils::BitstreamWriter& writer, const EncodingBlock& block);
+    // Partition symbols are priced from the tile's CDFs at the start of the superblock
+    void rdo_partition_decision(const processing::BlockStatistics& statistics, const processing::AV1EntropyEncoder& entropy,
+                                double lambda, EncodingBlock& block, double& best_cost,
+                                std::vector<PartitionType>& decisions);
+    double evaluate_partition_cost(const processing::BlockStatistics& statistics,
+                                   const processing::AV1EntropyEncoder& entropy, double lambda,
+                                   const EncodingBlock& block, PartitionType partition);
+    void encode_partition_tree(TileContext& tile, const EncodingBlock& block, size_t& decision_index);
+    void encode_block(TileContext& tile, EncodingBlock& block);
+    double calculate_residual_cost(const processing::BlockStatistics& statistics, double lambda, const EncodingBlock& block);
+    double calculate_partition_rate(const processing::AV1EntropyEncoder& entropy, const EncodingBlock& block,
+                                    PartitionType partition);
+    void encode_prediction_mode(TileContext& tile, const EncodingBlock& block);
+    // Chooses y_mode and angle_delta_y of a block on SATD against the prediction of its
+    // transform blocks from the neighbouring source samples
+    void decide_intra_mode(TileContext& tile, EncodingBlock& block);
+    // Predicts the transform block at (x, y) with the block's mode into tile.prediction
+    void predict_intra_tx(TileContext& tile, const EncodingBlock& block, int x, int y, int size);
+    void encode_transform_info(TileContext& tile, const EncodingBlock& block);
+    void encode_palette_mode(TileContext& tile, const EncodingBlock& block);
     
     // Yeni AV1 teknolojileri
     void apply_obmc_prediction(EncodingBlock& block);
@@ -66,6 +138,10 @@ private:
     uint32_t bitrate_ = 1000000;
     uint32_t gop_size_ = 30;
     uint32_t frame_count_ = 0;
+    uint32_t last_keyframe_ = 0;
+    bool is_keyframe_ = true;
+    uint32_t intra_refresh_period_ = 0;
+    bool delta_q_present_ = false; // Per-superblock qindex deltas (adaptive quantization)
     
     int superblock_size_ = 128;  // AV1'in büyük blokları
     int current_qp_ = 50;        // AV1 QP range: 0-63
@@ -79,7 +155,53 @@ private:
     
     std::unique_ptr<processing::DCT> dct_;
     std::unique_ptr<processing::Quantizer> quantizer_;
-    std::vector<uint8_t> reference_frames_;
+    
+    std::shared_ptr<ReferencePicturePool> reference_pool_;
+    DecodedPictureBuffer dpb_;
+    uint32_t max_reference_frames_ = 1;
+    
+    std::shared_ptr<performance::ThreadPool> thread_pool_;
+    RateController rate_control_;
+    const FrameView* current_frame_ = nullptr; // Frame being encoded (read-only in workers)
+    
+    // Tile layout (tile_info): requested counts and superblock start of every column / row
+    uint32_t tile_columns_ = 1;
+    uint32_t tile_rows_ = 1;
+    int tile_cols_log2_ = 0;
+    int tile_rows_log2_ = 0;
+    int max_tile_cols_log2_ = 0;
+    int max_tile_rows_log2_ = 0;
+    uint32_t tile_size_bytes_ = 4; // Width of the tile_size_minus_1 fields
+    std::vector<int> tile_col_starts_; // In superblocks, last entry = sb_cols
+    std::vector<int> tile_row_starts_;
+    
+    // Per-frame state, kept so steady-state frames do not allocate
+    utils::BitstreamWriter writer_;
+    utils::BitstreamWriter tile_group_;
+    utils::BitstreamWriter frame_header_;
+    std::vector<TileContext> tiles_;
+    processing::AV1EntropyEncoder::Contexts frame_contexts_; // CDFs every tile of the frame starts from
+    std::vector<std::future<void>> futures_;
+    
+    std::chrono::microseconds intra_time_budget_{0};
+    std::atomic<uint64_t> intra_modes_evaluated_{0};
+
+    // Settings a stream can change, as initialize() left them (reset())
+    struct Settings {
+        uint32_t gop_size = 30;
+        uint32_t intra_refresh_period = 0;
+        RateControlConfig rate_control;
+        int speed_preset = 5;
+        bool enable_obmc = true;
+        bool enable_cfl = true;
+        bool enable_palette = true;
+        bool enable_warp_motion = true;
+        uint32_t max_reference_frames = 1;
+        uint32_t tile_columns = 1;
+        uint32_t tile_rows = 1;
+        std::chrono::microseconds intra_time_budget{0};
+    };
+    Settings initial_settings_;
 };
 
 } // namespace codec
@@ -25,6 +25,8 @@ enum class PredictionMode {
     D135_PRED,      // Diagonal 135
     D113_PRED,      // Diagonal 113
     D157_PRED,      // Diagonal 157
+    D203_PRED,      // Diagonal 203
+    D67_PRED,       // Diagonal 67
     SMOOTH_PRED,    // Smooth
     SMOOTH_V_PRED,  // Smooth Vertical
     SMOOTH_H_PRED,  // Smooth Horizontal
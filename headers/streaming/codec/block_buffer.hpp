@@ -0,0 +1,93 @@
+// include/streaming/codec/block_buffer.hpp
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+
+namespace streaming {
+namespace codec {
+
+// Strided window on a block of samples or coefficients inside a larger plane. Copying a
+// view copies the pointer, never the block; sub() narrows it to a sub-block.
+template <typename T>
+struct BlockView {
+    T* data = nullptr;
+    int stride = 0;
+    int width = 0;
+    int height = 0;
+
+    T* row(int y) const { return data + static_cast<ptrdiff_t>(y) * stride; }
+    T& operator()(int y, int x) const { return row(y)[x]; }
+
+    BlockView sub(int x, int y, int w, int h) const { return {row(y) + x, stride, w, h}; }
+    operator BlockView<const T>() const { return {data, stride, width, height}; }
+
+    bool any_nonzero() const {
+        for (int y = 0; y < height; ++y) {
+            const T* r = row(y);
+            if (std::any_of(r, r + width, [](T v) { return v != T{}; })) return true;
+        }
+        return false;
+    }
+
+    void fill(T value) const {
+        for (int y = 0; y < height; ++y) {
+            std::fill(row(y), row(y) + width, value);
+        }
+    }
+};
+
+// Block buffers of one CTU / superblock as structure of arrays: a Y, a Cb and a Cr plane
+// (4:2:0), each with the CTU width as stride, in one cache-aligned allocation. Each worker
+// owns one and reuses it for every CTU it codes; CUs and TUs address their part through
+// views at their CTU-relative position instead of carrying arrays of their own.
+class CTUBlockArena {
+public:
+    static constexpr int ALIGNMENT = 64; // Cache line
+
+    enum Component { Y = 0, CB = 1, CR = 2 };
+
+    // Allocates on the first call and when the CTU size changes, so steady state does not
+    // allocate. The contents are unspecified until written or clear()ed.
+    void configure(int ctu_size) {
+        if (ctu_size == size_ && storage_) return;
+        const size_t luma = static_cast<size_t>(ctu_size) * ctu_size;
+        const size_t bytes = (luma + luma / 2) * sizeof(int16_t);
+        storage_.reset(static_cast<int16_t*>(std::aligned_alloc(ALIGNMENT, (bytes + ALIGNMENT - 1) & ~size_t{ALIGNMENT - 1})));
+        if (!storage_) throw std::bad_alloc();
+        size_ = ctu_size;
+    }
+
+    int size() const { return size_; }
+
+    BlockView<int16_t> plane(Component c) {
+        const size_t luma = static_cast<size_t>(size_) * size_;
+        if (c == Y) return {storage_.get(), size_, size_, size_};
+        const int half = size_ / 2;
+        return {storage_.get() + luma + (c == CR ? luma / 4 : 0), half, half, half};
+    }
+
+    // Block at (x, y) of the CTU, in samples of the component
+    BlockView<int16_t> block(Component c, int x, int y, int w, int h) { return plane(c).sub(x, y, w, h); }
+
+    void clear() {
+        const size_t luma = static_cast<size_t>(size_) * size_;
+        std::memset(storage_.get(), 0, (luma + luma / 2) * sizeof(int16_t));
+    }
+
+private:
+    struct AlignedFree {
+        void operator()(int16_t* p) const { std::free(p); }
+    };
+
+    int size_ = 0;
+    std::unique_ptr<int16_t, AlignedFree> storage_;
+};
+
+} // namespace codec
+} // namespace streaming
@@ -0,0 +1,97 @@
+// include/streaming/codec/encoder_pool.hpp
+#pragma once
+
+#include "video_codec.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace streaming {
+namespace codec {
+
+enum class EncoderCodec {
+    H264,
+    H265,
+    VVC,
+    AV1
+};
+
+// Encoders of one key are interchangeable: same codec, format and speed preset
+struct EncoderKey {
+    EncoderCodec codec = EncoderCodec::H264;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t fps = 30;
+    int preset = 5; // Speed preset, 0 = best .. 9 = fastest (H.264 has none)
+
+    bool operator==(const EncoderKey&) const = default;
+};
+
+struct EncoderKeyHash {
+    size_t operator()(const EncoderKey& key) const {
+        uint64_t h = static_cast<uint64_t>(key.codec);
+        for (uint64_t v : {uint64_t{key.width}, uint64_t{key.height}, uint64_t{key.fps}, static_cast<uint64_t>(key.preset)}) {
+            h = (h ^ v) * 1099511628211ull;
+        }
+        return static_cast<size_t>(h);
+    }
+};
+
+// Initialized encoders kept between sessions (server-side transcoding of many short
+// streams). A released encoder is reset() - next frame IDR, no references, fresh rate
+// control, settings back to what the factory and initialize() left - and kept with its
+// buffers and threads, so the next session of the same key skips construction and
+// initialize() and codes exactly like a fresh encoder.
+class EncoderPool {
+public:
+    // Creates and initializes an encoder for the key at a bitrate; nullptr on failure
+    using Factory = std::function<std::unique_ptr<IVideoEncoder>(const EncoderKey& key, uint32_t bitrate)>;
+
+    struct Stats {
+        uint64_t hits = 0;                      // Sessions given an idle encoder
+        uint64_t misses = 0;                    // Sessions that created one
+        std::chrono::nanoseconds init_time{0};  // Spent creating + initializing (misses)
+        std::chrono::nanoseconds reset_time{0}; // Spent resetting released encoders
+        uint64_t resets = 0;
+        size_t idle = 0;                        // Encoders waiting in the pool
+
+        double hit_rate() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+        double average_init_ms() const { return misses ? init_time.count() / 1e6 / misses : 0.0; }
+        double average_reset_ms() const { return resets ? reset_time.count() / 1e6 / resets : 0.0; }
+    };
+
+    // max_idle_per_key: encoders kept per key once released, the rest are destroyed
+    static std::shared_ptr<EncoderPool> create(size_t max_idle_per_key = 4, Factory factory = create_encoder);
+
+    // Encoder for a new session at the given bitrate. It returns to the pool when the
+    // last copy of the handle goes away (or is destroyed if the pool is gone).
+    std::shared_ptr<IVideoEncoder> acquire(const EncoderKey& key, uint32_t bitrate);
+
+    Stats stats() const;
+    void clear(); // Destroys the idle encoders
+
+    // Default factory: the encoder of the codec with the key's speed preset
+    static std::unique_ptr<IVideoEncoder> create_encoder(const EncoderKey& key, uint32_t bitrate);
+
+private:
+    EncoderPool(size_t max_idle_per_key, Factory factory)
+        : max_idle_per_key_(max_idle_per_key), factory_(std::move(factory)) {}
+
+    void release(const EncoderKey& key, IVideoEncoder* encoder);
+    std::shared_ptr<IVideoEncoder> wrap(const EncoderKey& key, std::unique_ptr<IVideoEncoder> encoder);
+
+    size_t max_idle_per_key_;
+    Factory factory_;
+    mutable std::mutex mutex_;
+    std::unordered_map<EncoderKey, std::vector<std::unique_ptr<IVideoEncoder>>, EncoderKeyHash> idle_;
+    Stats stats_;
+    std::weak_ptr<EncoderPool> self_;
+};
+
+} // namespace codec
+} // namespace streaming
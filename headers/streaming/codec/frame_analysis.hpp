@@ -0,0 +1,69 @@
+// include/streaming/codec/frame_analysis.hpp
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace streaming {
+namespace codec {
+
+// Pre-analysis of one frame on a half-resolution luma plane, shared by all encoders
+// through the rate controller
+struct FrameAnalysis {
+    uint32_t width = 0;   // Analysed frame size
+    uint32_t height = 0;
+
+    // Complexity, 8x8 SATD at half resolution (one block per 16x16 block of the frame)
+    double intra_cost = 0.0;  // Every block intra (DC) predicted
+    double inter_cost = 0.0;  // Best of intra and motion-compensated from the previous frame
+    uint32_t block_count = 0;
+    bool has_previous = false;
+
+    // Adaptive quantization: QP offset per 16x16 block, zero mean in the log domain
+    uint32_t blocks_x = 0;
+    uint32_t blocks_y = 0;
+    std::vector<float> qp_offsets;
+
+    // Lowres motion per 16x16 block against the previous frame, in full resolution pixels.
+    // Encoders start their motion search there; intra marks blocks that did not predict
+    // better from the previous frame. Empty for the first frame.
+    struct BlockHint {
+        int16_t mv_x = 0;
+        int16_t mv_y = 0;
+        bool intra = false;
+    };
+    std::vector<BlockHint> hints;
+
+    // Mean offset of the 16x16 blocks covered by a pixel rectangle (0 without AQ)
+    double qp_offset(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+    // Hint of the block containing a pixel, nullptr without hints
+    const BlockHint* hint(uint32_t x, uint32_t y) const;
+
+    // The same analysis for a resized copy of the frame: costs scale with the area,
+    // offsets and hints are resampled and vectors scaled (renditions of an ABR ladder)
+    void scale(uint32_t target_width, uint32_t target_height, FrameAnalysis& result) const;
+};
+
+// Frames must be analysed in coding order (inter cost uses the previous frame)
+class FrameAnalyzer {
+public:
+    // 0 disables the activity analysis
+    void set_aq_strength(double strength) { aq_strength_ = strength; }
+    void reset() { previous_.clear(); }
+
+    void analyze(const uint8_t* luma, int stride, int width, int height, FrameAnalysis& result);
+
+private:
+    void compute_aq_offsets(FrameAnalysis& result) const;
+
+    double aq_strength_ = 1.0;
+    std::vector<uint8_t> current_;
+    std::vector<uint8_t> previous_;
+    std::vector<std::pair<int, int>> vectors_; // Lowres motion per block, predictors for the search
+    int lowres_width_ = 0;
+    int lowres_height_ = 0;
+};
+
+} // namespace codec
+} // namespace streaming
@@ -2,35 +2,155 @@
 #pragma once
 
 #include "video_codec.hpp"
+#include "reference_picture.hpp"
 #include "../utils/bitstream.hpp"
 #include "../processing/dct_transform.hpp"
 #include "../processing/quantization.hpp"
+#include "../processing/deblocking_filter.hpp"
+#include "../processing/intra_prediction.hpp"
+#include "../performance/parallelization.hpp"
+#include <array>
+#include <future>
+#include <memory>
+#include <vector>
 
 namespace streaming {
+namespace processing {
+class CAVLCDecoder;
+struct CAVLCCoeffCounts;
+} // namespace processing
+
 namespace codec {
 
+// Decoder for the H264Encoder bitstream: an SPS and PPS ahead of every IDR, one NAL unit
+// per slice, CAVLC residuals, Intra_16x16 / Intra_8x8 and P_L0_16x16 macroblocks with
+// quarter-pel motion, in-loop deblocking.
+// Pictures are decoded into pooled ReferencePictures that double as references.
+// Slices are independent, so with a thread pool they are decoded in parallel.
+// For frame threading, decoding splits into prepare_picture() (parsing and DPB update,
+// in decoding order) and decode_prepared(), which can run for several pictures at once:
+// motion compensation waits for the reference rows it reads.
 class H264Decoder : public IVideoDecoder {
+private:
+    struct Slice {
+        std::vector<uint8_t> rbsp;                 // Payload without emulation prevention bytes
+        utils::BitstreamReader reader{nullptr, 0}; // Positioned after the slice header
+        uint32_t first_mb = 0;
+        uint32_t end_mb = 0;
+        bool idr = false;
+        bool intra = false;
+        uint32_t num_ref_idx_active = 1;
+        int qp = 26;
+        bool deblocking = true; // disable_deblocking_filter_idc 0
+        int alpha_offset = 0, beta_offset = 0; // FilterOffsetA / FilterOffsetB
+    };
+
 public:
+    // One parsed access unit: its slices, the references it was coded against and the
+    // picture it decodes into. Jobs are reusable, so steady-state decoding does not allocate.
+    class PictureJob {
+    public:
+        const std::shared_ptr<ReferencePicture>& picture() const { return picture_; }
+        // Drop the pictures, keep the buffers (the job is done with)
+        void release() {
+            picture_.reset();
+            references_.clear();
+        }
+
+    private:
+        friend class H264Decoder;
+
+        std::vector<Slice> slices_;
+        size_t slice_count_ = 0;
+        std::vector<std::shared_ptr<ReferencePicture>> references_; // ref_idx order
+        std::shared_ptr<ReferencePicture> picture_;
+        uint32_t width_ = 0, height_ = 0, mb_width_ = 0; // The next SPS may change the decoder's
+        std::vector<std::future<void>> futures_; // Slice tasks
+        processing::H264DeblockingFilter deblocking_filter_;
+        bool deblocking_ = false;
+        std::vector<uint8_t> intra_modes_; // Intra_8x8 mode per 8x8 block (DC elsewhere)
+        std::vector<uint8_t> coeff_counts_; // total_coeff per 4x4 luma block (CAVLC nC)
+    };
+
     H264Decoder();
-    ~H264Decoder() override = default;
-    
+    ~H264Decoder() override;
+
     bool initialize() override;
+    // One access unit in, one picture out, copied as packed YUV420 (stride = width).
+    // Reusing the same output keeps steady-state decoding allocation-free.
     bool decode_frame(const uint8_t* data, size_t size, VideoFrame& output) override;
+    // Zero-copy variant: the decoded picture itself. It is shared with the DPB and goes
+    // back to the pool once released; picture->view() gives a FrameView of it.
+    bool decode_picture(const uint8_t* data, size_t size, std::shared_ptr<ReferencePicture>& picture);
     void reset() override;
 
+    // Frame threading. prepare_picture() must be called for every access unit in decoding
+    // order from one thread; the picture is a reference for the next access units right
+    // away. decode_prepared() may then run on any thread, concurrently with the pictures
+    // prepared after it, and reports its rows as they complete. Call it for every prepared
+    // job: later pictures wait on it even when it fails.
+    bool prepare_picture(const uint8_t* data, size_t size, PictureJob& job);
+    bool decode_prepared(PictureJob& job);
+
+    // Slices of a picture are decoded on this pool (not the pool running decode_frame)
+    void set_thread_pool(std::shared_ptr<performance::ThreadPool> pool) { thread_pool_ = std::move(pool); }
+    // Share decoded pictures with other decoders / encoders of the same resolution
+    void set_reference_pool(std::shared_ptr<ReferencePicturePool> pool) { reference_pool_ = std::move(pool); }
+
+    uint32_t width() const { return width_; }
+    uint32_t height() const { return height_; }
+    uint64_t decoded_frames() const { return frame_count_; }
+
 private:
-    bool decode_nal_unit(utils::BitstreamReader& reader, VideoFrame& output);
-    void decode_slice_data(utils::BitstreamReader& reader, VideoFrame& output);
-    void decode_macroblock(utils::BitstreamReader& reader, VideoFrame& output, 
-                          uint32_t mb_x, uint32_t mb_y);
-    
+    using Block8x8 = std::array<std::array<int16_t, 8>, 8>;
+
+    bool decode_nal_unit(const uint8_t* nal, size_t size, PictureJob& job);
+    bool parse_sequence_parameter_set(utils::BitstreamReader& reader);
+    bool parse_picture_parameter_set(utils::BitstreamReader& reader);
+    void parse_slice_header(Slice& slice);
+    void decode_slices(PictureJob& job);
+    void decode_slice_data(PictureJob& job, Slice& slice, bool report_progress);
+    void decode_macroblock(PictureJob& job, utils::BitstreamReader& reader, const Slice& slice,
+                          uint32_t mb_x, uint32_t mb_y, int& qp);
+    void decode_skipped_macroblock(PictureJob& job, const Slice& slice, uint32_t mb_x, uint32_t mb_y, int qp);
+
+    void decode_intra_macroblock(PictureJob& job, utils::BitstreamReader& reader, const Slice& slice,
+                                 uint32_t mb_x, uint32_t mb_y, uint32_t intra_type, int& qp);
+    void reconstruct_block(const Block8x8& coefficients, int qp, const uint8_t* prediction,
+                           int prediction_stride, uint8_t* dst, int stride, int w, int h);
+    // Neighbouring macroblocks decoded already, limited to the slice
+    static processing::H264IntraNeighbours intra_neighbours(const PictureJob& job, const Slice& slice,
+                                                            uint32_t mb_x, uint32_t mb_y);
+    // The macroblock's view of the total_coeff map, neighbours limited to the slice
+    static processing::CAVLCCoeffCounts coeff_counts(PictureJob& job, const Slice& slice, uint32_t mb_x,
+                                                     uint32_t mb_y);
+
 private:
     std::unique_ptr<processing::DCT> dct_;
     std::unique_ptr<processing::Quantizer> quantizer_;
-    std::vector<uint8_t> reference_frame_;
+    std::unique_ptr<processing::CAVLCDecoder> cavlc_decoder_;
+
+    // Sequence parameters
+    bool sps_valid_ = false;
     uint32_t width_ = 0, height_ = 0;
-    int current_qp_ = 26;
+    uint32_t mb_width_ = 0, mb_height_ = 0;
+    uint32_t max_reference_frames_ = 1;
+
+    // Picture parameters
+    bool pps_valid_ = false;
+    uint32_t num_ref_idx_default_ = 1;
+    int pic_init_qp_ = 26;
+    bool deblocking_control_present_ = false;
+
+    std::shared_ptr<ReferencePicturePool> reference_pool_;
+    DecodedPictureBuffer dpb_;
+    std::shared_ptr<performance::ThreadPool> thread_pool_;
+    uint64_t frame_count_ = 0;
+
+    // Per-access-unit state, kept so steady-state frames do not allocate
+    PictureJob job_; // decode_frame / decode_picture
+    std::vector<uint8_t> parameter_set_rbsp_;
 };
 
 } // namespace codec
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
@@ -1,67 +1,196 @@
-// include/streaming/processing/dct_transform.hpp
+// include/streaming/codec/h264_encoder.hpp
 #pragma once
 
-#include <cmath>
+#include "video_codec.hpp"
+#include "rate_control.hpp"
+#include "reference_picture.hpp"
+#include "intra_refresh.hpp"
+#include "../utils/bitstream.hpp"
+#include "../processing/dct_transform.hpp"
+#include "../processing/quantization.hpp"
+#include "../processing/deblocking_filter.hpp"
+#include "../processing/intra_prediction.hpp"
+#include "../performance/parallelization.hpp"
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace streaming {
 namespace processing {
+class CAVLCEncoder;
+class MotionEstimator;
+struct CAVLCCoeffCounts;
+} // namespace processing
+
+namespace codec {
+
+class H264Encoder : public IVideoEncoder {
+protected:
+    using Block8x8 = std::array<std::array<int16_t, 8>, 8>;
+
+    struct Macroblock {
+        std::array<std::array<Block8x8, 2>, 2> y_blocks{}; // [row][col] 8x8 luma blocks
+    };
 
-class DCT {
-private:
-    static constexpr int N = 8;
-    std::array<std::array<double, N>, N> cos_table_;
-    
 public:
-    DCT() {
-        // Precompute cosine table for performance
-        for (int i = 0; i < N; ++i) {
-            for (int j = 0; j < N; ++j) {
-                cos_table_[i][j] = std::cos((2 * i + 1) * j * M_PI / (2.0 * N));
-            }
-        }
-    }
+    H264Encoder();
+    ~H264Encoder() override;
+
+    bool initialize(uint32_t width, uint32_t height, uint32_t fps,
+                   uint32_t bitrate) override;
+    bool encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) override;
+    bool encode_frame(const FrameView& input, std::vector<uint8_t>& output) override;
+    void set_bitrate(uint32_t bitrate) override;
+    void set_gop_size(uint32_t gop_size) override;
+    uint32_t get_encoded_size() const override;
+    void reset() override;
+    void set_rate_control(const RateControlConfig& config) override;
+    RateController& rate_control() override { return rate_control_; }
+
+    // Quarter-pel motion refinement (enabled by default)
+    void set_subpel_refinement(bool enabled) { subpel_refinement_ = enabled; }
     
-    void forward_dct(const std::array<std::array<int16_t, N>, N>& input,
-                    std::array<std::array<double, N>, N>& output) {
-        for (int u = 0; u < N; ++u) {
-            for (int v = 0; v < N; ++v) {
-                double sum = 0.0;
-                
-                for (int x = 0; x < N; ++x) {
-                    for (int y = 0; y < N; ++y) {
-                        sum += input[x][y] * cos_table_[x][u] * cos_table_[y][v];
-                    }
-                }
-                
-                double cu = (u == 0) ? 1.0 / std::sqrt(2) : 1.0;
-                double cv = (v == 0) ? 1.0 / std::sqrt(2) : 1.0;
-                
-                output[u][v] = 0.25 * cu * cv * sum;
-            }
-        }
-    }
+    // Number of previous frames searched by P macroblocks (DPB size, default 1)
+    void set_max_reference_frames(uint32_t count);
+    // Share reference pictures with other encoders of the same resolution
+    void set_reference_pool(std::shared_ptr<ReferencePicturePool> pool) { reference_pool_ = std::move(pool); }
     
-    void inverse_dct(const std::array<std::array<double, N>, N>& input,
-                    std::array<std::array<int16_t, N>, N>& output) {
-        for (int x = 0; x < N; ++x) {
-            for (int y = 0; y < N; ++y) {
-                double sum = 0.0;
-                
-                for (int u = 0; u < N; ++u) {
-                    for (int v = 0; v < N; ++v) {
-                        double cu = (u == 0) ? 1.0 / std::sqrt(2) : 1.0;
-                        double cv = (v == 0) ? 1.0 / std::sqrt(2) : 1.0;
-                        
-                        sum += cu * cv * input[u][v] * cos_table_[x][u] * cos_table_[y][v];
-                    }
-                }
-                
-                output[x][y] = static_cast<int16_t>(std::round(0.25 * sum));
-            }
-        }
+    // Parallel encoding. Without a pool, rows are encoded on the calling thread.
+    // The pool must not be the one running encode_frame (rows block on each other).
+    void set_thread_pool(std::shared_ptr<performance::ThreadPool> pool) { thread_pool_ = std::move(pool); }
+    // Independent slices per frame (split on macroblock rows, each its own NAL unit)
+    void set_slice_count(uint32_t count) { slice_count_ = std::max(1u, count); }
+    // Each slice is handed out once its rows are coded, while later slices are still coding
+    bool set_slice_output(SliceOutput output) override {
+        slice_output_ = std::move(output);
+        return true;
     }
+    // Row-lag-2 wavefront inside each slice; off = one task per slice
+    void set_wavefront(bool enabled) { wavefront_ = enabled; }
+    // In-loop deblocking (default on): each macroblock row is filtered once the row below
+    // is done too (intra prediction reads unfiltered samples), so references and the
+    // decoder see the filtered picture
+    void set_deblocking(bool enabled) { deblocking_ = enabled; }
+    // Time per macroblock for the intra mode decision (0 = unlimited, deterministic output).
+    // Past it the best mode found so far is coded.
+    void set_intra_time_budget(std::chrono::microseconds budget) { intra_time_budget_ = budget; }
+    // Intra refresh: a column of intra macroblocks sweeps the picture every `period` frames,
+    // each sweep starts with a recovery point SEI
+    bool set_intra_refresh(uint32_t period) override;
+    uint32_t intra_refresh_period() const override { return intra_refresh_.period(); }
+    // Deblocked reconstruction, the newest reference picture
+    FrameView reconstructed_frame() const override { return dpb_.empty() ? FrameView() : dpb_.get(0)->view(); }
+    // Intra prediction modes evaluated since initialize()
+    uint64_t intra_modes_evaluated() const { return intra_modes_evaluated_.load(std::memory_order_relaxed); }
+
+private:
+    bool encode_nal_unit(const FrameView& frame, utils::BitstreamWriter& writer);
+    void encode_sequence_parameter_set(utils::BitstreamWriter& writer);
+    void encode_picture_parameter_set(utils::BitstreamWriter& writer);
+    void encode_slice_header(utils::BitstreamWriter& writer, uint8_t slice_type, uint32_t first_mb);
+    // Recovery point SEI: the picture is exact again once the sweep it starts is done
+    void write_recovery_point(utils::BitstreamWriter& writer);
+    void encode_ref_idx(utils::BitstreamWriter& writer, uint32_t ref_idx);
+    // Codes the rows and writes each slice NAL unit into writer as soon as its rows are done
+    void encode_slice_data(utils::BitstreamWriter& writer, const FrameView& frame, uint8_t slice_type,
+                           uint32_t slice_count);
+    void write_slice(utils::BitstreamWriter& writer, uint32_t slice, uint8_t slice_type);
+    void encode_macroblock_row(utils::BitstreamWriter& writer, const FrameView& frame, uint32_t mb_y,
+                              uint8_t slice_type, const std::atomic<uint32_t>* above_progress,
+                              std::atomic<uint32_t>& progress);
+    // Codes the macroblock, or counts it in skip_run when it is P_Skip (mb_skip_run is
+    // written before the next coded one). previous_qp follows the coded macroblocks.
+    void encode_macroblock(utils::BitstreamWriter& writer, const FrameView& frame,
+                          uint32_t mb_x, uint32_t mb_y, uint8_t slice_type, int qp, int& previous_qp,
+                          uint32_t& skip_run, bool above_available,
+                          processing::MotionEstimator& motion_estimator,
+                          processing::IntraModeSearch& intra_search);
+    // Filters the finished rows below the last filtered one
+    void deblock_rows();
+
+    // Chooses Intra_16x16 or Intra_8x8 and their modes, codes the macroblock from mb_type
+    // on (mb_type_offset 0 in I slices, 5 in P slices) and reconstructs it into the picture.
+    // Without allow_8x8 only Intra_16x16, which does not read the above-right macroblock.
+    // Both return the 8x8 blocks with non-zero coefficients, one bit each.
+    uint8_t encode_intra_macroblock(utils::BitstreamWriter& writer, const Macroblock& mb, uint32_t mb_x,
+                                    uint32_t mb_y, uint32_t mb_type_offset, int qp, int qp_delta,
+                                    const processing::H264IntraNeighbours& neighbours,
+                                    processing::IntraModeSearch& search, bool allow_8x8 = true);
+    uint8_t encode_residual(utils::BitstreamWriter& writer, const Macroblock& mb, uint32_t mb_x, uint32_t mb_y,
+                            const processing::H264IntraNeighbours& neighbours);
+    // The macroblock's view of the total_coeff map
+    processing::CAVLCCoeffCounts coeff_counts(uint32_t mb_x, uint32_t mb_y,
+                                              const processing::H264IntraNeighbours& neighbours);
+
+    void extract_macroblock(const FrameView& frame, Macroblock& mb, uint32_t mb_x, uint32_t mb_y);
+    void perform_dct_quantization(Block8x8& block, int qp);
+    // Same as H264Decoder: prediction plus the dequantized, inverse transformed residual
+    void reconstruct_block(const Block8x8& coefficients, int qp, const uint8_t* prediction,
+                           int prediction_stride, uint8_t* dst, int stride, int w, int h);
+
+private:
+    uint32_t width_ = 0;
+    uint32_t height_ = 0;
+    uint32_t fps_ = 30;
+    uint32_t bitrate_ = 1000000;
+    uint32_t gop_size_ = 30;
+    uint32_t frame_count_ = 0;
+    uint32_t last_keyframe_ = 0;
+    bool is_keyframe_ = true;
+    IntraRefresh intra_refresh_;
+    bool recovery_point_ = false; // The frame starts an intra refresh sweep
+
+    int current_qp_ = 26;
+    bool subpel_refinement_ = true;
+    uint32_t max_reference_frames_ = 1;
+    uint32_t slice_count_ = 1;
+    bool wavefront_ = true;
+    bool deblocking_ = true;
+    std::chrono::microseconds intra_time_budget_{0};
+    SliceOutput slice_output_;
+    size_t slice_output_bytes_ = 0; // Bytes of the access unit handed to slice_output_
+
+    // Settings a stream can change, as initialize() left them (reset())
+    struct Settings {
+        uint32_t gop_size = 30;
+        uint32_t intra_refresh_period = 0;
+        RateControlConfig rate_control;
+        bool subpel_refinement = true;
+        uint32_t max_reference_frames = 1;
+        uint32_t slice_count = 1;
+        bool wavefront = true;
+        bool deblocking = true;
+        std::chrono::microseconds intra_time_budget{0};
+    };
+    Settings initial_settings_;
+
+    std::unique_ptr<processing::DCT> dct_;
+    std::unique_ptr<processing::Quantizer> quantizer_;
+    std::unique_ptr<processing::CAVLCEncoder> cavlc_encoder_;
+    
+    std::shared_ptr<ReferencePicturePool> reference_pool_;
+    DecodedPictureBuffer dpb_;
+    std::shared_ptr<ReferencePicture> reconstruction_; // Picture being reconstructed
+    std::shared_ptr<performance::ThreadPool> thread_pool_;
+    RateController rate_control_;
+
+    // Per-frame state, kept so steady-state frames do not allocate
+    utils::BitstreamWriter writer_;
+    utils::BitstreamWriter nal_writer_; // NAL payload before emulation prevention
+    std::vector<utils::BitstreamWriter> row_writers_;
+    std::vector<uint32_t> slice_first_rows_;
+    std::unique_ptr<std::atomic<uint32_t>[]> row_progress_; // Macroblocks finished per row
+    std::vector<std::future<void>> futures_;
+    processing::H264DeblockingFilter deblocking_filter_;
+    std::mutex deblocking_mutex_;
+    uint32_t deblocked_rows_ = 0; // Guarded by deblocking_mutex_
+    std::vector<uint8_t> intra_modes_; // Intra_8x8 mode per 8x8 block (DC elsewhere), for mode prediction
+    std::vector<uint8_t> coeff_counts_; // total_coeff per 4x4 luma block, the CAVLC nC context
+    std::atomic<uint64_t> intra_modes_evaluated_{0};
 };
 
-} // namespace processing
-} // namespace streaming
\ No newline at end of file
+} // namespace codec
+} // namespace streaming
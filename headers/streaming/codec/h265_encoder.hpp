@@ -2,26 +2,86 @@
 #pragma once
 
 #include "video_codec.hpp"
+#include "rate_control.hpp"
 #include "hevc_structures.hpp"
+#include "reference_picture.hpp"
+#include "intra_refresh.hpp"
 #include "../utils/bitstream.hpp"
 #include "../processing/dct_transform.hpp"
 #include "../processing/quantization.hpp"
+#include "../processing/cabac_encoder.hpp"
+#include "../processing/deblocking_filter.hpp"
+#include "../processing/intra_prediction.hpp"
+#include "../processing/partition_search.hpp"
+#include "../performance/parallelization.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace streaming {
+namespace processing {
+class MotionEstimator;
+} // namespace processing
+
 namespace codec {
 
 class H265Encoder : public IVideoEncoder {
 private:
     struct CodingUnit {
-        int x, y; // Position
-        int size; // CU size (64,32,16,8)
-        bool split; // Whether to split into smaller CUs
+        int x = 0, y = 0; // Position
+        int size = 0; // CU size (64,32,16,8)
+        int depth = 0; // Quad-tree depth inside the CTU
+        bool split = false; // Whether to split into smaller CUs
+        uint64_t coded_blocks = 0; // 8x8 blocks with coefficients, bit (y / 8) * 8 + x / 8
+        
+        // Prediction info; the coefficients of its TUs are in the SubstreamCoder's arena
+        PredictionUnit pu{};
+    };
+    
+    using ContextModel = processing::CABACEncoder::ContextModel;
+    
+    // CABAC context variables of one substream. Copied between CTU rows for WPP.
+    struct CabacContexts {
+        ContextModel sao_merge_flag;
+        ContextModel sao_type_idx;
+        ContextModel split_cu_flag[3];
+        ContextModel pred_mode_flag;
+        ContextModel prev_intra_luma_pred_flag;
+        ContextModel ref_idx[2];
+        ContextModel abs_mvd_greater0_flag;
+        ContextModel abs_mvd_greater1_flag;
+        ContextModel split_transform_flag[3];
+        ContextModel cbf_luma[2];
+        ContextModel cu_qp_delta_abs[2];
+        ContextModel coded_sub_block_flag[2];
+        ContextModel sig_coeff_flag[4];
+        ContextModel coeff_abs_level_greater1_flag[4];
+        
+        void init(int qp, bool is_intra);
+    };
+    
+    // Entropy coding state of one substream (tile, or CTU row of a tile with WPP)
+    struct SubstreamCoder {
+        processing::CABACEncoder cabac;
+        CabacContexts contexts;
+        int tile_x0 = 0, tile_y0 = 0; // Top-left sample of the tile (neighbour availability)
+        int tile_x1 = 0, tile_y1 = 0; // End of the tile, clipped to the picture
+        
+        // Quantization group = CTU: its QP is signalled in the first TU with coefficients
+        int qp = 0;
+        int previous_qp = 0;          // qPY_PREV
+        bool qp_delta_coded = false;
         
-        // Prediction and transform info
-        PredictionUnit pu;
-        TransformUnit tu;
+        std::vector<CodingUnit> coding_units; // Quad-tree of the current CTU (reused)
+        CTUBlockArena coefficients;           // Quantized TU coefficients of the current CTU
+        
+        processing::IntraModeSearch intra_search;
+        processing::BlockStatistics block_statistics; // Of the current CTU, for the split decisions
+        alignas(32) std::array<uint8_t, CTU::MAX_CU_SIZE * CTU::MAX_CU_SIZE> intra_prediction; // CU-sized, per TU
     };
 
 public:
@@ -31,25 +91,109 @@ public:
     bool initialize(uint32_t width, uint32_t height, uint32_t fps, 
                    uint32_t bitrate) override;
     bool encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) override;
+    bool encode_frame(const FrameView& input, std::vector<uint8_t>& output) override;
     void set_bitrate(uint32_t bitrate) override;
     void set_gop_size(uint32_t gop_size) override;
     uint32_t get_encoded_size() const override;
+    void reset() override;
+    void set_rate_control(const RateControlConfig& config) override;
+    RateController& rate_control() override { return rate_control_; }
+    
+    // Number of previous frames searched by inter CUs (DPB size, default 1)
+    void set_max_reference_frames(uint32_t count);
+    // Share reference pictures with other encoders of the same resolution
+    void set_reference_pool(std::shared_ptr<ReferencePicturePool> pool) { reference_pool_ = std::move(pool); }
+    
+    // Parallel CTU encoding. Without a pool, substreams are encoded on the calling thread.
+    // The pool must not be the one running encode_frame (WPP rows block on each other).
+    void set_thread_pool(std::shared_ptr<performance::ThreadPool> pool) { thread_pool_ = std::move(pool); }
+    // WPP (entropy_coding_sync): one substream per CTU row, two CTUs behind the row above,
+    // contexts inherited from the second CTU of that row
+    void set_wavefront(bool enabled) { entropy_coding_sync_ = enabled; }
+    // Uniformly spaced tiles; each tile is coded independently (1x1 = no tiles)
+    void set_tiles(uint32_t columns, uint32_t rows);
+    // In-loop deblocking of the reconstruction (default on). CTU rows are filtered one row
+    // behind coding; with several tile columns the picture is filtered once it is done.
+    void set_deblocking(bool enabled) { deblocking_ = enabled; }
+    // Time per CTU for the intra mode decision over the 35 modes (0 = unlimited,
+    // deterministic output). Past it each CU keeps the best mode found so far.
+    void set_intra_time_budget(std::chrono::microseconds budget) { intra_time_budget_ = budget; }
+    // CU split search effort: 0 = best quality .. 9 = fastest (processing::partition_search_config)
+    bool set_speed_preset(int speed) override {
+        speed_preset_ = std::clamp(speed, 0, processing::PARTITION_SPEED_PRESETS - 1);
+        return true;
+    }
+    int speed_preset() const override { return speed_preset_; }
+    // Intra refresh: a column of intra CTUs sweeps the picture every `period` frames, each
+    // sweep starts with a recovery point SEI
+    bool set_intra_refresh(uint32_t period) override;
+    uint32_t intra_refresh_period() const override { return intra_refresh_.period(); }
+    // Deblocked reconstruction, the newest reference picture
+    FrameView reconstructed_frame() const override { return dpb_.empty() ? FrameView() : dpb_.get(0)->view(); }
+    // Intra prediction modes evaluated since initialize()
+    uint64_t intra_modes_evaluated() const { return intra_modes_evaluated_.load(std::memory_order_relaxed); }
 
 private:
-    bool encode_nal_unit(const VideoFrame& frame, utils::BitstreamWriter& writer);
+    bool encode_nal_unit(const FrameView& frame, utils::BitstreamWriter& writer);
+    void encode_nal_header(utils::BitstreamWriter& writer, uint8_t nal_unit_type);
+    void encode_pps(utils::BitstreamWriter& writer); // Picture Parameter Set (tiles / WPP)
     void encode_slice_header(utils::BitstreamWriter& writer, bool is_idr);
-    void encode_ctu(utils::BitstreamWriter& writer, const CTU& ctu, int x, int y);
-    void encode_coding_unit(utils::BitstreamWriter& writer, const CodingUnit& cu);
+    // Prefix SEI: the picture is exact again once the intra refresh sweep it starts is done
+    void encode_recovery_point(utils::BitstreamWriter& writer);
+    
+    // CTU coding in tile scan; one substream per tile, or per tile CTU row with WPP
+    void setup_tiles(int ctus_width, int ctus_height);
+    void encode_slice_data(bool is_intra);
+    void encode_substream(size_t substream, bool is_intra);
+    void encode_ctu(SubstreamCoder& coder, int x, int y, bool is_intra,
+                    processing::MotionEstimator& motion_estimator);
+    void encode_coding_unit(SubstreamCoder& coder, CodingUnit& cu, bool is_intra,
+                            processing::MotionEstimator& motion_estimator);
     
     // HEVC-specific encoding tools
-    void rdo_ctu_split_decision(CTU& ctu, int x, int y, std::vector<CodingUnit>& cus);
-    void encode_intra_prediction(utils::BitstreamWriter& writer, const CodingUnit& cu);
-    void encode_inter_prediction(utils::BitstreamWriter& writer, const CodingUnit& cu);
-    void encode_residual_quadtree(utils::BitstreamWriter& writer, const TransformUnit& tu);
+    // Split decisions on the CTU's block statistics, pruned by the speed preset; split
+    // flags are priced from the contexts at the start of the CTU
+    void rdo_ctu_split_decision(SubstreamCoder& coder, int x, int y, std::vector<CodingUnit>& cus);
+    void rdo_cu_split_decision(const processing::BlockStatistics& statistics, const CabacContexts& contexts,
+                               double lambda, const CodingUnit& cu, std::vector<CodingUnit>& cus);
+    double calculate_cu_cost(const processing::BlockStatistics& statistics, double lambda, const CodingUnit& cu,
+                             bool split, double bits);
+    void encode_intra_prediction(SubstreamCoder& coder, CodingUnit& cu);
+    // Candidate list of 8.4.2 from the left and above CUs
+    void derive_intra_mpm(const SubstreamCoder& coder, const CodingUnit& cu, int mpm[3]) const;
+    // Predicts the TU at (x, y) with the CU's intra mode into coder.intra_prediction
+    void predict_intra_tu(SubstreamCoder& coder, const CodingUnit& cu, int x, int y, int size);
+    void encode_inter_prediction(SubstreamCoder& coder, CodingUnit& cu,
+                                 processing::MotionEstimator& motion_estimator);
+    void encode_mvd(SubstreamCoder& coder, int mvd_x, int mvd_y);
+    void encode_residual_quadtree(SubstreamCoder& coder, CodingUnit& cu, const uint8_t* prediction,
+                                  int prediction_stride);
+    void transform_residual(const CodingUnit& cu, int x, int y, int size, const uint8_t* prediction,
+                            int prediction_stride, int qp, TransformUnit& tu);
+    void encode_cu_qp_delta(SubstreamCoder& coder, int qp_delta);
+    // Describes a coded CU to the deblocking filter
+    void store_block_info(const CodingUnit& cu, int qp);
+    // Marks a CTU row reconstructed and filters the rows that are ready
+    void ctu_row_reconstructed(int row);
+    void encode_residual_coding(SubstreamCoder& coder, const TransformUnit& tu);
     
     // New HEVC features
-    void encode_sao_parameters(utils::BitstreamWriter& writer); // Sample Adaptive Offset
-    void encode_deblocking_params(utils::BitstreamWriter& writer); // Deblocking filter
+    void encode_sao_parameters(SubstreamCoder& coder, int x, int y); // Sample Adaptive Offset (per CTU)
+    void encode_deblocking_params(utils::BitstreamWriter& writer); // Deblocking filter (slice header)
+    
+    // Tile boundaries in CTUs (uniform spacing, last entry = picture size)
+    struct TileLayout {
+        std::vector<int> column_bounds;
+        std::vector<int> row_bounds;
+    };
+    
+    // Substream = a run of CTUs coded by one CABAC engine, in bitstream order
+    struct Substream {
+        int tile_x0, tile_x1; // CTU columns [x0, x1)
+        int tile_y0, tile_y1; // CTU rows of the tile [y0, y1)
+        int row;              // First CTU row (WPP: the only row)
+        int row_end;          // One past the last CTU row
+    };
     
 private:
     uint32_t width_ = 0;
@@ -58,14 +202,67 @@ private:
     uint32_t bitrate_ = 1000000;
     uint32_t gop_size_ = 30;
     uint32_t frame_count_ = 0;
+    uint32_t last_keyframe_ = 0;
+    bool is_keyframe_ = true;
+    IntraRefresh intra_refresh_;
+    bool recovery_point_ = false; // The frame starts an intra refresh sweep
     
     int ctu_size_ = 64; // HEVC uses larger CTUs (64x64)
     int max_cu_depth_ = 3; // Maximum CU split depth
     int current_qp_ = 32; // HEVC uses different QP range
+    int speed_preset_ = 5;
     
     std::unique_ptr<processing::DCT> dct_;
     std::unique_ptr<processing::Quantizer> quantizer_;
-    std::vector<uint8_t> reference_frames_;
+    
+    std::shared_ptr<ReferencePicturePool> reference_pool_;
+    DecodedPictureBuffer dpb_;
+    uint32_t max_reference_frames_ = 1;
+    const FrameView* current_frame_ = nullptr; // Frame being encoded (read-only in workers)
+    std::shared_ptr<ReferencePicture> reconstruction_; // Picture being reconstructed
+    
+    std::shared_ptr<performance::ThreadPool> thread_pool_;
+    RateController rate_control_;
+    bool entropy_coding_sync_ = true;
+    uint32_t tile_columns_ = 1;
+    uint32_t tile_rows_ = 1;
+    TileLayout tiles_;
+    std::vector<Substream> substreams_;
+    
+    // Per-frame state, kept so steady-state frames do not allocate. Sized for the
+    // substream layout in encode_slice_data().
+    utils::BitstreamWriter writer_;
+    std::vector<utils::BitstreamWriter> substream_writers_;
+    std::vector<SubstreamCoder> coders_;
+    std::vector<CabacContexts> sync_contexts_;             // WPP: contexts after the second CTU
+    std::unique_ptr<std::atomic<int>[]> substream_progress_; // CTUs finished per substream
+    std::vector<size_t> entry_point_sizes_;
+    std::vector<std::future<void>> futures_;
+    
+    std::chrono::microseconds intra_time_budget_{0};
+    std::vector<uint8_t> intra_modes_; // Luma intra mode per 8x8 block (DC for inter), for the MPMs
+    std::atomic<uint64_t> intra_modes_evaluated_{0};
+    
+    bool deblocking_ = true;
+    processing::HevcDeblockingFilter deblocking_filter_;
+    std::mutex deblocking_mutex_;
+    std::vector<uint8_t> rows_reconstructed_; // Per CTU row; guarded by deblocking_mutex_
+    int deblocked_rows_ = 0;                  // Guarded by deblocking_mutex_
+
+    // Settings a stream can change, as initialize() left them (reset())
+    struct Settings {
+        uint32_t gop_size = 30;
+        uint32_t intra_refresh_period = 0;
+        RateControlConfig rate_control;
+        int speed_preset = 5;
+        uint32_t max_reference_frames = 1;
+        bool entropy_coding_sync = true;
+        uint32_t tile_columns = 1;
+        uint32_t tile_rows = 1;
+        bool deblocking = true;
+        std::chrono::microseconds intra_time_budget{0};
+    };
+    Settings initial_settings_;
 };
 
 } // namespace codec
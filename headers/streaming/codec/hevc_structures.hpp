@@ -1,20 +1,18 @@
 // include/streaming/codec/hevc_structures.hpp
 #pragma once
 
+#include "block_buffer.hpp"
 #include <cstdint>
 #include <array>
 
 namespace streaming {
 namespace codec {
 
-// HEVC uses Coding Tree Units (CTU) instead of macroblocks
+// HEVC uses Coding Tree Units (CTU) instead of macroblocks. Their block data lives in a
+// CTUBlockArena per worker, reused from CTU to CTU.
 struct CTU {
     static constexpr int MAX_CU_SIZE = 64;
     static constexpr int MIN_CU_SIZE = 8;
-    
-    std::array<std::array<int16_t, MAX_CU_SIZE>, MAX_CU_SIZE> y_samples;
-    std::array<std::array<int16_t, MAX_CU_SIZE/2>, MAX_CU_SIZE/2> u_samples;
-    std::array<std::array<int16_t, MAX_CU_SIZE/2>, MAX_CU_SIZE/2> v_samples;
 };
 
 // HEVC Prediction Units (PU)
@@ -33,11 +31,12 @@ struct PredictionUnit {
     Type type;
     int16_t mv_x, mv_y; // Motion vector
     uint8_t ref_idx;    // Reference index
+    uint8_t intra_mode; // Luma intra mode: 0 planar, 1 DC, 2..34 angular
 };
 
-// HEVC Transform Units (TU)
+// HEVC Transform Units (TU): a view on the coefficients in the CTU's arena
 struct TransformUnit {
-    std::array<std::array<int16_t, 32>, 32> coeffs; // Up to 32x32 transforms
+    BlockView<int16_t> coeffs; // Up to 32x32 transforms
     uint8_t transform_size;
 };
 
@@ -0,0 +1,90 @@
+// include/streaming/codec/intra_refresh.hpp
+#pragma once
+
+#include "../processing/motion_estimation.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace streaming {
+namespace codec {
+
+// Periodic intra refresh in place of periodic keyframes: a column of intra blocks sweeps
+// the picture left to right over `period` inter frames, so every frame carries about the
+// same share of intra blocks and the bitrate stays flat. A decoder joining at the first
+// frame of a sweep (the recovery point) has an exact picture once the sweep is done:
+//
+// - all blocks predict from the previous frame only: older references hold parts that
+//   were not refreshed when the decoder joined
+// - blocks left of the column were refreshed earlier in the sweep; they only read the
+//   previous frame left of reference_limit() (the refreshed part, less what the in-loop
+//   filters changed across the old column edge)
+// - intra blocks whose above-right samples lie right of the column must not use them, they
+//   are not refreshed yet (reads_unrefreshed())
+// - blocks right of the column are free
+class IntraRefresh {
+public:
+    // Samples the in-loop filters change left of the old column edge (deblocking 3, SAO 1)
+    static constexpr int REFERENCE_MARGIN = 4;
+
+    // Frames per sweep, 0 = off
+    void set_period(uint32_t period) {
+        period_ = period;
+        restart();
+    }
+    // Picture width and the width of the blocks the column is made of (MB, CTU, superblock)
+    void set_geometry(uint32_t width, uint32_t unit) {
+        width_ = static_cast<int>(width);
+        unit_ = std::max(1u, unit);
+        restart();
+    }
+
+    bool enabled() const { return period_ > 0; }
+    uint32_t period() const { return period_; }
+
+    // After a keyframe: the next inter frame starts a sweep
+    void restart() {
+        position_ = 0;
+        active_ = false;
+    }
+
+    // Places the column of the next inter frame (keyframes call restart() instead).
+    // True when the frame starts a sweep, i.e. is a recovery point.
+    bool begin_frame() {
+        active_ = enabled() && width_ > 0;
+        if (!active_) return false;
+
+        const uint32_t units = (static_cast<uint32_t>(width_) + unit_ - 1) / unit_;
+        column_x0_ = static_cast<int>(position_ * units / period_ * unit_);
+        column_x1_ = std::min(static_cast<int>((position_ + 1) * units / period_ * unit_), width_);
+        const bool sweep_start = position_ == 0;
+        position_ = (position_ + 1) % period_;
+        return sweep_start;
+    }
+
+    // Block of width w at x overlaps the column and has to be intra
+    bool forces_intra(int x, int w) const { return active_ && x < column_x1_ && x + w > column_x0_; }
+    // Intra block at x (column or refreshed part) whose above samples, up to
+    // x + above_length, reach past the column into samples not refreshed yet
+    bool reads_unrefreshed(int x, int above_length) const {
+        return active_ && x < column_x1_ && x + above_length > column_x1_ && column_x1_ < width_;
+    }
+    // Blocks left of the column, see reference_limit()
+    bool limits_references(int x) const { return active_ && x < column_x0_; }
+    // Column of the previous frame the reference samples of a block at x must stay left of
+    // (MotionEstimator::set_reference_limit)
+    int reference_limit(int x) const {
+        return limits_references(x) ? column_x0_ - REFERENCE_MARGIN : processing::MotionEstimator::NO_REFERENCE_LIMIT;
+    }
+
+private:
+    uint32_t period_ = 0;
+    int width_ = 0;
+    uint32_t unit_ = 16;
+    uint32_t position_ = 0; // Frame of the sweep the next begin_frame() places
+    bool active_ = false;   // The current frame has a column
+    int column_x0_ = 0;
+    int column_x1_ = 0;
+};
+
+} // namespace codec
+} // namespace streaming
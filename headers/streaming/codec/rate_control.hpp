@@ -0,0 +1,194 @@
+// include/streaming/codec/rate_control.hpp
+#pragma once
+
+#include "video_codec.hpp"
+#include "frame_analysis.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace streaming {
+namespace codec {
+
+enum class RateControlMode {
+    CQP,  // Fixed QP
+    CBR,  // Constant bitrate; the VBV buffer is kept from underflowing and overflowing
+    VBR,  // Average bitrate; peaks up to max_bitrate as long as the VBV allows
+    CRF   // Constant quality; optionally capped by a VBV
+};
+
+struct RateControlConfig {
+    RateControlMode mode = RateControlMode::CBR;
+    uint32_t bitrate = 1000000;       // Average target (CBR / VBR), bits per second
+    uint32_t max_bitrate = 0;         // VBV fill rate; 0 = bitrate (CBR) or 2 x bitrate (VBR)
+    uint32_t vbv_buffer_size = 0;     // Bits; 0 = one second of max_bitrate (CRF: no VBV)
+    double vbv_initial_fullness = 0.9;
+    double fps = 30.0;
+
+    int qp = 26;                      // CQP
+    double crf = 23.0;                // CRF quality, QP scale
+    int min_qp = 10;
+    int max_qp = 51;
+    double qcompress = 0.6;           // 0 = constant bitrate per frame, 1 = constant QP
+    double ip_factor = 1.4;           // Keyframe quantizer step relative to P frames
+
+    uint32_t lookahead_frames = 0;    // 0-40 frames planned ahead for the VBV
+
+    // Pre-analysis, also applied in CQP mode
+    double aq_strength = 1.0;         // Per-block QP offsets from activity; 0 = off
+    double scenecut_threshold = 0.4;  // Keyframe when inter cost >= (1 - t) x intra; 0 = off
+    uint32_t min_keyframe_interval = 10;
+    bool external_analysis = false;   // Analyses come from submit_analysis(); no analysis thread
+
+    bool operator==(const RateControlConfig&) const = default;
+};
+
+// Frame-level rate controller used by all encoders. QPs are on the H.264 / HEVC scale
+// (0-51, quantizer step doubles every 6); encoders map them to their own range.
+//
+// Per frame: qp = begin_frame(frame, keyframe_requested), encode (keyframe if is_keyframe(),
+// block QPs from block_qp()), end_frame(bytes).
+// Analysis runs on a separate thread. Frames may be handed to submit_lookahead() ahead of
+// encoding (in coding order, every frame) so it overlaps the encode of earlier frames;
+// begin_frame() then also uses the analysed future frames to plan the VBV. With
+// external_analysis, submit_analysis() takes that role and nothing is analysed here.
+class RateController {
+public:
+    RateController();
+    explicit RateController(const RateControlConfig& config);
+    ~RateController();
+
+    RateController(const RateController&) = delete;
+    RateController& operator=(const RateController&) = delete;
+
+    // Resets all statistics and the buffer model
+    void configure(const RateControlConfig& config);
+    // Same reset with the current configuration, keeping the analysis thread and its
+    // buffers (a new stream on the same encoder)
+    void reset();
+    // Same reset back to a configuration, e.g. the one a pooled encoder was set up with.
+    // Bitrate and QP range change in place; any other difference goes through configure().
+    void reset(const RateControlConfig& config);
+    const RateControlConfig& config() const { return config_; }
+    // New target; the buffer state and the model are kept
+    void set_bitrate(uint32_t bitrate);
+    // New bounds for rate-controlled QPs (not CQP), same as set_bitrate
+    void set_qp_range(int min_qp, int max_qp);
+    // Off: scene cuts are still reported (is_scene_cut()) but coded as P frames, e.g. with
+    // intra refresh in place of keyframes. Kept across configure() and reset().
+    void set_scene_cut_keyframes(bool enabled) { scene_cut_keyframes_ = enabled; }
+
+    void submit_lookahead(const FrameView& frame);
+    void submit_lookahead(const VideoFrame& frame) { submit_lookahead(FrameView::from(frame)); }
+    // Analysis done elsewhere (e.g. once per ABR ladder), in place of the frame
+    void submit_analysis(const FrameAnalysis& analysis);
+
+    int begin_frame(const FrameView& frame, bool keyframe_requested);
+    int begin_frame(const VideoFrame& frame, bool keyframe_requested) {
+        return begin_frame(FrameView::from(frame), keyframe_requested);
+    }
+    void end_frame(size_t bytes);
+
+    // Decisions for the frame between begin_frame() and end_frame(); safe to call from
+    // encoder worker threads
+    bool is_keyframe() const { return current_.is_keyframe; }
+    bool is_scene_cut() const { return current_.scene_cut; }
+    int block_qp(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const;
+    const FrameAnalysis& analysis() const { return current_.analysis; }
+
+    uint64_t total_bits() const { return total_bits_; }
+    uint32_t frames_encoded() const { return frames_; }
+    double average_bitrate() const;
+    double vbv_fullness() const { return vbv_fullness_; }    // Bits in the decoder buffer
+    double vbv_buffer_size() const { return vbv_size_; }
+    uint32_t vbv_underflows() const { return underflows_; }
+    int last_qp() const { return last_qp_; }
+
+    // The frame predicts hardly better from the previous one than on its own
+    static bool is_scene_cut(const FrameAnalysis& analysis, double threshold);
+
+    static double qp_to_qscale(double qp);
+    static double qscale_to_qp(double qscale);
+
+private:
+    // Frame size model: bits = coeff * complexity / qscale (per frame type)
+    struct Predictor {
+        double coeff = 2.0;
+        double count = 1.0;
+
+        double predict(double qscale, double complexity) const { return coeff / count * complexity / qscale; }
+        void update(double qscale, double complexity, double bits);
+    };
+
+    struct LookaheadEntry {
+        std::vector<uint8_t> luma;
+        int width = 0;
+        int height = 0;
+        FrameAnalysis analysis;
+        bool done = false;
+    };
+
+    struct PendingFrame {
+        FrameAnalysis analysis;
+        double cost = 0.0;        // Complexity used for this frame type
+        double qscale = 1.0;
+        double blurred = 1.0;     // Blurred P complexity that set the quantizer
+        bool is_keyframe = false;
+        bool scene_cut = false;
+        bool active = false;
+    };
+
+    void reset_statistics();
+    void update_vbv_parameters();
+    bool needs_analysis() const;
+    double frame_cost(const FrameAnalysis& analysis, bool is_keyframe) const;
+    double clip_vbv(double qscale, double cost, bool is_keyframe, const std::vector<double>& future_costs);
+    void start_lookahead();
+    void stop_lookahead();
+    void lookahead_loop();
+    void push_lookahead_locked(const FrameView& frame);
+    std::unique_ptr<LookaheadEntry> take_entry_locked();
+
+    RateControlConfig config_;
+    double vbv_size_ = 0.0;
+    double vbv_rate_ = 0.0;       // Bits added to the buffer per frame
+    double vbv_fullness_ = 0.0;
+
+    Predictor predictors_[2];     // [0] = P, [1] = keyframe
+    double short_term_cplx_sum_ = 0.0;
+    double short_term_cplx_count_ = 0.0;
+    double cplxr_sum_ = 0.0;      // Sum of bits * qscale / rceq (ABR rate factor)
+    double wanted_bits_window_ = 0.0;
+    double cbr_decay_ = 1.0;
+    double last_p_qscale_ = 0.0;
+    double abr_bits_ = 0.0;       // Since the last bitrate change
+    double abr_wanted_bits_ = 0.0;
+
+    uint64_t total_bits_ = 0;
+    uint32_t frames_ = 0;
+    uint32_t underflows_ = 0;
+    int last_qp_ = 26;
+    uint32_t frames_since_keyframe_ = 0;
+    bool scene_cut_keyframes_ = true;
+    PendingFrame current_;
+    std::vector<double> future_costs_;
+
+    FrameAnalyzer analyzer_;      // Owned by the lookahead thread while it runs
+
+    std::thread lookahead_thread_;
+    std::mutex mutex_;
+    std::condition_variable work_condition_;
+    std::condition_variable done_condition_;
+    // Entries live on the heap so the thread's reference survives pushes and pops; a
+    // vector queue (front erased) stops allocating once it has held the longest window
+    std::vector<std::unique_ptr<LookaheadEntry>> lookahead_;
+    size_t next_to_analyze_ = 0;
+    std::vector<std::unique_ptr<LookaheadEntry>> spare_entries_;
+    bool stop_ = false;
+};
+
+} // namespace codec
+} // namespace streaming
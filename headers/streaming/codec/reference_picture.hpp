@@ -0,0 +1,153 @@
+// include/streaming/codec/reference_picture.hpp
+#pragma once
+
+#include "video_codec.hpp"
+#include "../processing/motion_estimation.hpp"
+#include "../processing/subpel_interpolation.hpp"
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace streaming {
+namespace codec {
+
+// YUV420 picture with border-extended planes, used as a motion compensation reference.
+// Any vector that stays within PADDING pixels of the frame reads valid samples,
+// so motion search needs no per-candidate bounds checks.
+class ReferencePicture {
+public:
+    static constexpr int PADDING = 64;     // Luma padding (chroma uses PADDING / 2)
+    static constexpr int ALIGNMENT = 64;   // Cache line
+
+    struct Plane {
+        uint8_t* origin = nullptr;  // Pixel (0, 0)
+        int stride = 0;
+        int width = 0;
+        int height = 0;
+        int padding = 0;
+
+        uint8_t* row(int y) const { return origin + static_cast<ptrdiff_t>(y) * stride; }
+    };
+
+    enum PlaneId { Y = 0, U = 1, V = 2 };
+
+    ReferencePicture(uint32_t width, uint32_t height);
+
+    // Copy a YUV420 frame into the picture and extend its borders
+    void import_frame(const FrameView& frame);
+    void import_frame(const VideoFrame& frame) { import_frame(FrameView::from(frame)); }
+    // Replicate edge pixels into the padding (call after writing reconstructed samples)
+    void extend_borders();
+
+    // Decoding progress, so a picture can be a reference while it is still being decoded
+    // (frame threading). begin_decoding() marks every row pending; the decoding thread
+    // reports luma rows top to bottom (their borders are extended on the way) and readers
+    // wait for the rows they touch. Pictures not being decoded count as complete.
+    void begin_decoding();
+    void report_rows(int rows);
+    void wait_rows(int rows) const;
+    void finish_decoding(); // All rows, chroma borders too
+
+    const Plane& plane(PlaneId id) const { return planes_[id]; }
+    Plane& plane(PlaneId id) { return planes_[id]; }
+
+    // Motion search view of the luma plane
+    processing::ReferencePlane luma_view() const;
+    // Non-owning view of the visible picture (e.g. a decoded picture handed to an encoder)
+    FrameView view() const;
+
+    // Half-pel planes, built on first use and cached until the picture is rewritten
+    const processing::HalfPelPlanes& subpel_planes(processing::SubpelFilterType type);
+
+    // Luma motion compensation at quarter-pel position (qx, qy) of the picture. Full-pel
+    // positions are read from the padded plane, the others from the half-pel planes if
+    // they are built, else interpolated for the block alone (same samples either way).
+    // Const apart from the lazily built planes, so concurrent calls are safe.
+    // Throws std::out_of_range when the block leaves the readable area.
+    void predict_luma(processing::SubpelFilterType type, int qx, int qy, int block_w, int block_h,
+                      uint8_t* dst, int dst_stride) const;
+
+    uint32_t width() const { return width_; }
+    uint32_t height() const { return height_; }
+
+    uint64_t picture_order = 0;  // POC / frame number of the picture
+    bool is_keyframe = false;
+
+private:
+    // Left padding is rounded up to the alignment so every plane origin stays aligned
+    static constexpr int left_margin(int padding) { return (padding + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+    void extend_rows(Plane& p, int first_row, int end_row);
+
+    struct AlignedFree {
+        void operator()(uint8_t* p) const { std::free(p); }
+    };
+
+    uint32_t width_;
+    uint32_t height_;
+    std::unique_ptr<uint8_t, AlignedFree> storage_;
+    std::array<Plane, 3> planes_;
+
+    processing::HalfPelPlanes subpel_;
+    bool subpel_valid_ = false;
+    std::atomic<int> decoded_rows_{INT_MAX}; // Luma rows final (borders included)
+};
+
+// Refcounted pool of reference pictures. Pictures handed out by acquire() return to the
+// pool when their last shared_ptr is released, and the shared_ptr control blocks are
+// recycled the same way, so steady-state encoding does not allocate.
+// A pool can be shared by several encoders of the same resolution.
+class ReferencePicturePool {
+public:
+    static std::shared_ptr<ReferencePicturePool> create(uint32_t width, uint32_t height);
+
+    std::shared_ptr<ReferencePicture> acquire();
+
+    uint32_t width() const { return width_; }
+    uint32_t height() const { return height_; }
+    size_t allocated_count() const;
+    size_t free_count() const;
+
+private:
+    ReferencePicturePool(uint32_t width, uint32_t height) : width_(width), height_(height) {}
+
+    void release(ReferencePicture* picture);
+
+    struct ControlBlockCache;
+
+    uint32_t width_;
+    uint32_t height_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ReferencePicture>> free_list_;
+    size_t allocated_ = 0;
+    std::weak_ptr<ReferencePicturePool> self_;
+    std::shared_ptr<ControlBlockCache> control_blocks_; // Outlives the pool while pictures are out
+};
+
+// Sliding-window decoded picture buffer; index 0 is the most recent reference.
+// A vector (at most 16 entries, shifted on push) so pushes never allocate.
+class DecodedPictureBuffer {
+public:
+    explicit DecodedPictureBuffer(size_t max_references = 1) { set_max_references(max_references); }
+
+    void set_max_references(size_t max_references);
+    size_t max_references() const { return max_references_; }
+
+    void push(std::shared_ptr<ReferencePicture> picture);
+    void clear() { references_.clear(); }
+
+    size_t size() const { return references_.size(); }
+    bool empty() const { return references_.empty(); }
+    const std::shared_ptr<ReferencePicture>& get(size_t index) const { return references_[index]; }
+
+private:
+    size_t max_references_ = 1;
+    std::vector<std::shared_ptr<ReferencePicture>> references_;
+};
+
+} // namespace codec
+} // namespace streaming
@@ -2,7 +2,10 @@
 #pragma once
 
 #include "../engine/types.hpp"
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <vector>
 #include <memory>
 
@@ -11,13 +14,56 @@ namespace codec {
 
 struct VideoFrame {
     std::vector<uint8_t> data;
-    uint32_t width;
-    uint32_t height;
-    uint32_t stride;
-    uint64_t timestamp;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t stride = 0; // 0 = width
+    uint64_t timestamp = 0;
     bool keyframe = false;
 };
 
+struct PlaneView {
+    const uint8_t* data = nullptr;
+    uint32_t stride = 0;
+};
+
+// Non-owning view of a YUV420 frame (e.g. a capture or decoder buffer). Chroma planes
+// are optional; without them the encoders code mid-grey chroma.
+struct FrameView {
+    std::array<PlaneView, 3> planes{};
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t timestamp = 0;
+    bool keyframe = false;
+
+    const uint8_t* luma() const { return planes[0].data; }
+    uint32_t luma_stride() const { return planes[0].stride ? planes[0].stride : width; }
+    bool has_chroma() const { return planes[1].data && planes[2].data; }
+
+    // View of a packed VideoFrame: chroma planes follow the luma plane with half its stride
+    static FrameView from(const VideoFrame& frame) {
+        FrameView view;
+        view.width = frame.width;
+        view.height = frame.height;
+        view.timestamp = frame.timestamp;
+        view.keyframe = frame.keyframe;
+
+        // A stride below the width cannot be right; treat it as unset
+        const uint32_t stride = frame.stride >= frame.width ? frame.stride : frame.width;
+        const size_t luma_size = static_cast<size_t>(stride) * frame.height;
+        const uint32_t chroma_stride = (stride + 1) / 2;
+        const size_t chroma_size = static_cast<size_t>(chroma_stride) * ((frame.height + 1) / 2);
+        view.planes[0] = {frame.data.data(), stride};
+        if (frame.data.size() >= luma_size + 2 * chroma_size) {
+            view.planes[1] = {frame.data.data() + luma_size, chroma_stride};
+            view.planes[2] = {frame.data.data() + luma_size + chroma_size, chroma_stride};
+        }
+        return view;
+    }
+};
+
+struct RateControlConfig;
+class RateController;
+
 class IVideoEncoder {
 public:
     virtual ~IVideoEncoder() = default;
@@ -25,9 +71,45 @@ public:
     virtual bool initialize(uint32_t width, uint32_t height, uint32_t fps, 
                            uint32_t bitrate) = 0;
     virtual bool encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) = 0;
+    // Allocation-free variant. The access unit is swapped into output and output's previous
+    // buffer becomes the encoder's next bitstream buffer, so passing the same vector every
+    // frame stops allocating once both buffers have held the largest access unit.
+    virtual bool encode_frame(const FrameView& input, std::vector<uint8_t>& output) = 0;
     virtual void set_bitrate(uint32_t bitrate) = 0;
     virtual void set_gop_size(uint32_t gop_size) = 0;
     virtual uint32_t get_encoded_size() const = 0;
+    // Starts a new stream with the settings initialize() left, undoing whatever the last
+    // stream changed (rate control, GOP, intra refresh, preset, ...) and dropping the slice
+    // output: the next frame is an IDR, references and rate control statistics are
+    // dropped, buffers and threads are kept (EncoderPool)
+    virtual void reset() = 0;
+    
+    // Frame-level rate control (rate_control.hpp); initialize() sets up CBR at the given
+    // bitrate, set_rate_control() switches mode, VBV and lookahead
+    virtual void set_rate_control(const RateControlConfig& config) = 0;
+    virtual RateController& rate_control() = 0;
+
+    // Speed / quality trade-off, 0 = best .. 9 = fastest, safe to change between frames.
+    // False if the encoder has no presets.
+    virtual bool set_speed_preset(int speed) { (void)speed; return false; }
+    // Current preset, -1 if the encoder has none
+    virtual int speed_preset() const { return -1; }
+
+    // Called with each slice NAL unit (start code included, parameter sets with the first)
+    // as soon as it is coded, in order and before encode_frame() returns; the access unit
+    // still goes to output. False if the encoder cannot hand out slices early.
+    using SliceOutput = std::function<void(const uint8_t* data, size_t size)>;
+    virtual bool set_slice_output(SliceOutput output) { (void)output; return false; }
+    
+    // Intra refresh every `period` frames in place of periodic and scene-cut keyframes, so
+    // no frame is much larger than the others (0 = off). Requested keyframes stay. False if
+    // the encoder has no intra refresh.
+    virtual bool set_intra_refresh(uint32_t period) { (void)period; return false; }
+    virtual uint32_t intra_refresh_period() const { return 0; }
+
+    // Luma of the last coded picture as a decoder reconstructs it (quality measurement),
+    // valid until the next encode_frame(). No luma plane if the encoder codes open loop.
+    virtual FrameView reconstructed_frame() const { return FrameView(); }
 };
 
 class IVideoDecoder {
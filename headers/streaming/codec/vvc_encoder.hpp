@@ -2,10 +2,18 @@
 #pragma once
 
 #include "video_codec.hpp"
+#include "rate_control.hpp"
 #include "vvc_structures.hpp"
+#include "reference_picture.hpp"
 #include "../utils/bitstream.hpp"
 #include "../processing/dct_transform.hpp"
 #include "../processing/quantization.hpp"
+#include "../processing/vvc_entropy.hpp"
+#include "../processing/intra_prediction.hpp"
+#include "../processing/partition_search.hpp"
+#include "../performance/parallelization.hpp"
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <vector>
 
@@ -17,9 +25,10 @@ private:
     struct VVCCodingUnit {
         int x, y;
         int width, height;
-        VVCPartitionType partition_type;
-        VVCPredictionMode pred_mode;
-        VVCTransformUnit transform;
+        VVCPartitionType partition_type = VVCPartitionType::NO_SPLIT;
+        int mtt_depth = 0; // Binary / ternary splits between the quad-tree leaf and this CU
+        VVCPredictionMode pred_mode = VVCPredictionMode::INTRA_DC;
+        VVCTransformUnit transform{}; // Coefficient view bound to the arena when the CU is coded
         
         // VVC-specific advanced features
         bool use_mip = false;        // Matrix-based Intra Prediction
@@ -36,27 +45,81 @@ public:
     bool initialize(uint32_t width, uint32_t height, uint32_t fps, 
                    uint32_t bitrate) override;
     bool encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) override;
+    bool encode_frame(const FrameView& input, std::vector<uint8_t>& output) override;
     void set_bitrate(uint32_t bitrate) override;
     void set_gop_size(uint32_t gop_size) override;
     uint32_t get_encoded_size() const override;
+    void reset() override;
+    void set_rate_control(const RateControlConfig& config) override;
+    RateController& rate_control() override { return rate_control_; }
 
     // VVC-specific advanced features
     void enable_advanced_tools(const VVCAdvancedFeatures& features);
-    void set_complexity_level(int level); // 0=simple, 10=full
+    void set_complexity_level(int level); // 0=simple, 10=full (partition search: speed preset 9 .. 0)
+    bool set_speed_preset(int speed) override; // Complexity level 10 .. 0 for presets 0 .. 9
+    int speed_preset() const override { return (10 - complexity_level_) * 9 / 10; }
+    // Every CU is intra coded (no inter prediction yet), so every frame refreshes the
+    // whole picture already: intra refresh only drops the periodic and scene-cut keyframes
+    bool set_intra_refresh(uint32_t period) override;
+    uint32_t intra_refresh_period() const override { return intra_refresh_period_; }
     void set_parallel_processing(bool enabled);
+    
+    // Worker pool for CTU encoding; created on initialize if parallel processing is on
+    // and none was given. The pool must not be the one running encode_frame.
+    void set_thread_pool(std::shared_ptr<performance::ThreadPool> pool) { thread_pool_ = std::move(pool); }
+    // WPP (entropy_coding_sync): one substream per CTU row, contexts inherited from the
+    // first CTU of the row above. Off = single substream, only CTU analysis runs in parallel.
+    void set_wavefront(bool enabled) { entropy_coding_sync_ = enabled; }
+
+    // Number of previous frames kept as references (DPB size, default 1)
+    void set_max_reference_frames(uint32_t count);
+    // Share reference pictures with other encoders of the same resolution
+    void set_reference_pool(std::shared_ptr<ReferencePicturePool> pool) { reference_pool_ = std::move(pool); }
+    
+    // Time per CTU for the intra mode decision over the 67 modes (0 = unlimited,
+    // deterministic output). Past it each CU keeps the best mode found so far.
+    void set_intra_time_budget(std::chrono::microseconds budget) { intra_time_budget_ = budget; }
+    // Intra prediction modes evaluated since initialize()
+    uint64_t intra_modes_evaluated() const { return intra_modes_evaluated_.load(std::memory_order_relaxed); }
 
 private:
-    bool encode_vvc_nal_units(const VideoFrame& frame, utils::BitstreamWriter& writer);
+    bool encode_vvc_nal_units(const FrameView& frame, utils::BitstreamWriter& writer);
     void encode_sps(utils::BitstreamWriter& writer); // Sequence Parameter Set
     void encode_pps(utils::BitstreamWriter& writer); // Picture Parameter Set
     void encode_slice_header(utils::BitstreamWriter& writer, bool is_idr);
-    void encode_ctu(utils::BitstreamWriter& writer, const VVCCTU& ctu, int x, int y);
+    void encode_slice_data(int ctus_width, int ctus_height);
+    void encode_ctu_row(int row, int ctus_width);
+    
+    // CTU analysis (partition decisions, pure) and CTU entropy coding are separate,
+    // so analysis can run in parallel even when the bitstream is a single substream
+    void analyze_ctu(int x, int y, processing::BlockStatistics& statistics, std::vector<VVCPartitionType>& decisions);
+    void encode_ctu(processing::VVCCABACEncoder& cabac, int x, int y, const std::vector<VVCPartitionType>& decisions,
+                    processing::IntraModeSearch& intra_search, CTUBlockArena& coefficients);
     
     // VVC'nin yeni algoritmaları
-    void mtt_partition_decision(VVCCodingUnit& cu, double& best_cost);
-    void encode_mtt_structure(utils::BitstreamWriter& writer, const VVCCodingUnit& cu);
-    void encode_affine_motion(utils::BitstreamWriter& writer, const VVCCodingUnit& cu);
-    void encode_geometric_partition(utils::BitstreamWriter& writer, const VVCCodingUnit& cu);
+    // Decisions are appended in pre-order (parent before children)
+    void mtt_partition_decision(const processing::BlockStatistics& statistics, VVCCodingUnit& cu, double& best_cost,
+                                std::vector<VVCPartitionType>& decisions);
+    void encode_mtt_structure(processing::VVCCABACEncoder& cabac, const VVCCodingUnit& cu,
+                              const std::vector<VVCPartitionType>& decisions, size_t& decision_index,
+                              processing::IntraModeSearch& intra_search, CTUBlockArena& coefficients);
+    // Luma intra mode (0 planar, 1 DC, 2..66 angular) of a leaf CU, chosen on SATD against
+    // a prediction from the neighbouring source samples plus the rate under `contexts`
+    int decide_intra_mode(const VVCCodingUnit& cu, processing::IntraModeSearch& search,
+                          const processing::VVCCABACEncoder::ContextSet& contexts) const;
+    // Coefficients, MTS index and motion data go through the coder as bypass bins
+    void encode_transform_info(processing::VVCCABACEncoder& cabac, const VVCTransformUnit& tu);
+    void encode_affine_motion(processing::VVCCABACEncoder& cabac, const VVCCodingUnit& cu);
+    void encode_geometric_partition(processing::VVCCABACEncoder& cabac, const VVCCodingUnit& cu);
+    bool is_partition_allowed(const VVCCodingUnit& cu, VVCPartitionType partition,
+                              const processing::PartitionSearchConfig& config) const;
+    double evaluate_mtt_partition_cost(const processing::BlockStatistics& statistics, double lambda,
+                                       const VVCCodingUnit& cu, VVCPartitionType partition);
+    double calculate_vvc_residual_cost(const processing::BlockStatistics& statistics, double lambda,
+                                       const VVCCodingUnit& cu) const;
+    double calculate_mtt_partition_rate(const VVCCodingUnit& cu, VVCPartitionType partition) const;
+    void setup_child_cu(const VVCCodingUnit& parent, VVCCodingUnit& child, int index);
+    static int get_num_children(VVCPartitionType partition);
     
     // Yeni VVC teknolojileri
     void apply_matrix_intra_prediction(VVCCodingUnit& cu);
@@ -71,6 +134,9 @@ private:
     uint32_t bitrate_ = 1000000;
     uint32_t gop_size_ = 32;
     uint32_t frame_count_ = 0;
+    uint32_t last_keyframe_ = 0;
+    bool is_keyframe_ = true;
+    uint32_t intra_refresh_period_ = 0;
     
     int ctu_size_ = 128;        // VVC: 128x128 default (256x256'a kadar)
     int max_mtt_depth_ = 4;     // Multi-Type Tree max depth
@@ -79,13 +145,50 @@ private:
     
     VVCAdvancedFeatures features_;
     bool parallel_processing_ = true;
+    bool entropy_coding_sync_ = true;
+    std::shared_ptr<performance::ThreadPool> thread_pool_;
+    RateController rate_control_;
+    const FrameView* current_frame_ = nullptr; // Frame being encoded (read-only in workers)
     
     std::unique_ptr<processing::DCT> dct_;
     std::unique_ptr<processing::Quantizer> quantizer_;
-    std::vector<uint8_t> reference_frames_;
+    
+    std::shared_ptr<ReferencePicturePool> reference_pool_;
+    DecodedPictureBuffer dpb_;
+    uint32_t max_reference_frames_ = 1;
+    
+    std::chrono::microseconds intra_time_budget_{0};
+    std::atomic<uint64_t> intra_modes_evaluated_{0};
     
     // VVC için yeni buffer'lar
     std::vector<uint8_t> ibc_buffer_; // Intra Block Copy buffer
+    
+    // Per-frame state, kept so steady-state frames do not allocate
+    utils::BitstreamWriter writer_;
+    std::vector<utils::BitstreamWriter> substream_writers_;     // One per CTU row with WPP
+    std::vector<processing::VVCCABACEncoder> row_cabacs_;       // Coder of each substream
+    std::vector<processing::VVCCABACEncoder::ContextSet> sync_contexts_; // WPP: contexts after the first CTU
+    processing::VVCCABACEncoder::ContextSet analysis_contexts_; // Initial contexts of the slice, price split flags
+    std::unique_ptr<std::atomic<int>[]> row_progress_;           // CTUs finished per row
+    std::vector<std::vector<VVCPartitionType>> ctu_decisions_;  // Per CTU, raster order
+    std::vector<processing::BlockStatistics> row_statistics_;   // Per CTU row, of the CTU being analysed
+    std::vector<CTUBlockArena> row_coefficients_;               // Per CTU row, of the CTU being coded
+    std::vector<size_t> entry_point_sizes_;
+    std::vector<std::future<void>> futures_;
+
+    // Settings a stream can change, as initialize() left them (reset())
+    struct Settings {
+        uint32_t gop_size = 32;
+        uint32_t intra_refresh_period = 0;
+        RateControlConfig rate_control;
+        int complexity_level = 5;
+        VVCAdvancedFeatures features;
+        bool parallel_processing = true;
+        bool entropy_coding_sync = true;
+        uint32_t max_reference_frames = 1;
+        std::chrono::microseconds intra_time_budget{0};
+    };
+    Settings initial_settings_;
 };
 
 } // namespace codec
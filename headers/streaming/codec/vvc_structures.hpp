@@ -1,6 +1,7 @@
 // include/streaming/codec/vvc_structures.hpp
 #pragma once
 
+#include "block_buffer.hpp"
 #include <cstdint>
 #include <array>
 #include <vector>
@@ -8,12 +9,10 @@
 namespace streaming {
 namespace codec {
 
-// VVC Coding Tree Units - 256x256'a kadar! (AV1'den 2x daha büyük)
+// VVC Coding Tree Units - 256x256'a kadar! (AV1'den 2x daha büyük). Block data lives in
+// a CTUBlockArena per worker, like HEVC's CTU.
 struct VVCCTU {
     static constexpr int MAX_SIZE = 256;
-    std::array<std::array<int16_t, MAX_SIZE>, MAX_SIZE> y_samples;
-    std::array<std::array<int16_t, MAX_SIZE/2>, MAX_SIZE/2> u_samples;
-    std::array<std::array<int16_t, MAX_SIZE/2>, MAX_SIZE/2> v_samples;
 };
 
 // VVC'nin Multi-Type Tree (MTT) partitioning'i
@@ -37,7 +36,7 @@ enum class VVCPredictionMode {
 
 // VVC Transform - DCT-II, DST-VII, LGT (yeni!)
 struct VVCTransformUnit {
-    std::array<std::array<int16_t, 64>, 64> coeffs; // 64x64'e kadar
+    BlockView<int16_t> coeffs;  // 64x64'e kadar, in the CTU's arena
     uint8_t tr_type;    // Transform type
     uint8_t tr_size;    // Transform size
     bool mts_enabled;   // Multiple Transform Selection
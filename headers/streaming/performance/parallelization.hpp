@@ -7,6 +7,10 @@
 #include <atomic>
 #include <queue>
 #include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <algorithm>
 
 namespace streaming {
 namespace performance {
@@ -23,6 +27,7 @@ public:
     void wait_all();
     size_t get_pending_tasks() const;
     size_t get_active_threads() const;
+    size_t get_thread_count() const { return workers_.size(); }
 
 private:
     void worker_loop();
@@ -31,6 +36,7 @@ private:
     std::queue<std::function<void()>> tasks_;
     mutable std::mutex queue_mutex_;
     std::condition_variable condition_;
+    std::condition_variable idle_condition_; // Signalled when a task finishes (wait_all)
     std::atomic<bool> stop_{false};
     std::atomic<size_t> active_threads_{0};
 };
@@ -67,8 +73,8 @@ public:
         size_t total = end - start;
         if (total == 0) return;
         
-        size_t num_chunks = std::min(total / min_chunk_size, 
-                                   std::thread::hardware_concurrency());
+        size_t num_chunks = std::min<size_t>(total / min_chunk_size, 
+                                           std::thread::hardware_concurrency());
         num_chunks = std::max(num_chunks, size_t(1));
         
         size_t chunk_size = (total + num_chunks - 1) / num_chunks;
@@ -2,12 +2,14 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <vector>
 #include <memory>
-#include <stack>
 #include <atomic>
+#include <mutex>
+#include <thread>
 
 namespace streaming {
 namespace performance {
@@ -26,33 +28,38 @@ public:
         uint32_t memory_usage = 0;
         uint32_t cache_misses = 0;
         uint32_t branch_mispredicts = 0;
+        uint64_t cpu_cycles = 0;
     };
 
     struct ThreadData {
-        std::stack<ProfileResult*> call_stack;
-        std::vector<ProfileResult> results;
-        uint32_t depth = 0;
+        std::vector<ProfileResult> open_samples; // Begun and not ended yet, innermost last
     };
 
     HighResProfiler();
     ~HighResProfiler();
     
+    // Samples are only recorded during a session; starting one drops the previous results,
+    // which stay queryable after end_session()
     void start_session(const std::string& name = "Session");
     void end_session();
+    bool session_active() const { return session_active_.load(std::memory_order_acquire); }
     
+    // Nested per thread; times are wall time in ns, aggregated per sample name
     void begin_sample(const std::string& name);
     void end_sample();
     
-    // Advanced profiling
+    // Advanced profiling, attributed to the innermost open sample of the calling thread
     void record_memory_usage(size_t bytes);
     void record_cache_misses(uint32_t misses);
     void record_branch_mispredicts(uint32_t mispredicts);
     void record_cpu_cycles(uint64_t cycles);
     
-    // Real-time statistics
+    // Real-time statistics (times in ms)
     double get_average_time(const std::string& sample_name) const;
     double get_throughput(const std::string& sample_name) const; // operations/sec
     uint32_t get_call_count(const std::string& sample_name) const;
+    // One entry per sample name, largest total time first
+    std::vector<ProfileResult> get_results() const;
     
     // Export results
     void export_to_chrome_tracing(const std::string& filename);
@@ -69,34 +76,42 @@ private:
     
     std::unordered_map<std::string, ProfileResult> results_;
     std::unordered_map<std::thread::id, ThreadData> thread_data_;
+    std::vector<ProfileResult> events_; // Completed samples for the Chrome trace
     mutable std::mutex mutex_;
     std::string current_session_;
-    bool session_active_ = false;
+    std::atomic<bool> session_active_{false}; // Checked before taking the lock
     
     // Performance counters
     std::atomic<uint64_t> total_samples_{0};
     std::atomic<uint64_t> total_duration_{0};
 };
 
-// RAII-based profiling macro
+// RAII-based profiling macro. Outside a session it costs the flag check: the name (a
+// literal or __FUNCTION__) only becomes a string once a sample is recorded.
 class ScopedProfiler {
 public:
-    ScopedProfiler(const std::string& name) : name_(name) {
-        HighResProfiler::get_instance().begin_sample(name_);
+    explicit ScopedProfiler(const char* name) : active_(HighResProfiler::get_instance().session_active()) {
+        if (active_) HighResProfiler::get_instance().begin_sample(name);
     }
     
     ~ScopedProfiler() {
-        HighResProfiler::get_instance().end_sample();
+        if (active_) HighResProfiler::get_instance().end_sample();
     }
     
+    ScopedProfiler(const ScopedProfiler&) = delete;
+    ScopedProfiler& operator=(const ScopedProfiler&) = delete;
+    
 private:
-    std::string name_;
+    bool active_;
 };
 
-// Convenience macros
-#define PROFILE_FUNCTION() ScopedProfiler profiler_##__LINE__(__FUNCTION__)
-#define PROFILE_SCOPE(name) ScopedProfiler profiler_##__LINE__(name)
-#define PROFILE_THREAD(name) HighResProfiler::get_instance().begin_sample(name)
+// Convenience macros; the two-level concatenation expands __LINE__ before pasting, so
+// every profiler gets its own name
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_FUNCTION() ::streaming::performance::ScopedProfiler PROFILE_CONCAT(profiler_, __LINE__)(__FUNCTION__)
+#define PROFILE_SCOPE(name) ::streaming::performance::ScopedProfiler PROFILE_CONCAT(profiler_, __LINE__)(name)
+#define PROFILE_THREAD(name) ::streaming::performance::HighResProfiler::get_instance().begin_sample(name)
 
 } // namespace performance
 } // namespace streaming
\ No newline at end of file
@@ -2,8 +2,11 @@
 #pragma once
 
 #include <cstdint>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
 #include <immintrin.h>  // AVX, AVX2, AVX-512
+#elif defined(__ARM_NEON)
 #include <arm_neon.h>   // ARM NEON
+#endif
 
 namespace streaming {
 namespace performance {
@@ -1,44 +1,98 @@
 // include/streaming/processing/av1_entropy.hpp
 #pragma once
 
+#include "../codec/av1_structures.hpp"
+#include "rate_estimation.hpp"
+#include <array>
 #include <vector>
 #include <cstdint>
 
 namespace streaming {
 namespace processing {
 
+// AV1 multi-symbol range coder (daala EC) with adaptive CDFs. One instance holds the
+// entropy state of one tile, so tiles can be coded independently.
 class AV1EntropyEncoder {
-private:
-    struct SymbolContext {
-        uint16_t cumulative_freq;
-        uint16_t symbol_freq;
+public:
+    static constexpr int CDF_PROB_BITS = 15;
+    static constexpr int MAX_SYMBOLS = 16;
+
+    // Inverse CDF (32768 - cdf) of up to 16 symbols; the entry after the last symbol
+    // counts adaptations (as in libaom). One per cache line, so the 16 probabilities are
+    // a single aligned vector for update_cdf().
+    struct alignas(64) CDF : std::array<uint16_t, MAX_SYMBOLS + 1> {};
+
+    // Every adaptive CDF of a tile. Tiles start from a copy of the frame's contexts, so
+    // they adapt independently; the contexts of context_update_tile_id at the end of the
+    // frame are what the next frame starts from.
+    struct Contexts {
+        std::array<CDF, 5> partition; // Per block size: 128, 64, 32, 16, 8
+        CDF is_inter;
+        CDF y_mode;
+        std::array<CDF, 8> angle_delta; // Per directional mode, V_PRED .. D67_PRED
+        CDF inter_mode;
+        CDF mv_zero;
+        CDF delta_q;
+        CDF all_zero;
+        std::array<CDF, 4> coeff_zero; // By distance from DC
+        CDF coeff_greater1;
+
+        // Equiprobable CDFs (also the state after an error resilient frame)
+        static const Contexts& defaults();
+        // Adaptation counters back to 0, as when the contexts are saved for the next frame
+        void reset_counters();
     };
 
-public:
     AV1EntropyEncoder();
-    
-    void init_frame();
-    void encode_symbol(utils::BitstreamWriter& writer, uint16_t symbol, 
-                      const std::vector<SymbolContext>& contexts);
-    void encode_coeffs(utils::BitstreamWriter& writer, 
-                      const std::vector<std::vector<int16_t>>& coeffs, 
+
+    // Load the CDFs and start a new range coder segment
+    void init_frame(const Contexts& contexts = Contexts::defaults());
+    const Contexts& contexts() const { return contexts_; }
+    // Finish the segment; the coded bytes are appended to `output`
+    void finish(std::vector<uint8_t>& output);
+    // Room for segments of up to `bytes` without reallocating
+    void reserve(size_t bytes) { precarry_.reserve(bytes); }
+
+    void encode_symbol(uint16_t symbol, CDF& cdf, int num_symbols); // Adaptive
+    void encode_bool(bool bit);                                     // Equiprobable
+    void encode_literal(uint32_t value, int bits);                  // MSB first
+    void encode_golomb(uint32_t value);                             // Exp-Golomb, equiprobable bits
+
+    void encode_coeffs(const std::vector<std::vector<int16_t>>& coeffs,
                       int tx_size, bool is_intra);
-    
+
     // AV1-specific encoding functions
-    void encode_partition_type(utils::BitstreamWriter& writer, PartitionType partition);
-    void encode_prediction_mode(utils::BitstreamWriter& writer, PredictionMode mode);
-    void encode_mv_component(utils::BitstreamWriter& writer, int16_t mv_component);
+    void encode_partition_type(codec::PartitionType partition, int block_size);
+    void encode_prediction_mode(codec::PredictionMode mode, bool is_inter_frame);
+    void encode_angle_delta(codec::PredictionMode mode, int angle_delta); // angle_delta_y, directional modes
+    void encode_mv_component(int16_t mv_component);
+    void encode_delta_qindex(int delta); // delta_q_abs / rem_bits / abs_bits / sign, in delta_q_res units
+
+    // RDO rates (RATE_ONE = one bit) of the symbols above under the current CDFs of the
+    // tile; nothing is coded or adapted
+    uint32_t partition_rate(codec::PartitionType partition, int block_size) const;
+    uint32_t prediction_mode_rate(codec::PredictionMode mode, bool is_inter_frame) const;
+    uint32_t angle_delta_rate(codec::PredictionMode mode, int angle_delta) const;
+    static uint32_t symbol_rate(uint16_t symbol, const CDF& cdf) {
+        const uint32_t fl = symbol > 0 ? cdf[symbol - 1] : 1u << CDF_PROB_BITS;
+        return probability_rate(fl - cdf[symbol]);
+    }
 
 private:
-    void encode_cdf(utils::BitstreamWriter& writer, uint16_t symbol, 
-                   const uint16_t* cdf, int precision);
-    void update_cdf(uint16_t* cdf, uint16_t symbol, int size);
-    
-    // AV1 adaptive probability models
-    std::vector<SymbolContext> partition_cdf_;
-    std::vector<SymbolContext> pred_mode_cdf_;
-    std::vector<SymbolContext> mv_joint_cdf_;
+    void encode_cdf(uint16_t symbol, const uint16_t* icdf, int num_symbols);
+    static void update_cdf(CDF& cdf, uint16_t symbol, int size);
+    void normalize(uint32_t low, uint32_t range);
+
+    static void init_uniform(CDF& cdf, int num_symbols);
+
+    // Range coder state (od_ec_enc)
+    uint32_t low_ = 0;
+    uint32_t range_ = 0x8000;
+    int count_ = -9;
+    std::vector<uint16_t> precarry_; // Output bytes before carry propagation
+
+    Contexts contexts_; // AV1 adaptive probability models
 };
 
 } // namespace processing
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
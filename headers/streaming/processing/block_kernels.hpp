@@ -0,0 +1,199 @@
+// include/streaming/processing/block_kernels.hpp
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace streaming {
+namespace processing {
+
+// Block kernels specialised on the block size at compile time: every loop bound is a
+// constant, so each size is unrolled and vectorised on its own. Callers that know the
+// size use the templates; callers with a runtime size go through block_kernels().
+
+enum class BlockSize : uint8_t {
+    BLOCK_4X4,
+    BLOCK_8X8,
+    BLOCK_16X16,
+    BLOCK_32X32,
+    BLOCK_64X64
+};
+
+inline constexpr int BLOCK_SIZE_COUNT = 5;
+
+constexpr int block_width(BlockSize size) { return 4 << static_cast<int>(size); }
+// Square block of width n (a power of two, 4..64)
+constexpr BlockSize block_size_of(int n) {
+    return static_cast<BlockSize>(std::countr_zero(static_cast<unsigned>(n)) - 2);
+}
+
+// Sum of absolute differences of a W x H block
+template <int W, int H>
+uint32_t sad(const uint8_t* a, ptrdiff_t a_stride, const uint8_t* b, ptrdiff_t b_stride) {
+    static_assert(W % 4 == 0 && H % 2 == 0, "SAD blocks are 4-wide, 2-high multiples");
+#ifdef __AVX2__
+    if constexpr (W % 32 == 0) {
+        __m256i acc = _mm256_setzero_si256();
+        for (int y = 0; y < H; ++y) {
+            for (int x = 0; x < W; x += 32) {
+                const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + y * a_stride + x));
+                const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + y * b_stride + x));
+                acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+            }
+        }
+        __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(s));
+    }
+#endif
+#ifdef __SSE2__
+    if constexpr (W % 16 == 0) {
+        __m128i acc = _mm_setzero_si128();
+        for (int y = 0; y < H; ++y) {
+            for (int x = 0; x < W; x += 16) {
+                const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + y * a_stride + x));
+                const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + y * b_stride + x));
+                acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+            }
+        }
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_add_epi64(acc, _mm_unpackhi_epi64(acc, acc))));
+    } else if constexpr (W == 8) {
+        // Two 8-pixel rows per register
+        __m128i acc = _mm_setzero_si128();
+        for (int y = 0; y < H; y += 2) {
+            const __m128i va = _mm_unpacklo_epi64(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + y * a_stride)),
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + (y + 1) * a_stride)));
+            const __m128i vb = _mm_unpacklo_epi64(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + y * b_stride)),
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + (y + 1) * b_stride)));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+        }
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_add_epi64(acc, _mm_unpackhi_epi64(acc, acc))));
+    }
+#endif
+    uint32_t sum = 0;
+    for (int y = 0; y < H; ++y) {
+        for (int x = 0; x < W; ++x) {
+            sum += static_cast<uint32_t>(std::abs(a[y * a_stride + x] - b[y * b_stride + x]));
+        }
+    }
+    return sum;
+}
+
+// cos((2x + 1) u pi / 2N) at [x * N + u], and the orthonormal scale of each frequency
+template <int N>
+struct DCTBasis {
+    std::array<double, N * N> cos;
+    std::array<double, N> scale;
+
+    DCTBasis() {
+        for (int x = 0; x < N; ++x) {
+            for (int u = 0; u < N; ++u) {
+                cos[x * N + u] = std::cos((2 * x + 1) * u * M_PI / (2.0 * N));
+            }
+        }
+        for (int u = 0; u < N; ++u) {
+            scale[u] = std::sqrt(2.0 / N) * (u == 0 ? 1.0 / std::sqrt(2) : 1.0);
+        }
+    }
+};
+
+template <int N>
+inline const DCTBasis<N> DCT_BASIS{};
+
+// 2D DCT-II of an N x N residual: rows, then columns. The inner loops run along the
+// output row, so each step is one broadcast multiply-add over N contiguous values.
+template <int N>
+void fdct(const int16_t* residual, ptrdiff_t stride, double* coeffs) {
+    const DCTBasis<N>& basis = DCT_BASIS<N>;
+    alignas(32) double rows[N * N];
+
+    for (int x = 0; x < N; ++x) {
+        double* out = rows + x * N;
+        for (int v = 0; v < N; ++v) out[v] = 0.0;
+        for (int y = 0; y < N; ++y) {
+            const double sample = residual[x * stride + y];
+            const double* c = basis.cos.data() + y * N;
+            for (int v = 0; v < N; ++v) out[v] += sample * c[v];
+        }
+    }
+
+    for (int u = 0; u < N; ++u) {
+        double* out = coeffs + u * N;
+        for (int v = 0; v < N; ++v) out[v] = 0.0;
+        for (int x = 0; x < N; ++x) {
+            const double c = basis.cos[x * N + u];
+            const double* in = rows + x * N;
+            for (int v = 0; v < N; ++v) out[v] += c * in[v];
+        }
+        for (int v = 0; v < N; ++v) out[v] *= basis.scale[u] * basis.scale[v];
+    }
+}
+
+// Quantizer step of a QP (H.264 scaling, flat weight 16)
+inline double quant_step(int qp) {
+    static constexpr double QP_SCALE[] = {
+        0.625, 0.6875, 0.8125, 0.875, 1.0, 1.125, 1.25, 1.375,
+        1.625, 1.75, 2.0, 2.25, 2.5, 2.75, 3.25, 3.5,
+        4.0, 4.5, 5.0, 5.5, 6.5, 7.0, 8.0, 9.0,
+        10.0, 11.0, 13.0, 14.0, 16.0, 18.0, 20.0, 22.0,
+        26.0, 28.0, 32.0, 36.0, 40.0, 44.0, 52.0, 56.0,
+        64.0, 72.0, 80.0, 88.0, 104.0, 112.0, 128.0, 144.0,
+        160.0, 176.0, 208.0, 224.0
+    };
+    return 16.0 * QP_SCALE[qp < 0 ? 0 : (qp > 51 ? 51 : qp)];
+}
+
+// Coefficients of an N x N block to levels (round to nearest) and back
+template <int N>
+void quant(double* coeffs, int qp) {
+    const double step = quant_step(qp);
+    for (int i = 0; i < N * N; ++i) {
+        coeffs[i] = std::round(coeffs[i] / step);
+    }
+}
+
+template <int N>
+void dequant(double* coeffs, int qp) {
+    const double step = quant_step(qp);
+    for (int i = 0; i < N * N; ++i) {
+        coeffs[i] *= step;
+    }
+}
+
+// Kernels of one square block size
+struct BlockKernels {
+    uint32_t (*sad)(const uint8_t* a, ptrdiff_t a_stride, const uint8_t* b, ptrdiff_t b_stride);
+    void (*fdct)(const int16_t* residual, ptrdiff_t stride, double* coeffs);
+    void (*quant)(double* coeffs, int qp);
+    void (*dequant)(double* coeffs, int qp);
+};
+
+template <int N>
+constexpr BlockKernels block_kernels_for() {
+    return {&sad<N, N>, &fdct<N>, &quant<N>, &dequant<N>};
+}
+
+inline constexpr std::array<BlockKernels, BLOCK_SIZE_COUNT> BLOCK_KERNELS = {
+    block_kernels_for<4>(),
+    block_kernels_for<8>(),
+    block_kernels_for<16>(),
+    block_kernels_for<32>(),
+    block_kernels_for<64>()
+};
+
+constexpr const BlockKernels& block_kernels(BlockSize size) {
+    return BLOCK_KERNELS[static_cast<size_t>(size)];
+}
+
+} // namespace processing
+} // namespace streaming
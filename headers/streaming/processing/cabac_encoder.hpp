@@ -1,46 +1,153 @@
 // include/streaming/processing/cabac_encoder.hpp
 #pragma once
 
+#include "../utils/bitstream.hpp"
+#include "rate_estimation.hpp"
+#include <array>
+#include <bit>
 #include <vector>
 #include <cstdint>
 
 namespace streaming {
 namespace processing {
 
+// Binary arithmetic coder of HEVC and VVC (9.3.4.3). Renormalisation shifts by the leading
+// zeros of the range in one step, bypass bins go eight at a time, and bytes collect in a
+// buffer that keeps its capacity across substreams; a byte reaches the buffer only once no
+// carry can change it, so checkpoint() / rollback() can undo trial encodes.
 class CABACEncoder {
-private:
+public:
+    // Probability state of one context (HEVC 9.3.2.2). Plain data, so context sets can be
+    // copied for WPP synchronisation.
     struct ContextModel {
-        uint8_t state = 63; // Initial state (0-63)
+        uint8_t state = 0;  // pStateIdx (0-62)
         uint8_t mps = 0;    // Most Probable Symbol (0 or 1)
+        
+        // initValue from the spec tables; 154 = equiprobable
+        void init(uint8_t init_value, int qp);
+    };
+
+    // Coder state between two bins
+    struct Checkpoint {
+        uint32_t low = 0;
+        uint32_t range = 0;
+        int bits_left = 0;
+        int num_buffered_bytes = 0;
+        uint32_t buffered_byte = 0;
+        size_t bytes = 0;
     };
 
-public:
     CABACEncoder();
     
-    void init_encoder(std::vector<uint8_t>& output_buffer);
-    void encode_bit(ContextModel& ctx, bool bit);
-    void encode_bin(ContextModel& ctx, uint32_t bin, int max_bins);
-    void encode_terminator();
-    void flush_encoder();
+    // Arithmetic coder state is reset; bits go to `writer` on flush_encoder()
+    void init_encoder(utils::BitstreamWriter& writer);
+    void encode_bit(ContextModel& ctx, bool bit) {
+        const uint32_t lps = LPS_RANGE[ctx.state][(range_ >> 6) & 3];
+        const bool is_mps = bit == static_cast<bool>(ctx.mps);
+        update_context(ctx, bit);
+        encode_decision(lps, is_mps);
+    }
+    void encode_bin(ContextModel& ctx, uint32_t bin, int max_bins); // Truncated unary, one context
+    void encode_bypass(bool bit);
+    void encode_bypass_bins(uint32_t value, int num_bins);  // MSB first, up to 32
+    void encode_ue_bypass(uint32_t value);                  // k-th order Exp-Golomb, k = 0
+    void encode_terminator(bool bit);                       // end_of_slice_segment_flag / end_of_subset_one_bit
+    void flush_encoder();                                   // Flush the arithmetic coder (after a terminating 1)
+
+    // One context-coded bin given its LPS range (rangeTabLPS, or the VVC estimate);
+    // `is_mps` when the bin equals the most probable symbol. Context update is the caller's.
+    void encode_decision(uint32_t lps_range, bool is_mps) {
+        range_ -= lps_range;
+        int num_bits;
+        if (!is_mps) {
+            num_bits = std::countl_zero(lps_range) - 23; // Back into [256, 510]
+            low_ = (low_ + range_) << num_bits;
+            range_ = lps_range << num_bits;
+        } else {
+            if (range_ >= 256) return;
+            num_bits = std::countl_zero(range_) - 23;
+            low_ <<= num_bits;
+            range_ <<= num_bits;
+        }
+        bits_left_ -= num_bits;
+        test_and_write_out();
+    }
+    uint32_t range() const { return range_; }
+
+    // Trial encoding: bins coded after checkpoint() are dropped by rollback(). Contexts
+    // are the caller's to save (they are plain data).
+    Checkpoint checkpoint() const {
+        return {low_, range_, bits_left_, num_buffered_bytes_, buffered_byte_, bytes_.size()};
+    }
+    void rollback(const Checkpoint& checkpoint);
+    // Bits produced since init_encoder(), counting those still held in the coder
+    uint64_t bits_written() const {
+        return (bytes_.size() + num_buffered_bytes_) * 8 + static_cast<uint64_t>(23 - bits_left_);
+    }
+
+    // RDO: rate of coding `bit` with `ctx` (RATE_ONE = one bit) and the context update
+    // encode_bit() makes, for pricing candidates on copied contexts (CABACRateEstimator)
+    static uint32_t bin_rate(const ContextModel& ctx, bool bit) {
+        return BIN_RATE[ctx.state][bit != static_cast<bool>(ctx.mps)];
+    }
+    static void update_context(ContextModel& ctx, bool bit) {
+        const uint8_t next = NEXT_STATE[ctx.state * 4 + ctx.mps * 2 + bit];
+        ctx.state = next & 63;
+        ctx.mps = next >> 6;
+    }
 
     // HEVC-specific encoding functions
-    void encode_ae(v) // Adaptive Encoding
     void encode_sao_type(ContextModel& ctx, uint8_t type);
     void encode_cu_split_flag(ContextModel& ctx, bool split_flag);
 
 private:
-    void encode_regular(ContextModel& ctx, bool bit);
-    void encode_bypass(bool bit);
-    void renorm_encoder();
+    // rangeTabLPS, and both state transitions (9.3.4.3.2.2) in one lookup indexed by
+    // state * 4 + mps * 2 + bin: the next state in bits 0-5, the next MPS in bit 6
+    static const std::array<std::array<uint8_t, 4>, 64> LPS_RANGE;
+    static const std::array<uint8_t, 64 * 4> NEXT_STATE;
+    // -log2 of the MPS and LPS probability of each state, from rangeTabLPS
+    static const std::array<std::array<uint32_t, 2>, 64> BIN_RATE;
+    
+    void test_and_write_out() {
+        if (bits_left_ < 12) {
+            write_out();
+        }
+    }
+    void write_out();
 
 private:
-    std::vector<uint8_t>* output_;
-    uint64_t low_ = 0;
-    uint64_t range_ = 510;
+    utils::BitstreamWriter* writer_ = nullptr;
+    std::vector<uint8_t> bytes_; // Final bytes of the substream
+    uint32_t low_ = 0;
+    uint32_t range_ = 510;
+    int bits_left_ = 23;
     int num_buffered_bytes_ = 0;
-    uint8_t buffered_byte_ = 0xFF;
-    int num_bits_left_ = 23;
+    uint32_t buffered_byte_ = 0xFF;
+};
+
+// Stands in for CABACEncoder while RDO prices a candidate: the same bin calls adapt the
+// caller's (copied) contexts, but only the rate adds up and nothing is coded
+class CABACRateEstimator {
+public:
+    using ContextModel = CABACEncoder::ContextModel;
+
+    void encode_bit(ContextModel& ctx, bool bit) {
+        rate_ += CABACEncoder::bin_rate(ctx, bit);
+        CABACEncoder::update_context(ctx, bit);
+    }
+    void encode_bypass(bool) { rate_ += RATE_ONE; }
+    void encode_bypass_bins(uint32_t, int num_bins) { rate_ += static_cast<uint32_t>(num_bins) * RATE_ONE; }
+    void encode_ue_bypass(uint32_t value) {
+        rate_ += static_cast<uint32_t>(2 * std::bit_width(value + 1) - 1) * RATE_ONE;
+    }
+
+    uint64_t rate() const { return rate_; }
+    double bits() const { return rate_to_bits(rate_); }
+    void reset() { rate_ = 0; }
+
+private:
+    uint64_t rate_ = 0;
 };
 
 } // namespace processing
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
@@ -0,0 +1,131 @@
+// include/streaming/processing/cavlc_decoder.hpp
+#pragma once
+
+#include "cavlc_encoder.hpp"
+#include "../utils/bitstream.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+
+namespace streaming {
+namespace processing {
+
+// Inverse of CAVLCEncoder::encode_residual
+class CAVLCDecoder {
+public:
+    int decode_residual(utils::BitstreamReader& reader,
+                        std::array<std::array<int16_t, 8>, 8>& block,
+                        const CAVLCCoeffCounts& counts, int block8x8) const {
+        int16_t* raster = block[0].data();
+        int total = 0;
+        for (int b = 0; b < 4; ++b) {
+            std::array<int16_t, 16> coeffs;
+            const int x4 = (block8x8 & 1) * 2 + (b & 1);
+            const int y4 = (block8x8 >> 1) * 2 + (b >> 1);
+            const int count = decode_block(reader, coeffs.data(), counts.nc(x4, y4));
+            counts.at(x4, y4) = static_cast<uint8_t>(count);
+            total += count;
+
+            for (int i = 0; i < 16; ++i) {
+                raster[CAVLC_SCAN_8X8_AS_4X4[b][i]] = coeffs[i];
+            }
+        }
+        return total;
+    }
+
+    // One residual_block_cavlc() of 16 coefficients in scan order; returns TotalCoeff
+    static int decode_block(utils::BitstreamReader& reader, int16_t* coeffs, int nc) {
+        std::fill(coeffs, coeffs + 16, int16_t{0});
+
+        const int token = read(reader, CAVLC_COEFF_TOKEN[cavlc_coeff_token_table(nc)]);
+        const int total_coeff = token >> 2;
+        const int trailing_ones = token & 3;
+        if (total_coeff == 0) {
+            return 0;
+        }
+
+        // Levels arrive highest frequency first
+        std::array<int16_t, 16> levels;
+        for (int i = 0; i < trailing_ones; ++i) {
+            levels[i] = reader.read_bit() ? -1 : 1;
+        }
+        int suffix_length = total_coeff > 10 && trailing_ones < 3 ? 1 : 0;
+        for (int i = trailing_ones; i < total_coeff; ++i) {
+            int level_code = decode_level_code(reader, suffix_length);
+            if (i == trailing_ones && trailing_ones < 3) {
+                level_code += 2;
+            }
+            const int level = level_code & 1 ? (-level_code - 1) >> 1 : (level_code + 2) >> 1;
+            if (level < INT16_MIN || level > INT16_MAX) {
+                throw std::runtime_error("Invalid CAVLC level");
+            }
+            levels[i] = static_cast<int16_t>(level);
+
+            if (suffix_length == 0) {
+                suffix_length = 1;
+            }
+            if (std::abs(level) > (3 << (suffix_length - 1)) && suffix_length < 6) {
+                suffix_length++;
+            }
+        }
+
+        int zeros_left = total_coeff < 16 ? read(reader, CAVLC_TOTAL_ZEROS[total_coeff - 1]) : 0;
+
+        // Position of the highest coefficient, then walk down over the runs
+        int position = total_coeff + zeros_left - 1;
+        for (int i = 0; i < total_coeff; ++i) {
+            coeffs[position] = levels[i];
+
+            int run = zeros_left; // The lowest coefficient takes what is left
+            if (i + 1 < total_coeff) {
+                run = zeros_left > 0 ? read(reader, CAVLC_RUN_BEFORE[std::min(zeros_left, 7) - 1]) : 0;
+            }
+            if (run > zeros_left) {
+                throw std::runtime_error("Invalid CAVLC run_before");
+            }
+            zeros_left -= run;
+            position -= 1 + run;
+        }
+        return total_coeff;
+    }
+
+private:
+    // Index of the code at the read position; the codes are prefix-free and at most 16 bits
+    template <size_t N>
+    static int read(utils::BitstreamReader& reader, const std::array<VLCCode, N>& table) {
+        const uint32_t window = reader.peek_bits(16);
+        for (size_t i = 0; i < N; ++i) {
+            const VLCCode vlc = table[i];
+            if (vlc.length != 0 && (window >> (16 - vlc.length)) == vlc.code) {
+                reader.skip_bits(vlc.length);
+                return static_cast<int>(i);
+            }
+        }
+        throw std::runtime_error("Invalid CAVLC code");
+    }
+
+    // level_prefix and level_suffix back to levelCode, 9.2.2.1
+    static int decode_level_code(utils::BitstreamReader& reader, int suffix_length) {
+        const int prefix = std::countl_zero(reader.peek_bits(32));
+        if (prefix > 28) {
+            throw std::runtime_error("Invalid CAVLC level_prefix");
+        }
+        reader.skip_bits(prefix + 1);
+
+        const int suffix_size = prefix == 14 && suffix_length == 0 ? 4 : (prefix >= 15 ? prefix - 3 : suffix_length);
+        int level_code = (std::min(15, prefix) << suffix_length) +
+                         static_cast<int>(reader.read_bits(static_cast<uint8_t>(suffix_size)));
+        if (prefix >= 15 && suffix_length == 0) {
+            level_code += 15;
+        }
+        if (prefix >= 16) {
+            level_code += (1 << (prefix - 3)) - 4096;
+        }
+        return level_code;
+    }
+};
+
+} // namespace processing
+} // namespace streaming
@@ -1,165 +1,188 @@
 // include/streaming/processing/cavlc_encoder.hpp
 #pragma once
 
+#include "cavlc_tables.hpp"
 #include "../utils/bitstream.hpp"
+#include <algorithm>
 #include <array>
-#include <vector>
+#include <bit>
+#include <cstddef>
+#include <cstdlib>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace streaming {
 namespace processing {
 
+// total_coeff of every 4x4 luma block of a picture, the nC context of coeff_token (9.2.1).
+// Points at the top-left 4x4 block of one macroblock; the blocks of the left and above
+// macroblocks are read only when those are available (same slice).
+struct CAVLCCoeffCounts {
+    uint8_t* counts = nullptr;
+    ptrdiff_t stride = 0;
+    bool left_available = false;
+    bool above_available = false;
+
+    uint8_t& at(int x4, int y4) const { return counts[y4 * stride + x4]; }
+
+    // nC of the 4x4 block at (x4, y4) of the macroblock
+    int nc(int x4, int y4) const {
+        const int a = x4 > 0 || left_available ? at(x4 - 1, y4) : -1;
+        const int b = y4 > 0 || above_available ? at(x4, y4 - 1) : -1;
+        if (a >= 0 && b >= 0) return (a + b + 1) >> 1;
+        return a >= 0 ? a : (b >= 0 ? b : 0);
+    }
+};
+
+// CAVLC residual coding of H.264 (9.2). An 8x8 block is coded as four interleaved 4x4
+// blocks (7.3.5.3.2), each one residual_block_cavlc() with the spec's code tables.
 class CAVLCEncoder {
-private:
-    struct CoefficientInfo {
-        int16_t value;
-        int8_t run; // Zero run length
-        bool significant;
+public:
+    // Zigzag scan order for 8x8 block (shared with CAVLCDecoder)
+    static constexpr int ZIGZAG_8x8[64] = {
+        0,  1,  8, 16,  9,  2,  3, 10,
+        17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34,
+        27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36,
+        29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46,
+        53, 60, 61, 54, 47, 55, 62, 63
     };
 
-public:
-    void encode_residual(utils::BitstreamWriter& writer, 
-                        const std::array<std::array<int16_t, 8>, 8>& block) {
-        // Convert 8x8 block to 4x4 sub-blocks (H.264 style)
-        std::vector<CoefficientInfo> coeffs = zigzag_scan(block);
-        encode_coefficients(writer, coeffs);
-    }
-    
-private:
-    std::vector<CoefficientInfo> zigzag_scan(const std::array<std::array<int16_t, 8>, 8>& block) {
-        // Zigzag scan order for 8x8 block
-        constexpr int ZIGZAG_8x8[64] = {
-            0,  1,  8, 16,  9,  2,  3, 10,
-            17, 24, 32, 25, 18, 11,  4,  5,
-            12, 19, 26, 33, 40, 48, 41, 34,
-            27, 20, 13,  6,  7, 14, 21, 28,
-            35, 42, 49, 56, 57, 50, 43, 36,
-            29, 22, 15, 23, 30, 37, 44, 51,
-            58, 59, 52, 45, 38, 31, 39, 46,
-            53, 60, 61, 54, 47, 55, 62, 63
-        };
-        
-        std::vector<CoefficientInfo> coeffs;
-        int zero_run = 0;
-        
-        for (int i = 0; i < 64; ++i) {
-            int x = ZIGZAG_8x8[i] % 8;
-            int y = ZIGZAG_8x8[i] / 8;
-            int16_t coeff = block[y][x];
-            
-            if (coeff == 0) {
-                zero_run++;
-            } else {
-                if (zero_run > 0) {
-                    coeffs.push_back({0, static_cast<int8_t>(zero_run), false});
-                    zero_run = 0;
-                }
-                coeffs.push_back({coeff, 0, true});
+    // Codes the 8x8 block block8x8 (0..3, raster order) of a macroblock and records the
+    // total_coeff of its 4x4 blocks in counts. Returns the number of nonzero coefficients.
+    int encode_residual(utils::BitstreamWriter& writer,
+                        const std::array<std::array<int16_t, 8>, 8>& block,
+                        const CAVLCCoeffCounts& counts, int block8x8) const {
+        const int16_t* raster = block[0].data();
+        int total = 0;
+        for (int b = 0; b < 4; ++b) {
+            alignas(32) std::array<int16_t, 16> coeffs;
+            for (int i = 0; i < 16; ++i) {
+                coeffs[i] = raster[CAVLC_SCAN_8X8_AS_4X4[b][i]];
             }
+
+            const int x4 = (block8x8 & 1) * 2 + (b & 1);
+            const int y4 = (block8x8 >> 1) * 2 + (b >> 1);
+            const int count = encode_block(writer, coeffs.data(), counts.nc(x4, y4));
+            counts.at(x4, y4) = static_cast<uint8_t>(count);
+            total += count;
         }
-        
-        // Trailing zeros
-        if (zero_run > 0) {
-            coeffs.push_back({0, static_cast<int8_t>(zero_run), false});
-        }
-        
-        return coeffs;
+        return total;
     }
-    
-    void encode_coefficients(utils::BitstreamWriter& writer, 
-                            const std::vector<CoefficientInfo>& coeffs) {
-        if (coeffs.empty()) {
-            writer.write_bits(0b1, 1); // No coefficients
-            return;
+
+    // One residual_block_cavlc() of 16 coefficients in scan order; returns TotalCoeff
+    static int encode_block(utils::BitstreamWriter& writer, const int16_t* coeffs, int nc) {
+        // Nonzero coefficients from the highest frequency down, with the zeros below each
+        // one; the zero runs are skipped through the mask instead of scanned
+        uint32_t mask = nonzero_mask(coeffs);
+        const int total_coeff = std::popcount(mask);
+        const int total_zeros = total_coeff ? std::bit_width(mask) - total_coeff : 0;
+        std::array<int16_t, 16> levels;
+        std::array<uint8_t, 16> runs;
+        for (int n = 0; mask; ++n) {
+            const int position = std::bit_width(mask) - 1;
+            mask ^= 1u << position;
+            levels[n] = coeffs[position];
+            runs[n] = static_cast<uint8_t>(position - std::bit_width(mask));
         }
-        
-        // Encode total coefficients and trailing ones
-        int total_coeffs = 0;
+
         int trailing_ones = 0;
-        
-        for (const auto& coeff : coeffs) {
-            if (coeff.significant) {
-                total_coeffs++;
-                if (std::abs(coeff.value) == 1) {
-                    trailing_ones++;
-                    if (trailing_ones == 3) break;
-                }
-            }
+        while (trailing_ones < 3 && trailing_ones < total_coeff && std::abs(levels[trailing_ones]) == 1) {
+            trailing_ones++;
         }
-        
-        trailing_ones = std::min(trailing_ones, 3);
-        
-        // Encode total coefficients and trailing ones
-        writer.write_ue(total_coeffs);
-        writer.write_ue(trailing_ones);
-        
-        // Encode trailing ones signs
-        int ones_encoded = 0;
-        for (const auto& coeff : coeffs) {
-            if (coeff.significant && std::abs(coeff.value) == 1 && ones_encoded < trailing_ones) {
-                writer.write_bit(coeff.value > 0 ? 0 : 1); // 0=positive, 1=negative
-                ones_encoded++;
-            }
+
+        write(writer, CAVLC_COEFF_TOKEN[cavlc_coeff_token_table(nc)][total_coeff * 4 + trailing_ones]);
+        if (total_coeff == 0) {
+            return 0;
         }
-        
-        // Encode levels (non-trailing ones)
-        int levels_encoded = 0;
-        for (const auto& coeff : coeffs) {
-            if (coeff.significant && std::abs(coeff.value) > 1) {
-                encode_level(writer, coeff.value);
-                levels_encoded++;
+
+        for (int i = 0; i < trailing_ones; ++i) {
+            writer.write_bit(levels[i] < 0); // trailing_ones_sign_flag
+        }
+
+        int suffix_length = total_coeff > 10 && trailing_ones < 3 ? 1 : 0;
+        for (int i = trailing_ones; i < total_coeff; ++i) {
+            const int level = levels[i];
+            int level_code = level > 0 ? 2 * level - 2 : -2 * level - 1;
+            if (i == trailing_ones && trailing_ones < 3) {
+                level_code -= 2; // This one cannot be +-1
+            }
+            encode_level(writer, level_code, suffix_length);
+
+            if (suffix_length == 0) {
+                suffix_length = 1;
+            }
+            if (std::abs(level) > (3 << (suffix_length - 1)) && suffix_length < 6) {
+                suffix_length++;
             }
         }
-        
-        // Encode total zeros and run before
-        encode_total_zeros(writer, coeffs, total_coeffs);
-        encode_run_before(writer, coeffs);
-    }
-    
-    void encode_level(utils::BitstreamWriter& writer, int16_t level) {
-        bool positive = level > 0;
-        uint32_t abs_level = std::abs(level);
-        
-        if (abs_level < 15) {
-            writer.write_bits((abs_level - 1) << 1 | (positive ? 0 : 1), 
-                            (abs_level < 8 ? abs_level : 15) + 1);
-        } else {
-            // Large level encoding
-            writer.write_bits(0b1111, 4);
-            encode_level(writer, level > 0 ? level - 14 : level + 14);
+
+        if (total_coeff < 16) {
+            write(writer, CAVLC_TOTAL_ZEROS[total_coeff - 1][total_zeros]);
         }
+
+        // run_before from the highest frequency; the lowest coefficient takes what is left
+        int zeros_left = total_zeros;
+        for (int i = 0; i < total_coeff - 1 && zeros_left > 0; ++i) {
+            write(writer, CAVLC_RUN_BEFORE[std::min(zeros_left, 7) - 1][runs[i]]);
+            zeros_left -= runs[i];
+        }
+        return total_coeff;
     }
-    
-    void encode_total_zeros(utils::BitstreamWriter& writer, 
-                           const std::vector<CoefficientInfo>& coeffs, int total_coeffs) {
-        int total_zeros = 0;
-        for (const auto& coeff : coeffs) {
-            if (!coeff.significant) {
-                total_zeros += coeff.run;
-            }
+
+    // Bit i set when coeffs[i] is nonzero
+    static uint32_t nonzero_mask(const int16_t* coeffs) {
+#ifdef __AVX2__
+        const __m256i zero = _mm256_cmpeq_epi16(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(coeffs)), _mm256_setzero_si256());
+        const __m128i packed = _mm_packs_epi16(_mm256_castsi256_si128(zero), _mm256_extracti128_si256(zero, 1));
+        return ~static_cast<uint32_t>(_mm_movemask_epi8(packed)) & 0xFFFF;
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < 16; ++i) {
+            mask |= static_cast<uint32_t>(coeffs[i] != 0) << i;
         }
-        
-        writer.write_ue(total_zeros);
+        return mask;
+#endif
     }
-    
-    void encode_run_before(utils::BitstreamWriter& writer, 
-                          const std::vector<CoefficientInfo>& coeffs) {
-        int zeros_left = 0;
-        for (const auto& coeff : coeffs) {
-            if (!coeff.significant) {
-                zeros_left += coeff.run;
-            }
+
+private:
+    static void write(utils::BitstreamWriter& writer, VLCCode vlc) {
+        writer.write_bits(vlc.code, vlc.length);
+    }
+
+    // level_prefix (leading zeros and a one) and level_suffix, 9.2.2.1
+    static void encode_level(utils::BitstreamWriter& writer, int level_code, int suffix_length) {
+        if (suffix_length == 0 && level_code < 14) {
+            writer.write_bits(1, static_cast<uint8_t>(level_code + 1));
+            return;
         }
-        
-        for (const auto& coeff : coeffs) {
-            if (coeff.significant) {
-                if (zeros_left > 0) {
-                    writer.write_ue(std::min(coeff.run, zeros_left));
-                    zeros_left -= coeff.run;
-                }
-            }
+        if (suffix_length == 0 && level_code < 30) {
+            writer.write_bits(1, 15); // prefix 14, 4-bit suffix
+            writer.write_bits(level_code - 14, 4);
+            return;
+        }
+        if (suffix_length > 0 && level_code < (15 << suffix_length)) {
+            writer.write_bits(1, static_cast<uint8_t>((level_code >> suffix_length) + 1));
+            writer.write_bits(level_code & ((1 << suffix_length) - 1), static_cast<uint8_t>(suffix_length));
+            return;
+        }
+
+        // Escape: prefix 15 has a 12-bit suffix, every longer prefix doubles the range
+        int escape = level_code - (suffix_length == 0 ? 30 : 15 << suffix_length);
+        int prefix = 15;
+        while (escape >= (1 << (prefix - 3))) {
+            escape -= 1 << (prefix - 3);
+            prefix++;
         }
+        writer.write_bits(1, static_cast<uint8_t>(prefix + 1));
+        writer.write_bits(static_cast<uint32_t>(escape), static_cast<uint8_t>(prefix - 3));
     }
 };
 
 } // namespace processing
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
@@ -0,0 +1,229 @@
+// include/streaming/processing/cavlc_tables.hpp
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace streaming {
+namespace processing {
+
+// CAVLC code tables of H.264 (9.2) as {code, length} pairs, plus the scan of an 8x8 block
+// coded as four interleaved 4x4 blocks (7.3.5.3.2). The tables are assembled from the
+// spec's length / code columns and checked to be prefix-free at compile time.
+struct VLCCode {
+    uint16_t code = 0;
+    uint8_t length = 0; // 0 = no such code
+};
+
+namespace cavlc_detail {
+
+// Table 9-5, [nC class][TotalCoeff][TrailingOnes]
+inline constexpr uint8_t COEFF_TOKEN_LENGTH[4][17][4] = {
+    { // 0 <= nC < 2
+        { 1,  0,  0,  0}, { 6,  2,  0,  0}, { 8,  6,  3,  0}, { 9,  8,  7,  5}, {10,  9,  8,  6},
+        {11, 10,  9,  7}, {13, 11, 10,  8}, {13, 13, 11,  9}, {13, 13, 13, 10}, {14, 14, 13, 11},
+        {14, 14, 14, 13}, {15, 15, 14, 14}, {15, 15, 15, 14}, {16, 15, 15, 15}, {16, 16, 16, 15},
+        {16, 16, 16, 16}, {16, 16, 16, 16}
+    },
+    { // 2 <= nC < 4
+        { 2,  0,  0,  0}, { 6,  2,  0,  0}, { 6,  5,  3,  0}, { 7,  6,  6,  4}, { 8,  6,  6,  4},
+        { 8,  7,  7,  5}, { 9,  8,  8,  6}, {11,  9,  9,  6}, {11, 11, 11,  7}, {12, 11, 11,  9},
+        {12, 12, 12, 11}, {12, 12, 12, 11}, {13, 13, 13, 12}, {13, 13, 13, 13}, {13, 14, 13, 13},
+        {14, 14, 14, 13}, {14, 14, 14, 14}
+    },
+    { // 4 <= nC < 8
+        { 4,  0,  0,  0}, { 6,  4,  0,  0}, { 6,  5,  4,  0}, { 6,  5,  5,  4}, { 7,  5,  5,  4},
+        { 7,  5,  5,  4}, { 7,  6,  6,  4}, { 7,  6,  6,  4}, { 8,  7,  7,  5}, { 8,  8,  7,  6},
+        { 9,  8,  8,  7}, { 9,  9,  8,  8}, { 9,  9,  9,  8}, {10,  9,  9,  9}, {10, 10, 10, 10},
+        {10, 10, 10, 10}, {10, 10, 10, 10}
+    },
+    { // 8 <= nC: 6-bit fixed length
+        { 6,  0,  0,  0}, { 6,  6,  0,  0}, { 6,  6,  6,  0}, { 6,  6,  6,  6}, { 6,  6,  6,  6},
+        { 6,  6,  6,  6}, { 6,  6,  6,  6}, { 6,  6,  6,  6}, { 6,  6,  6,  6}, { 6,  6,  6,  6},
+        { 6,  6,  6,  6}, { 6,  6,  6,  6}, { 6,  6,  6,  6}, { 6,  6,  6,  6}, { 6,  6,  6,  6},
+        { 6,  6,  6,  6}, { 6,  6,  6,  6}
+    }
+};
+
+inline constexpr uint8_t COEFF_TOKEN_CODE[4][17][4] = {
+    {
+        { 1,  0,  0,  0}, { 5,  1,  0,  0}, { 7,  4,  1,  0}, { 7,  6,  5,  3}, { 7,  6,  5,  3},
+        { 7,  6,  5,  4}, {15,  6,  5,  4}, {11, 14,  5,  4}, { 8, 10, 13,  4}, {15, 14,  9,  4},
+        {11, 10, 13, 12}, {15, 14,  9, 12}, {11, 10, 13,  8}, {15,  1,  9, 12}, {11, 14, 13,  8},
+        { 7, 10,  9, 12}, { 4,  6,  5,  8}
+    },
+    {
+        { 3,  0,  0,  0}, {11,  2,  0,  0}, { 7,  7,  3,  0}, { 7, 10,  9,  5}, { 7,  6,  5,  4},
+        { 4,  6,  5,  6}, { 7,  6,  5,  8}, {15,  6,  5,  4}, {11, 14, 13,  4}, {15, 10,  9,  4},
+        {11, 14, 13, 12}, { 8, 10,  9,  8}, {15, 14, 13, 12}, {11, 10,  9, 12}, { 7, 11,  6,  8},
+        { 9,  8, 10,  1}, { 7,  6,  5,  4}
+    },
+    {
+        {15,  0,  0,  0}, {15, 14,  0,  0}, {11, 15, 13,  0}, { 8, 12, 14, 12}, {15, 10, 11, 11},
+        {11,  8,  9, 10}, { 9, 14, 13,  9}, { 8, 10,  9,  8}, {15, 14, 13, 13}, {11, 14, 10, 12},
+        {15, 10, 13, 12}, {11, 14,  9, 12}, { 8, 10, 13,  8}, {13,  7,  9, 12}, { 9, 12, 11, 10},
+        { 5,  8,  7,  6}, { 1,  4,  3,  2}
+    },
+    { // (TotalCoeff - 1) << 2 | TrailingOnes, 000011 for no coefficients
+        { 3,  0,  0,  0}, { 0,  1,  0,  0}, { 4,  5,  6,  0}, { 8,  9, 10, 11}, {12, 13, 14, 15},
+        {16, 17, 18, 19}, {20, 21, 22, 23}, {24, 25, 26, 27}, {28, 29, 30, 31}, {32, 33, 34, 35},
+        {36, 37, 38, 39}, {40, 41, 42, 43}, {44, 45, 46, 47}, {48, 49, 50, 51}, {52, 53, 54, 55},
+        {56, 57, 58, 59}, {60, 61, 62, 63}
+    }
+};
+
+// Tables 9-7 and 9-8 (4x4 blocks), [TotalCoeff - 1][total_zeros]
+inline constexpr uint8_t TOTAL_ZEROS_LENGTH[15][16] = {
+    {1, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 9},
+    {3, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 6, 6, 6, 6},
+    {4, 3, 3, 3, 4, 4, 3, 3, 4, 5, 5, 6, 5, 6},
+    {5, 3, 4, 4, 3, 3, 3, 4, 3, 4, 5, 5, 5},
+    {4, 4, 4, 3, 3, 3, 3, 3, 4, 5, 4, 5},
+    {6, 5, 3, 3, 3, 3, 3, 3, 4, 3, 6},
+    {6, 5, 3, 3, 3, 2, 3, 4, 3, 6},
+    {6, 4, 5, 3, 2, 2, 3, 3, 6},
+    {6, 6, 4, 2, 2, 3, 2, 5},
+    {5, 5, 3, 2, 2, 2, 4},
+    {4, 4, 3, 3, 1, 3},
+    {4, 4, 2, 1, 3},
+    {3, 3, 1, 2},
+    {2, 2, 1},
+    {1, 1}
+};
+
+inline constexpr uint8_t TOTAL_ZEROS_CODE[15][16] = {
+    {1, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 1},
+    {7, 6, 5, 4, 3, 5, 4, 3, 2, 3, 2, 3, 2, 1, 0},
+    {5, 7, 6, 5, 4, 3, 4, 3, 2, 3, 2, 1, 1, 0},
+    {3, 7, 5, 4, 6, 5, 4, 3, 3, 2, 2, 1, 0},
+    {5, 4, 3, 7, 6, 5, 4, 3, 2, 1, 1, 0},
+    {1, 1, 7, 6, 5, 4, 3, 2, 1, 1, 0},
+    {1, 1, 5, 4, 3, 3, 2, 1, 1, 0},
+    {1, 1, 1, 3, 3, 2, 2, 1, 0},
+    {1, 0, 1, 3, 2, 1, 1, 1},
+    {1, 0, 1, 3, 2, 1, 1},
+    {0, 1, 1, 2, 1, 3},
+    {0, 1, 1, 1, 1},
+    {0, 1, 1, 1},
+    {0, 1, 1},
+    {0, 1}
+};
+
+// Table 9-10, [min(zerosLeft, 7) - 1][run_before]
+inline constexpr uint8_t RUN_BEFORE_LENGTH[7][15] = {
+    {1, 1},
+    {1, 2, 2},
+    {2, 2, 2, 2},
+    {2, 2, 2, 3, 3},
+    {2, 2, 3, 3, 3, 3},
+    {2, 3, 3, 3, 3, 3, 3},
+    {3, 3, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9, 10, 11}
+};
+
+inline constexpr uint8_t RUN_BEFORE_CODE[7][15] = {
+    {1, 0},
+    {1, 1, 0},
+    {3, 2, 1, 0},
+    {3, 2, 1, 1, 0},
+    {3, 2, 3, 2, 1, 0},
+    {3, 0, 1, 3, 2, 5, 4},
+    {7, 6, 5, 4, 3, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1}
+};
+
+template <std::size_t N>
+constexpr std::array<VLCCode, N> pack(const uint8_t (&lengths)[N], const uint8_t (&codes)[N]) {
+    std::array<VLCCode, N> table{};
+    for (std::size_t i = 0; i < N; ++i) {
+        table[i] = {codes[i], lengths[i]};
+    }
+    return table;
+}
+
+// No code may be the prefix of another one of the same table
+template <std::size_t N>
+constexpr bool prefix_free(const std::array<VLCCode, N>& table) {
+    for (std::size_t i = 0; i < N; ++i) {
+        for (std::size_t j = 0; j < N; ++j) {
+            const VLCCode a = table[i], b = table[j];
+            if (i == j || a.length == 0 || b.length == 0 || a.length > b.length) continue;
+            if ((b.code >> (b.length - a.length)) == a.code) return false;
+        }
+    }
+    return true;
+}
+
+constexpr auto make_coeff_token() {
+    std::array<std::array<VLCCode, 17 * 4>, 4> tables{};
+    for (int t = 0; t < 4; ++t) {
+        for (int total = 0; total <= 16; ++total) {
+            for (int ones = 0; ones < 4; ++ones) {
+                tables[t][total * 4 + ones] = {COEFF_TOKEN_CODE[t][total][ones], COEFF_TOKEN_LENGTH[t][total][ones]};
+            }
+        }
+    }
+    return tables;
+}
+
+constexpr auto make_total_zeros() {
+    std::array<std::array<VLCCode, 16>, 15> tables{};
+    for (int i = 0; i < 15; ++i) {
+        tables[i] = pack(TOTAL_ZEROS_LENGTH[i], TOTAL_ZEROS_CODE[i]);
+    }
+    return tables;
+}
+
+constexpr auto make_run_before() {
+    std::array<std::array<VLCCode, 15>, 7> tables{};
+    for (int i = 0; i < 7; ++i) {
+        tables[i] = pack(RUN_BEFORE_LENGTH[i], RUN_BEFORE_CODE[i]);
+    }
+    return tables;
+}
+
+// Coefficient i of the 4x4 block b of an 8x8 block is coefficient 4 * i + b of its zig-zag
+// scan (7.3.5.3.2); the table gives its raster position in the 8x8 block
+constexpr auto make_scan_8x8_as_4x4() {
+    constexpr int ZIGZAG[64] = {
+         0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+    };
+    std::array<std::array<uint8_t, 16>, 4> scan{};
+    for (int k = 0; k < 64; ++k) {
+        scan[k % 4][k / 4] = static_cast<uint8_t>(ZIGZAG[k]);
+    }
+    return scan;
+}
+
+} // namespace cavlc_detail
+
+// coeff_token by nC class, indexed TotalCoeff * 4 + TrailingOnes
+inline constexpr auto CAVLC_COEFF_TOKEN = cavlc_detail::make_coeff_token();
+// total_zeros of 4x4 blocks by TotalCoeff - 1
+inline constexpr auto CAVLC_TOTAL_ZEROS = cavlc_detail::make_total_zeros();
+// run_before by min(zerosLeft, 7) - 1
+inline constexpr auto CAVLC_RUN_BEFORE = cavlc_detail::make_run_before();
+// Raster positions of the four interleaved 4x4 blocks of an 8x8 block, in scan order
+inline constexpr auto CAVLC_SCAN_8X8_AS_4X4 = cavlc_detail::make_scan_8x8_as_4x4();
+
+constexpr int cavlc_coeff_token_table(int nc) {
+    return nc < 2 ? 0 : (nc < 4 ? 1 : (nc < 8 ? 2 : 3));
+}
+
+static_assert([] {
+    for (const auto& table : CAVLC_COEFF_TOKEN) {
+        if (!cavlc_detail::prefix_free(table)) return false;
+    }
+    for (const auto& table : CAVLC_TOTAL_ZEROS) {
+        if (!cavlc_detail::prefix_free(table)) return false;
+    }
+    for (const auto& table : CAVLC_RUN_BEFORE) {
+        if (!cavlc_detail::prefix_free(table)) return false;
+    }
+    return true;
+}(), "CAVLC code tables must be prefix-free");
+
+} // namespace processing
+} // namespace streaming
@@ -1,6 +1,7 @@
 // include/streaming/processing/dct_transform.hpp
 #pragma once
 
+#include "block_kernels.hpp"
 #include <cmath>
 #include <array>
 
@@ -11,6 +12,7 @@ class DCT {
 private:
     static constexpr int N = 8;
     std::array<std::array<double, N>, N> cos_table_;
+    std::array<std::array<double, N>, N> basis_; // C(u) * cos, for the inverse transform
     
 public:
     DCT() {
@@ -18,43 +20,56 @@ public:
         for (int i = 0; i < N; ++i) {
             for (int j = 0; j < N; ++j) {
                 cos_table_[i][j] = std::cos((2 * i + 1) * j * M_PI / (2.0 * N));
+                basis_[i][j] = (j == 0 ? 1.0 / std::sqrt(2) : 1.0) * cos_table_[i][j];
             }
         }
     }
     
+    // Separable fdct<8> (2 x 512 multiply-adds instead of 64 x 64 x 2)
     void forward_dct(const std::array<std::array<int16_t, N>, N>& input,
                     std::array<std::array<double, N>, N>& output) {
-        for (int u = 0; u < N; ++u) {
-            for (int v = 0; v < N; ++v) {
+        fdct<N>(input[0].data(), N, output[0].data());
+    }
+    
+    // Separable: columns then rows (2 x 512 multiplies instead of 64 x 64). Zero
+    // coefficient columns are skipped; that leaves every sum bit-identical, so the
+    // encoder's reconstruction and the decoder always agree.
+    void inverse_dct(const std::array<std::array<double, N>, N>& input,
+                    std::array<std::array<int16_t, N>, N>& output) const {
+        std::array<int, N> columns_used;
+        int used = 0;
+        for (int v = 0; v < N; ++v) {
+            for (int u = 0; u < N; ++u) {
+                if (input[u][v] != 0.0) {
+                    columns_used[used++] = v;
+                    break;
+                }
+            }
+        }
+        
+        if (used == 0) {
+            output = {};
+            return;
+        }
+        
+        std::array<std::array<double, N>, N> columns;
+        for (int x = 0; x < N; ++x) {
+            for (int i = 0; i < used; ++i) {
+                const int v = columns_used[i];
                 double sum = 0.0;
-                
-                for (int x = 0; x < N; ++x) {
-                    for (int y = 0; y < N; ++y) {
-                        sum += input[x][y] * cos_table_[x][u] * cos_table_[y][v];
-                    }
+                for (int u = 0; u < N; ++u) {
+                    sum += input[u][v] * basis_[x][u];
                 }
-                
-                double cu = (u == 0) ? 1.0 / std::sqrt(2) : 1.0;
-                double cv = (v == 0) ? 1.0 / std::sqrt(2) : 1.0;
-                
-                output[u][v] = 0.25 * cu * cv * sum;
+                columns[x][v] = sum;
             }
         }
-    }
-    
-    void inverse_dct(const std::array<std::array<double, N>, N>& input,
-                    std::array<std::array<int16_t, N>, N>& output) {
+        
         for (int x = 0; x < N; ++x) {
             for (int y = 0; y < N; ++y) {
                 double sum = 0.0;
-                
-                for (int u = 0; u < N; ++u) {
-                    for (int v = 0; v < N; ++v) {
-                        double cu = (u == 0) ? 1.0 / std::sqrt(2) : 1.0;
-                        double cv = (v == 0) ? 1.0 / std::sqrt(2) : 1.0;
-                        
-                        sum += cu * cv * input[u][v] * cos_table_[x][u] * cos_table_[y][v];
-                    }
+                for (int i = 0; i < used; ++i) {
+                    const int v = columns_used[i];
+                    sum += columns[x][v] * basis_[y][v];
                 }
                 
                 output[x][y] = static_cast<int16_t>(std::round(0.25 * sum));
@@ -0,0 +1,113 @@
+// include/streaming/processing/deblocking_filter.hpp
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace streaming {
+namespace processing {
+
+// In-loop deblocking filters. Codecs describe their blocks (prediction mode, coded
+// coefficients, motion, QP) while coding and filter one block row at a time right behind
+// the rows being reconstructed, so filtering overlaps with coding instead of being a
+// separate pass over the frame.
+// 16-sample luma edges go through AVX2 kernels (vertical edges via a 16x8 transpose);
+// shorter edges and chroma use scalar code that produces the same samples.
+// Edges are only filtered where all samples they read lie inside the picture, so the
+// area past the picture edge (undefined in a reconstruction) never affects the result.
+
+// H.264 (8.7) with 8x8 transforms: vertical then horizontal edges 0 and 8 of every
+// macroblock in decoding order; bS 4 / 3 for intra, 2 for coded 8x8 blocks, 1 for
+// motion or reference changes.
+class H264DeblockingFilter {
+public:
+    struct MacroblockInfo {
+        bool intra = true;
+        uint8_t coded = 0;          // Bit per 8x8 block (raster order) with non-zero coefficients
+        int8_t qp = 0;              // qP
+        int8_t ref_idx = -1;        // Inter: reference index (same list for the whole picture)
+        int16_t mv_x = 0, mv_y = 0; // Inter: quarter-pel motion vector
+    };
+
+    // Luma rows at the bottom of a macroblock row that filtering the next row still changes
+    static constexpr int ROWS_CHANGED_BELOW = 3;
+
+    void configure(uint32_t width, uint32_t height);
+    // FilterOffsetA / FilterOffsetB (slice_alpha_c0_offset_div2 / slice_beta_offset_div2 times 2)
+    void set_offsets(int alpha_offset, int beta_offset);
+
+    MacroblockInfo& info(uint32_t mb_x, uint32_t mb_y) { return info_[static_cast<size_t>(mb_y) * mb_width_ + mb_x]; }
+    const MacroblockInfo& info(uint32_t mb_x, uint32_t mb_y) const {
+        return info_[static_cast<size_t>(mb_y) * mb_width_ + mb_x];
+    }
+
+    // Filters macroblock row mb_y. Rows above have to be filtered already and this row
+    // fully reconstructed; the row below is left alone.
+    void filter_row(uint8_t* luma, int stride, uint32_t mb_y) const;
+    // Same for 4:2:0 chroma (chroma_qp_index_offset 0), for codecs that reconstruct it
+    void filter_chroma_row(uint8_t* cb, uint8_t* cr, int stride, uint32_t mb_y) const;
+
+    uint32_t mb_width() const { return mb_width_; }
+    uint32_t mb_height() const { return mb_height_; }
+
+private:
+    // bS of the edge segment between 8x8 block p_block of p and q_block of q
+    static int boundary_strength(const MacroblockInfo& p, int p_block, const MacroblockInfo& q, int q_block,
+                                 bool mb_edge);
+    void filter_luma_edge(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int length,
+                          const uint8_t bs[4], int qp) const;
+
+    uint32_t width_ = 0, height_ = 0;
+    uint32_t mb_width_ = 0, mb_height_ = 0;
+    int alpha_offset_ = 0, beta_offset_ = 0;
+    std::vector<MacroblockInfo> info_;
+};
+
+// HEVC (8.7.2) on the 8x8 grid: all vertical edges of a block row, then its horizontal
+// edges; bS 2 for intra, 1 for coded transform blocks or motion / reference changes;
+// strong, normal or no filtering decided per 4-line segment.
+class HevcDeblockingFilter {
+public:
+    struct BlockInfo { // One 8x8 luma block
+        bool intra = true;
+        bool coded = false;         // Transform block with non-zero coefficients
+        int8_t qp = 0;              // QpY of the coding unit
+        int8_t ref_idx = -1;
+        int16_t mv_x = 0, mv_y = 0; // Quarter-pel
+    };
+
+    static constexpr int ROWS_CHANGED_BELOW = 3;
+
+    // row_height = CTU size: the unit filter_row() works on
+    void configure(uint32_t width, uint32_t height, int row_height);
+    // slice_beta_offset_div2 / slice_tc_offset_div2
+    void set_offsets(int beta_offset_div2, int tc_offset_div2);
+
+    // Block covering luma sample (x, y)
+    BlockInfo& info(int x, int y) { return info_[static_cast<size_t>(y >> 3) * grid_width_ + (x >> 3)]; }
+    const BlockInfo& info(int x, int y) const { return info_[static_cast<size_t>(y >> 3) * grid_width_ + (x >> 3)]; }
+    // Sets every 8x8 block of the area (clipped to the picture)
+    void fill(int x, int y, int width, int height, const BlockInfo& block);
+
+    // Filters block row `row`. The row above has to be filtered already and this row
+    // fully reconstructed; the row below is left alone.
+    void filter_row(uint8_t* luma, int stride, int row) const;
+
+    int rows() const { return row_height_ ? (static_cast<int>(height_) + row_height_ - 1) / row_height_ : 0; }
+
+private:
+    static int boundary_strength(const BlockInfo& p, const BlockInfo& q);
+    // One edge of up to 16 samples: four 4-line segments with their own bS and QP
+    void filter_luma_edge(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int segments,
+                          const uint8_t bs[4], const int qp[4]) const;
+
+    uint32_t width_ = 0, height_ = 0;
+    int row_height_ = 64;
+    int grid_width_ = 0, grid_height_ = 0;
+    int beta_offset_ = 0, tc_offset_ = 0;
+    std::vector<BlockInfo> info_;
+};
+
+} // namespace processing
+} // namespace streaming
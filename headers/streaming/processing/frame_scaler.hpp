@@ -0,0 +1,50 @@
+// include/streaming/processing/frame_scaler.hpp
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace streaming {
+namespace processing {
+
+// Bilinear resampling of one 8-bit plane with centre-aligned sample positions.
+// Source positions and weights are computed once per size pair; scale() is a vertical
+// pass into a 16-bit row followed by a horizontal pass (both AVX2 when available).
+class PlaneScaler {
+public:
+    void configure(int src_width, int src_height, int dst_width, int dst_height);
+    void scale(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride);
+
+    int src_width() const { return src_width_; }
+    int src_height() const { return src_height_; }
+    int dst_width() const { return dst_width_; }
+    int dst_height() const { return dst_height_; }
+
+private:
+    int src_width_ = 0, src_height_ = 0;
+    int dst_width_ = 0, dst_height_ = 0;
+    std::vector<int32_t> x_index_;   // Left source sample per output column
+    std::vector<int32_t> x_weights_; // (64 - f) | f << 16, as madd pairs
+    std::vector<int32_t> y_index_;
+    std::vector<int16_t> y_fraction_;
+    std::vector<int16_t> row_;       // Vertically filtered row (x64), last sample repeated
+};
+
+// I420 frame resampler: luma and, when present, both chroma planes. The destination
+// is tightly packed (stride = width).
+class FrameScaler {
+public:
+    void configure(int src_width, int src_height, int dst_width, int dst_height);
+
+    // Chroma planes follow the luma plane with half the luma stride
+    void scale(const uint8_t* src, int src_stride, bool has_chroma, std::vector<uint8_t>& dst);
+    // Separate Y, U, V planes; without U / V the output chroma is mid-grey
+    void scale(const uint8_t* const planes[3], const int strides[3], std::vector<uint8_t>& dst);
+
+private:
+    PlaneScaler luma_;
+    PlaneScaler chroma_;
+};
+
+} // namespace processing
+} // namespace streaming
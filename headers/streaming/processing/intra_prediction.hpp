@@ -0,0 +1,234 @@
+// include/streaming/processing/intra_prediction.hpp
+#pragma once
+
+#include "../codec/av1_structures.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace streaming {
+namespace processing {
+
+// Intra prediction for the block-based codecs: reference sample preparation, the
+// predictors of each standard and a fast SATD-based mode decision.
+// Predictors work on rows of contiguous reference samples, so angular, planar and smooth
+// prediction run 16 samples per AVX2 instruction (horizontal modes predict transposed);
+// the scalar fallback produces the same samples.
+
+// Neighbouring samples of a block. above[0] and left[0] are the top-left corner,
+// above[1 + i] is the sample above column i and left[1 + j] the sample left of row j.
+struct IntraEdges {
+    static constexpr int MAX_SIZE = 128;
+    static constexpr int LENGTH = 2 * MAX_SIZE + 1;
+
+    alignas(32) std::array<uint8_t, LENGTH + 32> above{}; // Padded for vector loads
+    alignas(32) std::array<uint8_t, LENGTH + 32> left{};
+    bool has_above = false; // Availability before substitution (DC and H.264 mode rules)
+    bool has_left = false;
+    bool has_corner = false;
+
+    // Loads `above_length` samples above and `left_length` to the left of the block at
+    // `block`, of which the first `above_available` / `left_available` exist (a prefix, as
+    // availability goes in z-order). Missing samples are substituted HEVC-style (8.4.4.2.2):
+    // from the nearest available sample along the left-bottom to above-right chain, 128
+    // when there is none.
+    void load(const uint8_t* block, ptrdiff_t stride, int above_length, int left_length,
+              int above_available, int left_available, bool corner_available);
+};
+
+// Number of neighbouring samples available in z-order inside a CTU (or superblock), for
+// blocks coded in quad-tree order. Above-right samples in the CTU row above are available
+// up to tile_x1 (the CTU above-right is finished under WPP and without it); below-left
+// samples only inside the current CTU.
+struct IntraAvailability {
+    int above = 0; // Samples above, from x (0 .. above_length)
+    int left = 0;  // Samples left, from y (0 .. left_length)
+    bool corner = false;
+};
+IntraAvailability intra_availability(int x, int y, int width, int height, int above_length, int left_length,
+                                     int ctu_x, int ctu_y, int ctu_size, int tile_x0, int tile_y0,
+                                     int tile_x1, int tile_y1);
+
+// HEVC (8.4.4.2): 0 planar, 1 DC, 2..34 angular, square blocks of 4..32.
+// hevc_filter_edges() applies the [1 2 1] reference smoothing the size and mode call for
+// (hevc_filters_edges; no strong smoothing); the edges need 2 * size samples on each side.
+constexpr int HEVC_INTRA_MODES = 35;
+bool hevc_filters_edges(int size, int mode);
+void hevc_filter_edges(IntraEdges& edges, int size, int mode);
+void predict_hevc(const IntraEdges& edges, int size, int mode, uint8_t* dst, ptrdiff_t stride);
+
+// VVC: 0 planar, 1 DC, 2..66 angular on width x height blocks of up to 128 (the HEVC
+// geometry at twice the angular resolution; no wide angles, PDPC or 4-tap filters).
+// The edges need width + height samples on each side.
+constexpr int VVC_INTRA_MODES = 67;
+void predict_vvc(const IntraEdges& edges, int width, int height, int mode, uint8_t* dst, ptrdiff_t stride);
+
+// H.264 Intra_16x16 (8.3.3): 0 vertical, 1 horizontal, 2 DC, 3 plane
+constexpr int H264_INTRA_16X16_MODES = 4;
+bool h264_16x16_mode_available(const IntraEdges& edges, int mode);
+void predict_h264_16x16(const IntraEdges& edges, int mode, uint8_t* dst, ptrdiff_t stride);
+
+// H.264 Intra_8x8 (8.3.2): the nine Intra_NxN directions on the filtered reference
+// (h264_filter_edges_8x8, 8.3.2.2.1). The edges need 16 samples above and 8 on the left.
+constexpr int H264_INTRA_NXN_MODES = 9;
+constexpr int H264_INTRA_DC = 2;
+bool h264_8x8_mode_available(const IntraEdges& edges, int mode);
+void h264_filter_edges_8x8(IntraEdges& edges);
+void predict_h264_8x8(const IntraEdges& edges, int mode, uint8_t* dst, ptrdiff_t stride);
+
+// Macroblocks next to a H.264 macroblock that intra prediction may read (same slice)
+struct H264IntraNeighbours {
+    bool left = false;
+    bool above = false;
+    bool above_right = false;
+    bool above_left = false;
+};
+// Edges of the macroblock at `origin` (block -1, Intra_16x16) or of its 8x8 block `block`
+// (0..3 in raster order), limited to the visible_w x visible_h picture samples from the
+// macroblock origin. Encoder and decoder share it, so both see the same references.
+void load_h264_edges(IntraEdges& edges, const uint8_t* origin, ptrdiff_t stride, const H264IntraNeighbours& neighbours,
+                     int block, int visible_w, int visible_h);
+// Intra_8x8 mode prediction (8.3.2.1): the smaller mode of the left and above blocks,
+// DC when either is unavailable (-1). Blocks of other macroblock types count as DC.
+inline int h264_predicted_8x8_mode(int left_mode, int above_mode) {
+    return left_mode < 0 || above_mode < 0 ? H264_INTRA_DC : std::min(left_mode, above_mode);
+}
+
+// AV1 (7.11.2): DC, smooth, Paeth and the directional modes at their nominal angle plus
+// 3 * angle_delta (-3..3), on width x height blocks of up to 64 (no edge filter or
+// upsampling). The edges need width + height samples on each side; use load_av1_edges.
+constexpr int AV1_MAX_ANGLE_DELTA = 3;
+void load_av1_edges(IntraEdges& edges, const uint8_t* block, ptrdiff_t stride, int width, int height,
+                    int above_available, int left_available);
+bool av1_is_directional(codec::PredictionMode mode);
+void predict_av1(const IntraEdges& edges, int width, int height, codec::PredictionMode mode, int angle_delta,
+                 uint8_t* dst, ptrdiff_t stride);
+
+// SATD of a width x height block (8x8 Hadamard, 4x4 where a side is 4), AVX2 when available
+uint32_t intra_satd(const uint8_t* source, ptrdiff_t source_stride, const uint8_t* prediction,
+                    ptrdiff_t prediction_stride, int width, int height);
+
+// Mode decision on SATD + lambda * mode bits. Angular mode sets are searched coarse to
+// fine (planar, DC and the most probable modes, every step-th direction, then halving
+// steps around the best one), which evaluates about 17 of the 35 HEVC modes (step 4) and
+// 22 of the 67 VVC ones (step 8). The search stops early once the cost is below about one
+// unit per sample, and when the per-CTU time budget runs out it keeps the best mode found
+// so far. One instance per coding thread.
+class IntraModeSearch {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Result {
+        int mode = 0;
+        uint32_t cost = UINT32_MAX;
+    };
+
+    // 0 = unlimited (the default): the search is then deterministic
+    void set_time_budget(std::chrono::microseconds budget) { budget_ = budget; }
+    std::chrono::microseconds time_budget() const { return budget_; }
+
+    // Starts the time budget of the next CTU
+    void begin_ctu() {
+        if (budget_.count() > 0) {
+            deadline_ = Clock::now() + budget_;
+        }
+    }
+    bool out_of_time() const { return budget_.count() > 0 && Clock::now() >= deadline_; }
+
+    // cost(mode) -> uint32_t. Modes 0 and 1 are planar and DC, 2 .. mode_count - 1 angular;
+    // coarse_step is the spacing of the first angular pass (a power of two).
+    template <typename Cost>
+    Result search_angular(int mode_count, int coarse_step, const int* mpm, int mpm_count, uint32_t early_exit,
+                          Cost&& cost) {
+        Result best;
+        evaluated_.fill(0);
+        auto try_mode = [&](int mode) {
+            if (mode < 0 || mode >= mode_count || evaluated_[mode]) return;
+            evaluated_[mode] = 1;
+            const uint32_t c = cost(mode);
+            modes_evaluated_++;
+            if (c < best.cost) {
+                best.cost = c;
+                best.mode = mode;
+            }
+        };
+
+        // Always evaluated: the cheapest modes to signal
+        try_mode(0);
+        try_mode(1);
+        for (int i = 0; i < mpm_count; ++i) {
+            try_mode(mpm[i]);
+        }
+        if (best.cost <= early_exit) {
+            early_exits_++;
+            return best;
+        }
+
+        for (int mode = 2; mode < mode_count; mode += coarse_step) {
+            if (out_of_time()) {
+                budget_hits_++;
+                return best;
+            }
+            try_mode(mode);
+        }
+        if (best.mode < 2 || best.cost <= early_exit) {
+            return best; // Planar or DC won the coarse pass
+        }
+
+        for (int step = coarse_step / 2; step >= 1; step /= 2) {
+            if (out_of_time()) {
+                budget_hits_++;
+                return best;
+            }
+            const int centre = best.mode;
+            try_mode(centre - step);
+            try_mode(centre + step);
+        }
+        return best;
+    }
+
+    // Small mode sets (H.264, AV1): evaluated in the given order, cheapest to signal first.
+    // Unusable modes cost UINT32_MAX; the budget only stops the search once one is found.
+    template <typename Cost>
+    Result search_list(const int* modes, int count, uint32_t early_exit, Cost&& cost) {
+        Result best;
+        for (int i = 0; i < count; ++i) {
+            if (best.cost != UINT32_MAX && out_of_time()) {
+                budget_hits_++;
+                break;
+            }
+            const uint32_t c = cost(modes[i]);
+            modes_evaluated_++;
+            if (c < best.cost) {
+                best.cost = c;
+                best.mode = modes[i];
+            }
+            if (best.cost <= early_exit) {
+                early_exits_++;
+                break;
+            }
+        }
+        return best;
+    }
+
+    // Statistics since construction
+    uint64_t modes_evaluated() const { return modes_evaluated_; }
+    uint64_t early_exits() const { return early_exits_; }
+    uint64_t budget_hits() const { return budget_hits_; }
+
+private:
+    std::chrono::microseconds budget_{0};
+    Clock::time_point deadline_{};
+    std::array<uint8_t, 128> evaluated_{};
+    uint64_t modes_evaluated_ = 0;
+    uint64_t early_exits_ = 0;
+    uint64_t budget_hits_ = 0;
+};
+
+// sqrt(lambda) of the SATD-domain mode decision at a H.264-scale QP, in 1/16 units
+uint32_t intra_lambda_sad(int qp);
+
+} // namespace processing
+} // namespace streaming
@@ -1,11 +1,14 @@
 // include/streaming/processing/motion_estimation.hpp
 #pragma once
 
+#include <climits>
 #include <cstdint>
 #include <vector>
 #include <array>
 #include <cmath>
 #include <algorithm>
+#include "block_kernels.hpp"
+#include "subpel_interpolation.hpp"
 
 namespace streaming {
 namespace processing {
@@ -14,44 +17,154 @@ struct MotionVector {
     int16_t x, y;
     uint16_t cost;
     bool valid = false;
+    int8_t frac_x = 0, frac_y = 0; // Quarter-pel fraction (0-3), set by refine_subpel
     
     MotionVector() : x(0), y(0), cost(UINT16_MAX), valid(false) {}
     MotionVector(int16_t dx, int16_t dy, uint16_t c) : x(dx), y(dy), cost(c), valid(true) {}
+    
+    // Motion vector in quarter-pel units (as signalled in the bitstream)
+    int qpel_x() const { return x * 4 + frac_x; }
+    int qpel_y() const { return y * 4 + frac_y; }
+};
+
+// Luma reference plane. Samples up to `padding` pixels outside the frame must be
+// readable (border-extended), which lets the search clamp instead of skipping candidates.
+struct ReferencePlane {
+    const uint8_t* origin; // Pixel (0, 0)
+    int stride;
+    int width;
+    int height;
+    int padding;
 };
 
 class MotionEstimator {
-private:
+public:
     static constexpr int BLOCK_SIZE = 16;
     static constexpr int SEARCH_RANGE = 32; // Pixels to search
+    
+private:
     static constexpr int EARLY_TERMINATION_THRESHOLD = 256;
     
 public:
     MotionEstimator() = default;
     
+    // Keeps the reference block of block_width (>= BLOCK_SIZE) pixels, interpolation taps
+    // included, left of column max_x of the reference (intra refresh). Searches return an
+    // invalid vector when no candidate fits. NO_REFERENCE_LIMIT lifts it.
+    static constexpr int NO_REFERENCE_LIMIT = INT_MAX / 2;
+    void set_reference_limit(int max_x, int block_width = BLOCK_SIZE) {
+        reference_limit_ = max_x >= NO_REFERENCE_LIMIT ? NO_REFERENCE_LIMIT : max_x - (block_width - BLOCK_SIZE);
+    }
+    
     // Full search motion estimation (accurate but slow)
-    MotionVector estimate_full_search(const uint8_t* current_frame, const uint8_t* reference_frame,
-                                     int width, int height, int x, int y);
+    MotionVector estimate_full_search(const uint8_t* current_frame, int current_stride,
+                                     const ReferencePlane& reference, int x, int y);
     
     // Fast diamond search (good balance of speed/accuracy)
-    MotionVector estimate_diamond_search(const uint8_t* current_frame, const uint8_t* reference_frame,
-                                        int width, int height, int x, int y);
+    MotionVector estimate_diamond_search(const uint8_t* current_frame, int current_stride,
+                                        const ReferencePlane& reference, int x, int y) {
+        return estimate_diamond_search(current_frame, current_stride, reference, x, y, 0, 0);
+    }
+    // Diamond search starting from the better of the zero vector and a predictor
+    // (e.g. the pre-analysis vector of the block)
+    MotionVector estimate_diamond_search(const uint8_t* current_frame, int current_stride,
+                                        const ReferencePlane& reference, int x, int y,
+                                        int predictor_x, int predictor_y);
     
     // Three-step search (faster but less accurate)
-    MotionVector estimate_three_step_search(const uint8_t* current_frame, const uint8_t* reference_frame,
-                                           int width, int height, int x, int y);
+    MotionVector estimate_three_step_search(const uint8_t* current_frame, int current_stride,
+                                           const ReferencePlane& reference, int x, int y);
     
     // Adaptive search based on content complexity
+    MotionVector estimate_adaptive(const uint8_t* current_frame, int current_stride,
+                                  const ReferencePlane& reference, int x, int y,
+                                  int prev_mv_x, int prev_mv_y);
+    
+    // Unpadded references (stride == width): candidates are limited to the frame
+    MotionVector estimate_full_search(const uint8_t* current_frame, const uint8_t* reference_frame,
+                                     int width, int height, int x, int y) {
+        return estimate_full_search(current_frame, width, ReferencePlane{reference_frame, width, width, height, 0}, x, y);
+    }
+    MotionVector estimate_diamond_search(const uint8_t* current_frame, const uint8_t* reference_frame,
+                                        int width, int height, int x, int y) {
+        return estimate_diamond_search(current_frame, width, ReferencePlane{reference_frame, width, width, height, 0}, x, y);
+    }
+    MotionVector estimate_three_step_search(const uint8_t* current_frame, const uint8_t* reference_frame,
+                                           int width, int height, int x, int y) {
+        return estimate_three_step_search(current_frame, width, ReferencePlane{reference_frame, width, width, height, 0}, x, y);
+    }
     MotionVector estimate_adaptive(const uint8_t* current_frame, const uint8_t* reference_frame,
-                                  int width, int height, int x, int y, int prev_mv_x, int prev_mv_y);
+                                  int width, int height, int x, int y, int prev_mv_x, int prev_mv_y) {
+        return estimate_adaptive(current_frame, width, ReferencePlane{reference_frame, width, width, height, 0},
+                                 x, y, prev_mv_x, prev_mv_y);
+    }
+    
+    // Half-pel then quarter-pel refinement around an integer-pel vector (SATD + MV cost)
+    MotionVector refine_subpel(const uint8_t* current_frame, int current_stride,
+                               const HalfPelPlanes& reference, int x, int y,
+                               const MotionVector& integer_mv) const;
 
 private:
-    uint16_t calculate_sad(const uint8_t* block1, const uint8_t* block2, int stride) const;
+    // Vector range whose block stays inside the readable (padded) reference
+    struct SearchWindow {
+        int min_x, max_x;
+        int min_y, max_y;
+        
+        bool empty() const { return max_x < min_x || max_y < min_y; }
+    };
+    
+    // Samples right of an interpolated block that the longest (8-tap) filter reads
+    static constexpr int SUBPEL_TAPS_RIGHT = 4;
+    
+    SearchWindow search_window(const ReferencePlane& reference, int x, int y) const;
+    
     uint16_t calculate_satd(const uint8_t* block1, const uint8_t* block2, int stride) const;
-    bool is_within_frame(int x, int y, int width, int height) const;
     
     // Fast cost functions
-    uint16_t hybrid_cost(const uint8_t* block1, const uint8_t* block2, int stride, int mv_x, int mv_y) const;
+    uint16_t hybrid_cost(const uint8_t* current_block, int current_stride,
+                         const ReferencePlane& reference, int ref_x, int ref_y, int mv_x, int mv_y) const;
+    
+    int reference_limit_ = NO_REFERENCE_LIMIT;
+};
+
+// Motion of a macroblock next to the one being coded, for H.264 motion vector prediction
+struct H264NeighbourMotion {
+    bool available = false; // Inside the picture and the slice
+    int ref_idx = -1;       // -1: intra or not available
+    int mv_x = 0, mv_y = 0; // Quarter-pel
 };
 
+// mvpL0 of a 16x16 partition (8.4.1.3) from the left (a), above (b) and above-right (c,
+// the above-left when the above-right is not available) macroblocks
+inline void h264_predict_mv(const H264NeighbourMotion& a, H264NeighbourMotion b, H264NeighbourMotion c,
+                            int ref_idx, int& mv_x, int& mv_y) {
+    if (!b.available && !c.available && a.available) {
+        b = a;
+        c = a;
+    }
+    const int matches = (a.ref_idx == ref_idx) + (b.ref_idx == ref_idx) + (c.ref_idx == ref_idx);
+    if (matches == 1) {
+        const H264NeighbourMotion& only = a.ref_idx == ref_idx ? a : (b.ref_idx == ref_idx ? b : c);
+        mv_x = only.mv_x;
+        mv_y = only.mv_y;
+        return;
+    }
+    auto median = [](int x, int y, int z) { return std::max(std::min(x, y), std::min(std::max(x, y), z)); };
+    mv_x = median(a.mv_x, b.mv_x, c.mv_x);
+    mv_y = median(a.mv_y, b.mv_y, c.mv_y);
+}
+
+// Motion of a P_Skip macroblock (8.4.1.1): reference 0 and the predicted vector, or no
+// motion at the picture / slice edge and next to a still neighbour
+inline void h264_skip_mv(const H264NeighbourMotion& a, const H264NeighbourMotion& b,
+                         const H264NeighbourMotion& c, int& mv_x, int& mv_y) {
+    auto still = [](const H264NeighbourMotion& n) { return n.ref_idx == 0 && n.mv_x == 0 && n.mv_y == 0; };
+    if (!a.available || !b.available || still(a) || still(b)) {
+        mv_x = mv_y = 0;
+        return;
+    }
+    h264_predict_mv(a, b, c, 0, mv_x, mv_y);
+}
+
 } // namespace processing
 } // namespace streaming
\ No newline at end of file
@@ -0,0 +1,93 @@
+// include/streaming/processing/partition_search.hpp
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace streaming {
+namespace processing {
+
+// Fast split decisions for the HEVC quad-tree, the VVC multi-type tree and AV1 partitions.
+// Candidate costs come from statistics computed once per CTU (BlockStatistics), and the
+// search is pruned by three rules: a block is final once splitting cannot win, binary and
+// ternary splits are only tried along the direction the gradients point to, and the speed
+// preset caps the depth and the candidate set.
+
+// Luma statistics of a CTU / superblock on a grid of 4x4 units, as summed-area tables: the
+// statistics of any 4-aligned block inside it cost four lookups, so every block of every
+// candidate partition is measured once per CTU instead of once per evaluation.
+class BlockStatistics {
+public:
+    struct Stats {
+        uint32_t count = 0;      // Samples inside the picture
+        uint64_t sum = 0;
+        uint64_t sum_sq = 0;
+        uint64_t gradient_h = 0; // Sum of |p(x + 1, y) - p(x, y)|: detail across columns
+        uint64_t gradient_v = 0; // Sum of |p(x, y + 1) - p(x, y)|: detail across rows
+
+        // Squared error of a flat (DC) prediction of the block
+        double sse() const {
+            return count ? static_cast<double>(sum_sq) - static_cast<double>(sum) * static_cast<double>(sum) / count
+                         : 0.0;
+        }
+    };
+
+    // Builds the tables for the size x size area at (x0, y0), clipped to the picture
+    void compute(const uint8_t* luma, ptrdiff_t stride, int width, int height, int x0, int y0, int size);
+    // Block at picture position (x, y); position and size are multiples of 4 inside the area
+    Stats block(int x, int y, int width, int height) const;
+
+private:
+    int x0_ = 0, y0_ = 0;
+    int width_ = 0, height_ = 0; // Picture size
+    int units_ = 0;              // Table row length: area units + 1
+    std::vector<uint64_t> sum_, sum_sq_, gradient_h_, gradient_v_; // (units + 1)^2, zero first row / column
+};
+
+// Search limits of one speed preset
+struct PartitionSearchConfig {
+    int min_block_size;    // Blocks at this size are not split further
+    bool rectangular;      // Binary splits (VVC BT, AV1 HORZ / VERT)
+    bool ternary;          // VVC TT
+    int max_mtt_depth;     // VVC binary / ternary nesting below the quad-tree leaves
+    double gradient_ratio; // A split across rows needs gradient_v >= ratio x gradient_h (and
+                           // vice versa); 0 tries both directions
+    double early_exit;     // Block is final when its flat error <= early_exit x lambda x the
+                           // extra bits of the cheapest split; 1 is exact (no split can win
+                           // under residual_rd_cost)
+};
+
+// Speed 0 (slowest, best quality) .. 9 (fastest). The table in partition_search.cpp lists
+// the measured speed and BD-rate of each preset.
+constexpr int PARTITION_SPEED_PRESETS = 10;
+const PartitionSearchConfig& partition_search_config(int speed);
+
+// D + lambda x R of coding the flat-prediction residual of a block, on a high-rate model:
+// at the codecs' lambda (about the quantisation error Qstep^2 / 12) a block whose variance
+// is below lambda is left uncoded, otherwise each sample costs lambda in distortion plus
+// log2(variance / lambda) / 2 bits. Never more than the block's SSE.
+inline double residual_rd_cost(const BlockStatistics::Stats& stats, double lambda) {
+    const double sse = stats.sse();
+    if (sse <= lambda * stats.count) {
+        return sse;
+    }
+    return lambda * stats.count * (1.0 + 0.5 * std::log2(sse / (lambda * stats.count)));
+}
+
+// Pruning rules of the presets
+inline bool partition_is_final(const BlockStatistics::Stats& stats, double lambda, double extra_split_bits,
+                               const PartitionSearchConfig& config) {
+    return stats.sse() <= config.early_exit * lambda * extra_split_bits;
+}
+// across_rows: the split stacks the parts vertically (HEVC / VVC horizontal, AV1 HORZ)
+inline bool split_direction_useful(const BlockStatistics::Stats& stats, bool across_rows,
+                                   const PartitionSearchConfig& config) {
+    const double along = static_cast<double>(across_rows ? stats.gradient_v : stats.gradient_h);
+    const double other = static_cast<double>(across_rows ? stats.gradient_h : stats.gradient_v);
+    return along >= config.gradient_ratio * other;
+}
+
+} // namespace processing
+} // namespace streaming
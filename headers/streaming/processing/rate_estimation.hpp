@@ -0,0 +1,57 @@
+// include/streaming/processing/rate_estimation.hpp
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+namespace streaming {
+namespace processing {
+
+// Rates for RDO in fractional bits: RATE_ONE is one bit. The entropy coders price their
+// symbols with probability_rate() (CABAC contexts, AV1 CDFs), so a mode or partition
+// candidate costs a table lookup per bin instead of a trial encode.
+constexpr int RATE_FRAC_BITS = 15;
+constexpr uint32_t RATE_ONE = 1u << RATE_FRAC_BITS;
+
+namespace detail {
+
+// log2(1 + i / 128) in RATE units, by repeated squaring of the mantissa (Q30)
+constexpr auto make_log2_mantissa() {
+    std::array<uint32_t, 128> table{};
+    for (uint64_t i = 0; i < 128; ++i) {
+        uint64_t m = (128 + i) << 23; // [1, 2) in Q30
+        uint32_t log2 = 0;
+        for (int bit = 0; bit < RATE_FRAC_BITS; ++bit) {
+            m = (m * m) >> 30;
+            log2 <<= 1;
+            if (m >= (2ull << 30)) {
+                m >>= 1;
+                log2 |= 1;
+            }
+        }
+        table[i] = log2;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint32_t, 128> LOG2_MANTISSA = make_log2_mantissa();
+
+} // namespace detail
+
+// -log2(probability / 32768) in RATE units: the cost of a symbol whose 15-bit probability
+// is given. A 7-bit mantissa keeps the error under 0.012 bits.
+constexpr uint32_t probability_rate(uint32_t probability) {
+    probability = std::clamp<uint32_t>(probability, 1, 1u << 15);
+    const int exponent = std::bit_width(probability) - 1;
+    const uint32_t mantissa = exponent >= 7 ? probability >> (exponent - 7) : probability << (7 - exponent);
+    return (static_cast<uint32_t>(15 - exponent) << RATE_FRAC_BITS) - detail::LOG2_MANTISSA[mantissa - 128];
+}
+
+constexpr double rate_to_bits(uint64_t rate) {
+    return static_cast<double>(rate) / RATE_ONE;
+}
+
+} // namespace processing
+} // namespace streaming
@@ -0,0 +1,85 @@
+// include/streaming/processing/subpel_interpolation.hpp
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <vector>
+
+namespace streaming {
+namespace processing {
+
+// Codec-specific luma interpolation filters
+enum class SubpelFilterType {
+    H264_6TAP,      // (1,-5,20,20,-5,1)/32, quarter-pel = bilinear average
+    HEVC_8TAP,      // HEVC/VVC DCT-IF luma filter, /64
+    AV1_REGULAR,    // EIGHTTAP, /128
+    AV1_SMOOTH,     // EIGHTTAP_SMOOTH, /128
+    AV1_SHARP       // EIGHTTAP_SHARP, /128
+};
+
+struct SubpelFilter {
+    // coeffs[frac] for frac = 0 (full), 1 (1/4), 2 (1/2), 3 (3/4); centre tap is index 3
+    std::array<std::array<int16_t, 8>, 4> coeffs;
+    int shift;                 // log2 of the tap sum
+    int intermediate_shift;    // rounding shift after the first (horizontal) pass
+    bool bilinear_quarter;     // H.264: quarter positions average neighbouring half/full samples
+};
+
+const SubpelFilter& get_subpel_filter(SubpelFilterType type);
+
+// Half-pel planes precomputed once per reference frame.
+// Planes are border-extended by PADDING pixels so refinement never bounds-checks.
+class HalfPelPlanes {
+public:
+    static constexpr int PADDING = 48;
+
+    enum Plane { FULL = 0, HALF_H = 1, HALF_V = 2, HALF_HV = 3 };
+
+    void build(const uint8_t* reference, int stride, int width, int height,
+               SubpelFilterType type);
+
+    // Pointer to pixel (x, y) of the given plane (x, y may be negative up to PADDING)
+    const uint8_t* at(Plane plane, int x, int y) const {
+        return planes_[plane].data() + (y + PADDING) * stride_ + (x + PADDING);
+    }
+
+    // Block prediction at a quarter-pel position (qx, qy are absolute, in 1/4 units)
+    void predict_block(int qx, int qy, int block_w, int block_h,
+                       uint8_t* dst, int dst_stride) const;
+
+    int stride() const { return stride_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+    bool valid() const { return width_ > 0; }
+    SubpelFilterType filter_type() const { return type_; }
+
+private:
+    void extend_full_plane(const uint8_t* reference, int stride);
+    void filter_half_planes();
+
+    std::array<std::vector<uint8_t>, 4> planes_;
+    std::vector<int16_t> intermediate_;
+    int stride_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    SubpelFilterType type_ = SubpelFilterType::H264_6TAP;
+};
+
+// Separable 2D interpolation of one block from an integer-pel source
+// (src must be readable 3 pixels before and 4 pixels after the block in both directions)
+void interpolate_block(const uint8_t* src, int src_stride, int frac_x, int frac_y,
+                       const SubpelFilter& filter, uint8_t* dst, int dst_stride,
+                       int block_w, int block_h);
+
+// HalfPelPlanes::predict_block without the planes: the half-pel samples of one block are
+// interpolated on demand from a border-extended full-pel plane, bit-identical to the
+// cached planes. Cheaper when only some blocks of a picture use sub-pel vectors (decoding).
+void predict_block_direct(const uint8_t* origin, int stride, SubpelFilterType type, int qx, int qy,
+                          int block_w, int block_h, uint8_t* dst, int dst_stride);
+
+// SATD over a block with independent strides (4x4 Hadamard)
+uint32_t satd_block(const uint8_t* a, int a_stride, const uint8_t* b, int b_stride,
+                    int block_w, int block_h);
+
+} // namespace processing
+} // namespace streaming
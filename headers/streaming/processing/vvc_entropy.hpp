@@ -1,45 +1,127 @@
 // include/streaming/processing/vvc_entropy.hpp
 #pragma once
 
-#include <vector>
+#include "../utils/bitstream.hpp"
+#include "../codec/vvc_structures.hpp"
+#include "cabac_encoder.hpp"
+#include <array>
 #include <cstdint>
 
 namespace streaming {
 namespace processing {
 
+// VVC CABAC: the HEVC arithmetic coder with the VVC probability estimation (9.3.2.2,
+// 9.3.4.3.2), where each context averages two estimates adapting at different rates.
 class VVCCABACEncoder {
-private:
-    struct VVCContextModel {
-        uint8_t state;
-        uint8_t mps;
-        uint16_t count;
+public:
+    struct ContextModel {
+        uint16_t state0 = 0; // pStateIdx0, 10-bit probability of a 1
+        uint16_t state1 = 0; // pStateIdx1, 14-bit
+        uint8_t shift0 = 0;
+        uint8_t shift1 = 0;
+        
+        void init(uint8_t init_value, uint8_t shift_idx, int qp);
+        
+        uint32_t probability() const { return state1 + 16u * state0; } // Of a 1, 15 bits
+        // RDO rate of `bin` (RATE_ONE = one bit)
+        uint32_t rate(uint32_t bin) const {
+            return probability_rate(bin ? probability() : 32768 - probability());
+        }
+        // Both estimates move towards the bin at their own rate
+        void update(uint32_t bin) {
+            state0 = static_cast<uint16_t>(state0 - (state0 >> shift0) + ((1023 * bin) >> shift0));
+            state1 = static_cast<uint16_t>(state1 - (state1 >> shift1) + ((16383 * bin) >> shift1));
+        }
     };
+    
+    // Every context of a slice. Plain data: a copy is a snapshot (WPP stores the set after
+    // the first CTU of each row and the row below starts from it; RDO trials restore it).
+    struct ContextSet {
+        std::array<ContextModel, 4> mtt_split;
+        std::array<ContextModel, 8> pred_mode;
+        ContextModel affine_flag;
+        ContextModel mip_flag;
+        ContextModel ibc_flag;
+        ContextModel cbf;
+        ContextModel intra_luma_mpm;
+        ContextModel intra_luma_not_planar;
+        
+        void init(int qp);
+    };
+    
+    // Starts a substream: contexts at their initial values for `qp`, bits go to `writer`
+    // on flush_encoder()
+    void init_encoder(utils::BitstreamWriter& writer, int qp);
+    const ContextSet& contexts() const { return contexts_; }
+    void load_contexts(const ContextSet& contexts) { contexts_ = contexts; }
+    CABACEncoder& engine() { return engine_; }
+    
+    void encode_mtt_split(codec::VVCPartitionType split_type);
+    void encode_pred_mode(codec::VVCPredictionMode mode);
+    void encode_affine_flag(bool is_affine);
+    void encode_mip_flag(bool use_mip);
+    
+    // VVC-specific advanced encoding
+    void encode_ibc_flag(bool use_ibc);
+    void encode_gpm_info(int partition_idx, int angle);
+    void encode_bdpcm_dir(int direction);
+    void encode_cbf(bool coded);
+    // intra_luma_mpm_flag, intra_luma_not_planar_flag and intra_luma_mpm_idx, or the
+    // truncated binary intra_luma_mpm_remainder among the 61 modes outside the list
+    // (mpm[0] is planar)
+    void encode_intra_luma_mode(int mode, const int mpm[6]);
+    
+    // Bypass-coded values (MSB first) and signed Exp-Golomb
+    void encode_bypass_bins(uint32_t value, int num_bins) { engine_.encode_bypass_bins(value, num_bins); }
+    void encode_se_bypass(int32_t value) {
+        engine_.encode_ue_bypass(value <= 0 ? static_cast<uint32_t>(-2 * value) : static_cast<uint32_t>(2 * value - 1));
+    }
+    
+    // end_of_slice_one_bit / end_of_subset_one_bit, then the coder flush
+    void finish_substream();
+    
+    // One context-coded bin; the syntax methods above pick the context
+    void encode_bin(uint32_t bin, ContextModel& ctx);
+
+private:
+    CABACEncoder engine_;
+    ContextSet contexts_;
+};
 
+// Stands in for VVCCABACEncoder while RDO prices a candidate. It keeps its own copy of the
+// contexts and adapts it bin by bin as the coder would, but only adds up the rate; the
+// syntax methods share their binarisation with the coder.
+class VVCRateEstimator {
 public:
-    VVCCABACEncoder();
+    using ContextModel = VVCCABACEncoder::ContextModel;
+    using ContextSet = VVCCABACEncoder::ContextSet;
     
-    void init_vvc_slice();
-    void encode_mtt_split(utils::BitstreamWriter& writer, VVCPartitionType split_type);
-    void encode_pred_mode(utils::BitstreamWriter& writer, VVCPredictionMode mode);
-    void encode_affine_flag(utils::BitstreamWriter& writer, bool is_affine);
-    void encode_mip_flag(utils::BitstreamWriter& writer, bool use_mip);
+    explicit VVCRateEstimator(const ContextSet& contexts) : contexts_(contexts) {}
     
-    // VVC-specific advanced encoding
-    void encode_ibc_flag(utils::BitstreamWriter& writer, bool use_ibc);
-    void encode_gpm_info(utils::BitstreamWriter& writer, int partition_idx, int angle);
-    void encode_bdpcm_dir(utils::BitstreamWriter& writer, int direction);
+    // Back to `contexts` and a zero rate, for the next candidate
+    void reset(const ContextSet& contexts) {
+        contexts_ = contexts;
+        rate_ = 0;
+    }
+    
+    void encode_mtt_split(codec::VVCPartitionType split_type);
+    void encode_pred_mode(codec::VVCPredictionMode mode);
+    void encode_cbf(bool coded) { encode_bin(coded ? 1 : 0, contexts_.cbf); }
+    void encode_intra_luma_mode(int mode, const int mpm[6]);
+    
+    void encode_bin(uint32_t bin, ContextModel& ctx) {
+        rate_ += ctx.rate(bin);
+        ctx.update(bin);
+    }
+    void encode_bypass_bins(uint32_t, int num_bins) { rate_ += static_cast<uint32_t>(num_bins) * RATE_ONE; }
+    
+    uint64_t rate() const { return rate_; }
+    double bits() const { return rate_to_bits(rate_); }
 
 private:
-    void encode_bin(utils::BitstreamWriter& writer, uint32_t bin, VVCContextModel& ctx);
-    void encode_bin_ep(utils::BitstreamWriter& writer, uint32_t bin); // Equal probability
-    void encode_bin_tr(utils::BitstreamWriter& writer, uint32_t bin); // Bypass
-    
-    // VVC context models
-    std::vector<VVCContextModel> mtt_split_ctx_;
-    std::vector<VVCContextModel> pred_mode_ctx_;
-    std::vector<VVCContextModel> affine_flag_ctx_;
-    std::vector<VVCContextModel> mip_flag_ctx_;
+    ContextSet contexts_;
+    uint64_t rate_ = 0;
 };
 
 } // namespace processing
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
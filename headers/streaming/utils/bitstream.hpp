@@ -1,6 +1,7 @@
 // include/streaming/utils/bitstream.hpp
 #pragma once
 
+#include <bit>
 #include <cstdint>
 #include <vector>
 #include <stdexcept>
@@ -34,6 +35,17 @@ public:
         }
     }
     
+    // Whole bytes, copied at once when the writer is byte-aligned
+    void write_bytes(const uint8_t* data, size_t size) {
+        if (current_bit_ == 0) {
+            buffer_.insert(buffer_.end(), data, data + size);
+        } else {
+            for (size_t i = 0; i < size; ++i) {
+                write_bits(data[i], 8);
+            }
+        }
+    }
+    
     void write_ue(uint32_t value) { // Exponential Golomb coding
         uint32_t leading_zeros = 0;
         uint32_t temp = value + 1;
@@ -55,8 +67,57 @@ public:
         }
     }
     
+    // rbsp_trailing_bits: stop bit, then zero bits up to the byte boundary
+    void write_trailing_bits() {
+        write_bit(1);
+        while (current_bit_ != 0) {
+            write_bit(0);
+        }
+    }
+    
+    // Append the bits of another writer (merges independently encoded rows in order)
+    void append(const BitstreamWriter& other) {
+        const size_t full_bytes = other.current_bit_ ? other.buffer_.size() - 1 : other.buffer_.size();
+        
+        if (current_bit_ == 0) {
+            buffer_.insert(buffer_.end(), other.buffer_.begin(), other.buffer_.begin() + full_bytes);
+        } else {
+            for (size_t i = 0; i < full_bytes; ++i) {
+                write_bits(other.buffer_[i], 8);
+            }
+        }
+        
+        if (other.current_bit_) {
+            write_bits(other.buffer_.back() >> (8 - other.current_bit_), other.current_bit_);
+        }
+    }
+    
+    // Append a byte-aligned NAL unit payload (this writer must be byte-aligned too),
+    // inserting emulation prevention bytes so no start code appears inside it
+    void append_escaped(const BitstreamWriter& payload) {
+        int zeros = 0;
+        for (uint8_t byte : payload.buffer_) {
+            if (zeros >= 2 && byte <= 3) {
+                buffer_.push_back(3);
+                zeros = 0;
+            }
+            buffer_.push_back(byte);
+            zeros = byte == 0 ? zeros + 1 : 0;
+        }
+    }
+    
+    size_t bit_count() const { return buffer_.size() * 8 - (current_bit_ ? 8 - current_bit_ : 0); }
+    
     const std::vector<uint8_t>& get_data() const { return buffer_; }
     void clear() { buffer_.clear(); current_byte_ = 0; current_bit_ = 0; }
+    void reserve(size_t bytes) { buffer_.reserve(bytes); }
+    
+    // Hand the bytes to output without copying; output's old storage becomes the
+    // (cleared) buffer of this writer, so alternating two buffers stops allocating
+    void swap_data(std::vector<uint8_t>& output) {
+        buffer_.swap(output);
+        clear();
+    }
 };
 
 class BitstreamReader {
@@ -66,43 +127,70 @@ private:
     size_t current_byte_ = 0;
     uint8_t current_bit_ = 0;
     
+    // Next 32 bits without consuming them (zeros past the end)
+    uint32_t peek_32() const {
+        uint64_t window = 0;
+        if (current_byte_ + 5 <= size_) {
+            for (int i = 0; i < 5; ++i) {
+                window = (window << 8) | data_[current_byte_ + i];
+            }
+        } else {
+            for (size_t i = 0; i < 5; ++i) {
+                window = (window << 8) | (current_byte_ + i < size_ ? data_[current_byte_ + i] : 0);
+            }
+        }
+        return static_cast<uint32_t>(window >> (8 - current_bit_));
+    }
+    
 public:
     BitstreamReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
     
-    bool read_bit() {
-        if (current_byte_ >= size_) {
+    // Next num_bits (1..32) without consuming them, for table-driven VLC parsing
+    uint32_t peek_bits(uint8_t num_bits) const {
+        return peek_32() >> (32 - num_bits);
+    }
+    
+    void skip_bits(uint32_t num_bits) {
+        if (num_bits > bits_left()) {
             throw std::runtime_error("Bitstream read overflow");
         }
-        
-        bool bit = (data_[current_byte_] >> (7 - current_bit_)) & 1;
-        current_bit_++;
-        
-        if (current_bit_ == 8) {
-            current_byte_++;
-            current_bit_ = 0;
-        }
-        
-        return bit;
+        const size_t position = current_bit_ + static_cast<size_t>(num_bits);
+        current_byte_ += position >> 3;
+        current_bit_ = static_cast<uint8_t>(position & 7);
+    }
+    
+    bool read_bit() {
+        return read_bits(1) != 0;
     }
     
+    // Up to 32 bits, read through a 32-bit window instead of bit by bit
     uint32_t read_bits(uint8_t num_bits) {
-        uint32_t value = 0;
-        for (uint8_t i = 0; i < num_bits; ++i) {
-            value = (value << 1) | read_bit();
-        }
+        if (num_bits == 0) return 0;
+        const uint32_t value = peek_32() >> (32 - num_bits);
+        skip_bits(num_bits);
         return value;
     }
     
     uint32_t read_ue() {
+        // Leading zeros by counting the zero bits of the window at once
         uint32_t leading_zeros = 0;
-        while (read_bit() == 0) {
-            leading_zeros++;
+        uint32_t window = peek_32();
+        while (window == 0) {
+            skip_bits(32);
+            leading_zeros += 32;
+            window = peek_32();
         }
+        const int zeros = std::countl_zero(window);
+        skip_bits(zeros + 1);
+        leading_zeros += zeros;
         
         if (leading_zeros == 0) return 0;
+        if (leading_zeros > 31) {
+            throw std::runtime_error("Exp-Golomb code too long");
+        }
         
-        uint32_t value = read_bits(leading_zeros);
-        return value + (1 << leading_zeros) - 1;
+        uint32_t value = read_bits(static_cast<uint8_t>(leading_zeros));
+        return value + (1u << leading_zeros) - 1;
     }
     
     int32_t read_se() {
@@ -113,6 +201,8 @@ public:
             return static_cast<int32_t>((ue + 1) / 2);
         }
     }
+    
+    size_t bits_left() const { return (size_ - current_byte_) * 8 - current_bit_; }
 };
 
 } // namespace utils
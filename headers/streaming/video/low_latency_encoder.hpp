@@ -0,0 +1,100 @@
+// include/streaming/video/low_latency_encoder.hpp
+#pragma once
+
+#include "../codec/video_codec.hpp"
+#include "../codec/rate_control.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace streaming {
+namespace video {
+
+// Deadline-driven wrapper around any codec::IVideoEncoder. The encode time of every frame
+// is measured; while the average runs close to max_encoding_time_ms the speed preset is
+// raised, then the QP floor, and both come back once there is time to spare. Frames are
+// only dropped when encoding has fallen a whole frame budget behind regardless (e.g. after
+// a keyframe): a frame dropped before coding is referenced by nothing, so the stream stays
+// decodable. Keyframes are never dropped.
+class LowLatencyEncoder {
+public:
+    struct LowLatencyConfig {
+        uint32_t max_encoding_time_ms = 16;    // 60 FPS için 16ms; frames arrive at most this often
+        uint32_t target_frame_size_ms = 8;     // Ultra-low latency: VBV of this long at the bitrate
+        bool enable_frame_dropping = true;
+        uint32_t lookahead_frames = 0;         // 0 for low latency
+        int speed_preset = 5;                  // Used while within the deadline (0 = best .. 9)
+        int max_speed_preset = 9;
+        int max_qp_boost = 12;                 // Most the QP floor is raised under time pressure
+        uint32_t max_consecutive_drops = 2;
+        uint32_t intra_refresh_period = 0;     // Intra refresh instead of keyframes (0 = encoder's GOP)
+    };
+
+    struct Stats {
+        uint64_t frames = 0;            // Encoded
+        uint64_t dropped = 0;
+        uint64_t deadline_misses = 0;   // Encoded frames over max_encoding_time_ms
+        double average_encode_ms = 0.0; // Recent P frames
+        int speed_preset = 0;
+        int qp_boost = 0;
+    };
+
+    LowLatencyEncoder();
+    // Hands the encoder back as it was before initialize(): rate control (QP range
+    // included), intra refresh and speed preset restored, no slice output
+    ~LowLatencyEncoder();
+
+    LowLatencyEncoder(const LowLatencyEncoder&) = delete;
+    LowLatencyEncoder& operator=(const LowLatencyEncoder&) = delete;
+
+    // The encoder must be initialized. Its rate control becomes low-delay CBR at its current
+    // bitrate: no lookahead and a VBV of target_frame_size_ms (at least one frame).
+    bool initialize(std::shared_ptr<codec::IVideoEncoder> encoder, const LowLatencyConfig& config);
+    // A dropped frame returns true with frame_dropped set and an empty output
+    bool encode_frame_low_latency(const codec::VideoFrame& input,
+                                 std::vector<uint8_t>& output,
+                                 bool& frame_dropped);
+
+    // Slices go to output as soon as they are coded (IVideoEncoder::set_slice_output, e.g.
+    // H264Encoder with set_slice_count); other encoders pass each access unit once coded
+    void set_slice_output(codec::IVideoEncoder::SliceOutput output);
+
+    // Latency optimization: one adaptation step from the encode time of a P frame
+    void adaptive_quantization_control(double current_latency_ms);
+
+    double current_encoding_time_ms() const { return current_encoding_time_ms_; }
+    Stats stats() const;
+
+private:
+    bool should_drop_frame(const codec::VideoFrame& frame) const;
+    void apply_low_latency_presets();
+    void restore_encoder_settings();
+    void apply_qp_boost();
+
+private:
+    LowLatencyConfig config_;
+    std::shared_ptr<codec::IVideoEncoder> encoder_;
+    codec::IVideoEncoder::SliceOutput slice_output_;
+    bool early_slices_ = false; // The encoder calls slice_output_ itself
+
+    // The encoder's settings before initialize()
+    codec::RateControlConfig previous_rate_control_;
+    uint32_t previous_intra_refresh_period_ = 0;
+    int previous_speed_preset_ = -1;
+
+    std::atomic<double> current_encoding_time_ms_{0};
+    std::atomic<uint32_t> consecutive_dropped_frames_{0};
+    double average_encode_ms_ = 0.0;
+    double late_ms_ = 0.0;          // Encode time beyond the frame budgets so far
+    bool has_speed_presets_ = false;
+    int speed_preset_ = 5;
+    int qp_boost_ = 0;
+    int base_min_qp_ = 10;
+    uint32_t hold_frames_ = 0;      // Frames the last change gets before the next one
+    uint32_t relaxed_frames_ = 0;   // Consecutive frames well within the budget
+    Stats stats_;
+};
+
+} // namespace video
+} // namespace streaming
@@ -0,0 +1,262 @@
+// src/client/decoder.cpp
+#include "streaming/client/decoder.hpp"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+namespace streaming {
+namespace client {
+
+Decoder::Decoder() = default;
+
+Decoder::~Decoder() {
+    shutdown();
+}
+
+bool Decoder::initialize(const DecoderConfig& config) {
+    try {
+        shutdown();
+        config_ = config;
+        config_.max_concurrent_frames = std::max(1u, config_.max_concurrent_frames);
+
+        if (config_.hardware_acceleration && initialize_hardware_decoder()) {
+            std::cout << "🚀 Decoder initialized (hardware)" << std::endl;
+            return true;
+        }
+
+        h264_decoder_ = std::make_unique<codec::H264Decoder>();
+        if (!h264_decoder_->initialize()) {
+            return false;
+        }
+
+        // Frame threading: each picture is decoded by one worker, pictures overlap
+        if (config_.enable_parallel_decoding && config_.thread_count > 1 && config_.max_concurrent_frames > 1) {
+            frame_pool_ = std::make_unique<performance::ThreadPool>(config_.thread_count);
+        }
+
+        std::cout << "🚀 Decoder initialized: software";
+        if (frame_pool_) {
+            std::cout << ", " << config_.thread_count << " frame threads, " << config_.max_concurrent_frames
+                      << " frames in flight";
+        }
+        std::cout << std::endl;
+        return true;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Decoder initialization error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void Decoder::shutdown() {
+    flush_buffers();
+    frame_pool_.reset();
+    free_jobs_.clear();
+    h264_decoder_.reset();
+    h265_decoder_.reset();
+    av1_decoder_.reset();
+    opus_decoder_.reset();
+    aac_decoder_.reset();
+    hardware_context_ = nullptr;
+    hardware_initialized_ = false;
+}
+
+bool Decoder::decode_video(const uint8_t* encoded_data, size_t size,
+                           DecodedFrame& output_frame, uint64_t timestamp) {
+    try {
+        if (!encoded_data || size == 0) {
+            return false;
+        }
+        if (hardware_initialized_) {
+            return decode_video_hardware(encoded_data, size, output_frame);
+        }
+        if (!h264_decoder_) {
+            return false;
+        }
+        return frame_pool_ ? decode_video_threaded(encoded_data, size, output_frame, timestamp)
+                           : decode_video_software(encoded_data, size, output_frame, timestamp);
+
+    } catch (const std::exception& e) {
+        std::cerr << "Video decoding error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool Decoder::decode_video_software(const uint8_t* data, size_t size, DecodedFrame& output, uint64_t timestamp) {
+    std::shared_ptr<codec::ReferencePicture> picture;
+    if (!h264_decoder_->decode_picture(data, size, picture)) {
+        return false;
+    }
+    copy_picture(*picture, timestamp, output);
+    return true;
+}
+
+bool Decoder::decode_video_threaded(const uint8_t* data, size_t size, DecodedFrame& output, uint64_t timestamp) {
+    std::unique_ptr<codec::H264Decoder::PictureJob> job;
+    if (!free_jobs_.empty()) {
+        job = std::move(free_jobs_.back());
+        free_jobs_.pop_back();
+    } else {
+        job = std::make_unique<codec::H264Decoder::PictureJob>();
+    }
+
+    // Parsing and the DPB update stay on this thread, in decoding order; only the
+    // reconstruction runs on the pool. Workers run jobs in FIFO order, so every
+    // reference a job waits on is already being decoded.
+    if (!h264_decoder_->prepare_picture(data, size, *job)) {
+        free_jobs_.push_back(std::move(job));
+        return false;
+    }
+
+    PendingFrame pending;
+    pending.timestamp = timestamp;
+    codec::H264Decoder* decoder = h264_decoder_.get();
+    codec::H264Decoder::PictureJob* job_ptr = job.get();
+    pending.result = frame_pool_->enqueue([decoder, job_ptr]() { return decoder->decode_prepared(*job_ptr); });
+    pending.job = std::move(job);
+    in_flight_.push_back(std::move(pending));
+
+    if (in_flight_.size() < config_.max_concurrent_frames) {
+        return false; // Pipeline filling
+    }
+    return complete_oldest(output);
+}
+
+bool Decoder::drain_video(DecodedFrame& output_frame) {
+    try {
+        while (!in_flight_.empty()) {
+            if (complete_oldest(output_frame)) {
+                return true;
+            }
+        }
+        return false;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Video decoding error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool Decoder::complete_oldest(DecodedFrame& output) {
+    PendingFrame pending = std::move(in_flight_.front());
+    in_flight_.pop_front();
+
+    bool ok = false;
+    try {
+        ok = pending.result.get();
+    } catch (...) {
+        pending.job->release();
+        free_jobs_.push_back(std::move(pending.job));
+        throw;
+    }
+    if (ok) {
+        copy_picture(*pending.job->picture(), pending.timestamp, output);
+    }
+    pending.job->release();
+    free_jobs_.push_back(std::move(pending.job));
+    return ok;
+}
+
+void Decoder::copy_picture(const codec::ReferencePicture& picture, uint64_t timestamp, DecodedFrame& output) {
+    // Packed YUV420; reusing the output keeps its buffer
+    output.width = picture.width();
+    output.height = picture.height();
+    output.timestamp = timestamp;
+    output.is_keyframe = picture.is_keyframe;
+    output.format = 0;
+
+    const auto& luma = picture.plane(codec::ReferencePicture::Y);
+    const auto& chroma = picture.plane(codec::ReferencePicture::U);
+    output.data.resize(static_cast<size_t>(luma.width) * luma.height +
+                       2 * static_cast<size_t>(chroma.width) * chroma.height);
+
+    uint8_t* dst = output.data.data();
+    for (int id = codec::ReferencePicture::Y; id <= codec::ReferencePicture::V; ++id) {
+        const auto& plane = picture.plane(static_cast<codec::ReferencePicture::PlaneId>(id));
+        for (int y = 0; y < plane.height; ++y) {
+            std::memcpy(dst, plane.row(y), plane.width);
+            dst += plane.width;
+        }
+    }
+}
+
+bool Decoder::decode_video_hardware(const uint8_t* data, size_t size, DecodedFrame& output) {
+    (void)data;
+    (void)size;
+    (void)output;
+    return false; // No hardware backend is available
+}
+
+bool Decoder::decode_audio(const uint8_t* encoded_data, size_t size,
+                           audio::AudioFrame& output_frame, uint64_t timestamp) {
+    try {
+        if (!encoded_data || size == 0) {
+            return false;
+        }
+        const bool ok = hardware_initialized_ ? decode_audio_hardware(encoded_data, size, output_frame)
+                                              : decode_audio_software(encoded_data, size, output_frame);
+        if (ok) {
+            output_frame.timestamp = timestamp;
+        }
+        return ok;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Audio decoding error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool Decoder::decode_audio_software(const uint8_t* data, size_t size, audio::AudioFrame& output) {
+    audio::IAudioDecoder* decoder = opus_decoder_ ? opus_decoder_.get() : aac_decoder_.get();
+    return decoder && decoder->decode_frame(data, size, output);
+}
+
+bool Decoder::decode_audio_hardware(const uint8_t* data, size_t size, audio::AudioFrame& output) {
+    return decode_audio_software(data, size, output);
+}
+
+void Decoder::flush_buffers() {
+    // Every pending job has to finish: the workers use the jobs and the decoder
+    while (!in_flight_.empty()) {
+        PendingFrame& pending = in_flight_.front();
+        try {
+            pending.result.get();
+        } catch (const std::exception& e) {
+            std::cerr << "Video decoding error: " << e.what() << std::endl;
+        }
+        pending.job->release();
+        free_jobs_.push_back(std::move(pending.job));
+        in_flight_.pop_front();
+    }
+}
+
+void Decoder::reset() {
+    flush_buffers();
+    if (h264_decoder_) {
+        h264_decoder_->reset();
+    }
+    for (auto* decoder : {opus_decoder_.get(), aac_decoder_.get()}) {
+        if (decoder) {
+            decoder->reset();
+        }
+    }
+}
+
+void Decoder::set_max_decode_time(uint32_t max_time_ms) {
+    config_.max_decode_time_ms = max_time_ms;
+}
+
+bool Decoder::initialize_hardware_decoder() {
+    // No hardware decoder backend in this build; decoding falls back to software
+    hardware_context_ = nullptr;
+    hardware_initialized_ = false;
+    return false;
+}
+
+bool Decoder::is_hardware_accelerated() const {
+    return hardware_initialized_;
+}
+
+} // namespace client
+} // namespace streaming
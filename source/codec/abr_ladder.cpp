@@ -0,0 +1,170 @@
+// src/codec/abr_ladder.cpp
+#include "streaming/codec/abr_ladder.hpp"
+#include <algorithm>
+#include <future>
+#include <iostream>
+
+namespace streaming {
+namespace codec {
+
+AbrLadderEncoder::AbrLadderEncoder(EncoderFactory factory)
+    : factory_(std::move(factory)) {}
+
+bool AbrLadderEncoder::initialize(uint32_t source_width, uint32_t source_height, const AbrLadderConfig& config) {
+    try {
+        if (config.rungs.empty() || !factory_) {
+            return false;
+        }
+
+        config_ = config;
+        source_width_ = source_width;
+        source_height_ = source_height;
+        frame_count_ = 0;
+        last_keyframe_ = 0;
+        is_keyframe_ = false;
+
+        analyzer_.reset();
+        analyzer_.set_aq_strength(std::max(0.0, config_.rate_control.aq_strength));
+
+        // Rate control per rendition; analysis and keyframe placement come from the ladder
+        RateControlConfig rc_config = config_.rate_control;
+        rc_config.external_analysis = true;
+        rc_config.scenecut_threshold = 0.0;
+        rc_config.lookahead_frames = 0;
+
+        renditions_.clear();
+        renditions_.resize(config_.rungs.size());
+        for (size_t i = 0; i < renditions_.size(); ++i) {
+            Rendition& rendition = renditions_[i];
+            rendition.rung = config_.rungs[i];
+            rendition.rung.width = std::min(rendition.rung.width, source_width) & ~1u;
+            rendition.rung.height = std::min(rendition.rung.height, source_height) & ~1u;
+            if (rendition.rung.width == 0 || rendition.rung.height == 0) {
+                return false;
+            }
+
+            rendition.scaled = rendition.rung.width != source_width || rendition.rung.height != source_height;
+            if (rendition.scaled) {
+                rendition.scaler.configure(source_width, source_height, rendition.rung.width, rendition.rung.height);
+            }
+            rendition.frame.width = rendition.rung.width;
+            rendition.frame.height = rendition.rung.height;
+            rendition.frame.stride = rendition.rung.width;
+
+            rendition.encoder = factory_();
+            if (!rendition.encoder ||
+                !rendition.encoder->initialize(rendition.rung.width, rendition.rung.height, config_.fps,
+                                               rendition.rung.bitrate)) {
+                return false;
+            }
+            rendition.encoder->set_gop_size(config_.gop_size);
+            rendition.encoder->set_rate_control(rc_config);
+        }
+
+        std::cout << "🚀 AbrLadderEncoder initialized: " << source_width << "x" << source_height
+                  << ", " << renditions_.size() << " renditions" << std::endl;
+        for (const Rendition& rendition : renditions_) {
+            std::cout << "   " << rendition.rung.width << "x" << rendition.rung.height
+                      << " @" << rendition.rung.bitrate << "bps" << std::endl;
+        }
+        return true;
+
+    } catch (const std::exception& e) {
+        std::cerr << "ABR ladder initialization error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void AbrLadderEncoder::resize_source(Rendition& rendition, const FrameView& input) {
+    const uint8_t* const planes[3] = {input.luma(), input.planes[1].data, input.planes[2].data};
+    const int strides[3] = {static_cast<int>(input.luma_stride()), static_cast<int>(input.planes[1].stride),
+                            static_cast<int>(input.planes[2].stride)};
+    rendition.scaler.scale(planes, strides, rendition.frame.data);
+    rendition.frame.timestamp = input.timestamp;
+    rendition.view = FrameView::from(rendition.frame);
+}
+
+bool AbrLadderEncoder::encode_rendition(Rendition& rendition, const FrameView& input, std::vector<uint8_t>& output) {
+    rendition.encoder->rate_control().submit_analysis(rendition.analysis);
+
+    // Every rendition keys on the same frames: the source (or its resized copy) is passed
+    // as a view carrying the ladder's decision
+    if (rendition.scaled && &rendition != &renditions_.front()) {
+        resize_source(rendition, input); // The top rung was resized for the analysis
+    }
+    FrameView view = rendition.scaled ? rendition.view : input;
+    view.keyframe = is_keyframe_;
+    return rendition.encoder->encode_frame(view, output);
+}
+
+bool AbrLadderEncoder::encode_frame(const VideoFrame& input, std::vector<std::vector<uint8_t>>& outputs) {
+    return encode_frame(FrameView::from(input), outputs);
+}
+
+bool AbrLadderEncoder::encode_frame(const FrameView& input, std::vector<std::vector<uint8_t>>& outputs) {
+    try {
+        if (input.width != source_width_ || input.height != source_height_ || renditions_.empty()) {
+            return false;
+        }
+
+        // Pre-analysis once, on the top rung
+        Rendition& top = renditions_.front();
+        if (top.scaled) {
+            resize_source(top, input);
+        }
+        const FrameView& top_frame = top.scaled ? top.view : input;
+        analyzer_.analyze(top_frame.luma(), static_cast<int>(top_frame.luma_stride()), static_cast<int>(top_frame.width),
+                          static_cast<int>(top_frame.height), analysis_);
+
+        // Keyframes every GOP, on request and at scene cuts, for all renditions at once
+        const uint32_t since_keyframe = frame_count_ - last_keyframe_;
+        is_keyframe_ = frame_count_ == 0 || input.keyframe || since_keyframe >= config_.gop_size ||
+                       (since_keyframe >= config_.rate_control.min_keyframe_interval &&
+                        RateController::is_scene_cut(analysis_, config_.rate_control.scenecut_threshold));
+        if (is_keyframe_) {
+            last_keyframe_ = frame_count_;
+        }
+
+        for (Rendition& rendition : renditions_) {
+            analysis_.scale(rendition.rung.width, rendition.rung.height, rendition.analysis);
+        }
+
+        outputs.resize(renditions_.size());
+        bool ok = true;
+        if (thread_pool_ && renditions_.size() > 1) {
+            std::vector<std::future<bool>> futures;
+            futures.reserve(renditions_.size());
+            for (size_t i = 0; i < renditions_.size(); ++i) {
+                futures.push_back(thread_pool_->enqueue([this, i, &input, &outputs]() {
+                    return encode_rendition(renditions_[i], input, outputs[i]);
+                }));
+            }
+            // Wait for every task before reporting, they reference the outputs
+            std::exception_ptr error;
+            for (auto& future : futures) {
+                try {
+                    ok = future.get() && ok;
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        } else {
+            for (size_t i = 0; i < renditions_.size(); ++i) {
+                ok = encode_rendition(renditions_[i], input, outputs[i]) && ok;
+            }
+        }
+
+        frame_count_++;
+        return ok;
+
+    } catch (const std::exception& e) {
+        std::cerr << "ABR ladder encoding error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+} // namespace codec
+} // namespace streaming
@@ -2,13 +2,27 @@
 #include "streaming/codec/av1_encoder.hpp"
 #include "streaming/processing/av1_entropy.hpp"
 #include "streaming/processing/motion_estimation.hpp"
+#include "streaming/performance/profiler.hpp"
 #include <iostream>
 #include <cmath>
+#include <cstdlib>
 #include <algorithm>
+#include <limits>
 
 namespace streaming {
 namespace codec {
 
+namespace {
+
+// Uncompressed YUV420 size of an area: the capacity the coded buffers are given up front.
+// With the CDFs carried from frame to frame the tile sizes keep drifting, and growing a
+// buffer mid-stream would allocate in the steady state.
+size_t uncompressed_bytes(int width, int height) {
+    return static_cast<size_t>(width) * height * 3 / 2;
+}
+
+} // namespace
+
 AV1Encoder::AV1Encoder() 
     : dct_(std::make_unique<processing::DCT>())
     , quantizer_(std::make_unique<processing::Quantizer>()) {}
@@ -19,15 +33,39 @@ bool AV1Encoder::initialize(uint32_t width, uint32_t height, uint32_t fps, uint3
     fps_ = fps;
     bitrate_ = bitrate;
     frame_count_ = 0;
+    intra_modes_evaluated_.store(0, std::memory_order_relaxed);
+    last_keyframe_ = 0;
     
     // AV1-specific initialization
     superblock_size_ = 128; // AV1 allows 64x64 or 128x128 superblocks
     current_qp_ = 50; // AV1 QP range: 0-63
     
-    target_bits_per_frame_ = bitrate / fps;
+    // Frame QPs come from the rate controller (CBR at the target bitrate unless configured)
+    RateControlConfig rc_config = rate_control_.config();
+    rc_config.bitrate = bitrate;
+    rc_config.fps = fps;
+    rate_control_.configure(rc_config);
     
-    // Initialize reference frames buffer
-    reference_frames_.resize(width * height * 3 / 2);
+    // Reference pictures come from a pool that may be shared with other encoders
+    if (!reference_pool_ || reference_pool_->width() != width || reference_pool_->height() != height) {
+        reference_pool_ = ReferencePicturePool::create(width, height);
+    }
+    dpb_.set_max_references(max_reference_frames_);
+    dpb_.clear();
+    
+    // What reset() returns to
+    initial_settings_.gop_size = gop_size_;
+    initial_settings_.intra_refresh_period = intra_refresh_period_;
+    initial_settings_.rate_control = rate_control_.config();
+    initial_settings_.speed_preset = speed_preset_;
+    initial_settings_.enable_obmc = enable_obmc_;
+    initial_settings_.enable_cfl = enable_cfl_;
+    initial_settings_.enable_palette = enable_palette_;
+    initial_settings_.enable_warp_motion = enable_warp_motion_;
+    initial_settings_.max_reference_frames = max_reference_frames_;
+    initial_settings_.tile_columns = tile_columns_;
+    initial_settings_.tile_rows = tile_rows_;
+    initial_settings_.intra_time_budget = intra_time_budget_;
     
     std::cout << "🚀 AV1Encoder initialized: " << width << "x" << height 
               << " @" << fps << "fps, " << bitrate << "bps" << std::endl;
@@ -41,15 +79,33 @@ bool AV1Encoder::initialize(uint32_t width, uint32_t height, uint32_t fps, uint3
 }
 
 bool AV1Encoder::encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) {
-    utils::BitstreamWriter writer;
-    
+    return encode_frame(FrameView::from(input), output);
+}
+
+bool AV1Encoder::encode_frame(const FrameView& input, std::vector<uint8_t>& output) {
     try {
+        // Frame type and QP from the rate controller (keyframes every GOP, on request and
+        // at scene cuts; with intra refresh only on request); the coded size is fed back below
+        const bool keyframe_due = frame_count_ == 0 || input.keyframe ||
+                                  (intra_refresh_period_ == 0 && frame_count_ - last_keyframe_ >= gop_size_);
+        {
+            PROFILE_SCOPE("RateControl"); // Lookahead, scene cut and AQ analysis included
+            current_qp_ = (rate_control_.begin_frame(input, keyframe_due) * 63 + 25) / 51; // 0-51 -> 0-63
+        }
+        is_keyframe_ = rate_control_.is_keyframe();
+        if (is_keyframe_) {
+            last_keyframe_ = frame_count_;
+        }
+        
         // AV1 uses Open Bitstream Units (OBU) instead of NAL units
-        if (!encode_obu_sequence(input, writer)) {
+        writer_.clear();
+        writer_.reserve(uncompressed_bytes(width_, height_) + 64); // Plus OBU headers
+        if (!encode_obu_sequence(input, writer_)) {
             return false;
         }
         
-        output = writer.get_data();
+        writer_.swap_data(output);
+        rate_control_.end_frame(output.size());
         frame_count_++;
         
         return true;
@@ -60,229 +116,608 @@ bool AV1Encoder::encode_frame(const VideoFrame& input, std::vector<uint8_t>& out
     }
 }
 
-bool AV1Encoder::encode_obu_sequence(const VideoFrame& frame, utils::BitstreamWriter& writer) {
-    bool is_keyframe = (frame_count_ % gop_size_ == 0);
+bool AV1Encoder::encode_obu_sequence(const FrameView& frame, utils::BitstreamWriter& writer) {
+    const bool is_keyframe = is_keyframe_;
+    if (is_keyframe) {
+        dpb_.clear();
+    }
+    delta_q_present_ = current_qp_ > 0 && !rate_control_.analysis().qp_offsets.empty();
     
     // Temporal Delimiter OBU (optional but recommended)
-    writer.write_bits(0b10000, 5); // OBU header: type=TD, extension=0
-    writer.write_bit(0); // obu_has_size_field
-    writer.write_bit(1); // obu_extension_flag (temporal_id)
-    writer.write_bits(0, 3); // temporal_id
-    writer.write_bits(0, 2); // spatial_id
+    write_obu(writer, 2, utils::BitstreamWriter()); // OBU_TEMPORAL_DELIMITER, empty payload
     
     // Sequence Header OBU (first frame only)
     if (frame_count_ == 0) {
-        writer.write_bits(0b10001, 5); // OBU type=Sequence Header
-        writer.write_bit(1); // obu_has_size_field
-        
-        // Simplified sequence header
-        writer.write_bit(1); // still_picture
-        writer.write_bit(0); // reduced_still_picture_header
-        writer.write_bits(8, 5); // seq_profile (Main profile)
-        writer.write_bit(1); // initial_display_delay_present_flag
+        utils::BitstreamWriter sequence_header;
+        encode_sequence_header(sequence_header);
+        write_obu(writer, 1, sequence_header); // OBU_SEQUENCE_HEADER
+    }
+    
+    // Tiles are coded first: the frame header carries the size field width
+    const int sb_cols = (width_ + superblock_size_ - 1) / superblock_size_;
+    const int sb_rows = (height_ + superblock_size_ - 1) / superblock_size_;
+    setup_tiles(sb_cols, sb_rows);
+    
+    current_frame_ = &frame;
+    utils::BitstreamWriter& tile_group = tile_group_;
+    tile_group.clear();
+    tile_group.reserve(uncompressed_bytes(width_, height_) + 64); // Plus tile size fields
+    try {
+        PROFILE_SCOPE("BlockCoding");
+        encode_tile_group(tile_group, is_keyframe);
+    } catch (...) {
+        current_frame_ = nullptr;
+        throw;
     }
+    current_frame_ = nullptr;
     
     // Frame Header OBU
-    encode_frame_header(writer, is_keyframe);
+    utils::BitstreamWriter& frame_header = frame_header_;
+    frame_header.clear();
+    encode_frame_header(frame_header, is_keyframe);
+    write_obu(writer, 3, frame_header); // OBU_FRAME_HEADER
     
     // Tile Group OBU (actual frame data)
-    encode_tile_group(writer, frame);
+    write_obu(writer, 4, tile_group); // OBU_TILE_GROUP
     
-    // Metadata OBUs (optional)
-    if (enable_obmc_ || enable_cfl_) {
-        writer.write_bits(0b10010, 5); // OBU type=Metadata
-        // Encode tool metadata...
-    }
+    // The source frame becomes the next reference (no reconstruction loop yet)
+    PROFILE_SCOPE("References");
+    auto reference = reference_pool_->acquire();
+    reference->import_frame(frame);
+    reference->picture_order = frame_count_;
+    reference->is_keyframe = is_keyframe;
+    dpb_.push(std::move(reference));
     
     return true;
 }
 
-void AV1Encoder::encode_frame_header(utils::BitstreamWriter& writer, bool is_keyframe) {
-    writer.write_bits(0b10011, 5); // OBU type=Frame Header
+void AV1Encoder::write_obu(utils::BitstreamWriter& writer, uint8_t obu_type, const utils::BitstreamWriter& payload) {
+    writer.write_bit(0); // obu_forbidden_bit
+    writer.write_bits(obu_type, 4); // obu_type
+    writer.write_bit(0); // obu_extension_flag
     writer.write_bit(1); // obu_has_size_field
+    writer.write_bit(0); // obu_reserved_1bit
     
-    writer.write_bit(is_keyframe ? 1 : 0); // show_existing_frame
-    if (is_keyframe) {
-        writer.write_bit(1); // show_frame
-        writer.write_bit(1); // error_resilient_mode
-    } else {
-        writer.write_bit(0); // show_frame
-        writer.write_bit(0); // error_resilient_mode
-    }
+    // obu_size, leb128
+    size_t size = payload.get_data().size();
+    do {
+        uint8_t byte = size & 0x7F;
+        size >>= 7;
+        writer.write_bits(byte | (size ? 0x80 : 0), 8);
+    } while (size);
     
-    // Frame size
-    writer.write_bit(0); // frame_size_override_flag
+    writer.append(payload);
+}
+
+void AV1Encoder::encode_sequence_header(utils::BitstreamWriter& writer) {
+    // Simplified sequence header
+    writer.write_bits(0, 3); // seq_profile (Main profile)
+    writer.write_bit(0); // still_picture
+    writer.write_bit(0); // reduced_still_picture_header
+    writer.write_bit(1); // initial_display_delay_present_flag
     writer.write_ue(width_ - 1);
     writer.write_ue(height_ - 1);
+    writer.write_bit(superblock_size_ == 128 ? 1 : 0); // use_128x128_superblock
+    writer.write_trailing_bits();
+}
+
+void AV1Encoder::encode_frame_header(utils::BitstreamWriter& writer, bool is_keyframe) {
+    writer.write_bit(0); // show_existing_frame
+    writer.write_bits(is_keyframe ? 0 : 1, 2); // frame_type (KEY_FRAME / INTER_FRAME)
+    writer.write_bit(1); // show_frame
+    writer.write_bit(is_keyframe ? 1 : 0); // error_resilient_mode
+    
+    // Frame size
+    writer.write_bit(0); // frame_size_override_flag
     
     // Render size (same as frame size)
     writer.write_bit(0); // render_size_present_flag
     
     // Frame reference mode
     if (!is_keyframe) {
-        writer.write_bit(0); // primary_ref_frame
+        writer.write_bits(0, 3); // primary_ref_frame
     }
     
     // Refresh frame flags
     writer.write_bits(0b1, 8); // refresh_frame_flags
     
+    writer.write_bit(0); // disable_frame_end_update_cdf: the next frame starts from this one's CDFs
+    encode_tile_info(writer);
+    
     // Quantization parameters
-    writer.write_ue(current_qp_); // base_q_idx
+    writer.write_bits(current_qp_ * 4, 8); // base_q_idx (QP 0-63 -> qindex 0-255)
+    writer.write_bit(delta_q_present_ ? 1 : 0); // delta_q_present
+    if (delta_q_present_) {
+        writer.write_bits(2, 2); // delta_q_res: deltas in steps of 4 (one QP)
+    }
     
     // AV1 specific tools
     writer.write_bit(enable_obmc_ ? 1 : 0); // enable_obmc
     writer.write_bit(enable_cfl_ ? 1 : 0); // enable_cfl
+    writer.write_trailing_bits();
 }
 
-void AV1Encoder::encode_tile_group(utils::BitstreamWriter& writer, const VideoFrame& frame) {
-    writer.write_bits(0b10100, 5); // OBU type=Tile Group
-    writer.write_bit(1); // obu_has_size_field
+void AV1Encoder::encode_tile_info(utils::BitstreamWriter& writer) {
+    // tile_info() with uniform spacing: log2 counts as increment flags up to the maximum
+    writer.write_bit(1); // uniform_tile_spacing_flag
+    
+    for (int i = 0; i < max_tile_cols_log2_; ++i) {
+        const bool increment = i < tile_cols_log2_;
+        writer.write_bit(increment ? 1 : 0); // increment_tile_cols_log2
+        if (!increment) break;
+    }
+    for (int i = 0; i < max_tile_rows_log2_; ++i) {
+        const bool increment = i < tile_rows_log2_;
+        writer.write_bit(increment ? 1 : 0); // increment_tile_rows_log2
+        if (!increment) break;
+    }
     
-    // Tile group info (simplified - single tile)
-    writer.write_ue(0); // tile_start
-    writer.write_ue(0); // tile_size
+    if (tile_cols_log2_ > 0 || tile_rows_log2_ > 0) {
+        writer.write_bits(0, static_cast<uint8_t>(tile_cols_log2_ + tile_rows_log2_)); // context_update_tile_id
+        writer.write_bits(tile_size_bytes_ - 1, 2); // tile_size_bytes_minus_1
+    }
+}
+
+void AV1Encoder::set_tiles(uint32_t columns, uint32_t rows) {
+    // MAX_TILE_COLS / MAX_TILE_ROWS
+    tile_columns_ = std::max(1u, std::min(64u, columns));
+    tile_rows_ = std::max(1u, std::min(64u, rows));
+}
+
+namespace {
+
+// tile_log2(): smallest k with (block << k) >= target
+int tile_log2(int block, int target) {
+    int k = 0;
+    while ((block << k) < target) {
+        k++;
+    }
+    return k;
+}
+
+} // namespace
+
+void AV1Encoder::setup_tiles(int sb_cols, int sb_rows) {
+    // Spec limits for 128x128 superblocks: tiles at most 4096 samples wide and 4096x2304 in area
+    const int sb_log2 = superblock_size_ == 128 ? 7 : 6;
+    const int max_tile_width_sb = 4096 >> sb_log2;
+    const int max_tile_area_sb = (4096 * 2304) >> (2 * sb_log2);
+    
+    max_tile_cols_log2_ = tile_log2(1, std::min(sb_cols, 64));
+    max_tile_rows_log2_ = tile_log2(1, std::min(sb_rows, 64));
+    const int min_tile_cols_log2 = tile_log2(max_tile_width_sb, sb_cols);
+    const int min_tiles_log2 = std::max(min_tile_cols_log2, tile_log2(max_tile_area_sb, sb_rows * sb_cols));
+    
+    tile_cols_log2_ = std::clamp(tile_log2(1, tile_columns_), min_tile_cols_log2, max_tile_cols_log2_);
+    tile_rows_log2_ = std::clamp(tile_log2(1, tile_rows_), std::max(min_tiles_log2 - tile_cols_log2_, 0),
+                                 max_tile_rows_log2_);
+    
+    // Uniform spacing: equal tile size in superblocks, the last tile takes the remainder
+    auto starts = [](int sb_count, int log2, std::vector<int>& result) {
+        const int tile_size_sb = (sb_count + (1 << log2) - 1) >> log2;
+        result.clear();
+        for (int start = 0; start < sb_count; start += tile_size_sb) {
+            result.push_back(start);
+        }
+        result.push_back(sb_count);
+    };
+    starts(sb_cols, tile_cols_log2_, tile_col_starts_);
+    starts(sb_rows, tile_rows_log2_, tile_row_starts_);
+}
+
+void AV1Encoder::encode_tile_group(utils::BitstreamWriter& writer, bool is_keyframe) {
+    const int tile_cols = static_cast<int>(tile_col_starts_.size()) - 1;
+    const int tile_rows = static_cast<int>(tile_row_starts_.size()) - 1;
+    const int num_tiles = tile_cols * tile_rows;
+    
+    // Every tile has its own copy of the CDFs and its own output buffer, so tiles are
+    // fully independent. Keyframes are error resilient and start from the default CDFs,
+    // other frames from the ones the previous frame saved (primary_ref_frame 0).
+    if (tiles_.size() != static_cast<size_t>(num_tiles)) {
+        tiles_.resize(num_tiles);
+    }
+    // Every tile buffer can take the largest tile (no-op once reserved)
+    int max_tile_width = 0, max_tile_height = 0;
+    for (int col = 0; col < tile_cols; ++col) {
+        max_tile_width = std::max(max_tile_width, std::min<int>(tile_col_starts_[col + 1] * superblock_size_, width_) -
+                                                      tile_col_starts_[col] * superblock_size_);
+    }
+    for (int row = 0; row < tile_rows; ++row) {
+        max_tile_height = std::max(max_tile_height, std::min<int>(tile_row_starts_[row + 1] * superblock_size_, height_) -
+                                                        tile_row_starts_[row] * superblock_size_);
+    }
+    for (TileContext& tile : tiles_) {
+        tile.output.reserve(uncompressed_bytes(max_tile_width, max_tile_height));
+        tile.entropy.reserve(uncompressed_bytes(max_tile_width, max_tile_height));
+    }
+    if (is_keyframe) {
+        frame_contexts_ = processing::AV1EntropyEncoder::Contexts::defaults();
+    }
+    
+    if (thread_pool_ && num_tiles > 1) {
+        futures_.clear();
+        futures_.reserve(num_tiles);
+        for (int i = 0; i < num_tiles; ++i) {
+            futures_.push_back(thread_pool_->enqueue([this, i, is_keyframe]() {
+                encode_tile(i, is_keyframe);
+            }));
+        }
+        
+        std::exception_ptr error;
+        for (auto& future : futures_) {
+            try {
+                future.get();
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+        futures_.clear();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    } else {
+        for (int i = 0; i < num_tiles; ++i) {
+            encode_tile(i, is_keyframe);
+        }
+    }
     
-    processing::AV1EntropyEncoder entropy_encoder;
-    entropy_encoder.init_frame();
+    // Frame end CDF update: the CDFs of context_update_tile_id (tile 0) carry over
+    frame_contexts_ = tiles_[0].entropy.contexts();
+    frame_contexts_.reset_counters();
     
-    // Encode superblocks
-    int sb_width = (width_ + superblock_size_ - 1) / superblock_size_;
-    int sb_height = (height_ + superblock_size_ - 1) / superblock_size_;
+    // tile_size_minus_1 fields are just wide enough for the largest tile
+    size_t max_tile_size = 1;
+    for (int i = 0; i + 1 < num_tiles; ++i) {
+        max_tile_size = std::max(max_tile_size, tiles_[i].output.size());
+    }
+    tile_size_bytes_ = 1;
+    while (tile_size_bytes_ < 4 && ((max_tile_size - 1) >> (8 * tile_size_bytes_)) != 0) {
+        tile_size_bytes_++;
+    }
+    
+    if (num_tiles > 1) {
+        writer.write_bit(0); // tile_start_and_end_present_flag (all tiles in this group)
+        while (writer.bit_count() % 8 != 0) {
+            writer.write_bit(0); // byte_alignment()
+        }
+    }
     
-    for (int y = 0; y < sb_height; ++y) {
-        for (int x = 0; x < sb_width; ++x) {
-            SuperBlock sb;
-            // Extract superblock data (simplified)
-            encode_superblock(writer, sb, x * superblock_size_, y * superblock_size_);
+    for (int i = 0; i < num_tiles; ++i) {
+        if (i + 1 < num_tiles) {
+            // tile_size_minus_1, little endian
+            const uint32_t size_minus_1 = static_cast<uint32_t>(tiles_[i].output.size() - 1);
+            for (uint32_t b = 0; b < tile_size_bytes_; ++b) {
+                writer.write_bits((size_minus_1 >> (8 * b)) & 0xFF, 8);
+            }
+        }
+        for (uint8_t byte : tiles_[i].output) {
+            writer.write_bits(byte, 8);
+        }
+    }
+}
+
+void AV1Encoder::encode_tile(int tile_index, bool is_keyframe) {
+    const int tile_cols = static_cast<int>(tile_col_starts_.size()) - 1;
+    const int col = tile_index % tile_cols;
+    const int row = tile_index / tile_cols;
+    
+    TileContext& tile = tiles_[tile_index];
+    tile.x0 = tile_col_starts_[col] * superblock_size_;
+    tile.x1 = std::min<int>(tile_col_starts_[col + 1] * superblock_size_, width_);
+    tile.y0 = tile_row_starts_[row] * superblock_size_;
+    tile.y1 = std::min<int>(tile_row_starts_[row + 1] * superblock_size_, height_);
+    tile.is_keyframe = is_keyframe;
+    tile.qindex = current_qp_ * 4;
+    tile.target_qindex = tile.qindex;
+    tile.read_deltas = false;
+    tile.entropy.init_frame(frame_contexts_);
+    tile.intra_search = processing::IntraModeSearch();
+    tile.intra_search.set_time_budget(intra_time_budget_);
+    
+    // Superblocks in raster order inside the tile
+    for (int y = tile.y0; y < tile.y1; y += superblock_size_) {
+        for (int x = tile.x0; x < tile.x1; x += superblock_size_) {
+            encode_superblock(tile, x, y);
         }
     }
+    
+    tile.output.clear();
+    tile.entropy.finish(tile.output);
+    intra_modes_evaluated_.fetch_add(tile.intra_search.modes_evaluated(), std::memory_order_relaxed);
 }
 
-void AV1Encoder::encode_superblock(utils::BitstreamWriter& writer, const SuperBlock& sb, int x, int y) {
+void AV1Encoder::encode_superblock(TileContext& tile, int x, int y) {
+    tile.intra_search.begin_ctu();
+    
     EncodingBlock root_block;
     root_block.x = x;
     root_block.y = y;
     root_block.width = superblock_size_;
     root_block.height = superblock_size_;
     
+    // Superblock QP from adaptive quantization, signalled ahead of its first block
+    if (delta_q_present_) {
+        const int qp = rate_control_.block_qp(x, y, superblock_size_, superblock_size_);
+        tile.target_qindex = std::clamp((qp * 63 + 25) / 51 * 4, 4, 252);
+        tile.read_deltas = true;
+    }
+    
+    // Partition search on the superblock's statistics; SSE pairs with lambda at the
+    // quantizer's (H.264 scale) QP
+    const FrameView& frame = *current_frame_;
+    tile.block_statistics.compute(frame.luma(), frame.luma_stride(), width_, height_, x, y, superblock_size_);
+    const double lambda = 0.68 * std::pow(2.0, (tile.target_qindex / 4 * 51 / 63 - 12) / 3.0);
+    
     double best_cost = std::numeric_limits<double>::max();
-    rdo_partition_decision(root_block, best_cost);
+    tile.decisions.clear();
+    rdo_partition_decision(tile.block_statistics, tile.entropy, lambda, root_block, best_cost, tile.decisions);
     
     // Recursive partition encoding
-    encode_partition_tree(writer, root_block);
+    size_t decision_index = 0;
+    encode_partition_tree(tile, root_block, decision_index);
 }
 
-void AV1Encoder::rdo_partition_decision(EncodingBlock& block, double& best_cost) {
-    if (speed_preset_ > 6) {
-        // Fast mode: minimal partitioning
-        block.partition = PartitionType::PARTITION_NONE;
-        return;
+void AV1Encoder::rdo_partition_decision(const processing::BlockStatistics& statistics,
+                                        const processing::AV1EntropyEncoder& entropy, double lambda,
+                                        EncodingBlock& block, double& best_cost,
+                                        std::vector<PartitionType>& decisions) {
+    // Decisions are stored in pre-order, matching the order of encode_partition_tree
+    const size_t decision_index = decisions.size();
+    decisions.push_back(PartitionType::PARTITION_NONE);
+    block.partition = PartitionType::PARTITION_NONE;
+    best_cost = 0.0;
+    
+    if (block.x >= static_cast<int>(width_) || block.y >= static_cast<int>(height_)) {
+        return; // Outside the frame: not coded
     }
     
-    // AV1'in karmaşık RDO partition kararı
-    std::vector<PartitionType> candidates;
+    const bool inside = block.x + block.width <= static_cast<int>(width_) &&
+                        block.y + block.height <= static_cast<int>(height_);
+    const auto& config = processing::partition_search_config(speed_preset_);
     
-    // Hız preset'ine göre candidate'ları sınırla
-    if (speed_preset_ <= 3) {
-        // Best quality: tüm partition tipleri
-        candidates = {
-            PartitionType::PARTITION_NONE,
-            PartitionType::PARTITION_HORZ,
-            PartitionType::PARTITION_VERT,
-            PartitionType::PARTITION_SPLIT
-        };
+    if (!inside && block.width > 8) {
+        // Blocks crossing the frame edge are split
+        block.partition = PartitionType::PARTITION_SPLIT;
     } else {
-        // Faster: sadece temel partition'lar
-        candidates = {
-            PartitionType::PARTITION_NONE,
-            PartitionType::PARTITION_SPLIT
-        };
-    }
-    
-    PartitionType best_partition = PartitionType::PARTITION_NONE;
-    best_cost = std::numeric_limits<double>::max();
-    
-    for (auto partition : candidates) {
-        double cost = evaluate_partition_cost(block, partition);
-        if (cost < best_cost) {
-            best_cost = cost;
-            best_partition = partition;
+        // AV1'in RDO partition kararı. Hız preset'i derinliği ve candidate'ları sınırlar;
+        // HORZ / VERT sadece gradient yönünde denenir
+        best_cost = evaluate_partition_cost(statistics, entropy, lambda, block, PartitionType::PARTITION_NONE);
+        
+        const auto stats = statistics.block(block.x, block.y, block.width, block.height);
+        const PartitionType cheapest = config.rectangular ? PartitionType::PARTITION_HORZ : PartitionType::PARTITION_SPLIT;
+        const double extra_bits = calculate_partition_rate(entropy, block, cheapest) -
+                                  calculate_partition_rate(entropy, block, PartitionType::PARTITION_NONE);
+        
+        if (block.width > config.min_block_size && !processing::partition_is_final(stats, lambda, extra_bits, config)) {
+            static constexpr PartitionType SPLITS[] = {
+                PartitionType::PARTITION_HORZ,
+                PartitionType::PARTITION_VERT,
+                PartitionType::PARTITION_SPLIT
+            };
+            for (const PartitionType partition : SPLITS) {
+                if (partition != PartitionType::PARTITION_SPLIT &&
+                    (!config.rectangular ||
+                     !processing::split_direction_useful(stats, partition == PartitionType::PARTITION_HORZ, config))) {
+                    continue;
+                }
+                const double cost = evaluate_partition_cost(statistics, entropy, lambda, block, partition);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    block.partition = partition;
+                }
+            }
         }
     }
     
-    block.partition = best_partition;
+    decisions[decision_index] = block.partition;
     
     // Recursive partitioning
-    if (block.partition == PartitionType::PARTITION_SPLIT && 
-        block.width > 8 && block.height > 8) {
+    if (block.partition == PartitionType::PARTITION_SPLIT) {
         // 4-way split için child block'ları değerlendir
         int child_size = block.width / 2;
-        for (int i = 0; i < 2; ++i) {
-            for (int j = 0; j < 2; ++j) {
-                EncodingBlock child;
-                child.x = block.x + i * child_size;
-                child.y = block.y + j * child_size;
-                child.width = child_size;
-                child.height = child_size;
-                
-                double child_cost;
-                rdo_partition_decision(child, child_cost);
-                best_cost += child_cost;
-            }
+        best_cost = 0.0;
+        for (int i = 0; i < 4; ++i) {
+            EncodingBlock child;
+            child.x = block.x + (i % 2) * child_size;
+            child.y = block.y + (i / 2) * child_size;
+            child.width = child_size;
+            child.height = child_size;
+            
+            double child_cost;
+            rdo_partition_decision(statistics, entropy, lambda, child, child_cost, decisions);
+            best_cost += child_cost;
         }
     }
 }
 
-double AV1Encoder::evaluate_partition_cost(const EncodingBlock& block, PartitionType partition) {
+double AV1Encoder::evaluate_partition_cost(const processing::BlockStatistics& statistics,
+                                           const processing::AV1EntropyEncoder& entropy, double lambda,
+                                           const EncodingBlock& block, PartitionType partition) {
     // Rate-Distortion optimization cost calculation
-    double distortion = calculate_distortion(block);
-    double rate = calculate_partition_rate(block, partition);
+    double cost = 0.0;
     
-    // AV1-specific lambda calculation
-    double lambda = 0.68 * std::pow(2.0, (current_qp_ - 12) / 3.0);
+    EncodingBlock part = block;
+    switch (partition) {
+        case PartitionType::PARTITION_HORZ:
+            part.height /= 2;
+            cost = calculate_residual_cost(statistics, lambda, part);
+            part.y += part.height;
+            cost += calculate_residual_cost(statistics, lambda, part);
+            break;
+        case PartitionType::PARTITION_VERT:
+            part.width /= 2;
+            cost = calculate_residual_cost(statistics, lambda, part);
+            part.x += part.width;
+            cost += calculate_residual_cost(statistics, lambda, part);
+            break;
+        case PartitionType::PARTITION_SPLIT:
+            part.width /= 2;
+            part.height /= 2;
+            for (int i = 0; i < 4; ++i) {
+                part.x = block.x + (i % 2) * part.width;
+                part.y = block.y + (i / 2) * part.height;
+                cost += calculate_residual_cost(statistics, lambda, part);
+            }
+            break;
+        default:
+            cost = calculate_residual_cost(statistics, lambda, block);
+            break;
+    }
     
-    return distortion + lambda * rate;
+    return cost + lambda * calculate_partition_rate(entropy, block, partition);
 }
 
-void AV1Encoder::encode_partition_tree(utils::BitstreamWriter& writer, const EncodingBlock& block) {
-    processing::AV1EntropyEncoder entropy_encoder;
-    entropy_encoder.encode_partition_type(writer, block.partition);
+void AV1Encoder::encode_partition_tree(TileContext& tile, const EncodingBlock& block, size_t& decision_index) {
+    const PartitionType partition = tile.decisions[decision_index++];
     
-    if (block.partition == PartitionType::PARTITION_NONE) {
-        // Encode this block without partitioning
-        encode_prediction_mode(writer, block);
-        encode_transform_info(writer, block.transform);
-        
-        if (block.use_palette) {
-            encode_palette_mode(writer, block);
-        }
-    } else {
+    if (block.x >= static_cast<int>(width_) || block.y >= static_cast<int>(height_)) {
+        return;
+    }
+    
+    tile.entropy.encode_partition_type(partition, block.width);
+    
+    if (partition == PartitionType::PARTITION_SPLIT) {
         // Recursively encode partitions
-        int num_parts = 2; // Default for HORZ/VERT
-        if (block.partition == PartitionType::PARTITION_SPLIT) {
-            num_parts = 4;
-        }
-        
-        int part_width = block.width / ((block.partition == PartitionType::PARTITION_VERT) ? 2 : 1);
-        int part_height = block.height / ((block.partition == PartitionType::PARTITION_HORZ) ? 2 : 1);
-        
-        for (int i = 0; i < num_parts; ++i) {
+        int child_size = block.width / 2;
+        for (int i = 0; i < 4; ++i) {
             EncodingBlock child;
-            child.x = block.x + (i % 2) * part_width;
-            child.y = block.y + (i / 2) * part_height;
-            child.width = part_width;
-            child.height = part_height;
-            
-            // Simplified: assume same partition decision
-            child.partition = PartitionType::PARTITION_NONE;
-            encode_partition_tree(writer, child);
+            child.x = block.x + (i % 2) * child_size;
+            child.y = block.y + (i / 2) * child_size;
+            child.width = child_size;
+            child.height = child_size;
+            encode_partition_tree(tile, child, decision_index);
+        }
+        return;
+    }
+    
+    // NONE codes one block, HORZ/VERT two halves that are not partitioned further
+    int num_parts = (partition == PartitionType::PARTITION_NONE) ? 1 : 2;
+    int part_width = block.width / ((partition == PartitionType::PARTITION_VERT) ? 2 : 1);
+    int part_height = block.height / ((partition == PartitionType::PARTITION_HORZ) ? 2 : 1);
+    
+    for (int i = 0; i < num_parts; ++i) {
+        EncodingBlock part;
+        part.x = block.x + (partition == PartitionType::PARTITION_VERT ? i * part_width : 0);
+        part.y = block.y + (partition == PartitionType::PARTITION_HORZ ? i * part_height : 0);
+        part.width = part_width;
+        part.height = part_height;
+        part.partition = PartitionType::PARTITION_NONE;
+        encode_block(tile, part);
+    }
+}
+
+void AV1Encoder::encode_block(TileContext& tile, EncodingBlock& block) {
+    if (tile.read_deltas) {
+        const int delta = (tile.target_qindex - tile.qindex) / 4;
+        tile.entropy.encode_delta_qindex(delta);
+        tile.qindex += delta * 4;
+        tile.read_deltas = false;
+    }
+    
+    decide_intra_mode(tile, block);
+    encode_prediction_mode(tile, block);
+    
+    if (block.use_palette) {
+        encode_palette_mode(tile, block);
+    }
+    
+    encode_transform_info(tile, block);
+}
+
+void AV1Encoder::decide_intra_mode(TileContext& tile, EncodingBlock& block) {
+    using processing::AV1_MAX_ANGLE_DELTA;
+    block.pred_mode = PredictionMode::DC_PRED;
+    block.angle_delta = 0;
+    if (block.x + block.width > static_cast<int>(width_) || block.y + block.height > static_cast<int>(height_)) {
+        return; // DC across the frame border
+    }
+    
+    // Candidates as (mode, angle_delta) keys, the modes cheapest to signal first
+    static constexpr PredictionMode MODES[] = {
+        PredictionMode::DC_PRED, PredictionMode::SMOOTH_PRED, PredictionMode::PAETH_PRED,
+        PredictionMode::V_PRED, PredictionMode::H_PRED, PredictionMode::SMOOTH_V_PRED,
+        PredictionMode::SMOOTH_H_PRED, PredictionMode::D45_PRED, PredictionMode::D135_PRED,
+        PredictionMode::D113_PRED, PredictionMode::D157_PRED, PredictionMode::D203_PRED,
+        PredictionMode::D67_PRED
+    };
+    constexpr int DELTAS = 2 * AV1_MAX_ANGLE_DELTA + 1;
+    auto key = [](PredictionMode mode, int delta) {
+        return static_cast<int>(mode) * DELTAS + delta + AV1_MAX_ANGLE_DELTA;
+    };
+    
+    const FrameView& frame = *current_frame_;
+    const int stride = static_cast<int>(frame.luma_stride());
+    const int tx_size = std::min({block.width, block.height, 64});
+    const int qp = tile.qindex / 4 * 51 / 63;
+    const uint32_t lambda = processing::intra_lambda_sad(qp);
+    
+    // SATD over the transform blocks + lambda * rate of y_mode and angle_delta_y under the
+    // tile's current CDFs
+    auto cost = [&](int candidate) {
+        EncodingBlock trial = block;
+        trial.pred_mode = static_cast<PredictionMode>(candidate / DELTAS);
+        trial.angle_delta = candidate % DELTAS - AV1_MAX_ANGLE_DELTA;
+        uint32_t satd = 0;
+        for (int ty = block.y; ty < block.y + block.height; ty += tx_size) {
+            for (int tx_x = block.x; tx_x < block.x + block.width; tx_x += tx_size) {
+                predict_intra_tx(tile, trial, tx_x, ty, tx_size);
+                satd += processing::intra_satd(frame.luma() + static_cast<ptrdiff_t>(ty) * stride + tx_x, stride,
+                                               tile.prediction.data(), 64, tx_size, tx_size);
+            }
+        }
+        uint64_t rate = tile.entropy.prediction_mode_rate(trial.pred_mode, !tile.is_keyframe);
+        if (processing::av1_is_directional(trial.pred_mode)) {
+            rate += tile.entropy.angle_delta_rate(trial.pred_mode, trial.angle_delta);
+        }
+        return satd + static_cast<uint32_t>((lambda * rate + (1u << (processing::RATE_FRAC_BITS + 3))) >>
+                                            (processing::RATE_FRAC_BITS + 4));
+    };
+    
+    int candidates[DELTAS * 2];
+    int count = 0;
+    for (PredictionMode mode : MODES) {
+        candidates[count++] = key(mode, 0);
+    }
+    const uint32_t early_exit = static_cast<uint32_t>(block.width * block.height);
+    auto best = tile.intra_search.search_list(candidates, count, early_exit, cost);
+    
+    // Angle deltas around the best direction, nearest first
+    const PredictionMode best_mode = static_cast<PredictionMode>(best.mode / DELTAS);
+    if (processing::av1_is_directional(best_mode) && best.cost > early_exit) {
+        count = 0;
+        for (int delta = 1; delta <= AV1_MAX_ANGLE_DELTA; ++delta) {
+            candidates[count++] = key(best_mode, -delta);
+            candidates[count++] = key(best_mode, delta);
+        }
+        const auto refined = tile.intra_search.search_list(candidates, count, early_exit, cost);
+        if (refined.cost < best.cost) {
+            best = refined;
         }
     }
+    
+    block.pred_mode = static_cast<PredictionMode>(best.mode / DELTAS);
+    block.angle_delta = best.mode % DELTAS - AV1_MAX_ANGLE_DELTA;
+}
+
+void AV1Encoder::predict_intra_tx(TileContext& tile, const EncodingBlock& block, int x, int y, int size) {
+    // Open loop: the neighbouring source samples stand in for the reconstruction
+    const FrameView& frame = *current_frame_;
+    const int stride = static_cast<int>(frame.luma_stride());
+    const int sb_x = x / superblock_size_ * superblock_size_, sb_y = y / superblock_size_ * superblock_size_;
+    const auto available = processing::intra_availability(
+        x, y, size, size, 2 * size, 2 * size, sb_x, sb_y, superblock_size_, tile.x0, tile.y0, tile.x1, tile.y1);
+    
+    processing::IntraEdges edges;
+    processing::load_av1_edges(edges, frame.luma() + static_cast<ptrdiff_t>(y) * stride + x, stride, size, size,
+                               available.above, available.left);
+    processing::predict_av1(edges, size, size, block.pred_mode, block.angle_delta, tile.prediction.data(), 64);
 }
 
-void AV1Encoder::encode_prediction_mode(utils::BitstreamWriter& writer, const EncodingBlock& block) {
-    processing::AV1EntropyEncoder entropy_encoder;
-    entropy_encoder.encode_prediction_mode(writer, block.pred_mode);
+void AV1Encoder::encode_prediction_mode(TileContext& tile, const EncodingBlock& block) {
+    tile.entropy.encode_prediction_mode(block.pred_mode, !tile.is_keyframe);
+    if (processing::av1_is_directional(block.pred_mode)) {
+        tile.entropy.encode_angle_delta(block.pred_mode, block.angle_delta);
+    }
     
     // AV1'in gelişmiş prediction modları için ek bilgiler
     if (block.pred_mode >= PredictionMode::NEARESTMV) {
@@ -291,6 +726,67 @@ void AV1Encoder::encode_prediction_mode(utils::BitstreamWriter& writer, const En
     }
 }
 
+void AV1Encoder::encode_transform_info(TileContext& tile, const EncodingBlock& block) {
+    // Square transforms of up to 64x64 tile the block; each is a grid of 8x8 DCTs
+    const int tx_size = std::min({block.width, block.height, 64});
+    // Sized for the largest transform once; smaller ones use the top-left corner
+    TransformBlock& tx = tile.transform;
+    if (tx.coeffs.size() < 64) {
+        tx.coeffs.assign(64, std::vector<int16_t>(64));
+    }
+    tx.tx_size = static_cast<uint8_t>(tx_size);
+    tx.tx_type = 0; // DCT_DCT
+    
+    const FrameView& frame = *current_frame_;
+    const int stride = static_cast<int>(frame.luma_stride());
+    const int qp = tile.qindex / 4 * 51 / 63; // Quantizer uses the H.264 scale
+    
+    std::array<std::array<int16_t, 8>, 8> residual;
+    std::array<std::array<double, 8>, 8> coeffs;
+    
+    for (int ty = block.y; ty < block.y + block.height; ty += tx_size) {
+        for (int tx_x = block.x; tx_x < block.x + block.width; tx_x += tx_size) {
+            if (tx_x >= static_cast<int>(width_) || ty >= static_cast<int>(height_)) {
+                continue;
+            }
+            
+            // Intra prediction is per transform block (7.11.2)
+            predict_intra_tx(tile, block, tx_x, ty, tx_size);
+            
+            for (int by = 0; by < tx_size; by += 8) {
+                for (int bx = 0; bx < tx_size; bx += 8) {
+                    for (int i = 0; i < 8; ++i) {
+                        // Samples past the frame edge repeat the last row / column
+                        const int sy = std::min<int>(ty + by + i, height_ - 1);
+                        const uint8_t* src = frame.luma() + static_cast<size_t>(sy) * stride;
+                        const uint8_t* prediction = tile.prediction.data() + (by + i) * 64 + bx;
+                        for (int j = 0; j < 8; ++j) {
+                            const int sx = std::min<int>(tx_x + bx + j, width_ - 1);
+                            residual[i][j] = static_cast<int16_t>(src[sx] - prediction[j]);
+                        }
+                    }
+                    
+                    dct_->forward_dct(residual, coeffs);
+                    quantizer_->quantize_block(coeffs, qp);
+                    
+                    for (int i = 0; i < 8; ++i) {
+                        for (int j = 0; j < 8; ++j) {
+                            tx.coeffs[by + i][bx + j] = static_cast<int16_t>(coeffs[i][j]);
+                        }
+                    }
+                }
+            }
+            
+            tile.entropy.encode_coeffs(tx.coeffs, tx_size, block.pred_mode < PredictionMode::NEARESTMV);
+        }
+    }
+}
+
+void AV1Encoder::encode_palette_mode(TileContext& tile, const EncodingBlock& block) {
+    // has_palette_y; palette colours are not searched yet
+    tile.entropy.encode_bool(block.use_palette);
+}
+
 void AV1Encoder::apply_obmc_prediction(EncodingBlock& block) {
     if (!enable_obmc_) return;
     
@@ -307,6 +803,11 @@ void AV1Encoder::apply_cfl_prediction(EncodingBlock& block) {
     // Chroma component için bitrate tasarrufu sağlar
 }
 
+void AV1Encoder::set_max_reference_frames(uint32_t count) {
+    max_reference_frames_ = std::max(1u, std::min(8u, count)); // 8 reference slots
+    dpb_.set_max_references(max_reference_frames_);
+}
+
 void AV1Encoder::enable_tools(bool obmc, bool cfl, bool palette, bool warp_motion) {
     enable_obmc_ = obmc && (speed_preset_ <= 6);
     enable_cfl_ = cfl && (speed_preset_ <= 6);
@@ -314,7 +815,7 @@ void AV1Encoder::enable_tools(bool obmc, bool cfl, bool palette, bool warp_motio
     enable_warp_motion_ = warp_motion && (speed_preset_ <= 2);
 }
 
-void AV1Encoder::set_speed_preset(int speed) {
+bool AV1Encoder::set_speed_preset(int speed) {
     speed_preset_ = std::max(0, std::min(9, speed));
     
     // Speed preset'e göre tool'ları ayarla
@@ -322,36 +823,76 @@ void AV1Encoder::set_speed_preset(int speed) {
     enable_cfl_ = (speed_preset_ <= 6);
     enable_palette_ = (speed_preset_ <= 4);
     enable_warp_motion_ = (speed_preset_ <= 2);
+    return true;
 }
 
 void AV1Encoder::set_bitrate(uint32_t bitrate) {
     bitrate_ = bitrate;
-    target_bits_per_frame_ = bitrate / fps_;
-    
-    // AV1 QP adjustment
-    current_qp_ = 50 + (bitrate < 2000000 ? 8 : 0) - (bitrate > 4000000 ? 8 : 0);
-    current_qp_ = std::max(20, std::min(63, current_qp_));
+    rate_control_.set_bitrate(bitrate);
+}
+
+void AV1Encoder::set_rate_control(const RateControlConfig& config) {
+    RateControlConfig rc_config = config;
+    rc_config.fps = fps_;
+    bitrate_ = config.bitrate;
+    rate_control_.configure(rc_config);
+}
+
+void AV1Encoder::set_gop_size(uint32_t gop_size) {
+    gop_size_ = std::max(1u, gop_size);
+}
+
+bool AV1Encoder::set_intra_refresh(uint32_t period) {
+    intra_refresh_period_ = period;
+    rate_control_.set_scene_cut_keyframes(period == 0);
+    return true;
 }
 
 uint32_t AV1Encoder::get_encoded_size() const {
-    return frame_count_ * target_bits_per_frame_ / 8;
+    return static_cast<uint32_t>(rate_control_.total_bits() / 8);
+}
+
+void AV1Encoder::reset() {
+    frame_count_ = 0;
+    last_keyframe_ = 0;
+    
+    // The last stream's settings do not carry over
+    const Settings& settings = initial_settings_;
+    gop_size_ = settings.gop_size;
+    speed_preset_ = settings.speed_preset;
+    enable_obmc_ = settings.enable_obmc;
+    enable_cfl_ = settings.enable_cfl;
+    enable_palette_ = settings.enable_palette;
+    enable_warp_motion_ = settings.enable_warp_motion;
+    tile_columns_ = settings.tile_columns;
+    tile_rows_ = settings.tile_rows;
+    intra_time_budget_ = settings.intra_time_budget;
+    set_intra_refresh(settings.intra_refresh_period);
+    rate_control_.reset(settings.rate_control);
+    bitrate_ = settings.rate_control.bitrate;
+    
+    dpb_.clear(); // Pictures go back to the reference pool
+    set_max_reference_frames(settings.max_reference_frames);
+    intra_modes_evaluated_.store(0, std::memory_order_relaxed);
 }
 
 // Yardımcı fonksiyonlar
-double AV1Encoder::calculate_distortion(const EncodingBlock& block) {
-    // Simplified distortion calculation
-    // Gerçek implementasyonda MSE/SSIM hesaplanır
-    return block.width * block.height * 10.0;
+double AV1Encoder::calculate_residual_cost(const processing::BlockStatistics& statistics, double lambda,
+                                           const EncodingBlock& block) {
+    // DC prediction residual'ının D + lambda * R maliyeti, frame'e kırpılmış
+    return processing::residual_rd_cost(statistics.block(block.x, block.y, block.width, block.height), lambda);
 }
 
-double AV1Encoder::calculate_partition_rate(const EncodingBlock& block, PartitionType partition) {
-    // Partition type'ın bit maliyeti
+double AV1Encoder::calculate_partition_rate(const processing::AV1EntropyEncoder& entropy, const EncodingBlock& block,
+                                            PartitionType partition) {
+    // Partition symbol'ün CDF'ten bit maliyeti + coded block başına mode/coeff overhead
+    constexpr double BLOCK_OVERHEAD = 8.0;
+    const double symbol_bits = processing::rate_to_bits(entropy.partition_rate(partition, block.width));
     switch (partition) {
-        case PartitionType::PARTITION_NONE: return 1.0;
-        case PartitionType::PARTITION_HORZ: return 2.0;
-        case PartitionType::PARTITION_VERT: return 2.0;
-        case PartitionType::PARTITION_SPLIT: return 3.0;
-        default: return 5.0;
+        case PartitionType::PARTITION_NONE: return symbol_bits + BLOCK_OVERHEAD;
+        case PartitionType::PARTITION_HORZ: return symbol_bits + 2 * BLOCK_OVERHEAD;
+        case PartitionType::PARTITION_VERT: return symbol_bits + 2 * BLOCK_OVERHEAD;
+        default: return symbol_bits + 4 * BLOCK_OVERHEAD;
     }
 }
 
@@ -0,0 +1,134 @@
+// src/codec/encoder_pool.cpp
+#include "streaming/codec/encoder_pool.hpp"
+#include "streaming/codec/av1_encoder.hpp"
+#include "streaming/codec/h264_encoder.hpp"
+#include "streaming/codec/h265_encoder.hpp"
+#include "streaming/codec/vvc_encoder.hpp"
+#include <exception>
+#include <iostream>
+
+namespace streaming {
+namespace codec {
+
+std::shared_ptr<EncoderPool> EncoderPool::create(size_t max_idle_per_key, Factory factory) {
+    std::shared_ptr<EncoderPool> pool(new EncoderPool(max_idle_per_key, std::move(factory)));
+    pool->self_ = pool;
+    return pool;
+}
+
+std::unique_ptr<IVideoEncoder> EncoderPool::create_encoder(const EncoderKey& key, uint32_t bitrate) {
+    std::unique_ptr<IVideoEncoder> encoder;
+    switch (key.codec) {
+        case EncoderCodec::H264:
+            encoder = std::make_unique<H264Encoder>();
+            break;
+        case EncoderCodec::H265:
+            encoder = std::make_unique<H265Encoder>();
+            break;
+        case EncoderCodec::VVC:
+            encoder = std::make_unique<VVCEncoder>();
+            break;
+        case EncoderCodec::AV1:
+            encoder = std::make_unique<AV1Encoder>();
+            break;
+    }
+    if (encoder) {
+        encoder->set_speed_preset(key.preset);
+    }
+
+    if (!encoder || !encoder->initialize(key.width, key.height, key.fps, bitrate)) {
+        return nullptr;
+    }
+    return encoder;
+}
+
+std::shared_ptr<IVideoEncoder> EncoderPool::acquire(const EncoderKey& key, uint32_t bitrate) {
+    std::unique_ptr<IVideoEncoder> encoder;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = idle_.find(key);
+        if (it != idle_.end() && !it->second.empty()) {
+            encoder = std::move(it->second.back());
+            it->second.pop_back();
+            ++stats_.hits;
+        }
+    }
+
+    if (encoder) {
+        encoder->set_bitrate(bitrate);
+        return wrap(key, std::move(encoder));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        encoder = factory_(key, bitrate);
+    } catch (const std::exception& e) {
+        std::cerr << "❌ EncoderPool: encoder creation failed: " << e.what() << std::endl;
+    }
+    if (!encoder) {
+        return nullptr;
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.misses;
+        stats_.init_time += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+    }
+    return wrap(key, std::move(encoder));
+}
+
+std::shared_ptr<IVideoEncoder> EncoderPool::wrap(const EncoderKey& key, std::unique_ptr<IVideoEncoder> encoder) {
+    // Released encoders go back to the pool, or are deleted if the pool is gone
+    std::weak_ptr<EncoderPool> weak_pool = self_;
+    return std::shared_ptr<IVideoEncoder>(encoder.release(), [weak_pool, key](IVideoEncoder* e) {
+        if (auto pool = weak_pool.lock()) {
+            pool->release(key, e);
+        } else {
+            delete e;
+        }
+    });
+}
+
+void EncoderPool::release(const EncoderKey& key, IVideoEncoder* released) {
+    std::unique_ptr<IVideoEncoder> encoder(released);
+
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        encoder->reset();
+    } catch (const std::exception& e) {
+        std::cerr << "❌ EncoderPool: reset failed, encoder dropped: " << e.what() << std::endl;
+        return;
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Declared after encoder: unlocked before a surplus encoder is destroyed
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.resets;
+    stats_.reset_time += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+    std::vector<std::unique_ptr<IVideoEncoder>>& encoders = idle_[key];
+    if (encoders.size() < max_idle_per_key_) {
+        encoders.push_back(std::move(encoder));
+    }
+}
+
+EncoderPool::Stats EncoderPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.idle = 0;
+    for (const auto& [key, encoders] : idle_) {
+        stats.idle += encoders.size();
+    }
+    return stats;
+}
+
+void EncoderPool::clear() {
+    std::unordered_map<EncoderKey, std::vector<std::unique_ptr<IVideoEncoder>>, EncoderKeyHash> idle;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle.swap(idle_);
+    }
+}
+
+} // namespace codec
+} // namespace streaming
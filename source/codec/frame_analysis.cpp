@@ -0,0 +1,334 @@
+// src/codec/frame_analysis.cpp
+#include "streaming/codec/frame_analysis.hpp"
+#include "streaming/processing/block_kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h> // SIMD instructions
+
+namespace streaming {
+namespace codec {
+
+namespace {
+
+constexpr int LOWRES_BLOCK = 8;
+constexpr int LOWRES_SEARCH_RANGE = 16; // Half-resolution pixels
+constexpr double AQ_LOG2_SCALE = 1.0397; // QP per doubling of block variance at strength 1
+
+void hadamard4(int* d) {
+    const int a0 = d[0] + d[1], a1 = d[0] - d[1];
+    const int a2 = d[2] + d[3], a3 = d[2] - d[3];
+    d[0] = a0 + a2;
+    d[1] = a1 + a3;
+    d[2] = a0 - a2;
+    d[3] = a1 - a3;
+}
+
+// Sum of the four 4x4 Hadamard SATDs of an 8x8 difference block
+int satd_8x8(const int* diff) {
+    int sum = 0;
+    for (int by = 0; by < 8; by += 4) {
+        for (int bx = 0; bx < 8; bx += 4) {
+            int m[4][4];
+            for (int y = 0; y < 4; ++y) {
+                for (int x = 0; x < 4; ++x) {
+                    m[y][x] = diff[(by + y) * 8 + bx + x];
+                }
+                hadamard4(m[y]);
+            }
+
+            int block = 0;
+            for (int x = 0; x < 4; ++x) {
+                int column[4] = {m[0][x], m[1][x], m[2][x], m[3][x]};
+                hadamard4(column);
+                for (int y = 0; y < 4; ++y) {
+                    block += std::abs(column[y]);
+                }
+            }
+            sum += block / 2;
+        }
+    }
+    return sum;
+}
+
+// Sum and sum of squares of an 8x8 block; variance = sum_sq - sum^2 / 64
+void block_sums_8x8(const uint8_t* src, int stride, uint32_t& sum, uint32_t& sum_sq) {
+#ifdef __AVX2__
+    // Four 8-pixel rows per register
+    auto load_rows = [&](int y) {
+        uint64_t r[4];
+        for (int i = 0; i < 4; ++i) {
+            std::memcpy(&r[i], src + static_cast<ptrdiff_t>(y + i) * stride, 8);
+        }
+        return _mm256_set_epi64x(static_cast<long long>(r[3]), static_cast<long long>(r[2]),
+                                 static_cast<long long>(r[1]), static_cast<long long>(r[0]));
+    };
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i rows0 = load_rows(0);
+    const __m256i rows1 = load_rows(4);
+
+    const __m256i sums = _mm256_add_epi64(_mm256_sad_epu8(rows0, zero), _mm256_sad_epu8(rows1, zero));
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+    s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+    sum = static_cast<uint32_t>(_mm_cvtsi128_si32(s));
+
+    auto squares = [&](__m256i rows) {
+        const __m256i lo = _mm256_unpacklo_epi8(rows, zero);
+        const __m256i hi = _mm256_unpackhi_epi8(rows, zero);
+        return _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi));
+    };
+    const __m256i sq = _mm256_add_epi32(squares(rows0), squares(rows1));
+    __m128i q = _mm_add_epi32(_mm256_castsi256_si128(sq), _mm256_extracti128_si256(sq, 1));
+    q = _mm_add_epi32(q, _mm_shuffle_epi32(q, _MM_SHUFFLE(1, 0, 3, 2)));
+    q = _mm_add_epi32(q, _mm_shuffle_epi32(q, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum_sq = static_cast<uint32_t>(_mm_cvtsi128_si32(q));
+#else
+    sum = 0;
+    sum_sq = 0;
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            const uint32_t v = src[y * stride + x];
+            sum += v;
+            sum_sq += v * v;
+        }
+    }
+#endif
+}
+
+} // namespace
+
+double FrameAnalysis::qp_offset(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+    if (qp_offsets.empty() || width == 0 || height == 0) return 0.0;
+
+    const uint32_t bx0 = std::min(x / 16, blocks_x - 1);
+    const uint32_t by0 = std::min(y / 16, blocks_y - 1);
+    const uint32_t bx1 = std::clamp((x + width + 15) / 16, bx0 + 1, blocks_x);
+    const uint32_t by1 = std::clamp((y + height + 15) / 16, by0 + 1, blocks_y);
+
+    double sum = 0.0;
+    for (uint32_t by = by0; by < by1; ++by) {
+        for (uint32_t bx = bx0; bx < bx1; ++bx) {
+            sum += qp_offsets[static_cast<size_t>(by) * blocks_x + bx];
+        }
+    }
+    return sum / ((bx1 - bx0) * (by1 - by0));
+}
+
+const FrameAnalysis::BlockHint* FrameAnalysis::hint(uint32_t x, uint32_t y) const {
+    if (hints.empty()) return nullptr;
+    const uint32_t bx = std::min(x / 16, blocks_x - 1);
+    const uint32_t by = std::min(y / 16, blocks_y - 1);
+    return &hints[static_cast<size_t>(by) * blocks_x + bx];
+}
+
+void FrameAnalysis::scale(uint32_t target_width, uint32_t target_height, FrameAnalysis& result) const {
+    const double sx = width ? static_cast<double>(target_width) / width : 1.0;
+    const double sy = height ? static_cast<double>(target_height) / height : 1.0;
+
+    result.width = target_width;
+    result.height = target_height;
+    result.intra_cost = intra_cost * sx * sy;
+    result.inter_cost = inter_cost * sx * sy;
+    result.block_count = std::max(1u, static_cast<uint32_t>(std::lround(block_count * sx * sy)));
+    result.has_previous = has_previous;
+    result.blocks_x = (target_width + 15) / 16;
+    result.blocks_y = (target_height + 15) / 16;
+
+    // Nearest source block for the centre of every target block
+    const size_t count = static_cast<size_t>(result.blocks_x) * result.blocks_y;
+    auto source_index = [&](uint32_t bx, uint32_t by) {
+        const uint32_t x = std::min(static_cast<uint32_t>((bx * 16 + 8) / sx) / 16, blocks_x - 1);
+        const uint32_t y = std::min(static_cast<uint32_t>((by * 16 + 8) / sy) / 16, blocks_y - 1);
+        return static_cast<size_t>(y) * blocks_x + x;
+    };
+
+    result.qp_offsets.resize(qp_offsets.empty() ? 0 : count);
+    result.hints.resize(hints.empty() ? 0 : count);
+    for (uint32_t by = 0; by < result.blocks_y; ++by) {
+        for (uint32_t bx = 0; bx < result.blocks_x; ++bx) {
+            const size_t index = static_cast<size_t>(by) * result.blocks_x + bx;
+            const size_t source = source_index(bx, by);
+            if (!qp_offsets.empty()) {
+                result.qp_offsets[index] = qp_offsets[source];
+            }
+            if (!hints.empty()) {
+                BlockHint& hint = result.hints[index];
+                hint.mv_x = static_cast<int16_t>(std::lround(hints[source].mv_x * sx));
+                hint.mv_y = static_cast<int16_t>(std::lround(hints[source].mv_y * sy));
+                hint.intra = hints[source].intra;
+            }
+        }
+    }
+}
+
+void FrameAnalyzer::analyze(const uint8_t* luma, int stride, int width, int height, FrameAnalysis& result) {
+    result.intra_cost = result.inter_cost = 0.0;
+    result.block_count = 0;
+    result.has_previous = false;
+    result.width = static_cast<uint32_t>(width);
+    result.height = static_cast<uint32_t>(height);
+    result.blocks_x = static_cast<uint32_t>((width + 15) / 16);
+    result.blocks_y = static_cast<uint32_t>((height + 15) / 16);
+
+    const int lw = width / 2;
+    const int lh = height / 2;
+    if (lw < LOWRES_BLOCK || lh < LOWRES_BLOCK) {
+        result.intra_cost = result.inter_cost = 1.0;
+        result.block_count = 1;
+        result.qp_offsets.clear();
+        result.hints.clear();
+        return;
+    }
+
+    if (lw != lowres_width_ || lh != lowres_height_) {
+        previous_.clear();
+        lowres_width_ = lw;
+        lowres_height_ = lh;
+    }
+
+    // 2x2 box downscale of the luma plane
+    current_.resize(static_cast<size_t>(lw) * lh);
+    for (int y = 0; y < lh; ++y) {
+        const uint8_t* row0 = luma + static_cast<size_t>(2 * y) * stride;
+        const uint8_t* row1 = row0 + stride;
+        uint8_t* dst = &current_[static_cast<size_t>(y) * lw];
+        for (int x = 0; x < lw; ++x) {
+            dst[x] = static_cast<uint8_t>((row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1] + 2) >> 2);
+        }
+    }
+
+    const int blocks_x = lw / LOWRES_BLOCK;
+    const int blocks_y = lh / LOWRES_BLOCK;
+    const bool has_previous = !previous_.empty();
+    vectors_.assign(static_cast<size_t>(blocks_x) * blocks_y, {0, 0});
+    result.hints.assign(has_previous ? static_cast<size_t>(result.blocks_x) * result.blocks_y : 0,
+                        FrameAnalysis::BlockHint{});
+
+    int diff[64];
+    for (int by = 0; by < blocks_y; ++by) {
+        for (int bx = 0; bx < blocks_x; ++bx) {
+            const int x0 = bx * LOWRES_BLOCK;
+            const int y0 = by * LOWRES_BLOCK;
+            const uint8_t* src = &current_[static_cast<size_t>(y0) * lw + x0];
+
+            // Intra: residual against the block mean (DC prediction)
+            int sum = 0;
+            for (int y = 0; y < 8; ++y) {
+                for (int x = 0; x < 8; ++x) {
+                    sum += src[y * lw + x];
+                }
+            }
+            const int mean = (sum + 32) >> 6;
+            for (int y = 0; y < 8; ++y) {
+                for (int x = 0; x < 8; ++x) {
+                    diff[y * 8 + x] = src[y * lw + x] - mean;
+                }
+            }
+            const int intra = satd_8x8(diff);
+            int inter = intra;
+
+            if (has_previous) {
+                auto sad_at = [&](int mx, int my) {
+                    return static_cast<int>(processing::sad<LOWRES_BLOCK, LOWRES_BLOCK>(
+                        src, lw, &previous_[static_cast<size_t>(y0 + my) * lw + x0 + mx], lw));
+                };
+                auto clamp_vector = [&](std::pair<int, int> mv) {
+                    mv.first = std::clamp(mv.first, std::max(-LOWRES_SEARCH_RANGE, -x0),
+                                          std::min(LOWRES_SEARCH_RANGE, lw - LOWRES_BLOCK - x0));
+                    mv.second = std::clamp(mv.second, std::max(-LOWRES_SEARCH_RANGE, -y0),
+                                           std::min(LOWRES_SEARCH_RANGE, lh - LOWRES_BLOCK - y0));
+                    return mv;
+                };
+
+                // Zero, left and above vectors as predictors, then a small diamond search
+                std::pair<int, int> best = {0, 0};
+                int best_sad = sad_at(0, 0);
+                const size_t index = static_cast<size_t>(by) * blocks_x + bx;
+                std::pair<int, int> candidates[2] = {
+                    bx > 0 ? vectors_[index - 1] : std::pair<int, int>{0, 0},
+                    by > 0 ? vectors_[index - blocks_x] : std::pair<int, int>{0, 0}};
+                for (auto candidate : candidates) {
+                    candidate = clamp_vector(candidate);
+                    const int sad = sad_at(candidate.first, candidate.second);
+                    if (sad < best_sad) {
+                        best_sad = sad;
+                        best = candidate;
+                    }
+                }
+
+                static constexpr int DIAMOND[4][2] = {{0, -1}, {-1, 0}, {1, 0}, {0, 1}};
+                for (int step = 0; step < LOWRES_SEARCH_RANGE; ++step) {
+                    const std::pair<int, int> center = best;
+                    for (const auto& d : DIAMOND) {
+                        const auto candidate = clamp_vector({center.first + d[0], center.second + d[1]});
+                        const int sad = sad_at(candidate.first, candidate.second);
+                        if (sad < best_sad) {
+                            best_sad = sad;
+                            best = candidate;
+                        }
+                    }
+                    if (best == center) break;
+                }
+                vectors_[index] = best;
+
+                const uint8_t* ref = &previous_[static_cast<size_t>(y0 + best.second) * lw + x0 + best.first];
+                for (int y = 0; y < 8; ++y) {
+                    for (int x = 0; x < 8; ++x) {
+                        diff[y * 8 + x] = src[y * lw + x] - ref[y * lw + x];
+                    }
+                }
+                const int motion = satd_8x8(diff);
+                inter = std::min(intra, motion);
+
+                FrameAnalysis::BlockHint& hint = result.hints[static_cast<size_t>(by) * result.blocks_x + bx];
+                hint.mv_x = static_cast<int16_t>(best.first * 2);
+                hint.mv_y = static_cast<int16_t>(best.second * 2);
+                hint.intra = intra < motion;
+            }
+
+            result.intra_cost += intra;
+            result.inter_cost += inter;
+        }
+    }
+
+    result.block_count = static_cast<uint32_t>(blocks_x * blocks_y);
+    result.has_previous = has_previous;
+    compute_aq_offsets(result);
+    previous_.swap(current_);
+}
+
+void FrameAnalyzer::compute_aq_offsets(FrameAnalysis& result) const {
+    // Flat blocks show quantization artefacts first and textured blocks mask them:
+    // offsets follow log2 of the lowres block variance around the frame mean
+    // (x264 style variance AQ), so the frame QP stays the average
+    if (aq_strength_ <= 0.0) {
+        result.qp_offsets.clear();
+        return;
+    }
+    result.qp_offsets.assign(static_cast<size_t>(result.blocks_x) * result.blocks_y, 0.0f);
+
+    double mean = 0.0;
+    for (uint32_t by = 0; by < result.blocks_y; ++by) {
+        // Edge blocks past the lowres plane use the last full block
+        const int y0 = std::min<int>(by * LOWRES_BLOCK, lowres_height_ - LOWRES_BLOCK);
+        for (uint32_t bx = 0; bx < result.blocks_x; ++bx) {
+            const int x0 = std::min<int>(bx * LOWRES_BLOCK, lowres_width_ - LOWRES_BLOCK);
+            uint32_t sum, sum_sq;
+            block_sums_8x8(&current_[static_cast<size_t>(y0) * lowres_width_ + x0], lowres_width_, sum, sum_sq);
+
+            const double variance = sum_sq - static_cast<double>(sum) * sum / 64.0;
+            const float log_variance = static_cast<float>(std::log2(variance + 1.0));
+            result.qp_offsets[static_cast<size_t>(by) * result.blocks_x + bx] = log_variance;
+            mean += log_variance;
+        }
+    }
+    mean /= static_cast<double>(result.qp_offsets.size());
+
+    for (float& offset : result.qp_offsets) {
+        offset = static_cast<float>(aq_strength_ * AQ_LOG2_SCALE * (offset - mean));
+    }
+}
+
+} // namespace codec
+} // namespace streaming
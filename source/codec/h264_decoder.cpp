@@ -0,0 +1,771 @@
+// src/codec/h264_decoder.cpp
+#include "streaming/codec/h264_decoder.hpp"
+#include "streaming/processing/cavlc_decoder.hpp"
+#include "streaming/processing/motion_estimation.hpp"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+namespace streaming {
+namespace codec {
+
+namespace {
+
+// NAL payload with the emulation prevention bytes (00 00 03) removed
+void unescape_rbsp(const uint8_t* data, size_t size, std::vector<uint8_t>& rbsp) {
+    rbsp.clear();
+    int zeros = 0;
+    for (size_t i = 0; i < size; ++i) {
+        if (zeros >= 2 && data[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        rbsp.push_back(data[i]);
+        zeros = data[i] == 0 ? zeros + 1 : 0;
+    }
+}
+
+// Offset of the byte after the next 00 00 01 start code at or after pos, or size
+size_t next_start_code(const uint8_t* data, size_t size, size_t pos) {
+    for (size_t i = pos; i + 2 < size; ++i) {
+        if (data[i + 2] > 1) {
+            i += 2; // No start code can end at i + 1 or i + 2
+        } else if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            return i + 3;
+        }
+    }
+    return size;
+}
+
+// Motion of the left (a), above (b) and above-right (c, the above-left when the
+// above-right is not available) macroblocks as recorded for the deblocking filter
+// (same as H264Encoder)
+void neighbour_motion(const processing::H264DeblockingFilter& filter, const processing::H264IntraNeighbours& neighbours,
+                      uint32_t mb_x, uint32_t mb_y, processing::H264NeighbourMotion& a,
+                      processing::H264NeighbourMotion& b, processing::H264NeighbourMotion& c) {
+    auto motion = [&](bool available, uint32_t x, uint32_t y) {
+        processing::H264NeighbourMotion result;
+        result.available = available;
+        if (available && !filter.info(x, y).intra) {
+            const auto& info = filter.info(x, y);
+            result.ref_idx = info.ref_idx;
+            result.mv_x = info.mv_x;
+            result.mv_y = info.mv_y;
+        }
+        return result;
+    };
+    a = motion(neighbours.left, mb_x - 1, mb_y);
+    b = motion(neighbours.above, mb_x, mb_y - 1);
+    c = neighbours.above_right ? motion(true, mb_x + 1, mb_y - 1) : motion(neighbours.above_left, mb_x - 1, mb_y - 1);
+}
+
+} // namespace
+
+H264Decoder::H264Decoder()
+    : dct_(std::make_unique<processing::DCT>())
+    , quantizer_(std::make_unique<processing::Quantizer>())
+    , cavlc_decoder_(std::make_unique<processing::CAVLCDecoder>()) {}
+
+H264Decoder::~H264Decoder() = default;
+
+bool H264Decoder::initialize() {
+    reset();
+    std::cout << "🚀 H264Decoder initialized" << (thread_pool_ ? " (slice-threaded)" : "") << std::endl;
+    return true;
+}
+
+void H264Decoder::reset() {
+    // Buffers are kept; the next access unit has to start with an SPS, a PPS and an IDR
+    sps_valid_ = false;
+    pps_valid_ = false;
+    dpb_.clear();
+    job_.release();
+    job_.slice_count_ = 0;
+    frame_count_ = 0;
+}
+
+bool H264Decoder::decode_frame(const uint8_t* data, size_t size, VideoFrame& output) {
+    std::shared_ptr<ReferencePicture> picture;
+    if (!decode_picture(data, size, picture)) {
+        return false;
+    }
+
+    // Packed YUV420 copy of the picture
+    output.width = width_;
+    output.height = height_;
+    output.stride = width_;
+    output.timestamp = picture->picture_order;
+    output.keyframe = picture->is_keyframe;
+
+    const size_t luma_size = static_cast<size_t>(width_) * height_;
+    const uint32_t chroma_width = (width_ + 1) / 2;
+    const uint32_t chroma_height = (height_ + 1) / 2;
+    const size_t chroma_size = static_cast<size_t>(chroma_width) * chroma_height;
+    output.data.resize(luma_size + 2 * chroma_size);
+
+    uint8_t* dst = output.data.data();
+    for (int id = ReferencePicture::Y; id <= ReferencePicture::V; ++id) {
+        const ReferencePicture::Plane& plane = picture->plane(static_cast<ReferencePicture::PlaneId>(id));
+        for (int y = 0; y < plane.height; ++y) {
+            std::memcpy(dst, plane.row(y), plane.width);
+            dst += plane.width;
+        }
+    }
+    return true;
+}
+
+bool H264Decoder::decode_picture(const uint8_t* data, size_t size, std::shared_ptr<ReferencePicture>& picture) {
+    if (!prepare_picture(data, size, job_) || !decode_prepared(job_)) {
+        return false;
+    }
+    picture = job_.picture_;
+    job_.release(); // Only the DPB (and the caller) keep the picture
+    return true;
+}
+
+bool H264Decoder::prepare_picture(const uint8_t* data, size_t size, PictureJob& job) {
+    try {
+        job.release();
+
+        // Split the access unit on start codes; the zero byte of a 4-byte start code
+        // belongs to the next NAL unit, so trailing zeros are trimmed
+        job.slice_count_ = 0;
+        size_t start = next_start_code(data, size, 0);
+        while (start < size) {
+            const size_t next = next_start_code(data, size, start);
+            size_t end = next < size ? next - 3 : size;
+            while (end > start && data[end - 1] == 0) {
+                --end;
+            }
+            if (end > start && !decode_nal_unit(data + start, end - start, job)) {
+                return false;
+            }
+            start = next;
+        }
+
+        if (job.slice_count_ == 0) {
+            return false; // No picture in this access unit (parameter sets only)
+        }
+
+        // Slices cover consecutive macroblocks up to the start of the next one
+        const uint32_t total_mbs = mb_width_ * mb_height_;
+        for (size_t s = 0; s < job.slice_count_; ++s) {
+            Slice& slice = job.slices_[s];
+            slice.end_mb = s + 1 < job.slice_count_ ? job.slices_[s + 1].first_mb : total_mbs;
+            if (slice.first_mb >= slice.end_mb || slice.end_mb > total_mbs ||
+                slice.idr != job.slices_[0].idr) {
+                throw std::runtime_error("Invalid slice layout");
+            }
+            // The picture is filtered as a whole, across slice edges
+            if (slice.deblocking != job.slices_[0].deblocking || slice.alpha_offset != job.slices_[0].alpha_offset ||
+                slice.beta_offset != job.slices_[0].beta_offset) {
+                throw std::runtime_error("Deblocking parameters differ between slices");
+            }
+        }
+        if (job.slices_[0].first_mb != 0) {
+            throw std::runtime_error("Missing first slice");
+        }
+
+        // IDR pictures do not reference anything before them
+        if (job.slices_[0].idr) {
+            dpb_.clear();
+        }
+        for (size_t s = 0; s < job.slice_count_; ++s) {
+            if (!job.slices_[s].intra && job.slices_[s].num_ref_idx_active > dpb_.size()) {
+                throw std::runtime_error("Missing reference picture");
+            }
+        }
+
+        // The DPB moves on with the next access unit; the job keeps its own references
+        for (size_t i = 0; i < dpb_.size(); ++i) {
+            job.references_.push_back(dpb_.get(i));
+        }
+
+        job.width_ = width_;
+        job.height_ = height_;
+        job.mb_width_ = mb_width_;
+        job.intra_modes_.resize(static_cast<size_t>(mb_width_) * 2 * mb_height_ * 2);
+        job.coeff_counts_.resize(static_cast<size_t>(mb_width_) * 4 * mb_height_ * 4);
+        job.deblocking_ = job.slices_[0].deblocking;
+        // The macroblock info also feeds motion vector prediction
+        job.deblocking_filter_.configure(width_, height_);
+        if (job.deblocking_) {
+            job.deblocking_filter_.set_offsets(job.slices_[0].alpha_offset, job.slices_[0].beta_offset);
+        }
+        job.picture_ = reference_pool_->acquire();
+        job.picture_->picture_order = frame_count_;
+        job.picture_->is_keyframe = job.slices_[0].idr;
+        job.picture_->begin_decoding();
+
+        dpb_.push(job.picture_);
+        frame_count_++;
+        return true;
+
+    } catch (const std::exception& e) {
+        std::cerr << "Decoding error: " << e.what() << std::endl;
+        job.release();
+        return false;
+    }
+}
+
+bool H264Decoder::decode_prepared(PictureJob& job) {
+    if (!job.picture_) {
+        return false; // prepare_picture() failed
+    }
+
+    bool ok = true;
+    try {
+        decode_slices(job);
+    } catch (const std::exception& e) {
+        std::cerr << "Decoding error: " << e.what() << std::endl;
+        ok = false;
+    }
+
+    // Also after an error: later pictures may be waiting on these rows
+    job.picture_->finish_decoding();
+    return ok;
+}
+
+bool H264Decoder::decode_nal_unit(const uint8_t* nal, size_t size, PictureJob& job) {
+    // NAL header: forbidden_zero_bit, nal_ref_idc, nal_unit_type
+    if (nal[0] & 0x80) {
+        throw std::runtime_error("forbidden_zero_bit set");
+    }
+    const uint8_t nal_unit_type = nal[0] & 0x1F;
+
+    if (nal_unit_type == 7) { // SPS
+        unescape_rbsp(nal + 1, size - 1, parameter_set_rbsp_);
+        utils::BitstreamReader reader(parameter_set_rbsp_.data(), parameter_set_rbsp_.size());
+        return parse_sequence_parameter_set(reader);
+    }
+    if (nal_unit_type == 8) { // PPS
+        unescape_rbsp(nal + 1, size - 1, parameter_set_rbsp_);
+        utils::BitstreamReader reader(parameter_set_rbsp_.data(), parameter_set_rbsp_.size());
+        return parse_picture_parameter_set(reader);
+    }
+
+    if (nal_unit_type != 1 && nal_unit_type != 5) {
+        return true; // Other NAL units carry nothing this decoder needs
+    }
+    if (!sps_valid_ || !pps_valid_) {
+        std::cerr << "H264Decoder: slice before SPS / PPS" << std::endl;
+        return false;
+    }
+
+    if (job.slices_.size() <= job.slice_count_) {
+        job.slices_.emplace_back();
+    }
+    Slice& slice = job.slices_[job.slice_count_++];
+    unescape_rbsp(nal + 1, size - 1, slice.rbsp);
+    slice.reader = utils::BitstreamReader(slice.rbsp.data(), slice.rbsp.size());
+    slice.idr = nal_unit_type == 5;
+    parse_slice_header(slice);
+    return true;
+}
+
+bool H264Decoder::parse_sequence_parameter_set(utils::BitstreamReader& reader) {
+    const uint32_t profile_idc = reader.read_bits(8);
+    reader.read_bits(8); // constraint_set flags, reserved_zero_bits
+    reader.read_bits(8); // level_idc
+    reader.read_ue(); // seq_parameter_set_id
+
+    if (profile_idc != 66 && profile_idc != 77) {
+        std::cerr << "H264Decoder: unsupported profile " << profile_idc << std::endl;
+        return false;
+    }
+
+    reader.read_ue(); // log2_max_frame_num_minus4
+    const uint32_t pic_order_cnt_type = reader.read_ue();
+    if (pic_order_cnt_type != 2) {
+        std::cerr << "H264Decoder: unsupported pic_order_cnt_type " << pic_order_cnt_type << std::endl;
+        return false;
+    }
+
+    const uint32_t max_num_ref_frames = reader.read_ue();
+    reader.read_bit(); // gaps_in_frame_num_value_allowed_flag
+    const uint32_t mb_width = reader.read_ue() + 1;
+    const uint32_t mb_height = reader.read_ue() + 1;
+    if (!reader.read_bit()) { // frame_mbs_only_flag
+        std::cerr << "H264Decoder: interlaced streams are not supported" << std::endl;
+        return false;
+    }
+    reader.read_bit(); // direct_8x8_inference_flag
+
+    uint32_t crop_left = 0, crop_right = 0, crop_top = 0, crop_bottom = 0;
+    if (reader.read_bit()) { // frame_cropping_flag
+        crop_left = reader.read_ue();
+        crop_right = reader.read_ue();
+        crop_top = reader.read_ue();
+        crop_bottom = reader.read_ue();
+    }
+    if (crop_left || crop_top || 2 * crop_right >= mb_width * 16 || 2 * crop_bottom >= mb_height * 16 ||
+        mb_width > 1024 || mb_height > 1024) {
+        std::cerr << "H264Decoder: unsupported picture size" << std::endl;
+        return false;
+    }
+
+    const uint32_t width = mb_width * 16 - 2 * crop_right;
+    const uint32_t height = mb_height * 16 - 2 * crop_bottom;
+    if (width != width_ || height != height_) {
+        // New resolution: previous pictures cannot be references any more
+        dpb_.clear();
+    }
+
+    width_ = width;
+    height_ = height;
+    mb_width_ = mb_width;
+    mb_height_ = mb_height;
+    max_reference_frames_ = std::max(1u, std::min(16u, max_num_ref_frames));
+    dpb_.set_max_references(max_reference_frames_);
+
+    if (!reference_pool_ || reference_pool_->width() != width_ || reference_pool_->height() != height_) {
+        reference_pool_ = ReferencePicturePool::create(width_, height_);
+    }
+    sps_valid_ = true;
+    return true;
+}
+
+bool H264Decoder::parse_picture_parameter_set(utils::BitstreamReader& reader) {
+    reader.read_ue(); // pic_parameter_set_id
+    reader.read_ue(); // seq_parameter_set_id
+    if (reader.read_bit()) { // entropy_coding_mode_flag
+        std::cerr << "H264Decoder: CABAC is not supported" << std::endl;
+        return false;
+    }
+    reader.read_bit(); // bottom_field_pic_order_in_frame_present_flag
+    if (reader.read_ue() != 0) { // num_slice_groups_minus1
+        std::cerr << "H264Decoder: slice groups are not supported" << std::endl;
+        return false;
+    }
+
+    const uint32_t num_ref_idx_default = reader.read_ue() + 1; // num_ref_idx_l0_default_active_minus1
+    reader.read_ue(); // num_ref_idx_l1_default_active_minus1
+    const bool weighted_pred = reader.read_bit(); // weighted_pred_flag
+    reader.read_bits(2); // weighted_bipred_idc (no B slices)
+    const int pic_init_qp = 26 + reader.read_se(); // pic_init_qp_minus26
+    reader.read_se(); // pic_init_qs_minus26
+    reader.read_se(); // chroma_qp_index_offset (luma only)
+    const bool deblocking_control_present = reader.read_bit(); // deblocking_filter_control_present_flag
+    reader.read_bit(); // constrained_intra_pred_flag
+    const bool redundant_pic_cnt_present = reader.read_bit(); // redundant_pic_cnt_present_flag
+
+    if (weighted_pred || redundant_pic_cnt_present || num_ref_idx_default > 16 ||
+        pic_init_qp < 0 || pic_init_qp > 51) {
+        std::cerr << "H264Decoder: unsupported picture parameter set" << std::endl;
+        return false;
+    }
+
+    num_ref_idx_default_ = num_ref_idx_default;
+    pic_init_qp_ = pic_init_qp;
+    deblocking_control_present_ = deblocking_control_present;
+    pps_valid_ = true;
+    return true;
+}
+
+void H264Decoder::parse_slice_header(Slice& slice) {
+    utils::BitstreamReader& reader = slice.reader;
+
+    slice.first_mb = reader.read_ue(); // first_mb_in_slice
+    const uint32_t slice_type = reader.read_ue() % 5; // 0=P, 2=I (5..9 = same type for all slices)
+    if (slice_type != 0 && slice_type != 2) {
+        throw std::runtime_error("Unsupported slice type");
+    }
+    slice.intra = slice_type == 2;
+    if (slice.idr && !slice.intra) {
+        throw std::runtime_error("IDR picture with a P slice");
+    }
+
+    reader.read_ue(); // pic_parameter_set_id
+    reader.read_se(); // frame_num
+
+    slice.num_ref_idx_active = num_ref_idx_default_;
+    if (slice.idr) {
+        reader.read_ue(); // idr_pic_id
+    } else if (reader.read_bit()) { // num_ref_idx_active_override_flag
+        slice.num_ref_idx_active = reader.read_ue() + 1;
+        if (slice.num_ref_idx_active > 16) {
+            throw std::runtime_error("Invalid num_ref_idx_l0_active_minus1");
+        }
+    }
+
+    slice.qp = pic_init_qp_ + reader.read_se(); // slice_qp_delta
+    if (slice.qp < 0 || slice.qp > 51) {
+        throw std::runtime_error("Invalid slice QP");
+    }
+
+    slice.deblocking = true;
+    slice.alpha_offset = slice.beta_offset = 0;
+    if (deblocking_control_present_) {
+        const uint32_t idc = reader.read_ue(); // disable_deblocking_filter_idc
+        if (idc > 2) {
+            throw std::runtime_error("Invalid disable_deblocking_filter_idc");
+        }
+        if (idc == 2) {
+            throw std::runtime_error("Deblocking inside slices only is not supported");
+        }
+        slice.deblocking = idc == 0;
+        if (slice.deblocking) {
+            const int alpha_offset_div2 = reader.read_se(); // slice_alpha_c0_offset_div2
+            const int beta_offset_div2 = reader.read_se(); // slice_beta_offset_div2
+            if (alpha_offset_div2 < -6 || alpha_offset_div2 > 6 || beta_offset_div2 < -6 || beta_offset_div2 > 6) {
+                throw std::runtime_error("Invalid deblocking filter offsets");
+            }
+            slice.alpha_offset = alpha_offset_div2 * 2;
+            slice.beta_offset = beta_offset_div2 * 2;
+        }
+    }
+}
+
+void H264Decoder::decode_slices(PictureJob& job) {
+    if (!thread_pool_ || job.slice_count_ == 1) {
+        for (size_t s = 0; s < job.slice_count_; ++s) {
+            decode_slice_data(job, job.slices_[s], true);
+        }
+        return;
+    }
+
+    // Slices write disjoint macroblocks and only read references. Rows complete out of
+    // order, so progress is reported once the picture is done.
+    job.futures_.clear();
+    job.futures_.reserve(job.slice_count_);
+    for (size_t s = 0; s < job.slice_count_; ++s) {
+        job.futures_.push_back(thread_pool_->enqueue([this, &job, s]() {
+            decode_slice_data(job, job.slices_[s], false);
+        }));
+    }
+
+    // Wait for every task before rethrowing, the slices reference this picture
+    std::exception_ptr error;
+    for (auto& future : job.futures_) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!error) error = std::current_exception();
+        }
+    }
+    job.futures_.clear();
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    // Filtered once every slice is done, the progress is only reported at the end
+    if (job.deblocking_) {
+        const ReferencePicture::Plane& luma = job.picture_->plane(ReferencePicture::Y);
+        for (uint32_t mb_y = 0; mb_y < job.deblocking_filter_.mb_height(); ++mb_y) {
+            job.deblocking_filter_.filter_row(luma.origin, luma.stride, mb_y);
+        }
+    }
+}
+
+void H264Decoder::decode_slice_data(PictureJob& job, Slice& slice, bool report_progress) {
+    // mb_qp_delta is relative to the previous coded macroblock of the slice. P slices
+    // put an mb_skip_run before every coded macroblock.
+    int qp = slice.qp;
+    uint32_t skip_run = 0;
+    bool skip_run_read = false;
+    for (uint32_t mb = slice.first_mb; mb < slice.end_mb; ++mb) {
+        const uint32_t mb_y = mb / job.mb_width_;
+        if (!slice.intra && !skip_run_read) {
+            skip_run = slice.reader.read_ue(); // mb_skip_run
+            if (skip_run > slice.end_mb - mb) {
+                throw std::runtime_error("Invalid mb_skip_run");
+            }
+            skip_run_read = true;
+        }
+        if (skip_run > 0) {
+            decode_skipped_macroblock(job, slice, mb % job.mb_width_, mb_y, qp);
+            skip_run--;
+        } else {
+            decode_macroblock(job, slice.reader, slice, mb % job.mb_width_, mb_y, qp);
+            skip_run_read = false;
+        }
+
+        // Slices are decoded in order, so the last macroblock of a row completes it. Intra
+        // prediction of this row read the unfiltered row above, which is deblocked now;
+        // filtering this row will still change its last rows.
+        if (report_progress && mb % job.mb_width_ == job.mb_width_ - 1) {
+            int rows = static_cast<int>((mb_y + 1) * 16);
+            if (job.deblocking_) {
+                const ReferencePicture::Plane& luma = job.picture_->plane(ReferencePicture::Y);
+                const uint32_t mb_height = job.deblocking_filter_.mb_height();
+                if (mb_y > 0) {
+                    job.deblocking_filter_.filter_row(luma.origin, luma.stride, mb_y - 1);
+                }
+                if (mb_y + 1 == mb_height) {
+                    job.deblocking_filter_.filter_row(luma.origin, luma.stride, mb_y);
+                } else {
+                    rows -= 16 + processing::H264DeblockingFilter::ROWS_CHANGED_BELOW;
+                }
+            }
+            job.picture_->report_rows(rows);
+        }
+    }
+}
+
+void H264Decoder::decode_macroblock(PictureJob& job, utils::BitstreamReader& reader, const Slice& slice,
+                                    uint32_t mb_x, uint32_t mb_y, int& qp) {
+    const ReferencePicture::Plane& luma = job.picture_->plane(ReferencePicture::Y);
+    const int x0 = static_cast<int>(mb_x * 16);
+    const int y0 = static_cast<int>(mb_y * 16);
+    const int visible_w = std::min(16, static_cast<int>(job.width_) - x0);
+    const int visible_h = std::min(16, static_cast<int>(job.height_) - y0);
+
+    auto read_qp_delta = [&]() {
+        qp += reader.read_se(); // mb_qp_delta
+        if (qp < 0 || qp > 51) {
+            throw std::runtime_error("Invalid mb_qp_delta");
+        }
+    };
+
+    // Same description of the macroblock as H264Encoder gives its filter, also the motion
+    // the next macroblocks predict from
+    processing::H264DeblockingFilter::MacroblockInfo& info = job.deblocking_filter_.info(mb_x, mb_y);
+
+    Block8x8 block;
+    const uint32_t mb_type = reader.read_ue();
+
+    // I slices: 0 = I_NxN (Intra_8x8), 1..4 = I_16x16 by prediction mode; P slices put
+    // the same types after P_L0_16x16 .. P_8x8ref0
+    if (slice.intra || mb_type >= 5) {
+        const uint32_t intra_type = slice.intra ? mb_type : mb_type - 5;
+        if (intra_type > processing::H264_INTRA_16X16_MODES) {
+            throw std::runtime_error("Unsupported macroblock type");
+        }
+        decode_intra_macroblock(job, reader, slice, mb_x, mb_y, intra_type, qp);
+        return;
+    }
+
+    // Inter macroblocks count as DC for the Intra_8x8 mode prediction
+    const size_t modes_stride = static_cast<size_t>(job.mb_width_) * 2;
+    uint8_t* modes = job.intra_modes_.data() + mb_y * 2 * modes_stride + mb_x * 2;
+    modes[0] = modes[1] = modes[modes_stride] = modes[modes_stride + 1] = processing::H264_INTRA_DC;
+
+    if (mb_type != 0) {
+        throw std::runtime_error("Unsupported macroblock type");
+    }
+
+    // P_L0_16x16: ref_idx is te(v), absent with a single reference
+    uint32_t ref_idx = 0;
+    if (slice.num_ref_idx_active == 2) {
+        ref_idx = reader.read_bit() ? 0 : 1;
+    } else if (slice.num_ref_idx_active > 2) {
+        ref_idx = reader.read_ue();
+    }
+    if (ref_idx >= slice.num_ref_idx_active) {
+        throw std::runtime_error("Invalid ref_idx");
+    }
+
+    processing::H264NeighbourMotion left, above, corner;
+    neighbour_motion(job.deblocking_filter_, intra_neighbours(job, slice, mb_x, mb_y), mb_x, mb_y,
+                     left, above, corner);
+    int mv_x = 0, mv_y = 0;
+    processing::h264_predict_mv(left, above, corner, static_cast<int>(ref_idx), mv_x, mv_y);
+    mv_x += reader.read_se(); // mvd_l0, quarter-pel
+    mv_y += reader.read_se();
+    read_qp_delta();
+    if (mv_x < INT16_MIN || mv_x > INT16_MAX || mv_y < INT16_MIN || mv_y > INT16_MAX) {
+        throw std::runtime_error("Invalid motion vector");
+    }
+
+    info = processing::H264DeblockingFilter::MacroblockInfo{};
+    info.qp = static_cast<int8_t>(qp);
+    info.intra = false;
+    info.ref_idx = static_cast<int8_t>(ref_idx);
+    info.mv_x = static_cast<int16_t>(mv_x);
+    info.mv_y = static_cast<int16_t>(mv_y);
+
+    // The reference may still be decoding (frame threading): wait for the last row the
+    // 6-tap filter reads, 16 + 3 rows below the integer position
+    const ReferencePicture& reference = *job.references_[ref_idx];
+    reference.wait_rows(std::max(1, y0 + (mv_y >> 2) + 20));
+
+    alignas(32) std::array<uint8_t, 256> prediction;
+    reference.predict_luma(processing::SubpelFilterType::H264_6TAP, x0 * 4 + mv_x, y0 * 4 + mv_y,
+                             16, 16, prediction.data(), 16);
+
+    // Transformed residual on top of the prediction, as in intra macroblocks
+    const processing::CAVLCCoeffCounts counts = coeff_counts(job, slice, mb_x, mb_y);
+    uint8_t* origin = luma.row(y0) + x0;
+    for (int b = 0; b < 4; ++b) {
+        const int bx = b & 1, by = b >> 1;
+        const int total_coeff = cavlc_decoder_->decode_residual(reader, block, counts, b);
+        info.coded |= static_cast<uint8_t>(total_coeff != 0) << b;
+        reconstruct_block(block, qp, prediction.data() + by * 8 * 16 + bx * 8, 16,
+                          origin + by * 8 * luma.stride + bx * 8, luma.stride,
+                          std::clamp(visible_w - bx * 8, 0, 8), std::clamp(visible_h - by * 8, 0, 8));
+    }
+}
+
+void H264Decoder::decode_skipped_macroblock(PictureJob& job, const Slice& slice, uint32_t mb_x, uint32_t mb_y,
+                                            int qp) {
+    const ReferencePicture::Plane& luma = job.picture_->plane(ReferencePicture::Y);
+    const int x0 = static_cast<int>(mb_x * 16);
+    const int y0 = static_cast<int>(mb_y * 16);
+    const int visible_w = std::min(16, static_cast<int>(job.width_) - x0);
+    const int visible_h = std::min(16, static_cast<int>(job.height_) - y0);
+
+    const size_t modes_stride = static_cast<size_t>(job.mb_width_) * 2;
+    uint8_t* modes = job.intra_modes_.data() + mb_y * 2 * modes_stride + mb_x * 2;
+    modes[0] = modes[1] = modes[modes_stride] = modes[modes_stride + 1] = processing::H264_INTRA_DC;
+
+    // P_Skip: reference 0 at the predicted motion, no residual
+    processing::H264NeighbourMotion left, above, corner;
+    neighbour_motion(job.deblocking_filter_, intra_neighbours(job, slice, mb_x, mb_y), mb_x, mb_y,
+                     left, above, corner);
+    int mv_x = 0, mv_y = 0;
+    processing::h264_skip_mv(left, above, corner, mv_x, mv_y);
+
+    const ReferencePicture& reference = *job.references_[0];
+    reference.wait_rows(std::max(1, y0 + (mv_y >> 2) + 20));
+
+    alignas(32) std::array<uint8_t, 256> prediction;
+    reference.predict_luma(processing::SubpelFilterType::H264_6TAP, x0 * 4 + mv_x, y0 * 4 + mv_y,
+                             16, 16, prediction.data(), 16);
+    uint8_t* origin = luma.row(y0) + x0;
+    for (int y = 0; y < visible_h; ++y) {
+        std::memcpy(origin + y * luma.stride, prediction.data() + y * 16, static_cast<size_t>(visible_w));
+    }
+
+    const processing::CAVLCCoeffCounts counts = coeff_counts(job, slice, mb_x, mb_y);
+    for (int y4 = 0; y4 < 4; ++y4) {
+        for (int x4 = 0; x4 < 4; ++x4) {
+            counts.at(x4, y4) = 0;
+        }
+    }
+
+    // The QP of a skipped macroblock is the running one, as far as the filter cares
+    processing::H264DeblockingFilter::MacroblockInfo& info = job.deblocking_filter_.info(mb_x, mb_y);
+    info = processing::H264DeblockingFilter::MacroblockInfo{};
+    info.qp = static_cast<int8_t>(qp);
+    info.intra = false;
+    info.ref_idx = 0;
+    info.mv_x = static_cast<int16_t>(mv_x);
+    info.mv_y = static_cast<int16_t>(mv_y);
+}
+
+void H264Decoder::decode_intra_macroblock(PictureJob& job, utils::BitstreamReader& reader, const Slice& slice,
+                                          uint32_t mb_x, uint32_t mb_y, uint32_t intra_type, int& qp) {
+    const ReferencePicture::Plane& luma = job.picture_->plane(ReferencePicture::Y);
+    const int x0 = static_cast<int>(mb_x * 16);
+    const int y0 = static_cast<int>(mb_y * 16);
+    const int visible_w = static_cast<int>(job.width_) - x0;
+    const int visible_h = static_cast<int>(job.height_) - y0;
+    uint8_t* origin = luma.row(y0) + x0;
+
+    const processing::H264IntraNeighbours neighbours = intra_neighbours(job, slice, mb_x, mb_y);
+
+    const size_t modes_stride = static_cast<size_t>(job.mb_width_) * 2;
+    uint8_t* modes = job.intra_modes_.data() + mb_y * 2 * modes_stride + mb_x * 2;
+    std::array<uint8_t, 4> modes_8x8;
+    modes_8x8.fill(processing::H264_INTRA_DC);
+    if (intra_type == 0) {
+        for (int b = 0; b < 4; ++b) {
+            const int bx = b & 1, by = b >> 1;
+            const int left = bx ? modes_8x8[b - 1] : (neighbours.left ? modes[by * modes_stride - 1] : -1);
+            const int above = by ? modes_8x8[b - 2] : (neighbours.above ? modes[bx - modes_stride] : -1);
+            const int predicted_mode = processing::h264_predicted_8x8_mode(left, above);
+            if (reader.read_bit()) { // prev_intra8x8_pred_mode_flag
+                modes_8x8[b] = static_cast<uint8_t>(predicted_mode);
+            } else {
+                const int remaining = static_cast<int>(reader.read_bits(3)); // rem_intra8x8_pred_mode
+                modes_8x8[b] = static_cast<uint8_t>(remaining < predicted_mode ? remaining : remaining + 1);
+            }
+        }
+    }
+    for (int b = 0; b < 4; ++b) {
+        modes[(b >> 1) * modes_stride + (b & 1)] = modes_8x8[b];
+    }
+
+    qp += reader.read_se(); // mb_qp_delta
+    if (qp < 0 || qp > 51) {
+        throw std::runtime_error("Invalid mb_qp_delta");
+    }
+
+    processing::H264DeblockingFilter::MacroblockInfo& info = job.deblocking_filter_.info(mb_x, mb_y);
+    info = processing::H264DeblockingFilter::MacroblockInfo{};
+    info.qp = static_cast<int8_t>(qp);
+
+    processing::IntraEdges edges;
+    alignas(32) std::array<uint8_t, 256> prediction;
+    if (intra_type > 0) {
+        processing::load_h264_edges(edges, origin, luma.stride, neighbours, -1, visible_w, visible_h);
+        const int mode = static_cast<int>(intra_type) - 1;
+        if (!processing::h264_16x16_mode_available(edges, mode)) {
+            throw std::runtime_error("Intra_16x16 prediction mode without its neighbours");
+        }
+        processing::predict_h264_16x16(edges, mode, prediction.data(), 16);
+    }
+
+    Block8x8 block;
+    const processing::CAVLCCoeffCounts counts = coeff_counts(job, slice, mb_x, mb_y);
+    for (int b = 0; b < 4; ++b) {
+        const int bx = b & 1, by = b >> 1;
+        const uint8_t* block_prediction = prediction.data() + by * 8 * 16 + bx * 8;
+        if (intra_type == 0) {
+            // Each block predicts from the reconstruction of the ones before it
+            processing::load_h264_edges(edges, origin, luma.stride, neighbours, b, visible_w, visible_h);
+            if (!processing::h264_8x8_mode_available(edges, modes_8x8[b])) {
+                throw std::runtime_error("Intra_8x8 prediction mode without its neighbours");
+            }
+            processing::h264_filter_edges_8x8(edges);
+            processing::predict_h264_8x8(edges, modes_8x8[b], prediction.data(), 16);
+            block_prediction = prediction.data();
+        }
+
+        const int total_coeff = cavlc_decoder_->decode_residual(reader, block, counts, b);
+        info.coded |= static_cast<uint8_t>(total_coeff != 0) << b;
+        reconstruct_block(block, qp, block_prediction, 16, origin + by * 8 * luma.stride + bx * 8, luma.stride,
+                          std::clamp(visible_w - bx * 8, 0, 8), std::clamp(visible_h - by * 8, 0, 8));
+    }
+}
+
+processing::H264IntraNeighbours H264Decoder::intra_neighbours(const PictureJob& job, const Slice& slice,
+                                                             uint32_t mb_x, uint32_t mb_y) {
+    // Neighbours in the slice (addresses at or after first_mb) are decoded already
+    const uint32_t mb = mb_y * job.mb_width_ + mb_x;
+    processing::H264IntraNeighbours neighbours;
+    neighbours.left = mb_x > 0 && mb - 1 >= slice.first_mb;
+    neighbours.above = mb_y > 0 && mb - job.mb_width_ >= slice.first_mb;
+    neighbours.above_right = mb_y > 0 && mb_x + 1 < job.mb_width_ && mb - job.mb_width_ + 1 >= slice.first_mb;
+    neighbours.above_left = mb_y > 0 && mb_x > 0 && mb - job.mb_width_ - 1 >= slice.first_mb;
+    return neighbours;
+}
+
+processing::CAVLCCoeffCounts H264Decoder::coeff_counts(PictureJob& job, const Slice& slice, uint32_t mb_x,
+                                                       uint32_t mb_y) {
+    const uint32_t mb = mb_y * job.mb_width_ + mb_x;
+    processing::CAVLCCoeffCounts counts;
+    counts.stride = static_cast<ptrdiff_t>(job.mb_width_) * 4;
+    counts.counts = job.coeff_counts_.data() + mb_y * 4 * counts.stride + mb_x * 4;
+    counts.left_available = mb_x > 0 && mb - 1 >= slice.first_mb;
+    counts.above_available = mb_y > 0 && mb - job.mb_width_ >= slice.first_mb;
+    return counts;
+}
+
+void H264Decoder::reconstruct_block(const Block8x8& coefficients, int qp, const uint8_t* prediction,
+                                    int prediction_stride, uint8_t* dst, int stride, int w, int h) {
+    // Dequantize and inverse DCT exactly like H264Encoder's reconstruction
+    std::array<std::array<double, 8>, 8> dct_coeffs;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            dct_coeffs[i][j] = coefficients[i][j];
+        }
+    }
+    quantizer_->dequantize_block(dct_coeffs, qp);
+
+    Block8x8 residual;
+    dct_->inverse_dct(dct_coeffs, residual);
+
+    for (int y = 0; y < h; ++y) {
+        uint8_t* out = dst + static_cast<ptrdiff_t>(y) * stride;
+        for (int x = 0; x < w; ++x) {
+            out[x] = static_cast<uint8_t>(std::clamp(prediction[y * prediction_stride + x] + residual[y][x], 0, 255));
+        }
+    }
+}
+
+} // namespace codec
+} // namespace streaming
@@ -4,29 +4,106 @@
 #include "streaming/processing/quantization.hpp"
 #include "streaming/processing/cavlc_encoder.hpp"
 #include "streaming/processing/motion_estimation.hpp"
+#include "streaming/performance/profiler.hpp"
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <exception>
 
 namespace streaming {
 namespace codec {
 
+namespace {
+
+// Length of ue(v) for value
+int ue_bits(uint32_t value) {
+    int bits = 1;
+    for (uint32_t v = value + 1; v > 1; v >>= 1) {
+        bits += 2;
+    }
+    return bits;
+}
+
+// Motion of the left (a), above (b) and above-right (c, the above-left when the
+// above-right is not available) macroblocks as recorded for the deblocking filter
+// (same as H264Decoder)
+void neighbour_motion(const processing::H264DeblockingFilter& filter, const processing::H264IntraNeighbours& neighbours,
+                      uint32_t mb_x, uint32_t mb_y, processing::H264NeighbourMotion& a,
+                      processing::H264NeighbourMotion& b, processing::H264NeighbourMotion& c) {
+    auto motion = [&](bool available, uint32_t x, uint32_t y) {
+        processing::H264NeighbourMotion result;
+        result.available = available;
+        if (available && !filter.info(x, y).intra) {
+            const auto& info = filter.info(x, y);
+            result.ref_idx = info.ref_idx;
+            result.mv_x = info.mv_x;
+            result.mv_y = info.mv_y;
+        }
+        return result;
+    };
+    a = motion(neighbours.left, mb_x - 1, mb_y);
+    b = motion(neighbours.above, mb_x, mb_y - 1);
+    c = neighbours.above_right ? motion(true, mb_x + 1, mb_y - 1) : motion(neighbours.above_left, mb_x - 1, mb_y - 1);
+}
+
+} // namespace
+
 H264Encoder::H264Encoder() 
     : dct_(std::make_unique<processing::DCT>())
     , quantizer_(std::make_unique<processing::Quantizer>())
     , cavlc_encoder_(std::make_unique<processing::CAVLCEncoder>()) {}
 
+H264Encoder::~H264Encoder() = default;
+
 bool H264Encoder::initialize(uint32_t width, uint32_t height, uint32_t fps, uint32_t bitrate) {
+    // SPS cropping is in 2-sample units (4:2:0): an odd size would decode one sample
+    // larger than the encoder's reconstruction, and the two would drift apart
+    if (width == 0 || height == 0 || (width % 2) != 0 || (height % 2) != 0) {
+        std::cerr << "❌ H264Encoder: " << width << "x" << height
+                  << " is not supported, width and height must be even" << std::endl;
+        return false;
+    }
+    
     width_ = width;
     height_ = height;
     fps_ = fps;
     bitrate_ = bitrate;
     frame_count_ = 0;
+    last_keyframe_ = 0;
     
-    // Calculate target bits per frame
-    target_bits_per_frame_ = bitrate / fps;
+    // Frame QPs come from the rate controller (CBR at the target bitrate unless configured)
+    RateControlConfig rc_config = rate_control_.config();
+    rc_config.bitrate = bitrate;
+    rc_config.fps = fps;
+    rate_control_.configure(rc_config);
     
-    // Initialize reference frames buffer
-    reference_frames_.resize(width * height * 1.5); // YUV420
+    // Reference pictures come from a pool that may be shared with other encoders
+    if (!reference_pool_ || reference_pool_->width() != width || reference_pool_->height() != height) {
+        reference_pool_ = ReferencePicturePool::create(width, height);
+    }
+    dpb_.set_max_references(max_reference_frames_);
+    dpb_.clear();
+    reconstruction_.reset();
+    intra_refresh_.set_geometry(width, 16);
+    
+    const uint32_t mb_height = (height + 15) / 16;
+    row_writers_.assign(mb_height, utils::BitstreamWriter());
+    row_progress_ = std::make_unique<std::atomic<uint32_t>[]>(mb_height);
+    deblocking_filter_.configure(width, height);
+    intra_modes_.assign(static_cast<size_t>((width + 15) / 16) * 2 * mb_height * 2, processing::H264_INTRA_DC);
+    coeff_counts_.assign(static_cast<size_t>((width + 15) / 16) * 4 * mb_height * 4, 0);
+    intra_modes_evaluated_.store(0, std::memory_order_relaxed);
+    
+    // What reset() returns to
+    initial_settings_.gop_size = gop_size_;
+    initial_settings_.intra_refresh_period = intra_refresh_.period();
+    initial_settings_.rate_control = rate_control_.config();
+    initial_settings_.subpel_refinement = subpel_refinement_;
+    initial_settings_.max_reference_frames = max_reference_frames_;
+    initial_settings_.slice_count = slice_count_;
+    initial_settings_.wavefront = wavefront_;
+    initial_settings_.deblocking = deblocking_;
+    initial_settings_.intra_time_budget = intra_time_budget_;
     
     std::cout << "🚀 H264Encoder initialized: " << width << "x" << height 
               << " @" << fps << "fps, " << bitrate << "bps" << std::endl;
@@ -35,15 +112,36 @@ bool H264Encoder::initialize(uint32_t width, uint32_t height, uint32_t fps, uint
 }
 
 bool H264Encoder::encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) {
-    utils::BitstreamWriter writer;
-    
+    return encode_frame(FrameView::from(input), output);
+}
+
+bool H264Encoder::encode_frame(const FrameView& input, std::vector<uint8_t>& output) {
     try {
+        // Frame type and QP from the rate controller (keyframes every GOP, on request and
+        // at scene cuts; with intra refresh only on request); the coded size is fed back below
+        const bool keyframe_due = frame_count_ == 0 || input.keyframe ||
+                                  (!intra_refresh_.enabled() && frame_count_ - last_keyframe_ >= gop_size_);
+        {
+            PROFILE_SCOPE("RateControl"); // Lookahead, scene cut and AQ analysis included
+            current_qp_ = rate_control_.begin_frame(input, keyframe_due);
+        }
+        is_keyframe_ = rate_control_.is_keyframe();
+        recovery_point_ = false;
+        if (is_keyframe_) {
+            last_keyframe_ = frame_count_;
+            intra_refresh_.restart();
+        } else {
+            recovery_point_ = intra_refresh_.begin_frame();
+        }
+        
         // Encode NAL unit
-        if (!encode_nal_unit(input, writer)) {
+        writer_.clear();
+        if (!encode_nal_unit(input, writer_)) {
             return false;
         }
         
-        output = writer.get_data();
+        writer_.swap_data(output);
+        rate_control_.end_frame(output.size());
         frame_count_++;
         
         return true;
@@ -54,118 +152,702 @@ bool H264Encoder::encode_frame(const VideoFrame& input, std::vector<uint8_t>& ou
     }
 }
 
-bool H264Encoder::encode_nal_unit(const VideoFrame& frame, utils::BitstreamWriter& writer) {
-    // NAL unit start code
-    writer.write_bits(0x00000001, 32);
-    
-    // NAL header
+bool H264Encoder::encode_nal_unit(const FrameView& frame, utils::BitstreamWriter& writer) {
+    // NAL header fields
     bool forbidden_zero_bit = false;
-    uint8_t nal_ref_idc = (frame_count_ % gop_size_ == 0) ? 3 : 2;
-    uint8_t nal_unit_type = (frame_count_ % gop_size_ == 0) ? 5 : 1; // I-frame or P-frame
+    uint8_t nal_unit_type = is_keyframe_ ? 5 : 1; // I-frame or P-frame
     
-    writer.write_bit(forbidden_zero_bit);
-    writer.write_bits(nal_ref_idc, 2);
-    writer.write_bits(nal_unit_type, 5);
+    // IDR pictures may not reference anything that came before them
+    if (nal_unit_type == 5) {
+        dpb_.clear();
+    }
     
-    // Slice header
-    encode_slice_header(writer, nal_unit_type);
+    // Macroblocks are reconstructed into a pooled picture
+    reconstruction_ = reference_pool_->acquire();
+    reconstruction_->picture_order = frame_count_;
+    reconstruction_->is_keyframe = (nal_unit_type == 5);
+    
+    // Half-pel planes are built lazily; do it here, before rows run concurrently
+    if (nal_unit_type != 5 && subpel_refinement_) {
+        PROFILE_SCOPE("References");
+        for (size_t i = 0; i < dpb_.size(); ++i) {
+            dpb_.get(i)->subpel_planes(processing::SubpelFilterType::H264_6TAP);
+        }
+    }
+    
+    // Slices cover whole macroblock rows
+    const uint32_t mb_height = (height_ + 15) / 16;
+    const uint32_t slice_count = std::max(1u, std::min(slice_count_, mb_height));
+    
+    slice_first_rows_.resize(slice_count + 1);
+    for (uint32_t s = 0; s <= slice_count; ++s) {
+        slice_first_rows_[s] = s * mb_height / slice_count;
+    }
     
-    // Encode slice data
-    encode_slice_data(writer, frame, nal_unit_type);
+    // Every IDR is preceded by the SPS and PPS, so decoding can start at any keyframe
+    slice_output_bytes_ = 0;
+    if (nal_unit_type == 5) {
+        nal_writer_.clear();
+        nal_writer_.write_bit(forbidden_zero_bit);
+        nal_writer_.write_bits(3, 2); // nal_ref_idc
+        nal_writer_.write_bits(7, 5); // nal_unit_type: SPS
+        encode_sequence_parameter_set(nal_writer_);
+        nal_writer_.write_trailing_bits();
+        
+        writer.write_bits(0x00000001, 32);
+        writer.append_escaped(nal_writer_);
+        
+        nal_writer_.clear();
+        nal_writer_.write_bit(forbidden_zero_bit);
+        nal_writer_.write_bits(3, 2); // nal_ref_idc
+        nal_writer_.write_bits(8, 5); // nal_unit_type: PPS
+        encode_picture_parameter_set(nal_writer_);
+        nal_writer_.write_trailing_bits();
+        
+        writer.write_bits(0x00000001, 32);
+        writer.append_escaped(nal_writer_);
+    }
+    if (recovery_point_) {
+        write_recovery_point(writer);
+    }
+    
+    // Every row is encoded into its own buffer; merging them in order makes the
+    // output independent of the number of threads
+    {
+        PROFILE_SCOPE("BlockCoding"); // Deblocking runs behind the rows, inside this
+        encode_slice_data(writer, frame, nal_unit_type, slice_count);
+    }
+    
+    PROFILE_SCOPE("References");
+    reconstruction_->extend_borders();
+    dpb_.push(std::move(reconstruction_));
     
     return true;
 }
 
-void H264Encoder::encode_slice_header(utils::BitstreamWriter& writer, uint8_t slice_type) {
-    writer.write_ue(0); // first_mb_in_slice
+void H264Encoder::encode_sequence_parameter_set(utils::BitstreamWriter& writer) {
+    const uint32_t mb_width = (width_ + 15) / 16;
+    const uint32_t mb_height = (height_ + 15) / 16;
+    const uint32_t frame_mbs = mb_width * mb_height;
+    
+    writer.write_bits(66, 8); // profile_idc (Baseline)
+    writer.write_bits(0xC0, 8); // constraint_set0/1_flag, reserved_zero_bits
+    writer.write_bits(frame_mbs <= 1620 ? 30 : (frame_mbs <= 8192 ? 40 : 51), 8); // level_idc
+    writer.write_ue(0); // seq_parameter_set_id
+    writer.write_ue(0); // log2_max_frame_num_minus4
+    writer.write_ue(2); // pic_order_cnt_type (output order = decoding order)
+    writer.write_ue(max_reference_frames_); // max_num_ref_frames
+    writer.write_bit(false); // gaps_in_frame_num_value_allowed_flag
+    writer.write_ue(mb_width - 1); // pic_width_in_mbs_minus1
+    writer.write_ue(mb_height - 1); // pic_height_in_map_units_minus1
+    writer.write_bit(true); // frame_mbs_only_flag
+    writer.write_bit(true); // direct_8x8_inference_flag
+    
+    // Cropping to the real size, in 2-pixel units
+    const uint32_t crop_right = (mb_width * 16 - width_) / 2;
+    const uint32_t crop_bottom = (mb_height * 16 - height_) / 2;
+    const bool cropping = crop_right || crop_bottom;
+    writer.write_bit(cropping); // frame_cropping_flag
+    if (cropping) {
+        writer.write_ue(0); // frame_crop_left_offset
+        writer.write_ue(crop_right); // frame_crop_right_offset
+        writer.write_ue(0); // frame_crop_top_offset
+        writer.write_ue(crop_bottom); // frame_crop_bottom_offset
+    }
+    writer.write_bit(false); // vui_parameters_present_flag
+}
+
+void H264Encoder::encode_picture_parameter_set(utils::BitstreamWriter& writer) {
+    writer.write_ue(0); // pic_parameter_set_id
+    writer.write_ue(0); // seq_parameter_set_id
+    writer.write_bit(false); // entropy_coding_mode_flag (CAVLC)
+    writer.write_bit(false); // bottom_field_pic_order_in_frame_present_flag
+    writer.write_ue(0); // num_slice_groups_minus1
+    writer.write_ue(0); // num_ref_idx_l0_default_active_minus1
+    writer.write_ue(0); // num_ref_idx_l1_default_active_minus1
+    writer.write_bit(false); // weighted_pred_flag
+    writer.write_bits(0, 2); // weighted_bipred_idc
+    writer.write_se(0); // pic_init_qp_minus26
+    writer.write_se(0); // pic_init_qs_minus26
+    writer.write_se(0); // chroma_qp_index_offset
+    writer.write_bit(true); // deblocking_filter_control_present_flag
+    writer.write_bit(false); // constrained_intra_pred_flag
+    writer.write_bit(false); // redundant_pic_cnt_present_flag
+}
+
+void H264Encoder::write_recovery_point(utils::BitstreamWriter& writer) {
+    utils::BitstreamWriter payload;
+    payload.write_ue(intra_refresh_.period() - 1); // recovery_frame_cnt
+    payload.write_bit(true); // exact_match_flag
+    payload.write_bit(false); // broken_link_flag
+    payload.write_bits(0, 2); // changing_slice_group_idc
+    if (payload.bit_count() % 8) {
+        payload.write_trailing_bits(); // bit_equal_to_one, then zeros to the byte boundary
+    }
+    
+    nal_writer_.clear();
+    nal_writer_.write_bit(false); // forbidden_zero_bit
+    nal_writer_.write_bits(0, 2); // nal_ref_idc
+    nal_writer_.write_bits(6, 5); // nal_unit_type: SEI
+    nal_writer_.write_bits(6, 8); // payloadType: recovery point
+    nal_writer_.write_bits(static_cast<uint32_t>(payload.bit_count() / 8), 8); // payloadSize
+    nal_writer_.append(payload);
+    nal_writer_.write_trailing_bits();
+    
+    writer.write_bits(0x00000001, 32);
+    writer.append_escaped(nal_writer_);
+}
+
+void H264Encoder::encode_slice_header(utils::BitstreamWriter& writer, uint8_t slice_type, uint32_t first_mb) {
+    writer.write_ue(first_mb); // first_mb_in_slice
     writer.write_ue(slice_type == 5 ? 2 : 0); // slice_type (0=P, 2=I)
     writer.write_ue(0); // pic_parameter_set_id
     writer.write_se(0); // frame_num
     
     if (slice_type == 5) { // IDR frame
         writer.write_ue(0); // idr_pic_id
+    } else {
+        bool override_refs = dpb_.size() > 1;
+        writer.write_bit(override_refs); // num_ref_idx_active_override_flag
+        if (override_refs) {
+            writer.write_ue(static_cast<uint32_t>(dpb_.size() - 1)); // num_ref_idx_l0_active_minus1
+        }
     }
     
-    writer.write_ue(current_qp_); // slice_qp_delta
+    writer.write_se(current_qp_ - 26); // slice_qp_delta (pic_init_qp 26)
+    
+    // Filtering across slice edges too, so slices do not show as seams
+    writer.write_ue(deblocking_ ? 0 : 1); // disable_deblocking_filter_idc
+    if (deblocking_) {
+        writer.write_se(0); // slice_alpha_c0_offset_div2
+        writer.write_se(0); // slice_beta_offset_div2
+    }
 }
 
-void H264Encoder::encode_slice_data(utils::BitstreamWriter& writer, const VideoFrame& frame, uint8_t slice_type) {
-    uint32_t mb_width = (width_ + 15) / 16;
-    uint32_t mb_height = (height_ + 15) / 16;
+void H264Encoder::write_slice(utils::BitstreamWriter& writer, uint32_t slice, uint8_t slice_type) {
+    const uint32_t mb_width = (width_ + 15) / 16;
     
-    processing::MotionEstimator motion_estimator;
+    nal_writer_.clear();
+    nal_writer_.write_bit(false); // forbidden_zero_bit
+    nal_writer_.write_bits(is_keyframe_ ? 3 : 2, 2); // nal_ref_idc
+    nal_writer_.write_bits(slice_type, 5); // nal_unit_type
+    
+    // Slice header
+    encode_slice_header(nal_writer_, slice_type, slice_first_rows_[slice] * mb_width);
     
+    for (uint32_t mb_y = slice_first_rows_[slice]; mb_y < slice_first_rows_[slice + 1]; ++mb_y) {
+        nal_writer_.append(row_writers_[mb_y]);
+    }
+    
+    // Next start code begins on a byte boundary
+    nal_writer_.write_trailing_bits();
+    
+    // NAL unit start code; the payload is escaped so it cannot contain one
+    writer.write_bits(0x00000001, 32);
+    writer.append_escaped(nal_writer_);
+    
+    // Whole bytes only: everything written so far is byte aligned
+    if (slice_output_) {
+        const std::vector<uint8_t>& data = writer.get_data();
+        slice_output_(data.data() + slice_output_bytes_, data.size() - slice_output_bytes_);
+        slice_output_bytes_ = data.size();
+    }
+}
+
+void H264Encoder::encode_slice_data(utils::BitstreamWriter& writer, const FrameView& frame, uint8_t slice_type,
+                                    uint32_t slice_count) {
+    const uint32_t mb_height = (height_ + 15) / 16;
+    const std::vector<uint32_t>& slice_first_rows = slice_first_rows_;
+    
+    // Macroblocks finished per row (wavefront dependency tracking)
+    std::atomic<uint32_t>* progress = row_progress_.get();
     for (uint32_t mb_y = 0; mb_y < mb_height; ++mb_y) {
+        row_writers_[mb_y].clear();
+        progress[mb_y].store(0, std::memory_order_relaxed);
+    }
+    deblocked_rows_ = 0;
+    
+    // The first row of a slice never waits: slices are independent
+    auto run_row = [&](uint32_t mb_y, bool first_in_slice) {
+        encode_macroblock_row(row_writers_[mb_y], frame, mb_y, slice_type,
+                              first_in_slice ? nullptr : &progress[mb_y - 1], progress[mb_y]);
+    };
+    
+    if (!thread_pool_) {
+        for (uint32_t s = 0; s < slice_count; ++s) {
+            for (uint32_t mb_y = slice_first_rows[s]; mb_y < slice_first_rows[s + 1]; ++mb_y) {
+                run_row(mb_y, mb_y == slice_first_rows[s]);
+            }
+            write_slice(writer, s, slice_type);
+        }
+        return;
+    }
+    
+    std::vector<std::future<void>>& futures = futures_;
+    futures.clear();
+    
+    if (wavefront_) {
+        // One task per row, queued top to bottom: a row only ever waits on rows
+        // queued before it, so the FIFO pool cannot deadlock
+        futures.reserve(mb_height);
+        for (uint32_t s = 0; s < slice_count; ++s) {
+            for (uint32_t mb_y = slice_first_rows[s]; mb_y < slice_first_rows[s + 1]; ++mb_y) {
+                futures.push_back(thread_pool_->enqueue(run_row, mb_y, mb_y == slice_first_rows[s]));
+            }
+        }
+    } else {
+        // One task per slice, rows in order
+        futures.reserve(slice_count);
+        for (uint32_t s = 0; s < slice_count; ++s) {
+            futures.push_back(thread_pool_->enqueue([&, s]() {
+                for (uint32_t mb_y = slice_first_rows[s]; mb_y < slice_first_rows[s + 1]; ++mb_y) {
+                    run_row(mb_y, mb_y == slice_first_rows[s]);
+                }
+            }));
+        }
+    }
+    
+    // Slices are written in order as their last task finishes. Wait for every task before
+    // rethrowing, the rows reference this frame's state.
+    std::exception_ptr error;
+    uint32_t next_slice = 0;
+    for (size_t i = 0; i < futures.size(); ++i) {
+        try {
+            futures[i].get();
+        } catch (...) {
+            if (!error) error = std::current_exception();
+        }
+        const size_t slice_end = wavefront_ ? slice_first_rows[next_slice + 1] : next_slice + 1;
+        if (i + 1 == slice_end) {
+            if (!error) write_slice(writer, next_slice, slice_type);
+            ++next_slice;
+        }
+    }
+    futures.clear();
+    
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void H264Encoder::encode_macroblock_row(utils::BitstreamWriter& writer, const FrameView& frame, uint32_t mb_y,
+                                        uint8_t slice_type, const std::atomic<uint32_t>* above_progress,
+                                        std::atomic<uint32_t>& progress) {
+    const uint32_t mb_width = (width_ + 15) / 16;
+    processing::MotionEstimator motion_estimator;
+    processing::IntraModeSearch intra_search;
+    intra_search.set_time_budget(intra_time_budget_);
+    int previous_qp = current_qp_;
+    uint32_t skip_run = 0; // P_Skip macroblocks since the last coded one in this row
+    
+    try {
         for (uint32_t mb_x = 0; mb_x < mb_width; ++mb_x) {
+            // Row-lag-2: the above-right macroblock has to be finished first
+            if (above_progress) {
+                const uint32_t needed = std::min(mb_x + 2, mb_width);
+                uint32_t done = above_progress->load(std::memory_order_acquire);
+                while (done < needed) {
+                    above_progress->wait(done, std::memory_order_acquire);
+                    done = above_progress->load(std::memory_order_acquire);
+                }
+            }
+            
+            // Adaptive quantization: mb_qp_delta against the previous coded macroblock in
+            // decoding order, or the slice QP at the start of a slice. The last macroblock
+            // of a row is never skipped, so the QP a row starts from is known without
+            // waiting for the row above.
+            const int qp = rate_control_.block_qp(mb_x * 16, mb_y * 16, 16, 16);
+            if (mb_x == 0 && above_progress) {
+                previous_qp = rate_control_.block_qp((mb_width - 1) * 16, (mb_y - 1) * 16, 16, 16);
+            }
+            
             // Encode macroblock
-            encode_macroblock(writer, frame, mb_x, mb_y, slice_type, motion_estimator);
+            encode_macroblock(writer, frame, mb_x, mb_y, slice_type, qp, previous_qp, skip_run,
+                              above_progress != nullptr, motion_estimator, intra_search);
+            
+            progress.store(mb_x + 1, std::memory_order_release);
+            progress.notify_all();
+        }
+        intra_modes_evaluated_.fetch_add(intra_search.modes_evaluated(), std::memory_order_relaxed);
+        
+        // The in-loop filter follows right behind the finished rows
+        if (deblocking_) {
+            deblock_rows();
         }
+    } catch (...) {
+        // Release the row below so it does not wait forever
+        progress.store(mb_width, std::memory_order_release);
+        progress.notify_all();
+        throw;
+    }
+}
+
+void H264Encoder::deblock_rows() {
+    // Rows are filtered top to bottom (filtering a row also changes the bottom of the one
+    // above), by whichever thread finishes the row that lets the filter move on. Intra
+    // prediction reads the unfiltered bottom of the row above, so a row waits for the one
+    // below it; rows never wait for the filter.
+    const uint32_t mb_width = (width_ + 15) / 16;
+    const uint32_t mb_height = (height_ + 15) / 16;
+    const ReferencePicture::Plane& luma = reconstruction_->plane(ReferencePicture::Y);
+    auto finished = [&](uint32_t mb_y) {
+        return mb_y >= mb_height || row_progress_[mb_y].load(std::memory_order_acquire) == mb_width;
+    };
+    
+    std::lock_guard<std::mutex> lock(deblocking_mutex_);
+    PROFILE_SCOPE("LoopFilter");
+    while (deblocked_rows_ < mb_height && finished(deblocked_rows_) && finished(deblocked_rows_ + 1)) {
+        deblocking_filter_.filter_row(luma.origin, luma.stride, deblocked_rows_);
+        deblocked_rows_++;
     }
 }
 
-void H264Encoder::encode_macroblock(utils::BitstreamWriter& writer, const VideoFrame& frame, 
-                                   uint32_t mb_x, uint32_t mb_y, uint8_t slice_type,
-                                   processing::MotionEstimator& motion_estimator) {
+void H264Encoder::encode_macroblock(utils::BitstreamWriter& writer, const FrameView& frame, 
+                                   uint32_t mb_x, uint32_t mb_y, uint8_t slice_type, int qp, int& previous_qp,
+                                   uint32_t& skip_run, bool above_available,
+                                   processing::MotionEstimator& motion_estimator,
+                                   processing::IntraModeSearch& intra_search) {
     Macroblock mb;
     extract_macroblock(frame, mb, mb_x, mb_y);
     
+    // Slices start on a row, so only the above macroblocks can be in another slice
+    const uint32_t mb_width = (width_ + 15) / 16;
+    processing::H264IntraNeighbours neighbours;
+    neighbours.left = mb_x > 0;
+    neighbours.above = above_available;
+    neighbours.above_right = above_available && mb_x + 1 < mb_width;
+    neighbours.above_left = above_available && mb_x > 0;
+    
+    // Mode prediction of the next macroblocks: DC unless this one is coded Intra_8x8
+    const size_t modes_stride = mb_width * 2;
+    uint8_t* modes = intra_modes_.data() + mb_y * 2 * modes_stride + mb_x * 2;
+    modes[0] = modes[1] = modes[modes_stride] = modes[modes_stride + 1] = processing::H264_INTRA_DC;
+    
+    // What the deblocking filter needs to know about the macroblock
+    processing::H264DeblockingFilter::MacroblockInfo& info = deblocking_filter_.info(mb_x, mb_y);
+    info = processing::H264DeblockingFilter::MacroblockInfo{};
+    info.qp = static_cast<int8_t>(qp);
+    const int qp_delta = qp - previous_qp;
+    
+    // Intra refresh: the column is intra, Intra_8x8 at its right edge would read the
+    // macroblock above-right, which is not refreshed yet
+    const int x = static_cast<int>(mb_x * 16);
+    const bool allow_8x8 = !intra_refresh_.reads_unrefreshed(x, 32);
+    
     if (slice_type == 5) { // I-frame - Intra prediction
-        writer.write_ue(1); // I_PCM or I_16x16
-        encode_intra_macroblock(writer, mb);
-    } else { // P-frame - Inter prediction
-        // Motion estimation
-        auto mv = motion_estimator.estimate_diamond_search(
-            frame.data.data(), reference_frames_.data(), width_, height_, 
-            mb_x * 16, mb_y * 16
+        info.coded = encode_intra_macroblock(writer, mb, mb_x, mb_y, 0, qp, qp_delta, neighbours, intra_search);
+        previous_qp = qp;
+        return;
+    }
+    
+    // P-frame - Inter prediction. The residual against the motion-compensated prediction
+    // is transformed and quantized like the intra residual and reconstructed into the
+    // picture the same way.
+    const ReferencePicture::Plane& luma = reconstruction_->plane(ReferencePicture::Y);
+    const int y0 = static_cast<int>(mb_y * 16);
+    const int visible_w = static_cast<int>(width_) - x;
+    const int visible_h = static_cast<int>(height_) - y0;
+    uint8_t* origin = luma.row(y0) + x;
+    
+    alignas(32) std::array<uint8_t, 256> prediction;
+    Macroblock residual;
+    auto predict = [&](uint32_t ref_idx, int mv_x, int mv_y) {
+        dpb_.get(ref_idx)->predict_luma(processing::SubpelFilterType::H264_6TAP, x * 4 + mv_x, y0 * 4 + mv_y,
+                                        16, 16, prediction.data(), 16);
+        bool has_coefficients = false;
+        for (int by = 0; by < 2; ++by) {
+            for (int bx = 0; bx < 2; ++bx) {
+                Block8x8& block = residual.y_blocks[by][bx];
+                const uint8_t* block_prediction = prediction.data() + by * 8 * 16 + bx * 8;
+                for (int i = 0; i < 8; ++i) {
+                    for (int j = 0; j < 8; ++j) {
+                        block[i][j] = static_cast<int16_t>(mb.y_blocks[by][bx][i][j] + 128 - block_prediction[i * 16 + j]);
+                    }
+                }
+                perform_dct_quantization(block, qp);
+                for (const auto& row : block) {
+                    has_coefficients |= std::any_of(row.begin(), row.end(), [](int16_t c) { return c != 0; });
+                }
+            }
+        }
+        return has_coefficients;
+    };
+    auto reconstruct = [&]() {
+        for (int b = 0; b < 4; ++b) {
+            const int bx = b & 1, by = b >> 1;
+            reconstruct_block(residual.y_blocks[by][bx], qp, prediction.data() + by * 8 * 16 + bx * 8, 16,
+                              origin + by * 8 * luma.stride + bx * 8, luma.stride,
+                              std::clamp(visible_w - bx * 8, 0, 8), std::clamp(visible_h - by * 8, 0, 8));
+        }
+    };
+    
+    // Motion vectors are coded against the prediction from the left, above and above-right
+    // (above-left) macroblocks
+    processing::H264NeighbourMotion left, above, corner;
+    neighbour_motion(deblocking_filter_, neighbours, mb_x, mb_y, left, above, corner);
+    
+    // P_Skip first: reference 0 at the skip vector, taken when the residual quantizes to
+    // nothing. Not for the last macroblock of a row, the next row takes its QP as known.
+    // With intra refresh the reference samples (6-tap filter included) stay in the
+    // refreshed part.
+    int skip_x = 0, skip_y = 0;
+    processing::h264_skip_mv(left, above, corner, skip_x, skip_y);
+    const int skip_right = x + (skip_x >> 2) + 16 + ((skip_x & 3) ? 3 : 0);
+    if (!dpb_.empty() && !intra_refresh_.forces_intra(x, 16) && mb_x + 1 < mb_width &&
+        skip_right <= intra_refresh_.reference_limit(x) && !predict(0, skip_x, skip_y)) {
+        reconstruct();
+        info.qp = static_cast<int8_t>(previous_qp);
+        info.intra = false;
+        info.ref_idx = 0;
+        info.mv_x = static_cast<int16_t>(skip_x);
+        info.mv_y = static_cast<int16_t>(skip_y);
+        const processing::CAVLCCoeffCounts counts = coeff_counts(mb_x, mb_y, neighbours);
+        for (int y4 = 0; y4 < 4; ++y4) {
+            for (int x4 = 0; x4 < 4; ++x4) {
+                counts.at(x4, y4) = 0;
+            }
+        }
+        skip_run++;
+        return;
+    }
+    
+    // Motion estimation against every reference in the DPB. The pre-analysis vector
+    // (previous frame) seeds the search; blocks it found intra skip the search. With intra
+    // refresh only the previous frame, behind the column only its refreshed part.
+    processing::MotionVector mv;
+    uint32_t ref_idx = 0;
+    const auto* hint = rate_control_.analysis().hint(mb_x * 16, mb_y * 16);
+    size_t references = hint && hint->intra ? 0 : dpb_.size();
+    if (intra_refresh_.forces_intra(x, 16)) {
+        references = 0;
+    } else if (intra_refresh_.enabled()) {
+        references = std::min<size_t>(references, 1);
+    }
+    motion_estimator.set_reference_limit(intra_refresh_.reference_limit(x), 16);
+    
+    for (size_t i = 0; i < references; ++i) {
+        const auto& reference = dpb_.get(i);
+        auto candidate = motion_estimator.estimate_diamond_search(
+            frame.luma(), static_cast<int>(frame.luma_stride()), reference->luma_view(),
+            mb_x * 16, mb_y * 16, hint && i == 0 ? hint->mv_x : 0, hint && i == 0 ? hint->mv_y : 0
         );
         
-        if (mv.valid && mv.cost < 1000) { // Use motion compensation
-            writer.write_ue(0); // P_L0_16x16
-            encode_motion_vector(writer, mv);
-            encode_residual(writer, mb); // Encode residual
-        } else { // Fallback to intra
-            writer.write_ue(1); // Intra
-            encode_intra_macroblock(writer, mb);
+        // Half-pel planes are cached in the reference picture, built on first use
+        if (candidate.valid && subpel_refinement_) {
+            candidate = motion_estimator.refine_subpel(
+                frame.luma(), static_cast<int>(frame.luma_stride()),
+                reference->subpel_planes(processing::SubpelFilterType::H264_6TAP),
+                mb_x * 16, mb_y * 16, candidate);
+        }
+        
+        if (candidate.cost < mv.cost) {
+            mv = candidate;
+            ref_idx = static_cast<uint32_t>(i);
         }
     }
     
-    // Store as reference for future frames
-    store_macroblock_reference(mb, mb_x, mb_y);
+    if (!mv.valid || mv.cost >= 1000) { // Fallback to intra (mb_type 5.. in P slices)
+        writer.write_ue(skip_run); // mb_skip_run
+        skip_run = 0;
+        info.coded = encode_intra_macroblock(writer, mb, mb_x, mb_y, 5, qp, qp_delta, neighbours, intra_search,
+                                             allow_8x8);
+        previous_qp = qp;
+        return;
+    }
+    
+    predict(ref_idx, mv.qpel_x(), mv.qpel_y());
+    reconstruct();
+    info.intra = false;
+    info.ref_idx = static_cast<int8_t>(ref_idx);
+    info.mv_x = static_cast<int16_t>(mv.qpel_x());
+    info.mv_y = static_cast<int16_t>(mv.qpel_y());
+    
+    int mvp_x = 0, mvp_y = 0;
+    processing::h264_predict_mv(left, above, corner, static_cast<int>(ref_idx), mvp_x, mvp_y);
+    
+    writer.write_ue(skip_run); // mb_skip_run
+    skip_run = 0;
+    writer.write_ue(0); // P_L0_16x16
+    encode_ref_idx(writer, ref_idx);
+    writer.write_se(mv.qpel_x() - mvp_x); // mvd_l0, quarter-pel
+    writer.write_se(mv.qpel_y() - mvp_y);
+    writer.write_se(qp_delta); // mb_qp_delta
+    info.coded = encode_residual(writer, residual, mb_x, mb_y, neighbours); // Encode residual
+    previous_qp = qp;
 }
 
-void H264Encoder::encode_intra_macroblock(utils::BitstreamWriter& writer, const Macroblock& mb) {
-    // Perform DCT and quantization
-    Macroblock transformed_mb = mb;
-    perform_dct_quantization(transformed_mb);
+uint8_t H264Encoder::encode_intra_macroblock(utils::BitstreamWriter& writer, const Macroblock& mb, uint32_t mb_x,
+                                             uint32_t mb_y, uint32_t mb_type_offset, int qp, int qp_delta,
+                                             const processing::H264IntraNeighbours& neighbours,
+                                             processing::IntraModeSearch& search, bool allow_8x8) {
+    using processing::IntraEdges;
+    
+    // Predictions read the reconstruction (unfiltered, see deblock_rows)
+    const ReferencePicture::Plane& luma = reconstruction_->plane(ReferencePicture::Y);
+    const int x0 = static_cast<int>(mb_x * 16);
+    const int y0 = static_cast<int>(mb_y * 16);
+    const int visible_w = static_cast<int>(width_) - x0;
+    const int visible_h = static_cast<int>(height_) - y0;
+    uint8_t* origin = luma.row(y0) + x0;
     
-    // Encode each 8x8 block
-    for (const auto& block : transformed_mb.y_blocks) {
-        cavlc_encoder_->encode_residual(writer, block);
+    alignas(32) std::array<uint8_t, 256> source;
+    for (int y = 0; y < 16; ++y) {
+        for (int x = 0; x < 16; ++x) {
+            source[y * 16 + x] = static_cast<uint8_t>(mb.y_blocks[y/8][x/8][y%8][x%8] + 128);
+        }
     }
+    
+    // Mode decision on SATD + lambda * signalling bits; a cost of about one per sample
+    // is as good as it gets
+    const uint32_t lambda = processing::intra_lambda_sad(qp);
+    auto bits_cost = [lambda](int bits) { return (lambda * static_cast<uint32_t>(bits) + 8) >> 4; };
+    search.begin_ctu();
+    
+    // Intra_16x16: the mode is part of mb_type
+    IntraEdges edges_16x16;
+    processing::load_h264_edges(edges_16x16, origin, luma.stride, neighbours, -1, visible_w, visible_h);
+    alignas(32) std::array<uint8_t, 256> prediction;
+    static constexpr int MODES_16X16[] = {2, 0, 1, 3};
+    const auto best_16x16 = search.search_list(MODES_16X16, 4, 256, [&](int mode) {
+        if (!processing::h264_16x16_mode_available(edges_16x16, mode)) return UINT32_MAX;
+        processing::predict_h264_16x16(edges_16x16, mode, prediction.data(), 16);
+        return processing::intra_satd(source.data(), 16, prediction.data(), 16, 16, 16) +
+               bits_cost(ue_bits(mb_type_offset + 1 + mode));
+    });
+    
+    // Intra_8x8, block by block on the previous blocks' reconstruction. Skipped when
+    // Intra_16x16 is already good enough or the time is up.
+    const size_t modes_stride = (width_ + 15) / 16 * 2;
+    uint8_t* modes = intra_modes_.data() + mb_y * 2 * modes_stride + mb_x * 2;
+    std::array<uint8_t, 4> modes_8x8{};
+    std::array<int, 4> predicted_modes{};
+    Macroblock coefficients;
+    bool use_8x8 = false;
+    if (allow_8x8 && best_16x16.cost > 256 && !search.out_of_time()) {
+        uint32_t cost_8x8 = bits_cost(ue_bits(mb_type_offset));
+        IntraEdges edges;
+        alignas(32) std::array<uint8_t, 64> block_prediction;
+        for (int b = 0; b < 4; ++b) {
+            const int bx = b & 1, by = b >> 1;
+            const int left = bx ? modes_8x8[b - 1] : (neighbours.left ? modes[by * modes_stride - 1] : -1);
+            const int above = by ? modes_8x8[b - 2] : (neighbours.above ? modes[bx - modes_stride] : -1);
+            const int predicted_mode = processing::h264_predicted_8x8_mode(left, above);
+            
+            processing::load_h264_edges(edges, origin, luma.stride, neighbours, b, visible_w, visible_h);
+            processing::h264_filter_edges_8x8(edges);
+            const uint8_t* block_source = source.data() + by * 8 * 16 + bx * 8;
+            // The predicted mode first (one bit), then DC, vertical, horizontal, the diagonals
+            int order[processing::H264_INTRA_NXN_MODES] = {predicted_mode};
+            int count = 1;
+            for (int mode : {2, 0, 1, 3, 4, 5, 6, 7, 8}) {
+                if (mode != predicted_mode) order[count++] = mode;
+            }
+            const auto best = search.search_list(order, count, 64, [&](int mode) {
+                if (!processing::h264_8x8_mode_available(edges, mode)) return UINT32_MAX;
+                processing::predict_h264_8x8(edges, mode, block_prediction.data(), 8);
+                return processing::intra_satd(block_source, 16, block_prediction.data(), 8, 8, 8) +
+                       bits_cost(mode == predicted_mode ? 1 : 4);
+            });
+            modes_8x8[b] = static_cast<uint8_t>(best.mode);
+            predicted_modes[b] = predicted_mode;
+            cost_8x8 += best.cost;
+            
+            // The next blocks predict from this one's reconstruction
+            processing::predict_h264_8x8(edges, best.mode, block_prediction.data(), 8);
+            Block8x8& block = coefficients.y_blocks[by][bx];
+            for (int y = 0; y < 8; ++y) {
+                for (int x = 0; x < 8; ++x) {
+                    block[y][x] = static_cast<int16_t>(block_source[y * 16 + x] - block_prediction[y * 8 + x]);
+                }
+            }
+            perform_dct_quantization(block, qp);
+            reconstruct_block(block, qp, block_prediction.data(), 8,
+                              origin + by * 8 * luma.stride + bx * 8, luma.stride,
+                              std::clamp(visible_w - bx * 8, 0, 8), std::clamp(visible_h - by * 8, 0, 8));
+        }
+        use_8x8 = cost_8x8 < best_16x16.cost;
+    }
+    
+    if (use_8x8) {
+        writer.write_ue(mb_type_offset); // I_NxN
+        for (int b = 0; b < 4; ++b) {
+            const int mode = modes_8x8[b];
+            writer.write_bit(mode == predicted_modes[b]); // prev_intra8x8_pred_mode_flag
+            if (mode != predicted_modes[b]) {
+                writer.write_bits(mode - (mode > predicted_modes[b] ? 1 : 0), 3); // rem_intra8x8_pred_mode
+            }
+            modes[(b >> 1) * modes_stride + (b & 1)] = modes_8x8[b];
+        }
+        writer.write_se(qp_delta); // mb_qp_delta
+        return encode_residual(writer, coefficients, mb_x, mb_y, neighbours);
+    }
+    
+    // Intra_16x16 (overwrites the Intra_8x8 reconstruction, which it does not read)
+    processing::predict_h264_16x16(edges_16x16, best_16x16.mode, prediction.data(), 16);
+    for (int by = 0; by < 2; ++by) {
+        for (int bx = 0; bx < 2; ++bx) {
+            Block8x8& block = coefficients.y_blocks[by][bx];
+            for (int y = 0; y < 8; ++y) {
+                for (int x = 0; x < 8; ++x) {
+                    const int offset = (by * 8 + y) * 16 + bx * 8 + x;
+                    block[y][x] = static_cast<int16_t>(source[offset] - prediction[offset]);
+                }
+            }
+            perform_dct_quantization(block, qp);
+            reconstruct_block(block, qp, prediction.data() + by * 8 * 16 + bx * 8, 16,
+                              origin + by * 8 * luma.stride + bx * 8, luma.stride,
+                              std::clamp(visible_w - bx * 8, 0, 8), std::clamp(visible_h - by * 8, 0, 8));
+        }
+    }
+    
+    writer.write_ue(mb_type_offset + 1 + best_16x16.mode); // I_16x16_<mode>
+    writer.write_se(qp_delta); // mb_qp_delta
+    return encode_residual(writer, coefficients, mb_x, mb_y, neighbours);
 }
 
-void H264Encoder::encode_motion_vector(utils::BitstreamWriter& writer, const processing::MotionVector& mv) {
-    writer.write_se(mv.x); // Motion vector difference X
-    writer.write_se(mv.y); // Motion vector difference Y
+void H264Encoder::encode_ref_idx(utils::BitstreamWriter& writer, uint32_t ref_idx) {
+    // te(v): absent with one reference, a single inverted bit with two
+    if (dpb_.size() == 2) {
+        writer.write_bit(ref_idx == 0);
+    } else if (dpb_.size() > 2) {
+        writer.write_ue(ref_idx);
+    }
 }
 
-void H264Encoder::encode_residual(utils::BitstreamWriter& writer, const Macroblock& mb) {
-    // Encode residual after motion compensation
-    for (const auto& block : mb.y_blocks) {
-        cavlc_encoder_->encode_residual(writer, block);
+uint8_t H264Encoder::encode_residual(utils::BitstreamWriter& writer, const Macroblock& mb, uint32_t mb_x,
+                                     uint32_t mb_y, const processing::H264IntraNeighbours& neighbours) {
+    // Encode residual after motion compensation, the 8x8 blocks in raster order
+    const processing::CAVLCCoeffCounts counts = coeff_counts(mb_x, mb_y, neighbours);
+    uint8_t coded = 0;
+    for (int b = 0; b < 4; ++b) {
+        const int total_coeff = cavlc_encoder_->encode_residual(writer, mb.y_blocks[b >> 1][b & 1], counts, b);
+        coded |= static_cast<uint8_t>(total_coeff != 0) << b;
     }
+    return coded;
+}
+
+processing::CAVLCCoeffCounts H264Encoder::coeff_counts(uint32_t mb_x, uint32_t mb_y,
+                                                       const processing::H264IntraNeighbours& neighbours) {
+    processing::CAVLCCoeffCounts counts;
+    counts.stride = static_cast<ptrdiff_t>((width_ + 15) / 16) * 4;
+    counts.counts = coeff_counts_.data() + mb_y * 4 * counts.stride + mb_x * 4;
+    counts.left_available = neighbours.left;
+    counts.above_available = neighbours.above;
+    return counts;
 }
 
-void H264Encoder::extract_macroblock(const VideoFrame& frame, Macroblock& mb, uint32_t mb_x, uint32_t mb_y) {
+void H264Encoder::extract_macroblock(const FrameView& frame, Macroblock& mb, uint32_t mb_x, uint32_t mb_y) {
     // Extract Y component (luma)
+    const uint8_t* luma = frame.luma();
+    const uint32_t stride = frame.luma_stride();
     for (int y = 0; y < 16; ++y) {
         for (int x = 0; x < 16; ++x) {
             uint32_t px = mb_x * 16 + x;
             uint32_t py = mb_y * 16 + y;
             
             if (px < width_ && py < height_) {
-                uint32_t idx = py * width_ + px;
-                mb.y_blocks[y/8][x/8][y%8][x%8] = frame.data[idx] - 128; // Center around 0
+                size_t idx = static_cast<size_t>(py) * stride + px;
+                mb.y_blocks[y/8][x/8][y%8][x%8] = luma[idx] - 128; // Center around 0
             }
         }
     }
@@ -174,60 +856,97 @@ void H264Encoder::extract_macroblock(const VideoFrame& frame, Macroblock& mb, ui
     // Gerçek implementasyonda UV downsampling yapılacak
 }
 
-void H264Encoder::perform_dct_quantization(Macroblock& mb) {
-    for (auto& block : mb.y_blocks) {
-        std::array<std::array<double, 8>, 8> dct_coeffs;
-        
-        // Forward DCT
-        dct_->forward_dct(block, dct_coeffs);
-        
-        // Quantization
-        quantizer_->quantize_block(dct_coeffs, current_qp_);
-        
-        // Convert back to integer (for encoding)
-        for (int i = 0; i < 8; ++i) {
-            for (int j = 0; j < 8; ++j) {
-                block[i][j] = static_cast<int16_t>(std::round(dct_coeffs[i][j]));
-            }
+void H264Encoder::perform_dct_quantization(Block8x8& block, int qp) {
+    std::array<std::array<double, 8>, 8> dct_coeffs;
+    
+    // Forward DCT
+    dct_->forward_dct(block, dct_coeffs);
+    
+    // Quantization
+    quantizer_->quantize_block(dct_coeffs, qp);
+    
+    // Convert back to integer (for encoding)
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            block[i][j] = static_cast<int16_t>(std::round(dct_coeffs[i][j]));
         }
     }
 }
 
-void H264Encoder::store_macroblock_reference(const Macroblock& mb, uint32_t mb_x, uint32_t mb_y) {
-    // Store macroblock as reference for future frames
-    for (int y = 0; y < 16; ++y) {
-        for (int x = 0; x < 16; ++x) {
-            uint32_t px = mb_x * 16 + x;
-            uint32_t py = mb_y * 16 + y;
-            
-            if (px < width_ && py < height_) {
-                uint32_t idx = py * width_ + px;
-                reference_frames_[idx] = static_cast<uint8_t>(mb.y_blocks[y/8][x/8][y%8][x%8] + 128);
-            }
+void H264Encoder::reconstruct_block(const Block8x8& coefficients, int qp, const uint8_t* prediction,
+                                    int prediction_stride, uint8_t* dst, int stride, int w, int h) {
+    // Same steps as H264Decoder: dequantize, inverse DCT, add to the prediction, clip
+    std::array<std::array<double, 8>, 8> dct_coeffs;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            dct_coeffs[i][j] = coefficients[i][j];
+        }
+    }
+    quantizer_->dequantize_block(dct_coeffs, qp);
+    
+    Block8x8 residual;
+    dct_->inverse_dct(dct_coeffs, residual);
+    
+    for (int y = 0; y < h; ++y) {
+        uint8_t* out = dst + static_cast<ptrdiff_t>(y) * stride;
+        for (int x = 0; x < w; ++x) {
+            out[x] = static_cast<uint8_t>(std::clamp(prediction[y * prediction_stride + x] + residual[y][x], 0, 255));
         }
     }
 }
 
 void H264Encoder::set_bitrate(uint32_t bitrate) {
     bitrate_ = bitrate;
-    target_bits_per_frame_ = bitrate / fps_;
-    
-    
-    
-    
-    
-    
-    // Adjust QP based on bitrate
-    current_qp_ = 26 + (bitrate < 2000000 ? 5 : 0) - (bitrate > 5000000 ? 5 : 0);
-    current_qp_ = std::max(10, std::min(40, current_qp_));
+    rate_control_.set_bitrate(bitrate);
+}
+
+void H264Encoder::set_rate_control(const RateControlConfig& config) {
+    RateControlConfig rc_config = config;
+    rc_config.fps = fps_;
+    bitrate_ = config.bitrate;
+    rate_control_.configure(rc_config);
+}
+
+void H264Encoder::set_max_reference_frames(uint32_t count) {
+    max_reference_frames_ = std::max(1u, std::min(16u, count));
+    dpb_.set_max_references(max_reference_frames_);
 }
 
 void H264Encoder::set_gop_size(uint32_t gop_size) {
     gop_size_ = std::max(1u, gop_size);
 }
 
+bool H264Encoder::set_intra_refresh(uint32_t period) {
+    intra_refresh_.set_period(period);
+    rate_control_.set_scene_cut_keyframes(period == 0);
+    return true;
+}
+
 uint32_t H264Encoder::get_encoded_size() const {
-    return frame_count_ * target_bits_per_frame_ / 8; // Estimated size
+    return static_cast<uint32_t>(rate_control_.total_bits() / 8);
+}
+
+void H264Encoder::reset() {
+    frame_count_ = 0;
+    last_keyframe_ = 0;
+    
+    // The last stream's settings and slice callback do not carry over
+    const Settings& settings = initial_settings_;
+    gop_size_ = settings.gop_size;
+    subpel_refinement_ = settings.subpel_refinement;
+    slice_count_ = settings.slice_count;
+    wavefront_ = settings.wavefront;
+    deblocking_ = settings.deblocking;
+    intra_time_budget_ = settings.intra_time_budget;
+    slice_output_ = nullptr;
+    set_intra_refresh(settings.intra_refresh_period);
+    rate_control_.reset(settings.rate_control);
+    bitrate_ = settings.rate_control.bitrate;
+    
+    dpb_.clear(); // Pictures go back to the reference pool
+    set_max_reference_frames(settings.max_reference_frames);
+    reconstruction_.reset();
+    intra_modes_evaluated_.store(0, std::memory_order_relaxed);
 }
 
 } // namespace codec
@@ -2,8 +2,11 @@
 #include "streaming/codec/h265_encoder.hpp"
 #include "streaming/processing/cabac_encoder.hpp"
 #include "streaming/processing/motion_estimation.hpp"
-#include <iostream>
+#include "streaming/performance/profiler.hpp"
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <iostream>
 
 namespace streaming {
 namespace codec {
@@ -18,17 +21,44 @@ bool H265Encoder::initialize(uint32_t width, uint32_t height, uint32_t fps, uint
     fps_ = fps;
     bitrate_ = bitrate;
     frame_count_ = 0;
+    last_keyframe_ = 0;
     
     // HEVC-specific initialization
     ctu_size_ = 64; // HEVC allows 16, 32, 64
     max_cu_depth_ = std::log2(ctu_size_ / 8); // Up to 8x8 CUs
     
-    // Calculate target bits per frame
-    target_bits_per_frame_ = bitrate / fps;
+    // Frame QPs come from the rate controller (CBR at the target bitrate unless configured)
+    RateControlConfig rc_config = rate_control_.config();
+    rc_config.bitrate = bitrate;
+    rc_config.fps = fps;
+    rate_control_.configure(rc_config);
     current_qp_ = 32; // HEVC QP range: 0-51
     
-    // Initialize reference frames buffer
-    reference_frames_.resize(width * height * 3 / 2); // YUV420
+    // Reference pictures come from a pool that may be shared with other encoders
+    if (!reference_pool_ || reference_pool_->width() != width || reference_pool_->height() != height) {
+        reference_pool_ = ReferencePicturePool::create(width, height);
+    }
+    dpb_.set_max_references(max_reference_frames_);
+    dpb_.clear();
+    reconstruction_.reset();
+    
+    deblocking_filter_.configure(width, height, ctu_size_);
+    intra_refresh_.set_geometry(width, ctu_size_);
+    rows_reconstructed_.assign(deblocking_filter_.rows(), 0);
+    intra_modes_.assign(static_cast<size_t>((width + 7) / 8) * ((height + 7) / 8), 1);
+    intra_modes_evaluated_.store(0, std::memory_order_relaxed);
+    
+    // What reset() returns to
+    initial_settings_.gop_size = gop_size_;
+    initial_settings_.intra_refresh_period = intra_refresh_.period();
+    initial_settings_.rate_control = rate_control_.config();
+    initial_settings_.speed_preset = speed_preset_;
+    initial_settings_.max_reference_frames = max_reference_frames_;
+    initial_settings_.entropy_coding_sync = entropy_coding_sync_;
+    initial_settings_.tile_columns = tile_columns_;
+    initial_settings_.tile_rows = tile_rows_;
+    initial_settings_.deblocking = deblocking_;
+    initial_settings_.intra_time_budget = intra_time_budget_;
     
     std::cout << "🚀 H265Encoder initialized: " << width << "x" << height 
               << " @" << fps << "fps, " << bitrate << "bps" << std::endl;
@@ -38,15 +68,38 @@ bool H265Encoder::initialize(uint32_t width, uint32_t height, uint32_t fps, uint
 }
 
 bool H265Encoder::encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) {
-    utils::BitstreamWriter writer;
-    
+    return encode_frame(FrameView::from(input), output);
+}
+
+bool H265Encoder::encode_frame(const FrameView& input, std::vector<uint8_t>& output) {
     try {
-        // Encode HEVC NAL unit
-        if (!encode_nal_unit(input, writer)) {
+        // Frame type and QP from the rate controller (keyframes every GOP, on request and
+        // at scene cuts; with intra refresh only on request); the coded size is fed back below
+        const bool keyframe_due = frame_count_ == 0 || input.keyframe ||
+                                  (!intra_refresh_.enabled() && frame_count_ - last_keyframe_ >= gop_size_);
+        {
+            PROFILE_SCOPE("RateControl"); // Lookahead, scene cut and AQ analysis included
+            current_qp_ = rate_control_.begin_frame(input, keyframe_due);
+        }
+        is_keyframe_ = rate_control_.is_keyframe();
+        recovery_point_ = false;
+        if (is_keyframe_) {
+            last_keyframe_ = frame_count_;
+            intra_refresh_.restart();
+        } else {
+            recovery_point_ = intra_refresh_.begin_frame();
+        }
+        
+        // Encode HEVC NAL unit. Room for twice the average frame, so the rate controller's
+        // swings around its target do not grow the buffer mid-stream.
+        writer_.clear();
+        writer_.reserve(2 * (bitrate_ / 8) / std::max(1u, fps_));
+        if (!encode_nal_unit(input, writer_)) {
             return false;
         }
         
-        output = writer.get_data();
+        writer_.swap_data(output);
+        rate_control_.end_frame(output.size());
         frame_count_++;
         
         return true;
@@ -57,220 +110,1011 @@ bool H265Encoder::encode_frame(const VideoFrame& input, std::vector<uint8_t>& ou
     }
 }
 
-bool H265Encoder::encode_nal_unit(const VideoFrame& frame, utils::BitstreamWriter& writer) {
-    bool is_idr = (frame_count_ % gop_size_ == 0);
+bool H265Encoder::encode_nal_unit(const FrameView& frame, utils::BitstreamWriter& writer) {
+    const bool is_idr = is_keyframe_;
+    if (is_idr) {
+        dpb_.clear();
+        encode_pps(writer); // Tile and WPP layout travel with every IDR
+    }
     
-    // HEVC NAL unit header (2 bytes)
-    writer.write_bit(0); // forbidden_zero_bit
-    writer.write_bits(0, 6); // nal_unit_type (simplified)
-    writer.write_bits(is_idr ? 19 : 1, 6); // HEVC NAL unit types
-    writer.write_bits(0, 6); // nuh_temporal_id_plus1
+    // Reference half-pel planes are built here; workers only read them
+    {
+        PROFILE_SCOPE("References");
+        for (size_t i = 0; i < dpb_.size(); ++i) {
+            dpb_.get(i)->subpel_planes(processing::SubpelFilterType::HEVC_8TAP);
+        }
+    }
     
-    // Slice header
-    encode_slice_header(writer, is_idr);
+    // CTUs are coded into substreams first; the slice header needs their sizes
+    const int ctus_width = (width_ + ctu_size_ - 1) / ctu_size_;
+    const int ctus_height = (height_ + ctu_size_ - 1) / ctu_size_;
+    setup_tiles(ctus_width, ctus_height);
     
-    // Encode CTUs (Coding Tree Units)
-    int ctus_width = (width_ + ctu_size_ - 1) / ctu_size_;
-    int ctus_height = (height_ + ctu_size_ - 1) / ctu_size_;
+    // CUs are reconstructed into a pooled picture as a decoder would
+    reconstruction_ = reference_pool_->acquire();
+    reconstruction_->picture_order = frame_count_;
+    reconstruction_->is_keyframe = is_idr;
+    std::fill(rows_reconstructed_.begin(), rows_reconstructed_.end(), 0);
+    deblocked_rows_ = 0;
     
-    for (int y = 0; y < ctus_height; ++y) {
-        for (int x = 0; x < ctus_width; ++x) {
-            CTU ctu;
-            // Extract CTU from frame (simplified)
-            encode_ctu(writer, ctu, x * ctu_size_, y * ctu_size_);
+    current_frame_ = &frame;
+    try {
+        PROFILE_SCOPE("BlockCoding"); // Deblocking runs behind the CTU rows, inside this
+        encode_slice_data(is_idr);
+    } catch (...) {
+        current_frame_ = nullptr;
+        throw;
+    }
+    current_frame_ = nullptr;
+    
+    // Rows the wavefront could not filter yet (the last one, or all of them with tile columns)
+    if (deblocking_) {
+        PROFILE_SCOPE("LoopFilter");
+        const ReferencePicture::Plane& luma = reconstruction_->plane(ReferencePicture::Y);
+        for (int row = deblocked_rows_; row < deblocking_filter_.rows(); ++row) {
+            deblocking_filter_.filter_row(luma.origin, luma.stride, row);
         }
     }
     
-    // HEVC in-loop filters
-    encode_sao_parameters(writer);
-    encode_deblocking_params(writer);
+    if (recovery_point_) {
+        encode_recovery_point(writer);
+    }
+    encode_nal_header(writer, is_idr ? 19 : 1); // IDR_W_RADL / TRAIL_R
+    
+    entry_point_sizes_.clear();
+    for (size_t i = 0; i + 1 < substream_writers_.size(); ++i) {
+        entry_point_sizes_.push_back(substream_writers_[i].get_data().size());
+    }
+    encode_slice_header(writer, is_idr);
+    
+    // Substreams are byte aligned; concatenating them in bitstream order is deterministic
+    for (const auto& substream : substream_writers_) {
+        writer.append(substream);
+    }
+    
+    // The filtered reconstruction becomes the next reference (luma only, chroma is not coded)
+    PROFILE_SCOPE("References");
+    reconstruction_->extend_borders();
+    dpb_.push(std::move(reconstruction_));
     
     return true;
 }
 
-void H265Encoder::encode_slice_header(utils::BitstreamWriter& writer, bool is_idr) {
-    writer.write_ue(0); // first_slice_segment_in_pic_flag
-    writer.write_ue(is_idr ? 2 : 0); // slice_type (0=P, 2=I)
-    writer.write_ue(0); // pic_parameter_set_id
+void H265Encoder::encode_nal_header(utils::BitstreamWriter& writer, uint8_t nal_unit_type) {
+    writer.write_bits(0x00000001, 32); // Start code
+    
+    // HEVC NAL unit header (2 bytes)
+    writer.write_bit(0); // forbidden_zero_bit
+    writer.write_bits(nal_unit_type, 6); // nal_unit_type
+    writer.write_bits(0, 6); // nuh_layer_id
+    writer.write_bits(1, 3); // nuh_temporal_id_plus1
+}
+
+void H265Encoder::encode_pps(utils::BitstreamWriter& writer) {
+    encode_nal_header(writer, 34); // PPS_NUT
+    
+    const bool tiles_enabled = tile_columns_ > 1 || tile_rows_ > 1;
+    
+    writer.write_ue(0); // pps_pic_parameter_set_id
+    writer.write_ue(0); // pps_seq_parameter_set_id
+    writer.write_bit(0); // dependent_slice_segments_enabled_flag
+    writer.write_bit(0); // output_flag_present_flag
+    writer.write_bits(0, 3); // num_extra_slice_header_bits
+    writer.write_bit(0); // sign_data_hiding_enabled_flag
+    writer.write_bit(0); // cabac_init_present_flag
+    writer.write_ue(0); // num_ref_idx_l0_default_active_minus1
+    writer.write_ue(0); // num_ref_idx_l1_default_active_minus1
+    writer.write_se(0); // init_qp_minus26
+    writer.write_bit(0); // constrained_intra_pred_flag
+    writer.write_bit(0); // transform_skip_enabled_flag
+    writer.write_bit(1); // cu_qp_delta_enabled_flag (adaptive quantization)
+    writer.write_ue(0); // diff_cu_qp_delta_depth: one quantization group per CTU
+    writer.write_se(0); // pps_cb_qp_offset
+    writer.write_se(0); // pps_cr_qp_offset
+    writer.write_bit(0); // pps_slice_chroma_qp_offsets_present_flag
+    writer.write_bit(0); // weighted_pred_flag
+    writer.write_bit(0); // weighted_bipred_flag
+    writer.write_bit(0); // transquant_bypass_enabled_flag
+    writer.write_bit(tiles_enabled ? 1 : 0); // tiles_enabled_flag
+    writer.write_bit(entropy_coding_sync_ ? 1 : 0); // entropy_coding_sync_enabled_flag
+    
+    if (tiles_enabled) {
+        writer.write_ue(tile_columns_ - 1); // num_tile_columns_minus1
+        writer.write_ue(tile_rows_ - 1); // num_tile_rows_minus1
+        writer.write_bit(1); // uniform_spacing_flag
+        writer.write_bit(1); // loop_filter_across_tiles_enabled_flag
+    }
+    
+    writer.write_bit(1); // pps_loop_filter_across_slices_enabled_flag
+    writer.write_bit(1); // deblocking_filter_control_present_flag
+    writer.write_bit(1); // deblocking_filter_override_enabled_flag
+    writer.write_bit(0); // pps_deblocking_filter_disabled_flag
+    writer.write_bit(0); // pps_scaling_list_data_present_flag
+    writer.write_bit(0); // lists_modification_present_flag
+    writer.write_ue(0); // log2_parallel_merge_level_minus2
+    writer.write_bit(0); // slice_segment_header_extension_present_flag
+    writer.write_bit(0); // pps_extension_present_flag
+    writer.write_trailing_bits();
+}
+
+void H265Encoder::encode_recovery_point(utils::BitstreamWriter& writer) {
+    encode_nal_header(writer, 39); // PREFIX_SEI_NUT
+    
+    utils::BitstreamWriter payload;
+    payload.write_se(static_cast<int32_t>(intra_refresh_.period()) - 1); // recovery_poc_cnt
+    payload.write_bit(1); // exact_match_flag
+    payload.write_bit(0); // broken_link_flag
+    if (payload.bit_count() % 8) {
+        payload.write_trailing_bits(); // payload_bit_equal_to_one, then zeros
+    }
     
+    writer.write_bits(6, 8); // last_payload_type_byte: recovery point
+    writer.write_bits(static_cast<uint32_t>(payload.bit_count() / 8), 8); // last_payload_size_byte
+    writer.append(payload);
+    writer.write_trailing_bits();
+}
+
+void H265Encoder::encode_slice_header(utils::BitstreamWriter& writer, bool is_idr) {
+    const std::vector<size_t>& entry_point_sizes = entry_point_sizes_;
+    writer.write_bit(1); // first_slice_segment_in_pic_flag
     if (is_idr) {
-        writer.write_ue(frame_count_); // idr_pic_id
+        writer.write_bit(0); // no_output_of_prior_pics_flag
+    }
+    writer.write_ue(0); // slice_pic_parameter_set_id
+    writer.write_ue(is_idr ? 2 : 1); // slice_type (1=P, 2=I)
+    
+    if (!is_idr) {
+        writer.write_bits((frame_count_ - last_keyframe_) & 0xFF, 8); // slice_pic_order_cnt_lsb
+        writer.write_bit(1); // num_ref_idx_active_override_flag
+        writer.write_ue(static_cast<uint32_t>(std::max<size_t>(dpb_.size(), 1) - 1)); // num_ref_idx_l0_active_minus1
+    }
+    
+    // HEVC in-loop filters
+    writer.write_bit(1); // slice_sao_luma_flag
+    writer.write_bit(1); // slice_sao_chroma_flag
+    
+    writer.write_se(current_qp_ - 26); // slice_qp_delta
+    encode_deblocking_params(writer);
+    
+    // Entry points: one per substream after the first
+    if (tile_columns_ > 1 || tile_rows_ > 1 || entropy_coding_sync_) {
+        writer.write_ue(static_cast<uint32_t>(entry_point_sizes.size())); // num_entry_point_offsets
+        
+        if (!entry_point_sizes.empty()) {
+            size_t max_size = *std::max_element(entry_point_sizes.begin(), entry_point_sizes.end());
+            uint8_t offset_len = 1;
+            while (offset_len < 32 && (max_size - 1) >> offset_len) {
+                offset_len++;
+            }
+            
+            writer.write_ue(offset_len - 1); // offset_len_minus1
+            for (size_t size : entry_point_sizes) {
+                writer.write_bits(static_cast<uint32_t>(size - 1), offset_len); // entry_point_offset_minus1
+            }
+        }
     }
     
-    writer.write_ue(current_qp_); // slice_qp_delta
+    writer.write_trailing_bits(); // byte_alignment()
+}
+
+void H265Encoder::set_tiles(uint32_t columns, uint32_t rows) {
+    // HEVC level limits: at most 20 tile columns and 22 tile rows
+    tile_columns_ = std::max(1u, std::min(20u, columns));
+    tile_rows_ = std::max(1u, std::min(22u, rows));
+}
+
+void H265Encoder::setup_tiles(int ctus_width, int ctus_height) {
+    // Uniform spacing (6.5.1); a tile is at least one CTU wide and high
+    const int columns = std::min<int>(tile_columns_, ctus_width);
+    const int rows = std::min<int>(tile_rows_, ctus_height);
     
-    // HEVC specific parameters
-    writer.write_bit(0); // dependent_slice_segment_flag
-    writer.write_ue(0); // slice_segment_address
+    tiles_.column_bounds.resize(columns + 1);
+    tiles_.row_bounds.resize(rows + 1);
+    for (int i = 0; i <= columns; ++i) {
+        tiles_.column_bounds[i] = i * ctus_width / columns;
+    }
+    for (int j = 0; j <= rows; ++j) {
+        tiles_.row_bounds[j] = j * ctus_height / rows;
+    }
+    
+    // Substreams in bitstream order: tiles in raster order, CTU rows inside each tile
+    substreams_.clear();
+    for (int j = 0; j < rows; ++j) {
+        for (int i = 0; i < columns; ++i) {
+            const int x0 = tiles_.column_bounds[i], x1 = tiles_.column_bounds[i + 1];
+            const int y0 = tiles_.row_bounds[j], y1 = tiles_.row_bounds[j + 1];
+            
+            if (entropy_coding_sync_) {
+                for (int row = y0; row < y1; ++row) {
+                    substreams_.push_back({x0, x1, y0, y1, row, row + 1});
+                }
+            } else {
+                substreams_.push_back({x0, x1, y0, y1, y0, y1});
+            }
+        }
+    }
 }
 
-void H265Encoder::encode_ctu(utils::BitstreamWriter& writer, const CTU& ctu, int x, int y) {
-    std::vector<CodingUnit> coding_units;
+void H265Encoder::encode_slice_data(bool is_intra) {
+    const size_t count = substreams_.size();
+    if (substream_writers_.size() != count) {
+        substream_writers_.resize(count);
+        coders_.resize(count);
+        sync_contexts_.resize(count);
+        substream_progress_ = std::make_unique<std::atomic<int>[]>(count);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        substream_writers_[i].clear();
+        substream_progress_[i].store(0, std::memory_order_relaxed);
+    }
     
-    // Rate-Distortion Optimized CTU splitting decision
-    rdo_ctu_split_decision(const_cast<CTU&>(ctu), x, y, coding_units);
+    if (!thread_pool_) {
+        for (size_t i = 0; i < count; ++i) {
+            encode_substream(i, is_intra);
+        }
+        return;
+    }
     
-    // Encode quad-tree structure
-    for (const auto& cu : coding_units) {
-        encode_coding_unit(writer, cu);
+    // Substreams are queued in bitstream order, so a WPP row only waits on rows that already started
+    futures_.clear();
+    futures_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        futures_.push_back(thread_pool_->enqueue([this, i, is_intra]() {
+            encode_substream(i, is_intra);
+        }));
+    }
+    
+    std::exception_ptr error;
+    for (auto& future : futures_) {
+        try {
+            future.get();
+        } catch (...) {
+            if (!error) error = std::current_exception();
+        }
+    }
+    futures_.clear();
+    if (error) {
+        std::rethrow_exception(error);
     }
 }
 
-void H265Encoder::rdo_ctu_split_decision(CTU& ctu, int x, int y, std::vector<CodingUnit>& cus) {
-    // HEVC uses quad-tree structure for CTU splitting
-    // This is a simplified RDO-based splitting decision
+void H265Encoder::encode_substream(size_t index, bool is_intra) {
+    const Substream& substream = substreams_[index];
+    utils::BitstreamWriter& writer = substream_writers_[index];
+    std::atomic<int>* progress = substream_progress_.get();
+    const int tile_width = substream.tile_x1 - substream.tile_x0;
+    const bool last_substream = index + 1 == substreams_.size();
+    const bool wait_above = entropy_coding_sync_ && substream.row > substream.tile_y0;
     
-    for (int depth = 0; depth <= max_cu_depth_; ++depth) {
-        int cu_size = ctu_size_ >> depth;
-        
-        for (int cu_y = y; cu_y < y + ctu_size_; cu_y += cu_size) {
-            for (int cu_x = x; cu_x < x + ctu_size_; cu_x += cu_size) {
-                CodingUnit cu;
-                cu.x = cu_x;
-                cu.y = cu_y;
-                cu.size = cu_size;
-                
-                // Simplified RDO cost calculation
-                double cost_no_split = calculate_cu_cost(ctu, cu, false);
-                double cost_split = calculate_cu_cost(ctu, cu, true);
+    SubstreamCoder& coder = coders_[index];
+    coder.tile_x0 = substream.tile_x0 * ctu_size_;
+    coder.tile_y0 = substream.tile_y0 * ctu_size_;
+    coder.tile_x1 = std::min<int>(substream.tile_x1 * ctu_size_, width_);
+    coder.tile_y1 = std::min<int>(substream.tile_y1 * ctu_size_, height_);
+    coder.intra_search = processing::IntraModeSearch();
+    coder.intra_search.set_time_budget(intra_time_budget_);
+    coder.coefficients.configure(ctu_size_);
+    coder.cabac.init_encoder(writer);
+    coder.contexts.init(current_qp_, is_intra);
+    processing::MotionEstimator motion_estimator;
+    
+    try {
+        for (int row = substream.row; row < substream.row_end; ++row) {
+            // qPY_PREV restarts from the slice QP in each tile, and each CTU row with WPP
+            if (row == substream.row || entropy_coding_sync_) {
+                coder.previous_qp = current_qp_;
+            }
+            
+            for (int i = 0; i < tile_width; ++i) {
+                if (wait_above) {
+                    // WPP: the above-right CTU must be finished (two-CTU lag)
+                    const int needed = std::min(i + 2, tile_width);
+                    int done = progress[index - 1].load(std::memory_order_acquire);
+                    while (done < needed) {
+                        progress[index - 1].wait(done, std::memory_order_acquire);
+                        done = progress[index - 1].load(std::memory_order_acquire);
+                    }
+                    
+                    // 9.3.1: contexts after the second CTU of the row above, or a fresh
+                    // initialisation when the tile is a single CTU wide
+                    if (i == 0 && tile_width > 1) {
+                        coder.contexts = sync_contexts_[index - 1];
+                    }
+                }
                 
-                cu.split = (cost_split < cost_no_split) && (depth < max_cu_depth_);
-                cus.push_back(cu);
+                const int x = (substream.tile_x0 + i) * ctu_size_;
+                encode_ctu(coder, x, row * ctu_size_, is_intra, motion_estimator);
                 
-                if (!cu.split) {
-                    // Encode this CU without further splitting
-                    break;
+                if (entropy_coding_sync_ && i == 1) {
+                    sync_contexts_[index] = coder.contexts;
                 }
+                
+                // end_of_slice_segment_flag
+                const bool end_of_slice = last_substream && row + 1 == substream.row_end && i + 1 == tile_width;
+                coder.cabac.encode_terminator(end_of_slice);
+                
+                progress[index].store(i + 1, std::memory_order_release);
+                progress[index].notify_all();
             }
+            
+            // Rows span the picture only with a single tile column
+            if (deblocking_ && tiles_.column_bounds.size() == 2) {
+                ctu_row_reconstructed(row);
+            }
+        }
+        
+        intra_modes_evaluated_.fetch_add(coder.intra_search.modes_evaluated(), std::memory_order_relaxed);
+        
+        if (!last_substream) {
+            coder.cabac.encode_terminator(true); // end_of_subset_one_bit
+        }
+        coder.cabac.flush_encoder();
+        writer.write_trailing_bits(); // byte_alignment() / rbsp_slice_segment_trailing_bits()
+    } catch (...) {
+        // Release the row below so it does not wait forever
+        progress[index].store(tile_width, std::memory_order_release);
+        progress[index].notify_all();
+        throw;
+    }
+}
+
+void H265Encoder::ctu_row_reconstructed(int row) {
+    // Filtering a row changes all of its samples, and intra prediction of the row below
+    // reads its bottom row unfiltered: a row is filtered once the row below is coded too.
+    // Rows are filtered top to bottom by whichever thread completes the pair.
+    const ReferencePicture::Plane& luma = reconstruction_->plane(ReferencePicture::Y);
+    const int rows = deblocking_filter_.rows();
+    
+    std::lock_guard<std::mutex> lock(deblocking_mutex_);
+    PROFILE_SCOPE("LoopFilter");
+    rows_reconstructed_[row] = 1;
+    while (deblocked_rows_ + 1 < rows && rows_reconstructed_[deblocked_rows_] &&
+           rows_reconstructed_[deblocked_rows_ + 1]) {
+        deblocking_filter_.filter_row(luma.origin, luma.stride, deblocked_rows_);
+        deblocked_rows_++;
+    }
+}
+
+void H265Encoder::CabacContexts::init(int qp, bool is_intra) {
+    // initValue tables of 9.3.2.2 (initType 0 = I slice, 1 = P slice)
+    const int t = is_intra ? 0 : 1;
+    
+    sao_merge_flag.init(153, qp);
+    sao_type_idx.init(is_intra ? 200 : 185, qp);
+    
+    static constexpr uint8_t SPLIT_CU[2][3] = {{139, 141, 157}, {107, 139, 126}};
+    for (int i = 0; i < 3; ++i) {
+        split_cu_flag[i].init(SPLIT_CU[t][i], qp);
+    }
+    
+    pred_mode_flag.init(149, qp);
+    prev_intra_luma_pred_flag.init(is_intra ? 184 : 154, qp);
+    ref_idx[0].init(153, qp);
+    ref_idx[1].init(153, qp);
+    abs_mvd_greater0_flag.init(140, qp);
+    abs_mvd_greater1_flag.init(198, qp);
+    
+    static constexpr uint8_t SPLIT_TRANSFORM[2][3] = {{153, 138, 138}, {124, 138, 94}};
+    for (int i = 0; i < 3; ++i) {
+        split_transform_flag[i].init(SPLIT_TRANSFORM[t][i], qp);
+    }
+    
+    static constexpr uint8_t CBF_LUMA[2][2] = {{111, 141}, {153, 111}};
+    cbf_luma[0].init(CBF_LUMA[t][0], qp);
+    cbf_luma[1].init(CBF_LUMA[t][1], qp);
+    cu_qp_delta_abs[0].init(154, qp);
+    cu_qp_delta_abs[1].init(154, qp);
+    
+    static constexpr uint8_t CODED_SUB_BLOCK[2][2] = {{91, 171}, {121, 140}};
+    coded_sub_block_flag[0].init(CODED_SUB_BLOCK[t][0], qp);
+    coded_sub_block_flag[1].init(CODED_SUB_BLOCK[t][1], qp);
+    
+    static constexpr uint8_t SIG_COEFF[2][4] = {{111, 111, 125, 110}, {155, 154, 139, 153}};
+    static constexpr uint8_t GREATER1[2][4] = {{140, 92, 137, 138}, {154, 196, 196, 167}};
+    for (int i = 0; i < 4; ++i) {
+        sig_coeff_flag[i].init(SIG_COEFF[t][i], qp);
+        coeff_abs_level_greater1_flag[i].init(GREATER1[t][i], qp);
+    }
+}
+
+void H265Encoder::encode_ctu(SubstreamCoder& coder, int x, int y, bool is_intra,
+                             processing::MotionEstimator& motion_estimator) {
+    // CTU QP from adaptive quantization
+    coder.qp = rate_control_.block_qp(x, y, ctu_size_, ctu_size_);
+    coder.qp_delta_coded = false;
+    coder.intra_search.begin_ctu();
+    
+    encode_sao_parameters(coder, x, y);
+    
+    std::vector<CodingUnit>& coding_units = coder.coding_units;
+    coding_units.clear();
+    coding_units.reserve(1 + 4 + 16 + 64); // Full quad-tree down to 8x8
+    
+    // Rate-Distortion Optimized CTU splitting decision
+    rdo_ctu_split_decision(coder, x, y, coding_units);
+    
+    // Encode quad-tree structure (pre-order)
+    for (auto& cu : coding_units) {
+        encode_coding_unit(coder, cu, is_intra, motion_estimator);
+    }
+}
+
+void H265Encoder::rdo_ctu_split_decision(SubstreamCoder& coder, int x, int y, std::vector<CodingUnit>& cus) {
+    // HEVC uses quad-tree structure for CTU splitting
+    const FrameView& frame = *current_frame_;
+    coder.block_statistics.compute(frame.luma(), frame.luma_stride(), width_, height_, x, y, ctu_size_);
+    const double lambda = 0.85 * std::pow(2.0, (coder.qp - 12) / 3.0);
+    
+    CodingUnit root;
+    root.x = x;
+    root.y = y;
+    root.size = ctu_size_;
+    root.depth = 0;
+    rdo_cu_split_decision(coder.block_statistics, coder.contexts, lambda, root, cus);
+}
+
+namespace {
+
+// Overhead of each coded CU (mode, flags, cbf); the split flag is priced from its context
+constexpr double CU_OVERHEAD_BITS = 8.0;
+
+// prev_intra_luma_pred_flag, then mpm_idx (truncated rice, bypass) or the 5-bit
+// rem_intra_luma_pred_mode among the 32 other modes. The CABAC coder writes it, a
+// CABACRateEstimator prices the candidates of the mode decision.
+template <typename Coder>
+void code_intra_luma_mode(Coder& cabac, processing::CABACEncoder::ContextModel& prev_intra_luma_pred_flag,
+                          int mode, const int mpm[3]) {
+    const int mpm_idx = mode == mpm[0] ? 0 : (mode == mpm[1] ? 1 : (mode == mpm[2] ? 2 : -1));
+    cabac.encode_bit(prev_intra_luma_pred_flag, mpm_idx >= 0);
+    if (mpm_idx >= 0) {
+        cabac.encode_bypass(mpm_idx > 0);
+        if (mpm_idx > 0) {
+            cabac.encode_bypass(mpm_idx > 1);
+        }
+    } else {
+        int remaining = mode;
+        for (int candidate : {mpm[0], mpm[1], mpm[2]}) {
+            remaining -= candidate < mode ? 1 : 0;
         }
+        cabac.encode_bypass_bins(static_cast<uint32_t>(remaining), 5);
     }
 }
 
-double H265Encoder::calculate_cu_cost(const CTU& ctu, const CodingUnit& cu, bool split) {
-    // Simplified Rate-Distortion cost calculation
-    // In real implementation, this would involve actual encoding and distortion measurement
+} // namespace
+
+void H265Encoder::rdo_cu_split_decision(const processing::BlockStatistics& statistics, const CabacContexts& contexts,
+                                        double lambda, const CodingUnit& cu, std::vector<CodingUnit>& cus) {
+    if (cu.x >= static_cast<int>(width_) || cu.y >= static_cast<int>(height_)) {
+        return; // Outside the picture: not coded
+    }
+    
+    CodingUnit node = cu;
+    const bool inside = cu.x + cu.size <= static_cast<int>(width_) && cu.y + cu.size <= static_cast<int>(height_);
+    const auto& config = processing::partition_search_config(speed_preset_);
     
-    double distortion = 0.0;
-    double rate = 0.0;
-    double lambda = 0.85 * std::pow(2.0, (current_qp_ - 12) / 3.0);
+    if (!inside && cu.depth < max_cu_depth_) {
+        node.split = true; // Implicit split at the picture boundary
+    } else if (cu.depth < max_cu_depth_ && cu.size > config.min_block_size) {
+        const ContextModel& split_flag = contexts.split_cu_flag[std::min(cu.depth, 2)];
+        const double cu_bits =
+            processing::rate_to_bits(processing::CABACEncoder::bin_rate(split_flag, false)) + CU_OVERHEAD_BITS;
+        const double split_bits =
+            processing::rate_to_bits(processing::CABACEncoder::bin_rate(split_flag, true)) + 4 * CU_OVERHEAD_BITS;
+        if (!processing::partition_is_final(statistics.block(cu.x, cu.y, cu.size, cu.size), lambda,
+                                            split_bits - cu_bits, config)) {
+            node.split = calculate_cu_cost(statistics, lambda, cu, true, split_bits) <
+                         calculate_cu_cost(statistics, lambda, cu, false, cu_bits);
+        }
+    }
     
+    cus.push_back(node);
+    
+    if (node.split) {
+        const int half = cu.size / 2;
+        for (int i = 0; i < 4; ++i) {
+            CodingUnit child;
+            child.x = cu.x + (i & 1) * half;
+            child.y = cu.y + (i >> 1) * half;
+            child.size = half;
+            child.depth = cu.depth + 1;
+            rdo_cu_split_decision(statistics, contexts, lambda, child, cus);
+        }
+    }
+}
+
+double H265Encoder::calculate_cu_cost(const processing::BlockStatistics& statistics, double lambda,
+                                      const CodingUnit& cu, bool split, double bits) {
+    // Simplified Rate-Distortion cost: residual cost of the DC prediction plus the
+    // signalling of the coded CUs
+    double cost = 0.0;
     if (split) {
-        // Cost of signaling split flags + smaller CUs
-        rate = 1.0 + (4 * 0.5); // Split flag + 4 smaller CUs
-        distortion = 50.0; // Estimated distortion when splitting
+        const int half = cu.size / 2;
+        for (int i = 0; i < 4; ++i) {
+            cost += processing::residual_rd_cost(
+                statistics.block(cu.x + (i & 1) * half, cu.y + (i >> 1) * half, half, half), lambda);
+        }
     } else {
-        // Cost of encoding this CU directly
-        rate = 10.0; // More bits for larger CU
-        distortion = 30.0; // Less distortion for larger CU
+        cost = processing::residual_rd_cost(statistics.block(cu.x, cu.y, cu.size, cu.size), lambda);
     }
     
-    return distortion + lambda * rate;
+    return cost + lambda * bits;
 }
 
-void H265Encoder::encode_coding_unit(utils::BitstreamWriter& writer, const CodingUnit& cu) {
-    // Encode split flag
-    writer.write_bit(cu.split ? 1 : 0);
+void H265Encoder::encode_coding_unit(SubstreamCoder& coder, CodingUnit& cu, bool is_intra,
+                                     processing::MotionEstimator& motion_estimator) {
+    // split_cu_flag is only coded for CUs inside the picture that may still split
+    const bool inside = cu.x + cu.size <= static_cast<int>(width_) && cu.y + cu.size <= static_cast<int>(height_);
+    if (inside && cu.depth < max_cu_depth_) {
+        coder.cabac.encode_cu_split_flag(coder.contexts.split_cu_flag[std::min(cu.depth, 2)], cu.split);
+    }
     
-    if (!cu.split) {
-        // Encode prediction mode
-        bool is_intra = (frame_count_ % gop_size_ == 0); // Simplified
-        writer.write_bit(is_intra ? 1 : 0);
-        
-        if (is_intra) {
-            encode_intra_prediction(writer, cu);
+    if (cu.split) {
+        return;
+    }
+    
+    cu.coded_blocks = 0;
+    if (is_intra) {
+        encode_intra_prediction(coder, cu);
+    } else {
+        encode_inter_prediction(coder, cu, motion_estimator);
+    }
+    
+    // QpY: the group QP once cu_qp_delta is coded, the predicted QP before that
+    store_block_info(cu, coder.previous_qp);
+}
+
+void H265Encoder::store_block_info(const CodingUnit& cu, int qp) {
+    processing::HevcDeblockingFilter::BlockInfo block;
+    block.intra = cu.pu.type == PredictionUnit::Type::INTRA_2Nx2N;
+    block.qp = static_cast<int8_t>(qp);
+    if (!block.intra) {
+        block.ref_idx = static_cast<int8_t>(cu.pu.ref_idx);
+        block.mv_x = cu.pu.mv_x;
+        block.mv_y = cu.pu.mv_y;
+    }
+    
+    // 8x8 DCT blocks are the transform edges. Inter CUs count as DC for the MPMs.
+    const int x1 = std::min<int>(cu.x + cu.size, width_);
+    const int y1 = std::min<int>(cu.y + cu.size, height_);
+    const size_t modes_stride = (width_ + 7) / 8;
+    for (int y = cu.y; y < y1; y += 8) {
+        for (int x = cu.x; x < x1; x += 8) {
+            block.coded = (cu.coded_blocks >> (((y - cu.y) >> 3) * 8 + ((x - cu.x) >> 3))) & 1;
+            deblocking_filter_.info(x, y) = block;
+            intra_modes_[(y >> 3) * modes_stride + (x >> 3)] = block.intra ? cu.pu.intra_mode : 1;
+        }
+    }
+}
+
+void H265Encoder::derive_intra_mpm(const SubstreamCoder& coder, const CodingUnit& cu, int mpm[3]) const {
+    // Neighbours outside the tile, not intra or (above) in the CTU row above count as DC
+    const size_t modes_stride = (width_ + 7) / 8;
+    const int ctu_y = cu.y / ctu_size_ * ctu_size_;
+    const int left = cu.x > coder.tile_x0 ? intra_modes_[(cu.y >> 3) * modes_stride + ((cu.x - 1) >> 3)] : 1;
+    const int above = cu.y > coder.tile_y0 && cu.y > ctu_y ? intra_modes_[((cu.y - 1) >> 3) * modes_stride + (cu.x >> 3)] : 1;
+    
+    if (left == above) {
+        if (left < 2) {
+            mpm[0] = 0; // Planar, DC, vertical
+            mpm[1] = 1;
+            mpm[2] = 26;
         } else {
-            encode_inter_prediction(writer, cu);
+            mpm[0] = left; // The direction and its two neighbours
+            mpm[1] = 2 + ((left + 29) % 32);
+            mpm[2] = 2 + ((left - 2 + 1) % 32);
         }
+        return;
+    }
+    mpm[0] = left;
+    mpm[1] = above;
+    mpm[2] = left != 0 && above != 0 ? 0 : (left != 1 && above != 1 ? 1 : 26);
+}
+
+void H265Encoder::encode_intra_prediction(SubstreamCoder& coder, CodingUnit& cu) {
+    // Intra 2Nx2N with one of the 35 luma modes, chosen on the SATD of the prediction
+    // from the reconstructed (unfiltered) neighbours. 64x64 CUs are predicted per 32x32
+    // TU; the decision looks at the first one.
+    cu.pu.type = PredictionUnit::Type::INTRA_2Nx2N;
+    cu.pu.intra_mode = 1;
+    
+    int mpm[3];
+    derive_intra_mpm(coder, cu, mpm);
+    
+    const int size = std::min(cu.size, 32);
+    const bool inside = cu.x + size <= static_cast<int>(width_) && cu.y + size <= static_cast<int>(height_);
+    if (inside) {
+        const ReferencePicture::Plane& luma = reconstruction_->plane(ReferencePicture::Y);
+        const int ctu_x = cu.x / ctu_size_ * ctu_size_, ctu_y = cu.y / ctu_size_ * ctu_size_;
+        const auto available = processing::intra_availability(
+            cu.x, cu.y, size, size, 2 * size, 2 * size, ctu_x, ctu_y, ctu_size_,
+            coder.tile_x0, coder.tile_y0, coder.tile_x1, coder.tile_y1);
+        processing::IntraEdges edges, filtered;
+        edges.load(luma.row(cu.y) + cu.x, luma.stride, 2 * size, 2 * size, available.above, available.left,
+                   available.corner);
+        filtered = edges;
+        processing::hevc_filter_edges(filtered, size, 2); // Mode 2 is filtered at every size but 4
+        
+        const int stride = static_cast<int>(current_frame_->luma_stride());
+        const uint8_t* source = current_frame_->luma() + static_cast<ptrdiff_t>(cu.y) * stride + cu.x;
+        const uint32_t lambda = processing::intra_lambda_sad(coder.qp);
+        uint8_t* prediction = coder.intra_prediction.data();
         
-        // Encode residual
-        encode_residual_quadtree(writer, cu.tu);
+        // SATD + lambda * rate, the rate priced from the current context of the flag. At the
+        // right edge of the intra refresh column only DC, horizontal and vertical: the other
+        // modes read above-right samples that are not refreshed yet.
+        processing::CABACRateEstimator estimator;
+        auto mode_cost = [&](int mode) {
+            const bool filter = processing::hevc_filters_edges(size, mode);
+            processing::predict_hevc(filter ? filtered : edges, size, mode, prediction, CTU::MAX_CU_SIZE);
+            ContextModel flag = coder.contexts.prev_intra_luma_pred_flag;
+            estimator.reset();
+            code_intra_luma_mode(estimator, flag, mode, mpm);
+            const uint64_t rate_cost = (lambda * estimator.rate() + (1u << (processing::RATE_FRAC_BITS + 3))) >>
+                                       (processing::RATE_FRAC_BITS + 4);
+            return processing::intra_satd(source, stride, prediction, CTU::MAX_CU_SIZE, size, size) +
+                   static_cast<uint32_t>(rate_cost);
+        };
+        static constexpr int REFRESH_EDGE_MODES[] = {1, 26, 10};
+        const auto best = intra_refresh_.reads_unrefreshed(cu.x, cu.size + size)
+            ? coder.intra_search.search_list(REFRESH_EDGE_MODES, 3, static_cast<uint32_t>(size * size), mode_cost)
+            : coder.intra_search.search_angular(processing::HEVC_INTRA_MODES, 4, mpm, 3,
+                                                static_cast<uint32_t>(size * size), mode_cost);
+        cu.pu.intra_mode = static_cast<uint8_t>(best.mode);
+    }
+    
+    code_intra_luma_mode(coder.cabac, coder.contexts.prev_intra_luma_pred_flag, cu.pu.intra_mode, mpm);
+    
+    encode_residual_quadtree(coder, cu, coder.intra_prediction.data(), CTU::MAX_CU_SIZE);
+}
+
+void H265Encoder::predict_intra_tu(SubstreamCoder& coder, const CodingUnit& cu, int x, int y, int size) {
+    // The TU predicts from the reconstruction of the TUs before it (8.4.4.1)
+    const ReferencePicture::Plane& luma = reconstruction_->plane(ReferencePicture::Y);
+    const int ctu_x = x / ctu_size_ * ctu_size_, ctu_y = y / ctu_size_ * ctu_size_;
+    const auto available = processing::intra_availability(
+        x, y, size, size, 2 * size, 2 * size, ctu_x, ctu_y, ctu_size_,
+        coder.tile_x0, coder.tile_y0, coder.tile_x1, coder.tile_y1);
+    
+    processing::IntraEdges edges;
+    edges.load(luma.row(y) + x, luma.stride, 2 * size, 2 * size, available.above, available.left, available.corner);
+    processing::hevc_filter_edges(edges, size, cu.pu.intra_mode);
+    processing::predict_hevc(edges, size, cu.pu.intra_mode,
+                             coder.intra_prediction.data() + (y - cu.y) * CTU::MAX_CU_SIZE + (x - cu.x),
+                             CTU::MAX_CU_SIZE);
+}
+
+void H265Encoder::encode_inter_prediction(SubstreamCoder& coder, CodingUnit& cu,
+                                          processing::MotionEstimator& motion_estimator) {
+    processing::MotionVector mv;
+    uint32_t ref_idx = 0;
+    
+    // Motion estimation for this CU (16x16 search block anchored at the CU origin)
+    const bool block_in_frame =
+        cu.x + processing::MotionEstimator::BLOCK_SIZE <= static_cast<int>(width_) &&
+        cu.y + processing::MotionEstimator::BLOCK_SIZE <= static_cast<int>(height_);
+    
+    // The pre-analysis vector (previous frame) seeds the search; CUs it found intra skip it.
+    // With intra refresh only the previous frame, behind the column only its refreshed part.
+    const auto* hint = rate_control_.analysis().hint(cu.x, cu.y);
+    const size_t references = intra_refresh_.enabled() ? std::min<size_t>(dpb_.size(), 1) : dpb_.size();
+    
+    if (block_in_frame && !(hint && hint->intra) && !intra_refresh_.forces_intra(cu.x, cu.size)) {
+        const int stride = static_cast<int>(current_frame_->luma_stride());
+        motion_estimator.set_reference_limit(intra_refresh_.reference_limit(cu.x), cu.size);
+        
+        for (size_t i = 0; i < references; ++i) {
+            const auto& reference = dpb_.get(i);
+            auto candidate = motion_estimator.estimate_diamond_search(
+                current_frame_->luma(), stride, reference->luma_view(), cu.x, cu.y,
+                hint && i == 0 ? hint->mv_x : 0, hint && i == 0 ? hint->mv_y : 0);
+            
+            if (candidate.valid) {
+                candidate = motion_estimator.refine_subpel(
+                    current_frame_->luma(), stride,
+                    reference->subpel_planes(processing::SubpelFilterType::HEVC_8TAP),
+                    cu.x, cu.y, candidate);
+            }
+            
+            if (candidate.cost < mv.cost) {
+                mv = candidate;
+                ref_idx = static_cast<uint32_t>(i);
+            }
+        }
     }
+    
+    if (!mv.valid) {
+        coder.cabac.encode_bit(coder.contexts.pred_mode_flag, true); // fallback to intra
+        encode_intra_prediction(coder, cu);
+        return;
+    }
+    
+    coder.cabac.encode_bit(coder.contexts.pred_mode_flag, false);
+    cu.pu.type = PredictionUnit::Type::INTER_2Nx2N;
+    cu.pu.mv_x = static_cast<int16_t>(mv.qpel_x());
+    cu.pu.mv_y = static_cast<int16_t>(mv.qpel_y());
+    cu.pu.ref_idx = static_cast<uint8_t>(ref_idx);
+    
+    // ref_idx_l0: truncated unary, two context-coded bins then bypass
+    const uint32_t max_ref_idx = static_cast<uint32_t>(dpb_.size()) - 1;
+    for (uint32_t i = 0; i < max_ref_idx; ++i) {
+        const bool bin = i < ref_idx;
+        if (i < 2) {
+            coder.cabac.encode_bit(coder.contexts.ref_idx[i], bin);
+        } else {
+            coder.cabac.encode_bypass(bin);
+        }
+        if (!bin) break;
+    }
+    
+    encode_mvd(coder, mv.qpel_x(), mv.qpel_y()); // Zero predictor (no AMVP yet)
+    
+    // Integer-pel motion compensated prediction from the padded reference
+    const auto& reference = dpb_.get(ref_idx)->plane(ReferencePicture::Y);
+    const uint8_t* prediction = reference.row(cu.y + mv.y) + cu.x + mv.x;
+    encode_residual_quadtree(coder, cu, prediction, reference.stride);
 }
 
-void H265Encoder::encode_intra_prediction(utils::BitstreamWriter& writer, const CodingUnit& cu) {
-    // HEVC has 35 intra prediction modes
-    writer.write_ue(0); // Simplified: always use DC mode
+void H265Encoder::encode_mvd(SubstreamCoder& coder, int mvd_x, int mvd_y) {
+    // mvd_coding(): greater0 / greater1 flags for both components, then EG1 remainders and signs
+    const int abs_x = std::abs(mvd_x);
+    const int abs_y = std::abs(mvd_y);
+    
+    coder.cabac.encode_bit(coder.contexts.abs_mvd_greater0_flag, abs_x > 0);
+    coder.cabac.encode_bit(coder.contexts.abs_mvd_greater0_flag, abs_y > 0);
+    if (abs_x > 0) coder.cabac.encode_bit(coder.contexts.abs_mvd_greater1_flag, abs_x > 1);
+    if (abs_y > 0) coder.cabac.encode_bit(coder.contexts.abs_mvd_greater1_flag, abs_y > 1);
     
-    // Encode intra prediction details
-    if (cu.size > 8) {
-        writer.write_bit(0); // not intra_luma_mpm_flag
-        writer.write_ue(0); // intra_luma_mpm_idx
+    auto encode_eg1 = [&](uint32_t value) {
+        // First-order Exp-Golomb: EG0 of value >> 1, then the low bit
+        coder.cabac.encode_ue_bypass(value >> 1);
+        coder.cabac.encode_bypass(value & 1);
+    };
+    
+    if (abs_x > 0) {
+        if (abs_x > 1) encode_eg1(abs_x - 2);
+        coder.cabac.encode_bypass(mvd_x < 0);
+    }
+    if (abs_y > 0) {
+        if (abs_y > 1) encode_eg1(abs_y - 2);
+        coder.cabac.encode_bypass(mvd_y < 0);
     }
 }
 
-void H265Encoder::encode_inter_prediction(utils::BitstreamWriter& writer, const CodingUnit& cu) {
-    processing::MotionEstimator motion_est;
+void H265Encoder::encode_residual_quadtree(SubstreamCoder& coder, CodingUnit& cu, const uint8_t* prediction,
+                                           int prediction_stride) {
+    // HEVC uses residual quad-tree (RQT) for transform unit splitting. Transforms are at most
+    // 32x32, so 64x64 CUs split once implicitly; smaller CUs code a single TU.
+    const int max_tu_size = 32;
+    const int tu_size = std::min(cu.size, max_tu_size);
+    const int trafo_depth = cu.size > max_tu_size ? 1 : 0;
     
-    // Motion estimation for this CU
-    auto mv = motion_est.estimate_diamond_search(
-        nullptr, reference_frames_.data(), width_, height_, // Simplified
-        cu.x, cu.y
-    );
+    if (cu.size <= max_tu_size && cu.size > 8) {
+        const int log2_size = cu.size == 32 ? 5 : 4;
+        coder.cabac.encode_bit(coder.contexts.split_transform_flag[5 - log2_size], false);
+    }
     
-    if (mv.valid) {
-        writer.write_bit(1); // use_inter_prediction
-        writer.write_se(mv.x); // mv_diff_x
-        writer.write_se(mv.y); // mv_diff_y
-        writer.write_ue(0); // ref_idx_l0
-    } else {
-        writer.write_bit(0); // fallback to intra
-        encode_intra_prediction(writer, cu);
+    for (int ty = cu.y; ty < cu.y + cu.size; ty += tu_size) {
+        for (int tx = cu.x; tx < cu.x + cu.size; tx += tu_size) {
+            if (tx >= static_cast<int>(width_) || ty >= static_cast<int>(height_)) {
+                continue;
+            }
+            
+            if (cu.pu.type == PredictionUnit::Type::INTRA_2Nx2N) {
+                predict_intra_tu(coder, cu, tx, ty, tu_size);
+            }
+            // The TU's coefficients go to its place in the CTU's arena
+            TransformUnit tu;
+            tu.coeffs = coder.coefficients.block(CTUBlockArena::Y, tx % ctu_size_, ty % ctu_size_, tu_size, tu_size);
+            tu.transform_size = static_cast<uint8_t>(tu_size);
+            transform_residual(cu, tx, ty, tu_size, prediction, prediction_stride, coder.qp, tu);
+            
+            // Reconstruction and the deblocking filter work on 8x8 DCT blocks
+            bool cbf = false;
+            for (int by = 0; by < tu_size; by += 8) {
+                for (int bx = 0; bx < tu_size; bx += 8) {
+                    if (tu.coeffs.sub(bx, by, 8, 8).any_nonzero()) {
+                        cu.coded_blocks |= uint64_t{1} << (((ty - cu.y + by) >> 3) * 8 + ((tx - cu.x + bx) >> 3));
+                        cbf = true;
+                    }
+                }
+            }
+            
+            coder.cabac.encode_bit(coder.contexts.cbf_luma[trafo_depth == 0 ? 1 : 0], cbf);
+            if (cbf) {
+                // Without coefficients the group keeps the predicted QP
+                if (!coder.qp_delta_coded) {
+                    encode_cu_qp_delta(coder, coder.qp - coder.previous_qp);
+                    coder.previous_qp = coder.qp;
+                    coder.qp_delta_coded = true;
+                }
+                encode_residual_coding(coder, tu);
+            }
+        }
     }
 }
 
-void H265Encoder::encode_residual_quadtree(utils::BitstreamWriter& writer, const TransformUnit& tu) {
-    // HEVC uses residual quad-tree (RQT) for transform unit splitting
-    bool split_transform_flag = (tu.transform_size > 8); // Simplified
-    writer.write_bit(split_transform_flag ? 1 : 0);
+void H265Encoder::transform_residual(const CodingUnit& cu, int x, int y, int size, const uint8_t* prediction,
+                                     int prediction_stride, int qp, TransformUnit& tu) {
+    const FrameView& frame = *current_frame_;
+    const int stride = static_cast<int>(frame.luma_stride());
+    const uint8_t* pred = prediction + static_cast<ptrdiff_t>(y - cu.y) * prediction_stride + (x - cu.x);
+    const ReferencePicture::Plane& luma = reconstruction_->plane(ReferencePicture::Y);
     
-    if (!split_transform_flag) {
-        // Encode transform coefficients for this TU
-        for (int i = 0; i < tu.transform_size; ++i) {
-            for (int j = 0; j < tu.transform_size; ++j) {
-                if (tu.coeffs[i][j] != 0) {
-                    writer.write_se(tu.coeffs[i][j]);
+    // The TU is transformed as a grid of 8x8 DCTs, then reconstructed the way a decoder
+    // would: dequantize, inverse DCT, add the prediction
+    std::array<std::array<int16_t, 8>, 8> residual;
+    std::array<std::array<double, 8>, 8> coeffs;
+    
+    for (int by = 0; by < size; by += 8) {
+        for (int bx = 0; bx < size; bx += 8) {
+            for (int i = 0; i < 8; ++i) {
+                // Rows past the picture edge repeat the last row
+                const int sy = std::min<int>(y + by + i, height_ - 1);
+                const uint8_t* src = frame.luma() + static_cast<size_t>(sy) * stride;
+                const uint8_t* p = pred + static_cast<ptrdiff_t>(by + i) * prediction_stride + bx;
+                for (int j = 0; j < 8; ++j) {
+                    const int sx = std::min<int>(x + bx + j, width_ - 1);
+                    residual[i][j] = static_cast<int16_t>(src[sx] - p[j]);
+                }
+            }
+            
+            dct_->forward_dct(residual, coeffs);
+            quantizer_->quantize_block(coeffs, qp);
+            
+            for (int i = 0; i < 8; ++i) {
+                for (int j = 0; j < 8; ++j) {
+                    tu.coeffs(by + i, bx + j) = static_cast<int16_t>(coeffs[i][j]);
+                    coeffs[i][j] = tu.coeffs(by + i, bx + j);
+                }
+            }
+            
+            quantizer_->dequantize_block(coeffs, qp);
+            dct_->inverse_dct(coeffs, residual);
+            
+            const int h = std::min<int>(8, static_cast<int>(height_) - (y + by));
+            const int w = std::min<int>(8, static_cast<int>(width_) - (x + bx));
+            for (int i = 0; i < h; ++i) {
+                const uint8_t* p = pred + static_cast<ptrdiff_t>(by + i) * prediction_stride + bx;
+                uint8_t* out = luma.row(y + by + i) + x + bx;
+                for (int j = 0; j < w; ++j) {
+                    out[j] = static_cast<uint8_t>(std::clamp(p[j] + residual[i][j], 0, 255));
                 }
             }
         }
     }
 }
 
-void H265Encoder::encode_sao_parameters(utils::BitstreamWriter& writer) {
-    // Sample Adaptive Offset - HEVC's advanced in-loop filter
-    writer.write_bit(1); // slice_sao_luma_flag
-    writer.write_bit(1); // slice_sao_chroma_flag
+void H265Encoder::encode_cu_qp_delta(SubstreamCoder& coder, int qp_delta) {
+    // cu_qp_delta_abs: TU prefix of up to 5 bins (first bin context 0, the rest context 1),
+    // EG0 bypass suffix from 5, then a bypass sign
+    const uint32_t abs_delta = static_cast<uint32_t>(std::abs(qp_delta));
+    const uint32_t prefix = std::min(abs_delta, 5u);
+    for (uint32_t i = 0; i < prefix; ++i) {
+        coder.cabac.encode_bit(coder.contexts.cu_qp_delta_abs[i == 0 ? 0 : 1], true);
+    }
+    if (prefix < 5) {
+        coder.cabac.encode_bit(coder.contexts.cu_qp_delta_abs[prefix == 0 ? 0 : 1], false);
+    } else {
+        coder.cabac.encode_ue_bypass(abs_delta - 5);
+    }
+    
+    if (abs_delta > 0) {
+        coder.cabac.encode_bypass(qp_delta < 0); // cu_qp_delta_sign_flag
+    }
+}
+
+void H265Encoder::encode_residual_coding(SubstreamCoder& coder, const TransformUnit& tu) {
+    // Simplified residual_coding(): 4x4 sub-blocks in raster order, each with a coded flag,
+    // significance and greater1 flags per coefficient, then bypass-coded levels and signs
+    for (int sy = 0; sy < tu.transform_size; sy += 4) {
+        for (int sx = 0; sx < tu.transform_size; sx += 4) {
+            const BlockView<const int16_t> block = tu.coeffs.sub(sx, sy, 4, 4);
+            const bool coded = block.any_nonzero();
+            
+            coder.cabac.encode_bit(coder.contexts.coded_sub_block_flag[(sx | sy) == 0 ? 1 : 0], coded);
+            if (!coded) {
+                continue;
+            }
+            
+            for (int i = 0; i < 16; ++i) {
+                const int level = block(i >> 2, i & 3);
+                const int position_class = std::min((i >> 2) + (i & 3), 3);
+                
+                coder.cabac.encode_bit(coder.contexts.sig_coeff_flag[position_class], level != 0);
+                if (level == 0) {
+                    continue;
+                }
+                
+                const uint32_t abs_level = static_cast<uint32_t>(std::abs(level));
+                coder.cabac.encode_bit(coder.contexts.coeff_abs_level_greater1_flag[position_class], abs_level > 1);
+                if (abs_level > 1) {
+                    coder.cabac.encode_ue_bypass(abs_level - 2); // coeff_abs_level_remaining
+                }
+                coder.cabac.encode_bypass(level < 0); // coeff_sign_flag
+            }
+        }
+    }
+}
+
+void H265Encoder::encode_sao_parameters(SubstreamCoder& coder, int x, int y) {
+    // Sample Adaptive Offset - HEVC's advanced in-loop filter. SAO is off in the first CTU
+    // of each tile and merged from the left (or above) neighbour everywhere else.
+    if (x > coder.tile_x0) {
+        coder.cabac.encode_bit(coder.contexts.sao_merge_flag, true); // sao_merge_left_flag
+        return;
+    }
+    if (y > coder.tile_y0) {
+        coder.cabac.encode_bit(coder.contexts.sao_merge_flag, true); // sao_merge_up_flag
+        return;
+    }
     
-    // Simplified SAO parameters
-    writer.write_ue(0); // sao_type_idx_luma (0=OFF, 1=BO, 2=EO)
-    writer.write_ue(0); // sao_type_idx_chroma
+    coder.cabac.encode_sao_type(coder.contexts.sao_type_idx, 0); // sao_type_idx_luma (0=OFF, 1=BO, 2=EO)
+    coder.cabac.encode_sao_type(coder.contexts.sao_type_idx, 0); // sao_type_idx_chroma
 }
 
 void H265Encoder::encode_deblocking_params(utils::BitstreamWriter& writer) {
-    // Deblocking filter parameters
+    // Deblocking filter parameters (the filter itself runs on the reconstruction)
     writer.write_bit(1); // deblocking_filter_override_flag
-    writer.write_bit(0); // pic_disable_deblocking_filter_flag
+    writer.write_bit(deblocking_ ? 0 : 1); // slice_deblocking_filter_disabled_flag
     
-    if (true) { // deblocking_filter_enabled
-        writer.write_se(0); // beta_offset_div2
-        writer.write_se(0); // tc_offset_div2
+    if (deblocking_) {
+        writer.write_se(0); // slice_beta_offset_div2
+        writer.write_se(0); // slice_tc_offset_div2
     }
 }
 
 void H265Encoder::set_bitrate(uint32_t bitrate) {
     bitrate_ = bitrate;
-    target_bits_per_frame_ = bitrate / fps_;
-    
-    // HEVC QP adjustment based on bitrate
-    current_qp_ = 32 + (bitrate < 1500000 ? 6 : 0) - (bitrate > 3000000 ? 6 : 0);
-    current_qp_ = std::max(22, std::min(42, current_qp_));
+    rate_control_.set_bitrate(bitrate);
+}
+
+void H265Encoder::set_rate_control(const RateControlConfig& config) {
+    RateControlConfig rc_config = config;
+    rc_config.fps = fps_;
+    bitrate_ = config.bitrate;
+    rate_control_.configure(rc_config);
+}
+
+void H265Encoder::set_max_reference_frames(uint32_t count) {
+    max_reference_frames_ = std::max(1u, std::min(16u, count));
+    dpb_.set_max_references(max_reference_frames_);
 }
 
 void H265Encoder::set_gop_size(uint32_t gop_size) {
     gop_size_ = std::max(1u, gop_size);
 }
 
+bool H265Encoder::set_intra_refresh(uint32_t period) {
+    intra_refresh_.set_period(period);
+    rate_control_.set_scene_cut_keyframes(period == 0);
+    return true;
+}
+
 uint32_t H265Encoder::get_encoded_size() const {
-    return frame_count_ * target_bits_per_frame_ / 8;
+    return static_cast<uint32_t>(rate_control_.total_bits() / 8);
+}
+
+void H265Encoder::reset() {
+    frame_count_ = 0;
+    last_keyframe_ = 0;
+    
+    // The last stream's settings do not carry over
+    const Settings& settings = initial_settings_;
+    gop_size_ = settings.gop_size;
+    speed_preset_ = settings.speed_preset;
+    entropy_coding_sync_ = settings.entropy_coding_sync;
+    tile_columns_ = settings.tile_columns;
+    tile_rows_ = settings.tile_rows;
+    deblocking_ = settings.deblocking;
+    intra_time_budget_ = settings.intra_time_budget;
+    set_intra_refresh(settings.intra_refresh_period);
+    rate_control_.reset(settings.rate_control);
+    bitrate_ = settings.rate_control.bitrate;
+    
+    dpb_.clear(); // Pictures go back to the reference pool
+    set_max_reference_frames(settings.max_reference_frames);
+    reconstruction_.reset();
+    intra_modes_evaluated_.store(0, std::memory_order_relaxed);
 }
 
 } // namespace codec
@@ -0,0 +1,442 @@
+// src/codec/rate_control.cpp
+#include "streaming/codec/rate_control.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace streaming {
+namespace codec {
+
+namespace {
+
+constexpr double BASE_BLOCK_COMPLEXITY = 80.0; // CRF reference complexity per lowres block
+constexpr double QP_STEP_LIMIT = 1.5874;  // 2^(4/6): at most 4 QP between P frames (ABR)
+constexpr double VBV_MIN_FILL = 0.1;      // Keep this fraction of the buffer after each frame
+constexpr double VBV_MAX_FILL = 0.95;     // CBR: spend bits before the buffer saturates
+constexpr uint32_t MAX_LOOKAHEAD = 40;
+
+} // namespace
+
+void RateController::Predictor::update(double qscale, double complexity, double bits) {
+    if (complexity <= 0.0) return;
+    // Fast decay: the model follows content and encoder changes within a few frames
+    count = count * 0.5 + 1.0;
+    coeff = coeff * 0.5 + bits * qscale / complexity;
+}
+
+RateController::RateController() {
+    configure(config_);
+}
+
+RateController::RateController(const RateControlConfig& config) {
+    configure(config);
+}
+
+RateController::~RateController() {
+    stop_lookahead();
+}
+
+double RateController::qp_to_qscale(double qp) {
+    return 0.85 * std::pow(2.0, (qp - 12.0) / 6.0);
+}
+
+double RateController::qscale_to_qp(double qscale) {
+    return 12.0 + 6.0 * std::log2(qscale / 0.85);
+}
+
+void RateController::configure(const RateControlConfig& config) {
+    stop_lookahead();
+
+    config_ = config;
+    config_.fps = config_.fps > 0.0 ? config_.fps : 30.0;
+    config_.lookahead_frames = std::min(config_.lookahead_frames, MAX_LOOKAHEAD);
+    config_.min_qp = std::clamp(config_.min_qp, 0, 51);
+    config_.max_qp = std::clamp(config_.max_qp, config_.min_qp, 51);
+    config_.aq_strength = std::max(0.0, config_.aq_strength);
+    config_.scenecut_threshold = std::clamp(config_.scenecut_threshold, 0.0, 1.0);
+
+    update_vbv_parameters();
+    reset_statistics();
+    analyzer_.set_aq_strength(config_.aq_strength);
+    lookahead_.clear();
+    next_to_analyze_ = 0;
+
+    // Pre-analysis runs on its own thread; callers that submit the next frame before
+    // encoding the current one get it analysed in parallel with the encode
+    if (needs_analysis() && !config_.external_analysis) {
+        start_lookahead();
+    }
+}
+
+void RateController::reset() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // The analysis thread is idle once it has caught up; the queued entries are recycled
+    done_condition_.wait(lock, [this] { return next_to_analyze_ >= lookahead_.size(); });
+    for (auto& entry : lookahead_) {
+        spare_entries_.push_back(std::move(entry));
+    }
+    lookahead_.clear();
+    next_to_analyze_ = 0;
+    reset_statistics();
+}
+
+void RateController::reset(const RateControlConfig& config) {
+    RateControlConfig in_place = config_;
+    in_place.bitrate = config.bitrate;
+    in_place.min_qp = config.min_qp;
+    in_place.max_qp = config.max_qp;
+    if (!(in_place == config)) {
+        configure(config); // Restarts the analysis thread
+        return;
+    }
+
+    reset();
+    set_qp_range(config.min_qp, config.max_qp);
+    set_bitrate(config.bitrate);
+}
+
+void RateController::reset_statistics() {
+    vbv_fullness_ = vbv_size_ * std::clamp(config_.vbv_initial_fullness, 0.0, 1.0);
+
+    predictors_[0] = Predictor();
+    predictors_[1] = Predictor();
+    short_term_cplx_sum_ = 0.0;
+    short_term_cplx_count_ = 0.0;
+    cplxr_sum_ = 0.0;
+    wanted_bits_window_ = 0.0;
+    last_p_qscale_ = 0.0;
+    abr_bits_ = 0.0;
+    abr_wanted_bits_ = 0.0;
+
+    total_bits_ = 0;
+    frames_ = 0;
+    underflows_ = 0;
+    last_qp_ = config_.mode == RateControlMode::CQP ? std::clamp(config_.qp, 0, 51) : 26;
+    frames_since_keyframe_ = 0;
+    current_.active = false;
+    current_.analysis = FrameAnalysis();
+
+    analyzer_.reset(); // No previous frame for the next analysis
+}
+
+void RateController::update_vbv_parameters() {
+    double max_rate = config_.max_bitrate;
+    if (max_rate <= 0.0) {
+        if (config_.mode == RateControlMode::CBR) max_rate = config_.bitrate;
+        if (config_.mode == RateControlMode::VBR) max_rate = 2.0 * config_.bitrate;
+    }
+    if (config_.mode == RateControlMode::CQP) max_rate = 0.0;
+
+    vbv_size_ = max_rate > 0.0 ? (config_.vbv_buffer_size ? config_.vbv_buffer_size : max_rate) : 0.0;
+    vbv_rate_ = max_rate / config_.fps;
+    vbv_fullness_ = std::min(vbv_fullness_, vbv_size_);
+
+    // CBR forgets old rate factor history at a pace tied to the buffer length
+    cbr_decay_ = 1.0;
+    if (vbv_size_ > 0.0 && config_.mode == RateControlMode::CBR) {
+        cbr_decay_ = 1.0 - vbv_rate_ / vbv_size_ * 0.5 *
+                     std::max(0.0, 1.5 - vbv_rate_ * config_.fps / std::max(1u, config_.bitrate));
+    }
+}
+
+void RateController::set_bitrate(uint32_t bitrate) {
+    if (bitrate == 0 || bitrate == config_.bitrate) return;
+
+    // Keep the learned complexity-to-bits relation, rescaled to the new target
+    wanted_bits_window_ *= static_cast<double>(bitrate) / config_.bitrate;
+    config_.bitrate = bitrate;
+    update_vbv_parameters();
+    if (frames_ == 0) {
+        // Stream not started (new or reset): begin with the new buffer's initial fullness
+        vbv_fullness_ = vbv_size_ * std::clamp(config_.vbv_initial_fullness, 0.0, 1.0);
+    }
+
+    abr_bits_ = 0.0;
+    abr_wanted_bits_ = 0.0;
+}
+
+void RateController::set_qp_range(int min_qp, int max_qp) {
+    config_.min_qp = std::clamp(min_qp, 0, 51);
+    config_.max_qp = std::clamp(max_qp, config_.min_qp, 51);
+}
+
+void RateController::submit_lookahead(const FrameView& frame) {
+    if (!lookahead_thread_.joinable()) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    push_lookahead_locked(frame);
+    work_condition_.notify_one();
+}
+
+void RateController::submit_analysis(const FrameAnalysis& analysis) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<LookaheadEntry> entry = take_entry_locked();
+    entry->analysis = analysis;
+    entry->done = true;
+
+    // next_to_analyze_ stays on the first entry the thread still has to analyse
+    if (next_to_analyze_ == lookahead_.size()) ++next_to_analyze_;
+    lookahead_.push_back(std::move(entry));
+}
+
+std::unique_ptr<RateController::LookaheadEntry> RateController::take_entry_locked() {
+    // Entries are recycled so their buffers are only allocated once
+    if (spare_entries_.empty()) {
+        return std::make_unique<LookaheadEntry>();
+    }
+    std::unique_ptr<LookaheadEntry> entry = std::move(spare_entries_.back());
+    spare_entries_.pop_back();
+    return entry;
+}
+
+void RateController::push_lookahead_locked(const FrameView& frame) {
+    std::unique_ptr<LookaheadEntry> entry = take_entry_locked();
+    entry->done = false;
+
+    // Only the luma plane is analysed; copy it so the caller may reuse the frame
+    const uint32_t stride = frame.luma_stride();
+    entry->width = static_cast<int>(frame.width);
+    entry->height = static_cast<int>(frame.height);
+    entry->luma.resize(static_cast<size_t>(entry->width) * entry->height);
+    for (int y = 0; y < entry->height; ++y) {
+        std::copy_n(frame.luma() + static_cast<size_t>(y) * stride, entry->width,
+                    entry->luma.data() + static_cast<size_t>(y) * entry->width);
+    }
+
+    lookahead_.push_back(std::move(entry));
+}
+
+void RateController::start_lookahead() {
+    stop_ = false;
+    lookahead_thread_ = std::thread(&RateController::lookahead_loop, this);
+}
+
+void RateController::stop_lookahead() {
+    if (!lookahead_thread_.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_condition_.notify_all();
+    lookahead_thread_.join();
+}
+
+void RateController::lookahead_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_condition_.wait(lock, [this] { return stop_ || next_to_analyze_ < lookahead_.size(); });
+        if (stop_) return;
+
+        // The entry stays valid while the encoder thread pushes and pops other entries;
+        // the front is only popped once it has been analysed
+        LookaheadEntry& entry = *lookahead_[next_to_analyze_];
+        if (!entry.done) {
+            lock.unlock();
+            analyzer_.analyze(entry.luma.data(), entry.width, entry.width, entry.height, entry.analysis);
+            lock.lock();
+        }
+
+        entry.done = true;
+        ++next_to_analyze_;
+        done_condition_.notify_all();
+    }
+}
+
+double RateController::frame_cost(const FrameAnalysis& analysis, bool is_keyframe) const {
+    const double cost = is_keyframe ? analysis.intra_cost : analysis.inter_cost;
+    return std::max(cost, static_cast<double>(std::max(1u, analysis.block_count)));
+}
+
+bool RateController::is_scene_cut(const FrameAnalysis& analysis, double threshold) {
+    return threshold > 0.0 && analysis.has_previous &&
+           analysis.inter_cost >= (1.0 - threshold) * analysis.intra_cost;
+}
+
+bool RateController::needs_analysis() const {
+    return config_.mode != RateControlMode::CQP || config_.aq_strength > 0.0 || config_.scenecut_threshold > 0.0;
+}
+
+int RateController::block_qp(uint32_t x, uint32_t y, uint32_t width, uint32_t height) const {
+    const double offset = current_.analysis.qp_offset(x, y, width, height);
+    return std::clamp(static_cast<int>(std::lround(last_qp_ + offset)), config_.min_qp, config_.max_qp);
+}
+
+int RateController::begin_frame(const FrameView& frame, bool keyframe_requested) {
+    current_.active = true;
+    future_costs_.clear();
+
+    // Analysis of this frame and of the analysed frames after it
+    FrameAnalysis& analysis = current_.analysis;
+    if (lookahead_thread_.joinable() || !lookahead_.empty()) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (lookahead_.empty()) {
+            push_lookahead_locked(frame);
+            work_condition_.notify_one();
+        }
+
+        // Wait for the whole window so the decision does not depend on thread timing
+        const size_t window = std::min<size_t>(lookahead_.size(), config_.lookahead_frames + 1);
+        done_condition_.wait(lock, [&] { return next_to_analyze_ >= window; });
+
+        std::swap(analysis, lookahead_.front()->analysis);
+        for (size_t i = 1; i < window; ++i) {
+            future_costs_.push_back(frame_cost(lookahead_[i]->analysis, false));
+        }
+
+        spare_entries_.push_back(std::move(lookahead_.front()));
+        lookahead_.erase(lookahead_.begin());
+        --next_to_analyze_;
+    } else if (needs_analysis() && !config_.external_analysis) {
+        analyzer_.analyze(frame.luma(), static_cast<int>(frame.luma_stride()), static_cast<int>(frame.width),
+                          static_cast<int>(frame.height), analysis);
+    } else {
+        analysis = FrameAnalysis();
+    }
+
+    // Keyframes where the encoder schedules them, and at scene cuts: the frame predicts
+    // hardly better from the previous one than on its own
+    bool is_keyframe = keyframe_requested;
+    current_.scene_cut = false;
+    if (!is_keyframe && frames_since_keyframe_ >= config_.min_keyframe_interval &&
+        is_scene_cut(analysis, config_.scenecut_threshold)) {
+        is_keyframe = scene_cut_keyframes_;
+        current_.scene_cut = true;
+    }
+    current_.is_keyframe = is_keyframe;
+    frames_since_keyframe_ = is_keyframe ? 1 : frames_since_keyframe_ + 1;
+
+    if (config_.mode == RateControlMode::CQP) {
+        last_qp_ = std::clamp(config_.qp, 0, 51);
+        current_.qscale = qp_to_qscale(last_qp_);
+        return last_qp_;
+    }
+
+    current_.cost = frame_cost(analysis, is_keyframe);
+
+    // Blurred P-frame complexity over recent history and, with lookahead, the frames ahead
+    const double p_cost = frame_cost(analysis, false);
+    short_term_cplx_sum_ = short_term_cplx_sum_ * 0.5 + p_cost;
+    short_term_cplx_count_ = short_term_cplx_count_ * 0.5 + 1.0;
+    double blur_sum = short_term_cplx_sum_;
+    double blur_count = short_term_cplx_count_;
+    double weight = 0.5;
+    for (double cost : future_costs_) {
+        blur_sum += weight * cost;
+        blur_count += weight;
+        weight *= 0.5;
+    }
+    current_.blurred = std::pow(blur_sum / blur_count, 1.0 - config_.qcompress);
+
+    const double frame_bits = config_.bitrate / config_.fps;
+    double qscale_p;
+
+    if (config_.mode == RateControlMode::CRF) {
+        const double base = std::max(1u, analysis.block_count) * BASE_BLOCK_COMPLEXITY;
+        const double rate_factor = std::pow(base, 1.0 - config_.qcompress) / qp_to_qscale(config_.crf);
+        qscale_p = current_.blurred / rate_factor;
+    } else if (cplxr_sum_ <= 0.0) {
+        // First frame: the size model alone, a keyframe may take a few frames' worth
+        const double target = frame_bits * (is_keyframe ? 3.0 : 1.0);
+        qscale_p = predictors_[is_keyframe].predict(1.0, current_.cost) / target;
+        if (is_keyframe) qscale_p *= config_.ip_factor;
+    } else {
+        const double rate_factor = wanted_bits_window_ / cplxr_sum_;
+        qscale_p = current_.blurred / rate_factor;
+
+        // Long-term correction towards the average bitrate
+        const double seconds = frames_ / config_.fps;
+        const double abr_buffer = 2.0 * config_.bitrate * std::max(1.0, std::sqrt(seconds));
+        qscale_p *= std::clamp(1.0 + (abr_bits_ - abr_wanted_bits_) / abr_buffer, 0.5, 2.0);
+
+        if (last_p_qscale_ > 0.0) {
+            qscale_p = std::clamp(qscale_p, last_p_qscale_ / QP_STEP_LIMIT, last_p_qscale_ * QP_STEP_LIMIT);
+        }
+    }
+
+    double qscale = is_keyframe ? qscale_p / config_.ip_factor : qscale_p;
+    if (vbv_size_ > 0.0) {
+        qscale = clip_vbv(qscale, current_.cost, is_keyframe, future_costs_);
+    }
+
+    const double qp = std::clamp(qscale_to_qp(qscale), static_cast<double>(config_.min_qp),
+                                 static_cast<double>(config_.max_qp));
+    last_qp_ = static_cast<int>(std::lround(qp));
+    current_.qscale = qp_to_qscale(last_qp_);
+    return last_qp_;
+}
+
+double RateController::clip_vbv(double qscale, double cost, bool is_keyframe,
+                                const std::vector<double>& future_costs) {
+    const double min_qscale = qp_to_qscale(config_.min_qp);
+    const double max_qscale = qp_to_qscale(config_.max_qp);
+    const Predictor& predictor = predictors_[is_keyframe];
+
+    // Lowest buffer level over the window when this frame is coded at `q` and the
+    // frames ahead at the equivalent P quantizer
+    auto min_fill = [&](double q) {
+        double fill = vbv_fullness_ - predictor.predict(q, cost);
+        double lowest = fill;
+        const double q_p = is_keyframe ? q * config_.ip_factor : q;
+        for (double future : future_costs) {
+            fill = std::min(fill + vbv_rate_, vbv_size_) - predictors_[0].predict(q_p, future);
+            lowest = std::min(lowest, fill);
+        }
+        return lowest;
+    };
+
+    if (config_.mode == RateControlMode::CBR) {
+        // Buffer about to saturate: the bits would be lost as padding, lower the quantizer
+        while (qscale > min_qscale &&
+               vbv_fullness_ - predictor.predict(qscale, cost) + vbv_rate_ > vbv_size_ * VBV_MAX_FILL) {
+            qscale /= 1.05;
+        }
+    }
+
+    // Never let the buffer underflow; without lookahead also cap one frame at half the level
+    const double floor = vbv_size_ * VBV_MIN_FILL;
+    while (qscale < max_qscale &&
+           (min_fill(qscale) < floor ||
+            (future_costs.empty() && predictor.predict(qscale, cost) > vbv_fullness_ * 0.5))) {
+        qscale *= 1.05;
+    }
+
+    return std::clamp(qscale, min_qscale, max_qscale);
+}
+
+void RateController::end_frame(size_t bytes) {
+    if (!current_.active) return;
+    current_.active = false;
+
+    const double bits = static_cast<double>(bytes) * 8.0;
+    const double frame_bits = config_.bitrate / config_.fps;
+    total_bits_ += static_cast<uint64_t>(bits);
+    ++frames_;
+
+    if (vbv_size_ > 0.0) {
+        vbv_fullness_ -= bits;
+        if (vbv_fullness_ < 0.0) {
+            ++underflows_;
+            vbv_fullness_ = 0.0;
+        }
+        vbv_fullness_ = std::min(vbv_fullness_ + vbv_rate_, vbv_size_);
+    }
+
+    if (config_.mode == RateControlMode::CQP) return;
+
+    predictors_[current_.is_keyframe].update(current_.qscale, current_.cost, bits);
+
+    const double qscale_p = current_.is_keyframe ? current_.qscale * config_.ip_factor : current_.qscale;
+    cplxr_sum_ = cplxr_sum_ * cbr_decay_ + bits * qscale_p / current_.blurred;
+    wanted_bits_window_ = wanted_bits_window_ * cbr_decay_ + frame_bits;
+    last_p_qscale_ = qscale_p;
+
+    abr_bits_ += bits;
+    abr_wanted_bits_ += frame_bits;
+}
+
+double RateController::average_bitrate() const {
+    return frames_ ? static_cast<double>(total_bits_) * config_.fps / frames_ : 0.0;
+}
+
+} // namespace codec
+} // namespace streaming
@@ -0,0 +1,320 @@
+// src/codec/reference_picture.cpp
+#include "streaming/codec/reference_picture.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace streaming {
+namespace codec {
+
+ReferencePicture::ReferencePicture(uint32_t width, uint32_t height)
+    : width_(width), height_(height) {
+    const int chroma_width = static_cast<int>((width + 1) / 2);
+    const int chroma_height = static_cast<int>((height + 1) / 2);
+
+    const std::array<std::array<int, 3>, 3> dims = {{
+        {static_cast<int>(width), static_cast<int>(height), PADDING},
+        {chroma_width, chroma_height, PADDING / 2},
+        {chroma_width, chroma_height, PADDING / 2}
+    }};
+
+    // One allocation for all three planes; every row starts on a cache line
+    std::array<size_t, 3> offsets{};
+    size_t total = 0;
+    for (int i = 0; i < 3; ++i) {
+        const int stride = (left_margin(dims[i][2]) + dims[i][0] + dims[i][2] + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        planes_[i].stride = stride;
+        planes_[i].width = dims[i][0];
+        planes_[i].height = dims[i][1];
+        planes_[i].padding = dims[i][2];
+        offsets[i] = total;
+        total += static_cast<size_t>(stride) * (dims[i][1] + 2 * dims[i][2]);
+    }
+
+    storage_.reset(static_cast<uint8_t*>(std::aligned_alloc(ALIGNMENT, total)));
+    if (!storage_) throw std::bad_alloc();
+    std::memset(storage_.get(), 128, total);
+
+    for (int i = 0; i < 3; ++i) {
+        Plane& p = planes_[i];
+        p.origin = storage_.get() + offsets[i] + static_cast<size_t>(p.padding) * p.stride +
+                   left_margin(p.padding);
+    }
+}
+
+void ReferencePicture::import_frame(const FrameView& frame) {
+    const int luma_stride = static_cast<int>(frame.luma_stride());
+    const int copy_w = std::min<int>(planes_[Y].width, frame.width);
+    const int copy_h = std::min<int>(planes_[Y].height, frame.height);
+    for (int y = 0; y < copy_h; ++y) {
+        std::memcpy(planes_[Y].row(y), frame.luma() + static_cast<size_t>(y) * luma_stride, copy_w);
+    }
+
+    // Luma-only frames keep neutral chroma
+    const bool has_chroma = frame.has_chroma();
+    for (int c = U; c <= V; ++c) {
+        Plane& p = planes_[c];
+        const PlaneView& src = frame.planes[c];
+        for (int y = 0; y < p.height; ++y) {
+            if (has_chroma && y < static_cast<int>((frame.height + 1) / 2)) {
+                std::memcpy(p.row(y), src.data + static_cast<size_t>(y) * src.stride,
+                            std::min<int>(p.width, src.stride));
+            } else {
+                std::memset(p.row(y), 128, p.width);
+            }
+        }
+    }
+
+    extend_borders();
+}
+
+void ReferencePicture::extend_rows(Plane& p, int first_row, int end_row) {
+    // The allocated margins may exceed the logical padding; fill all of it
+    const int left = left_margin(p.padding);
+    const int right = p.stride - left - p.width;
+
+    for (int y = first_row; y < end_row; ++y) {
+        uint8_t* row = p.row(y);
+        std::memset(row - left, row[0], left);
+        std::memset(row + p.width, row[p.width - 1], right);
+    }
+
+    if (first_row == 0 && end_row > 0) {
+        const uint8_t* first = p.row(0) - left;
+        for (int y = 1; y <= p.padding; ++y) {
+            std::memcpy(p.row(-y) - left, first, p.stride);
+        }
+    }
+    if (end_row == p.height) {
+        const uint8_t* last = p.row(p.height - 1) - left;
+        for (int y = 1; y <= p.padding; ++y) {
+            std::memcpy(p.row(p.height - 1 + y) - left, last, p.stride);
+        }
+    }
+}
+
+void ReferencePicture::extend_borders() {
+    for (Plane& p : planes_) {
+        extend_rows(p, 0, p.height);
+    }
+
+    subpel_valid_ = false;
+}
+
+void ReferencePicture::begin_decoding() {
+    subpel_valid_ = false;
+    decoded_rows_.store(0, std::memory_order_relaxed);
+}
+
+void ReferencePicture::report_rows(int rows) {
+    // Borders of the new rows first: readers may use them as soon as the count is published
+    const int done = decoded_rows_.load(std::memory_order_relaxed);
+    rows = std::min(rows, planes_[Y].height);
+    if (rows <= done) {
+        return;
+    }
+    extend_rows(planes_[Y], done, rows);
+    decoded_rows_.store(rows, std::memory_order_release);
+    decoded_rows_.notify_all();
+}
+
+void ReferencePicture::wait_rows(int rows) const {
+    rows = std::min(rows, planes_[Y].height);
+    int done = decoded_rows_.load(std::memory_order_acquire);
+    while (done < rows) {
+        decoded_rows_.wait(done, std::memory_order_acquire);
+        done = decoded_rows_.load(std::memory_order_acquire);
+    }
+}
+
+void ReferencePicture::finish_decoding() {
+    extend_rows(planes_[U], 0, planes_[U].height);
+    extend_rows(planes_[V], 0, planes_[V].height);
+    report_rows(planes_[Y].height);
+}
+
+processing::ReferencePlane ReferencePicture::luma_view() const {
+    const Plane& p = planes_[Y];
+    return processing::ReferencePlane{p.origin, p.stride, p.width, p.height, p.padding};
+}
+
+FrameView ReferencePicture::view() const {
+    FrameView frame;
+    frame.width = width_;
+    frame.height = height_;
+    frame.timestamp = picture_order;
+    frame.keyframe = is_keyframe;
+    for (int i = 0; i < 3; ++i) {
+        frame.planes[i] = {planes_[i].origin, static_cast<uint32_t>(planes_[i].stride)};
+    }
+    return frame;
+}
+
+const processing::HalfPelPlanes& ReferencePicture::subpel_planes(processing::SubpelFilterType type) {
+    if (!subpel_valid_ || subpel_.filter_type() != type) {
+        const Plane& p = planes_[Y];
+        subpel_.build(p.origin, p.stride, p.width, p.height, type);
+        subpel_valid_ = true;
+    }
+    return subpel_;
+}
+
+void ReferencePicture::predict_luma(processing::SubpelFilterType type, int qx, int qy, int block_w, int block_h,
+                                    uint8_t* dst, int dst_stride) const {
+    const Plane& p = planes_[Y];
+
+    if ((qx & 3) == 0 && (qy & 3) == 0) {
+        const int x = qx >> 2, y = qy >> 2;
+        if (x < -p.padding || y < -p.padding || x + block_w > p.width + p.padding ||
+            y + block_h > p.height + p.padding) {
+            throw std::out_of_range("Motion vector outside the reference picture");
+        }
+        for (int row = 0; row < block_h; ++row) {
+            std::memcpy(dst + static_cast<ptrdiff_t>(row) * dst_stride, p.row(y + row) + x, block_w);
+        }
+        return;
+    }
+
+    // Same limit as MotionEstimator::refine_subpel: inside the filtered part of the planes
+    const int limit = (processing::HalfPelPlanes::PADDING - 8) * 4;
+    if (qx < -limit || qy < -limit || qx > (p.width - block_w) * 4 + limit ||
+        qy > (p.height - block_h) * 4 + limit) {
+        throw std::out_of_range("Motion vector outside the reference picture");
+    }
+    // Cached planes when the encoder built them for motion search; otherwise (decoding)
+    // only this block is interpolated
+    if (subpel_valid_ && subpel_.filter_type() == type) {
+        subpel_.predict_block(qx, qy, block_w, block_h, dst, dst_stride);
+    } else {
+        processing::predict_block_direct(p.origin, p.stride, type, qx, qy, block_w, block_h, dst, dst_stride);
+    }
+}
+
+// Free list of shared_ptr control blocks. Every block handed out by one pool has the
+// same type, so any cached block fits the next request.
+struct ReferencePicturePool::ControlBlockCache {
+    std::mutex mutex;
+    std::vector<void*> blocks;
+
+    ~ControlBlockCache() {
+        for (void* block : blocks) {
+            ::operator delete(block);
+        }
+    }
+
+    void* get(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!blocks.empty()) {
+                void* block = blocks.back();
+                blocks.pop_back();
+                return block;
+            }
+        }
+        return ::operator new(size);
+    }
+
+    void put(void* block) {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.push_back(block);
+    }
+
+    void reserve(size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.reserve(count);
+    }
+};
+
+namespace {
+
+// shared_ptr allocator over the control block cache. The control block keeps a copy,
+// so the cache lives until the last picture handed out by the pool is released.
+template <typename T, typename Cache>
+struct ControlBlockAllocator {
+    using value_type = T;
+
+    std::shared_ptr<Cache> cache;
+
+    explicit ControlBlockAllocator(std::shared_ptr<Cache> c) : cache(std::move(c)) {}
+    template <typename U>
+    ControlBlockAllocator(const ControlBlockAllocator<U, Cache>& other) : cache(other.cache) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(cache->get(n * sizeof(T))); }
+    void deallocate(T* p, size_t) { cache->put(p); }
+
+    template <typename U>
+    bool operator==(const ControlBlockAllocator<U, Cache>& other) const { return cache == other.cache; }
+};
+
+} // namespace
+
+std::shared_ptr<ReferencePicturePool> ReferencePicturePool::create(uint32_t width, uint32_t height) {
+    std::shared_ptr<ReferencePicturePool> pool(new ReferencePicturePool(width, height));
+    pool->self_ = pool;
+    pool->control_blocks_ = std::make_shared<ControlBlockCache>();
+    return pool;
+}
+
+std::shared_ptr<ReferencePicture> ReferencePicturePool::acquire() {
+    std::unique_ptr<ReferencePicture> picture;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_list_.empty()) {
+            picture = std::move(free_list_.back());
+            free_list_.pop_back();
+        } else {
+            // Room for every picture, so releasing them (e.g. at an IDR) never allocates
+            ++allocated_;
+            free_list_.reserve(allocated_);
+            control_blocks_->reserve(allocated_);
+        }
+    }
+
+    if (!picture) {
+        picture = std::make_unique<ReferencePicture>(width_, height_);
+    }
+
+    // Released pictures go back to the pool, or are deleted if the pool is gone
+    std::weak_ptr<ReferencePicturePool> weak_pool = self_;
+    return std::shared_ptr<ReferencePicture>(picture.release(), [weak_pool](ReferencePicture* p) {
+        if (auto pool = weak_pool.lock()) {
+            pool->release(p);
+        } else {
+            delete p;
+        }
+    }, ControlBlockAllocator<ReferencePicture, ControlBlockCache>(control_blocks_));
+}
+
+void ReferencePicturePool::release(ReferencePicture* picture) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_list_.emplace_back(picture);
+}
+
+size_t ReferencePicturePool::allocated_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return allocated_;
+}
+
+size_t ReferencePicturePool::free_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_list_.size();
+}
+
+void DecodedPictureBuffer::set_max_references(size_t max_references) {
+    max_references_ = std::max<size_t>(1, max_references);
+    references_.reserve(max_references_ + 1);
+    while (references_.size() > max_references_) {
+        references_.pop_back();
+    }
+}
+
+void DecodedPictureBuffer::push(std::shared_ptr<ReferencePicture> picture) {
+    references_.insert(references_.begin(), std::move(picture));
+    if (references_.size() > max_references_) {
+        references_.pop_back();
+    }
+}
+
+} // namespace codec
+} // namespace streaming
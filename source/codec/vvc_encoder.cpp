@@ -2,14 +2,31 @@
 #include "streaming/codec/vvc_encoder.hpp"
 #include "streaming/processing/vvc_entropy.hpp"
 #include "streaming/processing/motion_estimation.hpp"
+#include "streaming/performance/profiler.hpp"
 #include <iostream>
 #include <cmath>
-#include <thread>
+#include <algorithm>
+#include <exception>
 #include <future>
+#include <limits>
 
 namespace streaming {
 namespace codec {
 
+namespace {
+
+// MPM list of a CU whose neighbours are not angular (8.4.2): planar, DC, vertical,
+// horizontal and the two directions next to vertical. The encoder keeps no mode map, so
+// every CU uses it.
+constexpr int DEFAULT_MPM[6] = {0, 1, 50, 18, 46, 54};
+
+VVCPredictionMode intra_pred_mode(int intra_mode) {
+    return intra_mode == 0 ? VVCPredictionMode::INTRA_PLANAR :
+           (intra_mode == 1 ? VVCPredictionMode::INTRA_DC : VVCPredictionMode::INTRA_ANGULAR);
+}
+
+} // namespace
+
 VVCEncoder::VVCEncoder() 
     : dct_(std::make_unique<processing::DCT>())
     , quantizer_(std::make_unique<processing::Quantizer>()) {
@@ -29,18 +46,60 @@ bool VVCEncoder::initialize(uint32_t width, uint32_t height, uint32_t fps, uint3
     fps_ = fps;
     bitrate_ = bitrate;
     frame_count_ = 0;
+    last_keyframe_ = 0;
     
     // VVC-specific initialization
     ctu_size_ = 128; // VVC supports up to 256x256 CTUs!
     max_mtt_depth_ = 4;
     current_qp_ = 35;
     
-    target_bits_per_frame_ = bitrate / fps;
+    // Frame QPs come from the rate controller (CBR at the target bitrate unless configured)
+    RateControlConfig rc_config = rate_control_.config();
+    rc_config.bitrate = bitrate;
+    rc_config.fps = fps;
+    rate_control_.configure(rc_config);
     
-    // Initialize reference frames and IBC buffer
-    reference_frames_.resize(width * height * 3 / 2);
+    // IBC buffer
     ibc_buffer_.resize(width * height);
     
+    // Substream and CTU scratch state
+    const int ctus_width = (width + ctu_size_ - 1) / ctu_size_;
+    const int ctus_height = (height + ctu_size_ - 1) / ctu_size_;
+    substream_writers_.assign(ctus_height, utils::BitstreamWriter());
+    row_cabacs_.assign(ctus_height, processing::VVCCABACEncoder());
+    sync_contexts_.assign(ctus_height, processing::VVCCABACEncoder::ContextSet());
+    row_progress_ = std::make_unique<std::atomic<int>[]>(ctus_height);
+    ctu_decisions_.assign(static_cast<size_t>(ctus_width) * ctus_height, {});
+    row_statistics_.assign(ctus_height, processing::BlockStatistics());
+    row_coefficients_.resize(ctus_height);
+    for (CTUBlockArena& arena : row_coefficients_) {
+        arena.configure(ctu_size_);
+    }
+    intra_modes_evaluated_.store(0, std::memory_order_relaxed);
+    
+    // CTU workers (shared pool if one was set)
+    if (parallel_processing_ && !thread_pool_) {
+        thread_pool_ = std::make_shared<performance::ThreadPool>(std::thread::hardware_concurrency());
+    }
+    
+    // Reference pictures come from a pool that may be shared with other encoders
+    if (!reference_pool_ || reference_pool_->width() != width || reference_pool_->height() != height) {
+        reference_pool_ = ReferencePicturePool::create(width, height);
+    }
+    dpb_.set_max_references(max_reference_frames_);
+    dpb_.clear();
+    
+    // What reset() returns to
+    initial_settings_.gop_size = gop_size_;
+    initial_settings_.intra_refresh_period = intra_refresh_period_;
+    initial_settings_.rate_control = rate_control_.config();
+    initial_settings_.complexity_level = complexity_level_;
+    initial_settings_.features = features_;
+    initial_settings_.parallel_processing = parallel_processing_;
+    initial_settings_.entropy_coding_sync = entropy_coding_sync_;
+    initial_settings_.max_reference_frames = max_reference_frames_;
+    initial_settings_.intra_time_budget = intra_time_budget_;
+    
     std::cout << "🚀 VVCEncoder initialized: " << width << "x" << height 
               << " @" << fps << "fps, " << bitrate << "bps" << std::endl;
     std::cout << "   CTU Size: " << ctu_size_ 
@@ -54,14 +113,31 @@ bool VVCEncoder::initialize(uint32_t width, uint32_t height, uint32_t fps, uint3
 }
 
 bool VVCEncoder::encode_frame(const VideoFrame& input, std::vector<uint8_t>& output) {
-    utils::BitstreamWriter writer;
-    
+    return encode_frame(FrameView::from(input), output);
+}
+
+bool VVCEncoder::encode_frame(const FrameView& input, std::vector<uint8_t>& output) {
     try {
-        if (!encode_vvc_nal_units(input, writer)) {
+        // Frame type and QP from the rate controller (keyframes every GOP, on request and
+        // at scene cuts; with intra refresh only on request); the coded size is fed back below
+        const bool keyframe_due = frame_count_ == 0 || input.keyframe ||
+                                  (intra_refresh_period_ == 0 && frame_count_ - last_keyframe_ >= gop_size_);
+        {
+            PROFILE_SCOPE("RateControl"); // Lookahead, scene cut and AQ analysis included
+            current_qp_ = rate_control_.begin_frame(input, keyframe_due);
+        }
+        is_keyframe_ = rate_control_.is_keyframe();
+        if (is_keyframe_) {
+            last_keyframe_ = frame_count_;
+        }
+        
+        writer_.clear();
+        if (!encode_vvc_nal_units(input, writer_)) {
             return false;
         }
         
-        output = writer.get_data();
+        writer_.swap_data(output);
+        rate_control_.end_frame(output.size());
         frame_count_++;
         
         return true;
@@ -72,8 +148,11 @@ bool VVCEncoder::encode_frame(const VideoFrame& input, std::vector<uint8_t>& out
     }
 }
 
-bool VVCEncoder::encode_vvc_nal_units(const VideoFrame& frame, utils::BitstreamWriter& writer) {
-    bool is_idr = (frame_count_ % gop_size_ == 0);
+bool VVCEncoder::encode_vvc_nal_units(const FrameView& frame, utils::BitstreamWriter& writer) {
+    const bool is_idr = is_keyframe_;
+    if (is_idr) {
+        dpb_.clear();
+    }
     
     // VVC NAL unit structure
     if (frame_count_ == 0) {
@@ -85,6 +164,21 @@ bool VVCEncoder::encode_vvc_nal_units(const VideoFrame& frame, utils::BitstreamW
     writer.write_bits(0x00000001, 32); // Start code
     writer.write_bits(0x20, 8); // AUD NAL unit type
     
+    // CTUs are coded into substreams first; the slice header needs their sizes
+    int ctus_width = (width_ + ctu_size_ - 1) / ctu_size_;
+    int ctus_height = (height_ + ctu_size_ - 1) / ctu_size_;
+    
+    current_frame_ = &frame;
+    try {
+        PROFILE_SCOPE("BlockCoding");
+        encode_slice_data(ctus_width, ctus_height);
+    } catch (...) {
+        current_frame_ = nullptr;
+        throw;
+    }
+    current_frame_ = nullptr;
+    const size_t substream_count = entropy_coding_sync_ ? ctus_height : 1;
+    
     // Slice NAL unit
     writer.write_bits(0x00000001, 32); // Start code
     writer.write_bit(0); // forbidden_zero_bit
@@ -92,39 +186,25 @@ bool VVCEncoder::encode_vvc_nal_units(const VideoFrame& frame, utils::BitstreamW
     writer.write_bits(is_idr ? 2 : 0, 6); // VVC NAL unit type
     writer.write_bits(0, 6); // nuh_temporal_id_plus1
     
+    entry_point_sizes_.clear();
+    for (size_t i = 0; i + 1 < substream_count; ++i) {
+        entry_point_sizes_.push_back(substream_writers_[i].get_data().size());
+    }
     encode_slice_header(writer, is_idr);
     
-    // Encode CTUs in parallel if enabled
-    int ctus_width = (width_ + ctu_size_ - 1) / ctu_size_;
-    int ctus_height = (height_ + ctu_size_ - 1) / ctu_size_;
-    
-    if (parallel_processing_ && complexity_level_ > 3) {
-        std::vector<std::future<void>> futures;
-        
-        for (int y = 0; y < ctus_height; ++y) {
-            for (int x = 0; x < ctus_width; ++x) {
-                futures.push_back(std::async(std::launch::async, [&, x, y]() {
-                    VVCCTU ctu;
-                    // Process CTU in parallel
-                    encode_ctu(writer, ctu, x * ctu_size_, y * ctu_size_);
-                }));
-            }
-        }
-        
-        // Wait for all CTUs to complete
-        for (auto& future : futures) {
-            future.get();
-        }
-    } else {
-        // Sequential processing
-        for (int y = 0; y < ctus_height; ++y) {
-            for (int x = 0; x < ctus_width; ++x) {
-                VVCCTU ctu;
-                encode_ctu(writer, ctu, x * ctu_size_, y * ctu_size_);
-            }
-        }
+    // Substreams are byte aligned; concatenating them in row order is deterministic
+    for (size_t i = 0; i < substream_count; ++i) {
+        writer.append(substream_writers_[i]);
     }
     
+    // The source frame becomes the next reference (no reconstruction loop yet)
+    PROFILE_SCOPE("References");
+    auto reference = reference_pool_->acquire();
+    reference->import_frame(frame);
+    reference->picture_order = frame_count_;
+    reference->is_keyframe = is_idr;
+    dpb_.push(std::move(reference));
+    
     return true;
 }
 
@@ -149,9 +229,187 @@ void VVCEncoder::encode_sps(utils::BitstreamWriter& writer) {
     writer.write_ue(ctu_size_ == 256 ? 3 : (ctu_size_ == 128 ? 2 : 1)); // log2_ctu_size_minus5
     writer.write_bit(features_.mip_enabled ? 1 : 0); // mip_flag
     writer.write_bit(features_.affine_enabled ? 1 : 0); // affine_flag
+    writer.write_bit(entropy_coding_sync_ ? 1 : 0); // sps_entropy_coding_sync_enabled_flag
+    writer.write_bit(entropy_coding_sync_ ? 1 : 0); // sps_entry_point_offsets_present_flag
+    writer.write_trailing_bits();
+}
+
+void VVCEncoder::encode_pps(utils::BitstreamWriter& writer) {
+    writer.write_bits(0x00000001, 32); // Start code
+    writer.write_bits(0x22, 8); // PPS NAL unit type
+    
+    writer.write_ue(0); // pps_pic_parameter_set_id
+    writer.write_ue(0); // pps_seq_parameter_set_id
+    writer.write_bit(0); // pps_no_pic_partition_flag (single tile)
+    writer.write_se(0); // pps_init_qp_minus26 (frame QP is sent per slice)
+    writer.write_trailing_bits();
+}
+
+void VVCEncoder::encode_slice_header(utils::BitstreamWriter& writer, bool is_idr) {
+    const std::vector<size_t>& entry_point_sizes = entry_point_sizes_;
+    writer.write_ue(0); // sh_slice_address
+    writer.write_ue(is_idr ? 2 : 1); // sh_slice_type (1=P, 2=I)
+    writer.write_se(current_qp_ - 26); // sh_qp_delta
+    
+    // Entry points: one per CTU row after the first
+    if (entropy_coding_sync_) {
+        writer.write_ue(static_cast<uint32_t>(entry_point_sizes.size())); // num_entry_points
+        
+        if (!entry_point_sizes.empty()) {
+            size_t max_size = *std::max_element(entry_point_sizes.begin(), entry_point_sizes.end());
+            uint8_t offset_len = 1;
+            while (offset_len < 32 && (max_size - 1) >> offset_len) {
+                offset_len++;
+            }
+            
+            writer.write_ue(offset_len - 1); // sh_entry_offset_len_minus1
+            for (size_t size : entry_point_sizes) {
+                writer.write_bits(static_cast<uint32_t>(size - 1), offset_len); // sh_entry_point_offset_minus1
+            }
+        }
+    }
+    
+    writer.write_trailing_bits(); // byte_alignment()
+}
+
+void VVCEncoder::encode_slice_data(int ctus_width, int ctus_height) {
+    const bool use_pool = parallel_processing_ && thread_pool_;
+    analysis_contexts_.init(current_qp_);
+    for (int row = 0; row < ctus_height; ++row) {
+        substream_writers_[row].clear();
+        row_progress_[row].store(0, std::memory_order_relaxed);
+    }
+    futures_.clear();
+    
+    if (entropy_coding_sync_) {
+        // WPP: rows run as a wavefront one CTU behind the row above
+        if (!use_pool) {
+            for (int row = 0; row < ctus_height; ++row) {
+                encode_ctu_row(row, ctus_width);
+            }
+            return;
+        }
+        
+        // Rows are queued top to bottom, so a row only waits on rows that already started
+        futures_.reserve(ctus_height);
+        for (int row = 0; row < ctus_height; ++row) {
+            futures_.push_back(thread_pool_->enqueue([this, row, ctus_width]() {
+                encode_ctu_row(row, ctus_width);
+            }));
+        }
+        
+        std::exception_ptr error;
+        for (auto& future : futures_) {
+            try {
+                future.get();
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+        futures_.clear();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return;
+    }
+    
+    // Single substream: analyse CTU rows in parallel, then entropy code in raster order
+    std::vector<std::vector<VVCPartitionType>>& decisions = ctu_decisions_;
+    
+    auto analyze_row = [&](int row) {
+        for (int x = 0; x < ctus_width; ++x) {
+            std::vector<VVCPartitionType>& ctu = decisions[row * ctus_width + x];
+            ctu.clear();
+            analyze_ctu(x * ctu_size_, row * ctu_size_, row_statistics_[row], ctu);
+        }
+    };
+    
+    if (use_pool) {
+        futures_.reserve(ctus_height);
+        for (int row = 0; row < ctus_height; ++row) {
+            futures_.push_back(thread_pool_->enqueue(analyze_row, row));
+        }
+        for (auto& future : futures_) {
+            future.wait();
+        }
+        for (auto& future : futures_) {
+            future.get(); // Rethrows the first failure
+        }
+        futures_.clear();
+    } else {
+        for (int row = 0; row < ctus_height; ++row) {
+            analyze_row(row);
+        }
+    }
+    
+    processing::VVCCABACEncoder& cabac = row_cabacs_[0];
+    processing::IntraModeSearch intra_search;
+    intra_search.set_time_budget(intra_time_budget_);
+    cabac.init_encoder(substream_writers_[0], current_qp_);
+    for (int row = 0; row < ctus_height; ++row) {
+        for (int x = 0; x < ctus_width; ++x) {
+            encode_ctu(cabac, x * ctu_size_, row * ctu_size_, decisions[row * ctus_width + x], intra_search,
+                       row_coefficients_[0]);
+        }
+    }
+    cabac.finish_substream(); // end_of_slice_one_bit
+    substream_writers_[0].write_trailing_bits();
+    intra_modes_evaluated_.fetch_add(intra_search.modes_evaluated(), std::memory_order_relaxed);
+}
+
+void VVCEncoder::encode_ctu_row(int row, int ctus_width) {
+    utils::BitstreamWriter& writer = substream_writers_[row];
+    processing::VVCCABACEncoder& cabac = row_cabacs_[row];
+    std::atomic<int>* progress = row_progress_.get();
+    processing::IntraModeSearch intra_search;
+    intra_search.set_time_budget(intra_time_budget_);
+    cabac.init_encoder(writer, current_qp_);
+    
+    try {
+        for (int x = 0; x < ctus_width; ++x) {
+            if (row > 0) {
+                // The CTU above must be finished (VVC WPP has a one-CTU delay)
+                const int needed = std::min(x + 1, ctus_width);
+                int done = progress[row - 1].load(std::memory_order_acquire);
+                while (done < needed) {
+                    progress[row - 1].wait(done, std::memory_order_acquire);
+                    done = progress[row - 1].load(std::memory_order_acquire);
+                }
+                
+                // Contexts after the first CTU of the row above
+                if (x == 0) {
+                    cabac.load_contexts(sync_contexts_[row - 1]);
+                }
+            }
+            
+            std::vector<VVCPartitionType>& decisions = ctu_decisions_[row * ctus_width + x];
+            decisions.clear();
+            analyze_ctu(x * ctu_size_, row * ctu_size_, row_statistics_[row], decisions);
+            encode_ctu(cabac, x * ctu_size_, row * ctu_size_, decisions, intra_search, row_coefficients_[row]);
+            
+            if (x == 0) {
+                sync_contexts_[row] = cabac.contexts();
+            }
+            
+            progress[row].store(x + 1, std::memory_order_release);
+            progress[row].notify_all();
+        }
+        
+        cabac.finish_substream(); // end_of_subset_one_bit / end_of_slice_one_bit
+        writer.write_trailing_bits(); // byte_alignment()
+        intra_modes_evaluated_.fetch_add(intra_search.modes_evaluated(), std::memory_order_relaxed);
+    } catch (...) {
+        // Release the row below so it does not wait forever
+        progress[row].store(ctus_width, std::memory_order_release);
+        progress[row].notify_all();
+        throw;
+    }
 }
 
-void VVCEncoder::encode_ctu(utils::BitstreamWriter& writer, const VVCCTU& ctu, int x, int y) {
+void VVCEncoder::analyze_ctu(int x, int y, processing::BlockStatistics& statistics,
+                             std::vector<VVCPartitionType>& decisions) {
+    statistics.compute(current_frame_->luma(), current_frame_->luma_stride(), width_, height_, x, y, ctu_size_);
+    
     VVCCodingUnit root_cu;
     root_cu.x = x;
     root_cu.y = y;
@@ -159,126 +417,209 @@ void VVCEncoder::encode_ctu(utils::BitstreamWriter& writer, const VVCCTU& ctu, i
     root_cu.height = ctu_size_;
     
     double best_cost = std::numeric_limits<double>::max();
-    mtt_partition_decision(root_cu, best_cost);
-    
-    encode_mtt_structure(writer, root_cu);
-}
-
-void VVCEncoder::mtt_partition_decision(VVCCodingUnit& cu, double& best_cost) {
-    // VVC'nin Multi-Type Tree partitioning kararı
-    std::vector<VVCPartitionType> candidates;
-    
-    // Complexity-based candidate selection
-    if (complexity_level_ >= 8) {
-        // Full MTT: Quadtree + Binary Tree + Ternary Tree
-        candidates = {
-            VVCPartitionType::NO_SPLIT,
-            VVCPartitionType::QT_SPLIT,
-            VVCPartitionType::BT_HORZ_SPLIT,
-            VVCPartitionType::BT_VERT_SPLIT,
-            VVCPartitionType::TT_HORZ_SPLIT,
-            VVCPartitionType::TT_VERT_SPLIT
-        };
-    } else if (complexity_level_ >= 5) {
-        // Medium: QT + BT
-        candidates = {
-            VVCPartitionType::NO_SPLIT,
-            VVCPartitionType::QT_SPLIT,
-            VVCPartitionType::BT_HORZ_SPLIT,
-            VVCPartitionType::BT_VERT_SPLIT
-        };
-    } else {
-        // Simple: QT only
-        candidates = {
-            VVCPartitionType::NO_SPLIT,
-            VVCPartitionType::QT_SPLIT
-        };
-    }
+    mtt_partition_decision(statistics, root_cu, best_cost, decisions);
+}
+
+void VVCEncoder::encode_ctu(processing::VVCCABACEncoder& cabac, int x, int y,
+                            const std::vector<VVCPartitionType>& decisions,
+                            processing::IntraModeSearch& intra_search, CTUBlockArena& coefficients) {
+    intra_search.begin_ctu();
+    coefficients.clear();
+    
+    VVCCodingUnit root_cu;
+    root_cu.x = x;
+    root_cu.y = y;
+    root_cu.width = ctu_size_;
+    root_cu.height = ctu_size_;
+    
+    size_t decision_index = 0;
+    root_cu.partition_type = decisions[decision_index++];
+    encode_mtt_structure(cabac, root_cu, decisions, decision_index, intra_search, coefficients);
+}
+
+void VVCEncoder::mtt_partition_decision(const processing::BlockStatistics& statistics, VVCCodingUnit& cu,
+                                        double& best_cost, std::vector<VVCPartitionType>& decisions) {
+    // VVC'nin Multi-Type Tree partitioning kararı: one level at a time, candidates limited
+    // by the speed preset of the complexity level and pruned on the block statistics
+    static constexpr VVCPartitionType SPLITS[] = {
+        VVCPartitionType::QT_SPLIT,
+        VVCPartitionType::BT_HORZ_SPLIT,
+        VVCPartitionType::BT_VERT_SPLIT,
+        VVCPartitionType::TT_HORZ_SPLIT,
+        VVCPartitionType::TT_VERT_SPLIT
+    };
+    const auto& config = processing::partition_search_config((10 - complexity_level_) * 9 / 10);
+    
+    // Reserve this CU's slot so decisions stay in pre-order
+    const size_t slot = decisions.size();
+    decisions.push_back(VVCPartitionType::NO_SPLIT);
+    
+    // VVC-specific lambda, at the block's adaptive-quantization QP: flat areas get a lower
+    // lambda and so finer partitions
+    const int qp = rate_control_.block_qp(cu.x, cu.y, cu.width, cu.height);
+    const double lambda = 0.57 * std::pow(2.0, (qp - 12) / 3.0);
     
     VVCPartitionType best_partition = VVCPartitionType::NO_SPLIT;
-    best_cost = std::numeric_limits<double>::max();
+    best_cost = evaluate_mtt_partition_cost(statistics, lambda, cu, VVCPartitionType::NO_SPLIT);
     
-    for (auto partition : candidates) {
-        double cost = evaluate_mtt_partition_cost(cu, partition);
-        if (cost < best_cost) {
-            best_cost = cost;
-            best_partition = partition;
+    double extra_split_bits = std::numeric_limits<double>::max();
+    for (const VVCPartitionType partition : SPLITS) {
+        if (is_partition_allowed(cu, partition, config)) {
+            extra_split_bits = std::min(extra_split_bits, calculate_mtt_partition_rate(cu, partition) -
+                                                          calculate_mtt_partition_rate(cu, VVCPartitionType::NO_SPLIT));
+        }
+    }
+    
+    const auto stats = statistics.block(cu.x, cu.y, cu.width, cu.height);
+    if (extra_split_bits != std::numeric_limits<double>::max() &&
+        !processing::partition_is_final(stats, lambda, extra_split_bits, config)) {
+        for (const VVCPartitionType partition : SPLITS) {
+            if (!is_partition_allowed(cu, partition, config)) continue;
+            if (partition != VVCPartitionType::QT_SPLIT) {
+                const bool across_rows = partition == VVCPartitionType::BT_HORZ_SPLIT ||
+                                         partition == VVCPartitionType::TT_HORZ_SPLIT;
+                if (!processing::split_direction_useful(stats, across_rows, config)) continue;
+            }
+            
+            const double cost = evaluate_mtt_partition_cost(statistics, lambda, cu, partition);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_partition = partition;
+            }
         }
     }
     
     cu.partition_type = best_partition;
+    decisions[slot] = best_partition;
     
     // Recursive partitioning for QT/BT/TT
     if (cu.partition_type != VVCPartitionType::NO_SPLIT) {
-        int num_parts = 2; // BT/TT
-        if (cu.partition_type == VVCPartitionType::QT_SPLIT) {
-            num_parts = 4;
-        } else if (cu.partition_type == VVCPartitionType::TT_HORZ_SPLIT || 
-                  cu.partition_type == VVCPartitionType::TT_VERT_SPLIT) {
-            num_parts = 3;
-        }
+        int num_parts = get_num_children(cu.partition_type);
         
         for (int i = 0; i < num_parts; ++i) {
             VVCCodingUnit child_cu;
             setup_child_cu(cu, child_cu, i);
             
             double child_cost;
-            mtt_partition_decision(child_cu, child_cost);
+            mtt_partition_decision(statistics, child_cu, child_cost, decisions);
             best_cost += child_cost;
         }
     }
 }
 
-void VVCEncoder::encode_mtt_structure(utils::BitstreamWriter& writer, const VVCCodingUnit& cu) {
-    processing::VVCCABACEncoder cabac;
-    
+void VVCEncoder::encode_mtt_structure(processing::VVCCABACEncoder& cabac, const VVCCodingUnit& cu,
+                                      const std::vector<VVCPartitionType>& decisions, size_t& decision_index,
+                                      processing::IntraModeSearch& intra_search, CTUBlockArena& coefficients) {
     // Encode partition type
-    cabac.encode_mtt_split(writer, cu.partition_type);
+    cabac.encode_mtt_split(cu.partition_type);
     
     if (cu.partition_type == VVCPartitionType::NO_SPLIT) {
         // Encode this CU
-        cabac.encode_pred_mode(writer, cu.pred_mode);
+        const int intra_mode = decide_intra_mode(cu, intra_search, cabac.contexts());
+        cabac.encode_pred_mode(intra_pred_mode(intra_mode));
+        cabac.encode_intra_luma_mode(intra_mode, DEFAULT_MPM);
         
         // VVC advanced features
         if (features_.mip_enabled) {
-            cabac.encode_mip_flag(writer, cu.use_mip);
+            cabac.encode_mip_flag(cu.use_mip);
         }
         if (features_.affine_enabled) {
-            cabac.encode_affine_flag(writer, cu.use_affine);
+            cabac.encode_affine_flag(cu.use_affine);
         }
         if (features_.ibc_enabled) {
-            cabac.encode_ibc_flag(writer, cu.use_ibc);
+            cabac.encode_ibc_flag(cu.use_ibc);
         }
         
         // Encode prediction data
         if (cu.use_affine) {
-            encode_affine_motion(writer, cu);
+            encode_affine_motion(cabac, cu);
         }
         if (cu.use_gpm) {
-            encode_geometric_partition(writer, cu);
+            encode_geometric_partition(cabac, cu);
         }
         
-        // Encode transform data
-        encode_transform_info(writer, cu.transform);
+        // Encode transform data, from the CU's place in the CTU's arena
+        VVCTransformUnit tu = cu.transform;
+        tu.coeffs = coefficients.block(CTUBlockArena::Y, cu.x % ctu_size_, cu.y % ctu_size_, tu.tr_size, tu.tr_size);
+        encode_transform_info(cabac, tu);
     } else {
         // Recursively encode child CUs
         int num_children = get_num_children(cu.partition_type);
         for (int i = 0; i < num_children; ++i) {
             VVCCodingUnit child_cu;
             setup_child_cu(cu, child_cu, i);
-            encode_mtt_structure(writer, child_cu);
+            child_cu.partition_type = decisions[decision_index++];
+            encode_mtt_structure(cabac, child_cu, decisions, decision_index, intra_search, coefficients);
+        }
+    }
+}
+
+int VVCEncoder::decide_intra_mode(const VVCCodingUnit& cu, processing::IntraModeSearch& search,
+                                  const processing::VVCCABACEncoder::ContextSet& contexts) const {
+    const int w = cu.width, h = cu.height;
+    if (!current_frame_ || cu.x + w > static_cast<int>(width_) || cu.y + h > static_cast<int>(height_) ||
+        w % 4 != 0 || h % 4 != 0 || w > processing::IntraEdges::MAX_SIZE || h > processing::IntraEdges::MAX_SIZE) {
+        return 1; // DC across the picture border
+    }
+    
+    // Open loop: the neighbouring source samples stand in for the reconstruction
+    const int stride = static_cast<int>(current_frame_->luma_stride());
+    const uint8_t* source = current_frame_->luma() + static_cast<ptrdiff_t>(cu.y) * stride + cu.x;
+    const int ctu_x = cu.x / ctu_size_ * ctu_size_, ctu_y = cu.y / ctu_size_ * ctu_size_;
+    const auto available = processing::intra_availability(
+        cu.x, cu.y, w, h, w + h, w + h, ctu_x, ctu_y, ctu_size_,
+        0, 0, static_cast<int>(width_), static_cast<int>(height_));
+    processing::IntraEdges edges;
+    edges.load(source, stride, w + h, w + h, available.above, available.left, available.corner);
+    
+    alignas(32) uint8_t prediction[128 * 128];
+    const uint32_t lambda = processing::intra_lambda_sad(current_qp_);
+    
+    // SATD + lambda * rate of pred_mode and the intra_luma syntax under the current contexts
+    processing::VVCRateEstimator estimator(contexts);
+    const auto best = search.search_angular(
+        processing::VVC_INTRA_MODES, 8, DEFAULT_MPM, 6, static_cast<uint32_t>(w * h), [&](int mode) {
+            processing::predict_vvc(edges, w, h, mode, prediction, 128);
+            estimator.reset(contexts);
+            estimator.encode_pred_mode(intra_pred_mode(mode));
+            estimator.encode_intra_luma_mode(mode, DEFAULT_MPM);
+            const uint64_t rate_cost = (lambda * estimator.rate() + (1u << (processing::RATE_FRAC_BITS + 3))) >>
+                                       (processing::RATE_FRAC_BITS + 4);
+            return processing::intra_satd(source, stride, prediction, 128, w, h) + static_cast<uint32_t>(rate_cost);
+        });
+    return best.mode;
+}
+
+void VVCEncoder::encode_transform_info(processing::VVCCABACEncoder& cabac, const VVCTransformUnit& tu) {
+    const bool coded = tu.coeffs.any_nonzero();
+    cabac.encode_cbf(coded); // tu_y_coded_flag
+    if (!coded) return;
+    
+    cabac.encode_bypass_bins(tu.tr_type, 2); // mts_idx
+    for (int i = 0; i < tu.coeffs.height; ++i) {
+        for (int j = 0; j < tu.coeffs.width; ++j) {
+            cabac.encode_se_bypass(tu.coeffs(i, j));
         }
     }
 }
 
-void VVCEncoder::encode_affine_motion(utils::BitstreamWriter& writer, const VVCCodingUnit& cu) {
-    // VVC Affine motion prediction - 4/6 parameter model
-    writer.write_bit(0); // affine_type (4-param or 6-param)
+void VVCEncoder::encode_geometric_partition(processing::VVCCABACEncoder& cabac, const VVCCodingUnit&) {
+    // GPM: partition index plus the two merge candidates. The CU carries no GPM data yet,
+    // so the first partition and candidate are coded.
+    cabac.encode_gpm_info(0, 0); // merge_gpm_partition_idx
+    cabac.encode_se_bypass(0); // merge_gpm_idx0
+    cabac.encode_se_bypass(0); // merge_gpm_idx1
+}
+
+void VVCEncoder::encode_affine_motion(processing::VVCCABACEncoder& cabac, const VVCCodingUnit&) {
+    // VVC Affine motion prediction - 4/6 parameter model. No affine motion search yet: the
+    // CU carries no control point MVs, so zero differences are coded.
+    cabac.encode_bypass_bins(0, 1); // affine_type (4-param or 6-param)
     
     // Control point motion vectors
     for (int i = 0; i < 3; ++i) { // Up to 3 control points
-        writer.write_se(0); // mv_diff_x (simplified)
-        writer.write_se(0); // mv_diff_y
+        cabac.encode_se_bypass(0); // mv_diff_x (simplified)
+        cabac.encode_se_bypass(0); // mv_diff_y
     }
 }
 
@@ -314,22 +655,80 @@ void VVCEncoder::enable_advanced_tools(const VVCAdvancedFeatures& features) {
 
 void VVCEncoder::set_bitrate(uint32_t bitrate) {
     bitrate_ = bitrate;
-    target_bits_per_frame_ = bitrate / fps_;
-    
-    // VVC QP adjustment - daha agresif bitrate control
-    current_qp_ = 35 + (bitrate < 1500000 ? 10 : 0) - (bitrate > 3000000 ? 10 : 0);
-    current_qp_ = std::max(15, std::min(55, current_qp_));
+    rate_control_.set_bitrate(bitrate);
+}
+
+void VVCEncoder::set_rate_control(const RateControlConfig& config) {
+    RateControlConfig rc_config = config;
+    rc_config.fps = fps_;
+    bitrate_ = config.bitrate;
+    rate_control_.configure(rc_config);
+}
+
+void VVCEncoder::set_max_reference_frames(uint32_t count) {
+    max_reference_frames_ = std::max(1u, std::min(16u, count));
+    dpb_.set_max_references(max_reference_frames_);
 }
 
 // Yardımcı fonksiyonlar
-double VVCEncoder::evaluate_mtt_partition_cost(const VVCCodingUnit& cu, VVCPartitionType partition) {
-    double distortion = calculate_vvc_distortion(cu);
-    double rate = calculate_mtt_partition_rate(cu, partition);
+bool VVCEncoder::is_partition_allowed(const VVCCodingUnit& cu, VVCPartitionType partition,
+                                      const processing::PartitionSearchConfig& config) const {
+    constexpr int MIN_CU_SIZE = 8;
+    // Quad-tree splits only above the multi-type tree; binary / ternary ones up to the depth
+    // limit of the spec (max_mtt_depth_) and of the preset
+    const int min_size = std::max(2 * MIN_CU_SIZE, config.min_block_size + 1);
+    const bool mtt = config.rectangular && cu.mtt_depth < std::min(max_mtt_depth_, config.max_mtt_depth);
     
-    // VVC-specific lambda
-    double lambda = 0.57 * std::pow(2.0, (current_qp_ - 12) / 3.0);
+    switch (partition) {
+        case VVCPartitionType::NO_SPLIT:      return true;
+        case VVCPartitionType::QT_SPLIT:      return cu.mtt_depth == 0 && cu.width == cu.height && cu.width >= min_size;
+        case VVCPartitionType::BT_HORZ_SPLIT: return mtt && cu.height >= min_size;
+        case VVCPartitionType::BT_VERT_SPLIT: return mtt && cu.width >= min_size;
+        case VVCPartitionType::TT_HORZ_SPLIT: return mtt && config.ternary && cu.height >= 2 * min_size;
+        case VVCPartitionType::TT_VERT_SPLIT: return mtt && config.ternary && cu.width >= 2 * min_size;
+    }
+    return false;
+}
+
+double VVCEncoder::evaluate_mtt_partition_cost(const processing::BlockStatistics& statistics, double lambda,
+                                               const VVCCodingUnit& cu, VVCPartitionType partition) {
+    // Residual cost of the partition = residual cost of the blocks it produces
+    double cost = 0.0;
+    if (partition == VVCPartitionType::NO_SPLIT) {
+        cost = calculate_vvc_residual_cost(statistics, lambda, cu);
+    } else {
+        VVCCodingUnit parent;
+        parent.x = cu.x;
+        parent.y = cu.y;
+        parent.width = cu.width;
+        parent.height = cu.height;
+        parent.partition_type = partition;
+        
+        for (int i = 0; i < get_num_children(partition); ++i) {
+            VVCCodingUnit child;
+            setup_child_cu(parent, child, i);
+            cost += calculate_vvc_residual_cost(statistics, lambda, child);
+        }
+    }
     
-    return distortion + lambda * rate;
+    return cost + lambda * calculate_mtt_partition_rate(cu, partition);
+}
+
+double VVCEncoder::calculate_vvc_residual_cost(const processing::BlockStatistics& statistics, double lambda,
+                                               const VVCCodingUnit& cu) const {
+    // Flat (DC) prediction residual: luma D + lambda * R, clipped to the frame
+    return processing::residual_rd_cost(statistics.block(cu.x, cu.y, cu.width, cu.height), lambda);
+}
+
+double VVCEncoder::calculate_mtt_partition_rate(const VVCCodingUnit& cu, VVCPartitionType partition) const {
+    // Split flags, priced from the initial contexts of the slice (analysis runs ahead of
+    // the coder), plus an approximate per-CU overhead (mode, flags, cbf)
+    constexpr double CU_OVERHEAD_BITS = 8.0;
+    (void)cu;
+    
+    processing::VVCRateEstimator estimator(analysis_contexts_);
+    estimator.encode_mtt_split(partition);
+    return estimator.bits() + get_num_children(partition) * CU_OVERHEAD_BITS;
 }
 
 void VVCEncoder::setup_child_cu(const VVCCodingUnit& parent, VVCCodingUnit& child, int index) {
@@ -350,20 +749,33 @@ void VVCEncoder::setup_child_cu(const VVCCodingUnit& parent, VVCCodingUnit& chil
             child.y += index * child.height;
             break;
             
+        case VVCPartitionType::BT_VERT_SPLIT:
+            child.width = parent.width / 2;
+            child.height = parent.height;
+            child.x += index * child.width;
+            break;
+            
         case VVCPartitionType::TT_HORZ_SPLIT:
+            // 1/4, 1/2, 1/4
             child.width = parent.width;
-            if (index == 0 || index == 2) {
-                child.height = parent.height / 4;
-            } else {
-                child.height = parent.height / 2;
-            }
-            // Complex positioning for TT...
+            child.height = (index == 1) ? parent.height / 2 : parent.height / 4;
+            child.y += (index == 0) ? 0 : (index == 1 ? parent.height / 4 : parent.height * 3 / 4);
+            break;
+            
+        case VVCPartitionType::TT_VERT_SPLIT:
+            child.width = (index == 1) ? parent.width / 2 : parent.width / 4;
+            child.height = parent.height;
+            child.x += (index == 0) ? 0 : (index == 1 ? parent.width / 4 : parent.width * 3 / 4);
             break;
             
         default:
-            child = parent;
+            child.width = parent.width;
+            child.height = parent.height;
             break;
     }
+    
+    child.mtt_depth = parent.mtt_depth + (parent.partition_type == VVCPartitionType::QT_SPLIT ? 0 : 1);
+    child.transform.tr_size = static_cast<uint8_t>(std::min({child.width, child.height, 64}));
 }
 
 int VVCEncoder::get_num_children(VVCPartitionType partition) {
@@ -377,5 +789,54 @@ int VVCEncoder::get_num_children(VVCPartitionType partition) {
     }
 }
 
+void VVCEncoder::set_gop_size(uint32_t gop_size) {
+    gop_size_ = std::max(1u, gop_size);
+}
+
+bool VVCEncoder::set_intra_refresh(uint32_t period) {
+    intra_refresh_period_ = period;
+    rate_control_.set_scene_cut_keyframes(period == 0);
+    return true;
+}
+
+uint32_t VVCEncoder::get_encoded_size() const {
+    return static_cast<uint32_t>(rate_control_.total_bits() / 8);
+}
+
+void VVCEncoder::reset() {
+    frame_count_ = 0;
+    last_keyframe_ = 0;
+    
+    // The last stream's settings do not carry over
+    const Settings& settings = initial_settings_;
+    gop_size_ = settings.gop_size;
+    complexity_level_ = settings.complexity_level;
+    features_ = settings.features;
+    parallel_processing_ = settings.parallel_processing;
+    entropy_coding_sync_ = settings.entropy_coding_sync;
+    intra_time_budget_ = settings.intra_time_budget;
+    set_intra_refresh(settings.intra_refresh_period);
+    rate_control_.reset(settings.rate_control);
+    bitrate_ = settings.rate_control.bitrate;
+    
+    dpb_.clear(); // Pictures go back to the reference pool
+    set_max_reference_frames(settings.max_reference_frames);
+    intra_modes_evaluated_.store(0, std::memory_order_relaxed);
+}
+
+void VVCEncoder::set_complexity_level(int level) {
+    complexity_level_ = std::max(0, std::min(10, level));
+}
+
+bool VVCEncoder::set_speed_preset(int speed) {
+    // Inverse of the (10 - level) * 9 / 10 partition preset: preset 9 -> 0, 5 -> 4, 0 -> 10
+    set_complexity_level(10 - (std::clamp(speed, 0, 9) * 10 + 8) / 9);
+    return true;
+}
+
+void VVCEncoder::set_parallel_processing(bool enabled) {
+    parallel_processing_ = enabled;
+}
+
 } // namespace codec
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
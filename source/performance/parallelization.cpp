@@ -0,0 +1,74 @@
+// src/performance/parallelization.cpp
+#include "streaming/performance/parallelization.hpp"
+
+namespace streaming {
+namespace performance {
+
+ThreadPool::ThreadPool(size_t num_threads) {
+    num_threads = std::max<size_t>(1, num_threads);
+    workers_.reserve(num_threads);
+    
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back([this]() { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        stop_ = true;
+    }
+    condition_.notify_all();
+    
+    // Workers drain the queue before exiting
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void ThreadPool::worker_loop() {
+    for (;;) {
+        std::function<void()> task;
+        
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            condition_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            
+            if (stop_ && tasks_.empty()) {
+                return;
+            }
+            
+            task = std::move(tasks_.front());
+            tasks_.pop();
+            active_threads_++;
+        }
+        
+        // Exceptions are captured by the packaged_task and surface through the future
+        task();
+        
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            active_threads_--;
+        }
+        idle_condition_.notify_all();
+    }
+}
+
+void ThreadPool::wait_all() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    idle_condition_.wait(lock, [this]() { return tasks_.empty() && active_threads_ == 0; });
+}
+
+size_t ThreadPool::get_pending_tasks() const {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    return tasks_.size();
+}
+
+size_t ThreadPool::get_active_threads() const {
+    return active_threads_;
+}
+
+} // namespace performance
+} // namespace streaming
@@ -0,0 +1,252 @@
+// src/performance/profiler.cpp
+#include "streaming/performance/profiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+namespace streaming {
+namespace performance {
+
+namespace {
+
+// Completed samples kept for export_to_chrome_tracing(); statistics keep counting past it
+constexpr size_t MAX_TRACE_EVENTS = 1 << 20;
+
+double to_ms(uint64_t ns) {
+    return static_cast<double>(ns) / 1e6;
+}
+
+// Sample names go into JSON strings unchanged apart from quotes and backslashes
+std::string json_escape(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+} // namespace
+
+HighResProfiler::HighResProfiler() = default;
+HighResProfiler::~HighResProfiler() = default;
+
+HighResProfiler& HighResProfiler::get_instance() {
+    static HighResProfiler instance;
+    return instance;
+}
+
+void HighResProfiler::start_session(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    results_.clear();
+    thread_data_.clear();
+    events_.clear();
+    current_session_ = name;
+    total_samples_ = 0;
+    total_duration_ = 0;
+    session_active_.store(true, std::memory_order_release);
+}
+
+void HighResProfiler::end_session() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    session_active_.store(false, std::memory_order_release);
+    thread_data_.clear(); // Samples still open are dropped
+}
+
+void HighResProfiler::begin_sample(const std::string& name) {
+    if (!session_active_.load(std::memory_order_acquire)) return;
+
+    ProfileResult sample;
+    sample.name = name;
+    sample.thread_id = std::hash<std::thread::id>()(std::this_thread::get_id());
+    sample.start_time = get_current_time_ns();
+    sample.end_time = sample.start_time;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    thread_data_[std::this_thread::get_id()].open_samples.push_back(std::move(sample));
+}
+
+void HighResProfiler::end_sample() {
+    if (!session_active_.load(std::memory_order_acquire)) return;
+    const uint64_t now = get_current_time_ns();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = thread_data_.find(std::this_thread::get_id());
+    // Begun before the session started
+    if (it == thread_data_.end() || it->second.open_samples.empty()) return;
+
+    ProfileResult sample = std::move(it->second.open_samples.back());
+    it->second.open_samples.pop_back();
+    sample.end_time = now;
+    const uint64_t duration = now - sample.start_time;
+
+    ProfileResult* result = get_or_create_result(sample.name);
+    update_statistics(*result, duration);
+    result->memory_usage = std::max(result->memory_usage, sample.memory_usage);
+    result->cache_misses += sample.cache_misses;
+    result->branch_mispredicts += sample.branch_mispredicts;
+    result->cpu_cycles += sample.cpu_cycles;
+
+    if (events_.size() < MAX_TRACE_EVENTS) {
+        events_.push_back(std::move(sample));
+    }
+    total_samples_++;
+    total_duration_ += duration;
+}
+
+void HighResProfiler::record_memory_usage(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = thread_data_.find(std::this_thread::get_id());
+    if (it == thread_data_.end() || it->second.open_samples.empty()) return;
+    uint32_t& usage = it->second.open_samples.back().memory_usage;
+    usage = std::max<uint32_t>(usage, static_cast<uint32_t>(std::min<size_t>(bytes, UINT32_MAX)));
+}
+
+void HighResProfiler::record_cache_misses(uint32_t misses) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = thread_data_.find(std::this_thread::get_id());
+    if (it == thread_data_.end() || it->second.open_samples.empty()) return;
+    it->second.open_samples.back().cache_misses += misses;
+}
+
+void HighResProfiler::record_branch_mispredicts(uint32_t mispredicts) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = thread_data_.find(std::this_thread::get_id());
+    if (it == thread_data_.end() || it->second.open_samples.empty()) return;
+    it->second.open_samples.back().branch_mispredicts += mispredicts;
+}
+
+void HighResProfiler::record_cpu_cycles(uint64_t cycles) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = thread_data_.find(std::this_thread::get_id());
+    if (it == thread_data_.end() || it->second.open_samples.empty()) return;
+    it->second.open_samples.back().cpu_cycles += cycles;
+}
+
+double HighResProfiler::get_average_time(const std::string& sample_name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = results_.find(sample_name);
+    if (it == results_.end() || it->second.call_count == 0) return 0.0;
+    return to_ms(it->second.total_time) / it->second.call_count;
+}
+
+double HighResProfiler::get_throughput(const std::string& sample_name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = results_.find(sample_name);
+    if (it == results_.end() || it->second.total_time == 0) return 0.0;
+    return it->second.call_count * 1e9 / static_cast<double>(it->second.total_time);
+}
+
+uint32_t HighResProfiler::get_call_count(const std::string& sample_name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = results_.find(sample_name);
+    return it == results_.end() ? 0 : it->second.call_count;
+}
+
+std::vector<HighResProfiler::ProfileResult> HighResProfiler::get_results() const {
+    std::vector<ProfileResult> results;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        results.reserve(results_.size());
+        for (const auto& entry : results_) {
+            results.push_back(entry.second);
+        }
+    }
+    std::sort(results.begin(), results.end(), [](const ProfileResult& a, const ProfileResult& b) {
+        return a.total_time != b.total_time ? a.total_time > b.total_time : a.name < b.name;
+    });
+    return results;
+}
+
+void HighResProfiler::export_to_chrome_tracing(const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file) {
+        std::cerr << "❌ Profiler: cannot write " << filename << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t origin = events_.empty() ? 0 : std::min_element(events_.begin(), events_.end(),
+        [](const ProfileResult& a, const ProfileResult& b) { return a.start_time < b.start_time; })->start_time;
+
+    // Complete ("X") events, microseconds since the first sample
+    file << "{\"otherData\":{\"session\":\"" << json_escape(current_session_) << "\"},\"traceEvents\":[";
+    file << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < events_.size(); ++i) {
+        const ProfileResult& event = events_[i];
+        file << (i ? "," : "") << "\n{\"name\":\"" << json_escape(event.name) << "\",\"cat\":\"function\",\"ph\":\"X\""
+             << ",\"pid\":0,\"tid\":" << event.thread_id
+             << ",\"ts\":" << (event.start_time - origin) / 1000.0
+             << ",\"dur\":" << (event.end_time - event.start_time) / 1000.0 << "}";
+    }
+    file << "\n]}\n";
+}
+
+void HighResProfiler::export_to_csv(const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file) {
+        std::cerr << "❌ Profiler: cannot write " << filename << std::endl;
+        return;
+    }
+
+    file << "name,calls,total_ms,average_ms,min_ms,max_ms,memory_bytes,cache_misses,branch_mispredicts,cpu_cycles\n";
+    file << std::fixed << std::setprecision(6);
+    for (const ProfileResult& result : get_results()) {
+        file << result.name << "," << result.call_count << "," << to_ms(result.total_time) << ","
+             << to_ms(result.total_time) / std::max(1u, result.call_count) << "," << to_ms(result.min_time) << ","
+             << to_ms(result.max_time) << "," << result.memory_usage << "," << result.cache_misses << ","
+             << result.branch_mispredicts << "," << result.cpu_cycles << "\n";
+    }
+}
+
+void HighResProfiler::print_summary() const {
+    const std::vector<ProfileResult> results = get_results();
+    std::string session;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        session = current_session_;
+    }
+
+    std::cout << "📊 Profile '" << session << "': " << total_samples_.load() << " samples, "
+              << std::fixed << std::setprecision(3) << to_ms(total_duration_.load()) << " ms" << std::endl;
+    for (const ProfileResult& result : results) {
+        std::cout << "   " << std::left << std::setw(32) << result.name << std::right
+                  << std::setw(10) << result.call_count << " calls"
+                  << std::setw(12) << to_ms(result.total_time) << " ms total"
+                  << std::setw(10) << to_ms(result.total_time) / std::max(1u, result.call_count) << " ms avg"
+                  << std::setw(10) << to_ms(result.min_time) << " min"
+                  << std::setw(10) << to_ms(result.max_time) << " max" << std::endl;
+    }
+}
+
+uint64_t HighResProfiler::get_current_time_ns() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+HighResProfiler::ProfileResult* HighResProfiler::get_or_create_result(const std::string& name) {
+    auto it = results_.find(name);
+    if (it == results_.end()) {
+        ProfileResult result;
+        result.name = name;
+        result.start_time = 0;
+        result.end_time = 0;
+        result.thread_id = 0;
+        result.call_count = 0;
+        it = results_.emplace(name, std::move(result)).first;
+    }
+    return &it->second;
+}
+
+void HighResProfiler::update_statistics(ProfileResult& result, uint64_t duration) {
+    result.call_count++;
+    result.total_time += duration;
+    result.min_time = std::min(result.min_time, duration);
+    result.max_time = std::max(result.max_time, duration);
+}
+
+} // namespace performance
+} // namespace streaming
@@ -1,68 +1,366 @@
 // src/processing/av1_entropy.cpp
 #include "streaming/processing/av1_entropy.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
 namespace streaming {
 namespace processing {
 
+namespace {
+
+constexpr int EC_PROB_SHIFT = 6;
+constexpr int EC_MIN_PROB = 4;
+constexpr uint32_t CDF_PROB_TOP = 1u << AV1EntropyEncoder::CDF_PROB_BITS;
+
+// Number of intra luma modes (DC_PRED ... PAETH_PRED in the spec) and inter modes
+constexpr int INTRA_MODES = 13;
+constexpr int INTER_MODES = 4;
+constexpr int MAX_ANGLE_DELTA = 3;
+constexpr int DELTA_Q_SMALL = 3;
+
+// Partition CDF of a block size (128 .. 8) and its symbol count: 128x128 has no 4-way
+// partitions, 8x8 only NONE/HORZ/VERT/SPLIT
+int partition_context(int block_size) {
+    return std::clamp(8 - static_cast<int>(std::bit_width(static_cast<uint32_t>(block_size))), 0, 4);
+}
+
+int partition_symbols(int context) {
+    return context == 0 ? 8 : (context == 4 ? 4 : 10);
+}
+
+} // namespace
+
 AV1EntropyEncoder::AV1EntropyEncoder() {
-    // Initialize CDFs (Cumulative Distribution Functions)
-    partition_cdf_.resize(10);
-    pred_mode_cdf_.resize(20);
-    mv_joint_cdf_.resize(4);
+    precarry_.reserve(4096);
+    init_frame();
 }
 
-void AV1EntropyEncoder::encode_partition_type(utils::BitstreamWriter& writer, PartitionType partition) {
-    uint16_t symbol = static_cast<uint16_t>(partition);
-    
-    // Simplified CDF for partition types
-    uint16_t partition_cdf[] = {2048, 1536, 1024, 512, 256, 128, 64, 32, 16, 0};
-    encode_cdf(writer, symbol, partition_cdf, 12);
+void AV1EntropyEncoder::init_uniform(CDF& cdf, int num_symbols) {
+    // Equiprobable start; the CDFs adapt to the content of the tile
+    cdf.fill(0);
+    for (int i = 0; i < num_symbols; ++i) {
+        cdf[i] = static_cast<uint16_t>(CDF_PROB_TOP - ((i + 1) * CDF_PROB_TOP) / num_symbols);
+    }
+    cdf[num_symbols] = 0; // Adaptation counter
 }
 
-void AV1EntropyEncoder::encode_prediction_mode(utils::BitstreamWriter& writer, PredictionMode mode) {
-    uint16_t symbol = static_cast<uint16_t>(mode);
-    
-    // Simplified CDF for prediction modes
-    uint16_t mode_cdf[] = {2048, 1920, 1792, 1664, 1536, 1408, 1280, 1152, 
-                          1024, 896, 768, 640, 512, 384, 256, 128, 64, 32, 16, 0};
-    encode_cdf(writer, symbol, mode_cdf, 12);
+const AV1EntropyEncoder::Contexts& AV1EntropyEncoder::Contexts::defaults() {
+    static const Contexts contexts = [] {
+        Contexts c;
+        for (int i = 0; i < 5; ++i) {
+            init_uniform(c.partition[i], partition_symbols(i));
+        }
+        init_uniform(c.is_inter, 2);
+        init_uniform(c.y_mode, INTRA_MODES);
+        for (auto& cdf : c.angle_delta) {
+            init_uniform(cdf, 2 * MAX_ANGLE_DELTA + 1);
+        }
+        init_uniform(c.inter_mode, INTER_MODES);
+        init_uniform(c.mv_zero, 2);
+        init_uniform(c.delta_q, DELTA_Q_SMALL + 1);
+        init_uniform(c.all_zero, 2);
+        for (auto& cdf : c.coeff_zero) {
+            init_uniform(cdf, 2);
+        }
+        init_uniform(c.coeff_greater1, 2);
+        return c;
+    }();
+    return contexts;
 }
 
-void AV1EntropyEncoder::encode_cdf(utils::BitstreamWriter& writer, uint16_t symbol, 
-                                  const uint16_t* cdf, int precision) {
-    uint16_t value = 0;
-    uint16_t scale = 1 << precision;
-    
-    for (uint16_t i = 0; i <= symbol; ++i) {
-        value += cdf[i];
+void AV1EntropyEncoder::Contexts::reset_counters() {
+    // The counter follows the last symbol, whose inverse CDF entry is the first 0
+    auto reset = [](CDF& cdf) {
+        const auto last = std::find(cdf.begin(), cdf.end() - 1, 0);
+        *(last + 1) = 0;
+    };
+    for (auto& cdf : partition) reset(cdf);
+    reset(is_inter);
+    reset(y_mode);
+    for (auto& cdf : angle_delta) reset(cdf);
+    reset(inter_mode);
+    reset(mv_zero);
+    reset(delta_q);
+    reset(all_zero);
+    for (auto& cdf : coeff_zero) reset(cdf);
+    reset(coeff_greater1);
+}
+
+void AV1EntropyEncoder::init_frame(const Contexts& contexts) {
+    low_ = 0;
+    range_ = 0x8000;
+    count_ = -9;
+    precarry_.clear();
+    contexts_ = contexts;
+}
+
+void AV1EntropyEncoder::encode_symbol(uint16_t symbol, CDF& cdf, int num_symbols) {
+    encode_cdf(symbol, cdf.data(), num_symbols);
+    update_cdf(cdf, symbol, num_symbols);
+}
+
+void AV1EntropyEncoder::encode_cdf(uint16_t symbol, const uint16_t* icdf, int num_symbols) {
+    // od_ec_encode_q15(): fl/fh are the inverse CDF values bracketing the symbol
+    const uint32_t fl = symbol > 0 ? icdf[symbol - 1] : CDF_PROB_TOP;
+    const uint32_t fh = icdf[symbol];
+    const int n = num_symbols - 1;
+
+    uint32_t low = low_;
+    uint32_t range = range_;
+
+    if (fl < CDF_PROB_TOP) {
+        uint32_t u = ((range >> 8) * (fl >> EC_PROB_SHIFT) >> (7 - EC_PROB_SHIFT)) + EC_MIN_PROB * (n - (symbol - 1));
+        uint32_t v = ((range >> 8) * (fh >> EC_PROB_SHIFT) >> (7 - EC_PROB_SHIFT)) + EC_MIN_PROB * (n - symbol);
+        low += range - u;
+        range = u - v;
+    } else {
+        range -= ((range >> 8) * (fh >> EC_PROB_SHIFT) >> (7 - EC_PROB_SHIFT)) + EC_MIN_PROB * (n - symbol);
     }
-    
-    // Normalize and encode
-    uint32_t normalized = (value * scale) / cdf[0];
-    writer.write_bits(normalized, precision);
+
+    normalize(low, range);
 }
 
-void AV1EntropyEncoder::encode_coeffs(utils::BitstreamWriter& writer, 
-                                     const std::vector<std::vector<int16_t>>& coeffs, 
-                                     int tx_size, bool is_intra) {
-    // AV1'in karmaşık coefficient encoding'i
-    // DC coefficient first
-    if (!coeffs.empty() && !coeffs[0].empty()) {
-        int16_t dc_coeff = coeffs[0][0];
-        writer.write_se(dc_coeff);
+void AV1EntropyEncoder::update_cdf(CDF& cdf, uint16_t symbol, int size) {
+    // Adaptation rate grows with the number of symbols seen, up to a limit
+    static constexpr int SPEED[MAX_SYMBOLS + 1] = {0, 0, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2};
+    const int rate = 3 + (cdf[size] > 15) + (cdf[size] > 31) + SPEED[size];
+
+#ifdef __AVX2__
+    // All 16 entries at once: entries before the symbol move up towards 32768, the others
+    // down towards 0; the last symbol's entry (always 0) and the counter stay as they are
+    const __m256i index = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i shift = _mm_cvtsi32_si128(rate);
+    __m256i* entries = reinterpret_cast<__m256i*>(cdf.data());
+    const __m256i values = _mm256_load_si256(entries);
+
+    const __m256i up = _mm256_add_epi16(
+        values, _mm256_srl_epi16(_mm256_sub_epi16(_mm256_set1_epi16(static_cast<int16_t>(CDF_PROB_TOP)), values), shift));
+    const __m256i down = _mm256_sub_epi16(values, _mm256_srl_epi16(values, shift));
+    const __m256i below_symbol = _mm256_cmpgt_epi16(_mm256_set1_epi16(static_cast<int16_t>(symbol)), index);
+    const __m256i adapted = _mm256_cmpgt_epi16(_mm256_set1_epi16(static_cast<int16_t>(size - 1)), index);
+    const __m256i updated = _mm256_blendv_epi8(down, up, below_symbol);
+    _mm256_store_si256(entries, _mm256_blendv_epi8(values, updated, adapted));
+#else
+    uint32_t target = CDF_PROB_TOP;
+    for (int i = 0; i < size - 1; ++i) {
+        if (i == symbol) target = 0;
+        if (target < cdf[i]) {
+            cdf[i] -= static_cast<uint16_t>((cdf[i] - target) >> rate);
+        } else {
+            cdf[i] += static_cast<uint16_t>((target - cdf[i]) >> rate);
+        }
+    }
+#endif
+    cdf[size] += (cdf[size] < 32);
+}
+
+void AV1EntropyEncoder::encode_bool(bool bit) {
+    // od_ec_encode_bool_q15() with probability 1/2
+    const uint32_t f = CDF_PROB_TOP / 2;
+    uint32_t low = low_;
+    uint32_t range = range_;
+
+    uint32_t v = ((range >> 8) * (f >> EC_PROB_SHIFT) >> (7 - EC_PROB_SHIFT)) + EC_MIN_PROB;
+    if (bit) low += range - v;
+    range = bit ? v : range - v;
+
+    normalize(low, range);
+}
+
+void AV1EntropyEncoder::encode_literal(uint32_t value, int bits) {
+    for (int i = bits - 1; i >= 0; --i) {
+        encode_bool((value >> i) & 1);
+    }
+}
+
+void AV1EntropyEncoder::encode_golomb(uint32_t value) {
+    // Exp-Golomb: leading zeros, then value + 1 in binary
+    const uint32_t x = value + 1;
+    const int length = static_cast<int>(std::bit_width(x));
+    for (int i = 1; i < length; ++i) {
+        encode_bool(false);
+    }
+    encode_literal(x, length);
+}
+
+void AV1EntropyEncoder::normalize(uint32_t low, uint32_t range) {
+    // Renormalise range to 16 bits, moving whole bytes of low into the precarry buffer
+    const int d = 16 - static_cast<int>(std::bit_width(range));
+    int c = count_;
+    int s = c + d;
+
+    if (s >= 0) {
+        c += 16;
+        uint32_t m = (1u << c) - 1;
+        if (s >= 8) {
+            precarry_.push_back(static_cast<uint16_t>(low >> c));
+            low &= m;
+            c -= 8;
+            m >>= 8;
+        }
+        precarry_.push_back(static_cast<uint16_t>(low >> c));
+        s = c + d - 24;
+        low &= m;
+    }
+
+    low_ = low << d;
+    range_ = range << d;
+    count_ = s;
+}
+
+void AV1EntropyEncoder::finish(std::vector<uint8_t>& output) {
+    // od_ec_enc_done(): emit the fewest bits that decode correctly whatever follows
+    int c = count_;
+    int s = 10 + c;
+    const uint32_t m = 0x3FFF;
+    uint32_t e = ((low_ + m) & ~m) | (m + 1);
+
+    if (s > 0) {
+        uint32_t n = (1u << (c + 16)) - 1;
+        do {
+            precarry_.push_back(static_cast<uint16_t>(e >> (c + 16)));
+            e &= n;
+            s -= 8;
+            c -= 8;
+            n >>= 8;
+        } while (s > 0);
+    }
+
+    // Carry propagation from the last byte backwards
+    const size_t start = output.size();
+    output.resize(start + precarry_.size());
+    uint32_t carry = 0;
+    for (size_t i = precarry_.size(); i-- > 0;) {
+        carry += precarry_[i];
+        output[start + i] = static_cast<uint8_t>(carry);
+        carry >>= 8;
     }
+
+    precarry_.clear();
+}
+
+void AV1EntropyEncoder::encode_partition_type(codec::PartitionType partition, int block_size) {
+    const int index = partition_context(block_size);
+    const int num_symbols = partition_symbols(index);
+    const uint16_t symbol = static_cast<uint16_t>(partition);
+
+    encode_symbol(std::min<uint16_t>(symbol, num_symbols - 1), contexts_.partition[index], num_symbols);
+}
+
+void AV1EntropyEncoder::encode_prediction_mode(codec::PredictionMode mode, bool is_inter_frame) {
+    const uint16_t symbol = static_cast<uint16_t>(mode);
+    const uint16_t first_inter = static_cast<uint16_t>(codec::PredictionMode::NEARESTMV);
+    const bool is_inter = symbol >= first_inter;
+
+    if (is_inter_frame) {
+        encode_symbol(is_inter ? 1 : 0, contexts_.is_inter, 2); // is_inter
+    }
+
+    if (is_inter) {
+        encode_symbol(symbol - first_inter, contexts_.inter_mode, INTER_MODES);
+    } else {
+        encode_symbol(symbol, contexts_.y_mode, INTRA_MODES); // y_mode
+    }
+}
+
+void AV1EntropyEncoder::encode_angle_delta(codec::PredictionMode mode, int angle_delta) {
+    const int index = static_cast<int>(mode) - static_cast<int>(codec::PredictionMode::V_PRED);
+    encode_symbol(static_cast<uint16_t>(angle_delta + MAX_ANGLE_DELTA), contexts_.angle_delta[index],
+                  2 * MAX_ANGLE_DELTA + 1);
+}
+
+void AV1EntropyEncoder::encode_mv_component(int16_t mv_component) {
+    encode_symbol(mv_component != 0 ? 1 : 0, contexts_.mv_zero, 2);
+    if (mv_component == 0) {
+        return;
+    }
+
+    encode_bool(mv_component < 0); // mv_sign
+    encode_golomb(static_cast<uint32_t>(std::abs(mv_component)) - 1);
+}
+
+void AV1EntropyEncoder::encode_delta_qindex(int delta) {
+    // Small magnitudes are a symbol; from DELTA_Q_SMALL on, the bit count and the bits
+    // of abs - 1 follow as literals
+    const uint32_t abs_delta = static_cast<uint32_t>(std::abs(delta));
+    encode_symbol(static_cast<uint16_t>(std::min<uint32_t>(abs_delta, DELTA_Q_SMALL)), contexts_.delta_q,
+                  DELTA_Q_SMALL + 1);
     
-    // AC coefficients with special scanning
-    // AV1 uses multiple scan patterns based on transform type
-    for (size_t i = 1; i < coeffs.size(); ++i) {
-        for (size_t j = 0; j < coeffs[i].size(); ++j) {
+    if (abs_delta >= DELTA_Q_SMALL) {
+        const int rem_bits = static_cast<int>(std::bit_width(abs_delta - 1)) - 1;
+        encode_literal(static_cast<uint32_t>(rem_bits - 1), 3); // delta_q_rem_bits
+        encode_literal(abs_delta - 1 - (1u << rem_bits), rem_bits); // delta_q_abs_bits
+    }
+    if (abs_delta > 0) {
+        encode_bool(delta < 0); // delta_q_sign_bit
+    }
+}
+
+uint32_t AV1EntropyEncoder::partition_rate(codec::PartitionType partition, int block_size) const {
+    const int index = partition_context(block_size);
+    const uint16_t symbol = std::min<uint16_t>(static_cast<uint16_t>(partition), partition_symbols(index) - 1);
+    return symbol_rate(symbol, contexts_.partition[index]);
+}
+
+uint32_t AV1EntropyEncoder::prediction_mode_rate(codec::PredictionMode mode, bool is_inter_frame) const {
+    const uint16_t symbol = static_cast<uint16_t>(mode);
+    const uint16_t first_inter = static_cast<uint16_t>(codec::PredictionMode::NEARESTMV);
+    const bool is_inter = symbol >= first_inter;
+
+    uint32_t rate = is_inter_frame ? symbol_rate(is_inter ? 1 : 0, contexts_.is_inter) : 0;
+    return rate + (is_inter ? symbol_rate(symbol - first_inter, contexts_.inter_mode) : symbol_rate(symbol, contexts_.y_mode));
+}
+
+uint32_t AV1EntropyEncoder::angle_delta_rate(codec::PredictionMode mode, int angle_delta) const {
+    const int index = static_cast<int>(mode) - static_cast<int>(codec::PredictionMode::V_PRED);
+    return symbol_rate(static_cast<uint16_t>(angle_delta + MAX_ANGLE_DELTA), contexts_.angle_delta[index]);
+}
+
+void AV1EntropyEncoder::encode_coeffs(const std::vector<std::vector<int16_t>>& coeffs,
+                                     int tx_size, bool is_intra) {
+    // Simplified coefficient coding: all_zero, then per coefficient in raster order a
+    // zero flag (context by distance from DC), greater1 flag, Golomb remainder and sign
+    const int size = std::min<int>(tx_size, static_cast<int>(coeffs.size()));
+
+    bool all_zero = true;
+    for (int i = 0; i < size && all_zero; ++i) {
+        for (int j = 0; j < size; ++j) {
             if (coeffs[i][j] != 0) {
-                writer.write_se(coeffs[i][j]);
-                // Encode sign and magnitude separately
+                all_zero = false;
+                break;
             }
         }
     }
+
+    encode_symbol(all_zero ? 1 : 0, contexts_.all_zero, 2);
+    if (all_zero) {
+        return;
+    }
+
+    for (int i = 0; i < size; ++i) {
+        for (int j = 0; j < size; ++j) {
+            const int level = coeffs[i][j];
+            encode_symbol(level != 0 ? 1 : 0, contexts_.coeff_zero[std::min(i + j, 3)], 2);
+            if (level == 0) {
+                continue;
+            }
+
+            const uint32_t abs_level = static_cast<uint32_t>(std::abs(level));
+            encode_symbol(abs_level > 1 ? 1 : 0, contexts_.coeff_greater1, 2);
+            if (abs_level > 1) {
+                encode_golomb(abs_level - 2);
+            }
+            encode_bool(level < 0); // dc_sign / sign_bit
+        }
+    }
+
+    (void)is_intra; // Intra and inter blocks share contexts for now
 }
 
 } // namespace processing
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
@@ -1,103 +1,238 @@
 // src/processing/cabac_encoder.cpp
 #include "streaming/processing/cabac_encoder.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
 
 namespace streaming {
 namespace processing {
 
-CABACEncoder::CABACEncoder() {
-    // Initialize context models for HEVC
+namespace {
+
+// HEVC state transition tables
+constexpr uint8_t next_state_mps[64] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+    33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48,
+    49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 62, 63
+};
+
+constexpr uint8_t next_state_lps[64] = {
+    0, 0, 1, 2, 2, 4, 4, 5, 6, 7, 8, 9, 9, 11, 11, 12,
+    13, 13, 15, 15, 16, 16, 18, 18, 19, 19, 21, 21, 22, 22, 23, 24,
+    24, 25, 26, 26, 27, 27, 28, 29, 29, 30, 30, 30, 31, 32, 32, 33,
+    33, 33, 34, 34, 35, 35, 35, 36, 36, 36, 37, 37, 37, 38, 38, 63
+};
+
+constexpr auto make_next_state() {
+    std::array<uint8_t, 64 * 4> table{};
+    for (int state = 0; state < 64; ++state) {
+        for (int mps = 0; mps < 2; ++mps) {
+            for (int bin = 0; bin < 2; ++bin) {
+                const bool is_mps = bin == mps;
+                const int next = is_mps ? next_state_mps[state] : next_state_lps[state];
+                const int next_mps = !is_mps && state == 0 ? 1 - mps : mps;
+                table[state * 4 + mps * 2 + bin] = static_cast<uint8_t>(next | next_mps << 6);
+            }
+        }
+    }
+    return table;
 }
 
-void CABACEncoder::init_encoder(std::vector<uint8_t>& output_buffer) {
-    output_ = &output_buffer;
+// rangeTabLPS[pStateIdx][qRangeIdx]
+constexpr std::array<std::array<uint8_t, 4>, 64> lps_range = {{
+    {128, 176, 208, 240}, {128, 167, 197, 227}, {128, 158, 187, 216}, {123, 150, 178, 205},
+    {116, 142, 169, 195}, {111, 135, 160, 185}, {105, 128, 152, 175}, {100, 122, 144, 166},
+    { 95, 116, 137, 158}, { 90, 110, 130, 150}, { 85, 104, 123, 142}, { 81,  99, 117, 135},
+    { 77,  94, 111, 128}, { 73,  89, 105, 122}, { 69,  85, 100, 116}, { 66,  80,  95, 110},
+    { 62,  76,  90, 104}, { 59,  72,  86,  99}, { 56,  69,  81,  94}, { 53,  65,  77,  89},
+    { 51,  62,  73,  85}, { 48,  59,  69,  80}, { 46,  56,  66,  76}, { 43,  53,  63,  72},
+    { 41,  50,  59,  69}, { 39,  48,  56,  65}, { 37,  45,  54,  62}, { 35,  43,  51,  59},
+    { 33,  41,  48,  56}, { 32,  39,  46,  53}, { 30,  37,  43,  50}, { 29,  35,  41,  48},
+    { 27,  33,  39,  45}, { 26,  31,  37,  43}, { 24,  30,  35,  41}, { 23,  28,  33,  39},
+    { 22,  27,  32,  37}, { 21,  26,  30,  35}, { 20,  24,  29,  33}, { 19,  23,  27,  31},
+    { 18,  22,  26,  30}, { 17,  21,  25,  28}, { 16,  20,  23,  27}, { 15,  19,  22,  25},
+    { 14,  18,  21,  24}, { 14,  17,  20,  23}, { 13,  16,  19,  22}, { 12,  15,  18,  21},
+    { 12,  14,  17,  20}, { 11,  14,  16,  19}, { 11,  13,  15,  18}, { 10,  12,  15,  17},
+    { 10,  12,  14,  16}, {  9,  11,  13,  15}, {  9,  11,  12,  14}, {  8,  10,  12,  14},
+    {  8,   9,  11,  13}, {  7,   9,  11,  12}, {  7,   9,  10,  12}, {  7,   8,  10,  11},
+    {  6,   8,   9,  11}, {  6,   7,   9,  10}, {  6,   7,   8,   9}, {  2,   2,   2,   2}
+}};
+
+constexpr auto make_bin_rate() {
+    // LPS probability of a state: its LPS range over the mid-point of each range quarter,
+    // averaged over the quarters
+    std::array<std::array<uint32_t, 2>, 64> table{};
+    for (int state = 0; state < 64; ++state) {
+        uint32_t lps_probability = 0;
+        for (int q = 0; q < 4; ++q) {
+            lps_probability += (lps_range[state][q] << 15) / (288 + 64 * q);
+        }
+        lps_probability /= 4;
+        table[state][0] = probability_rate((1u << 15) - lps_probability);
+        table[state][1] = probability_rate(lps_probability);
+    }
+    return table;
+}
+
+} // namespace
+
+const std::array<std::array<uint8_t, 4>, 64> CABACEncoder::LPS_RANGE = lps_range;
+const std::array<uint8_t, 64 * 4> CABACEncoder::NEXT_STATE = make_next_state();
+const std::array<std::array<uint32_t, 2>, 64> CABACEncoder::BIN_RATE = make_bin_rate();
+
+void CABACEncoder::ContextModel::init(uint8_t init_value, int qp) {
+    // 9.3.2.2: linear model in QP
+    int slope = (init_value >> 4) * 5 - 45;
+    int offset = ((init_value & 15) << 3) - 16;
+    int pre_state = std::clamp(((slope * std::clamp(qp, 0, 51)) >> 4) + offset, 1, 126);
+    
+    mps = pre_state <= 63 ? 0 : 1;
+    state = static_cast<uint8_t>(mps ? pre_state - 64 : 63 - pre_state);
+}
+
+CABACEncoder::CABACEncoder() = default;
+
+void CABACEncoder::init_encoder(utils::BitstreamWriter& writer) {
+    writer_ = &writer;
+    bytes_.clear(); // Capacity stays for the next substream
     low_ = 0;
     range_ = 510;
+    bits_left_ = 23;
     num_buffered_bytes_ = 0;
     buffered_byte_ = 0xFF;
-    num_bits_left_ = 23;
 }
 
-void CABACEncoder::encode_bit(ContextModel& ctx, bool bit) {
-    uint32_t lps = get_lps_range(ctx.state);
-    uint32_t mps_range = range_ - lps;
-    
-    if (bit == ctx.mps) {
-        range_ = mps_range;
-        if (range_ < 256) {
-            renorm_encoder();
-        }
-        // Update MPS state
-        if (ctx.state == 0) ctx.mps = 1 - ctx.mps;
-        ctx.state = next_state_mps[ctx.state];
-    } else {
-        low_ += mps_range;
-        range_ = lps;
-        if (range_ < 256) {
-            renorm_encoder();
-        }
-        // Update LPS state
-        ctx.state = next_state_lps[ctx.state];
+void CABACEncoder::encode_bin(ContextModel& ctx, uint32_t bin, int max_bins) {
+    // Truncated unary: `bin` ones, then a zero unless the maximum was reached
+    for (int i = 0; i < static_cast<int>(bin) && i < max_bins; ++i) {
+        encode_bit(ctx, true);
+    }
+    if (static_cast<int>(bin) < max_bins) {
+        encode_bit(ctx, false);
     }
 }
 
-void CABACEncoder::renorm_encoder() {
-    while (range_ < 256) {
-        if (low_ < (0x1FF << 23)) {
-            // Write out buffered byte
-            if (buffered_byte_ != 0xFF) {
-                output_->push_back(buffered_byte_);
-            }
-            buffered_byte_ = (low_ >> 31) & 0xFF;
-            low_ = (low_ << 9) & 0x7FFFFFFFFF;
-            num_bits_left_ -= 9;
-        } else {
-            low_ = (low_ - (0x1FF << 23)) << 9;
-            num_bits_left_ -= 9;
-            buffered_byte_++;
-        }
-        range_ <<= 1;
+void CABACEncoder::encode_bypass(bool bit) {
+    low_ <<= 1;
+    if (bit) {
+        low_ += range_;
+    }
+    bits_left_--;
+    
+    test_and_write_out();
+}
+
+void CABACEncoder::encode_bypass_bins(uint32_t value, int num_bins) {
+    // Eight bins per step: low = low * 2^8 + bins * range. write_out() keeps at least
+    // 12 free bits in low, so a byte of bins always fits.
+    while (num_bins > 8) {
+        num_bins -= 8;
+        low_ = (low_ << 8) + range_ * ((value >> num_bins) & 0xFF);
+        bits_left_ -= 8;
+        test_and_write_out();
     }
+    low_ = (low_ << num_bins) + range_ * (value & ((1u << num_bins) - 1));
+    bits_left_ -= num_bins;
+    test_and_write_out();
 }
 
-void CABACEncoder::encode_terminator() {
-    // Encode termination symbol
-    ContextModel term_ctx;
-    term_ctx.state = 63;
+void CABACEncoder::encode_ue_bypass(uint32_t value) {
+    // EG0: k ones and a zero, then the k-bit suffix, where k is the length of value + 1
+    // minus one
+    const int k = std::bit_width(value + 1) - 1;
+    encode_bypass_bins(((1u << k) - 1) << 1, k + 1);
+    encode_bypass_bins(value + 1 - (1u << k), k);
+}
+
+void CABACEncoder::encode_terminator(bool bit) {
+    range_ -= 2;
     
-    for (int i = 0; i < 4; ++i) {
-        encode_bit(term_ctx, 1);
+    if (bit) {
+        low_ += range_;
+        low_ <<= 7;
+        range_ = 2 << 7;
+        bits_left_ -= 7;
+    } else if (range_ >= 256) {
+        return;
+    } else {
+        low_ <<= 1;
+        range_ <<= 1;
+        bits_left_--;
     }
     
-    flush_encoder();
+    test_and_write_out();
 }
 
 void CABACEncoder::flush_encoder() {
-    // Finish encoding and write remaining bits
-    if (buffered_byte_ != 0xFF) {
-        output_->push_back(buffered_byte_);
+    // Resolve a pending carry, then emit the remaining bits of low
+    if (low_ >> (32 - bits_left_)) {
+        bytes_.push_back(static_cast<uint8_t>(buffered_byte_ + 1));
+        while (num_buffered_bytes_ > 1) {
+            bytes_.push_back(0x00);
+            num_buffered_bytes_--;
+        }
+        low_ -= 1u << (32 - bits_left_);
+    } else {
+        if (num_buffered_bytes_ > 0) {
+            bytes_.push_back(static_cast<uint8_t>(buffered_byte_));
+        }
+        while (num_buffered_bytes_ > 1) {
+            bytes_.push_back(0xFF);
+            num_buffered_bytes_--;
+        }
     }
     
-    // Write final bytes
-    uint64_t final_bits = low_ >> (32 - num_bits_left_);
-    for (int i = 0; i < (num_bits_left_ + 7) / 8; ++i) {
-        output_->push_back((final_bits >> (i * 8)) & 0xFF);
+    writer_->write_bytes(bytes_.data(), bytes_.size());
+    writer_->write_bits(low_ >> 8, static_cast<uint8_t>(24 - bits_left_));
+    bytes_.clear();
+    num_buffered_bytes_ = 0;
+}
+
+void CABACEncoder::rollback(const Checkpoint& checkpoint) {
+    low_ = checkpoint.low;
+    range_ = checkpoint.range;
+    bits_left_ = checkpoint.bits_left;
+    num_buffered_bytes_ = checkpoint.num_buffered_bytes;
+    buffered_byte_ = checkpoint.buffered_byte;
+    bytes_.resize(checkpoint.bytes);
+}
+
+void CABACEncoder::encode_sao_type(ContextModel& ctx, uint8_t type) {
+    // sao_type_idx: first bin context coded, second bin bypass
+    encode_bit(ctx, type != 0);
+    if (type != 0) {
+        encode_bypass(type == 2);
     }
 }
 
-// HEVC state transition tables
-constexpr uint8_t next_state_mps[64] = {
-    1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
-    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
-    33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48,
-    49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 62, 63
-};
+void CABACEncoder::encode_cu_split_flag(ContextModel& ctx, bool split_flag) {
+    encode_bit(ctx, split_flag);
+}
 
-constexpr uint8_t next_state_lps[64] = {
-    0, 0, 1, 2, 2, 4, 4, 5, 6, 7, 8, 9, 9, 11, 11, 12,
-    13, 13, 15, 15, 16, 16, 18, 18, 19, 19, 21, 21, 22, 22, 23, 24,
-    24, 25, 26, 26, 27, 27, 28, 29, 29, 30, 30, 30, 31, 32, 32, 33,
-    33, 33, 34, 34, 35, 35, 35, 36, 36, 36, 37, 37, 37, 38, 38, 63
-};
+void CABACEncoder::write_out() {
+    // Bytes of 0xFF are held back until it is known whether a carry reaches them
+    uint32_t lead_byte = low_ >> (24 - bits_left_);
+    bits_left_ += 8;
+    low_ &= 0xFFFFFFFFu >> bits_left_;
+    
+    if (lead_byte == 0xFF) {
+        num_buffered_bytes_++;
+    } else if (num_buffered_bytes_ > 0) {
+        uint32_t carry = lead_byte >> 8;
+        bytes_.push_back(static_cast<uint8_t>(buffered_byte_ + carry));
+        buffered_byte_ = lead_byte & 0xFF;
+        
+        const uint8_t byte = static_cast<uint8_t>(0xFF + carry);
+        while (num_buffered_bytes_ > 1) {
+            bytes_.push_back(byte);
+            num_buffered_bytes_--;
+        }
+    } else {
+        num_buffered_bytes_ = 1;
+        buffered_byte_ = lead_byte;
+    }
+}
 
 } // namespace processing
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
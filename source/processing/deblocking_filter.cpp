@@ -0,0 +1,701 @@
+// src/processing/deblocking_filter.cpp
+#include "streaming/processing/deblocking_filter.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <immintrin.h> // SIMD instructions
+
+namespace streaming {
+namespace processing {
+
+namespace {
+
+// H.264 Table 8-16: alpha / beta by indexA / indexB, tC0 by indexA and bS 1..3
+constexpr uint8_t H264_ALPHA[52] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    4, 4, 5, 6, 7, 8, 9, 10, 12, 13, 15, 17, 20, 22, 25, 28,
+    32, 36, 40, 45, 50, 56, 63, 71, 80, 90, 101, 113, 127, 144, 162, 182,
+    203, 226, 255, 255};
+constexpr uint8_t H264_BETA[52] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 6, 6, 7, 7, 8, 8,
+    9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16, 16,
+    17, 17, 18, 18};
+constexpr uint8_t H264_TC0[52][3] = {
+    {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {0, 0, 0}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 0, 1}, {0, 1, 1}, {0, 1, 1}, {1, 1, 1},
+    {1, 1, 1}, {1, 1, 1}, {1, 1, 1}, {1, 1, 2}, {1, 1, 2}, {1, 1, 2}, {1, 1, 2}, {1, 2, 3},
+    {1, 2, 3}, {2, 2, 3}, {2, 2, 4}, {2, 3, 4}, {2, 3, 4}, {3, 3, 5}, {3, 4, 6}, {3, 4, 6},
+    {4, 5, 7}, {4, 5, 8}, {4, 6, 9}, {5, 7, 10}, {6, 8, 11}, {6, 8, 13}, {7, 10, 14}, {8, 11, 16},
+    {9, 12, 18}, {10, 13, 20}, {11, 15, 23}, {13, 17, 25}};
+// Table 8-15: QPc by qPI (4:2:0)
+constexpr uint8_t H264_CHROMA_QP[52] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+    16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 29, 30,
+    31, 32, 32, 33, 34, 34, 35, 35, 36, 36, 37, 37, 37, 38, 38, 38,
+    39, 39, 39, 39};
+
+// HEVC Table 8-12: beta' by Q (0..51), tC' by Q (0..53)
+constexpr uint8_t HEVC_BETA[52] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 20, 22, 24,
+    26, 28, 30, 32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56,
+    58, 60, 62, 64};
+constexpr uint8_t HEVC_TC[54] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4,
+    4, 4, 5, 5, 6, 6, 7, 8, 9, 10, 11, 13, 14, 16, 18, 20, 22, 24};
+
+// Samples across one edge of up to 16 lines: s[i][line], i = p3 p2 p1 p0 q0 q1 q2 q3.
+// pix points at q0 of line 0; `across` steps over the edge, `along` to the next line.
+enum { P3 = 0, P2, P1, P0, Q0, Q1, Q2, Q3 };
+using EdgeSamples = int16_t[8][16];
+
+void gather(const uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int lines, EdgeSamples s) {
+    for (int line = 0; line < lines; ++line) {
+        const uint8_t* q0 = pix + line * along;
+        for (int i = 0; i < 8; ++i) {
+            s[i][line] = q0[(i - 4) * across];
+        }
+    }
+}
+
+// p3 and q3 are only read
+void scatter(const EdgeSamples s, uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int lines) {
+    for (int line = 0; line < lines; ++line) {
+        uint8_t* q0 = pix + line * along;
+        for (int i = P2; i <= Q2; ++i) {
+            q0[(i - 4) * across] = static_cast<uint8_t>(std::clamp<int>(s[i][line], 0, 255));
+        }
+    }
+}
+
+// H.264 8.7.2.3 / 8.7.2.4 for one luma line
+void h264_luma_line(EdgeSamples s, int l, int bs, int alpha, int beta, int tc0) {
+    const int p3 = s[P3][l], p2 = s[P2][l], p1 = s[P1][l], p0 = s[P0][l];
+    const int q0 = s[Q0][l], q1 = s[Q1][l], q2 = s[Q2][l], q3 = s[Q3][l];
+    if (std::abs(p0 - q0) >= alpha || std::abs(p1 - p0) >= beta || std::abs(q1 - q0) >= beta) {
+        return;
+    }
+    const bool ap = std::abs(p2 - p0) < beta;
+    const bool aq = std::abs(q2 - q0) < beta;
+
+    if (bs < 4) {
+        const int tc = tc0 + ap + aq;
+        const int delta = std::clamp(((q0 - p0) * 4 + (p1 - q1) + 4) >> 3, -tc, tc);
+        const int avg = (p0 + q0 + 1) >> 1;
+        s[P0][l] = static_cast<int16_t>(p0 + delta);
+        s[Q0][l] = static_cast<int16_t>(q0 - delta);
+        if (ap) s[P1][l] = static_cast<int16_t>(p1 + std::clamp((p2 + avg - 2 * p1) >> 1, -tc0, tc0));
+        if (aq) s[Q1][l] = static_cast<int16_t>(q1 + std::clamp((q2 + avg - 2 * q1) >> 1, -tc0, tc0));
+        return;
+    }
+
+    const bool small_gap = std::abs(p0 - q0) < ((alpha >> 2) + 2);
+    if (ap && small_gap) {
+        s[P0][l] = static_cast<int16_t>((p2 + 2 * p1 + 2 * p0 + 2 * q0 + q1 + 4) >> 3);
+        s[P1][l] = static_cast<int16_t>((p2 + p1 + p0 + q0 + 2) >> 2);
+        s[P2][l] = static_cast<int16_t>((2 * p3 + 3 * p2 + p1 + p0 + q0 + 4) >> 3);
+    } else {
+        s[P0][l] = static_cast<int16_t>((2 * p1 + p0 + q1 + 2) >> 2);
+    }
+    if (aq && small_gap) {
+        s[Q0][l] = static_cast<int16_t>((p1 + 2 * p0 + 2 * q0 + 2 * q1 + q2 + 4) >> 3);
+        s[Q1][l] = static_cast<int16_t>((p0 + q0 + q1 + q2 + 2) >> 2);
+        s[Q2][l] = static_cast<int16_t>((2 * q3 + 3 * q2 + q1 + q0 + p0 + 4) >> 3);
+    } else {
+        s[Q0][l] = static_cast<int16_t>((2 * q1 + q0 + p1 + 2) >> 2);
+    }
+}
+
+// H.264 chroma: only p0 / q0 change
+void h264_chroma_line(uint8_t* pix, ptrdiff_t across, int bs, int alpha, int beta, int tc0) {
+    const int p1 = pix[-2 * across], p0 = pix[-across], q0 = pix[0], q1 = pix[across];
+    if (std::abs(p0 - q0) >= alpha || std::abs(p1 - p0) >= beta || std::abs(q1 - q0) >= beta) {
+        return;
+    }
+    if (bs < 4) {
+        const int tc = tc0 + 1;
+        const int delta = std::clamp(((q0 - p0) * 4 + (p1 - q1) + 4) >> 3, -tc, tc);
+        pix[-across] = static_cast<uint8_t>(std::clamp(p0 + delta, 0, 255));
+        pix[0] = static_cast<uint8_t>(std::clamp(q0 - delta, 0, 255));
+    } else {
+        pix[-across] = static_cast<uint8_t>((2 * p1 + p0 + q1 + 2) >> 2);
+        pix[0] = static_cast<uint8_t>((2 * q1 + q0 + p1 + 2) >> 2);
+    }
+}
+
+// HEVC 8.7.2.5.3: filter decision of a 4-line segment from its lines 0 and 3
+struct HevcSegment {
+    int mode = 0; // 0 = off, 1 = normal, 2 = strong
+    bool side_p = false, side_q = false; // Normal filter also changes p1 / q1
+};
+
+HevcSegment hevc_decide(const EdgeSamples s, int line0, int beta, int tc) {
+    HevcSegment segment;
+    const int line3 = line0 + 3;
+    auto second_difference = [&](int a, int b, int c, int l) { return std::abs(s[a][l] - 2 * s[b][l] + s[c][l]); };
+    const int dp0 = second_difference(P2, P1, P0, line0), dp3 = second_difference(P2, P1, P0, line3);
+    const int dq0 = second_difference(Q2, Q1, Q0, line0), dq3 = second_difference(Q2, Q1, Q0, line3);
+    if (dp0 + dq0 + dp3 + dq3 >= beta) {
+        return segment;
+    }
+
+    auto strong_line = [&](int l, int dpq) {
+        return 2 * dpq < (beta >> 2) &&
+               std::abs(s[P3][l] - s[P0][l]) + std::abs(s[Q0][l] - s[Q3][l]) < (beta >> 3) &&
+               std::abs(s[P0][l] - s[Q0][l]) < ((5 * tc + 1) >> 1);
+    };
+    segment.mode = strong_line(line0, dp0 + dq0) && strong_line(line3, dp3 + dq3) ? 2 : 1;
+    const int side_threshold = (beta + (beta >> 1)) >> 3;
+    segment.side_p = dp0 + dp3 < side_threshold;
+    segment.side_q = dq0 + dq3 < side_threshold;
+    return segment;
+}
+
+// HEVC 8.7.2.5.7 for one luma line
+void hevc_luma_line(EdgeSamples s, int l, const HevcSegment& segment, int tc) {
+    const int p3 = s[P3][l], p2 = s[P2][l], p1 = s[P1][l], p0 = s[P0][l];
+    const int q0 = s[Q0][l], q1 = s[Q1][l], q2 = s[Q2][l], q3 = s[Q3][l];
+
+    if (segment.mode == 2) {
+        const int tc2 = 2 * tc;
+        s[P0][l] = static_cast<int16_t>(std::clamp((p2 + 2 * p1 + 2 * p0 + 2 * q0 + q1 + 4) >> 3, p0 - tc2, p0 + tc2));
+        s[P1][l] = static_cast<int16_t>(std::clamp((p2 + p1 + p0 + q0 + 2) >> 2, p1 - tc2, p1 + tc2));
+        s[P2][l] = static_cast<int16_t>(std::clamp((2 * p3 + 3 * p2 + p1 + p0 + q0 + 4) >> 3, p2 - tc2, p2 + tc2));
+        s[Q0][l] = static_cast<int16_t>(std::clamp((p1 + 2 * p0 + 2 * q0 + 2 * q1 + q2 + 4) >> 3, q0 - tc2, q0 + tc2));
+        s[Q1][l] = static_cast<int16_t>(std::clamp((p0 + q0 + q1 + q2 + 2) >> 2, q1 - tc2, q1 + tc2));
+        s[Q2][l] = static_cast<int16_t>(std::clamp((p0 + q0 + q1 + 3 * q2 + 2 * q3 + 4) >> 3, q2 - tc2, q2 + tc2));
+        return;
+    }
+
+    int delta = (9 * (q0 - p0) - 3 * (q1 - p1) + 8) >> 4;
+    if (std::abs(delta) >= tc * 10) {
+        return;
+    }
+    delta = std::clamp(delta, -tc, tc);
+    s[P0][l] = static_cast<int16_t>(p0 + delta);
+    s[Q0][l] = static_cast<int16_t>(q0 - delta);
+    const int half_tc = tc >> 1;
+    if (segment.side_p) {
+        s[P1][l] = static_cast<int16_t>(p1 + std::clamp((((p2 + p0 + 1) >> 1) - p1 + delta) >> 1, -half_tc, half_tc));
+    }
+    if (segment.side_q) {
+        s[Q1][l] = static_cast<int16_t>(q1 + std::clamp((((q2 + q0 + 1) >> 1) - q1 - delta) >> 1, -half_tc, half_tc));
+    }
+}
+
+#ifdef __AVX2__
+// 16 lines at once, one 16-bit lane per line
+
+// Horizontal edge: rows of 16 samples. Vertical edge: 16 rows of 8 samples, transposed.
+void transpose_8x8_rows(const uint8_t* src, ptrdiff_t stride, __m128i out[4]) {
+    __m128i r[8];
+    for (int i = 0; i < 8; ++i) {
+        r[i] = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i * stride));
+    }
+    const __m128i t0 = _mm_unpacklo_epi8(r[0], r[1]), t1 = _mm_unpacklo_epi8(r[2], r[3]);
+    const __m128i t2 = _mm_unpacklo_epi8(r[4], r[5]), t3 = _mm_unpacklo_epi8(r[6], r[7]);
+    const __m128i u0 = _mm_unpacklo_epi16(t0, t1), u1 = _mm_unpackhi_epi16(t0, t1);
+    const __m128i u2 = _mm_unpacklo_epi16(t2, t3), u3 = _mm_unpackhi_epi16(t2, t3);
+    out[0] = _mm_unpacklo_epi32(u0, u2); // Columns 0, 1
+    out[1] = _mm_unpackhi_epi32(u0, u2); // Columns 2, 3
+    out[2] = _mm_unpacklo_epi32(u1, u3); // Columns 4, 5
+    out[3] = _mm_unpackhi_epi32(u1, u3); // Columns 6, 7
+}
+
+void load_edge(const uint8_t* pix, ptrdiff_t across, ptrdiff_t along, __m256i v[8]) {
+    if (across != 1) {
+        for (int i = 0; i < 8; ++i) {
+            v[i] = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pix + (i - 4) * across)));
+        }
+        return;
+    }
+    __m128i top[4], bottom[4];
+    transpose_8x8_rows(pix - 4, along, top);
+    transpose_8x8_rows(pix - 4 + 8 * along, along, bottom);
+    for (int i = 0; i < 4; ++i) {
+        v[2 * i] = _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(top[i], bottom[i]));
+        v[2 * i + 1] = _mm256_cvtepu8_epi16(_mm_unpackhi_epi64(top[i], bottom[i]));
+    }
+}
+
+inline __m128i pack_lanes(__m256i v) {
+    return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+void store_edge(const __m256i v[8], uint8_t* pix, ptrdiff_t across, ptrdiff_t along) {
+    if (across != 1) {
+        for (int i = P2; i <= Q2; ++i) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pix + (i - 4) * across), pack_lanes(v[i]));
+        }
+        return;
+    }
+    // Back to 16 rows of 8 samples (p3 / q3 are written back unchanged)
+    __m128i c[8];
+    for (int i = 0; i < 8; ++i) {
+        c[i] = pack_lanes(v[i]);
+    }
+    for (int half = 0; half < 2; ++half) {
+        auto unpack8 = [half](__m128i a, __m128i b) {
+            return half ? _mm_unpackhi_epi8(a, b) : _mm_unpacklo_epi8(a, b);
+        };
+        const __m128i t0 = unpack8(c[0], c[1]), t1 = unpack8(c[2], c[3]);
+        const __m128i t2 = unpack8(c[4], c[5]), t3 = unpack8(c[6], c[7]);
+        const __m128i u0 = _mm_unpacklo_epi16(t0, t1), u1 = _mm_unpackhi_epi16(t0, t1);
+        const __m128i u2 = _mm_unpacklo_epi16(t2, t3), u3 = _mm_unpackhi_epi16(t2, t3);
+        const __m128i rows[4] = {_mm_unpacklo_epi32(u0, u2), _mm_unpackhi_epi32(u0, u2),
+                                 _mm_unpacklo_epi32(u1, u3), _mm_unpackhi_epi32(u1, u3)};
+        uint8_t* dst = pix - 4 + 8 * half * along;
+        for (int i = 0; i < 4; ++i) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + (2 * i) * along), rows[i]);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + (2 * i + 1) * along), _mm_unpackhi_epi64(rows[i], rows[i]));
+        }
+    }
+}
+
+// One value per 4-line segment
+inline __m256i segment_lanes(int a, int b, int c, int d) {
+    return _mm256_setr_epi16(a, a, a, a, b, b, b, b, c, c, c, c, d, d, d, d);
+}
+inline __m256i less_than(__m256i a, __m256i b) { return _mm256_cmpgt_epi16(b, a); }
+inline __m256i abs_diff(__m256i a, __m256i b) { return _mm256_abs_epi16(_mm256_sub_epi16(a, b)); }
+inline __m256i clamp_lanes(__m256i v, __m256i limit) {
+    return _mm256_min_epi16(_mm256_max_epi16(v, _mm256_sub_epi16(_mm256_setzero_si256(), limit)), limit);
+}
+inline __m256i clamp_around(__m256i v, __m256i centre, __m256i range) {
+    return _mm256_min_epi16(_mm256_max_epi16(v, _mm256_sub_epi16(centre, range)), _mm256_add_epi16(centre, range));
+}
+inline __m256i blend(__m256i a, __m256i b, __m256i mask) { return _mm256_blendv_epi8(a, b, mask); }
+
+// h264_luma_line on 16 lines; normal / strong: lanes with 0 < bS < 4 / bS == 4
+void h264_luma_avx2(__m256i v[8], int alpha, int beta, __m256i tc0, __m256i normal, __m256i strong) {
+    const __m256i p3 = v[P3], p2 = v[P2], p1 = v[P1], p0 = v[P0];
+    const __m256i q0 = v[Q0], q1 = v[Q1], q2 = v[Q2], q3 = v[Q3];
+    const __m256i va = _mm256_set1_epi16(static_cast<int16_t>(alpha));
+    const __m256i vb = _mm256_set1_epi16(static_cast<int16_t>(beta));
+    const __m256i two = _mm256_set1_epi16(2), four = _mm256_set1_epi16(4);
+
+    const __m256i filter = _mm256_and_si256(_mm256_and_si256(less_than(abs_diff(p0, q0), va),
+                                                             less_than(abs_diff(p1, p0), vb)),
+                                            less_than(abs_diff(q1, q0), vb));
+    const __m256i ap = less_than(abs_diff(p2, p0), vb);
+    const __m256i aq = less_than(abs_diff(q2, q0), vb);
+
+    // bS < 4 (masks are -1, so subtracting them adds one)
+    const __m256i n = _mm256_and_si256(normal, filter);
+    const __m256i tc = _mm256_sub_epi16(_mm256_sub_epi16(tc0, ap), aq);
+    const __m256i delta = clamp_lanes(
+        _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(_mm256_sub_epi16(q0, p0), 2),
+                                                            _mm256_sub_epi16(p1, q1)), four), 3), tc);
+    const __m256i avg = _mm256_avg_epu16(p0, q0);
+    const __m256i dp1 = clamp_lanes(_mm256_srai_epi16(_mm256_sub_epi16(_mm256_add_epi16(p2, avg),
+                                                                       _mm256_slli_epi16(p1, 1)), 1), tc0);
+    const __m256i dq1 = clamp_lanes(_mm256_srai_epi16(_mm256_sub_epi16(_mm256_add_epi16(q2, avg),
+                                                                       _mm256_slli_epi16(q1, 1)), 1), tc0);
+    __m256i np0 = blend(p0, _mm256_add_epi16(p0, delta), n);
+    __m256i nq0 = blend(q0, _mm256_sub_epi16(q0, delta), n);
+    __m256i np1 = blend(p1, _mm256_add_epi16(p1, dp1), _mm256_and_si256(n, ap));
+    __m256i nq1 = blend(q1, _mm256_add_epi16(q1, dq1), _mm256_and_si256(n, aq));
+
+    // bS == 4
+    const __m256i s = _mm256_and_si256(strong, filter);
+    const __m256i small_gap = less_than(abs_diff(p0, q0), _mm256_set1_epi16(static_cast<int16_t>((alpha >> 2) + 2)));
+    const __m256i sp = _mm256_and_si256(s, _mm256_and_si256(ap, small_gap));
+    const __m256i sq = _mm256_and_si256(s, _mm256_and_si256(aq, small_gap));
+    const __m256i p0q0 = _mm256_add_epi16(p0, q0);
+
+    const __m256i p0s = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(p2, _mm256_slli_epi16(p1, 1)),
+        _mm256_add_epi16(_mm256_slli_epi16(p0q0, 1), _mm256_add_epi16(q1, four))), 3);
+    const __m256i p1s = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(p2, p1), _mm256_add_epi16(p0q0, two)), 2);
+    const __m256i p2s = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(p3, 1),
+        _mm256_mullo_epi16(p2, _mm256_set1_epi16(3))), _mm256_add_epi16(_mm256_add_epi16(p1, p0q0), four)), 3);
+    const __m256i p0w = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(p1, 1), p0),
+                                                           _mm256_add_epi16(q1, two)), 2);
+    const __m256i q0s = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(q2, _mm256_slli_epi16(q1, 1)),
+        _mm256_add_epi16(_mm256_slli_epi16(p0q0, 1), _mm256_add_epi16(p1, four))), 3);
+    const __m256i q1s = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(q2, q1), _mm256_add_epi16(p0q0, two)), 2);
+    const __m256i q2s = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(q3, 1),
+        _mm256_mullo_epi16(q2, _mm256_set1_epi16(3))), _mm256_add_epi16(_mm256_add_epi16(q1, p0q0), four)), 3);
+    const __m256i q0w = _mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(q1, 1), q0),
+                                                           _mm256_add_epi16(p1, two)), 2);
+
+    np0 = blend(blend(np0, p0w, s), p0s, sp);
+    nq0 = blend(blend(nq0, q0w, s), q0s, sq);
+    v[P2] = blend(p2, p2s, sp);
+    v[P1] = blend(np1, p1s, sp);
+    v[P0] = np0;
+    v[Q0] = nq0;
+    v[Q1] = blend(nq1, q1s, sq);
+    v[Q2] = blend(q2, q2s, sq);
+}
+
+// hevc_luma_line on 16 lines with per-lane tC and segment decisions
+void hevc_luma_avx2(__m256i v[8], __m256i tc, __m256i strong, __m256i normal, __m256i side_p, __m256i side_q) {
+    const __m256i p3 = v[P3], p2 = v[P2], p1 = v[P1], p0 = v[P0];
+    const __m256i q0 = v[Q0], q1 = v[Q1], q2 = v[Q2], q3 = v[Q3];
+    const __m256i two = _mm256_set1_epi16(2), four = _mm256_set1_epi16(4), three = _mm256_set1_epi16(3);
+    const __m256i p0q0 = _mm256_add_epi16(p0, q0);
+
+    // Strong filter, clipped to +-2 tC
+    const __m256i tc2 = _mm256_slli_epi16(tc, 1);
+    const __m256i p0s = clamp_around(_mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(p2, _mm256_slli_epi16(p1, 1)),
+        _mm256_add_epi16(_mm256_slli_epi16(p0q0, 1), _mm256_add_epi16(q1, four))), 3), p0, tc2);
+    const __m256i p1s = clamp_around(_mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(p2, p1),
+                                                                        _mm256_add_epi16(p0q0, two)), 2), p1, tc2);
+    const __m256i p2s = clamp_around(_mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(p3, 1),
+        _mm256_mullo_epi16(p2, three)), _mm256_add_epi16(_mm256_add_epi16(p1, p0q0), four)), 3), p2, tc2);
+    const __m256i q0s = clamp_around(_mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(q2, _mm256_slli_epi16(q1, 1)),
+        _mm256_add_epi16(_mm256_slli_epi16(p0q0, 1), _mm256_add_epi16(p1, four))), 3), q0, tc2);
+    const __m256i q1s = clamp_around(_mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(q2, q1),
+                                                                        _mm256_add_epi16(p0q0, two)), 2), q1, tc2);
+    const __m256i q2s = clamp_around(_mm256_srai_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_slli_epi16(q3, 1),
+        _mm256_mullo_epi16(q2, three)), _mm256_add_epi16(_mm256_add_epi16(q1, p0q0), four)), 3), q2, tc2);
+
+    // Normal filter
+    __m256i delta = _mm256_srai_epi16(_mm256_add_epi16(_mm256_sub_epi16(
+        _mm256_mullo_epi16(_mm256_sub_epi16(q0, p0), _mm256_set1_epi16(9)),
+        _mm256_mullo_epi16(_mm256_sub_epi16(q1, p1), three)), _mm256_set1_epi16(8)), 4);
+    const __m256i apply = _mm256_and_si256(normal, less_than(_mm256_abs_epi16(delta),
+                                                             _mm256_mullo_epi16(tc, _mm256_set1_epi16(10))));
+    delta = clamp_lanes(delta, tc);
+    const __m256i half_tc = _mm256_srai_epi16(tc, 1);
+    const __m256i dp = clamp_lanes(_mm256_srai_epi16(_mm256_add_epi16(_mm256_sub_epi16(_mm256_avg_epu16(p2, p0), p1),
+                                                                      delta), 1), half_tc);
+    const __m256i dq = clamp_lanes(_mm256_srai_epi16(_mm256_sub_epi16(_mm256_sub_epi16(_mm256_avg_epu16(q2, q0), q1),
+                                                                      delta), 1), half_tc);
+
+    v[P0] = blend(blend(p0, _mm256_add_epi16(p0, delta), apply), p0s, strong);
+    v[Q0] = blend(blend(q0, _mm256_sub_epi16(q0, delta), apply), q0s, strong);
+    v[P1] = blend(blend(p1, _mm256_add_epi16(p1, dp), _mm256_and_si256(apply, side_p)), p1s, strong);
+    v[Q1] = blend(blend(q1, _mm256_add_epi16(q1, dq), _mm256_and_si256(apply, side_q)), q1s, strong);
+    v[P2] = blend(p2, p2s, strong);
+    v[Q2] = blend(q2, q2s, strong);
+}
+#endif
+
+} // namespace
+
+// ---------------------------------------------------------------------------------------
+// H.264
+
+void H264DeblockingFilter::configure(uint32_t width, uint32_t height) {
+    width_ = width;
+    height_ = height;
+    mb_width_ = (width + 15) / 16;
+    mb_height_ = (height + 15) / 16;
+    info_.assign(static_cast<size_t>(mb_width_) * mb_height_, MacroblockInfo{});
+}
+
+void H264DeblockingFilter::set_offsets(int alpha_offset, int beta_offset) {
+    alpha_offset_ = alpha_offset;
+    beta_offset_ = beta_offset;
+}
+
+int H264DeblockingFilter::boundary_strength(const MacroblockInfo& p, int p_block, const MacroblockInfo& q,
+                                            int q_block, bool mb_edge) {
+    if (p.intra || q.intra) {
+        return mb_edge ? 4 : 3;
+    }
+    if (((p.coded >> p_block) & 1) || ((q.coded >> q_block) & 1)) {
+        return 2;
+    }
+    if (p.ref_idx != q.ref_idx || std::abs(p.mv_x - q.mv_x) >= 4 || std::abs(p.mv_y - q.mv_y) >= 4) {
+        return 1;
+    }
+    return 0;
+}
+
+void H264DeblockingFilter::filter_luma_edge(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int length,
+                                            const uint8_t bs[4], int qp) const {
+    const int index_a = std::clamp(qp + alpha_offset_, 0, 51);
+    const int index_b = std::clamp(qp + beta_offset_, 0, 51);
+    const int alpha = H264_ALPHA[index_a];
+    const int beta = H264_BETA[index_b];
+    if (alpha == 0 || beta == 0 || (bs[0] | bs[1] | bs[2] | bs[3]) == 0) {
+        return; // Nothing passes |p0 - q0| < alpha
+    }
+    const uint8_t* tc0 = H264_TC0[index_a];
+
+#ifdef __AVX2__
+    if (length == 16) {
+        auto tc0_of = [&](int b) { return b > 0 && b < 4 ? tc0[b - 1] : 0; };
+        auto normal_of = [](int b) { return b > 0 && b < 4 ? -1 : 0; };
+        auto strong_of = [](int b) { return b == 4 ? -1 : 0; };
+        __m256i v[8];
+        load_edge(pix, across, along, v);
+        h264_luma_avx2(v, alpha, beta,
+                       segment_lanes(tc0_of(bs[0]), tc0_of(bs[1]), tc0_of(bs[2]), tc0_of(bs[3])),
+                       segment_lanes(normal_of(bs[0]), normal_of(bs[1]), normal_of(bs[2]), normal_of(bs[3])),
+                       segment_lanes(strong_of(bs[0]), strong_of(bs[1]), strong_of(bs[2]), strong_of(bs[3])));
+        store_edge(v, pix, across, along);
+        return;
+    }
+#endif
+
+    EdgeSamples s;
+    gather(pix, across, along, length, s);
+    for (int line = 0; line < length; ++line) {
+        const int b = bs[line >> 2];
+        if (b) {
+            h264_luma_line(s, line, b, alpha, beta, b < 4 ? tc0[b - 1] : 0);
+        }
+    }
+    scatter(s, pix, across, along, length);
+}
+
+void H264DeblockingFilter::filter_row(uint8_t* luma, int stride, uint32_t mb_y) const {
+    const int y0 = static_cast<int>(mb_y) * 16;
+    const int lines = std::min(16, static_cast<int>(height_) - y0);
+    uint8_t bs[4];
+
+    for (uint32_t mb_x = 0; mb_x < mb_width_; ++mb_x) {
+        const MacroblockInfo& q = info(mb_x, mb_y);
+        const int x0 = static_cast<int>(mb_x) * 16;
+        uint8_t* mb = luma + static_cast<ptrdiff_t>(y0) * stride + x0;
+
+        // Vertical edges: the left macroblock edge, then the internal 8x8 edge
+        for (int edge = 0; edge < 2; ++edge) {
+            const int x = x0 + edge * 8;
+            if (x == 0 || x + 4 > static_cast<int>(width_)) {
+                continue;
+            }
+            const MacroblockInfo& p = edge ? q : info(mb_x - 1, mb_y);
+            for (int segment = 0; segment < 4; ++segment) {
+                const int block_row = (segment >> 1) * 2;
+                bs[segment] = static_cast<uint8_t>(boundary_strength(p, block_row + (edge ? 0 : 1), q,
+                                                                     block_row + edge, edge == 0));
+            }
+            filter_luma_edge(mb + edge * 8, 1, stride, lines, bs, (p.qp + q.qp + 1) >> 1);
+        }
+
+        // Horizontal edges: the top macroblock edge, then the internal 8x8 edge
+        const int columns = std::min(16, static_cast<int>(width_) - x0);
+        for (int edge = 0; edge < 2; ++edge) {
+            const int y = y0 + edge * 8;
+            if (y == 0 || y + 4 > static_cast<int>(height_)) {
+                continue;
+            }
+            const MacroblockInfo& p = edge ? q : info(mb_x, mb_y - 1);
+            for (int segment = 0; segment < 4; ++segment) {
+                const int block_column = segment >> 1;
+                bs[segment] = static_cast<uint8_t>(boundary_strength(p, (edge ? 0 : 2) + block_column, q,
+                                                                     edge * 2 + block_column, edge == 0));
+            }
+            filter_luma_edge(mb + static_cast<ptrdiff_t>(edge) * 8 * stride, stride, 1, columns, bs,
+                             (p.qp + q.qp + 1) >> 1);
+        }
+    }
+}
+
+void H264DeblockingFilter::filter_chroma_row(uint8_t* cb, uint8_t* cr, int stride, uint32_t mb_y) const {
+    // Chroma edges 0 and 4 take bS from luma edges 0 and 8; line k of an edge lies next to luma segment k / 2
+    const int chroma_width = static_cast<int>((width_ + 1) / 2);
+    const int chroma_height = static_cast<int>((height_ + 1) / 2);
+    const int y0 = static_cast<int>(mb_y) * 8;
+    const int lines = std::min(8, chroma_height - y0);
+
+    auto chroma_qp = [](const MacroblockInfo& p, const MacroblockInfo& q) {
+        return (H264_CHROMA_QP[std::clamp<int>(p.qp, 0, 51)] + H264_CHROMA_QP[std::clamp<int>(q.qp, 0, 51)] + 1) >> 1;
+    };
+    auto filter_edge = [&](ptrdiff_t offset, ptrdiff_t across, ptrdiff_t along, int length, const uint8_t bs[4], int qp) {
+        const int index_a = std::clamp(qp + alpha_offset_, 0, 51);
+        const int alpha = H264_ALPHA[index_a];
+        const int beta = H264_BETA[std::clamp(qp + beta_offset_, 0, 51)];
+        if (alpha == 0 || beta == 0) {
+            return;
+        }
+        for (uint8_t* plane : {cb, cr}) {
+            for (int line = 0; line < length; ++line) {
+                const int b = bs[line >> 1];
+                if (b) {
+                    h264_chroma_line(plane + offset + line * along, across, b, alpha, beta,
+                                     b < 4 ? H264_TC0[index_a][b - 1] : 0);
+                }
+            }
+        }
+    };
+
+    uint8_t bs[4];
+    for (uint32_t mb_x = 0; mb_x < mb_width_; ++mb_x) {
+        const MacroblockInfo& q = info(mb_x, mb_y);
+        const int x0 = static_cast<int>(mb_x) * 8;
+        const ptrdiff_t mb = static_cast<ptrdiff_t>(y0) * stride + x0;
+
+        for (int edge = 0; edge < 2; ++edge) {
+            const int x = x0 + edge * 4;
+            if (x == 0 || x + 2 > chroma_width) {
+                continue;
+            }
+            const MacroblockInfo& p = edge ? q : info(mb_x - 1, mb_y);
+            for (int segment = 0; segment < 4; ++segment) {
+                const int block_row = (segment >> 1) * 2;
+                bs[segment] = static_cast<uint8_t>(boundary_strength(p, block_row + (edge ? 0 : 1), q,
+                                                                     block_row + edge, edge == 0));
+            }
+            filter_edge(mb + edge * 4, 1, stride, lines, bs, chroma_qp(p, q));
+        }
+
+        const int columns = std::min(8, chroma_width - x0);
+        for (int edge = 0; edge < 2; ++edge) {
+            const int y = y0 + edge * 4;
+            if (y == 0 || y + 2 > chroma_height) {
+                continue;
+            }
+            const MacroblockInfo& p = edge ? q : info(mb_x, mb_y - 1);
+            for (int segment = 0; segment < 4; ++segment) {
+                const int block_column = segment >> 1;
+                bs[segment] = static_cast<uint8_t>(boundary_strength(p, (edge ? 0 : 2) + block_column, q,
+                                                                     edge * 2 + block_column, edge == 0));
+            }
+            filter_edge(mb + static_cast<ptrdiff_t>(edge) * 4 * stride, stride, 1, columns, bs, chroma_qp(p, q));
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// HEVC
+
+void HevcDeblockingFilter::configure(uint32_t width, uint32_t height, int row_height) {
+    width_ = width;
+    height_ = height;
+    row_height_ = std::max(8, row_height);
+    grid_width_ = static_cast<int>((width + 7) / 8);
+    grid_height_ = static_cast<int>((height + 7) / 8);
+    info_.assign(static_cast<size_t>(grid_width_) * grid_height_, BlockInfo{});
+}
+
+void HevcDeblockingFilter::set_offsets(int beta_offset_div2, int tc_offset_div2) {
+    beta_offset_ = beta_offset_div2 * 2;
+    tc_offset_ = tc_offset_div2 * 2;
+}
+
+void HevcDeblockingFilter::fill(int x, int y, int width, int height, const BlockInfo& block) {
+    const int x1 = std::min(x + width, static_cast<int>(width_));
+    const int y1 = std::min(y + height, static_cast<int>(height_));
+    for (int by = y >> 3; by < (y1 + 7) >> 3; ++by) {
+        for (int bx = x >> 3; bx < (x1 + 7) >> 3; ++bx) {
+            info_[static_cast<size_t>(by) * grid_width_ + bx] = block;
+        }
+    }
+}
+
+int HevcDeblockingFilter::boundary_strength(const BlockInfo& p, const BlockInfo& q) {
+    if (p.intra || q.intra) {
+        return 2;
+    }
+    if (p.coded || q.coded) {
+        return 1;
+    }
+    if (p.ref_idx != q.ref_idx || std::abs(p.mv_x - q.mv_x) >= 4 || std::abs(p.mv_y - q.mv_y) >= 4) {
+        return 1;
+    }
+    return 0;
+}
+
+void HevcDeblockingFilter::filter_luma_edge(uint8_t* pix, ptrdiff_t across, ptrdiff_t along, int segments,
+                                            const uint8_t bs[4], const int qp[4]) const {
+    int beta[4] = {}, tc[4] = {};
+    bool any = false;
+    for (int k = 0; k < segments; ++k) {
+        if (bs[k]) {
+            beta[k] = HEVC_BETA[std::clamp(qp[k] + beta_offset_, 0, 51)];
+            tc[k] = HEVC_TC[std::clamp(qp[k] + 2 * (bs[k] - 1) + tc_offset_, 0, 53)];
+            any = any || beta[k] > 0;
+        }
+    }
+    if (!any) {
+        return;
+    }
+
+    alignas(32) EdgeSamples s;
+    HevcSegment decisions[4];
+
+#ifdef __AVX2__
+    if (segments == 4) {
+        __m256i v[8];
+        load_edge(pix, across, along, v);
+        for (int i = 0; i < 8; ++i) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(s[i]), v[i]);
+        }
+        int lane_tc[4], strong[4], normal[4], side_p[4], side_q[4];
+        bool filtered = false;
+        for (int k = 0; k < 4; ++k) {
+            decisions[k] = bs[k] ? hevc_decide(s, k * 4, beta[k], tc[k]) : HevcSegment{};
+            lane_tc[k] = decisions[k].mode ? tc[k] : 0;
+            strong[k] = decisions[k].mode == 2 ? -1 : 0;
+            normal[k] = decisions[k].mode == 1 ? -1 : 0;
+            side_p[k] = decisions[k].side_p ? -1 : 0;
+            side_q[k] = decisions[k].side_q ? -1 : 0;
+            filtered = filtered || decisions[k].mode;
+        }
+        if (!filtered) {
+            return;
+        }
+        hevc_luma_avx2(v, segment_lanes(lane_tc[0], lane_tc[1], lane_tc[2], lane_tc[3]),
+                       segment_lanes(strong[0], strong[1], strong[2], strong[3]),
+                       segment_lanes(normal[0], normal[1], normal[2], normal[3]),
+                       segment_lanes(side_p[0], side_p[1], side_p[2], side_p[3]),
+                       segment_lanes(side_q[0], side_q[1], side_q[2], side_q[3]));
+        store_edge(v, pix, across, along);
+        return;
+    }
+#endif
+
+    const int lines = segments * 4;
+    gather(pix, across, along, lines, s);
+    for (int k = 0; k < segments; ++k) {
+        decisions[k] = bs[k] ? hevc_decide(s, k * 4, beta[k], tc[k]) : HevcSegment{};
+        if (decisions[k].mode) {
+            for (int line = k * 4; line < k * 4 + 4; ++line) {
+                hevc_luma_line(s, line, decisions[k], tc[k]);
+            }
+        }
+    }
+    scatter(s, pix, across, along, lines);
+}
+
+void HevcDeblockingFilter::filter_row(uint8_t* luma, int stride, int row) const {
+    const int y0 = row * row_height_;
+    const int y1 = std::min(y0 + row_height_, static_cast<int>(height_));
+    const int width = static_cast<int>(width_);
+    uint8_t bs[4];
+    int qp[4];
+
+    // Vertical edges, 16 lines at a time; only whole 4-line segments inside the picture
+    for (int x = 8; x + 4 <= width; x += 8) {
+        for (int y = y0; y < y1; y += 16) {
+            const int segments = std::min(4, (y1 - y) / 4);
+            if (segments == 0) {
+                break;
+            }
+            for (int k = 0; k < segments; ++k) {
+                const BlockInfo& p = info(x - 1, y + k * 4);
+                const BlockInfo& q = info(x, y + k * 4);
+                bs[k] = static_cast<uint8_t>(boundary_strength(p, q));
+                qp[k] = (p.qp + q.qp + 1) >> 1;
+            }
+            filter_luma_edge(luma + static_cast<ptrdiff_t>(y) * stride + x, 1, stride, segments, bs, qp);
+        }
+    }
+
+    // Horizontal edges, on vertically filtered samples
+    for (int y = std::max(y0, 8); y < y1 && y + 4 <= static_cast<int>(height_); y += 8) {
+        for (int x = 0; x < width; x += 16) {
+            const int segments = std::min(4, (width - x) / 4);
+            if (segments == 0) {
+                break;
+            }
+            for (int k = 0; k < segments; ++k) {
+                const BlockInfo& p = info(x + k * 4, y - 1);
+                const BlockInfo& q = info(x + k * 4, y);
+                bs[k] = static_cast<uint8_t>(boundary_strength(p, q));
+                qp[k] = (p.qp + q.qp + 1) >> 1;
+            }
+            filter_luma_edge(luma + static_cast<ptrdiff_t>(y) * stride + x, stride, 1, segments, bs, qp);
+        }
+    }
+}
+
+} // namespace processing
+} // namespace streaming
@@ -0,0 +1,134 @@
+// src/processing/frame_scaler.cpp
+#include "streaming/processing/frame_scaler.hpp"
+#include <algorithm>
+#include <immintrin.h> // SIMD instructions
+
+namespace streaming {
+namespace processing {
+
+namespace {
+
+constexpr int WEIGHT_BITS = 6; // Bilinear weights in 1/64
+constexpr int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+// Left source sample and weight of the right one for every output position
+void build_axis(int src_size, int dst_size, std::vector<int32_t>& index, std::vector<int16_t>& fraction) {
+    index.resize(dst_size);
+    fraction.resize(dst_size);
+    for (int i = 0; i < dst_size; ++i) {
+        // Centre of output sample i in source coordinates, in 1/64
+        const int64_t position = (static_cast<int64_t>(2 * i + 1) * src_size * WEIGHT_ONE) / (2 * dst_size) -
+                                 WEIGHT_ONE / 2;
+        const int32_t clamped = static_cast<int32_t>(std::max<int64_t>(position, 0));
+        int32_t left = clamped >> WEIGHT_BITS;
+        int16_t weight = static_cast<int16_t>(clamped & (WEIGHT_ONE - 1));
+        if (left >= src_size - 1) {
+            left = src_size - 1;
+            weight = 0;
+        }
+        index[i] = left;
+        fraction[i] = weight;
+    }
+}
+
+} // namespace
+
+void PlaneScaler::configure(int src_width, int src_height, int dst_width, int dst_height) {
+    src_width_ = src_width;
+    src_height_ = src_height;
+    dst_width_ = dst_width;
+    dst_height_ = dst_height;
+
+    std::vector<int16_t> x_fraction;
+    build_axis(src_width, dst_width, x_index_, x_fraction);
+    x_weights_.resize(dst_width);
+    for (int i = 0; i < dst_width; ++i) {
+        x_weights_[i] = (WEIGHT_ONE - x_fraction[i]) | (static_cast<int32_t>(x_fraction[i]) << 16);
+    }
+    build_axis(src_height, dst_height, y_index_, y_fraction_);
+
+    // One spare sample so the right neighbour of the last column is always readable
+    row_.assign(static_cast<size_t>(src_width) + 1, 0);
+}
+
+void PlaneScaler::scale(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride) {
+    int16_t* row = row_.data();
+
+    for (int y = 0; y < dst_height_; ++y) {
+        // Vertical pass: row = top * (64 - f) + bottom * f
+        const uint8_t* top = src + static_cast<size_t>(y_index_[y]) * src_stride;
+        const uint8_t* bottom = top + (y_index_[y] + 1 < src_height_ ? src_stride : 0);
+        const int16_t fy = y_fraction_[y];
+        int x = 0;
+#ifdef __AVX2__
+        const __m256i top_weight = _mm256_set1_epi16(static_cast<int16_t>(WEIGHT_ONE - fy));
+        const __m256i bottom_weight = _mm256_set1_epi16(fy);
+        for (; x + 16 <= src_width_; x += 16) {
+            const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + x)));
+            const __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + x)));
+            const __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(a, top_weight), _mm256_mullo_epi16(b, bottom_weight));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + x), sum);
+        }
+#endif
+        for (; x < src_width_; ++x) {
+            row[x] = static_cast<int16_t>(top[x] * (WEIGHT_ONE - fy) + bottom[x] * fy);
+        }
+        row[src_width_] = row[src_width_ - 1];
+
+        // Horizontal pass: out = (row[i] * (64 - f) + row[i + 1] * f + round) >> 12
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_stride;
+        constexpr int SHIFT = 2 * WEIGHT_BITS;
+        int i = 0;
+#ifdef __AVX2__
+        const __m256i rounding = _mm256_set1_epi32(1 << (SHIFT - 1));
+        for (; i + 8 <= dst_width_; i += 8) {
+            // Each 32-bit gather fetches a sample and its right neighbour
+            const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x_index_.data() + i));
+            const __m256i pairs = _mm256_i32gather_epi32(reinterpret_cast<const int*>(row), index, 2);
+            const __m256i weights = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x_weights_.data() + i));
+            __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(pairs, weights), rounding), SHIFT);
+            sum = _mm256_permute4x64_epi64(_mm256_packus_epi32(sum, sum), 0x08);
+            const __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(sum), _mm256_castsi256_si128(sum));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), bytes);
+        }
+#endif
+        for (; i < dst_width_; ++i) {
+            const int left = x_index_[i];
+            const int fx = x_weights_[i] >> 16;
+            const int value = (row[left] * (WEIGHT_ONE - fx) + row[left + 1] * fx + (1 << (SHIFT - 1))) >> SHIFT;
+            out[i] = static_cast<uint8_t>(std::clamp(value, 0, 255));
+        }
+    }
+}
+
+void FrameScaler::configure(int src_width, int src_height, int dst_width, int dst_height) {
+    luma_.configure(src_width, src_height, dst_width, dst_height);
+    chroma_.configure((src_width + 1) / 2, (src_height + 1) / 2, (dst_width + 1) / 2, (dst_height + 1) / 2);
+}
+
+void FrameScaler::scale(const uint8_t* src, int src_stride, bool has_chroma, std::vector<uint8_t>& dst) {
+    const int chroma_stride = src_stride / 2;
+    const uint8_t* u = src + static_cast<size_t>(src_stride) * luma_.src_height();
+    const uint8_t* v = u + static_cast<size_t>(chroma_stride) * chroma_.src_height();
+    const uint8_t* const planes[3] = {src, has_chroma ? u : nullptr, has_chroma ? v : nullptr};
+    const int strides[3] = {src_stride, chroma_stride, chroma_stride};
+    scale(planes, strides, dst);
+}
+
+void FrameScaler::scale(const uint8_t* const planes[3], const int strides[3], std::vector<uint8_t>& dst) {
+    const size_t luma_size = static_cast<size_t>(luma_.dst_width()) * luma_.dst_height();
+    const size_t chroma_size = static_cast<size_t>(chroma_.dst_width()) * chroma_.dst_height();
+    dst.resize(luma_size + 2 * chroma_size);
+
+    luma_.scale(planes[0], strides[0], dst.data(), luma_.dst_width());
+
+    if (!planes[1] || !planes[2]) {
+        std::fill(dst.begin() + luma_size, dst.end(), 128);
+        return;
+    }
+    chroma_.scale(planes[1], strides[1], dst.data() + luma_size, chroma_.dst_width());
+    chroma_.scale(planes[2], strides[2], dst.data() + luma_size + chroma_size, chroma_.dst_width());
+}
+
+} // namespace processing
+} // namespace streaming
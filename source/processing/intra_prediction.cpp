@@ -0,0 +1,946 @@
+// src/processing/intra_prediction.cpp
+#include "streaming/processing/intra_prediction.hpp"
+#include "streaming/processing/subpel_interpolation.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h> // SIMD instructions
+
+namespace streaming {
+namespace processing {
+
+namespace {
+
+constexpr int MAX_SIZE = IntraEdges::MAX_SIZE;
+
+// intraPredAngle magnitudes from the diagonal (32) to the pure direction (0)
+constexpr int8_t HEVC_ANGLES[9] = {32, 26, 21, 17, 13, 9, 5, 2, 0};
+constexpr int8_t VVC_ANGLES[17] = {32, 29, 26, 23, 20, 18, 16, 14, 12, 10, 8, 6, 4, 3, 2, 1, 0};
+
+// AV1 dr_intra_derivative by angle (only the angles nominal +- 3 * delta reach are set)
+constexpr int16_t AV1_DR_DERIVATIVE[90] = {
+    0, 0, 0, 1023, 0, 0, 547, 0, 0, 372, 0, 0, 0, 0, 273, 0, 0, 215, 0, 0, 178, 0, 0, 151, 0, 0, 132, 0, 0,
+    116, 0, 0, 102, 0, 0, 0, 90, 0, 0, 80, 0, 0, 71, 0, 0, 64, 0, 0, 57, 0, 0, 51, 0, 0, 45, 0, 0, 0, 40,
+    0, 0, 35, 0, 0, 31, 0, 0, 27, 0, 0, 23, 0, 0, 19, 0, 0, 15, 0, 0, 0, 0, 11, 0, 0, 7, 0, 0, 3, 0, 0};
+
+// AV1 smooth weights (sm_weight_arrays), scale 256, by block dimension
+constexpr uint8_t AV1_SMOOTH_4[4] = {255, 149, 85, 64};
+constexpr uint8_t AV1_SMOOTH_8[8] = {255, 197, 146, 105, 73, 50, 37, 32};
+constexpr uint8_t AV1_SMOOTH_16[16] = {255, 225, 196, 170, 145, 123, 102, 84, 68, 54, 43, 33, 26, 20, 17, 16};
+constexpr uint8_t AV1_SMOOTH_32[32] = {
+    255, 240, 225, 210, 196, 182, 169, 157, 145, 133, 122, 111, 101, 92, 83, 74,
+    66, 59, 52, 45, 39, 34, 29, 25, 21, 17, 14, 12, 10, 9, 8, 8};
+constexpr uint8_t AV1_SMOOTH_64[64] = {
+    255, 248, 240, 233, 225, 218, 210, 203, 196, 189, 182, 176, 169, 163, 156, 150,
+    144, 138, 133, 127, 121, 116, 111, 106, 101, 96, 91, 86, 82, 77, 73, 69,
+    65, 61, 57, 54, 50, 47, 44, 41, 38, 35, 32, 29, 27, 25, 22, 20,
+    18, 16, 15, 13, 12, 10, 9, 8, 7, 6, 6, 5, 5, 4, 4, 4};
+
+const uint8_t* av1_smooth_weights(int size) {
+    switch (size) {
+        case 4: return AV1_SMOOTH_4;
+        case 8: return AV1_SMOOTH_8;
+        case 16: return AV1_SMOOTH_16;
+        case 32: return AV1_SMOOTH_32;
+        default: return AV1_SMOOTH_64;
+    }
+}
+
+inline uint8_t clip_pixel(int v) {
+    return static_cast<uint8_t>(std::clamp(v, 0, 255));
+}
+
+inline int log2_size(int size) {
+    return std::countr_zero(static_cast<unsigned>(size));
+}
+
+void fill_block(uint8_t value, int width, int height, uint8_t* dst, ptrdiff_t stride) {
+    for (int y = 0; y < height; ++y) {
+        std::memset(dst + y * stride, value, width);
+    }
+}
+
+// out[x] = ((32 - fact) * ref[x] + fact * ref[x + 1] + 16) >> 5
+void interpolate_row(const uint8_t* ref, int fact, uint8_t* out, int count) {
+    if (fact == 0) {
+        std::memcpy(out, ref, count);
+        return;
+    }
+    int x = 0;
+#ifdef __AVX2__
+    const __m256i weight_a = _mm256_set1_epi16(static_cast<int16_t>(32 - fact));
+    const __m256i weight_b = _mm256_set1_epi16(static_cast<int16_t>(fact));
+    const __m256i rounding = _mm256_set1_epi16(16);
+    for (; x + 16 <= count; x += 16) {
+        const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ref + x)));
+        const __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ref + x + 1)));
+        __m256i v = _mm256_add_epi16(_mm256_mullo_epi16(a, weight_a), _mm256_mullo_epi16(b, weight_b));
+        v = _mm256_srli_epi16(_mm256_add_epi16(v, rounding), 5);
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0xD8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm256_castsi256_si128(packed));
+    }
+#endif
+    for (; x < count; ++x) {
+        out[x] = static_cast<uint8_t>(((32 - fact) * ref[x] + fact * ref[x + 1] + 16) >> 5);
+    }
+}
+
+void transpose_block(const uint8_t* src, int src_stride, int width, int height, uint8_t* dst, ptrdiff_t stride) {
+    // src is height x width (rows of `width`), dst gets width x height
+    for (int y = 0; y < width; ++y) {
+        for (int x = 0; x < height; ++x) {
+            dst[y * stride + x] = src[x * src_stride + y];
+        }
+    }
+}
+
+// Angular prediction in the vertical frame (HEVC 8.4.4.2.6, VVC 8.4.5.2.12 without the
+// filters): `main` runs along the rows (main[0] = corner), `side` across them. Negative
+// angles project side samples onto the main reference with inv_angle (shift 8 or 9).
+// Writes height rows of width samples.
+void predict_angular(const uint8_t* main, const uint8_t* side, int width, int height, int angle,
+                     int inv_shift, uint8_t* dst, ptrdiff_t stride) {
+    alignas(32) uint8_t buffer[3 * MAX_SIZE + 64];
+    uint8_t* ref = buffer + MAX_SIZE + 16;
+    std::memcpy(ref, main, width + height + 1 + 16);
+
+    if (angle < 0) {
+        const int abs_angle = -angle;
+        const int inv_angle = ((32 << inv_shift) + abs_angle / 2) / abs_angle;
+        const int last = (height * angle) >> 5;
+        for (int k = -1; k >= last; --k) {
+            ref[k] = side[std::min((-k * inv_angle + (1 << (inv_shift - 1))) >> inv_shift, height)];
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        const int position = (y + 1) * angle;
+        interpolate_row(ref + (position >> 5) + 1, position & 31, dst + y * stride, width);
+    }
+}
+
+// Planar for width x height (VVC 8.4.5.2.10; HEVC 8.4.4.2.5 is the square case)
+void predict_planar(const IntraEdges& edges, int width, int height, uint8_t* dst, ptrdiff_t stride) {
+    const uint8_t* above = edges.above.data() + 1;
+    const uint8_t* left = edges.left.data() + 1;
+    const int log2_w = log2_size(width), log2_h = log2_size(height);
+    const int shift = log2_w + log2_h + 1;
+    const int top_right = above[width];
+    const int bottom_left = left[height];
+
+    for (int y = 0; y < height; ++y) {
+        uint8_t* out = dst + y * stride;
+        int x = 0;
+#ifdef __AVX2__
+        const __m256i row_weight = _mm256_set1_epi32(height - 1 - y);
+        const __m256i bottom = _mm256_set1_epi32((y + 1) * bottom_left);
+        const __m256i left_sample = _mm256_set1_epi32(left[y]);
+        const __m256i right = _mm256_set1_epi32(top_right);
+        const __m256i rounding = _mm256_set1_epi32(width * height);
+        const __m256i ones = _mm256_set1_epi32(1);
+        const __m256i last = _mm256_set1_epi32(width - 1);
+        const __m128i sw = _mm_cvtsi32_si128(log2_w), sh = _mm_cvtsi32_si128(log2_h), ss = _mm_cvtsi32_si128(shift);
+        for (; x + 8 <= width; x += 8) {
+            const __m256i column = _mm256_add_epi32(_mm256_set1_epi32(x), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+            const __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(above + x)));
+            const __m256i vertical = _mm256_sll_epi32(
+                _mm256_add_epi32(_mm256_mullo_epi32(row_weight, a), bottom), sw);
+            const __m256i horizontal = _mm256_sll_epi32(
+                _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(last, column), left_sample),
+                                 _mm256_mullo_epi32(_mm256_add_epi32(column, ones), right)), sh);
+            const __m256i v = _mm256_sra_epi32(_mm256_add_epi32(_mm256_add_epi32(vertical, horizontal), rounding), ss);
+            const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(words, words));
+        }
+#endif
+        for (; x < width; ++x) {
+            const int vertical = ((height - 1 - y) * above[x] + (y + 1) * bottom_left) << log2_w;
+            const int horizontal = ((width - 1 - x) * left[y] + (x + 1) * top_right) << log2_h;
+            out[x] = static_cast<uint8_t>((vertical + horizontal + width * height) >> shift);
+        }
+    }
+}
+
+int sum_samples(const uint8_t* samples, int count) {
+    int sum = 0;
+    for (int i = 0; i < count; ++i) {
+        sum += samples[i];
+    }
+    return sum;
+}
+
+// Angular prediction of a HEVC / VVC mode: vertical modes directly, horizontal ones
+// transposed (left becomes the main reference)
+void predict_directional(const IntraEdges& edges, int width, int height, int angle, bool vertical,
+                         int inv_shift, uint8_t* dst, ptrdiff_t stride) {
+    if (vertical) {
+        predict_angular(edges.above.data(), edges.left.data(), width, height, angle, inv_shift, dst, stride);
+        return;
+    }
+    alignas(32) uint8_t transposed[MAX_SIZE * MAX_SIZE];
+    predict_angular(edges.left.data(), edges.above.data(), height, width, angle, inv_shift, transposed, MAX_SIZE);
+    transpose_block(transposed, MAX_SIZE, height, width, dst, stride);
+}
+
+// H.264 neighbours: p[x, -1] for x >= -1 and p[-1, y] for y >= -1
+struct H264Neighbours {
+    const uint8_t* above; // above[x] = p[x, -1], above[-1] = p[-1, -1]
+    const uint8_t* left;  // left[y] = p[-1, y]
+    explicit H264Neighbours(const IntraEdges& edges)
+        : above(edges.above.data() + 1), left(edges.left.data() + 1) {}
+    int p(int x, int y) const { return y < 0 ? above[x] : left[y]; }
+};
+
+#ifdef __AVX2__
+// One Hadamard butterfly stage between lanes `distance` apart: the first lane of each pair
+// gets the sum, the second the difference (signs do not matter for SATD)
+template <int Distance>
+inline __m256i hadamard_stage(__m256i v) {
+    __m256i swapped;
+    __m256i signs;
+    if constexpr (Distance == 4) {
+        swapped = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+        signs = _mm256_setr_epi16(1, 1, 1, 1, -1, -1, -1, -1, 1, 1, 1, 1, -1, -1, -1, -1);
+    } else if constexpr (Distance == 2) {
+        swapped = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+        signs = _mm256_setr_epi16(1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1, 1, 1, -1, -1);
+    } else {
+        swapped = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+        signs = _mm256_setr_epi16(1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1, 1, -1);
+    }
+    return _mm256_add_epi16(swapped, _mm256_sign_epi16(v, signs));
+}
+
+// Two horizontally adjacent 8x8 blocks: |coefficients| summed over both
+uint32_t hadamard_16x8_avx2(const uint8_t* a, ptrdiff_t a_stride, const uint8_t* b, ptrdiff_t b_stride) {
+    __m256i rows[8];
+    for (int i = 0; i < 8; ++i) {
+        const __m256i pa = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i * a_stride)));
+        const __m256i pb = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i * b_stride)));
+        rows[i] = _mm256_sub_epi16(pa, pb);
+    }
+    // Vertical transform across the rows
+    for (int distance = 4; distance >= 1; distance /= 2) {
+        for (int i = 0; i < 8; ++i) {
+            if (i & distance) continue;
+            const __m256i sum = _mm256_add_epi16(rows[i], rows[i + distance]);
+            const __m256i difference = _mm256_sub_epi16(rows[i], rows[i + distance]);
+            rows[i] = sum;
+            rows[i + distance] = difference;
+        }
+    }
+    // Horizontal transform inside each group of 8 lanes, then |x| summed
+    __m256i total = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (int i = 0; i < 8; ++i) {
+        __m256i v = hadamard_stage<4>(rows[i]);
+        v = hadamard_stage<2>(v);
+        v = hadamard_stage<1>(v);
+        total = _mm256_add_epi32(total, _mm256_madd_epi16(_mm256_abs_epi16(v), ones));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+}
+
+// One 8x8 block, rows i and i + 4 in the two halves of a register
+uint32_t hadamard_8x8_avx2(const uint8_t* a, ptrdiff_t a_stride, const uint8_t* b, ptrdiff_t b_stride) {
+    auto load = [](const uint8_t* p, ptrdiff_t stride) {
+        return _mm256_cvtepu8_epi16(_mm_unpacklo_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)),
+                                                       _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p + 4 * stride))));
+    };
+    __m256i rows[4];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = _mm256_sub_epi16(load(a + i * a_stride, a_stride), load(b + i * b_stride, b_stride));
+    }
+    // Vertical transform: rows i / i + 4 across the halves, then i / i + 2 and i / i + 1
+    const __m256i half_signs = _mm256_setr_epi16(1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1, -1);
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = _mm256_add_epi16(_mm256_permute2x128_si256(rows[i], rows[i], 1), _mm256_sign_epi16(rows[i], half_signs));
+    }
+    for (int distance = 2; distance >= 1; distance /= 2) {
+        for (int i = 0; i < 4; ++i) {
+            if (i & distance) continue;
+            const __m256i sum = _mm256_add_epi16(rows[i], rows[i + distance]);
+            const __m256i difference = _mm256_sub_epi16(rows[i], rows[i + distance]);
+            rows[i] = sum;
+            rows[i + distance] = difference;
+        }
+    }
+    __m256i total = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (int i = 0; i < 4; ++i) {
+        __m256i v = hadamard_stage<4>(rows[i]);
+        v = hadamard_stage<2>(v);
+        v = hadamard_stage<1>(v);
+        total = _mm256_add_epi32(total, _mm256_madd_epi16(_mm256_abs_epi16(v), ones));
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return static_cast<uint32_t>(_mm_cvtsi128_si32(sum));
+}
+#endif
+
+uint32_t hadamard_8x8(const uint8_t* a, ptrdiff_t a_stride, const uint8_t* b, ptrdiff_t b_stride) {
+    int32_t d[8][8];
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            d[i][j] = a[i * a_stride + j] - b[i * b_stride + j];
+        }
+    }
+    for (int distance = 4; distance >= 1; distance /= 2) {
+        for (int i = 0; i < 8; ++i) {
+            if (i & distance) continue;
+            for (int j = 0; j < 8; ++j) {
+                const int32_t s = d[i][j] + d[i + distance][j];
+                const int32_t t = d[i][j] - d[i + distance][j];
+                d[i][j] = s;
+                d[i + distance][j] = t;
+            }
+        }
+    }
+    uint32_t sum = 0;
+    for (int i = 0; i < 8; ++i) {
+        int32_t* row = d[i];
+        for (int distance = 4; distance >= 1; distance /= 2) {
+            for (int j = 0; j < 8; ++j) {
+                if (j & distance) continue;
+                const int32_t s = row[j] + row[j + distance];
+                const int32_t t = row[j] - row[j + distance];
+                row[j] = s;
+                row[j + distance] = t;
+            }
+        }
+        for (int j = 0; j < 8; ++j) {
+            sum += static_cast<uint32_t>(std::abs(row[j]));
+        }
+    }
+    return sum;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------------------
+// Reference samples
+// ---------------------------------------------------------------------------------------
+
+void IntraEdges::load(const uint8_t* block, ptrdiff_t stride, int above_length, int left_length,
+                      int above_available, int left_available, bool corner_available) {
+    above_available = std::clamp(above_available, 0, above_length);
+    left_available = std::clamp(left_available, 0, left_length);
+    has_above = above_available > 0;
+    has_left = left_available > 0;
+    has_corner = corner_available;
+
+    if (!has_above && !has_left && !has_corner) {
+        std::memset(above.data(), 128, above.size());
+        std::memset(left.data(), 128, left.size());
+        return;
+    }
+
+    if (has_above) {
+        std::memcpy(above.data() + 1, block - stride, above_available);
+    }
+    for (int j = 0; j < left_available; ++j) {
+        left[1 + j] = block[j * stride - 1];
+    }
+    if (corner_available) {
+        above[0] = left[0] = block[-stride - 1];
+    }
+
+    // The bottom of the chain takes the first available sample going up, then every
+    // missing sample copies its predecessor (below / to the left)
+    const uint8_t first = has_left ? left[left_available] : (corner_available ? above[0] : above[1]);
+    for (int j = left_available + 1; j <= left_length; ++j) {
+        left[j] = first;
+    }
+    if (!corner_available) {
+        above[0] = left[0] = left[1];
+    }
+    for (int i = above_available + 1; i <= above_length; ++i) {
+        above[i] = above[i - 1];
+    }
+    // Padding for the vector loads past the end
+    std::memset(above.data() + above_length + 1, above[above_length], above.size() - above_length - 1);
+    std::memset(left.data() + left_length + 1, left[left_length], left.size() - left_length - 1);
+}
+
+IntraAvailability intra_availability(int x, int y, int width, int height, int above_length, int left_length,
+                                     int ctu_x, int ctu_y, int ctu_size, int tile_x0, int tile_y0,
+                                     int tile_x1, int tile_y1) {
+    // z-order of 4x4 units inside the CTU: a unit is coded before the block when its
+    // Morton index is lower
+    auto z_index = [&](int px, int py) {
+        const uint32_t ux = static_cast<uint32_t>(px - ctu_x) >> 2, uy = static_cast<uint32_t>(py - ctu_y) >> 2;
+        uint32_t z = 0;
+        for (int bit = 0; bit < 6; ++bit) {
+            z |= ((ux >> bit) & 1u) << (2 * bit);
+            z |= ((uy >> bit) & 1u) << (2 * bit + 1);
+        }
+        return z;
+    };
+    const uint32_t current = z_index(x, y);
+    (void)width;
+    (void)height;
+
+    IntraAvailability available;
+    if (y > tile_y0) {
+        for (int i = 0; i < above_length; i += 4) {
+            const int px = x + i;
+            if (px >= tile_x1) break;
+            if (y - 1 >= ctu_y && (px >= ctu_x + ctu_size || z_index(px, y - 1) > current)) break;
+            available.above = std::min(i + 4, above_length);
+        }
+    }
+    if (x > tile_x0) {
+        for (int j = 0; j < left_length; j += 4) {
+            const int py = y + j;
+            if (py >= tile_y1 || py >= ctu_y + ctu_size) break;
+            if (x - 1 >= ctu_x && z_index(x - 1, py) > current) break;
+            available.left = std::min(j + 4, left_length);
+        }
+    }
+    available.corner = x > tile_x0 && y > tile_y0;
+    return available;
+}
+
+// ---------------------------------------------------------------------------------------
+// HEVC / VVC
+// ---------------------------------------------------------------------------------------
+
+bool hevc_filters_edges(int size, int mode) {
+    // 8.4.4.2.3: DC and 4x4 blocks are never filtered, the rest by distance from the
+    // pure horizontal / vertical directions
+    if (mode == 1 || size == 4) return false;
+    const int distance = std::min(std::abs(mode - 26), std::abs(mode - 10));
+    const int threshold = size == 8 ? 7 : (size == 16 ? 1 : 0);
+    return distance > threshold;
+}
+
+void hevc_filter_edges(IntraEdges& edges, int size, int mode) {
+    if (!hevc_filters_edges(size, mode)) return;
+
+    const int length = 2 * size;
+    uint8_t* above = edges.above.data();
+    uint8_t* left = edges.left.data();
+    uint8_t above_in[2 * MAX_SIZE + 1], left_in[2 * MAX_SIZE + 1];
+    std::memcpy(above_in, above, length + 1);
+    std::memcpy(left_in, left, length + 1);
+
+    above[0] = left[0] = static_cast<uint8_t>((left_in[1] + 2 * above_in[0] + above_in[1] + 2) >> 2);
+    for (int i = 1; i < length; ++i) {
+        above[i] = static_cast<uint8_t>((above_in[i - 1] + 2 * above_in[i] + above_in[i + 1] + 2) >> 2);
+        left[i] = static_cast<uint8_t>((left_in[i - 1] + 2 * left_in[i] + left_in[i + 1] + 2) >> 2);
+    }
+}
+
+void predict_hevc(const IntraEdges& edges, int size, int mode, uint8_t* dst, ptrdiff_t stride) {
+    const uint8_t* above = edges.above.data();
+    const uint8_t* left = edges.left.data();
+
+    if (mode == 0) {
+        predict_planar(edges, size, size, dst, stride);
+        return;
+    }
+
+    if (mode == 1) {
+        const int dc = (sum_samples(above + 1, size) + sum_samples(left + 1, size) + size) >> (log2_size(size) + 1);
+        fill_block(static_cast<uint8_t>(dc), size, size, dst, stride);
+        if (size < 32) { // DC edge filter (8.4.4.2.5)
+            dst[0] = static_cast<uint8_t>((left[1] + 2 * dc + above[1] + 2) >> 2);
+            for (int i = 1; i < size; ++i) {
+                dst[i] = static_cast<uint8_t>((above[1 + i] + 3 * dc + 2) >> 2);
+                dst[i * stride] = static_cast<uint8_t>((left[1 + i] + 3 * dc + 2) >> 2);
+            }
+        }
+        return;
+    }
+
+    const bool vertical = mode >= 18;
+    int angle;
+    if (mode <= 10) angle = HEVC_ANGLES[mode - 2];
+    else if (mode < 18) angle = -HEVC_ANGLES[18 - mode];
+    else if (mode <= 26) angle = -HEVC_ANGLES[mode - 18];
+    else angle = HEVC_ANGLES[34 - mode];
+    predict_directional(edges, size, size, angle, vertical, 8, dst, stride);
+
+    // Boundary smoothing of the pure directions
+    if (size < 32 && mode == 26) {
+        for (int y = 0; y < size; ++y) {
+            dst[y * stride] = clip_pixel(above[1] + ((left[1 + y] - left[0]) >> 1));
+        }
+    } else if (size < 32 && mode == 10) {
+        for (int x = 0; x < size; ++x) {
+            dst[x] = clip_pixel(left[1] + ((above[1 + x] - above[0]) >> 1));
+        }
+    }
+}
+
+void predict_vvc(const IntraEdges& edges, int width, int height, int mode, uint8_t* dst, ptrdiff_t stride) {
+    if (mode == 0) {
+        predict_planar(edges, width, height, dst, stride);
+        return;
+    }
+
+    if (mode == 1) {
+        // Rectangular blocks average the longer side only, so the divisor stays a power of two
+        int dc;
+        if (width == height) {
+            dc = (sum_samples(edges.above.data() + 1, width) + sum_samples(edges.left.data() + 1, height) + width) >>
+                 (log2_size(width) + 1);
+        } else if (width > height) {
+            dc = (sum_samples(edges.above.data() + 1, width) + (width >> 1)) >> log2_size(width);
+        } else {
+            dc = (sum_samples(edges.left.data() + 1, height) + (height >> 1)) >> log2_size(height);
+        }
+        fill_block(static_cast<uint8_t>(dc), width, height, dst, stride);
+        return;
+    }
+
+    const bool vertical = mode >= 34;
+    int angle;
+    if (mode <= 18) angle = VVC_ANGLES[mode - 2];
+    else if (mode < 34) angle = -VVC_ANGLES[34 - mode];
+    else if (mode <= 50) angle = -VVC_ANGLES[mode - 34];
+    else angle = VVC_ANGLES[66 - mode];
+    predict_directional(edges, width, height, angle, vertical, 9, dst, stride);
+}
+
+// ---------------------------------------------------------------------------------------
+// H.264
+// ---------------------------------------------------------------------------------------
+
+bool h264_16x16_mode_available(const IntraEdges& edges, int mode) {
+    switch (mode) {
+        case 0: return edges.has_above;
+        case 1: return edges.has_left;
+        case 2: return true;
+        default: return edges.has_above && edges.has_left && edges.has_corner;
+    }
+}
+
+void predict_h264_16x16(const IntraEdges& edges, int mode, uint8_t* dst, ptrdiff_t stride) {
+    const H264Neighbours p(edges);
+    switch (mode) {
+        case 0: // Vertical
+            for (int y = 0; y < 16; ++y) {
+                std::memcpy(dst + y * stride, p.above, 16);
+            }
+            break;
+        case 1: // Horizontal
+            for (int y = 0; y < 16; ++y) {
+                std::memset(dst + y * stride, p.left[y], 16);
+            }
+            break;
+        case 2: { // DC
+            int dc = 128;
+            if (edges.has_above && edges.has_left) {
+                dc = (sum_samples(p.above, 16) + sum_samples(p.left, 16) + 16) >> 5;
+            } else if (edges.has_above) {
+                dc = (sum_samples(p.above, 16) + 8) >> 4;
+            } else if (edges.has_left) {
+                dc = (sum_samples(p.left, 16) + 8) >> 4;
+            }
+            fill_block(static_cast<uint8_t>(dc), 16, 16, dst, stride);
+            break;
+        }
+        default: { // Plane
+            int h = 0, v = 0;
+            for (int i = 0; i < 8; ++i) {
+                h += (i + 1) * (p.above[8 + i] - p.above[6 - i]);
+                v += (i + 1) * (p.left[8 + i] - p.p(-1, 6 - i));
+            }
+            const int a = 16 * (p.left[15] + p.above[15]);
+            const int b = (5 * h + 32) >> 6;
+            const int c = (5 * v + 32) >> 6;
+            for (int y = 0; y < 16; ++y) {
+                for (int x = 0; x < 16; ++x) {
+                    dst[y * stride + x] = clip_pixel((a + b * (x - 7) + c * (y - 7) + 16) >> 5);
+                }
+            }
+            break;
+        }
+    }
+}
+
+bool h264_8x8_mode_available(const IntraEdges& edges, int mode) {
+    switch (mode) {
+        case 0: case 3: case 7: return edges.has_above; // Vertical, diagonal down left, vertical left
+        case 1: case 8: return edges.has_left;          // Horizontal, horizontal up
+        case 2: return true;                            // DC
+        default: return edges.has_above && edges.has_left && edges.has_corner;
+    }
+}
+
+void h264_filter_edges_8x8(IntraEdges& edges) {
+    // 8.3.2.2.1 on p[-1, -1], p[0..15, -1] and p[-1, 0..7] (above-right already substituted)
+    uint8_t* above = edges.above.data(); // above[1 + x] = p[x, -1], above[0] = p[-1, -1]
+    uint8_t* left = edges.left.data();
+    uint8_t a[17], l[9];
+    std::memcpy(a, above, 17);
+    std::memcpy(l, left, 9);
+
+    if (edges.has_above) {
+        above[1] = static_cast<uint8_t>(edges.has_corner ? (a[0] + 2 * a[1] + a[2] + 2) >> 2 : (3 * a[1] + a[2] + 2) >> 2);
+        for (int x = 1; x < 15; ++x) {
+            above[1 + x] = static_cast<uint8_t>((a[x] + 2 * a[1 + x] + a[2 + x] + 2) >> 2);
+        }
+        above[16] = static_cast<uint8_t>((a[15] + 3 * a[16] + 2) >> 2);
+    }
+    if (edges.has_corner) {
+        int corner = a[0];
+        if (edges.has_above && edges.has_left) {
+            corner = (a[1] + 2 * a[0] + l[1] + 2) >> 2;
+        } else if (edges.has_above) {
+            corner = (3 * a[0] + a[1] + 2) >> 2;
+        } else if (edges.has_left) {
+            corner = (3 * a[0] + l[1] + 2) >> 2;
+        }
+        above[0] = left[0] = static_cast<uint8_t>(corner);
+    }
+    if (edges.has_left) {
+        left[1] = static_cast<uint8_t>(edges.has_corner ? (l[0] + 2 * l[1] + l[2] + 2) >> 2 : (3 * l[1] + l[2] + 2) >> 2);
+        for (int y = 1; y < 7; ++y) {
+            left[1 + y] = static_cast<uint8_t>((l[y] + 2 * l[1 + y] + l[2 + y] + 2) >> 2);
+        }
+        left[8] = static_cast<uint8_t>((l[7] + 3 * l[8] + 2) >> 2);
+    }
+}
+
+void predict_h264_8x8(const IntraEdges& edges, int mode, uint8_t* dst, ptrdiff_t stride) {
+    const H264Neighbours n(edges);
+    auto top = [&](int x) { return static_cast<int>(n.above[x]); };  // p[x, -1], x >= -1
+    auto side = [&](int y) { return n.p(-1, y); };                   // p[-1, y], y >= -1
+
+    for (int y = 0; y < 8; ++y) {
+        uint8_t* out = dst + y * stride;
+        for (int x = 0; x < 8; ++x) {
+            int v;
+            switch (mode) {
+                case 0: v = top(x); break;
+                case 1: v = side(y); break;
+                case 2: {
+                    if (edges.has_above && edges.has_left) {
+                        v = (sum_samples(n.above, 8) + sum_samples(n.left, 8) + 8) >> 4;
+                    } else if (edges.has_above) {
+                        v = (sum_samples(n.above, 8) + 4) >> 3;
+                    } else if (edges.has_left) {
+                        v = (sum_samples(n.left, 8) + 4) >> 3;
+                    } else {
+                        v = 128;
+                    }
+                    fill_block(static_cast<uint8_t>(v), 8, 8, dst, stride);
+                    return;
+                }
+                case 3: // Diagonal down left
+                    v = (x == 7 && y == 7) ? (top(14) + 3 * top(15) + 2) >> 2
+                                           : (top(x + y) + 2 * top(x + y + 1) + top(x + y + 2) + 2) >> 2;
+                    break;
+                case 4: // Diagonal down right
+                    if (x > y) v = (top(x - y - 2) + 2 * top(x - y - 1) + top(x - y) + 2) >> 2;
+                    else if (x < y) v = (side(y - x - 2) + 2 * side(y - x - 1) + side(y - x) + 2) >> 2;
+                    else v = (top(0) + 2 * top(-1) + side(0) + 2) >> 2;
+                    break;
+                case 5: { // Vertical right
+                    const int z = 2 * x - y;
+                    if (z >= 0 && !(z & 1)) v = (top(x - (y >> 1) - 1) + top(x - (y >> 1)) + 1) >> 1;
+                    else if (z >= 0) v = (top(x - (y >> 1) - 2) + 2 * top(x - (y >> 1) - 1) + top(x - (y >> 1)) + 2) >> 2;
+                    else if (z == -1) v = (side(0) + 2 * side(-1) + top(0) + 2) >> 2;
+                    else v = (side(y - 2 * x - 1) + 2 * side(y - 2 * x - 2) + side(y - 2 * x - 3) + 2) >> 2;
+                    break;
+                }
+                case 6: { // Horizontal down
+                    const int z = 2 * y - x;
+                    if (z >= 0 && !(z & 1)) v = (side(y - (x >> 1) - 1) + side(y - (x >> 1)) + 1) >> 1;
+                    else if (z >= 0) v = (side(y - (x >> 1) - 2) + 2 * side(y - (x >> 1) - 1) + side(y - (x >> 1)) + 2) >> 2;
+                    else if (z == -1) v = (side(0) + 2 * side(-1) + top(0) + 2) >> 2;
+                    else v = (top(x - 2 * y - 1) + 2 * top(x - 2 * y - 2) + top(x - 2 * y - 3) + 2) >> 2;
+                    break;
+                }
+                case 7: // Vertical left
+                    if (!(y & 1)) v = (top(x + (y >> 1)) + top(x + (y >> 1) + 1) + 1) >> 1;
+                    else v = (top(x + (y >> 1)) + 2 * top(x + (y >> 1) + 1) + top(x + (y >> 1) + 2) + 2) >> 2;
+                    break;
+                default: { // Horizontal up
+                    const int z = x + 2 * y;
+                    if (z < 13 && !(z & 1)) v = (side(y + (x >> 1)) + side(y + (x >> 1) + 1) + 1) >> 1;
+                    else if (z < 13) v = (side(y + (x >> 1)) + 2 * side(y + (x >> 1) + 1) + side(y + (x >> 1) + 2) + 2) >> 2;
+                    else if (z == 13) v = (side(6) + 3 * side(7) + 2) >> 2;
+                    else v = side(7);
+                    break;
+                }
+            }
+            out[x] = static_cast<uint8_t>(v);
+        }
+    }
+}
+
+void load_h264_edges(IntraEdges& edges, const uint8_t* origin, ptrdiff_t stride, const H264IntraNeighbours& neighbours,
+                     int block, int visible_w, int visible_h) {
+    if (block < 0) {
+        edges.load(origin, stride, 16, 16, neighbours.above ? std::min(16, visible_w) : 0,
+                   neighbours.left ? std::min(16, visible_h) : 0, neighbours.above_left);
+        return;
+    }
+
+    const int bx = (block & 1) * 8, by = (block >> 1) * 8;
+    if (bx >= visible_w || by >= visible_h) { // Outside the picture: nothing to predict from
+        edges.load(origin, stride, 16, 8, 0, 0, false);
+        return;
+    }
+
+    // Inside the macroblock the blocks before this one are done; the above-right of block 1
+    // is the next macroblock's, block 3 has none
+    static constexpr bool ABOVE_RIGHT_INSIDE[4] = {false, false, true, false};
+    const bool above = by > 0 || neighbours.above;
+    const bool left = bx > 0 || neighbours.left;
+    bool above_right = ABOVE_RIGHT_INSIDE[block];
+    if (block == 0) above_right = neighbours.above;
+    if (block == 1) above_right = neighbours.above_right;
+    bool corner = block == 3;
+    if (block == 0) corner = neighbours.above_left;
+    if (block == 1) corner = neighbours.above;
+    if (block == 2) corner = neighbours.left;
+
+    const int above_count = above ? std::min(above_right ? 16 : 8, visible_w - bx) : 0;
+    const int left_count = left ? std::min(8, visible_h - by) : 0;
+    edges.load(origin + by * stride + bx, stride, 16, 8, above_count, left_count, corner);
+}
+
+// ---------------------------------------------------------------------------------------
+// AV1
+// ---------------------------------------------------------------------------------------
+
+void load_av1_edges(IntraEdges& edges, const uint8_t* block, ptrdiff_t stride, int width, int height,
+                    int above_available, int left_available) {
+    // 7.11.2: rows past the available samples repeat the last one; a missing edge takes the
+    // first sample of the other one, or 127 / 129 when there is neither
+    const int length = width + height;
+    above_available = std::clamp(above_available, 0, length);
+    left_available = std::clamp(left_available, 0, length);
+    edges.has_above = above_available > 0;
+    edges.has_left = left_available > 0;
+    edges.has_corner = edges.has_above && edges.has_left;
+    uint8_t* above = edges.above.data();
+    uint8_t* left = edges.left.data();
+
+    if (edges.has_above) {
+        std::memcpy(above + 1, block - stride, above_available);
+        std::memset(above + 1 + above_available, above[above_available], edges.above.size() - 1 - above_available);
+    } else {
+        std::memset(above + 1, edges.has_left ? block[-1] : 127, edges.above.size() - 1);
+    }
+    if (edges.has_left) {
+        for (int j = 0; j < left_available; ++j) {
+            left[1 + j] = block[j * stride - 1];
+        }
+        std::memset(left + 1 + left_available, left[left_available], edges.left.size() - 1 - left_available);
+    } else {
+        std::memset(left + 1, edges.has_above ? block[-stride] : 129, edges.left.size() - 1);
+    }
+
+    if (edges.has_corner) above[0] = block[-stride - 1];
+    else if (edges.has_above) above[0] = block[-stride];
+    else if (edges.has_left) above[0] = block[-1];
+    else above[0] = 128;
+    left[0] = above[0];
+}
+
+bool av1_is_directional(codec::PredictionMode mode) {
+    return mode >= codec::PredictionMode::V_PRED && mode <= codec::PredictionMode::D67_PRED;
+}
+
+void predict_av1(const IntraEdges& edges, int width, int height, codec::PredictionMode mode, int angle_delta,
+                 uint8_t* dst, ptrdiff_t stride) {
+    using codec::PredictionMode;
+    const uint8_t* above = edges.above.data() + 1; // AboveRow[i], AboveRow[-1] = corner
+    const uint8_t* left = edges.left.data() + 1;   // LeftCol[i]
+
+    switch (mode) {
+        case PredictionMode::DC_PRED: {
+            int dc = 128;
+            if (edges.has_above && edges.has_left) {
+                const int count = width + height;
+                dc = (sum_samples(above, width) + sum_samples(left, height) + (count >> 1)) / count;
+            } else if (edges.has_above) {
+                dc = (sum_samples(above, width) + (width >> 1)) >> log2_size(width);
+            } else if (edges.has_left) {
+                dc = (sum_samples(left, height) + (height >> 1)) >> log2_size(height);
+            }
+            fill_block(static_cast<uint8_t>(dc), width, height, dst, stride);
+            return;
+        }
+        case PredictionMode::SMOOTH_PRED:
+        case PredictionMode::SMOOTH_V_PRED:
+        case PredictionMode::SMOOTH_H_PRED: {
+            const uint8_t* weights_x = av1_smooth_weights(width);
+            const uint8_t* weights_y = av1_smooth_weights(height);
+            const int bottom_left = left[height - 1];
+            const int top_right = above[width - 1];
+            for (int i = 0; i < height; ++i) {
+                uint8_t* out = dst + i * stride;
+                int j = 0;
+#ifdef __AVX2__
+                const __m256i wy = _mm256_set1_epi32(weights_y[i]);
+                const __m256i wy_inverse = _mm256_set1_epi32(256 - weights_y[i]);
+                const __m256i bl = _mm256_set1_epi32(bottom_left);
+                const __m256i tr = _mm256_set1_epi32(top_right);
+                const __m256i l = _mm256_set1_epi32(left[i]);
+                const __m256i full = _mm256_set1_epi32(256);
+                for (; j + 8 <= width; j += 8) {
+                    const __m256i a = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(above + j)));
+                    const __m256i wx = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights_x + j)));
+                    const __m256i vertical = _mm256_add_epi32(_mm256_mullo_epi32(wy, a), _mm256_mullo_epi32(wy_inverse, bl));
+                    const __m256i horizontal = _mm256_add_epi32(_mm256_mullo_epi32(wx, l),
+                                                                _mm256_mullo_epi32(_mm256_sub_epi32(full, wx), tr));
+                    __m256i v;
+                    if (mode == PredictionMode::SMOOTH_PRED) {
+                        v = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(vertical, horizontal), full), 9);
+                    } else if (mode == PredictionMode::SMOOTH_V_PRED) {
+                        v = _mm256_srli_epi32(_mm256_add_epi32(vertical, _mm256_set1_epi32(128)), 8);
+                    } else {
+                        v = _mm256_srli_epi32(_mm256_add_epi32(horizontal, _mm256_set1_epi32(128)), 8);
+                    }
+                    const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(out + j), _mm_packus_epi16(words, words));
+                }
+#endif
+                for (; j < width; ++j) {
+                    const int vertical = weights_y[i] * above[j] + (256 - weights_y[i]) * bottom_left;
+                    const int horizontal = weights_x[j] * left[i] + (256 - weights_x[j]) * top_right;
+                    if (mode == PredictionMode::SMOOTH_PRED) out[j] = static_cast<uint8_t>((vertical + horizontal + 256) >> 9);
+                    else if (mode == PredictionMode::SMOOTH_V_PRED) out[j] = static_cast<uint8_t>((vertical + 128) >> 8);
+                    else out[j] = static_cast<uint8_t>((horizontal + 128) >> 8);
+                }
+            }
+            return;
+        }
+        case PredictionMode::PAETH_PRED: {
+            const int corner = above[-1];
+            for (int i = 0; i < height; ++i) {
+                for (int j = 0; j < width; ++j) {
+                    const int base = above[j] + left[i] - corner;
+                    const int p_left = std::abs(base - left[i]);
+                    const int p_top = std::abs(base - above[j]);
+                    const int p_corner = std::abs(base - corner);
+                    uint8_t v;
+                    if (p_left <= p_top && p_left <= p_corner) v = left[i];
+                    else if (p_top <= p_corner) v = above[j];
+                    else v = static_cast<uint8_t>(corner);
+                    dst[i * stride + j] = v;
+                }
+            }
+            return;
+        }
+        default:
+            break;
+    }
+
+    // Directional: nominal angle + 3 * delta
+    static constexpr int16_t NOMINAL[] = {0, 90, 180, 45, 135, 113, 157, 203, 67};
+    const int angle = NOMINAL[static_cast<int>(mode)] + 3 * angle_delta;
+
+    if (angle == 90 || angle == 180) {
+        for (int i = 0; i < height; ++i) {
+            if (angle == 90) std::memcpy(dst + i * stride, above, width);
+            else std::memset(dst + i * stride, left[i], width);
+        }
+        return;
+    }
+
+    if (angle < 90) {
+        // Zone 1: above only. Samples past AboveRow[w + h - 1] repeat it (the buffer is
+        // padded with it), which is the spec's clamp to maxBaseX.
+        const int dx = AV1_DR_DERIVATIVE[angle];
+        for (int i = 0; i < height; ++i) {
+            const int idx = (i + 1) * dx;
+            interpolate_row(above + (idx >> 6), (idx >> 1) & 0x1F, dst + i * stride, width);
+        }
+        return;
+    }
+
+    if (angle > 180) {
+        // Zone 3: left only, predicted transposed
+        const int dy = AV1_DR_DERIVATIVE[270 - angle];
+        alignas(32) uint8_t transposed[MAX_SIZE * MAX_SIZE];
+        for (int j = 0; j < width; ++j) {
+            const int idx = (j + 1) * dy;
+            interpolate_row(left + (idx >> 6), (idx >> 1) & 0x1F, transposed + j * MAX_SIZE, height);
+        }
+        transpose_block(transposed, MAX_SIZE, width, height, dst, stride);
+        return;
+    }
+
+    // Zone 2: each sample projects onto the above row, or the left column past its start
+    const int dx = AV1_DR_DERIVATIVE[180 - angle];
+    const int dy = AV1_DR_DERIVATIVE[angle - 90];
+    for (int i = 0; i < height; ++i) {
+        for (int j = 0; j < width; ++j) {
+            int idx = (j << 6) - (i + 1) * dx;
+            int base = idx >> 6;
+            int v;
+            if (base >= -1) {
+                const int shift = (idx >> 1) & 0x1F;
+                v = (above[base] * (32 - shift) + above[base + 1] * shift + 16) >> 5;
+            } else {
+                idx = (i << 6) - (j + 1) * dy;
+                base = idx >> 6;
+                const int shift = (idx >> 1) & 0x1F;
+                const int l0 = base < 0 ? above[-1] : left[base];
+                v = (l0 * (32 - shift) + left[base + 1] * shift + 16) >> 5;
+            }
+            dst[i * stride + j] = static_cast<uint8_t>(v);
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------
+// Mode decision
+// ---------------------------------------------------------------------------------------
+
+uint32_t intra_satd(const uint8_t* source, ptrdiff_t source_stride, const uint8_t* prediction,
+                    ptrdiff_t prediction_stride, int width, int height) {
+    if ((width & 7) || (height & 7)) {
+        return satd_block(source, static_cast<int>(source_stride), prediction, static_cast<int>(prediction_stride),
+                          width, height);
+    }
+
+    // 8x8 Hadamard, normalised like the 4x4 one (coefficient gain 2)
+    uint32_t sum = 0;
+    for (int y = 0; y < height; y += 8) {
+        const uint8_t* a = source + y * source_stride;
+        const uint8_t* b = prediction + y * prediction_stride;
+        int x = 0;
+#ifdef __AVX2__
+        for (; x + 16 <= width; x += 16) {
+            sum += hadamard_16x8_avx2(a + x, source_stride, b + x, prediction_stride);
+        }
+        for (; x < width; x += 8) {
+            sum += hadamard_8x8_avx2(a + x, source_stride, b + x, prediction_stride);
+        }
+#endif
+        for (; x < width; x += 8) {
+            sum += hadamard_8x8(a + x, source_stride, b + x, prediction_stride);
+        }
+    }
+    return (sum + 2) >> 2;
+}
+
+uint32_t intra_lambda_sad(int qp) {
+    // sqrt(0.85 * 2^((qp - 12) / 3)), the usual SAD-domain lambda, in 1/16 units
+    static const std::array<uint32_t, 52> table = [] {
+        std::array<uint32_t, 52> values{};
+        for (int q = 0; q < 52; ++q) {
+            values[q] = static_cast<uint32_t>(std::lround(16.0 * std::sqrt(0.85 * std::pow(2.0, (q - 12) / 3.0))));
+        }
+        return values;
+    }();
+    return table[std::clamp(qp, 0, 51)];
+}
+
+} // namespace processing
+} // namespace streaming
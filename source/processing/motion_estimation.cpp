@@ -1,42 +1,28 @@
 // src/processing/motion_estimation.cpp
 #include "streaming/processing/motion_estimation.hpp"
+#include <algorithm>
 #include <immintrin.h> // SIMD instructions
 
 namespace streaming {
 namespace processing {
 
-uint16_t MotionEstimator::calculate_sad(const uint8_t* block1, const uint8_t* block2, int stride) const {
-    uint16_t sad = 0;
+MotionEstimator::SearchWindow MotionEstimator::search_window(const ReferencePlane& reference, int x, int y) const {
+    // Every vector inside the window keeps the whole block within the readable area,
+    // so the search loops clamp once per block instead of testing each candidate
+    SearchWindow window;
+    window.min_x = std::max(-SEARCH_RANGE, -reference.padding - x);
+    window.max_x = std::min(SEARCH_RANGE, reference.width + reference.padding - BLOCK_SIZE - x);
+    window.min_y = std::max(-SEARCH_RANGE, -reference.padding - y);
+    window.max_y = std::min(SEARCH_RANGE, reference.height + reference.padding - BLOCK_SIZE - y);
     
-    // Basic SAD calculation
-    for (int y = 0; y < BLOCK_SIZE; ++y) {
-        for (int x = 0; x < BLOCK_SIZE; ++x) {
-            sad += std::abs(static_cast<int16_t>(block1[y * stride + x]) - 
-                           static_cast<int16_t>(block2[y * stride + x]));
-        }
-    }
-    
-    return sad;
-}
-
-#ifdef __SSE2__
-// SIMD-accelerated SAD calculation
-uint16_t MotionEstimator::calculate_sad_simd(const uint8_t* block1, const uint8_t* block2, int stride) const {
-    __m128i sad = _mm_setzero_si128();
+    // Degenerate (frame smaller than a block): only the zero vector
+    if (window.max_x < window.min_x) window.min_x = window.max_x = 0;
+    if (window.max_y < window.min_y) window.min_y = window.max_y = 0;
     
-    for (int y = 0; y < BLOCK_SIZE; ++y) {
-        for (int x = 0; x < BLOCK_SIZE; x += 16) {
-            __m128i src = _mm_load_si128(reinterpret_cast<const __m128i*>(block1 + y * stride + x));
-            __m128i ref = _mm_load_si128(reinterpret_cast<const __m128i*>(block2 + y * stride + x));
-            
-            __m128i diff = _mm_sad_epu8(src, ref);
-            sad = _mm_add_epi16(sad, diff);
-        }
-    }
-    
-    return _mm_extract_epi16(sad, 0) + _mm_extract_epi16(sad, 4);
+    // Integer vectors read no samples beyond the block; may leave the window empty
+    window.max_x = std::min(window.max_x, reference_limit_ - BLOCK_SIZE - x);
+    return window;
 }
-#endif
 
 uint16_t MotionEstimator::calculate_satd(const uint8_t* block1, const uint8_t* block2, int stride) const {
     // Sum of Absolute Transformed Differences - better for compression
@@ -84,35 +70,30 @@ uint16_t MotionEstimator::calculate_satd(const uint8_t* block1, const uint8_t* b
     return static_cast<uint16_t>(satd / 2); // Normalization
 }
 
-uint16_t MotionEstimator::hybrid_cost(const uint8_t* block1, const uint8_t* block2, int stride, int mv_x, int mv_y) const {
+uint16_t MotionEstimator::hybrid_cost(const uint8_t* current_block, int current_stride,
+                                      const ReferencePlane& reference, int ref_x, int ref_y,
+                                      int mv_x, int mv_y) const {
     // Combine SAD with motion vector cost (rate-distortion optimization)
-    uint16_t sad = calculate_sad(block1, block2, stride);
+    const uint8_t* ref_block = reference.origin + ref_y * reference.stride + ref_x;
+    uint32_t sad = processing::sad<BLOCK_SIZE, BLOCK_SIZE>(current_block, current_stride, ref_block, reference.stride);
     
     // Motion vector cost (lambda * |MV|)
-    int mv_cost = (std::abs(mv_x) + std::abs(mv_y)) * 2;
+    uint32_t mv_cost = (std::abs(mv_x) + std::abs(mv_y)) * 2;
     
-    return sad + mv_cost;
+    return static_cast<uint16_t>(std::min<uint32_t>(sad + mv_cost, UINT16_MAX - 1));
 }
 
-bool MotionEstimator::is_within_frame(int x, int y, int width, int height) const {
-    return x >= 0 && y >= 0 && (x + BLOCK_SIZE) <= width && (y + BLOCK_SIZE) <= height;
-}
-
-MotionVector MotionEstimator::estimate_full_search(const uint8_t* current_frame, const uint8_t* reference_frame,
-                                                  int width, int height, int x, int y) {
+MotionVector MotionEstimator::estimate_full_search(const uint8_t* current_frame, int current_stride,
+                                                  const ReferencePlane& reference, int x, int y) {
     MotionVector best_mv;
-    const uint8_t* current_block = current_frame + y * width + x;
+    const uint8_t* current_block = current_frame + y * current_stride + x;
+    const SearchWindow window = search_window(reference, x, y);
+    if (window.empty()) return best_mv;
     
-    // Search in [-SEARCH_RANGE, SEARCH_RANGE] range
-    for (int dy = -SEARCH_RANGE; dy <= SEARCH_RANGE; ++dy) {
-        for (int dx = -SEARCH_RANGE; dx <= SEARCH_RANGE; ++dx) {
-            int ref_x = x + dx;
-            int ref_y = y + dy;
-            
-            if (!is_within_frame(ref_x, ref_y, width, height)) continue;
-            
-            const uint8_t* ref_block = reference_frame + ref_y * width + ref_x;
-            uint16_t cost = hybrid_cost(current_block, ref_block, width, dx, dy);
+    // Search the clamped [-SEARCH_RANGE, SEARCH_RANGE] window
+    for (int dy = window.min_y; dy <= window.max_y; ++dy) {
+        for (int dx = window.min_x; dx <= window.max_x; ++dx) {
+            uint16_t cost = hybrid_cost(current_block, current_stride, reference, x + dx, y + dy, dx, dy);
             
             if (cost < best_mv.cost) {
                 best_mv = MotionVector(dx, dy, cost);
@@ -128,8 +109,9 @@ MotionVector MotionEstimator::estimate_full_search(const uint8_t* current_frame,
     return best_mv;
 }
 
-MotionVector MotionEstimator::estimate_diamond_search(const uint8_t* current_frame, const uint8_t* reference_frame,
-                                                     int width, int height, int x, int y) {
+MotionVector MotionEstimator::estimate_diamond_search(const uint8_t* current_frame, int current_stride,
+                                                     const ReferencePlane& reference, int x, int y,
+                                                     int predictor_x, int predictor_y) {
     // Large Diamond Search Pattern (LDSP) points
     constexpr std::array<std::pair<int, int>, 9> ldsp = {{
         {0, 0}, {0, -4}, {0, 4}, {-4, 0}, {4, 0},
@@ -142,29 +124,42 @@ MotionVector MotionEstimator::estimate_diamond_search(const uint8_t* current_fra
     }};
     
     MotionVector best_mv;
-    const uint8_t* current_block = current_frame + y * width + x;
+    const uint8_t* current_block = current_frame + y * current_stride + x;
+    const SearchWindow window = search_window(reference, x, y);
+    if (window.empty()) return best_mv;
     
-    // Step 1: LDSP until minimum is at center
+    // Step 1: LDSP until minimum is at center, from the predictor if it beats zero motion
     bool minimum_at_center = false;
-    int center_x = 0, center_y = 0;
+    int center_x = std::clamp(0, window.min_x, window.max_x);
+    int center_y = std::clamp(0, window.min_y, window.max_y);
+    
+    predictor_x = std::clamp(predictor_x, window.min_x, window.max_x);
+    predictor_y = std::clamp(predictor_y, window.min_y, window.max_y);
+    if (predictor_x != center_x || predictor_y != center_y) {
+        const uint16_t zero_cost = hybrid_cost(current_block, current_stride, reference,
+                                               x + center_x, y + center_y, center_x, center_y);
+        const uint16_t predictor_cost = hybrid_cost(current_block, current_stride, reference,
+                                                    x + predictor_x, y + predictor_y, predictor_x, predictor_y);
+        if (predictor_cost < zero_cost) {
+            center_x = predictor_x;
+            center_y = predictor_y;
+        }
+    }
     
     while (!minimum_at_center) {
         minimum_at_center = true;
         
         for (const auto& [dx, dy] : ldsp) {
-            int search_x = center_x + dx;
-            int search_y = center_y + dy;
-            int ref_x = x + search_x;
-            int ref_y = y + search_y;
-            
-            if (!is_within_frame(ref_x, ref_y, width, height)) continue;
+            // Points outside the window collapse onto its edge
+            int search_x = std::clamp(center_x + dx, window.min_x, window.max_x);
+            int search_y = std::clamp(center_y + dy, window.min_y, window.max_y);
             
-            const uint8_t* ref_block = reference_frame + ref_y * width + ref_x;
-            uint16_t cost = hybrid_cost(current_block, ref_block, width, search_x, search_y);
+            uint16_t cost = hybrid_cost(current_block, current_stride, reference,
+                                        x + search_x, y + search_y, search_x, search_y);
             
             if (cost < best_mv.cost) {
                 best_mv = MotionVector(search_x, search_y, cost);
-                if (dx != 0 || dy != 0) { // Not center point
+                if (search_x != center_x || search_y != center_y) { // Not center point
                     center_x = search_x;
                     center_y = search_y;
                     minimum_at_center = false;
@@ -175,15 +170,11 @@ MotionVector MotionEstimator::estimate_diamond_search(const uint8_t* current_fra
     
     // Step 2: SDSP for refinement
     for (const auto& [dx, dy] : sdsp) {
-        int search_x = center_x + dx;
-        int search_y = center_y + dy;
-        int ref_x = x + search_x;
-        int ref_y = y + search_y;
+        int search_x = std::clamp(center_x + dx, window.min_x, window.max_x);
+        int search_y = std::clamp(center_y + dy, window.min_y, window.max_y);
         
-        if (!is_within_frame(ref_x, ref_y, width, height)) continue;
-        
-        const uint8_t* ref_block = reference_frame + ref_y * width + ref_x;
-        uint16_t cost = hybrid_cost(current_block, ref_block, width, search_x, search_y);
+        uint16_t cost = hybrid_cost(current_block, current_stride, reference,
+                                    x + search_x, y + search_y, search_x, search_y);
         
         if (cost < best_mv.cost) {
             best_mv = MotionVector(search_x, search_y, cost);
@@ -193,32 +184,32 @@ MotionVector MotionEstimator::estimate_diamond_search(const uint8_t* current_fra
     return best_mv;
 }
 
-MotionVector MotionEstimator::estimate_three_step_search(const uint8_t* current_frame, const uint8_t* reference_frame,
-                                                        int width, int height, int x, int y) {
+MotionVector MotionEstimator::estimate_three_step_search(const uint8_t* current_frame, int current_stride,
+                                                        const ReferencePlane& reference, int x, int y) {
     MotionVector best_mv;
-    const uint8_t* current_block = current_frame + y * width + x;
+    const uint8_t* current_block = current_frame + y * current_stride + x;
+    const SearchWindow window = search_window(reference, x, y);
+    if (window.empty()) return best_mv;
     
     int step_size = 4; // Start with large step
-    int center_x = 0, center_y = 0;
+    int center_x = std::clamp(0, window.min_x, window.max_x);
+    int center_y = std::clamp(0, window.min_y, window.max_y);
     
     // Three steps of search
     for (int step = 0; step < 3; ++step) {
         bool found_better = false;
+        int base_x = center_x, base_y = center_y;
         
         // Search 8 points around current center
         for (int dy = -step_size; dy <= step_size; dy += step_size) {
             for (int dx = -step_size; dx <= step_size; dx += step_size) {
                 if (dx == 0 && dy == 0) continue; // Skip center (already checked)
                 
-                int search_x = center_x + dx;
-                int search_y = center_y + dy;
-                int ref_x = x + search_x;
-                int ref_y = y + search_y;
-                
-                if (!is_within_frame(ref_x, ref_y, width, height)) continue;
+                int search_x = std::clamp(base_x + dx, window.min_x, window.max_x);
+                int search_y = std::clamp(base_y + dy, window.min_y, window.max_y);
                 
-                const uint8_t* ref_block = reference_frame + ref_y * width + ref_x;
-                uint16_t cost = hybrid_cost(current_block, ref_block, width, search_x, search_y);
+                uint16_t cost = hybrid_cost(current_block, current_stride, reference,
+                                            x + search_x, y + search_y, search_x, search_y);
                 
                 if (cost < best_mv.cost) {
                     best_mv = MotionVector(search_x, search_y, cost);
@@ -239,19 +230,20 @@ MotionVector MotionEstimator::estimate_three_step_search(const uint8_t* current_
     return best_mv;
 }
 
-MotionVector MotionEstimator::estimate_adaptive(const uint8_t* current_frame, const uint8_t* reference_frame,
-                                               int width, int height, int x, int y, int prev_mv_x, int prev_mv_y) {
+MotionVector MotionEstimator::estimate_adaptive(const uint8_t* current_frame, int current_stride,
+                                               const ReferencePlane& reference, int x, int y,
+                                               int prev_mv_x, int prev_mv_y) {
     // Adaptive algorithm selection based on content characteristics
+    const uint8_t* current_block = current_frame + y * current_stride + x;
     
     // Check if previous motion vector is a good predictor
     if (prev_mv_x != 0 || prev_mv_y != 0) {
-        int ref_x = x + prev_mv_x;
-        int ref_y = y + prev_mv_y;
+        const SearchWindow window = search_window(reference, x, y);
         
-        if (is_within_frame(ref_x, ref_y, width, height)) {
-            const uint8_t* current_block = current_frame + y * width + x;
-            const uint8_t* ref_block = reference_frame + ref_y * width + ref_x;
-            uint16_t cost = hybrid_cost(current_block, ref_block, width, prev_mv_x, prev_mv_y);
+        if (prev_mv_x >= window.min_x && prev_mv_x <= window.max_x &&
+            prev_mv_y >= window.min_y && prev_mv_y <= window.max_y) {
+            uint16_t cost = hybrid_cost(current_block, current_stride, reference,
+                                        x + prev_mv_x, y + prev_mv_y, prev_mv_x, prev_mv_y);
             
             // If previous MV is good enough, use it
             if (cost < EARLY_TERMINATION_THRESHOLD * 2) {
@@ -261,28 +253,92 @@ MotionVector MotionEstimator::estimate_adaptive(const uint8_t* current_frame, co
     }
     
     // Estimate scene complexity
-    const uint8_t* current_block = current_frame + y * width + x;
-    uint16_t variance = 0;
-    uint16_t mean = 0;
+    uint32_t sum = 0;
+    uint32_t sum_sq = 0;
     
     // Calculate block variance for complexity estimation
-    for (int i = 0; i < BLOCK_SIZE * BLOCK_SIZE; ++i) {
-        mean += current_block[i];
+    for (int i = 0; i < BLOCK_SIZE; ++i) {
+        const uint8_t* row = current_block + i * current_stride;
+        for (int j = 0; j < BLOCK_SIZE; ++j) {
+            sum += row[j];
+            sum_sq += row[j] * row[j];
+        }
     }
-    mean /= BLOCK_SIZE * BLOCK_SIZE;
     
-    for (int i = 0; i < BLOCK_SIZE * BLOCK_SIZE; ++i) {
-        variance += (current_block[i] - mean) * (current_block[i] - mean);
-    }
+    constexpr uint32_t pixels = BLOCK_SIZE * BLOCK_SIZE;
+    uint32_t variance = sum_sq - (sum * sum) / pixels;
     
     // Select algorithm based on complexity
     if (variance < 1000) { // Low complexity - fast search
-        return estimate_three_step_search(current_frame, reference_frame, width, height, x, y);
+        return estimate_three_step_search(current_frame, current_stride, reference, x, y);
     } else if (variance < 10000) { // Medium complexity
-        return estimate_diamond_search(current_frame, reference_frame, width, height, x, y);
+        return estimate_diamond_search(current_frame, current_stride, reference, x, y);
     } else { // High complexity - full search for best quality
-        return estimate_full_search(current_frame, reference_frame, width, height, x, y);
+        return estimate_full_search(current_frame, current_stride, reference, x, y);
+    }
+}
+
+MotionVector MotionEstimator::refine_subpel(const uint8_t* current_frame, int current_stride,
+                                            const HalfPelPlanes& reference, int x, int y,
+                                            const MotionVector& integer_mv) const {
+    if (!integer_mv.valid || !reference.valid()) return integer_mv;
+    
+    // Neighbours of the current best position: 8-connected ring
+    constexpr std::array<std::pair<int, int>, 8> ring = {{
+        {-1, -1}, {0, -1}, {1, -1}, {-1, 0}, {1, 0}, {-1, 1}, {0, 1}, {1, 1}
+    }};
+    
+    // Keep every candidate inside the filtered part of the padded planes
+    const int limit = HalfPelPlanes::PADDING - 8;
+    const int min_qx = -limit * 4, max_qx = (reference.width() - BLOCK_SIZE + limit) * 4;
+    const int min_qy = -limit * 4, max_qy = (reference.height() - BLOCK_SIZE + limit) * 4;
+    // Reference limit: whole-pel columns read the block only, fractional ones the taps too
+    const bool limited = reference_limit_ < NO_REFERENCE_LIMIT;
+    const int max_whole_qx = limited ? (reference_limit_ - BLOCK_SIZE) * 4 : INT_MAX;
+    const int max_fractional_qx = limited ? (reference_limit_ - BLOCK_SIZE - SUBPEL_TAPS_RIGHT) * 4 : INT_MAX;
+    
+    const uint8_t* current_block = current_frame + y * current_stride + x;
+    alignas(32) uint8_t prediction[BLOCK_SIZE * BLOCK_SIZE];
+    
+    auto evaluate = [&](int mvq_x, int mvq_y) -> uint32_t {
+        reference.predict_block(x * 4 + mvq_x, y * 4 + mvq_y, BLOCK_SIZE, BLOCK_SIZE,
+                                prediction, BLOCK_SIZE);
+        uint32_t satd = satd_block(current_block, current_stride, prediction, BLOCK_SIZE,
+                                   BLOCK_SIZE, BLOCK_SIZE);
+        // Same lambda as hybrid_cost, expressed per quarter-pel
+        return satd + ((std::abs(mvq_x) + std::abs(mvq_y)) >> 1);
+    };
+    
+    int best_x = integer_mv.x * 4;
+    int best_y = integer_mv.y * 4;
+    uint32_t best_cost = evaluate(best_x, best_y);
+    
+    // Step 2 = half-pel ring around the integer MV, step 1 = quarter-pel ring around the best half
+    for (int step = 2; step >= 1; --step) {
+        int center_x = best_x, center_y = best_y;
+        
+        for (const auto& [dx, dy] : ring) {
+            int cand_x = center_x + dx * step;
+            int cand_y = center_y + dy * step;
+            int abs_x = x * 4 + cand_x, abs_y = y * 4 + cand_y;
+            
+            if (abs_x < min_qx || abs_x > max_qx || abs_y < min_qy || abs_y > max_qy) continue;
+            if (abs_x > ((abs_x & 3) ? max_fractional_qx : max_whole_qx)) continue;
+            
+            uint32_t cost = evaluate(cand_x, cand_y);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_x = cand_x;
+                best_y = cand_y;
+            }
+        }
     }
+    
+    MotionVector refined(static_cast<int16_t>(best_x >> 2), static_cast<int16_t>(best_y >> 2),
+                         static_cast<uint16_t>(std::min<uint32_t>(best_cost, UINT16_MAX)));
+    refined.frac_x = static_cast<int8_t>(best_x & 3);
+    refined.frac_y = static_cast<int8_t>(best_y & 3);
+    return refined;
 }
 
 } // namespace processing
@@ -0,0 +1,389 @@
+// src/processing/subpel_interpolation.cpp
+#include "streaming/processing/subpel_interpolation.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h> // SIMD instructions
+
+namespace streaming {
+namespace processing {
+
+namespace {
+
+// Filter taps per fractional position; index 3 is the tap on the integer sample
+const SubpelFilter FILTERS[] = {
+    // H.264: half-pel 6-tap, quarter entries only used by interpolate_block (bilinear in ME)
+    {{{{0, 0, 0, 32, 0, 0, 0, 0},
+       {0, 1, -3, 26, 10, -3, 1, 0},
+       {0, 1, -5, 20, 20, -5, 1, 0},
+       {0, 1, -3, 10, 26, -3, 1, 0}}}, 5, 0, true},
+    // HEVC / VVC luma
+    {{{{0, 0, 0, 64, 0, 0, 0, 0},
+       {-1, 4, -10, 58, 17, -5, 1, 0},
+       {-1, 4, -11, 40, 40, -11, 4, -1},
+       {0, 1, -5, 17, 58, -10, 4, -1}}}, 6, 0, false},
+    // AV1 EIGHTTAP (regular)
+    {{{{0, 0, 0, 128, 0, 0, 0, 0},
+       {0, 2, -14, 110, 38, -10, 2, 0},
+       {0, 2, -14, 76, 76, -14, 2, 0},
+       {0, 2, -10, 38, 110, -14, 2, 0}}}, 7, 2, false},
+    // AV1 EIGHTTAP_SMOOTH
+    {{{{0, 0, 0, 128, 0, 0, 0, 0},
+       {0, 0, 20, 60, 42, 6, 0, 0},
+       {0, -2, 14, 52, 52, 14, -2, 0},
+       {0, 0, 6, 42, 60, 20, 0, 0}}}, 7, 2, false},
+    // AV1 EIGHTTAP_SHARP
+    {{{{0, 0, 0, 128, 0, 0, 0, 0},
+       {-4, 10, -22, 116, 38, -14, 6, -2},
+       {-4, 12, -24, 80, 80, -24, 12, -4},
+       {-2, 6, -14, 38, 116, -22, 10, -4}}}, 7, 2, false},
+};
+
+constexpr int MAX_TILE = 64;
+constexpr int TAPS = 8;
+constexpr int TAP_OFFSET = 3;
+
+inline uint8_t clip_pixel(int32_t v) {
+    return static_cast<uint8_t>(std::clamp(v, 0, 255));
+}
+
+inline int32_t round_shift(int32_t v, int shift) {
+    return shift > 0 ? (v + (1 << (shift - 1))) >> shift : v;
+}
+
+// Horizontal pass: dst[i] = sum_k taps[k] * src[i - 3 + k]
+template<typename Out>
+void filter_h_row(const uint8_t* src, Out* dst, int count, const int16_t* taps, int shift) {
+    int i = 0;
+#ifdef __AVX2__
+    const __m256i rounding = _mm256_set1_epi32(shift > 0 ? 1 << (shift - 1) : 0);
+    const __m128i shift_count = _mm_cvtsi32_si128(shift);
+    for (; i + 8 <= count; i += 8) {
+        __m256i acc = rounding;
+        for (int k = 0; k < TAPS; ++k) {
+            if (taps[k] == 0) continue;
+            __m256i px = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i - TAP_OFFSET + k)));
+            acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(px, _mm256_set1_epi32(taps[k])));
+        }
+        acc = _mm256_sra_epi32(acc, shift_count);
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(acc),
+                                        _mm256_extracti128_si256(acc, 1));
+        if constexpr (sizeof(Out) == 1) {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(words, words));
+        } else {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), words);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        int32_t sum = 0;
+        for (int k = 0; k < TAPS; ++k) {
+            sum += taps[k] * src[i - TAP_OFFSET + k];
+        }
+        sum = round_shift(sum, shift);
+        if constexpr (sizeof(Out) == 1) {
+            dst[i] = clip_pixel(sum);
+        } else {
+            dst[i] = static_cast<Out>(sum);
+        }
+    }
+}
+
+// Vertical pass: dst[i] = sum_k taps[k] * src[i + (k - 3) * stride], always producing pixels
+template<typename In>
+void filter_v_row(const In* src, int stride, uint8_t* dst, int count, const int16_t* taps, int shift) {
+    int i = 0;
+#ifdef __AVX2__
+    const __m256i rounding = _mm256_set1_epi32(1 << (shift - 1));
+    const __m128i shift_count = _mm_cvtsi32_si128(shift);
+    for (; i + 8 <= count; i += 8) {
+        __m256i acc = rounding;
+        for (int k = 0; k < TAPS; ++k) {
+            if (taps[k] == 0) continue;
+            const In* row = src + i + (k - TAP_OFFSET) * stride;
+            __m256i px;
+            if constexpr (sizeof(In) == 1) {
+                px = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row)));
+            } else {
+                px = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row)));
+            }
+            acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(px, _mm256_set1_epi32(taps[k])));
+        }
+        acc = _mm256_sra_epi32(acc, shift_count);
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(acc),
+                                        _mm256_extracti128_si256(acc, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(words, words));
+    }
+#endif
+    for (; i < count; ++i) {
+        int32_t sum = 0;
+        for (int k = 0; k < TAPS; ++k) {
+            sum += taps[k] * src[i + (k - TAP_OFFSET) * stride];
+        }
+        dst[i] = clip_pixel(round_shift(sum, shift));
+    }
+}
+
+inline void copy_block(const uint8_t* src, int src_stride, uint8_t* dst, int dst_stride, int w, int h) {
+    for (int y = 0; y < h; ++y) {
+        std::memcpy(dst + y * dst_stride, src + y * src_stride, w);
+    }
+}
+
+} // namespace
+
+const SubpelFilter& get_subpel_filter(SubpelFilterType type) {
+    return FILTERS[static_cast<int>(type)];
+}
+
+void HalfPelPlanes::build(const uint8_t* reference, int stride, int width, int height,
+                          SubpelFilterType type) {
+    type_ = type;
+    width_ = width;
+    height_ = height;
+    stride_ = (width + 2 * PADDING + 63) & ~63; // Cache-line aligned rows
+
+    const size_t plane_size = static_cast<size_t>(stride_) * (height + 2 * PADDING);
+    for (auto& plane : planes_) {
+        plane.assign(plane_size, 0); // No-op reallocation when the size is unchanged
+    }
+
+    extend_full_plane(reference, stride);
+    filter_half_planes();
+}
+
+void HalfPelPlanes::extend_full_plane(const uint8_t* reference, int stride) {
+    uint8_t* full = planes_[FULL].data();
+
+    for (int y = 0; y < height_; ++y) {
+        uint8_t* row = full + (y + PADDING) * stride_;
+        std::memcpy(row + PADDING, reference + y * stride, width_);
+        std::memset(row, row[PADDING], PADDING);
+        std::memset(row + PADDING + width_, row[PADDING + width_ - 1], stride_ - PADDING - width_);
+    }
+
+    const uint8_t* first_row = full + PADDING * stride_;
+    const uint8_t* last_row = full + (PADDING + height_ - 1) * stride_;
+    for (int y = 0; y < PADDING; ++y) {
+        std::memcpy(full + y * stride_, first_row, stride_);
+        std::memcpy(full + (PADDING + height_ + y) * stride_, last_row, stride_);
+    }
+}
+
+void HalfPelPlanes::filter_half_planes() {
+    const SubpelFilter& filter = get_subpel_filter(type_);
+    const int16_t* half = filter.coeffs[2].data();
+
+    // Half-pel samples are produced up to PADDING - MARGIN pixels outside the frame;
+    // the margin keeps every tap inside the extended full plane.
+    constexpr int MARGIN = 4;
+    const int x0 = -(PADDING - MARGIN);
+    const int y0 = -(PADDING - MARGIN);
+    const int count = width_ + 2 * (PADDING - MARGIN);
+    const int rows = height_ + 2 * (PADDING - MARGIN);
+
+    for (int r = 0; r < rows; ++r) {
+        int y = y0 + r;
+        const uint8_t* src = at(FULL, x0, y);
+        filter_h_row(src, const_cast<uint8_t*>(at(HALF_H, x0, y)), count, half, filter.shift);
+        filter_v_row(src, stride_, const_cast<uint8_t*>(at(HALF_V, x0, y)), count, half, filter.shift);
+    }
+
+    // Centre samples: unrounded horizontal intermediates, then vertical filter
+    const int inter_rows = rows + TAPS - 1;
+    intermediate_.resize(static_cast<size_t>(inter_rows) * count);
+    for (int r = 0; r < inter_rows; ++r) {
+        filter_h_row(at(FULL, x0, y0 - TAP_OFFSET + r), intermediate_.data() + r * count,
+                     count, half, filter.intermediate_shift);
+    }
+
+    const int second_shift = 2 * filter.shift - filter.intermediate_shift;
+    for (int r = 0; r < rows; ++r) {
+        filter_v_row(intermediate_.data() + (r + TAP_OFFSET) * count, count,
+                     const_cast<uint8_t*>(at(HALF_HV, x0, y0 + r)), count, half, second_shift);
+    }
+}
+
+namespace {
+
+// Block prediction from the full / half-pel samples returned by plane_at(ex, ey)
+// (positions in 1/4 pel, even; rows `stride` apart)
+template<typename PlaneAt>
+void predict_from_planes(PlaneAt&& plane_at, int stride, int qx, int qy, int block_w, int block_h,
+                         uint8_t* dst, int dst_stride) {
+    const int ix = qx >> 2, fx = qx & 3;
+    const int iy = qy >> 2, fy = qy & 3;
+
+    // H.264 quarter samples: rounded average of the two nearest full/half samples
+    const uint8_t* a;
+    const uint8_t* b;
+    if ((fx & 1) && (fy & 1)) {
+        a = plane_at(4 * ix + 2, 4 * (iy + (fy == 3)));
+        b = plane_at(4 * (ix + (fx == 3)), 4 * iy + 2);
+    } else if (fx & 1) {
+        a = plane_at(qx - 1, qy);
+        b = plane_at(qx + 1, qy);
+    } else {
+        a = plane_at(qx, qy - 1);
+        b = plane_at(qx, qy + 1);
+    }
+
+    for (int y = 0; y < block_h; ++y) {
+        const uint8_t* ra = a + y * stride;
+        const uint8_t* rb = b + y * stride;
+        uint8_t* out = dst + y * dst_stride;
+        int x = 0;
+#ifdef __SSE2__
+        for (; x + 16 <= block_w; x += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ra + x));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rb + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_avg_epu8(va, vb));
+        }
+#endif
+        for (; x < block_w; ++x) {
+            out[x] = static_cast<uint8_t>((ra[x] + rb[x] + 1) >> 1);
+        }
+    }
+}
+
+} // namespace
+
+void HalfPelPlanes::predict_block(int qx, int qy, int block_w, int block_h,
+                                  uint8_t* dst, int dst_stride) const {
+    const int ix = qx >> 2, fx = qx & 3;
+    const int iy = qy >> 2, fy = qy & 3;
+
+    // Even quarter positions are direct reads from the cached planes
+    auto plane_at = [this](int ex, int ey) {
+        Plane plane = static_cast<Plane>(((ex & 2) >> 1) | (ey & 2));
+        return at(plane, ex >> 2, ey >> 2);
+    };
+
+    if ((fx & 1) == 0 && (fy & 1) == 0) {
+        copy_block(plane_at(qx, qy), stride_, dst, dst_stride, block_w, block_h);
+        return;
+    }
+
+    const SubpelFilter& filter = get_subpel_filter(type_);
+    if (!filter.bilinear_quarter) {
+        interpolate_block(at(FULL, ix, iy), stride_, fx, fy, filter, dst, dst_stride, block_w, block_h);
+        return;
+    }
+
+    predict_from_planes(plane_at, stride_, qx, qy, block_w, block_h, dst, dst_stride);
+}
+
+void predict_block_direct(const uint8_t* origin, int stride, SubpelFilterType type, int qx, int qy,
+                          int block_w, int block_h, uint8_t* dst, int dst_stride) {
+    if (block_w > MAX_TILE || block_h > MAX_TILE) {
+        for (int ty = 0; ty < block_h; ty += MAX_TILE) {
+            for (int tx = 0; tx < block_w; tx += MAX_TILE) {
+                predict_block_direct(origin, stride, type, qx + 4 * tx, qy + 4 * ty,
+                                     std::min(MAX_TILE, block_w - tx), std::min(MAX_TILE, block_h - ty),
+                                     dst + ty * dst_stride + tx, dst_stride);
+            }
+        }
+        return;
+    }
+
+    const int ix = qx >> 2, fx = qx & 3;
+    const int iy = qy >> 2, fy = qy & 3;
+    const SubpelFilter& filter = get_subpel_filter(type);
+    if (!filter.bilinear_quarter || ((fx & 1) == 0 && (fy & 1) == 0)) {
+        interpolate_block(origin + iy * stride + ix, stride, fx, fy, filter, dst, dst_stride, block_w, block_h);
+        return;
+    }
+
+    // The half-pel planes' samples for just this block: full / H / V / HV are
+    // interpolate_block at fractions 0 / 2 in each direction, same arithmetic as build()
+    alignas(32) uint8_t tiles[2][MAX_TILE * MAX_TILE];
+    int next_tile = 0;
+    auto plane_at = [&](int ex, int ey) -> const uint8_t* {
+        uint8_t* tile = tiles[next_tile++];
+        interpolate_block(origin + (ey >> 2) * stride + (ex >> 2), stride, ex & 2, ey & 2, filter,
+                          tile, MAX_TILE, block_w, block_h);
+        return tile;
+    };
+    predict_from_planes(plane_at, MAX_TILE, qx, qy, block_w, block_h, dst, dst_stride);
+}
+
+void interpolate_block(const uint8_t* src, int src_stride, int frac_x, int frac_y,
+                       const SubpelFilter& filter, uint8_t* dst, int dst_stride,
+                       int block_w, int block_h) {
+    if (frac_x == 0 && frac_y == 0) {
+        copy_block(src, src_stride, dst, dst_stride, block_w, block_h);
+        return;
+    }
+
+    const int16_t* h_taps = filter.coeffs[frac_x].data();
+    const int16_t* v_taps = filter.coeffs[frac_y].data();
+
+    if (frac_y == 0) {
+        for (int y = 0; y < block_h; ++y) {
+            filter_h_row(src + y * src_stride, dst + y * dst_stride, block_w, h_taps, filter.shift);
+        }
+        return;
+    }
+    if (frac_x == 0) {
+        for (int y = 0; y < block_h; ++y) {
+            filter_v_row(src + y * src_stride, src_stride, dst + y * dst_stride, block_w, v_taps, filter.shift);
+        }
+        return;
+    }
+
+    // 2D case, tiled so the intermediate buffer stays on the stack
+    alignas(32) int16_t tmp[(MAX_TILE + TAPS - 1) * MAX_TILE];
+    const int second_shift = 2 * filter.shift - filter.intermediate_shift;
+
+    for (int ty = 0; ty < block_h; ty += MAX_TILE) {
+        for (int tx = 0; tx < block_w; tx += MAX_TILE) {
+            const int w = std::min(MAX_TILE, block_w - tx);
+            const int h = std::min(MAX_TILE, block_h - ty);
+            const uint8_t* tile = src + ty * src_stride + tx;
+
+            for (int r = 0; r < h + TAPS - 1; ++r) {
+                filter_h_row(tile + (r - TAP_OFFSET) * src_stride, tmp + r * MAX_TILE, w,
+                             h_taps, filter.intermediate_shift);
+            }
+            for (int r = 0; r < h; ++r) {
+                filter_v_row(tmp + (r + TAP_OFFSET) * MAX_TILE, MAX_TILE,
+                             dst + (ty + r) * dst_stride + tx, w, v_taps, second_shift);
+            }
+        }
+    }
+}
+
+uint32_t satd_block(const uint8_t* a, int a_stride, const uint8_t* b, int b_stride,
+                    int block_w, int block_h) {
+    uint32_t satd = 0;
+
+    for (int y = 0; y < block_h; y += 4) {
+        for (int x = 0; x < block_w; x += 4) {
+            int32_t d[4][4];
+            for (int i = 0; i < 4; ++i) {
+                const uint8_t* ra = a + (y + i) * a_stride + x;
+                const uint8_t* rb = b + (y + i) * b_stride + x;
+                int32_t d0 = ra[0] - rb[0], d1 = ra[1] - rb[1];
+                int32_t d2 = ra[2] - rb[2], d3 = ra[3] - rb[3];
+                int32_t s02 = d0 + d2, s13 = d1 + d3;
+                int32_t t02 = d0 - d2, t13 = d1 - d3;
+                d[i][0] = s02 + s13;
+                d[i][1] = t02 + t13;
+                d[i][2] = s02 - s13;
+                d[i][3] = t02 - t13;
+            }
+            for (int j = 0; j < 4; ++j) {
+                int32_t s02 = d[0][j] + d[2][j], s13 = d[1][j] + d[3][j];
+                int32_t t02 = d[0][j] - d[2][j], t13 = d[1][j] - d[3][j];
+                satd += std::abs(s02 + s13) + std::abs(t02 + t13) +
+                        std::abs(s02 - s13) + std::abs(t02 - t13);
+            }
+        }
+    }
+
+    return satd / 2; // Same normalisation as MotionEstimator::calculate_satd
+}
+
+} // namespace processing
+} // namespace streaming
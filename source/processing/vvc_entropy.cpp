@@ -1,63 +1,192 @@
 // src/processing/vvc_entropy.cpp
 #include "streaming/processing/vvc_entropy.hpp"
+#include <algorithm>
 
 namespace streaming {
 namespace processing {
 
-VVCCABACEncoder::VVCCABACEncoder() {
-    // Initialize VVC context models
-    mtt_split_ctx_.resize(6);
-    pred_mode_ctx_.resize(10);
-    affine_flag_ctx_.resize(2);
-    mip_flag_ctx_.resize(2);
+namespace {
+
+// Binarisations shared by VVCCABACEncoder and VVCRateEstimator: `Coder` provides
+// encode_bin() and encode_bypass_bins()
+
+template <typename Coder>
+void code_mtt_split(Coder& coder, VVCCABACEncoder::ContextSet& contexts, codec::VVCPartitionType split_type) {
+    // split_cu_flag, split_qt_flag, mtt_split_cu_vertical_flag, mtt_split_cu_binary_flag
+    if (split_type == codec::VVCPartitionType::NO_SPLIT) {
+        coder.encode_bin(0, contexts.mtt_split[0]);
+        return;
+    }
+    
+    coder.encode_bin(1, contexts.mtt_split[0]);
     
-    // Initialize with default probabilities
-    for (auto& ctx : mtt_split_ctx_) {
-        ctx.state = 63;
-        ctx.mps = 0;
-        ctx.count = 0;
+    if (split_type == codec::VVCPartitionType::QT_SPLIT) {
+        coder.encode_bin(1, contexts.mtt_split[1]);
+        return;
     }
+    
+    coder.encode_bin(0, contexts.mtt_split[1]);
+    
+    bool vertical = split_type == codec::VVCPartitionType::BT_VERT_SPLIT ||
+                    split_type == codec::VVCPartitionType::TT_VERT_SPLIT;
+    bool binary = split_type == codec::VVCPartitionType::BT_HORZ_SPLIT ||
+                  split_type == codec::VVCPartitionType::BT_VERT_SPLIT;
+    
+    coder.encode_bin(vertical ? 1 : 0, contexts.mtt_split[2]);
+    coder.encode_bin(binary ? 1 : 0, contexts.mtt_split[3]);
 }
 
-void VVCCABACEncoder::encode_mtt_split(utils::BitstreamWriter& writer, VVCPartitionType split_type) {
-    uint32_t symbol = static_cast<uint32_t>(split_type);
+template <typename Coder>
+void code_pred_mode(Coder& coder, VVCCABACEncoder::ContextSet& contexts, codec::VVCPredictionMode mode) {
+    // Truncated unary over the prediction modes, one context per bin
+    const uint32_t symbol = static_cast<uint32_t>(mode);
+    const uint32_t max_symbol = static_cast<uint32_t>(codec::VVCPredictionMode::GPM);
+    auto& bins = contexts.pred_mode;
     
-    // Complex MTT split encoding with context modeling
-    if (symbol == 0) { // NO_SPLIT
-        encode_bin(writer, 0, mtt_split_ctx_[0]);
-    } else {
-        encode_bin(writer, 1, mtt_split_ctx_[0]);
-        
-        if (symbol == 1) { // QT_SPLIT
-            encode_bin(writer, 0, mtt_split_ctx_[1]);
-        } else {
-            encode_bin(writer, 1, mtt_split_ctx_[1]);
-            
-            // Encode BT/TT types...
-        }
+    for (uint32_t i = 0; i < symbol; ++i) {
+        coder.encode_bin(1, bins[std::min<size_t>(i, bins.size() - 1)]);
+    }
+    if (symbol < max_symbol) {
+        coder.encode_bin(0, bins[std::min<size_t>(symbol, bins.size() - 1)]);
     }
 }
 
-void VVCCABACEncoder::encode_bin(utils::BitstreamWriter& writer, uint32_t bin, VVCContextModel& ctx) {
-    // VVC CABAC encoding - daha gelişmiş context modeling
-    uint32_t range = ctx.state * 4;
-    uint32_t offset = 0;
+template <typename Coder>
+void code_intra_luma_mode(Coder& coder, VVCCABACEncoder::ContextSet& contexts, int mode, const int mpm[6]) {
+    int index = -1;
+    for (int i = 0; i < 6; ++i) {
+        if (mpm[i] == mode) {
+            index = i;
+            break;
+        }
+    }
     
-    if (bin == ctx.mps) {
-        // Encode MPS
-        offset = range;
-        // Update state for MPS
-        if (ctx.state > 0) ctx.state--;
-    } else {
-        // Encode LPS
-        offset = 1024 - range; // Range is 10-bit in VVC
-        // Update state for LPS
-        ctx.state = (ctx.state < 63) ? ctx.state + 1 : 63;
-        ctx.mps = 1 - ctx.mps; // Toggle MPS if needed
+    coder.encode_bin(index >= 0 ? 1 : 0, contexts.intra_luma_mpm);
+    if (index >= 0) {
+        coder.encode_bin(index > 0 ? 1 : 0, contexts.intra_luma_not_planar);
+        // intra_luma_mpm_idx: truncated rice (cMax 4) over mpm[1..5], bypass
+        if (index > 0) {
+            const int ones = index - 1;
+            if (index < 5) {
+                coder.encode_bypass_bins(((1u << ones) - 1) << 1, ones + 1);
+            } else {
+                coder.encode_bypass_bins((1u << ones) - 1, ones);
+            }
+        }
+        return;
     }
     
-    writer.write_bits(offset, 10);
+    // The remainder counts the modes below `mode` that are not in the list
+    int remainder = mode;
+    for (int i = 0; i < 6; ++i) {
+        if (mpm[i] < mode) remainder--;
+    }
+    // Truncated binary over 61 values: the first 3 take 5 bits, the rest 6
+    if (remainder < 3) {
+        coder.encode_bypass_bins(static_cast<uint32_t>(remainder), 5);
+    } else {
+        coder.encode_bypass_bins(static_cast<uint32_t>(remainder + 3), 6);
+    }
+}
+
+} // namespace
+
+void VVCCABACEncoder::ContextModel::init(uint8_t init_value, uint8_t shift_idx, int qp) {
+    // 9.3.2.2: linear model in QP, both estimates start from the same probability
+    const int slope = (init_value >> 3) - 4;
+    const int offset = (init_value & 7) * 18 + 1;
+    const int pre_state = std::clamp(((slope * (std::clamp(qp, 0, 63) - 16)) >> 1) + offset, 1, 127);
+    state0 = static_cast<uint16_t>(pre_state << 3);
+    state1 = static_cast<uint16_t>(pre_state << 7);
+    shift0 = static_cast<uint8_t>((shift_idx >> 2) + 2);
+    shift1 = static_cast<uint8_t>((shift_idx & 3) + 3 + shift0);
+}
+
+void VVCCABACEncoder::ContextSet::init(int qp) {
+    // The syntax is simplified, so every context starts at CNU (35, p(1) about 0.43) with
+    // shiftIdx 5: adaptation windows of 8 and 128 bins
+    constexpr uint8_t CNU = 35, SHIFT_IDX = 5;
+    for (auto& ctx : mtt_split) {
+        ctx.init(CNU, SHIFT_IDX, qp);
+    }
+    for (auto& ctx : pred_mode) {
+        ctx.init(CNU, SHIFT_IDX, qp);
+    }
+    for (auto* ctx : {&affine_flag, &mip_flag, &ibc_flag, &cbf, &intra_luma_mpm, &intra_luma_not_planar}) {
+        ctx->init(CNU, SHIFT_IDX, qp);
+    }
+}
+
+void VVCCABACEncoder::init_encoder(utils::BitstreamWriter& writer, int qp) {
+    engine_.init_encoder(writer);
+    contexts_.init(qp);
+}
+
+void VVCCABACEncoder::encode_mtt_split(codec::VVCPartitionType split_type) {
+    code_mtt_split(*this, contexts_, split_type);
+}
+
+void VVCCABACEncoder::encode_pred_mode(codec::VVCPredictionMode mode) {
+    code_pred_mode(*this, contexts_, mode);
+}
+
+void VVCCABACEncoder::encode_affine_flag(bool is_affine) {
+    encode_bin(is_affine ? 1 : 0, contexts_.affine_flag);
+}
+
+void VVCCABACEncoder::encode_mip_flag(bool use_mip) {
+    encode_bin(use_mip ? 1 : 0, contexts_.mip_flag);
+}
+
+void VVCCABACEncoder::encode_ibc_flag(bool use_ibc) {
+    encode_bin(use_ibc ? 1 : 0, contexts_.ibc_flag);
+}
+
+void VVCCABACEncoder::encode_gpm_info(int partition_idx, int angle) {
+    // merge_gpm_partition_idx is a 6-bit bypass value; the angle follows from it
+    (void)angle;
+    engine_.encode_bypass_bins(static_cast<uint32_t>(partition_idx) & 63, 6);
+}
+
+void VVCCABACEncoder::encode_bdpcm_dir(int direction) {
+    engine_.encode_bypass(direction != 0);
+}
+
+void VVCCABACEncoder::encode_cbf(bool coded) {
+    encode_bin(coded ? 1 : 0, contexts_.cbf);
+}
+
+void VVCCABACEncoder::encode_intra_luma_mode(int mode, const int mpm[6]) {
+    code_intra_luma_mode(*this, contexts_, mode, mpm);
+}
+
+void VVCCABACEncoder::finish_substream() {
+    engine_.encode_terminator(true);
+    engine_.flush_encoder();
+}
+
+void VVCCABACEncoder::encode_bin(uint32_t bin, ContextModel& ctx) {
+    // 9.3.4.3.2: the LPS range from the averaged 15-bit probability, then both estimates
+    // move towards the bin at their own rate
+    const uint32_t state = ctx.probability();
+    const uint32_t mps = state >> 14;
+    const uint32_t lps_probability = (mps ? 32767 - state : state) >> 9;
+    const uint32_t lps_range = (((engine_.range() >> 5) * lps_probability) >> 1) + 4;
+    engine_.encode_decision(lps_range, bin == mps);
+    ctx.update(bin);
+}
+
+void VVCRateEstimator::encode_mtt_split(codec::VVCPartitionType split_type) {
+    code_mtt_split(*this, contexts_, split_type);
+}
+
+void VVCRateEstimator::encode_pred_mode(codec::VVCPredictionMode mode) {
+    code_pred_mode(*this, contexts_, mode);
+}
+
+void VVCRateEstimator::encode_intra_luma_mode(int mode, const int mpm[6]) {
+    code_intra_luma_mode(*this, contexts_, mode, mpm);
 }
 
 } // namespace processing
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming
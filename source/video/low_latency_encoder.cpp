@@ -1,119 +1,229 @@
 // src/video/low_latency_encoder.cpp
 #include "streaming/video/low_latency_encoder.hpp"
+#include "streaming/codec/rate_control.hpp"
+#include <algorithm>
 #include <chrono>
+#include <iostream>
 
 namespace streaming {
 namespace video {
 
-LowLatencyEncoder::LowLatencyEncoder() {
-    last_frame_time_ = std::chrono::high_resolution_clock::now();
+namespace {
+
+// Average encode time, relative to the budget, above which the encoder is sped up
+// (headroom for jitter) and below which it may slow down again
+constexpr double SPEED_UP_RATIO = 0.9;
+constexpr double SLOW_DOWN_RATIO = 0.6;
+constexpr uint32_t SLOW_DOWN_FRAMES = 8;  // Consecutive relaxed frames per step back
+constexpr uint32_t SETTLE_FRAMES = 2;     // Frames a step gets to show in the average
+constexpr int QP_BOOST_STEP = 2;
+
+} // namespace
+
+LowLatencyEncoder::LowLatencyEncoder() = default;
+
+LowLatencyEncoder::~LowLatencyEncoder() {
+    restore_encoder_settings();
 }
 
-bool LowLatencyEncoder::initialize(const LowLatencyConfig& config) {
+bool LowLatencyEncoder::initialize(std::shared_ptr<codec::IVideoEncoder> encoder, const LowLatencyConfig& config) {
+    if (!encoder) {
+        std::cerr << "❌ LowLatencyEncoder: no encoder" << std::endl;
+        return false;
+    }
+    if (config.max_encoding_time_ms == 0) {
+        std::cerr << "❌ LowLatencyEncoder: max encoding time must be positive" << std::endl;
+        return false;
+    }
+
+    restore_encoder_settings(); // Initialized before with another encoder
+
     config_ = config;
-    
+    config_.max_speed_preset = std::clamp(config_.max_speed_preset, 0, 9);
+    config_.speed_preset = std::clamp(config_.speed_preset, 0, config_.max_speed_preset);
+    config_.max_qp_boost = std::max(0, config_.max_qp_boost);
+    encoder_ = std::move(encoder);
+
     if (config_.max_encoding_time_ms < 5) {
         std::cerr << "⚠️ Warning: Very low encoding time may affect quality" << std::endl;
     }
-    
+
     apply_low_latency_presets();
-    
+    if (slice_output_) {
+        early_slices_ = encoder_->set_slice_output(slice_output_);
+    }
+
     std::cout << "🚀 LowLatencyEncoder initialized:" << std::endl;
     std::cout << "   Max encoding time: " << config_.max_encoding_time_ms << "ms" << std::endl;
     std::cout << "   Target frame size: " << config_.target_frame_size_ms << "ms" << std::endl;
     std::cout << "   Frame dropping: " << (config_.enable_frame_dropping ? "enabled" : "disabled") << std::endl;
-    
+
     return true;
 }
 
-bool LowLatencyEncoder::encode_frame_low_latency(const VideoFrame& input, 
+void LowLatencyEncoder::set_slice_output(codec::IVideoEncoder::SliceOutput output) {
+    slice_output_ = std::move(output);
+    early_slices_ = encoder_ && encoder_->set_slice_output(slice_output_);
+}
+
+bool LowLatencyEncoder::encode_frame_low_latency(const codec::VideoFrame& input,
                                                 std::vector<uint8_t>& output,
                                                 bool& frame_dropped) {
-    auto start_time = std::chrono::high_resolution_clock::now();
-    
-    // Check if we should drop this frame to maintain latency
-    if (config_.enable_frame_dropping && 
-        should_drop_frame(input, config_.max_encoding_time_ms)) {
+    frame_dropped = false;
+    if (!encoder_) {
+        std::cerr << "❌ LowLatencyEncoder: not initialized" << std::endl;
+        return false;
+    }
+
+    const double budget_ms = config_.max_encoding_time_ms;
+
+    // Behind schedule: skipping this frame frees its whole slot
+    if (should_drop_frame(input)) {
         frame_dropped = true;
+        output.clear();
         consecutive_dropped_frames_++;
+        stats_.dropped++;
+        late_ms_ = std::max(0.0, late_ms_ - budget_ms);
+        return true;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    if (!encoder_->encode_frame(input, output)) {
         return false;
     }
-    
-    frame_dropped = false;
-    
-    // Estimate encoding time based on frame complexity
-    double estimated_time = estimate_encoding_time(input);
-    if (estimated_time > config_.max_encoding_time_ms * 1.5) {
-        // Frame too complex - apply aggressive optimization
-        apply_emergency_optimizations(input);
+    const double encoding_time = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_time).count();
+
+    if (slice_output_ && !early_slices_) {
+        slice_output_(output.data(), output.size());
     }
-    
-    // ACTUAL ENCODING WOULD HAPPEN HERE
-    // Simulate encoding with controlled time
-    std::this_thread::sleep_for(
-        std::chrono::microseconds(static_cast<int>(config_.max_encoding_time_ms * 100))
-    );
-    
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto encoding_time = std::chrono::duration_cast<std::chrono::microseconds>(
-        end_time - start_time).count() / 1000.0;
-    
+
     current_encoding_time_ms_ = encoding_time;
-    
-    // Update statistics
-    if (encoding_time > config_.max_encoding_time_ms) {
-        std::cout << "⚠️ Encoding time exceeded: " << encoding_time << "ms" << std::endl;
+    consecutive_dropped_frames_ = 0;
+    stats_.frames++;
+    if (encoding_time > budget_ms) {
+        stats_.deadline_misses++;
+    }
+    late_ms_ = std::max(0.0, late_ms_ + encoding_time - budget_ms);
+
+    // Keyframes cost several P frames: they count towards being late, but are no reason
+    // to change the preset for the frames after them
+    if (!encoder_->rate_control().is_keyframe()) {
         adaptive_quantization_control(encoding_time);
     }
-    
+
     return true;
 }
 
-bool LowLatencyEncoder::should_drop_frame(const VideoFrame& frame, double max_time_ms) {
-    auto current_time = std::chrono::high_resolution_clock::now();
-    auto time_since_last_frame = std::chrono::duration_cast<std::chrono::milliseconds>(
-        current_time - last_frame_time_).count();
-    
-    // Drop frame if we're behind schedule
-    if (time_since_last_frame > config_.target_frame_size_ms * 1.5) {
-        return true;
-    }
-    
-    // Drop frame if we've been dropping too many consecutively
-    if (consecutive_dropped_frames_ > 5) {
-        return false; // Force encode to maintain quality
-    }
-    
-    // Estimate complexity-based dropping
-    double complexity = estimate_frame_complexity(frame);
-    double estimated_time = complexity * 0.1; // Empirical factor
-    
-    return estimated_time > max_time_ms;
+bool LowLatencyEncoder::should_drop_frame(const codec::VideoFrame& frame) const {
+    return config_.enable_frame_dropping &&
+           stats_.frames > 0 && !frame.keyframe &&
+           late_ms_ >= config_.max_encoding_time_ms &&
+           consecutive_dropped_frames_ < config_.max_consecutive_drops;
 }
 
 void LowLatencyEncoder::adaptive_quantization_control(double current_latency_ms) {
-    // Dynamically adjust QP based on latency
-    double latency_ratio = current_latency_ms / config_.max_encoding_time_ms;
-    
-    if (latency_ratio > 2.0) {
-        // Emergency mode - aggressive QP increase
-        increase_qp(10);
-    } else if (latency_ratio > 1.5) {
-        increase_qp(5);
-    } else if (latency_ratio < 0.5) {
-        // We have extra time - improve quality
-        decrease_qp(2);
+    const double budget_ms = config_.max_encoding_time_ms;
+    average_encode_ms_ = average_encode_ms_ > 0.0 ? 0.7 * average_encode_ms_ + 0.3 * current_latency_ms
+                                                   : current_latency_ms;
+
+    if (hold_frames_ > 0) {
+        hold_frames_--;
+        return;
+    }
+
+    if (average_encode_ms_ > budget_ms * SPEED_UP_RATIO) {
+        // Faster search first, coarser quantization (fewer coefficients to code) after
+        relaxed_frames_ = 0;
+        if (has_speed_presets_ && speed_preset_ < config_.max_speed_preset) {
+            encoder_->set_speed_preset(++speed_preset_);
+        } else if (qp_boost_ < config_.max_qp_boost) {
+            qp_boost_ = std::min(qp_boost_ + QP_BOOST_STEP, config_.max_qp_boost);
+            apply_qp_boost();
+        } else {
+            return;
+        }
+        hold_frames_ = SETTLE_FRAMES;
+    } else if (average_encode_ms_ < budget_ms * SLOW_DOWN_RATIO) {
+        // Quality back in the reverse order, one step per run of relaxed frames
+        if (++relaxed_frames_ < SLOW_DOWN_FRAMES) {
+            return;
+        }
+        relaxed_frames_ = 0;
+        if (qp_boost_ > 0) {
+            qp_boost_ = std::max(0, qp_boost_ - QP_BOOST_STEP);
+            apply_qp_boost();
+        } else if (speed_preset_ > config_.speed_preset) {
+            encoder_->set_speed_preset(--speed_preset_);
+        }
+    } else {
+        relaxed_frames_ = 0;
     }
 }
 
 void LowLatencyEncoder::apply_low_latency_presets() {
-    // Ultra-low latency optimizations
-    config_.lookahead_frames = 0;          // No B-frames
-    config_.enable_parallel_encoding = false; // Sequential processing
-    
-    // Encoding tools that increase latency
-    disable_high_latency_features();
+    previous_rate_control_ = encoder_->rate_control().config();
+    previous_intra_refresh_period_ = encoder_->intra_refresh_period();
+    previous_speed_preset_ = encoder_->speed_preset();
+
+    // Ultra-low latency: no lookahead delay, and a VBV that keeps every frame short
+    // enough to be sent within target_frame_size_ms (but never below one average frame)
+    codec::RateControlConfig rc_config = previous_rate_control_;
+    rc_config.mode = codec::RateControlMode::CBR;
+    rc_config.lookahead_frames = config_.lookahead_frames;
+    const double frame_ms = std::max<double>(config_.target_frame_size_ms, 1000.0 / rc_config.fps);
+    rc_config.vbv_buffer_size = static_cast<uint32_t>(rc_config.bitrate * frame_ms / 1000.0);
+    encoder_->set_rate_control(rc_config);
+    
+    // A keyframe does not fit such a buffer at a sensible QP; intra refresh spreads it
+    if (config_.intra_refresh_period > 0 && !encoder_->set_intra_refresh(config_.intra_refresh_period)) {
+        std::cerr << "⚠️ Warning: encoder has no intra refresh, keeping keyframes" << std::endl;
+    }
+
+    base_min_qp_ = encoder_->rate_control().config().min_qp;
+    qp_boost_ = 0;
+    speed_preset_ = config_.speed_preset;
+    has_speed_presets_ = encoder_->set_speed_preset(speed_preset_);
+
+    average_encode_ms_ = 0.0;
+    late_ms_ = 0.0;
+    hold_frames_ = 0;
+    relaxed_frames_ = 0;
+    consecutive_dropped_frames_ = 0;
+    stats_ = Stats();
+}
+
+void LowLatencyEncoder::restore_encoder_settings() {
+    if (!encoder_) return;
+
+    // The encoder may outlive the wrapper (shared, pooled): it must not call into it
+    if (early_slices_) {
+        encoder_->set_slice_output({});
+        early_slices_ = false;
+    }
+    encoder_->set_rate_control(previous_rate_control_);
+    if (config_.intra_refresh_period > 0) {
+        encoder_->set_intra_refresh(previous_intra_refresh_period_);
+    }
+    if (has_speed_presets_ && previous_speed_preset_ >= 0) {
+        encoder_->set_speed_preset(previous_speed_preset_);
+    }
+    encoder_.reset();
+}
+
+void LowLatencyEncoder::apply_qp_boost() {
+    codec::RateController& rate_control = encoder_->rate_control();
+    const int max_qp = rate_control.config().max_qp;
+    rate_control.set_qp_range(std::min(base_min_qp_ + qp_boost_, max_qp), max_qp);
+}
+
+LowLatencyEncoder::Stats LowLatencyEncoder::stats() const {
+    Stats stats = stats_;
+    stats.average_encode_ms = average_encode_ms_;
+    stats.speed_preset = speed_preset_;
+    stats.qp_boost = qp_boost_;
+    return stats;
 }
 
 } // namespace video
-} // namespace streaming
\ No newline at end of file
+} // namespace streaming